@@ -0,0 +1,337 @@
+/*
+ * Helpers of papi_bench: timing, percentiles, pinned threads, running
+ * a benchmark in a child process and the JSON report.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "papi.h"
+#include "bench_utils.h"
+
+int bench_quiet = 0;
+
+/* Results so far, and in a child the pipe they go to instead */
+static bench_result_t *results;
+static int num_results;
+static int result_pipe = -1;
+
+static __thread int bench_went;
+
+long long
+bench_now_ns( void )
+{
+	struct timespec t;
+
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return ( long long ) t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+int
+bench_num_cpus( void )
+{
+	long n = sysconf( _SC_NPROCESSORS_ONLN );
+
+	return n > 0 ? ( int ) n : 1;
+}
+
+/* Pin the calling thread to one cpu */
+int
+bench_pin( int cpu )
+{
+	cpu_set_t set;
+
+	CPU_ZERO( &set );
+	CPU_SET( cpu, &set );
+	return pthread_setaffinity_np( pthread_self(  ), sizeof ( set ), &set );
+}
+
+static int
+compare_ll( const void *a, const void *b )
+{
+	long long x = *( const long long * ) a, y = *( const long long * ) b;
+
+	return ( x > y ) - ( x < y );
+}
+
+/* Fill the distribution of r from n samples, which get sorted */
+void
+bench_stats( bench_result_t * r, long long *samples, long long n,
+			 long long elapsed_ns )
+{
+	long long i;
+	double sum = 0;
+
+	r->samples = n;
+	if ( n == 0 )
+		return;
+
+	qsort( samples, ( size_t ) n, sizeof ( long long ), compare_ll );
+	for ( i = 0; i < n; i++ )
+		sum += ( double ) samples[i];
+
+	r->min_ns = samples[0];
+	r->p50_ns = samples[( n - 1 ) * 50 / 100];
+	r->p99_ns = samples[( n - 1 ) * 99 / 100];
+	r->p999_ns = samples[( n - 1 ) * 999 / 1000];
+	r->max_ns = samples[n - 1];
+	r->mean_ns = sum / ( double ) n;
+	/* one after the other if the time of the whole run is not known */
+	if ( elapsed_ns <= 0 )
+		elapsed_ns = ( long long ) sum;
+	r->ops_per_sec = elapsed_ns > 0 ? ( double ) n * 1e9 / ( double ) elapsed_ns : 0;
+}
+
+void
+bench_header( void )
+{
+	if ( bench_quiet )
+		return;
+	printf( "%-16s %-14s %6s %7s %9s %8s %8s %8s %9s %12s\n",
+			"benchmark", "mode", "events", "threads", "samples",
+			"p50 ns", "p99 ns", "p999 ns", "max ns", "ops/s" );
+}
+
+/* Record a result, in a child by passing it up to the parent */
+void
+bench_add( const bench_result_t * r )
+{
+	bench_result_t *more;
+
+	if ( result_pipe >= 0 ) {
+		if ( write( result_pipe, r, sizeof ( *r ) ) != sizeof ( *r ) )
+			perror( "papi_bench: write" );
+		return;
+	}
+
+	more = realloc( results, ( size_t ) ( num_results + 1 ) * sizeof ( *r ) );
+	if ( more == NULL ) {
+		fprintf( stderr, "papi_bench: out of memory\n" );
+		return;
+	}
+	results = more;
+	results[num_results++] = *r;
+
+	if ( !bench_quiet ) {
+		printf( "%-16s %-14s %6d %7d %9lld %8lld %8lld %8lld %9lld %12.0f\n",
+				r->name, r->mode, r->events, r->threads, r->samples,
+				r->p50_ns, r->p99_ns, r->p999_ns, r->max_ns, r->ops_per_sec );
+		fflush( stdout );
+	}
+}
+
+/* Wait for the other threads, then start timing */
+void
+bench_go( bench_threads_t * bt )
+{
+	long long now;
+
+	bench_went = 1;
+	pthread_barrier_wait( &bt->barrier );
+	now = bench_now_ns(  );
+	pthread_mutex_lock( &bt->lock );
+	if ( bt->start_ns == 0 || now < bt->start_ns )
+		bt->start_ns = now;
+	pthread_mutex_unlock( &bt->lock );
+}
+
+void
+bench_done( bench_threads_t * bt )
+{
+	long long now = bench_now_ns(  );
+
+	pthread_mutex_lock( &bt->lock );
+	if ( now > bt->end_ns )
+		bt->end_ns = now;
+	pthread_mutex_unlock( &bt->lock );
+}
+
+typedef struct
+{
+	bench_threads_t *bt;
+	bench_thread_fn fn;
+	int thread;
+	long long *samples;
+	int retval;
+} bench_thread_t;
+
+static void *
+bench_thread( void *arg )
+{
+	bench_thread_t *t = arg;
+
+	bench_pin( t->thread % bench_num_cpus(  ) );
+	bench_went = 0;
+	t->retval = t->fn( t->bt, t->thread, t->samples );
+	/* do not leave the others waiting for a thread that failed */
+	if ( !bench_went )
+		pthread_barrier_wait( &t->bt->barrier );
+
+	return NULL;
+}
+
+/*
+ * Run fn in nthreads threads pinned round robin to the cpus, each
+ * taking iters samples, and fill r with the distribution of all of
+ * them. Returns the first error of a thread, if any.
+ */
+int
+bench_threads( int nthreads, long long iters, bench_thread_fn fn,
+			   void *arg, bench_result_t * r )
+{
+	bench_threads_t bt;
+	bench_thread_t *t;
+	pthread_t *tid;
+	long long *samples;
+	int i, retval = PAPI_OK;
+
+	samples = calloc( ( size_t ) ( nthreads * iters ), sizeof ( long long ) );
+	t = calloc( ( size_t ) nthreads, sizeof ( *t ) );
+	tid = calloc( ( size_t ) nthreads, sizeof ( *tid ) );
+	if ( samples == NULL || t == NULL || tid == NULL ) {
+		free( samples );
+		free( t );
+		free( tid );
+		return PAPI_ENOMEM;
+	}
+
+	memset( &bt, 0, sizeof ( bt ) );
+	bt.arg = arg;
+	bt.nthreads = nthreads;
+	bt.iters = iters;
+	pthread_barrier_init( &bt.barrier, NULL, ( unsigned ) nthreads );
+	pthread_mutex_init( &bt.lock, NULL );
+
+	for ( i = 0; i < nthreads; i++ ) {
+		t[i].bt = &bt;
+		t[i].fn = fn;
+		t[i].thread = i;
+		t[i].samples = samples + i * iters;
+		pthread_create( &tid[i], NULL, bench_thread, &t[i] );
+	}
+	for ( i = 0; i < nthreads; i++ ) {
+		pthread_join( tid[i], NULL );
+		if ( retval == PAPI_OK && t[i].retval != PAPI_OK )
+			retval = t[i].retval;
+	}
+
+	if ( retval == PAPI_OK ) {
+		r->threads = nthreads;
+		bench_stats( r, samples, nthreads * iters, bt.end_ns - bt.start_ns );
+	}
+
+	pthread_barrier_destroy( &bt.barrier );
+	pthread_mutex_destroy( &bt.lock );
+	free( samples );
+	free( t );
+	free( tid );
+
+	return retval;
+}
+
+/*
+ * Run fn in a child process, so that it starts from an uninitialized
+ * library and whatever it leaves behind, including high-level output
+ * at exit, goes with the child. Its results are collected here.
+ */
+int
+bench_fork( void ( *fn ) ( void * ), void *arg )
+{
+	bench_result_t r;
+	int fd[2], status;
+	pid_t pid;
+
+	fflush( stdout );
+	if ( pipe( fd ) != 0 )
+		return PAPI_ESYS;
+
+	pid = fork(  );
+	if ( pid < 0 ) {
+		close( fd[0] );
+		close( fd[1] );
+		return PAPI_ESYS;
+	}
+	if ( pid == 0 ) {
+		close( fd[0] );
+		result_pipe = fd[1];
+		fn( arg );
+		fflush( stdout );
+		fflush( stderr );
+		_exit( 0 );
+	}
+
+	close( fd[1] );
+	while ( read( fd[0], &r, sizeof ( r ) ) == sizeof ( r ) )
+		bench_add( &r );
+	close( fd[0] );
+
+	if ( waitpid( pid, &status, 0 ) != pid || !WIFEXITED( status ) ||
+		 WEXITSTATUS( status ) != 0 ) {
+		fprintf( stderr, "papi_bench: benchmark child failed\n" );
+		return PAPI_ESYS;
+	}
+
+	return PAPI_OK;
+}
+
+static void
+json_string( FILE * f, const char *s )
+{
+	fputc( '"', f );
+	for ( ; *s; s++ ) {
+		if ( *s == '"' || *s == '\\' )
+			fputc( '\\', f );
+		if ( ( unsigned char ) *s >= ' ' )
+			fputc( *s, f );
+	}
+	fputc( '"', f );
+}
+
+int
+bench_write_json( const char *file, const char *cpu_model, int iters )
+{
+	FILE *f;
+	int i;
+
+	f = fopen( file, "w" );
+	if ( f == NULL ) {
+		perror( file );
+		return PAPI_ESYS;
+	}
+
+	fprintf( f, "{\n  \"papi_version\": \"%d.%d.%d.%d\",\n",
+			 PAPI_VERSION_MAJOR( PAPI_VERSION ),
+			 PAPI_VERSION_MINOR( PAPI_VERSION ),
+			 PAPI_VERSION_REVISION( PAPI_VERSION ),
+			 PAPI_VERSION_INCREMENT( PAPI_VERSION ) );
+	fprintf( f, "  \"cpu_model\": " );
+	json_string( f, cpu_model );
+	fprintf( f, ",\n  \"cpus\": %d,\n  \"iterations\": %d,\n  \"results\": [",
+			 bench_num_cpus(  ), iters );
+
+	for ( i = 0; i < num_results; i++ ) {
+		fprintf( f, "%s\n    {\"name\": ", i ? "," : "" );
+		json_string( f, results[i].name );
+		fprintf( f, ", \"mode\": " );
+		json_string( f, results[i].mode );
+		fprintf( f, ", \"events\": %d, \"threads\": %d, \"samples\": %lld, "
+				 "\"min_ns\": %lld, \"p50_ns\": %lld, \"p99_ns\": %lld, "
+				 "\"p999_ns\": %lld, \"max_ns\": %lld, \"mean_ns\": %.1f, "
+				 "\"ops_per_sec\": %.1f}",
+				 results[i].events, results[i].threads, results[i].samples,
+				 results[i].min_ns, results[i].p50_ns, results[i].p99_ns,
+				 results[i].p999_ns, results[i].max_ns, results[i].mean_ns,
+				 results[i].ops_per_sec );
+	}
+	fprintf( f, "\n  ]\n}\n" );
+
+	return fclose( f ) == 0 ? PAPI_OK : PAPI_ESYS;
+}
@@ -0,0 +1,53 @@
+#ifndef __PAPI_BENCH_UTILS_H__
+#define __PAPI_BENCH_UTILS_H__
+
+#include <pthread.h>
+
+/* One line of the report: the latency distribution of one operation */
+typedef struct
+{
+	char name[32];				/* operation, e.g. "read" */
+	char mode[32];				/* variant, e.g. "rdpmc", "multiplex" */
+	int events;					/* events in the EventSet, 0 if none */
+	int threads;				/* pinned threads running it at once */
+	long long samples;
+	long long min_ns, p50_ns, p99_ns, p999_ns, max_ns;
+	double mean_ns;
+	double ops_per_sec;			/* over all threads */
+} bench_result_t;
+
+/* Shared by the threads of one run of bench_threads() */
+typedef struct bench_threads
+{
+	void *arg;
+	int nthreads;
+	long long iters;			/* samples per thread */
+	pthread_barrier_t barrier;
+	long long start_ns, end_ns;
+	pthread_mutex_t lock;
+} bench_threads_t;
+
+/* Set up, call bench_go(), fill samples[0..iters), call bench_done() */
+typedef int ( *bench_thread_fn ) ( bench_threads_t * bt, int thread,
+								   long long *samples );
+
+extern int bench_quiet;
+
+long long bench_now_ns( void );
+int bench_num_cpus( void );
+int bench_pin( int cpu );
+
+void bench_stats( bench_result_t * r, long long *samples, long long n,
+				  long long elapsed_ns );
+void bench_add( const bench_result_t * r );
+void bench_header( void );
+
+void bench_go( bench_threads_t * bt );
+void bench_done( bench_threads_t * bt );
+int bench_threads( int nthreads, long long iters, bench_thread_fn fn,
+				   void *arg, bench_result_t * r );
+
+int bench_fork( void ( *fn ) ( void * ), void *arg );
+int bench_write_json( const char *file, const char *cpu_model, int iters );
+
+#endif /* __PAPI_BENCH_UTILS_H__ */
@@ -0,0 +1,836 @@
+/** file papi_bench.c
+  * @brief papi_bench utility.
+  *	@page papi_bench
+  * @section  NAME
+  *		papi_bench - latency and throughput of the hot paths of the PAPI API.
+  *
+  *	@section Synopsis
+  *		papi_bench [-hq] [-b benchmarks] [-E events] [-e max_events]
+  *			[-i iterations] [-o file] [-t max_threads]
+  *
+  *	@section Description
+  *		papi_bench times single calls of the PAPI API and reports, for each
+  *		operation, the 50th, 99th and 99.9th percentile of its latency and
+  *		the calls per second over all threads, as a table and as JSON so
+  *		that releases can be compared.
+  *		The EventSet operations are swept over the number of events and
+  *		the number of threads, each thread pinned to its own cpu.
+  *		Every benchmark runs in its own process, starting from an
+  *		uninitialized library.
+  *		The benchmarks are:
+  *	<ul>
+  *		<li>init	PAPI_library_init() in a fresh process.
+  *		<li>name_to_code	PAPI_event_name_to_code() of a preset, a native
+  *			and an unknown event.
+  *		<li>read	PAPI_read() with rdpmc if the cpu allows it, with the
+  *			read system call and multiplexed.
+  *		<li>accum, reset, start_stop	PAPI_accum(), PAPI_reset() and a
+  *			PAPI_start() / PAPI_stop() pair.
+  *		<li>derived	PAPI_read() of derived presets.
+  *		<li>hl	PAPI_hl_region_begin() / PAPI_hl_region_end() pairs, by name
+  *			and by handle, and PAPI_hl_read().
+  *		<li>sde	papi_sde_inc_counter(), papi_sde_record() and
+  *			papi_sde_counting_set_insert(), if libsde was built.
+  *		<li>overflow	the rate of overflow dispatch and its cost.
+  *		<li>threads	a PAPI_register_thread() / PAPI_unregister_thread() pair.
+  *	</ul>
+  *		"make bench" in the source directory builds and runs it.
+  *
+  *	@section Options
+  *	<ul>
+  *		<li>-b < benchmarks >	Comma separated benchmarks to run. The default is all.
+  *		<li>-E < events >	Comma separated events to use instead of the
+  *			first that can be counted together of a built in list.
+  *		<li>-e < max_events >	Most events in an EventSet. The default is 4.
+  *		<li>-h	Display help information about this utility.
+  *		<li>-i < iterations >	Calls timed per thread. The default is 100,000;
+  *			slower operations take a tenth of it.
+  *		<li>-o < file >	Write the JSON report to file. The default is
+  *			papi_bench.json.
+  *		<li>-q	Do not print the table.
+  *		<li>-t < max_threads >	Most threads. The default is the number of cpus.
+  *	</ul>
+  *
+  *	@section Bugs
+  *		There are no known bugs in this utility. If you find a bug,
+  *		it should be reported to the PAPI Mailing List at <ptools-perfapi@icl.utk.edu>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "papi.h"
+#include "bench_utils.h"
+#ifdef BENCH_SDE
+#include "sde_lib.h"
+#endif
+
+#define MAX_EVENTS 32
+#define WARMUP 100
+
+static int iters = 100000;
+static int max_threads = 0;
+static int max_events = 4;
+static char *user_events = NULL;
+static char *only = NULL;
+
+/* Events that can be counted together, in the order they are added */
+static char event_names[MAX_EVENTS][PAPI_MAX_STR_LEN];
+static int event_codes[MAX_EVENTS];
+static int num_events;
+
+/* Tried in order when no events are given, software events last */
+static const char *default_events[] = {
+	"PAPI_TOT_CYC", "PAPI_TOT_INS", "PAPI_BR_INS", "PAPI_LD_INS",
+	"PAPI_SR_INS", "PAPI_BR_MSP", "PAPI_L1_DCM", "PAPI_L2_TCM",
+	"perf::TASK-CLOCK", "perf::CPU-CLOCK", "perf::PAGE-FAULTS",
+	"perf::CONTEXT-SWITCHES", "perf::CPU-MIGRATIONS", "perf::MINOR-FAULTS",
+	NULL
+};
+
+enum { OP_READ, OP_ACCUM, OP_RESET, OP_START_STOP, OP_NAME_TO_CODE,
+	OP_REGISTER, OP_HL_REGION, OP_HL_REGION_H, OP_HL_READ,
+	OP_SDE_INC, OP_SDE_RECORD, OP_SDE_CSET };
+
+enum { MODE_DEFAULT, MODE_INHERIT, MODE_MULTIPLEX };
+
+/* What the threads of one run do */
+typedef struct
+{
+	int op;
+	int mode;
+	int nevents;
+	int *codes;
+	const char *name;
+	void *handle;
+} bench_op_t;
+
+static void
+print_help( char **argv )
+{
+	printf( "This is the PAPI benchmark utility.\n" );
+	printf( "It times the hot paths of the PAPI API and writes a JSON report.\n" );
+	printf( "Usage: %s [options]\n", argv[0] );
+	printf( "Options:\n\n" );
+	printf( "  -b BENCHMARKS  comma separated subset of: init, name_to_code, read,\n" );
+	printf( "                 accum, reset, start_stop, derived, hl, sde, overflow,\n" );
+	printf( "                 threads\n" );
+	printf( "  -E EVENTS      comma separated events to use\n" );
+	printf( "  -e NUM         most events in an EventSet (default 4)\n" );
+	printf( "  -h             display this help\n" );
+	printf( "  -i NUM         calls timed per thread (default 100000)\n" );
+	printf( "  -o FILE        JSON report (default papi_bench.json)\n" );
+	printf( "  -q             do not print the table\n" );
+	printf( "  -t NUM         most threads (default: number of cpus)\n" );
+}
+
+static int
+wanted( const char *benchmark )
+{
+	size_t len = strlen( benchmark );
+	const char *s;
+
+	if ( only == NULL )
+		return 1;
+	for ( s = only; ( s = strstr( s, benchmark ) ) != NULL; s += len ) {
+		if ( ( s == only || s[-1] == ',' ) && ( s[len] == ',' || s[len] == 0 ) )
+			return 1;
+	}
+	return 0;
+}
+
+/* 1, 2, 4, ... up to and including max */
+static int
+next_step( int n, int max )
+{
+	if ( n >= max )
+		return max + 1;
+	return n * 2 < max ? n * 2 : max;
+}
+
+static void
+set_result( bench_result_t * r, const char *name, const char *mode, int events )
+{
+	memset( r, 0, sizeof ( *r ) );
+	snprintf( r->name, sizeof ( r->name ), "%s", name );
+	snprintf( r->mode, sizeof ( r->mode ), "%s", mode );
+	r->events = events;
+}
+
+/* Keep the events that can be counted together */
+static void
+add_candidate( int EventSet, const char *name )
+{
+	int code;
+
+	if ( num_events >= max_events || num_events >= MAX_EVENTS )
+		return;
+	if ( PAPI_event_name_to_code( name, &code ) != PAPI_OK )
+		return;
+	if ( PAPI_add_event( EventSet, code ) != PAPI_OK )
+		return;
+	if ( PAPI_start( EventSet ) != PAPI_OK ) {
+		PAPI_remove_event( EventSet, code );
+		return;
+	}
+	PAPI_stop( EventSet, NULL );
+
+	snprintf( event_names[num_events], PAPI_MAX_STR_LEN, "%s", name );
+	event_codes[num_events++] = code;
+}
+
+static int
+find_events( void )
+{
+	int i, EventSet = PAPI_NULL;
+	char *list, *name, *save;
+
+	num_events = 0;
+	if ( PAPI_create_eventset( &EventSet ) != PAPI_OK )
+		return 0;
+
+	if ( user_events != NULL ) {
+		list = strdup( user_events );
+		for ( name = strtok_r( list, ",", &save ); name != NULL;
+			  name = strtok_r( NULL, ",", &save ) )
+			add_candidate( EventSet, name );
+		free( list );
+	} else {
+		for ( i = 0; default_events[i] != NULL; i++ )
+			add_candidate( EventSet, default_events[i] );
+	}
+
+	PAPI_cleanup_eventset( EventSet );
+	PAPI_destroy_eventset( &EventSet );
+
+	return num_events;
+}
+
+static int
+init_library( void )
+{
+	int retval;
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		fprintf( stderr, "papi_bench: PAPI_library_init: %s\n",
+				 PAPI_strerror( retval ) );
+		return 0;
+	}
+	retval = PAPI_thread_init( ( unsigned long ( * )( void ) ) ( pthread_self ) );
+	if ( retval != PAPI_OK ) {
+		fprintf( stderr, "papi_bench: PAPI_thread_init: %s\n",
+				 PAPI_strerror( retval ) );
+		return 0;
+	}
+	if ( find_events(  ) == 0 ) {
+		fprintf( stderr, "papi_bench: no event can be counted\n" );
+		return 0;
+	}
+	return 1;
+}
+
+static int
+setup_eventset( int *EventSet, bench_op_t * op )
+{
+	PAPI_option_t opt;
+	int i, retval;
+
+	retval = PAPI_create_eventset( EventSet );
+	if ( retval != PAPI_OK )
+		return retval;
+
+	if ( op->mode != MODE_DEFAULT ) {
+		retval = PAPI_assign_eventset_component( *EventSet,
+					PAPI_get_event_component( op->codes[0] ) );
+		if ( retval != PAPI_OK )
+			return retval;
+	}
+	if ( op->mode == MODE_INHERIT ) {
+		memset( &opt, 0, sizeof ( opt ) );
+		opt.inherit.eventset = *EventSet;
+		opt.inherit.inherit = PAPI_INHERIT_ALL;
+		retval = PAPI_set_opt( PAPI_INHERIT, &opt );
+	} else if ( op->mode == MODE_MULTIPLEX ) {
+		retval = PAPI_set_multiplex( *EventSet );
+	}
+	if ( retval != PAPI_OK )
+		return retval;
+
+	for ( i = 0; i < op->nevents; i++ ) {
+		retval = PAPI_add_event( *EventSet, op->codes[i] );
+		if ( retval != PAPI_OK )
+			return retval;
+	}
+
+	return PAPI_OK;
+}
+
+/* One call of the operation under test */
+static inline int
+do_op( bench_op_t * op, int EventSet, long long *values, long long i )
+{
+	int code;
+
+	switch ( op->op ) {
+	case OP_READ:
+		return PAPI_read( EventSet, values );
+	case OP_ACCUM:
+		return PAPI_accum( EventSet, values );
+	case OP_RESET:
+		return PAPI_reset( EventSet );
+	case OP_START_STOP:
+		if ( PAPI_start( EventSet ) != PAPI_OK )
+			return PAPI_ESYS;
+		return PAPI_stop( EventSet, values );
+	case OP_NAME_TO_CODE:
+		PAPI_event_name_to_code( op->name, &code );
+		return PAPI_OK;
+	case OP_REGISTER:
+		if ( PAPI_register_thread(  ) != PAPI_OK )
+			return PAPI_ESYS;
+		return PAPI_unregister_thread(  );
+	case OP_HL_REGION:
+		PAPI_hl_region_begin( op->name );
+		return PAPI_hl_region_end( op->name );
+	case OP_HL_REGION_H:
+		PAPI_hl_region_begin_h( *( int * ) op->handle );
+		return PAPI_hl_region_end_h( *( int * ) op->handle );
+	case OP_HL_READ:
+		return PAPI_hl_read( op->name );
+#ifdef BENCH_SDE
+	case OP_SDE_INC:
+		return papi_sde_inc_counter( op->handle, 1 );
+	case OP_SDE_RECORD:
+		return papi_sde_record( op->handle, sizeof ( i ), &i );
+	case OP_SDE_CSET:
+		{
+			long long key = i & 63;
+
+			return papi_sde_counting_set_insert( op->handle, sizeof ( key ),
+												 sizeof ( key ), &key, 0 );
+		}
+#endif
+	}
+	( void ) i;
+	return PAPI_EINVAL;
+}
+
+static int
+op_thread( bench_threads_t * bt, int thread, long long *samples )
+{
+	bench_op_t *op = bt->arg;
+	long long values[MAX_EVENTS], i, start;
+	int EventSet = PAPI_NULL, uses_eventset, retval = PAPI_OK;
+
+	( void ) thread;
+	uses_eventset = op->op <= OP_START_STOP;
+
+	/* the library keeps per thread state even for event lookups */
+	if ( op->op < OP_REGISTER ) {
+		retval = PAPI_register_thread(  );
+		if ( retval != PAPI_OK )
+			return retval;
+	}
+	if ( uses_eventset ) {
+		retval = setup_eventset( &EventSet, op );
+		if ( retval == PAPI_OK && op->op != OP_START_STOP )
+			retval = PAPI_start( EventSet );
+		if ( retval != PAPI_OK )
+			goto out;
+	}
+	if ( op->op == OP_HL_READ )
+		PAPI_hl_region_begin( op->name );
+
+	for ( i = 0; i < WARMUP; i++ )
+		do_op( op, EventSet, values, i );
+
+	bench_go( bt );
+	for ( i = 0; i < bt->iters; i++ ) {
+		start = bench_now_ns(  );
+		do_op( op, EventSet, values, i );
+		samples[i] = bench_now_ns(  ) - start;
+	}
+	bench_done( bt );
+
+	if ( op->op == OP_HL_READ )
+		PAPI_hl_region_end( op->name );
+	if ( uses_eventset && op->op != OP_START_STOP )
+		PAPI_stop( EventSet, values );
+
+  out:
+	if ( EventSet != PAPI_NULL ) {
+		PAPI_cleanup_eventset( EventSet );
+		PAPI_destroy_eventset( &EventSet );
+	}
+	if ( op->op < OP_REGISTER )
+		PAPI_unregister_thread(  );
+
+	return retval;
+}
+
+/* Run op for each thread count, adding a result for each */
+static int
+sweep_threads( bench_op_t * op, const char *name, const char *mode,
+			   int events, int n )
+{
+	bench_result_t r;
+	int t, retval;
+
+	for ( t = 1; t <= max_threads; t = next_step( t, max_threads ) ) {
+		set_result( &r, name, mode, events );
+		retval = bench_threads( t, n, op_thread, op, &r );
+		if ( retval != PAPI_OK ) {
+			fprintf( stderr, "papi_bench: %s %s: %s\n", name, mode,
+					 PAPI_strerror( retval ) );
+			return retval;
+		}
+		bench_add( &r );
+	}
+	return PAPI_OK;
+}
+
+static void
+bench_init( void *arg )
+{
+	bench_result_t r;
+	long long *samples, start, ns;
+	int i, n, fd[2], status;
+	pid_t pid;
+
+	( void ) arg;
+
+	/* every sample is a process */
+	n = iters / 2000 > 10 ? iters / 2000 : 10;
+	samples = calloc( ( size_t ) n, sizeof ( long long ) );
+	if ( samples == NULL )
+		return;
+
+	for ( i = 0; i < n; i++ ) {
+		if ( pipe( fd ) != 0 )
+			break;
+		pid = fork(  );
+		if ( pid == 0 ) {
+			start = bench_now_ns(  );
+			PAPI_library_init( PAPI_VER_CURRENT );
+			ns = bench_now_ns(  ) - start;
+			if ( write( fd[1], &ns, sizeof ( ns ) ) != sizeof ( ns ) )
+				_exit( 1 );
+			_exit( 0 );
+		}
+		close( fd[1] );
+		if ( pid < 0 || read( fd[0], &samples[i], sizeof ( ns ) ) != sizeof ( ns ) )
+			break;
+		close( fd[0] );
+		waitpid( pid, &status, 0 );
+	}
+
+	set_result( &r, "init", "library_init", 0 );
+	r.threads = 1;
+	bench_stats( &r, samples, i, 0 );
+	bench_add( &r );
+	free( samples );
+}
+
+static void
+bench_name_to_code( void *arg )
+{
+	PAPI_event_info_t info;
+	bench_op_t op;
+	char native[PAPI_MAX_STR_LEN] = "";
+	int i;
+
+	( void ) arg;
+	if ( !init_library(  ) )
+		return;
+
+	for ( i = 0; i < num_events && native[0] == 0; i++ ) {
+		if ( strncmp( event_names[i], "PAPI_", 5 ) != 0 )
+			snprintf( native, sizeof ( native ), "%s", event_names[i] );
+		else if ( PAPI_get_event_info( event_codes[i], &info ) == PAPI_OK &&
+				  info.count > 0 )
+			snprintf( native, sizeof ( native ), "%s", info.name[0] );
+	}
+
+	memset( &op, 0, sizeof ( op ) );
+	op.op = OP_NAME_TO_CODE;
+	op.name = "PAPI_TOT_CYC";
+	sweep_threads( &op, "name_to_code", "preset", 0, iters );
+	if ( native[0] ) {
+		op.name = native;
+		sweep_threads( &op, "name_to_code", "native", 0, iters );
+	}
+	/* the slow path: every component gets asked */
+	op.name = "PAPI_BENCH_NO_SUCH_EVENT";
+	sweep_threads( &op, "name_to_code", "unknown", 0, iters / 10 );
+}
+
+/* The EventSet operations, over event counts, modes and threads */
+static void
+bench_eventset( void *arg )
+{
+	const PAPI_component_info_t *cmp;
+	const char *mode_name[3] = { NULL, "read", "multiplex" };
+	const char *name = arg;
+	bench_op_t op;
+	int e, mode, n = iters;
+
+	if ( !init_library(  ) )
+		return;
+
+	memset( &op, 0, sizeof ( op ) );
+	op.codes = event_codes;
+	if ( strcmp( name, "read" ) == 0 ) {
+		op.op = OP_READ;
+	} else if ( strcmp( name, "accum" ) == 0 ) {
+		op.op = OP_ACCUM;
+	} else if ( strcmp( name, "reset" ) == 0 ) {
+		op.op = OP_RESET;
+	} else {
+		op.op = OP_START_STOP;
+		n = iters / 10;
+	}
+
+	/* a thread counting itself reads with rdpmc when it can */
+	cmp = PAPI_get_component_info( PAPI_get_event_component( event_codes[0] ) );
+	mode_name[MODE_DEFAULT] = ( cmp != NULL && cmp->fast_counter_read ) ?
+		"rdpmc" : "read";
+
+	for ( mode = MODE_DEFAULT; mode <= MODE_MULTIPLEX; mode++ ) {
+		/* without rdpmc the inherited EventSet reads the same way */
+		if ( mode == MODE_INHERIT &&
+			 ( op.op != OP_READ || strcmp( mode_name[MODE_DEFAULT], "read" ) == 0 ) )
+			continue;
+		if ( mode == MODE_MULTIPLEX ) {
+			if ( op.op != OP_READ || PAPI_multiplex_init(  ) != PAPI_OK )
+				continue;
+		}
+		op.mode = mode;
+		for ( e = 1; e <= num_events; e = next_step( e, num_events ) ) {
+			op.nevents = e;
+			if ( sweep_threads( &op, name, mode_name[mode], e, n ) != PAPI_OK )
+				break;
+		}
+	}
+}
+
+static void
+bench_derived( void *arg )
+{
+	const char *types[] = { "DERIVED_ADD", "DERIVED_SUB", "DERIVED_POSTFIX", NULL };
+	PAPI_event_info_t info;
+	bench_result_t r;
+	bench_op_t op;
+	int t, code, found;
+
+	( void ) arg;
+	if ( !init_library(  ) )
+		return;
+
+	memset( &op, 0, sizeof ( op ) );
+	op.op = OP_READ;
+	op.nevents = 1;
+
+	for ( t = 0; types[t] != NULL; t++ ) {
+		found = 0;
+		code = 0 | PAPI_PRESET_MASK;
+		if ( PAPI_enum_event( &code, PAPI_ENUM_FIRST ) != PAPI_OK )
+			return;
+		do {
+			if ( PAPI_get_event_info( code, &info ) != PAPI_OK ||
+				 strcmp( info.derived, types[t] ) != 0 )
+				continue;
+			op.codes = &code;
+			set_result( &r, "derived", types[t], ( int ) info.count );
+			if ( bench_threads( 1, iters, op_thread, &op, &r ) == PAPI_OK ) {
+				bench_add( &r );
+				found = 1;
+			}
+		} while ( !found && PAPI_enum_event( &code, PAPI_PRESET_ENUM_AVAIL ) == PAPI_OK );
+	}
+}
+
+static void
+bench_hl( void *arg )
+{
+	char events[MAX_EVENTS * PAPI_MAX_STR_LEN] = "";
+	bench_op_t op;
+	int i, handle;
+
+	( void ) arg;
+
+	/* find the events with a library of our own, then let go of it */
+	if ( !init_library(  ) )
+		return;
+	for ( i = 0; i < num_events; i++ ) {
+		strcat( events, i ? "," : "" );
+		strcat( events, event_names[i] );
+	}
+	PAPI_shutdown(  );
+
+	setenv( "PAPI_EVENTS", events, 1 );
+	unsetenv( "PAPI_HL_SAMPLE_INTERVAL_MS" );
+	unsetenv( "PAPI_HL_VERBOSE" );
+
+	memset( &op, 0, sizeof ( op ) );
+	op.name = "papi_bench";
+	op.op = OP_HL_REGION;
+	sweep_threads( &op, "hl", "begin_end", num_events, iters );
+	if ( PAPI_hl_region_register( op.name, &handle ) == PAPI_OK ) {
+		op.op = OP_HL_REGION_H;
+		op.handle = &handle;
+		sweep_threads( &op, "hl", "begin_end_h", num_events, iters );
+	}
+	op.op = OP_HL_READ;
+	sweep_threads( &op, "hl", "read", num_events, iters );
+}
+
+#ifdef BENCH_SDE
+static void
+bench_sde( void *arg )
+{
+	papi_handle_t sde;
+	void *counter, *recorder, *cset;
+	bench_op_t op;
+
+	( void ) arg;
+
+	sde = papi_sde_init( "papi_bench" );
+	papi_sde_create_counter( sde, "counter", PAPI_SDE_DELTA, &counter );
+	papi_sde_create_recorder( sde, "recorder", sizeof ( long long ),
+							  papi_sde_compare_long_long, &recorder );
+	papi_sde_create_counting_set( sde, "cset", &cset );
+
+	memset( &op, 0, sizeof ( op ) );
+	op.op = OP_SDE_INC;
+	op.handle = counter;
+	sweep_threads( &op, "sde", "inc_counter", 0, iters );
+	op.op = OP_SDE_RECORD;
+	op.handle = recorder;
+	sweep_threads( &op, "sde", "record", 0, iters );
+	op.op = OP_SDE_CSET;
+	op.handle = cset;
+	sweep_threads( &op, "sde", "cset_insert", 0, iters );
+
+	papi_sde_shutdown( sde );
+}
+#endif
+
+/* Times of the overflows, as the handler saw them */
+static long long *overflow_at;
+static volatile int overflows;
+static int max_overflows;
+
+static void
+overflow_handler( int EventSet, void *address, long long overflow_vector,
+				  void *context )
+{
+	( void ) EventSet;
+	( void ) address;
+	( void ) overflow_vector;
+	( void ) context;
+
+	if ( overflows < max_overflows )
+		overflow_at[overflows] = bench_now_ns(  );
+	overflows++;
+}
+
+static volatile double busy_sink;
+
+static void
+busy( long long loops )
+{
+	double x = 1.0;
+	long long i;
+
+	for ( i = 0; i < loops; i++ )
+		x = x * 1.0000001 + 0.0000001;
+	busy_sink = x;
+}
+
+/* Run loops with EventSet counting, return the time it took */
+static long long
+timed_busy( int EventSet, long long loops, long long *value )
+{
+	long long start;
+
+	start = bench_now_ns(  );
+	if ( PAPI_start( EventSet ) != PAPI_OK )
+		return -1;
+	busy( loops );
+	PAPI_stop( EventSet, value );
+
+	return bench_now_ns(  ) - start;
+}
+
+static void
+bench_overflow( void *arg )
+{
+	bench_result_t r;
+	long long loops, value, plain_ns, overflow_ns, threshold, cost, *gaps;
+	int i, e, EventSet = PAPI_NULL;
+
+	( void ) arg;
+	if ( !init_library(  ) )
+		return;
+	if ( PAPI_create_eventset( &EventSet ) != PAPI_OK )
+		return;
+
+	/* about half a second of work */
+	loops = 1000000;
+	plain_ns = bench_now_ns(  );
+	busy( loops );
+	plain_ns = bench_now_ns(  ) - plain_ns;
+	loops = plain_ns > 0 ? loops * 500000000LL / plain_ns : loops;
+
+	for ( e = 0; e < num_events; e++ ) {
+		if ( PAPI_add_event( EventSet, event_codes[e] ) != PAPI_OK )
+			continue;
+		plain_ns = timed_busy( EventSet, loops, &value );
+		/* aim at ten thousand overflows a second */
+		threshold = plain_ns > 0 ? value * 100000LL / plain_ns : 0;
+		if ( plain_ns > 0 && threshold > 0 && threshold < 0x7fffffff &&
+			 PAPI_overflow( EventSet, event_codes[e], ( int ) threshold, 0,
+							overflow_handler ) == PAPI_OK )
+			break;
+		PAPI_remove_event( EventSet, event_codes[e] );
+	}
+	if ( e == num_events ) {
+		fprintf( stderr, "papi_bench: no event can overflow\n" );
+		return;
+	}
+
+	max_overflows = ( int ) ( plain_ns / 50000 ) + 1000;
+	overflow_at = calloc( ( size_t ) max_overflows, sizeof ( long long ) );
+	if ( overflow_at == NULL )
+		return;
+	overflows = 0;
+	overflow_ns = timed_busy( EventSet, loops, &value );
+	PAPI_overflow( EventSet, event_codes[e], 0, 0, overflow_handler );
+
+	if ( overflows < 2 ) {
+		fprintf( stderr, "papi_bench: %s did not overflow\n", event_names[e] );
+		return;
+	}
+	if ( overflows > max_overflows )
+		overflows = max_overflows;
+
+	/* the time between overflows and their rate */
+	gaps = overflow_at;
+	for ( i = 0; i < overflows - 1; i++ )
+		gaps[i] = overflow_at[i + 1] - overflow_at[i];
+	set_result( &r, "overflow", "interval", 1 );
+	r.threads = 1;
+	bench_stats( &r, gaps, overflows - 1, overflow_ns );
+	bench_add( &r );
+
+	/* what the program lost to each of them */
+	cost = ( overflow_ns - plain_ns ) / overflows;
+	if ( cost < 0 )
+		cost = 0;
+	set_result( &r, "overflow", "cost", 1 );
+	r.threads = 1;
+	r.samples = overflows;
+	r.min_ns = r.p50_ns = r.p99_ns = r.p999_ns = r.max_ns = cost;
+	r.mean_ns = ( double ) cost;
+	r.ops_per_sec = ( double ) overflows * 1e9 / ( double ) overflow_ns;
+	bench_add( &r );
+
+	free( overflow_at );
+}
+
+static void
+bench_register( void *arg )
+{
+	bench_op_t op;
+
+	( void ) arg;
+	if ( !init_library(  ) )
+		return;
+
+	memset( &op, 0, sizeof ( op ) );
+	op.op = OP_REGISTER;
+	sweep_threads( &op, "threads", "register", 0, iters / 10 );
+}
+
+int
+main( int argc, char **argv )
+{
+	const PAPI_hw_info_t *hw = NULL;
+	const char *output = "papi_bench.json";
+	const char *eventset_ops[] = { "read", "accum", "reset", "start_stop", NULL };
+	int c, i;
+
+	while ( ( c = getopt( argc, argv, "b:E:e:hi:o:qt:" ) ) != -1 ) {
+		switch ( c ) {
+		case 'b':
+			only = optarg;
+			break;
+		case 'E':
+			user_events = optarg;
+			break;
+		case 'e':
+			max_events = atoi( optarg );
+			break;
+		case 'i':
+			iters = atoi( optarg );
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'q':
+			bench_quiet = 1;
+			break;
+		case 't':
+			max_threads = atoi( optarg );
+			break;
+		case 'h':
+		default:
+			print_help( argv );
+			exit( 1 );
+		}
+	}
+	if ( iters < 10 || max_events < 1 ) {
+		print_help( argv );
+		exit( 1 );
+	}
+	if ( max_threads < 1 )
+		max_threads = bench_num_cpus(  );
+
+	bench_header(  );
+
+	if ( wanted( "init" ) )
+		bench_fork( bench_init, NULL );
+	if ( wanted( "name_to_code" ) )
+		bench_fork( bench_name_to_code, NULL );
+	for ( i = 0; eventset_ops[i] != NULL; i++ ) {
+		if ( wanted( eventset_ops[i] ) )
+			bench_fork( bench_eventset, ( void * ) eventset_ops[i] );
+	}
+	if ( wanted( "derived" ) )
+		bench_fork( bench_derived, NULL );
+	if ( wanted( "hl" ) )
+		bench_fork( bench_hl, NULL );
+#ifdef BENCH_SDE
+	if ( wanted( "sde" ) )
+		bench_fork( bench_sde, NULL );
+#endif
+	if ( wanted( "overflow" ) )
+		bench_fork( bench_overflow, NULL );
+	if ( wanted( "threads" ) )
+		bench_fork( bench_register, NULL );
+
+	if ( PAPI_library_init( PAPI_VER_CURRENT ) == PAPI_VER_CURRENT )
+		hw = PAPI_get_hardware_info(  );
+	if ( bench_write_json( output, hw ? hw->model_string : "", iters ) != PAPI_OK )
+		exit( 1 );
+	if ( !bench_quiet )
+		printf( "\nWrote %s\n", output );
+
+	return 0;
+}
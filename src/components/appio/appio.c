@@ -23,17 +23,12 @@
  *  This file contains the source code for a component that enables
  *  PAPI to access application level file and socket I/O information.
  *  It does this through function replacement in the first person and
- *  by trapping syscalls in the third person.
+ *  by trapping syscalls in the third person.  The replacements are in
+ *  appio_lib.c, built into libpapi_appio.
  */
 
 #include <stdlib.h>
-#include <ctype.h>
 #include <string.h>
-#include <errno.h>
-#include <sys/select.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include <sys/stat.h>
 
 /* Headers required by PAPI */
 #include "papi.h"
@@ -43,17 +38,6 @@
 
 #include "appio.h"
 
-// The PIC test implies it's built for shared linkage
-#ifdef PIC
-#  include "dlfcn.h"
-#endif
-
-/*
-#pragma weak dlerror
-static void *_dlsym_fake(void *handle, const char* symbol) { (void) handle; (void) symbol; return NULL; }
-void *dlsym(void *handle, const char* symbol) __attribute__ ((weak, alias ("_dlsym_fake")));
-*/
-
 papi_vector_t _appio_vector;
 
 /*********************************************************************
@@ -64,56 +48,15 @@ papi_vector_t _appio_vector;
 
 static APPIO_native_event_entry_t * _appio_native_events;
 
-
-/* If you modify the appio_stats_t below, you MUST update APPIO_MAX_COUNTERS */
-static __thread long long _appio_register_current[APPIO_MAX_COUNTERS];
-typedef enum {
-  READ_BYTES = 0,
-  READ_CALLS,
-  READ_ERR,
-  READ_INTERRUPTED,
-  READ_WOULD_BLOCK,
-  READ_SHORT,
-  READ_EOF,
-  READ_BLOCK_SIZE,
-  READ_USEC,
-  WRITE_BYTES,
-  WRITE_CALLS,
-  WRITE_ERR,
-  WRITE_SHORT,
-  WRITE_INTERRUPTED,
-  WRITE_WOULD_BLOCK,
-  WRITE_BLOCK_SIZE,
-  WRITE_USEC,
-  OPEN_CALLS,
-  OPEN_ERR,
-  OPEN_FDS,
-  SELECT_USEC,
-  RECV_BYTES,
-  RECV_CALLS,
-  RECV_ERR,
-  RECV_INTERRUPTED,
-  RECV_WOULD_BLOCK,
-  RECV_SHORT,
-  RECV_EOF,
-  RECV_BLOCK_SIZE,
-  RECV_USEC,
-  SOCK_READ_BYTES,
-  SOCK_READ_CALLS,
-  SOCK_READ_ERR,
-  SOCK_READ_SHORT,
-  SOCK_READ_WOULD_BLOCK,
-  SOCK_READ_USEC,
-  SOCK_WRITE_BYTES,
-  SOCK_WRITE_CALLS,
-  SOCK_WRITE_ERR,
-  SOCK_WRITE_SHORT,
-  SOCK_WRITE_WOULD_BLOCK,
-  SOCK_WRITE_USEC,
-  SEEK_CALLS,
-  SEEK_ABS_STRIDE_SIZE,
-  SEEK_USEC
-} _appio_stats_t ;
+/* The counters of libpapi_appio.  libpapi.a carries them, so a  */
+/* static link pulls them in.  With the shared libpapi they are   */
+/* NULL unless the program preloads or links libpapi_appio.so.    */
+#ifdef PIC
+extern APPIO_lib_t papi_appio_lib __attribute__((weak, visibility("default")));
+#else
+extern APPIO_lib_t papi_appio_lib;
+#endif
+static APPIO_lib_t *_appio_lib;
 
 static const struct appio_counters {
     const char *name;
@@ -163,248 +106,86 @@ static const struct appio_counters {
     { "SOCK_WRITE_USEC", "Real microseconds spent in write(s) to socket(s)"},
     { "SEEK_CALLS",      "Number of seek calls"},
     { "SEEK_ABS_STRIDE_SIZE", "Average absolute stride size of seeks"},
-    { "SEEK_USEC",       "Real microseconds spent in seek calls"}
+    { "SEEK_USEC",       "Real microseconds spent in seek calls"},
+    { "PREAD_CALLS",     "Number of pread/preadv/preadv2 calls, also counted as reads"},
+    { "PWRITE_CALLS",    "Number of pwrite/pwritev/pwritev2 calls, also counted as writes"},
+    { "READV_CALLS",     "Number of readv/preadv/preadv2 calls, also counted as reads"},
+    { "WRITEV_CALLS",    "Number of writev/pwritev/pwritev2 calls, also counted as writes"},
+    { "SEND_BYTES",      "Bytes sent in send/sendto/sendmsg"},
+    { "SEND_CALLS",      "Number of send/sendto/sendmsg calls"},
+    { "SEND_ERR",        "Number of send/sendto/sendmsg calls that resulted in an error"},
+    { "SEND_USEC",       "Real microseconds spent in send/sendto/sendmsg"},
+    { "MMAP_CALLS",      "Number of mmap calls"},
+    { "MMAP_BYTES",      "Bytes of files mapped by mmap"},
+    { "MUNMAP_CALLS",    "Number of munmap calls"},
+    { "IO_URING_SUBMITTED", "Number of io_uring submissions consumed by the kernel, all threads"},
+    { "IO_URING_COMPLETED", "Number of io_uring completions posted by the kernel, all threads"},
+    { "IO_URING_READ_BYTES", "Bytes requested by the io_uring reads consumed by the kernel, all threads"},
+    { "IO_URING_WRITE_BYTES", "Bytes requested by the io_uring writes consumed by the kernel, all threads"}
 };
 
-// The following macro follows if a string function has an error. It should 
-// never happen; but it is necessary to prevent compiler warnings. We print 
-// something just in case there is programmer error in invoking the function.
-#define HANDLE_STRING_ERROR {fprintf(stderr,"%s:%i unexpected string function error.\n",__FILE__,__LINE__); exit(-1);}
-
-/*********************************************************************
- ***  BEGIN FUNCTIONS  USED INTERNALLY SPECIFIC TO THIS COMPONENT ****
- ********************************************************************/
-
-int __close(int fd);
-int close(int fd) {
-  int retval;
-  SUBDBG("appio: intercepted close(%d)\n", fd);
-  retval = __close(fd);
-  if ((retval == 0) && (_appio_register_current[OPEN_FDS]>0)) _appio_register_current[OPEN_FDS]--;
-  return retval;
-}
+/* Setting PAPI_APPIO_DETAILED=1 probes every call with fstat() and a */
+/* zero-timeout select() timed by PAPI_get_real_usec().  Otherwise    */
+/* calls are timed with the cycle counter when it can be scaled.      */
+#define APPIO_DETAILED_ENV "PAPI_APPIO_DETAILED"
 
-int __open(const char *pathname, int flags, mode_t mode);
-int open(const char *pathname, int flags, mode_t mode) {
-  int retval;
-  SUBDBG("appio: intercepted open(%s,%d,%d)\n", pathname, flags, mode);
-  retval = __open(pathname,flags,mode);
-  _appio_register_current[OPEN_CALLS]++;
-  if (retval < 0) _appio_register_current[OPEN_ERR]++;
-  else _appio_register_current[OPEN_FDS]++;
-  return retval;
-}
+/* The cycle counter is scaled by its own rate, measured against the */
+/* real time clock over this many ns: the TSC of x86 ticks at the    */
+/* nominal frequency, not at cpu_max_mhz.                            */
+#define APPIO_CALIBRATE_NSEC 200000LL
 
-/* we use timeval as a zero value timeout to select in read/write
-   for polling if the operation would block */
-struct timeval zerotv; /* this has to be zero, so define it here */
-
-int __select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
-int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) {
-  int retval;
-  SUBDBG("appio: intercepted select(%d,%p,%p,%p,%p)\n", nfds,readfds,writefds,exceptfds,timeout);
-  long long start_ts = PAPI_get_real_usec();
-  retval = __select(nfds,readfds,writefds,exceptfds,timeout);
-  long long duration = PAPI_get_real_usec() - start_ts;
-  _appio_register_current[SELECT_USEC] += duration;
-  return retval;
-}
+/* Per-descriptor and per-path statistics are off until a qualified */
+/* event asks for them, or PAPI_APPIO_PER_FD=1 is set.              */
+#define APPIO_PER_FD_ENV "PAPI_APPIO_PER_FD"
 
-off_t __lseek(int fd, off_t offset, int whence);
-off_t lseek(int fd, off_t offset, int whence) {
-  off_t retval;
-  SUBDBG("appio: intercepted lseek(%d,%ld,%d)\n", fd, offset, whence);
-  long long start_ts = PAPI_get_real_usec();
-  retval = __lseek(fd, offset, whence);
-  long long duration = PAPI_get_real_usec() - start_ts;
-  int n = _appio_register_current[SEEK_CALLS]++;
-  _appio_register_current[SEEK_USEC] += duration;
-  if (offset < 0) offset = -offset; // get abs offset
-  _appio_register_current[SEEK_ABS_STRIDE_SIZE]= (n * _appio_register_current[SEEK_ABS_STRIDE_SIZE] + offset)/(n+1); // mean absolute stride size
-  return retval;
-}
+/* Events counted for the whole process rather than per thread */
+static inline int
+appio_is_process_wide( unsigned int code )
+{
+  int qual = APPIO_CODE_QUAL(code);
+  int index = APPIO_CODE_INDEX(code);
 
-extern int errno;
-ssize_t __read(int fd, void *buf, size_t count);
-ssize_t read(int fd, void *buf, size_t count) {
-  int retval;
-  SUBDBG("appio: intercepted read(%d,%p,%lu)\n", fd, buf, (unsigned long)count);
-
-  struct stat st;
-  int issocket = 0;
-  if (fstat(fd, &st) == 0) {
-    if ((st.st_mode & S_IFMT) == S_IFSOCK) issocket = 1;
-  }
-  // check if read would block on descriptor
-  fd_set readfds;
-  FD_ZERO(&readfds);
-  FD_SET(fd, &readfds);
-  int ready = __select(fd+1, &readfds, NULL, NULL, &zerotv);
-  if (ready == 0) {
-     _appio_register_current[READ_WOULD_BLOCK]++; 
-     if (issocket) _appio_register_current[SOCK_READ_WOULD_BLOCK]++; 
-  }
-
-  long long start_ts = PAPI_get_real_usec();
-  retval = __read(fd,buf, count);
-  long long duration = PAPI_get_real_usec() - start_ts;
-  int n = _appio_register_current[READ_CALLS]++; // read calls
-  if (issocket) _appio_register_current[SOCK_READ_CALLS]++; // read calls
-  if (retval > 0) {
-    _appio_register_current[READ_BLOCK_SIZE]= (n * _appio_register_current[READ_BLOCK_SIZE] + count)/(n+1); // mean size
-    _appio_register_current[READ_BYTES] += retval; // read bytes
-    if (issocket) _appio_register_current[SOCK_READ_BYTES] += retval;
-    if (retval < (int)count) {
-       _appio_register_current[READ_SHORT]++; // read short
-       if (issocket) _appio_register_current[SOCK_READ_SHORT]++; // read short
-    }
-    _appio_register_current[READ_USEC] += duration;
-    if (issocket) _appio_register_current[SOCK_READ_USEC] += duration;
-  }
-  if (retval < 0) { 
-    _appio_register_current[READ_ERR]++; // read err
-    if (issocket) _appio_register_current[SOCK_READ_ERR]++; // read err
-    if (EINTR == errno)
-      _appio_register_current[READ_INTERRUPTED]++; // signal interrupted the read
-    //if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) {
-    //  _appio_register_current[READ_WOULD_BLOCK]++; //read would block on descriptor marked as non-blocking
-    //  if (issocket) _appio_register_current[SOCK_READ_WOULD_BLOCK]++; //read would block on descriptor marked as non-blocking
-    //}
-  }
-  if (retval == 0) _appio_register_current[READ_EOF]++; // read eof
-  return retval;
+  return (qual == APPIO_QUAL_FD || qual == APPIO_QUAL_PATH ||
+          qual == APPIO_QUAL_USEC_LOG2 || qual == APPIO_QUAL_SIZE_LOG2 ||
+          appio_is_uring(index));
 }
 
-size_t _IO_fread(void *ptr, size_t size, size_t nmemb, FILE *stream);
-size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-  size_t retval;
-  SUBDBG("appio: intercepted fread(%p,%lu,%lu,%p)\n", ptr, (unsigned long) size, (unsigned long) nmemb, (void*) stream);
-  long long start_ts = PAPI_get_real_usec();
-  retval = _IO_fread(ptr,size,nmemb,stream);
-  long long duration = PAPI_get_real_usec() - start_ts;
-  int n = _appio_register_current[READ_CALLS]++; // read calls
-  if (retval > 0) {
-    _appio_register_current[READ_BLOCK_SIZE]= (n * _appio_register_current[READ_BLOCK_SIZE]+ size*nmemb)/(n+1);//mean size
-    _appio_register_current[READ_BYTES]+= retval * size; // read bytes
-    if (retval < nmemb) _appio_register_current[READ_SHORT]++; // read short
-    _appio_register_current[READ_USEC] += duration;
-  }
-
-  /* A value of zero returned means one of two things..*/
-  if (retval == 0) {
-     if (feof(stream)) _appio_register_current[READ_EOF]++; // read eof
-     else _appio_register_current[READ_ERR]++; // read err
-  }
-  return retval;
-}
+/* Count of a process-wide event since start.  An fd= event whose */
+/* number was taken by another descriptor counts from that one's  */
+/* first call instead.                                            */
+static long long
+appio_since_start( APPIO_control_state_t *appio_ctl, int i )
+{
+  unsigned int code = appio_ctl->counter_bits[i];
 
-ssize_t __write(int fd, const void *buf, size_t count);
-ssize_t write(int fd, const void *buf, size_t count) {
-  int retval;
-  SUBDBG("appio: intercepted write(%d,%p,%lu)\n", fd, buf, (unsigned long)count);
-  struct stat st;
-  int issocket = 0;
-  if (fstat(fd, &st) == 0) {
-    if ((st.st_mode & S_IFMT) == S_IFSOCK) issocket = 1;
-  }
-
-  // check if write would block on descriptor
-  fd_set writefds;
-  FD_ZERO(&writefds);
-  FD_SET(fd, &writefds);
-  int ready = __select(fd+1, NULL, &writefds, NULL, &zerotv);
-  if (ready == 0) {
-    _appio_register_current[WRITE_WOULD_BLOCK]++; 
-    if (issocket) _appio_register_current[SOCK_WRITE_WOULD_BLOCK]++; 
-  }
-
-  long long start_ts = PAPI_get_real_usec();
-  retval = __write(fd,buf, count);
-  long long duration = PAPI_get_real_usec() - start_ts;
-  int n = _appio_register_current[WRITE_CALLS]++; // write calls
-  if (issocket) _appio_register_current[SOCK_WRITE_CALLS]++; // socket write
-  if (retval >= 0) {
-    _appio_register_current[WRITE_BLOCK_SIZE]= (n * _appio_register_current[WRITE_BLOCK_SIZE] + count)/(n+1); // mean size
-    _appio_register_current[WRITE_BYTES]+= retval; // write bytes
-    if (issocket) _appio_register_current[SOCK_WRITE_BYTES] += retval;
-    if (retval < (int)count) {
-      _appio_register_current[WRITE_SHORT]++; // short write
-      if (issocket) _appio_register_current[SOCK_WRITE_SHORT]++; 
-    }
-    _appio_register_current[WRITE_USEC] += duration;
-    if (issocket) _appio_register_current[SOCK_WRITE_USEC] += duration;
-  }
-  if (retval < 0) {
-    _appio_register_current[WRITE_ERR]++; // err
-    if (issocket) _appio_register_current[SOCK_WRITE_ERR]++;
-    if (EINTR == errno)
-      _appio_register_current[WRITE_INTERRUPTED]++; // signal interrupted the op
-    //if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) {
-    //  _appio_register_current[WRITE_WOULD_BLOCK]++; //op would block on descriptor marked as non-blocking
-    //  if (issocket) _appio_register_current[SOCK_WRITE_WOULD_BLOCK]++;
-    //}
-  }
-  return retval;
+  if (_appio_lib->epoch(code) != appio_ctl->start_epochs[i])
+    return _appio_lib->value(code);
+  return _appio_lib->value(code) - appio_ctl->start_values[i];
 }
 
-// The PIC test implies it's built for shared linkage
-#ifdef PIC
-static ssize_t (*__recv)(int sockfd, void *buf, size_t len, int flags) = NULL;
-ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
-  int retval;
-  SUBDBG("appio: intercepted recv(%d,%p,%lu,%d)\n", sockfd, buf, (unsigned long)len, flags);
-  if (!__recv) __recv  = dlsym(RTLD_NEXT, "recv");
-  if (!__recv) {
-    fprintf(stderr, "appio,c Internal Error: Could not obtain handle for real recv\n");
-    exit(1);
-  }
-  // check if recv would block on descriptor
-  fd_set readfds;
-  FD_ZERO(&readfds);
-  FD_SET(sockfd, &readfds);
-  int ready = __select(sockfd+1, &readfds, NULL, NULL, &zerotv);
-  if (ready == 0) _appio_register_current[RECV_WOULD_BLOCK]++; 
-
-  long long start_ts = PAPI_get_real_usec();
-  retval = __recv(sockfd, buf, len, flags);
-  long long duration = PAPI_get_real_usec() - start_ts;
-  int n = _appio_register_current[RECV_CALLS]++; // read calls
-  if (retval > 0) {
-    _appio_register_current[RECV_BLOCK_SIZE]= (n * _appio_register_current[RECV_BLOCK_SIZE] + len)/(n+1); // mean size
-    _appio_register_current[RECV_BYTES] += retval; // read bytes
-    if (retval < (int)len) _appio_register_current[RECV_SHORT]++; // read short
-    _appio_register_current[RECV_USEC] += duration;
-  }
-  if (retval < 0) { 
-    _appio_register_current[RECV_ERR]++; // read err
-    if (EINTR == errno)
-      _appio_register_current[RECV_INTERRUPTED]++; // signal interrupted the read
-    if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) 
-      _appio_register_current[RECV_WOULD_BLOCK]++; //read would block on descriptor marked as non-blocking
-  }
-  if (retval == 0) _appio_register_current[RECV_EOF]++; // read eof
-  return retval;
-}
-#endif /* PIC */
-
-size_t _IO_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream);
-size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
-  size_t retval;
-  SUBDBG("appio: intercepted fwrite(%p,%lu,%lu,%p)\n", ptr, (unsigned long) size, (unsigned long) nmemb, (void*) stream);
-  long long start_ts = PAPI_get_real_usec();
-  retval = _IO_fwrite(ptr,size,nmemb,stream);
-  long long duration = PAPI_get_real_usec() - start_ts;
-  int n = _appio_register_current[WRITE_CALLS]++; // write calls
-  if (retval > 0) {
-    _appio_register_current[WRITE_BLOCK_SIZE]= (n * _appio_register_current[WRITE_BLOCK_SIZE] + size*nmemb)/(n+1); // mean block size
-    _appio_register_current[WRITE_BYTES]+= retval * size; // write bytes
-    if (retval < nmemb) _appio_register_current[WRITE_SHORT]++; // short write
-    _appio_register_current[WRITE_USEC] += duration;
-  }
-  if (retval == 0) _appio_register_current[WRITE_ERR]++; // err
-  return retval;
+/* Ticks of PAPI_get_real_cyc() per microsecond, 0 if it cannot be */
+/* scaled to better than 1/1000.                                   */
+static long long
+appio_cycles_per_usec( void )
+{
+  long long c0, c1, n0, n1, rate;
+
+  n0 = PAPI_get_real_nsec();
+  c0 = PAPI_get_real_cyc();
+  do {
+    n1 = PAPI_get_real_nsec();
+  } while (n1 >= n0 && n1 - n0 < APPIO_CALIBRATE_NSEC);
+  c1 = PAPI_get_real_cyc();
+
+  if (n1 <= n0 || c1 <= c0) return 0;
+  rate = (c1 - c0) * 1000 / (n1 - n0);
+  return (rate >= 1000) ? rate : 0;
 }
 
+// The following macro follows if a string function has an error. It should 
+// never happen; but it is necessary to prevent compiler warnings. We print 
+// something just in case there is programmer error in invoking the function.
+#define HANDLE_STRING_ERROR {fprintf(stderr,"%s:%i unexpected string function error.\n",__FILE__,__LINE__); exit(-1);}
 
 /*********************************************************************
  ***************  BEGIN PAPI's COMPONENT REQUIRED FUNCTIONS  *********
@@ -450,6 +231,30 @@ _appio_init_component( int cidx  )
       _appio_native_events[i].resources.selector = i + 1;
     }
   
+    _appio_lib = &papi_appio_lib;
+    if (_appio_lib == NULL || _appio_lib->version != APPIO_LIB_VERSION) {
+      _appio_lib = NULL;
+      strErr=snprintf(_appio_vector.cmp_info.disabled_reason, PAPI_MAX_STR_LEN, "libpapi_appio.so must be preloaded or linked to count I/O.");
+      _appio_vector.cmp_info.disabled_reason[PAPI_MAX_STR_LEN-1]=0;
+      if (strErr>PAPI_MAX_STR_LEN) HANDLE_STRING_ERROR;
+      retval = PAPI_ECMP;
+      goto fn_fail;
+    }
+
+    char *detailed = getenv(APPIO_DETAILED_ENV);
+    int is_detailed = (detailed != NULL && atoi(detailed) != 0);
+
+    /* The cycle counter is only worth it when it can be scaled */
+    long long cycles_per_usec = 0;
+    if (!is_detailed)
+      cycles_per_usec = appio_cycles_per_usec();
+    SUBDBG("appio: detailed %d, cycles per usec %lld\n", is_detailed, cycles_per_usec);
+    if (cycles_per_usec) _appio_lib->init(is_detailed, PAPI_get_real_cyc, cycles_per_usec);
+    else _appio_lib->init(is_detailed, PAPI_get_real_usec, 1);
+
+    char *per_fd = getenv(APPIO_PER_FD_ENV);
+    if (per_fd != NULL && atoi(per_fd) != 0) _appio_lib->enable(APPIO_QUAL_FD);
+
     /* Export the total number of events available */
     _appio_vector.cmp_info.num_native_events = APPIO_MAX_COUNTERS;;
 
@@ -484,13 +289,24 @@ _appio_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
 
     SUBDBG("_appio_start %p %p\n", ctx, ctl);
     APPIO_control_state_t *appio_ctl = (APPIO_control_state_t *) ctl;
+    int i, rings = 0;
 
-    /* this memset needs to move to thread_init */
-    memset(_appio_register_current, 0, APPIO_MAX_COUNTERS * sizeof(_appio_register_current[0]));
+    for ( i=0; i<appio_ctl->num_events; i++ )
+            if (appio_is_uring(APPIO_CODE_INDEX(appio_ctl->counter_bits[i]))) rings = 1;
+    _appio_lib->start(rings);
 
     /* set initial values to 0 */
     memset(appio_ctl->values, 0, APPIO_MAX_COUNTERS*sizeof(appio_ctl->values[0]));
-    
+
+    /* the process-wide counts are shared and never cleared */
+    for ( i=0; i<appio_ctl->num_events; i++ ) {
+            unsigned int code = appio_ctl->counter_bits[i];
+            appio_ctl->start_values[i] = 0;
+            appio_ctl->start_epochs[i] = _appio_lib->epoch(code);
+            if (appio_is_process_wide(code))
+                appio_ctl->start_values[i] = _appio_lib->value(code);
+    }
+
     return PAPI_OK;
 }
 
@@ -507,9 +323,8 @@ _appio_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
     int i;
 
     for ( i=0; i<appio_ctl->num_events; i++ ) {
-            int index = appio_ctl->counter_bits[i];
-            SUBDBG("event=%d, index=%d, val=%lld\n", i, index, _appio_register_current[index]);
-            appio_ctl->values[index] = _appio_register_current[index];
+            appio_ctl->values[i] = appio_since_start(appio_ctl, i);
+            SUBDBG("event=%d, code=%#x, val=%lld\n", i, appio_ctl->counter_bits[i], appio_ctl->values[i]);
     }
     *events = appio_ctl->values;
 
@@ -526,9 +341,8 @@ _appio_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
     APPIO_control_state_t *appio_ctl = (APPIO_control_state_t *) ctl;
     int i;
     for ( i=0; i<appio_ctl->num_events; i++ ) {
-            int index = appio_ctl->counter_bits[i];
-            SUBDBG("event=%d, index=%d, val=%lld\n", i, index, _appio_register_current[index]);
-            appio_ctl->values[i] = _appio_register_current[index];
+            appio_ctl->values[i] = appio_since_start(appio_ctl, i);
+            SUBDBG("event=%d, code=%#x, val=%lld\n", i, appio_ctl->counter_bits[i], appio_ctl->values[i]);
     }
 
     return PAPI_OK;
@@ -553,6 +367,8 @@ _appio_shutdown_thread( hwd_context_t *ctx )
 static int
 _appio_shutdown_component( void )
 {
+    if (_appio_lib) _appio_lib->fini();
+    _appio_lib = NULL;
     papi_free( _appio_native_events );
     return PAPI_OK;
 }
@@ -582,14 +398,14 @@ _appio_update_control_state( hwd_control_state_t *ctl,
     ( void ) ctl;
 
     SUBDBG("_appio_update_control_state ctx=%p ctl=%p num_events=%d\n", ctx, ctl, count);
-    int i, index;
+    int i;
     APPIO_control_state_t *appio_ctl = (APPIO_control_state_t *) ctl;
     (void) ctx;
 
+    /* Qualified events share a counter index, so values are by position */
     for ( i = 0; i < count; i++ ) {
-        index = native[i].ni_event;
-        appio_ctl->counter_bits[i] = index;
-        native[i].ni_position = index;
+        appio_ctl->counter_bits[i] = native[i].ni_event;
+        native[i].ni_position = i;
     }
     appio_ctl->num_events = count;
 
@@ -671,16 +487,63 @@ _appio_ntv_enum_events( unsigned int *EventCode, int modifier )
 static int
 _appio_ntv_name_to_code( const char *name, unsigned int *EventCode )
 {
-    int i;
+    const char *qual_str;
+    size_t len;
+    int i, index = -1, qual = APPIO_QUAL_NONE, value = 0;
+    char *end;
+    long num;
+
+    /* BASE or BASE:qualifier=value */
+    qual_str = strchr(name, ':');
+    len = qual_str ? (size_t) (qual_str - name) : strlen(name);
 
     for ( i=0; i<APPIO_MAX_COUNTERS; i++) {
-        if (strcmp(name, _appio_counter_info[i].name) == 0) {
-            *EventCode = i;
-            return PAPI_OK;
+        if (strlen(_appio_counter_info[i].name) == len &&
+            strncmp(name, _appio_counter_info[i].name, len) == 0) {
+            index = i;
+            break;
         }
     }
+    if (index < 0) return PAPI_ENOEVNT;
 
-    return PAPI_ENOEVNT;
+    if (qual_str == NULL) {
+        *EventCode = APPIO_CODE(index, APPIO_QUAL_NONE, 0);
+        return PAPI_OK;
+    }
+    qual_str++;
+
+    if (strncmp(qual_str, "path=", 5) == 0) {
+        if (appio_fd_slot(index) < 0) return PAPI_ENOEVNT;
+        value = _appio_lib->register_path(qual_str + 5);
+        if (value < 0) return PAPI_ENOMEM;
+        qual = APPIO_QUAL_PATH;
+    } else {
+        if (strncmp(qual_str, "fd=", 3) == 0) {
+            if (appio_fd_slot(index) < 0) return PAPI_ENOEVNT;
+            qual = APPIO_QUAL_FD;
+            qual_str += 3;
+        } else if (strncmp(qual_str, "usec_log2=", 10) == 0) {
+            if (appio_hist_cat(index) < 0) return PAPI_ENOEVNT;
+            qual = APPIO_QUAL_USEC_LOG2;
+            qual_str += 10;
+        } else if (strncmp(qual_str, "size_log2=", 10) == 0) {
+            if (appio_hist_cat(index) < 0) return PAPI_ENOEVNT;
+            qual = APPIO_QUAL_SIZE_LOG2;
+            qual_str += 10;
+        } else {
+            return PAPI_ENOEVNT;
+        }
+        num = strtol(qual_str, &end, 10);
+        if (end == qual_str || *end != '\0' || num < 0) return PAPI_EINVAL;
+        if (num >= (qual == APPIO_QUAL_FD ? APPIO_MAX_FDS : APPIO_HIST_BUCKETS))
+            return PAPI_EINVAL;
+        value = (int) num;
+    }
+
+    _appio_lib->enable(qual);
+
+    *EventCode = APPIO_CODE(index, qual, value);
+    return PAPI_OK;
 }
 
 
@@ -690,14 +553,35 @@ _appio_ntv_name_to_code( const char *name, unsigned int *EventCode )
 static int
 _appio_ntv_code_to_name( unsigned int EventCode, char *name, int len )
 {
-    int index = EventCode;
+    int index = APPIO_CODE_INDEX(EventCode);
+    int value = APPIO_CODE_VALUE(EventCode);
+    const char *base, *path;
 
-    if ( index >= 0 && index < APPIO_MAX_COUNTERS ) {
-        strncpy( name, _appio_counter_info[index].name, len );
-        return PAPI_OK;
+    if ( index < 0 || index >= APPIO_MAX_COUNTERS ) return PAPI_ENOEVNT;
+    base = _appio_counter_info[index].name;
+
+    switch (APPIO_CODE_QUAL(EventCode)) {
+        case APPIO_QUAL_NONE:
+            strncpy( name, base, len );
+            break;
+        case APPIO_QUAL_FD:
+            snprintf( name, len, "%s:fd=%d", base, value );
+            break;
+        case APPIO_QUAL_PATH:
+            if ((path = _appio_lib->path(value)) == NULL) return PAPI_ENOEVNT;
+            snprintf( name, len, "%s:path=%s", base, path );
+            break;
+        case APPIO_QUAL_USEC_LOG2:
+            snprintf( name, len, "%s:usec_log2=%d", base, value );
+            break;
+        case APPIO_QUAL_SIZE_LOG2:
+            snprintf( name, len, "%s:size_log2=%d", base, value );
+            break;
+        default:
+            return PAPI_ENOEVNT;
     }
 
-    return PAPI_ENOEVNT;
+    return PAPI_OK;
 }
 
 
@@ -707,14 +591,35 @@ _appio_ntv_code_to_name( unsigned int EventCode, char *name, int len )
 static int
 _appio_ntv_code_to_descr( unsigned int EventCode, char *desc, int len )
 {
-    int index = EventCode;
+    int index = APPIO_CODE_INDEX(EventCode);
+    int value = APPIO_CODE_VALUE(EventCode);
+    const char *base, *path;
 
-    if ( index >= 0 && index < APPIO_MAX_COUNTERS ) {
-        strncpy(desc, _appio_counter_info[index].description, len );
-        return PAPI_OK;
+    if ( index < 0 || index >= APPIO_MAX_COUNTERS ) return PAPI_ENOEVNT;
+    base = _appio_counter_info[index].description;
+
+    switch (APPIO_CODE_QUAL(EventCode)) {
+        case APPIO_QUAL_NONE:
+            strncpy(desc, base, len );
+            break;
+        case APPIO_QUAL_FD:
+            snprintf( desc, len, "%s on descriptor %d, all threads", base, value );
+            break;
+        case APPIO_QUAL_PATH:
+            if ((path = _appio_lib->path(value)) == NULL) return PAPI_ENOEVNT;
+            snprintf( desc, len, "%s on files under %s, all threads", base, path );
+            break;
+        case APPIO_QUAL_USEC_LOG2:
+            snprintf( desc, len, "%s taking [2^%d, 2^%d) usec", base, value, value + 1 );
+            break;
+        case APPIO_QUAL_SIZE_LOG2:
+            snprintf( desc, len, "%s of [2^%d, 2^%d) bytes", base, value, value + 1 );
+            break;
+        default:
+            return PAPI_ENOEVNT;
     }
 
-    return PAPI_ENOEVNT;
+    return PAPI_OK;
 }
 
 
@@ -724,7 +629,7 @@ _appio_ntv_code_to_descr( unsigned int EventCode, char *desc, int len )
 static int
 _appio_ntv_code_to_bits( unsigned int EventCode, hwd_register_t *bits )
 {
-    int index = EventCode;
+    int index = APPIO_CODE_INDEX(EventCode);
 
     if ( index >= 0 && index < APPIO_MAX_COUNTERS ) {
         memcpy( ( APPIO_register_t * ) bits,
@@ -29,7 +29,93 @@
 /*************************  DEFINES SECTION  ***********************************/
 
 /* Set this equal to the number of elements in _appio_counter_info array */
-#define APPIO_MAX_COUNTERS 45
+#define APPIO_MAX_COUNTERS 60
+
+/* Bounds of the per-descriptor and per-path statistics */
+#define APPIO_MAX_FDS      1024
+#define APPIO_MAX_PATHS    64
+
+/* log2 buckets of the latency and size histograms */
+#define APPIO_HIST_BUCKETS 32
+
+/* Event qualifiers: READ_BYTES:fd=7, READ_BYTES:path=/data, */
+/* READ_CALLS:usec_log2=4, READ_CALLS:size_log2=12           */
+#define APPIO_QUAL_NONE      0
+#define APPIO_QUAL_FD        1
+#define APPIO_QUAL_PATH      2
+#define APPIO_QUAL_USEC_LOG2 3
+#define APPIO_QUAL_SIZE_LOG2 4
+
+/* An event code holds the counter index, the qualifier and its value */
+#define APPIO_CODE(index, qual, value) \
+    ((unsigned int)(index) | ((unsigned int)(qual) << 8) | ((unsigned int)(value) << 12))
+#define APPIO_CODE_INDEX(code)  ((int)((code) & 0xff))
+#define APPIO_CODE_QUAL(code)   ((int)(((code) >> 8) & 0xf))
+#define APPIO_CODE_VALUE(code)  ((int)(((code) >> 12) & 0xffff))
+
+/* If you modify the _appio_stats_t below, you MUST update APPIO_MAX_COUNTERS */
+typedef enum {
+  READ_BYTES = 0,
+  READ_CALLS,
+  READ_ERR,
+  READ_INTERRUPTED,
+  READ_WOULD_BLOCK,
+  READ_SHORT,
+  READ_EOF,
+  READ_BLOCK_SIZE,
+  READ_USEC,
+  WRITE_BYTES,
+  WRITE_CALLS,
+  WRITE_ERR,
+  WRITE_SHORT,
+  WRITE_INTERRUPTED,
+  WRITE_WOULD_BLOCK,
+  WRITE_BLOCK_SIZE,
+  WRITE_USEC,
+  OPEN_CALLS,
+  OPEN_ERR,
+  OPEN_FDS,
+  SELECT_USEC,
+  RECV_BYTES,
+  RECV_CALLS,
+  RECV_ERR,
+  RECV_INTERRUPTED,
+  RECV_WOULD_BLOCK,
+  RECV_SHORT,
+  RECV_EOF,
+  RECV_BLOCK_SIZE,
+  RECV_USEC,
+  SOCK_READ_BYTES,
+  SOCK_READ_CALLS,
+  SOCK_READ_ERR,
+  SOCK_READ_SHORT,
+  SOCK_READ_WOULD_BLOCK,
+  SOCK_READ_USEC,
+  SOCK_WRITE_BYTES,
+  SOCK_WRITE_CALLS,
+  SOCK_WRITE_ERR,
+  SOCK_WRITE_SHORT,
+  SOCK_WRITE_WOULD_BLOCK,
+  SOCK_WRITE_USEC,
+  SEEK_CALLS,
+  SEEK_ABS_STRIDE_SIZE,
+  SEEK_USEC,
+  PREAD_CALLS,
+  PWRITE_CALLS,
+  READV_CALLS,
+  WRITEV_CALLS,
+  SEND_BYTES,
+  SEND_CALLS,
+  SEND_ERR,
+  SEND_USEC,
+  MMAP_CALLS,
+  MMAP_BYTES,
+  MUNMAP_CALLS,
+  IO_URING_SUBMITTED,
+  IO_URING_COMPLETED,
+  IO_URING_READ_BYTES,
+  IO_URING_WRITE_BYTES
+} _appio_stats_t ;
 
 /** Structure that stores private information of each event */
 typedef struct APPIO_register
@@ -65,11 +151,120 @@ typedef struct APPIO_reg_alloc
 typedef struct APPIO_control_state
 {
     int num_events;
-    int counter_bits[APPIO_MAX_COUNTERS];
+    unsigned int counter_bits[APPIO_MAX_COUNTERS]; // event codes
+    long long start_values[APPIO_MAX_COUNTERS]; // of the process-wide events
+    unsigned int start_epochs[APPIO_MAX_COUNTERS]; // of the fd= events
     long long values[APPIO_MAX_COUNTERS]; // used for caching
 } APPIO_control_state_t;
 
 
+/* Counters kept per descriptor and per path */
+typedef enum {
+    FD_READ_BYTES = 0,
+    FD_READ_CALLS,
+    FD_READ_ERR,
+    FD_READ_USEC,
+    FD_WRITE_BYTES,
+    FD_WRITE_CALLS,
+    FD_WRITE_ERR,
+    FD_WRITE_USEC,
+    APPIO_FD_COUNTERS
+} APPIO_fd_counter_t;
+
+typedef struct APPIO_fd_stats
+{
+    long long counts[APPIO_FD_COUNTERS];
+    unsigned int epoch; /* of the descriptor number the counts are for */
+} APPIO_fd_stats_t;
+
+/* Latency and size histograms of the calls.  Category and kind */
+/* are the first two indices.                                   */
+#define APPIO_HIST_READ   0
+#define APPIO_HIST_WRITE  1
+#define APPIO_HIST_RECV   2
+#define APPIO_HIST_SEEK   3
+#define APPIO_HIST_CATS   4
+#define APPIO_HIST_USEC   0
+#define APPIO_HIST_SIZE   1
+
+/* One per thread doing I/O, summed over all threads when read.  */
+/* The table of a thread that exits is taken over by a new one. */
+typedef struct APPIO_thread_stats
+{
+    struct APPIO_thread_stats *next;
+    int in_use;
+    APPIO_fd_stats_t fd[APPIO_MAX_FDS];
+    APPIO_fd_stats_t path[APPIO_MAX_PATHS];
+    long long hist[APPIO_HIST_CATS][2][APPIO_HIST_BUCKETS];
+} APPIO_thread_stats_t;
+
+/* Slot of a counter in APPIO_fd_stats_t, -1 if not kept per fd */
+static inline int
+appio_fd_slot( int index )
+{
+    switch (index) {
+        case READ_BYTES:  return FD_READ_BYTES;
+        case READ_CALLS:  return FD_READ_CALLS;
+        case READ_ERR:    return FD_READ_ERR;
+        case READ_USEC:   return FD_READ_USEC;
+        case WRITE_BYTES: return FD_WRITE_BYTES;
+        case WRITE_CALLS: return FD_WRITE_CALLS;
+        case WRITE_ERR:   return FD_WRITE_ERR;
+        case WRITE_USEC:  return FD_WRITE_USEC;
+    }
+    return -1;
+}
+
+/* Events read from the io_uring rings of the whole process */
+static inline int
+appio_is_uring( int index )
+{
+    return (index == IO_URING_SUBMITTED || index == IO_URING_COMPLETED ||
+            index == IO_URING_READ_BYTES || index == IO_URING_WRITE_BYTES);
+}
+
+/* Histogram category broken down by a *_CALLS event, -1 if none */
+static inline int
+appio_hist_cat( int index )
+{
+    switch (index) {
+        case READ_CALLS:  return APPIO_HIST_READ;
+        case WRITE_CALLS: return APPIO_HIST_WRITE;
+        case RECV_CALLS:  return APPIO_HIST_RECV;
+        case SEEK_CALLS:  return APPIO_HIST_SEEK;
+    }
+    return -1;
+}
+
+
+/* The replacements of the libc functions live in libpapi_appio, which */
+/* the program preloads or links.  The component only sees them        */
+/* through this table, exported by the library as papi_appio_lib.      */
+#define APPIO_LIB_VERSION 3
+
+typedef struct APPIO_lib
+{
+    int version;
+    /* Time the calls with now(), which counts cycles_per_usec per   */
+    /* microsecond.  Calls made before, or after fini(), take 0 usec. */
+    void (*init)( int detailed, long long (*now)( void ), long long cycles_per_usec );
+    void (*fini)( void );
+    /* Start keeping the statistics of a qualifier (APPIO_QUAL_*) */
+    void (*enable)( int qual );
+    /* Id of a path prefix, -1 if the table is full, and its name */
+    int (*register_path)( const char *prefix );
+    const char *(*path)( int id );
+    /* Clear the counters of the calling thread, find the io_uring */
+    /* rings if the counters include IO_URING_* events              */
+    void (*start)( int rings );
+    /* Current value of an event code in the calling thread */
+    long long (*value)( unsigned int code );
+    /* Changes when the descriptor of an fd= event is closed and its */
+    /* number used again, the value then restarts from 0             */
+    unsigned int (*epoch)( unsigned int code );
+} APPIO_lib_t;
+
+
 typedef struct APPIO_context
 {
     APPIO_control_state_t state;
@@ -0,0 +1,1564 @@
+/****************************/
+/* THIS IS OPEN SOURCE CODE */
+/****************************/
+
+/**
+ * @file    appio_lib.c
+ *
+ * @ingroup papi_components
+ *
+ * @brief appio wrapper library
+ *  This file contains the replacements of the libc I/O functions that
+ *  feed the appio component.  They are built into libpapi_appio rather
+ *  than into libpapi, so that only the programs that preload or link
+ *  libpapi_appio have their I/O intercepted.  The component reaches the
+ *  counters through the papi_appio_lib table at the end of this file.
+ *
+ *  Nothing in here calls into libpapi: the clock is handed over by the
+ *  component when it is initialized.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#include "appio.h"
+
+// The PIC test implies it's built for shared linkage
+#ifdef PIC
+#  include "dlfcn.h"
+#endif
+
+#if defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#    ifdef IORING_OFF_SQES
+#      define APPIO_IO_URING 1
+#    endif
+#  endif
+#endif
+
+/*********************************************************************
+ * Private
+ ********************************************************************/
+
+static __thread long long _appio_register_current[APPIO_MAX_COUNTERS];
+
+/* By default the interceptors keep their own overhead low: sockets   */
+/* are recognized through a per-fd cache and would-block is inferred  */
+/* from EAGAIN.  In detailed mode every call is probed with fstat()   */
+/* and a zero-timeout select().                                       */
+static int _appio_detailed = 0;
+
+/* The clock set by the component, and its ticks per microsecond.    */
+/* The *_USEC registers accumulate ticks and are only converted to   */
+/* microseconds when read.  Without a clock calls take no time.      */
+static long long (*volatile _appio_clock)( void ) = NULL;
+static volatile long long _appio_ticks_per_usec = 1;
+
+static inline long long
+appio_now( void )
+{
+  long long (*now)( void ) = _appio_clock;
+  return now ? now() : 0;
+}
+
+/* Ticks since start, 0 if the clock was set or unset in between */
+static inline long long
+appio_since( long long start )
+{
+  long long end;
+  if (!start) return 0;
+  end = appio_now();
+  return (end > start) ? end - start : 0;
+}
+
+static inline long long
+appio_usec( long long ticks )
+{
+  return ticks / _appio_ticks_per_usec;
+}
+
+/* Classification of the descriptors, indexed by fd.  Shared by all  */
+/* threads like the descriptors themselves.  Descriptors beyond the   */
+/* cache are classified with fstat() on every call.                  */
+#define APPIO_FD_CACHE_SIZE 4096
+#define APPIO_FD_UNKNOWN    0
+#define APPIO_FD_FILE       1
+#define APPIO_FD_SOCKET     2
+static volatile unsigned char _appio_fd_class[APPIO_FD_CACHE_SIZE];
+
+static inline void
+appio_fd_set_class( int fd, int cls )
+{
+  if (fd >= 0 && fd < APPIO_FD_CACHE_SIZE) _appio_fd_class[fd] = cls;
+}
+
+static int
+appio_is_socket( int fd )
+{
+  struct stat st;
+  int cls;
+
+  if (!_appio_detailed && fd >= 0 && fd < APPIO_FD_CACHE_SIZE) {
+    cls = _appio_fd_class[fd];
+    if (cls != APPIO_FD_UNKNOWN) return (cls == APPIO_FD_SOCKET);
+  }
+
+  /* Do not cache anything for descriptors fstat() does not know */
+  if (fstat(fd, &st) != 0) return 0;
+  cls = ((st.st_mode & S_IFMT) == S_IFSOCK) ? APPIO_FD_SOCKET : APPIO_FD_FILE;
+  appio_fd_set_class(fd, cls);
+
+  return (cls == APPIO_FD_SOCKET);
+}
+
+/* Is the *_USEC register at index holding clock ticks? */
+static inline int
+appio_is_usec( int index )
+{
+  return (index == READ_USEC || index == WRITE_USEC || index == SELECT_USEC ||
+          index == RECV_USEC || index == SOCK_READ_USEC ||
+          index == SOCK_WRITE_USEC || index == SEEK_USEC || index == SEND_USEC);
+}
+
+/* Latency and size histograms of the calls are kept in the thread */
+/* tables below, and only filled in once a histogram event has been */
+/* named.                                                           */
+static volatile int _appio_histograms = 0;
+
+/* Bucket k holds values in [2^k, 2^(k+1)), bucket 0 also holds 0 */
+static inline int
+appio_log2( long long value )
+{
+  int bucket;
+  if (value < 2) return 0;
+  bucket = 63 - __builtin_clzll((unsigned long long) value);
+  return (bucket < APPIO_HIST_BUCKETS) ? bucket : APPIO_HIST_BUCKETS - 1;
+}
+
+/* Per-descriptor and per-path statistics are off until a qualified */
+/* event asks for them.                                             */
+static volatile int _appio_per_fd = 0;
+
+/* List of all the thread tables, only ever grows */
+static APPIO_thread_stats_t *_appio_all_stats;
+static __thread APPIO_thread_stats_t *_appio_my_stats;
+static pthread_key_t _appio_stats_key;
+static pthread_once_t _appio_stats_once = PTHREAD_ONCE_INIT;
+
+/* The path prefixes named by events, and the prefix (id+1, 0 for */
+/* none) each descriptor was opened under.  Prefixes are added    */
+/* with _appio_path_lock held and never change once published.    */
+static char _appio_paths[APPIO_MAX_PATHS][PATH_MAX];
+static int _appio_num_paths;
+static volatile unsigned char _appio_fd_path[APPIO_MAX_FDS];
+static pthread_mutex_t _appio_path_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A number that was closed starts a new epoch with its next I/O;   */
+/* the per-fd counts of the earlier epochs are no longer summed.    */
+static unsigned int _appio_fd_epoch[APPIO_MAX_FDS];
+static unsigned char _appio_fd_stale[APPIO_MAX_FDS];
+
+static void
+appio_release_stats( void *arg )
+{
+  APPIO_thread_stats_t *t = (APPIO_thread_stats_t *) arg;
+  __atomic_store_n(&t->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void
+appio_make_stats_key( void )
+{
+  pthread_key_create(&_appio_stats_key, appio_release_stats);
+}
+
+/* The statistics table of the calling thread */
+static APPIO_thread_stats_t *
+appio_thread_stats( void )
+{
+  APPIO_thread_stats_t *t = _appio_my_stats;
+  int unused;
+
+  if (t) return t;
+
+  pthread_once(&_appio_stats_once, appio_make_stats_key);
+
+  /* Take over the table of a thread that has exited */
+  for (t = __atomic_load_n(&_appio_all_stats, __ATOMIC_ACQUIRE); t; t = t->next) {
+    unused = 0;
+    if (__atomic_compare_exchange_n(&t->in_use, &unused, 1, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) break;
+  }
+
+  if (t == NULL) {
+    t = calloc(1, sizeof(APPIO_thread_stats_t));
+    if (t == NULL) return NULL;
+    t->in_use = 1;
+    t->next = __atomic_load_n(&_appio_all_stats, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&_appio_all_stats, &t->next, t, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  }
+
+  pthread_setspecific(_appio_stats_key, t);
+  _appio_my_stats = t;
+
+  return t;
+}
+
+static inline void
+appio_hist_add( int cat, long long size, long long duration )
+{
+  APPIO_thread_stats_t *t;
+  int saved_errno = errno;
+
+  if (!_appio_histograms) return;
+  if ((t = appio_thread_stats()) == NULL) return;
+  duration = appio_usec(duration);
+  t->hist[cat][APPIO_HIST_USEC][appio_log2(duration)]++;
+  t->hist[cat][APPIO_HIST_SIZE][appio_log2(size)]++;
+  errno = saved_errno;
+}
+
+/* The next I/O on fd is on another descriptor */
+static inline void
+appio_fd_stale( int fd )
+{
+  if (fd >= 0 && fd < APPIO_MAX_FDS)
+    __atomic_store_n(&_appio_fd_stale[fd], 1, __ATOMIC_RELAXED);
+}
+
+/* Current epoch of fd, a new one if it was closed since its last I/O */
+static inline unsigned int
+appio_fd_epoch( int fd )
+{
+  if (__atomic_load_n(&_appio_fd_stale[fd], __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(&_appio_fd_stale[fd], 0, __ATOMIC_ACQ_REL))
+    return __atomic_add_fetch(&_appio_fd_epoch[fd], 1, __ATOMIC_ACQ_REL);
+  return __atomic_load_n(&_appio_fd_epoch[fd], __ATOMIC_ACQUIRE);
+}
+
+/* Account a read (write=0) or write (write=1) call on fd */
+static void
+appio_fd_add( int fd, int write, long long retval, long long duration )
+{
+  APPIO_thread_stats_t *t;
+  long long *c, *p = NULL;
+  int saved_errno = errno;
+  int base = write ? FD_WRITE_BYTES : FD_READ_BYTES;
+  unsigned int epoch;
+  int path, i;
+
+  if (!_appio_per_fd || fd < 0 || fd >= APPIO_MAX_FDS) return;
+  if ((t = appio_thread_stats()) == NULL) return;
+
+  /* only this thread writes its table, the counts of an earlier */
+  /* descriptor with the same number are dropped here            */
+  epoch = appio_fd_epoch(fd);
+  if (t->fd[fd].epoch != epoch) {
+    memset(t->fd[fd].counts, 0, sizeof(t->fd[fd].counts));
+    t->fd[fd].epoch = epoch;
+  }
+
+  c = t->fd[fd].counts + base;
+  path = _appio_fd_path[fd];
+  if (path) p = t->path[path - 1].counts + base;
+
+  /* BYTES, CALLS, ERR and USEC follow each other for both directions */
+  for (i = 0; i < (p ? 2 : 1); i++, c = p) {
+    c[FD_READ_CALLS - FD_READ_BYTES]++;
+    if (retval > 0) {
+      c[FD_READ_BYTES - FD_READ_BYTES] += retval;
+      c[FD_READ_USEC - FD_READ_BYTES] += duration;
+    }
+    if (retval < 0) c[FD_READ_ERR - FD_READ_BYTES]++;
+  }
+
+  errno = saved_errno;
+}
+
+/* Sum of a per-fd (qual APPIO_QUAL_FD), per-path or histogram */
+/* counter over all threads                                      */
+static long long
+appio_merged_value( int qual, int id, int slot )
+{
+  APPIO_thread_stats_t *t;
+  unsigned int epoch = 0;
+  long long sum = 0;
+
+  if (qual == APPIO_QUAL_FD) epoch = __atomic_load_n(&_appio_fd_epoch[id], __ATOMIC_ACQUIRE);
+
+  for (t = __atomic_load_n(&_appio_all_stats, __ATOMIC_ACQUIRE); t; t = t->next) {
+    switch (qual) {
+      case APPIO_QUAL_FD:
+        if (t->fd[id].epoch == epoch) sum += t->fd[id].counts[slot];
+        break;
+      case APPIO_QUAL_PATH:
+        sum += t->path[id].counts[slot];
+        break;
+      case APPIO_QUAL_USEC_LOG2:
+        sum += t->hist[slot][APPIO_HIST_USEC][id];
+        break;
+      case APPIO_QUAL_SIZE_LOG2:
+        sum += t->hist[slot][APPIO_HIST_SIZE][id];
+        break;
+    }
+  }
+
+  return sum;
+}
+
+/* Does path fall under the registered prefix? */
+static int
+appio_path_matches( const char *path, const char *prefix )
+{
+  size_t len = strlen(prefix);
+
+  if (strncmp(path, prefix, len)) return 0;
+  return (path[len] == '\0' || path[len] == '/' || prefix[len - 1] == '/');
+}
+
+/* Prefix id+1 of the longest registered prefix of path, 0 if none */
+static int
+appio_match_path( const char *path )
+{
+  int i, n, best = 0;
+  size_t len, best_len = 0;
+
+  n = __atomic_load_n(&_appio_num_paths, __ATOMIC_ACQUIRE);
+  for (i = 0; i < n; i++) {
+    len = strlen(_appio_paths[i]);
+    if (len > best_len && appio_path_matches(path, _appio_paths[i])) {
+      best = i + 1;
+      best_len = len;
+    }
+  }
+
+  return best;
+}
+
+/* Record the prefix of a descriptor that was just opened */
+static inline void
+appio_fd_set_path( int fd, int path )
+{
+  if (fd >= 0 && fd < APPIO_MAX_FDS) _appio_fd_path[fd] = path;
+}
+
+static inline int
+appio_fd_get_path( int fd )
+{
+  return (fd >= 0 && fd < APPIO_MAX_FDS) ? _appio_fd_path[fd] : 0;
+}
+
+/* Prefix of a path passed to open(), relative ones are made absolute */
+static int
+appio_open_path( const char *pathname )
+{
+  char cwd[PATH_MAX], full[PATH_MAX];
+  int saved_errno = errno;
+  int path = 0;
+
+  if (!_appio_per_fd || !__atomic_load_n(&_appio_num_paths, __ATOMIC_ACQUIRE))
+    return 0;
+
+  if (pathname[0] == '/') {
+    path = appio_match_path(pathname);
+  } else if (getcwd(cwd, sizeof(cwd)) != NULL &&
+             snprintf(full, sizeof(full), "%s/%s", cwd, pathname) < (int) sizeof(full)) {
+    path = appio_match_path(full);
+  }
+
+  errno = saved_errno;
+  return path;
+}
+
+/* Register a path prefix, returns its id or -1 if the table is full. */
+/* Descriptors that are already open are matched through /proc.       */
+static int
+appio_register_path( const char *prefix )
+{
+  char target[PATH_MAX], link[PATH_MAX];
+  struct dirent *de;
+  DIR *dir;
+  size_t len;
+  ssize_t ret;
+  int i, id = -1, fd;
+
+  len = strlen(prefix);
+  while (len > 1 && prefix[len - 1] == '/') len--;
+  if (len == 0 || len >= PATH_MAX) return -1;
+
+  pthread_mutex_lock(&_appio_path_lock);
+
+  for (i = 0; i < _appio_num_paths; i++) {
+    if (strlen(_appio_paths[i]) == len && !strncmp(_appio_paths[i], prefix, len)) {
+      id = i;
+      break;
+    }
+  }
+
+  if (id < 0 && _appio_num_paths < APPIO_MAX_PATHS) {
+    id = _appio_num_paths;
+    memcpy(_appio_paths[id], prefix, len);
+    _appio_paths[id][len] = '\0';
+    __atomic_store_n(&_appio_num_paths, id + 1, __ATOMIC_RELEASE);
+
+    dir = opendir("/proc/self/fd");
+    while (dir && (de = readdir(dir)) != NULL) {
+      fd = atoi(de->d_name);
+      if (!isdigit(de->d_name[0]) || fd >= APPIO_MAX_FDS) continue;
+      snprintf(link, sizeof(link), "/proc/self/fd/%s", de->d_name);
+      ret = readlink(link, target, sizeof(target) - 1);
+      if (ret <= 0) continue;
+      target[ret] = '\0';
+      if (appio_match_path(target) == id + 1) appio_fd_set_path(fd, id + 1);
+    }
+    if (dir) closedir(dir);
+  }
+
+  pthread_mutex_unlock(&_appio_path_lock);
+
+  return id;
+}
+
+/* The libc functions behind the replacements.  Those libc exports    */
+/* under a second name are called directly, the others are looked up  */
+/* once when the library is loaded.                                   */
+int __close(int fd);
+int __open(const char *pathname, int flags, ...);
+int __select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+off_t __lseek(int fd, off_t offset, int whence);
+ssize_t __read(int fd, void *buf, size_t count);
+ssize_t __pread64(int fd, void *buf, size_t count, __off64_t offset);
+ssize_t __write(int fd, const void *buf, size_t count);
+ssize_t __pwrite64(int fd, const void *buf, size_t count, __off64_t offset);
+size_t _IO_fread(void *ptr, size_t size, size_t nmemb, FILE *stream);
+size_t _IO_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream);
+int _IO_fclose(FILE *stream);
+int __pipe(int pipefd[2]);
+
+#ifdef PIC
+static struct {
+  ssize_t (*recv)(int sockfd, void *buf, size_t len, int flags);
+  ssize_t (*recvfrom)(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen);
+  ssize_t (*recvmsg)(int sockfd, struct msghdr *msg, int flags);
+  ssize_t (*send)(int sockfd, const void *buf, size_t len, int flags);
+  ssize_t (*sendto)(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen);
+  ssize_t (*sendmsg)(int sockfd, const struct msghdr *msg, int flags);
+  ssize_t (*readv)(int fd, const struct iovec *iov, int iovcnt);
+  ssize_t (*writev)(int fd, const struct iovec *iov, int iovcnt);
+  ssize_t (*preadv2)(int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags);
+  ssize_t (*pwritev2)(int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags);
+  void *(*mmap)(void *addr, size_t length, int prot, int flags, int fd, __off64_t offset);
+  int (*munmap)(void *addr, size_t length);
+  int (*socket)(int domain, int type, int protocol);
+  int (*accept)(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+  int (*accept4)(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+  int (*dup)(int oldfd);
+  int (*dup2)(int oldfd, int newfd);
+  int (*dup3)(int oldfd, int newfd, int flags);
+  int (*pipe2)(int pipefd[2], int flags);
+  int (*socketpair)(int domain, int type, int protocol, int sv[2]);
+  int (*closedir)(DIR *dirp);
+} _appio_real;
+
+static pthread_once_t _appio_real_once = PTHREAD_ONCE_INIT;
+
+#define APPIO_RESOLVE(field, name) \
+  *(void **) (&_appio_real.field) = dlsym(RTLD_NEXT, name)
+
+static void
+appio_resolve( void )
+{
+  APPIO_RESOLVE(recv, "recv");
+  APPIO_RESOLVE(recvfrom, "recvfrom");
+  APPIO_RESOLVE(recvmsg, "recvmsg");
+  APPIO_RESOLVE(send, "send");
+  APPIO_RESOLVE(sendto, "sendto");
+  APPIO_RESOLVE(sendmsg, "sendmsg");
+  APPIO_RESOLVE(readv, "readv");
+  APPIO_RESOLVE(writev, "writev");
+  APPIO_RESOLVE(preadv2, "preadv64v2");
+  APPIO_RESOLVE(pwritev2, "pwritev64v2");
+  APPIO_RESOLVE(munmap, "munmap");
+  APPIO_RESOLVE(socket, "socket");
+  APPIO_RESOLVE(accept, "accept");
+  APPIO_RESOLVE(accept4, "accept4");
+  APPIO_RESOLVE(dup, "dup");
+  APPIO_RESOLVE(dup2, "dup2");
+  APPIO_RESOLVE(dup3, "dup3");
+  APPIO_RESOLVE(pipe2, "pipe2");
+  APPIO_RESOLVE(socketpair, "socketpair");
+  APPIO_RESOLVE(closedir, "closedir");
+  APPIO_RESOLVE(mmap, "mmap64");
+}
+
+static void __attribute__((constructor))
+appio_lib_load( void )
+{
+  pthread_once(&_appio_real_once, appio_resolve);
+}
+
+/* Make sure the libc function is known, for calls made before the */
+/* library is initialized.  A function libc does not have fails     */
+/* the call with ENOSYS.                                            */
+#define APPIO_REAL(field, fail) \
+  do { \
+    if (_appio_real.field == NULL) { \
+      pthread_once(&_appio_real_once, appio_resolve); \
+      if (_appio_real.field == NULL) { \
+        errno = ENOSYS; \
+        return fail; \
+      } \
+    } \
+  } while (0)
+
+/* An allocator may map memory while dlsym() runs, so mmap and munmap */
+/* never wait for the lookup and go to the system call until then.    */
+static void *
+appio_real_mmap( void *addr, size_t length, int prot, int flags, int fd, __off64_t offset )
+{
+  if (_appio_real.mmap) return _appio_real.mmap(addr, length, prot, flags, fd, offset);
+#if defined(__x86_64__) || defined(__aarch64__) || defined(__powerpc64__)
+  return (void *) syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+#else
+  errno = ENOSYS;
+  return MAP_FAILED;
+#endif
+}
+
+static int
+appio_real_munmap( void *addr, size_t length )
+{
+  if (_appio_real.munmap) return _appio_real.munmap(addr, length);
+  return (int) syscall(SYS_munmap, addr, length);
+}
+#endif /* PIC */
+
+/* The io_uring rings of the process, with their fdinfo open.  They */
+/* are looked for in /proc/self/fd when counters of a ring event    */
+/* are started and, in the shared library, when a ring is mapped,   */
+/* so that only the fdinfo of known rings is read with the counters. */
+#define APPIO_MAX_RINGS 16
+static struct appio_ring {
+  int fd_plus_one;              /* 0 if free */
+  int info_fd;
+  unsigned long ino;            /* of the ring, as in /proc/self/maps */
+  unsigned int mask;            /* SqMask */
+  unsigned int head;            /* SqHead the bytes are counted up to */
+  int sqe_shift;                /* 1 with 128-byte SQEs */
+  void *sqes;                   /* mapping of the SQEs, NULL if unknown */
+} _appio_rings[APPIO_MAX_RINGS];
+static volatile int _appio_num_rings;
+static pthread_mutex_t _appio_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Bytes requested by the SQEs of all the rings, closed ones included */
+static long long _appio_ring_bytes[2];
+
+static int
+appio_is_ring( int fd )
+{
+  char link[64], target[64];
+  ssize_t ret;
+
+  snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+  ret = readlink(link, target, sizeof(target) - 1);
+  if (ret <= 0) return 0;
+  target[ret] = '\0';
+  return !strcmp(target, "anon_inode:[io_uring]");
+}
+
+/* The fdinfo of a ring in buf, 0 if it cannot be read */
+static int
+appio_ring_info( struct appio_ring *ring, char *buf, size_t size )
+{
+  ssize_t ret = __pread64(ring->info_fd, buf, size - 1, 0);
+  if (ret <= 0) return 0;
+  buf[ret] = '\0';
+  return 1;
+}
+
+static int
+appio_info_field( const char *info, const char *key, int base, unsigned long *value )
+{
+  const char *line = strstr(info, key);
+  if (line == NULL) return 0;
+  *value = strtoul(line + strlen(key), NULL, base);
+  return 1;
+}
+
+/* Record where the SQEs of the ring are mapped; the length tells */
+/* 64 from 128-byte SQEs, as far as page rounding lets it.         */
+static void
+appio_ring_set_sqes( struct appio_ring *ring, void *addr, size_t length )
+{
+  size_t plain = ((size_t) ring->mask + 1) * 64;
+  size_t page = getpagesize();
+
+  ring->sqe_shift = (length == 2 * plain || length > (plain + page - 1) / page * page);
+  ring->sqes = addr;
+}
+
+/* Start following ring fd, called with _appio_ring_lock held */
+static struct appio_ring *
+appio_ring_add( int fd )
+{
+  struct appio_ring *ring;
+  unsigned long value;
+  char info[64], buf[1024];
+  int i, free_slot = -1;
+
+  for (i = 0; i < APPIO_MAX_RINGS; i++) {
+    if (_appio_rings[i].fd_plus_one == fd + 1) return &_appio_rings[i];
+    if (!_appio_rings[i].fd_plus_one && free_slot < 0) free_slot = i;
+  }
+  if (free_slot < 0) return NULL;
+  ring = &_appio_rings[free_slot];
+
+  snprintf(info, sizeof(info), "/proc/self/fdinfo/%d", fd);
+  ring->info_fd = __open(info, O_RDONLY | O_CLOEXEC);
+  if (ring->info_fd < 0) return NULL;
+  ring->ino = 0;
+  ring->mask = 0;
+  ring->head = 0;
+  ring->sqes = NULL;
+  if (appio_ring_info(ring, buf, sizeof(buf))) {
+    if (appio_info_field(buf, "ino:", 10, &value)) ring->ino = value;
+    if (appio_info_field(buf, "SqMask:", 16, &value)) ring->mask = value;
+    if (appio_info_field(buf, "SqHead:", 10, &value)) ring->head = value;
+  }
+  ring->fd_plus_one = fd + 1;
+  _appio_num_rings++;
+  return ring;
+}
+
+#ifdef APPIO_IO_URING
+/* Called with _appio_ring_lock held */
+static void
+appio_ring_maps_line( const char *line )
+{
+  unsigned long start, end, ino;
+  unsigned long long offset;
+  struct appio_ring *found = NULL;
+  int i, matches = 0;
+
+  if (strstr(line, "anon_inode:[io_uring]") == NULL) return;
+  if (sscanf(line, "%lx-%lx %*s %llx %*s %lu", &start, &end, &offset, &ino) != 4) return;
+  if (offset != IORING_OFF_SQES) return;
+
+  /* Before rings had an inode each, their mappings cannot be told apart */
+  for (i = 0; i < APPIO_MAX_RINGS; i++) {
+    if (!_appio_rings[i].fd_plus_one || _appio_rings[i].ino != ino) continue;
+    found = &_appio_rings[i];
+    matches++;
+  }
+  if (matches == 1 && found->sqes == NULL)
+    appio_ring_set_sqes(found, (void *) start, end - start);
+}
+
+/* Find the SQEs of the rings that were mapped before they were     */
+/* known, or without mmap().  Called with _appio_ring_lock held.    */
+static void
+appio_ring_find_sqes( void )
+{
+  char buf[4096], *line, *end;
+  size_t len = 0;
+  ssize_t ret;
+  int i, fd;
+
+  for (i = 0; i < APPIO_MAX_RINGS; i++)
+    if (_appio_rings[i].fd_plus_one && _appio_rings[i].sqes == NULL) break;
+  if (i == APPIO_MAX_RINGS) return;
+
+  fd = __open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return;
+
+  while ((ret = __read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+    len += ret;
+    buf[len] = '\0';
+    line = buf;
+    while ((end = strchr(line, '\n')) != NULL) {
+      *end = '\0';
+      appio_ring_maps_line(line);
+      line = end + 1;
+    }
+    len -= line - buf;
+    /* a line too long for the buffer is not a ring */
+    if (len == sizeof(buf) - 1) len = 0;
+    memmove(buf, line, len);
+  }
+
+  __close(fd);
+}
+#endif
+
+static void
+appio_ring_scan( void )
+{
+  struct dirent *de;
+  DIR *dir;
+
+  dir = opendir("/proc/self/fd");
+  if (dir == NULL) return;
+
+  pthread_mutex_lock(&_appio_ring_lock);
+  while ((de = readdir(dir)) != NULL) {
+    if (!isdigit(de->d_name[0])) continue;
+    if (appio_is_ring(atoi(de->d_name))) appio_ring_add(atoi(de->d_name));
+  }
+#ifdef APPIO_IO_URING
+  appio_ring_find_sqes();
+#endif
+  pthread_mutex_unlock(&_appio_ring_lock);
+
+  closedir(dir);
+}
+
+static void
+appio_ring_close( int fd )
+{
+  int i;
+
+  if (!_appio_num_rings) return;
+
+  pthread_mutex_lock(&_appio_ring_lock);
+  for (i = 0; i < APPIO_MAX_RINGS; i++) {
+    if (_appio_rings[i].fd_plus_one != fd + 1) continue;
+    __close(_appio_rings[i].info_fd);
+    _appio_rings[i].fd_plus_one = 0;
+    _appio_num_rings--;
+  }
+  pthread_mutex_unlock(&_appio_ring_lock);
+}
+
+/* Add up the bytes requested by the SQEs the kernel consumed since  */
+/* the last time, up to head.  The slots are taken as the SQ array   */
+/* that liburing sets up, slot i holding SQE i.  The application may */
+/* have reused the slots of older SQEs, only the last ring size are  */
+/* still there.  The iovec of a vectored request may be gone, those  */
+/* are not counted.  Called with _appio_ring_lock held.              */
+static void
+appio_ring_account( struct appio_ring *ring, unsigned int head )
+{
+#ifdef APPIO_IO_URING
+  const struct io_uring_sqe *sqe;
+  unsigned int pos = ring->head;
+
+  if (ring->sqes == NULL) {
+    ring->head = head;
+    return;
+  }
+  if (head - pos > ring->mask + 1) pos = head - (ring->mask + 1);
+
+  for (; pos != head; pos++) {
+    sqe = (const struct io_uring_sqe *) ring->sqes + ((pos & ring->mask) << ring->sqe_shift);
+    switch (__atomic_load_n(&sqe->opcode, __ATOMIC_RELAXED)) {
+      case IORING_OP_READ:
+      case IORING_OP_READ_FIXED:
+      case IORING_OP_RECV:
+        _appio_ring_bytes[0] += sqe->len;
+        break;
+      case IORING_OP_WRITE:
+      case IORING_OP_WRITE_FIXED:
+      case IORING_OP_SEND:
+        _appio_ring_bytes[1] += sqe->len;
+        break;
+    }
+  }
+#endif
+  ring->head = head;
+}
+
+/* Submissions consumed and completions posted on all the known     */
+/* rings, or the bytes they requested.  A ring that is closed while */
+/* counting drops out of the submissions and completions.           */
+static long long
+appio_uring_total( int index )
+{
+  const char *key = (index == IO_URING_COMPLETED) ? "CqTail:" : "SqHead:";
+  unsigned long value;
+  long long total = 0;
+  char buf[1024];
+  int i;
+
+  if (!_appio_num_rings) {
+    if (index == IO_URING_READ_BYTES) return _appio_ring_bytes[0];
+    if (index == IO_URING_WRITE_BYTES) return _appio_ring_bytes[1];
+    return 0;
+  }
+
+  pthread_mutex_lock(&_appio_ring_lock);
+  for (i = 0; i < APPIO_MAX_RINGS; i++) {
+    if (!_appio_rings[i].fd_plus_one) continue;
+    if (!appio_ring_info(&_appio_rings[i], buf, sizeof(buf))) continue;
+    if (!appio_info_field(buf, key, 10, &value)) continue;
+    if (index == IO_URING_SUBMITTED || index == IO_URING_COMPLETED)
+      total += (unsigned int) value;
+    else
+      appio_ring_account(&_appio_rings[i], (unsigned int) value);
+  }
+  if (index == IO_URING_READ_BYTES) total = _appio_ring_bytes[0];
+  if (index == IO_URING_WRITE_BYTES) total = _appio_ring_bytes[1];
+  pthread_mutex_unlock(&_appio_ring_lock);
+
+  return total;
+}
+
+/*********************************************************************
+ ***  REPLACEMENTS OF THE LIBC FUNCTIONS                          ****
+ ********************************************************************/
+
+/* The library is built with hidden visibility, the replacements must */
+/* be exported to take the place of the libc functions.               */
+#pragma GCC visibility push(default)
+
+/* Forget what is known of a descriptor that was closed.  Every    */
+/* call that closes descriptors has to come here, or their number   */
+/* may be reused with a stale classification.                       */
+static void
+appio_fd_closed( int fd )
+{
+  appio_fd_set_class(fd, APPIO_FD_UNKNOWN);
+  appio_fd_set_path(fd, 0);
+  appio_fd_stale(fd);
+  appio_ring_close(fd);
+}
+
+int close(int fd) {
+  int retval;
+  retval = __close(fd);
+  if (retval == 0) appio_fd_closed(fd);
+  if ((retval == 0) && (_appio_register_current[OPEN_FDS]>0)) _appio_register_current[OPEN_FDS]--;
+  return retval;
+}
+
+/* libc closes the descriptor of a stream internally */
+int fclose(FILE *stream) {
+  int fd = fileno(stream);
+  int retval = _IO_fclose(stream);
+  /* the descriptor is gone even if flushing failed */
+  if (fd >= 0) appio_fd_closed(fd);
+  return retval;
+}
+
+/* Pipes are files, as far as SOCK_* is concerned */
+int pipe(int pipefd[2]) {
+  int retval = __pipe(pipefd);
+  if (retval == 0) {
+    appio_fd_set_class(pipefd[0], APPIO_FD_FILE);
+    appio_fd_set_class(pipefd[1], APPIO_FD_FILE);
+  }
+  return retval;
+}
+
+int open(const char *pathname, int flags, ...) {
+  mode_t mode = 0;
+  va_list ap;
+  int retval;
+
+  /* the mode is only passed when a file may be created */
+  if (flags & (O_CREAT | O_TMPFILE)) {
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+  retval = __open(pathname,flags,mode);
+  _appio_register_current[OPEN_CALLS]++;
+  if (retval < 0) _appio_register_current[OPEN_ERR]++;
+  else {
+    _appio_register_current[OPEN_FDS]++;
+    /* sockets cannot be opened, fifos and devices count as files */
+    appio_fd_set_class(retval, APPIO_FD_FILE);
+    appio_fd_set_path(retval, appio_open_path(pathname));
+  }
+  return retval;
+}
+
+/* we use timeval as a zero value timeout to select in read/write
+   for polling if the operation would block */
+static struct timeval zerotv; /* this has to be zero, so define it here */
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) {
+  int retval;
+  long long start_ts = appio_now();
+  retval = __select(nfds,readfds,writefds,exceptfds,timeout);
+  long long duration = appio_since(start_ts);
+  _appio_register_current[SELECT_USEC] += duration;
+  return retval;
+}
+
+off_t lseek(int fd, off_t offset, int whence) {
+  off_t retval;
+  long long start_ts = appio_now();
+  retval = __lseek(fd, offset, whence);
+  long long duration = appio_since(start_ts);
+  int n = _appio_register_current[SEEK_CALLS]++;
+  _appio_register_current[SEEK_USEC] += duration;
+  if (offset < 0) offset = -offset; // get abs offset
+  appio_hist_add(APPIO_HIST_SEEK, offset, duration);
+  _appio_register_current[SEEK_ABS_STRIDE_SIZE]= (n * _appio_register_current[SEEK_ABS_STRIDE_SIZE] + offset)/(n+1); // mean absolute stride size
+  return retval;
+}
+
+/* Bookkeeping shared by the read, write, recv and send families.   */
+/* count is the number of bytes requested, errno is the one left by */
+/* the call.                                                        */
+static void
+appio_account_read( int fd, size_t count, ssize_t retval, long long duration, int issocket )
+{
+  int n = _appio_register_current[READ_CALLS]++; // read calls
+  if (issocket) _appio_register_current[SOCK_READ_CALLS]++; // read calls
+  if (retval > 0) {
+    _appio_register_current[READ_BLOCK_SIZE]= (n * _appio_register_current[READ_BLOCK_SIZE] + count)/(n+1); // mean size
+    _appio_register_current[READ_BYTES] += retval; // read bytes
+    if (issocket) _appio_register_current[SOCK_READ_BYTES] += retval;
+    if (retval < (ssize_t)count) {
+       _appio_register_current[READ_SHORT]++; // read short
+       if (issocket) _appio_register_current[SOCK_READ_SHORT]++; // read short
+    }
+    _appio_register_current[READ_USEC] += duration;
+    if (issocket) _appio_register_current[SOCK_READ_USEC] += duration;
+  }
+  if (retval < 0) {
+    _appio_register_current[READ_ERR]++; // read err
+    if (issocket) _appio_register_current[SOCK_READ_ERR]++; // read err
+    if (EINTR == errno)
+      _appio_register_current[READ_INTERRUPTED]++; // signal interrupted the read
+    if (!_appio_detailed && ((EAGAIN == errno) || (EWOULDBLOCK == errno))) {
+      _appio_register_current[READ_WOULD_BLOCK]++; //read would block on descriptor marked as non-blocking
+      if (issocket) _appio_register_current[SOCK_READ_WOULD_BLOCK]++; //read would block on descriptor marked as non-blocking
+    }
+  }
+  if (retval == 0) _appio_register_current[READ_EOF]++; // read eof
+  appio_hist_add(APPIO_HIST_READ, count, duration);
+  appio_fd_add(fd, 0, retval, duration);
+}
+
+static void
+appio_account_write( int fd, size_t count, ssize_t retval, long long duration, int issocket )
+{
+  int n = _appio_register_current[WRITE_CALLS]++; // write calls
+  if (issocket) _appio_register_current[SOCK_WRITE_CALLS]++; // socket write
+  if (retval >= 0) {
+    _appio_register_current[WRITE_BLOCK_SIZE]= (n * _appio_register_current[WRITE_BLOCK_SIZE] + count)/(n+1); // mean size
+    _appio_register_current[WRITE_BYTES]+= retval; // write bytes
+    if (issocket) _appio_register_current[SOCK_WRITE_BYTES] += retval;
+    if (retval < (ssize_t)count) {
+      _appio_register_current[WRITE_SHORT]++; // short write
+      if (issocket) _appio_register_current[SOCK_WRITE_SHORT]++;
+    }
+    _appio_register_current[WRITE_USEC] += duration;
+    if (issocket) _appio_register_current[SOCK_WRITE_USEC] += duration;
+  }
+  if (retval < 0) {
+    _appio_register_current[WRITE_ERR]++; // err
+    if (issocket) _appio_register_current[SOCK_WRITE_ERR]++;
+    if (EINTR == errno)
+      _appio_register_current[WRITE_INTERRUPTED]++; // signal interrupted the op
+    if (!_appio_detailed && ((EAGAIN == errno) || (EWOULDBLOCK == errno))) {
+      _appio_register_current[WRITE_WOULD_BLOCK]++; //op would block on descriptor marked as non-blocking
+      if (issocket) _appio_register_current[SOCK_WRITE_WOULD_BLOCK]++;
+    }
+  }
+  appio_hist_add(APPIO_HIST_WRITE, count, duration);
+  appio_fd_add(fd, 1, retval, duration);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+  int retval;
+
+  int issocket = appio_is_socket(fd);
+  if (_appio_detailed) {
+    // check if read would block on descriptor
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(fd, &readfds);
+    int ready = __select(fd+1, &readfds, NULL, NULL, &zerotv);
+    if (ready == 0) {
+       _appio_register_current[READ_WOULD_BLOCK]++;
+       if (issocket) _appio_register_current[SOCK_READ_WOULD_BLOCK]++;
+    }
+  }
+
+  long long start_ts = appio_now();
+  retval = __read(fd,buf, count);
+  long long duration = appio_since(start_ts);
+  appio_account_read(fd, count, retval, duration, issocket);
+  return retval;
+}
+
+/* Positional reads and writes cannot be done on sockets and pipes */
+static ssize_t
+appio_pread( int fd, void *buf, size_t count, __off64_t offset )
+{
+  ssize_t retval;
+  long long start_ts = appio_now();
+  retval = __pread64(fd, buf, count, offset);
+  long long duration = appio_since(start_ts);
+  _appio_register_current[PREAD_CALLS]++;
+  appio_account_read(fd, count, retval, duration, 0);
+  return retval;
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+  return appio_pread(fd, buf, count, offset);
+}
+
+ssize_t pread64(int fd, void *buf, size_t count, __off64_t offset) {
+  return appio_pread(fd, buf, count, offset);
+}
+
+size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
+  size_t retval;
+  long long start_ts = appio_now();
+  retval = _IO_fread(ptr,size,nmemb,stream);
+  long long duration = appio_since(start_ts);
+  int n = _appio_register_current[READ_CALLS]++; // read calls
+  if (retval > 0) {
+    _appio_register_current[READ_BLOCK_SIZE]= (n * _appio_register_current[READ_BLOCK_SIZE]+ size*nmemb)/(n+1);//mean size
+    _appio_register_current[READ_BYTES]+= retval * size; // read bytes
+    if (retval < nmemb) _appio_register_current[READ_SHORT]++; // read short
+    _appio_register_current[READ_USEC] += duration;
+  }
+
+  /* A value of zero returned means one of two things..*/
+  if (retval == 0) {
+     if (feof(stream)) _appio_register_current[READ_EOF]++; // read eof
+     else _appio_register_current[READ_ERR]++; // read err
+  }
+  appio_hist_add(APPIO_HIST_READ, size*nmemb, duration);
+  if (_appio_per_fd)
+    appio_fd_add(fileno(stream), 0, (retval == 0 && ferror(stream)) ? -1 : (long long) (retval * size), duration);
+  return retval;
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+  int retval;
+  int issocket = appio_is_socket(fd);
+
+  if (_appio_detailed) {
+    // check if write would block on descriptor
+    fd_set writefds;
+    FD_ZERO(&writefds);
+    FD_SET(fd, &writefds);
+    int ready = __select(fd+1, NULL, &writefds, NULL, &zerotv);
+    if (ready == 0) {
+      _appio_register_current[WRITE_WOULD_BLOCK]++;
+      if (issocket) _appio_register_current[SOCK_WRITE_WOULD_BLOCK]++;
+    }
+  }
+
+  long long start_ts = appio_now();
+  retval = __write(fd,buf, count);
+  long long duration = appio_since(start_ts);
+  appio_account_write(fd, count, retval, duration, issocket);
+  return retval;
+}
+
+static ssize_t
+appio_pwrite( int fd, const void *buf, size_t count, __off64_t offset )
+{
+  ssize_t retval;
+  long long start_ts = appio_now();
+  retval = __pwrite64(fd, buf, count, offset);
+  long long duration = appio_since(start_ts);
+  _appio_register_current[PWRITE_CALLS]++;
+  appio_account_write(fd, count, retval, duration, 0);
+  return retval;
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+  return appio_pwrite(fd, buf, count, offset);
+}
+
+ssize_t pwrite64(int fd, const void *buf, size_t count, __off64_t offset) {
+  return appio_pwrite(fd, buf, count, offset);
+}
+
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
+  size_t retval;
+  long long start_ts = appio_now();
+  retval = _IO_fwrite(ptr,size,nmemb,stream);
+  long long duration = appio_since(start_ts);
+  int n = _appio_register_current[WRITE_CALLS]++; // write calls
+  if (retval > 0) {
+    _appio_register_current[WRITE_BLOCK_SIZE]= (n * _appio_register_current[WRITE_BLOCK_SIZE] + size*nmemb)/(n+1); // mean block size
+    _appio_register_current[WRITE_BYTES]+= retval * size; // write bytes
+    if (retval < nmemb) _appio_register_current[WRITE_SHORT]++; // short write
+    _appio_register_current[WRITE_USEC] += duration;
+  }
+  if (retval == 0) _appio_register_current[WRITE_ERR]++; // err
+  appio_hist_add(APPIO_HIST_WRITE, size*nmemb, duration);
+  if (_appio_per_fd)
+    appio_fd_add(fileno(stream), 1, (retval == 0) ? -1 : (long long) (retval * size), duration);
+  return retval;
+}
+
+// The PIC test implies it's built for shared linkage
+#ifdef PIC
+static size_t
+appio_iov_bytes( const struct iovec *iov, int iovcnt )
+{
+  size_t bytes = 0;
+  int i;
+  for (i = 0; i < iovcnt; i++) bytes += iov[i].iov_len;
+  return bytes;
+}
+
+static void
+appio_account_recv( size_t len, ssize_t retval, long long duration )
+{
+  int n = _appio_register_current[RECV_CALLS]++; // read calls
+  if (retval > 0) {
+    _appio_register_current[RECV_BLOCK_SIZE]= (n * _appio_register_current[RECV_BLOCK_SIZE] + len)/(n+1); // mean size
+    _appio_register_current[RECV_BYTES] += retval; // read bytes
+    if (retval < (ssize_t)len) _appio_register_current[RECV_SHORT]++; // read short
+    _appio_register_current[RECV_USEC] += duration;
+  }
+  if (retval < 0) {
+    _appio_register_current[RECV_ERR]++; // read err
+    if (EINTR == errno)
+      _appio_register_current[RECV_INTERRUPTED]++; // signal interrupted the read
+    if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+      _appio_register_current[RECV_WOULD_BLOCK]++; //read would block on descriptor marked as non-blocking
+  }
+  if (retval == 0) _appio_register_current[RECV_EOF]++; // read eof
+  appio_hist_add(APPIO_HIST_RECV, len, duration);
+}
+
+static void
+appio_account_send( ssize_t retval, long long duration )
+{
+  _appio_register_current[SEND_CALLS]++;
+  if (retval >= 0) {
+    _appio_register_current[SEND_BYTES] += retval;
+    _appio_register_current[SEND_USEC] += duration;
+  }
+  if (retval < 0) _appio_register_current[SEND_ERR]++;
+}
+
+/* In detailed mode, would a recv on sockfd block? */
+static void
+appio_probe_recv( int sockfd )
+{
+  fd_set readfds;
+  FD_ZERO(&readfds);
+  FD_SET(sockfd, &readfds);
+  int ready = __select(sockfd+1, &readfds, NULL, NULL, &zerotv);
+  if (ready == 0) _appio_register_current[RECV_WOULD_BLOCK]++;
+}
+
+ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+  int retval;
+  APPIO_REAL(recv, -1);
+  if (_appio_detailed) appio_probe_recv(sockfd);
+
+  long long start_ts = appio_now();
+  retval = _appio_real.recv(sockfd, buf, len, flags);
+  long long duration = appio_since(start_ts);
+  appio_account_recv(len, retval, duration);
+  return retval;
+}
+
+ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
+  ssize_t retval;
+  APPIO_REAL(recvfrom, -1);
+  if (_appio_detailed) appio_probe_recv(sockfd);
+
+  long long start_ts = appio_now();
+  retval = _appio_real.recvfrom(sockfd, buf, len, flags, src_addr, addrlen);
+  long long duration = appio_since(start_ts);
+  appio_account_recv(len, retval, duration);
+  return retval;
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
+  ssize_t retval;
+  APPIO_REAL(recvmsg, -1);
+  if (_appio_detailed) appio_probe_recv(sockfd);
+
+  long long start_ts = appio_now();
+  retval = _appio_real.recvmsg(sockfd, msg, flags);
+  long long duration = appio_since(start_ts);
+  appio_account_recv(appio_iov_bytes(msg->msg_iov, msg->msg_iovlen), retval, duration);
+  return retval;
+}
+
+ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
+  ssize_t retval;
+  APPIO_REAL(send, -1);
+  long long start_ts = appio_now();
+  retval = _appio_real.send(sockfd, buf, len, flags);
+  long long duration = appio_since(start_ts);
+  appio_account_send(retval, duration);
+  return retval;
+}
+
+ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen) {
+  ssize_t retval;
+  APPIO_REAL(sendto, -1);
+  long long start_ts = appio_now();
+  retval = _appio_real.sendto(sockfd, buf, len, flags, dest_addr, addrlen);
+  long long duration = appio_since(start_ts);
+  appio_account_send(retval, duration);
+  return retval;
+}
+
+ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags) {
+  ssize_t retval;
+  APPIO_REAL(sendmsg, -1);
+  long long start_ts = appio_now();
+  retval = _appio_real.sendmsg(sockfd, msg, flags);
+  long long duration = appio_since(start_ts);
+  appio_account_send(retval, duration);
+  return retval;
+}
+
+/* Vectored reads and writes, with or without an offset.  The 64-bit */
+/* offset variants of libc are used for all of them.                 */
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+  ssize_t retval;
+  APPIO_REAL(readv, -1);
+  int issocket = appio_is_socket(fd);
+  long long start_ts = appio_now();
+  retval = _appio_real.readv(fd, iov, iovcnt);
+  long long duration = appio_since(start_ts);
+  _appio_register_current[READV_CALLS]++;
+  appio_account_read(fd, appio_iov_bytes(iov, iovcnt), retval, duration, issocket);
+  return retval;
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+  ssize_t retval;
+  APPIO_REAL(writev, -1);
+  int issocket = appio_is_socket(fd);
+  long long start_ts = appio_now();
+  retval = _appio_real.writev(fd, iov, iovcnt);
+  long long duration = appio_since(start_ts);
+  _appio_register_current[WRITEV_CALLS]++;
+  appio_account_write(fd, appio_iov_bytes(iov, iovcnt), retval, duration, issocket);
+  return retval;
+}
+
+static ssize_t
+appio_preadv2( int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags )
+{
+  ssize_t retval;
+  APPIO_REAL(preadv2, -1);
+  long long start_ts = appio_now();
+  retval = _appio_real.preadv2(fd, iov, iovcnt, offset, flags);
+  long long duration = appio_since(start_ts);
+  /* an offset of -1 reads at the file position like readv */
+  if (offset != -1) _appio_register_current[PREAD_CALLS]++;
+  _appio_register_current[READV_CALLS]++;
+  appio_account_read(fd, appio_iov_bytes(iov, iovcnt), retval, duration, 0);
+  return retval;
+}
+
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+  return appio_preadv2(fd, iov, iovcnt, offset, 0);
+}
+
+ssize_t preadv64(int fd, const struct iovec *iov, int iovcnt, __off64_t offset) {
+  return appio_preadv2(fd, iov, iovcnt, offset, 0);
+}
+
+ssize_t preadv2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags) {
+  return appio_preadv2(fd, iov, iovcnt, offset, flags);
+}
+
+ssize_t preadv64v2(int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags) {
+  return appio_preadv2(fd, iov, iovcnt, offset, flags);
+}
+
+static ssize_t
+appio_pwritev2( int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags )
+{
+  ssize_t retval;
+  APPIO_REAL(pwritev2, -1);
+  long long start_ts = appio_now();
+  retval = _appio_real.pwritev2(fd, iov, iovcnt, offset, flags);
+  long long duration = appio_since(start_ts);
+  if (offset != -1) _appio_register_current[PWRITE_CALLS]++;
+  _appio_register_current[WRITEV_CALLS]++;
+  appio_account_write(fd, appio_iov_bytes(iov, iovcnt), retval, duration, 0);
+  return retval;
+}
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+  return appio_pwritev2(fd, iov, iovcnt, offset, 0);
+}
+
+ssize_t pwritev64(int fd, const struct iovec *iov, int iovcnt, __off64_t offset) {
+  return appio_pwritev2(fd, iov, iovcnt, offset, 0);
+}
+
+ssize_t pwritev2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags) {
+  return appio_pwritev2(fd, iov, iovcnt, offset, flags);
+}
+
+ssize_t pwritev64v2(int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags) {
+  return appio_pwritev2(fd, iov, iovcnt, offset, flags);
+}
+
+#ifdef APPIO_IO_URING
+/* Is a mapping of fd at offset one of the rings of an io_uring? */
+static int
+appio_ring_mapped( void *addr, size_t length, int fd, __off64_t offset )
+{
+  struct appio_ring *ring;
+
+  if (offset != IORING_OFF_SQ_RING && offset != IORING_OFF_CQ_RING &&
+      offset != IORING_OFF_SQES) return 0;
+  /* descriptors from open() are files */
+  if (fd < APPIO_FD_CACHE_SIZE && _appio_fd_class[fd] == APPIO_FD_FILE) return 0;
+  if (!appio_is_ring(fd)) return 0;
+
+  pthread_mutex_lock(&_appio_ring_lock);
+  ring = appio_ring_add(fd);
+  if (ring && offset == IORING_OFF_SQES) appio_ring_set_sqes(ring, addr, length);
+  pthread_mutex_unlock(&_appio_ring_lock);
+  return 1;
+}
+#endif
+
+/* File-backed mappings are counted, not the accesses through them */
+static void
+appio_account_mmap( void *addr, size_t length, int flags, int fd, __off64_t offset )
+{
+  int saved_errno = errno;
+
+  _appio_register_current[MMAP_CALLS]++;
+  if (addr == MAP_FAILED || (flags & MAP_ANONYMOUS) || fd < 0) return;
+#ifdef APPIO_IO_URING
+  if (appio_ring_mapped(addr, length, fd, offset)) {
+    errno = saved_errno;
+    return;
+  }
+#else
+  (void) offset;
+#endif
+  _appio_register_current[MMAP_BYTES] += length;
+  errno = saved_errno;
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+  void *retval;
+  retval = appio_real_mmap(addr, length, prot, flags, fd, offset);
+  appio_account_mmap(retval, length, flags, fd, offset);
+  return retval;
+}
+
+void *mmap64(void *addr, size_t length, int prot, int flags, int fd, __off64_t offset) {
+  void *retval;
+  retval = appio_real_mmap(addr, length, prot, flags, fd, offset);
+  appio_account_mmap(retval, length, flags, fd, offset);
+  return retval;
+}
+
+int munmap(void *addr, size_t length) {
+  _appio_register_current[MUNMAP_CALLS]++;
+  return appio_real_munmap(addr, length);
+}
+
+/* The following only keep the descriptor classification up to date */
+
+int socket(int domain, int type, int protocol) {
+  int retval;
+  APPIO_REAL(socket, -1);
+  retval = _appio_real.socket(domain, type, protocol);
+  if (retval >= 0) appio_fd_set_class(retval, APPIO_FD_SOCKET);
+  return retval;
+}
+
+int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
+  int retval;
+  APPIO_REAL(accept, -1);
+  retval = _appio_real.accept(sockfd, addr, addrlen);
+  if (retval >= 0) appio_fd_set_class(retval, APPIO_FD_SOCKET);
+  return retval;
+}
+
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+  int retval;
+  APPIO_REAL(accept4, -1);
+  retval = _appio_real.accept4(sockfd, addr, addrlen, flags);
+  if (retval >= 0) appio_fd_set_class(retval, APPIO_FD_SOCKET);
+  return retval;
+}
+
+int dup(int oldfd) {
+  int retval;
+  APPIO_REAL(dup, -1);
+  retval = _appio_real.dup(oldfd);
+  if (retval >= 0) {
+    appio_fd_set_class(retval, APPIO_FD_UNKNOWN);
+    appio_fd_set_path(retval, appio_fd_get_path(oldfd));
+    if (retval != oldfd) appio_fd_stale(retval);
+  }
+  return retval;
+}
+
+int dup2(int oldfd, int newfd) {
+  int retval;
+  APPIO_REAL(dup2, -1);
+  retval = _appio_real.dup2(oldfd, newfd);
+  if (retval >= 0) {
+    appio_fd_set_class(retval, APPIO_FD_UNKNOWN);
+    appio_fd_set_path(retval, appio_fd_get_path(oldfd));
+    if (retval != oldfd) appio_fd_stale(retval);
+  }
+  return retval;
+}
+
+int pipe2(int pipefd[2], int flags) {
+  int retval;
+  APPIO_REAL(pipe2, -1);
+  retval = _appio_real.pipe2(pipefd, flags);
+  if (retval == 0) {
+    appio_fd_set_class(pipefd[0], APPIO_FD_FILE);
+    appio_fd_set_class(pipefd[1], APPIO_FD_FILE);
+  }
+  return retval;
+}
+
+int socketpair(int domain, int type, int protocol, int sv[2]) {
+  int retval;
+  APPIO_REAL(socketpair, -1);
+  retval = _appio_real.socketpair(domain, type, protocol, sv);
+  if (retval == 0) {
+    appio_fd_set_class(sv[0], APPIO_FD_SOCKET);
+    appio_fd_set_class(sv[1], APPIO_FD_SOCKET);
+  }
+  return retval;
+}
+
+int closedir(DIR *dirp) {
+  int fd, retval;
+  APPIO_REAL(closedir, -1);
+  fd = dirfd(dirp);
+  retval = _appio_real.closedir(dirp);
+  if (retval == 0 && fd >= 0) appio_fd_closed(fd);
+  return retval;
+}
+
+int dup3(int oldfd, int newfd, int flags) {
+  int retval;
+  APPIO_REAL(dup3, -1);
+  retval = _appio_real.dup3(oldfd, newfd, flags);
+  if (retval >= 0) {
+    appio_fd_set_class(retval, APPIO_FD_UNKNOWN);
+    appio_fd_set_path(retval, appio_fd_get_path(oldfd));
+    if (retval != oldfd) appio_fd_stale(retval);
+  }
+  return retval;
+}
+#endif /* PIC */
+
+#pragma GCC visibility pop
+
+
+/*********************************************************************
+ ***  INTERFACE TO THE COMPONENT                                  ****
+ ********************************************************************/
+
+static void
+appio_lib_init( int detailed, long long (*now)( void ), long long ticks_per_usec )
+{
+  _appio_detailed = detailed;
+  _appio_ticks_per_usec = (ticks_per_usec > 0) ? ticks_per_usec : 1;
+  __atomic_store_n(&_appio_clock, now, __ATOMIC_RELEASE);
+}
+
+static void
+appio_lib_fini( void )
+{
+  __atomic_store_n(&_appio_clock, NULL, __ATOMIC_RELEASE);
+}
+
+static void
+appio_lib_enable( int qual )
+{
+  if (qual == APPIO_QUAL_FD || qual == APPIO_QUAL_PATH) _appio_per_fd = 1;
+  else if (qual == APPIO_QUAL_USEC_LOG2 || qual == APPIO_QUAL_SIZE_LOG2) _appio_histograms = 1;
+}
+
+static const char *
+appio_lib_path( int id )
+{
+  if (id < 0 || id >= __atomic_load_n(&_appio_num_paths, __ATOMIC_ACQUIRE)) return NULL;
+  return _appio_paths[id];
+}
+
+static void
+appio_lib_start( int rings )
+{
+  memset(_appio_register_current, 0, sizeof(_appio_register_current));
+  if (rings) appio_ring_scan();
+}
+
+/* Current value of an event code in the calling thread.  Process   */
+/* wide events are made relative to start by the component.         */
+static long long
+appio_lib_value( unsigned int code )
+{
+  int index = APPIO_CODE_INDEX(code);
+  int value = APPIO_CODE_VALUE(code);
+  long long count;
+
+  switch (APPIO_CODE_QUAL(code)) {
+    case APPIO_QUAL_FD:
+    case APPIO_QUAL_PATH:
+      count = appio_merged_value(APPIO_CODE_QUAL(code), value, appio_fd_slot(index));
+      return appio_is_usec(index) ? appio_usec(count) : count;
+    case APPIO_QUAL_USEC_LOG2:
+    case APPIO_QUAL_SIZE_LOG2:
+      return appio_merged_value(APPIO_CODE_QUAL(code), value, appio_hist_cat(index));
+  }
+
+  if (appio_is_uring(index)) return appio_uring_total(index);
+
+  count = _appio_register_current[index];
+  return appio_is_usec(index) ? appio_usec(count) : count;
+}
+
+static unsigned int
+appio_lib_epoch( unsigned int code )
+{
+  int value = APPIO_CODE_VALUE(code);
+
+  if (APPIO_CODE_QUAL(code) != APPIO_QUAL_FD) return 0;
+  return __atomic_load_n(&_appio_fd_epoch[value], __ATOMIC_ACQUIRE);
+}
+
+#pragma GCC visibility push(default)
+
+APPIO_lib_t papi_appio_lib = {
+  .version       = APPIO_LIB_VERSION,
+  .init          = appio_lib_init,
+  .fini          = appio_lib_fini,
+  .enable        = appio_lib_enable,
+  .register_path = appio_register_path,
+  .path          = appio_lib_path,
+  .start         = appio_lib_start,
+  .value         = appio_lib_value,
+  .epoch         = appio_lib_epoch,
+};
+
+#pragma GCC visibility pop
@@ -0,0 +1,95 @@
+/*
+ * Test case for appio
+ *
+ * Description: Checks that a descriptor number reused for another kind
+ *              of descriptor is classified again. A file opened through
+ *              stdio is read and closed with fclose(), then a socketpair
+ *              takes the same number; the write to it must count as a
+ *              socket write.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define NUM_EVENTS 2
+
+int main(int argc, char** argv) {
+  const char* names[NUM_EVENTS] = {"WRITE_CALLS", "SOCK_WRITE_CALLS"};
+  long long values[NUM_EVENTS];
+  int EventSet = PAPI_NULL;
+  int e, event_code, retval, fd, sv[2];
+  char buf[64];
+  FILE *fp;
+
+  tests_quiet( argc, argv );
+
+  retval = PAPI_library_init(PAPI_VER_CURRENT);
+  if (retval != PAPI_VER_CURRENT) {
+    test_fail(__FILE__, __LINE__, "PAPI_library_init", retval);
+  }
+
+  retval = PAPI_create_eventset(&EventSet);
+  if (retval != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_create_eventset", retval);
+  }
+  for (e=0; e<NUM_EVENTS; e++) {
+    retval = PAPI_event_name_to_code((char*)names[e], &event_code);
+    if (retval != PAPI_OK) {
+      test_fail(__FILE__, __LINE__, "PAPI_event_name_to_code", retval);
+    }
+    retval = PAPI_add_event(EventSet, event_code);
+    if (retval != PAPI_OK) {
+      test_fail(__FILE__, __LINE__, "PAPI_add_event", retval);
+    }
+  }
+
+  /* the read classifies the descriptor as a file */
+  fp = fopen("/etc/group", "r");
+  if (fp == NULL) {
+    test_skip(__FILE__, __LINE__, "fopen /etc/group", PAPI_ESYS);
+  }
+  fd = fileno(fp);
+  if (read(fd, buf, sizeof(buf)) <= 0) {
+    test_fail(__FILE__, __LINE__, "read", PAPI_ESYS);
+  }
+  fclose(fp);
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+    test_fail(__FILE__, __LINE__, "socketpair", PAPI_ESYS);
+  }
+  if (!TESTS_QUIET) {
+    printf("file descriptor %d, socket descriptor %d\n", fd, sv[0]);
+  }
+
+  retval = PAPI_start(EventSet);
+  if (retval != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_start", retval);
+  }
+  if (write(sv[0], buf, 1) != 1) {
+    test_fail(__FILE__, __LINE__, "write", PAPI_ESYS);
+  }
+  retval = PAPI_stop(EventSet, values);
+  if (retval != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_stop", retval);
+  }
+  close(sv[0]);
+  close(sv[1]);
+
+  if (!TESTS_QUIET) {
+    for (e=0; e<NUM_EVENTS; e++) {
+      printf("%s: %lld\n", names[e], values[e]);
+    }
+  }
+
+  if ((values[0] != 1) || (values[1] != 1)) {
+    test_fail(__FILE__, __LINE__, "Write not counted on the socket", 1);
+  }
+
+  test_pass( __FILE__ );
+  return 0;
+}
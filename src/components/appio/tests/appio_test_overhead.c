@@ -0,0 +1,125 @@
+/*
+ * Test case for appio
+ *
+ * Description: Enforces the per-call overhead budget of the
+ *              interceptors. One-byte reads of /dev/zero are timed
+ *              through the intercepted read() and through the raw
+ *              system call, once with the default events and once with
+ *              per-descriptor and histogram events added. The best of
+ *              several trials is compared against the budget, or
+ *              against the raw call on a machine too slow for it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+/* Documented in the Overhead section of the README: an intercepted */
+/* call may add BUDGET_NSEC, or as much as the raw call takes.       */
+#define BUDGET_NSEC 500
+#define CALLS       100000
+#define TRIALS      5
+
+static long long
+time_reads( int fd, int intercepted )
+{
+  long long best = -1, start, elapsed;
+  char c;
+  int t, i;
+
+  for (t=0; t<TRIALS; t++) {
+    start = PAPI_get_real_nsec();
+    for (i=0; i<CALLS; i++) {
+      if (intercepted) {
+        if (read(fd, &c, 1) != 1) test_fail(__FILE__, __LINE__, "read", 0);
+      } else {
+        if (syscall(SYS_read, fd, &c, 1) != 1) test_fail(__FILE__, __LINE__, "read", 0);
+      }
+    }
+    elapsed = PAPI_get_real_nsec() - start;
+    if (best < 0 || elapsed < best) best = elapsed;
+  }
+
+  return best / CALLS;
+}
+
+/* Returns the overhead per call in nanoseconds beyond the budget */
+static long long
+measure( int fd, const char *label, const char **names, int num_names )
+{
+  long long raw, intercepted, values[4];
+  int EventSet = PAPI_NULL;
+  int e, retval;
+
+  if (PAPI_create_eventset(&EventSet) != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_create_eventset", 0);
+  }
+  for (e=0; e<num_names; e++) {
+    retval = PAPI_add_named_event(EventSet, names[e]);
+    if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, names[e], retval);
+  }
+  if (PAPI_start(EventSet) != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_start", 0);
+  }
+
+  raw = time_reads(fd, 0);
+  intercepted = time_reads(fd, 1);
+
+  if (PAPI_stop(EventSet, values) != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_stop", 0);
+  }
+  if (values[0] != CALLS * TRIALS) {
+    test_fail(__FILE__, __LINE__, "READ_CALLS", 0);
+  }
+  PAPI_cleanup_eventset(EventSet);
+  PAPI_destroy_eventset(&EventSet);
+
+  if (!TESTS_QUIET) {
+    printf("%-16s raw %5lld ns, intercepted %5lld ns per read\n", label, raw, intercepted);
+  }
+
+  return intercepted - raw - (raw > BUDGET_NSEC ? raw : BUDGET_NSEC);
+}
+
+int main(int argc, char** argv) {
+  const char *plain[2] = {"READ_CALLS", "READ_USEC"};
+  const char *per_fd[4] = {"READ_CALLS", "READ_USEC", NULL, "appio:::READ_CALLS:usec_log2=0"};
+  char fd_event[PAPI_MAX_STR_LEN];
+  long long overhead;
+  int fd;
+
+  /* Set TESTS_QUIET variable */
+  tests_quiet( argc, argv );
+
+  if (getenv("PAPI_APPIO_DETAILED")) {
+    test_skip(__FILE__, __LINE__, "the budget applies to the default mode", 0);
+  }
+
+  if (PAPI_library_init(PAPI_VER_CURRENT) != PAPI_VER_CURRENT) {
+    test_fail(__FILE__, __LINE__, "PAPI_library_init", 0);
+  }
+
+  fd = open("/dev/zero", O_RDONLY);
+  if (fd < 0) test_fail(__FILE__, __LINE__, "open /dev/zero", 0);
+
+  overhead = measure(fd, "default", plain, 2);
+  if (overhead > 0) {
+    test_fail(__FILE__, __LINE__, "overhead budget exceeded", (int) overhead);
+  }
+
+  snprintf(fd_event, sizeof(fd_event), "appio:::READ_BYTES:fd=%d", fd);
+  per_fd[2] = fd_event;
+  overhead = measure(fd, "per-fd events", per_fd, 4);
+  if (overhead > 0) {
+    test_fail(__FILE__, __LINE__, "overhead budget exceeded with per-fd events", (int) overhead);
+  }
+
+  close(fd);
+
+  test_pass( __FILE__ );
+  return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Test case for appio
+ *
+ * Description: Checks the per-descriptor, per-path and histogram
+ *              qualifiers. A file is written from two threads under a
+ *              private directory and read back; the path=, fd= and
+ *              size_log2 events sum the I/O of both threads. A second
+ *              file then takes the descriptor number, and the fd=
+ *              events only count its own call.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define NUM_EVENTS 4
+#define BLOCK      4096
+#define MAIN_BLOCKS   8
+#define THREAD_BLOCKS 5
+
+static int fd;
+static char buf[BLOCK];
+
+void *ThreadIO(void *arg) {
+  int i;
+  (void) arg;
+  for (i=0; i<THREAD_BLOCKS; i++) {
+    if (write(fd, buf, BLOCK) != BLOCK) return (void *) 1;
+  }
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  char dir[] = "/tmp/appio_per_fdXXXXXX";
+  char file[PAPI_MAX_STR_LEN], file2[PAPI_MAX_STR_LEN];
+  char names[NUM_EVENTS][PAPI_MAX_STR_LEN];
+  long long values[NUM_EVENTS];
+  int EventSet = PAPI_NULL;
+  pthread_t thread;
+  void *thread_ret;
+  int retval, e, i, fd2;
+
+  /* Set TESTS_QUIET variable */
+  tests_quiet( argc, argv );
+
+  if (PAPI_library_init(PAPI_VER_CURRENT) != PAPI_VER_CURRENT) {
+    test_fail(__FILE__, __LINE__, "PAPI_library_init", 0);
+  }
+
+  if (mkdtemp(dir) == NULL) {
+    test_fail(__FILE__, __LINE__, "mkdtemp", 0);
+  }
+  snprintf(file, sizeof(file), "%s/data", dir);
+  snprintf(file2, sizeof(file2), "%s/data2", dir);
+
+  fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    test_fail(__FILE__, __LINE__, "open", 0);
+  }
+
+  snprintf(names[0], PAPI_MAX_STR_LEN, "appio:::WRITE_BYTES:path=%s", dir);
+  snprintf(names[1], PAPI_MAX_STR_LEN, "appio:::WRITE_CALLS:fd=%d", fd);
+  snprintf(names[2], PAPI_MAX_STR_LEN, "appio:::WRITE_CALLS:size_log2=12");
+  snprintf(names[3], PAPI_MAX_STR_LEN, "appio:::READ_BYTES:fd=%d", fd);
+
+  if (PAPI_create_eventset(&EventSet) != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_create_eventset", 0);
+  }
+
+  for (e=0; e<NUM_EVENTS; e++) {
+    retval = PAPI_add_named_event(EventSet, names[e]);
+    if (retval != PAPI_OK) {
+      test_fail(__FILE__, __LINE__, names[e], retval);
+    }
+  }
+
+  if (PAPI_start(EventSet) != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_start", 0);
+  }
+
+  memset(buf, 'x', BLOCK);
+  if (pthread_create(&thread, NULL, ThreadIO, NULL) != 0) {
+    test_fail(__FILE__, __LINE__, "pthread_create", 0);
+  }
+  for (i=0; i<MAIN_BLOCKS; i++) {
+    if (write(fd, buf, BLOCK) != BLOCK) {
+      test_fail(__FILE__, __LINE__, "write", 0);
+    }
+  }
+  pthread_join(thread, &thread_ret);
+  if (thread_ret != NULL) {
+    test_fail(__FILE__, __LINE__, "thread write", 0);
+  }
+
+  lseek(fd, 0, SEEK_SET);
+  while (read(fd, buf, BLOCK) > 0);
+
+  /* the lowest free number is the one just closed */
+  close(fd);
+  fd2 = open(file2, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd2 != fd) {
+    test_fail(__FILE__, __LINE__, "open of the second file", 0);
+  }
+  if (write(fd2, buf, BLOCK) != BLOCK) {
+    test_fail(__FILE__, __LINE__, "write", 0);
+  }
+
+  if (PAPI_stop(EventSet, values) != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_stop", 0);
+  }
+
+  close(fd2);
+  unlink(file);
+  unlink(file2);
+  rmdir(dir);
+
+  if (!TESTS_QUIET) {
+    for (e=0; e<NUM_EVENTS; e++) {
+      printf("%-50s %12lld\n", names[e], values[e]);
+    }
+  }
+
+  if (values[0] != (MAIN_BLOCKS + THREAD_BLOCKS + 1) * BLOCK) {
+    test_fail(__FILE__, __LINE__, "path= bytes do not include all threads", 0);
+  }
+  if (values[1] != 1) {
+    test_fail(__FILE__, __LINE__, "fd= calls of the closed descriptor", 0);
+  }
+  if (values[2] != MAIN_BLOCKS + THREAD_BLOCKS + 1) {
+    test_fail(__FILE__, __LINE__, "size_log2 histogram does not include all threads", 0);
+  }
+  if (values[3] != 0) {
+    test_fail(__FILE__, __LINE__, "fd= read bytes of the closed descriptor", 0);
+  }
+
+  test_pass( __FILE__ );
+  return 0;
+}
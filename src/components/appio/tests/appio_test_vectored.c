@@ -0,0 +1,201 @@
+/*
+ * Test case for appio
+ *
+ * Description: Exercises the positional, vectored, message, mmap and
+ *              io_uring interceptors on a temporary file and a socket
+ *              pair. The io_uring checks are skipped if the kernel does
+ *              not allow io_uring_setup(). The interceptors are only
+ *              present in the shared libpapi_appio.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define NUM_EVENTS 12
+static const char* names[NUM_EVENTS] = {"PREAD_CALLS", "PWRITE_CALLS", "READV_CALLS", "WRITEV_CALLS",
+                                        "READ_BYTES", "WRITE_BYTES", "SEND_BYTES", "RECV_BYTES",
+                                        "MMAP_CALLS", "MMAP_BYTES",
+                                        "IO_URING_SUBMITTED", "IO_URING_COMPLETED"};
+enum { PREAD, PWRITE, READV, WRITEV, READ_BYTES, WRITE_BYTES, SEND_BYTES, RECV_BYTES,
+       MMAP_CALLS, MMAP_BYTES, URING_SUBMITTED, URING_COMPLETED };
+
+#define BLOCK 4096
+
+static char buf[BLOCK], buf2[BLOCK];
+
+/* Read the first block of fd through a one entry io_uring, returns  */
+/* the ring descriptor, or -1 if io_uring is not available.          */
+static int
+uring_read( int fd )
+{
+  struct io_uring_params p;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  unsigned int *sq_tail, *sq_array, *cq_head, *cq_tail;
+  size_t sq_size, cq_size;
+  char *sq_ring, *cq_ring;
+  int rfd;
+
+  memset(&p, 0, sizeof(p));
+  rfd = syscall(__NR_io_uring_setup, 1, &p);
+  if (rfd < 0) return -1;
+
+  sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cq_size > sq_size) sq_size = cq_size;
+  }
+
+  sq_ring = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED) test_fail(__FILE__, __LINE__, "mmap sq ring", 0);
+  cq_ring = sq_ring;
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+    cq_ring = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) test_fail(__FILE__, __LINE__, "mmap cq ring", 0);
+  }
+  sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) test_fail(__FILE__, __LINE__, "mmap sqes", 0);
+
+  sq_tail = (unsigned int *) (sq_ring + p.sq_off.tail);
+  sq_array = (unsigned int *) (sq_ring + p.sq_off.array);
+  cq_head = (unsigned int *) (cq_ring + p.cq_off.head);
+  cq_tail = (unsigned int *) (cq_ring + p.cq_off.tail);
+  cqes = (struct io_uring_cqe *) (cq_ring + p.cq_off.cqes);
+
+  memset(&sqes[0], 0, sizeof(sqes[0]));
+  sqes[0].opcode = IORING_OP_READ;
+  sqes[0].fd = fd;
+  sqes[0].addr = (unsigned long) buf2;
+  sqes[0].len = BLOCK;
+  sqes[0].off = 0;
+  sq_array[0] = 0;
+  __atomic_store_n(sq_tail, *sq_tail + 1, __ATOMIC_RELEASE);
+
+  if (syscall(__NR_io_uring_enter, rfd, 1, 1, IORING_ENTER_GETEVENTS, NULL, 0) != 1) {
+    test_fail(__FILE__, __LINE__, "io_uring_enter", 0);
+  }
+  if (__atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) == *cq_head ||
+      cqes[*cq_head & (p.cq_entries - 1)].res != BLOCK) {
+    test_fail(__FILE__, __LINE__, "io_uring read", 0);
+  }
+  __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+
+  return rfd;
+}
+
+int main(int argc, char** argv) {
+  char file[] = "/tmp/appio_vectoredXXXXXX";
+  long long values[NUM_EVENTS];
+  int EventSet = PAPI_NULL;
+  struct iovec iov[2];
+  struct msghdr msg;
+  int fd, sv[2], rfd, e, retval;
+  void *map;
+
+  /* Set TESTS_QUIET variable */
+  tests_quiet( argc, argv );
+
+  if (PAPI_library_init(PAPI_VER_CURRENT) != PAPI_VER_CURRENT) {
+    test_fail(__FILE__, __LINE__, "PAPI_library_init", 0);
+  }
+
+  if (PAPI_create_eventset(&EventSet) != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_create_eventset", 0);
+  }
+  for (e=0; e<NUM_EVENTS; e++) {
+    retval = PAPI_add_named_event(EventSet, names[e]);
+    if (retval != PAPI_OK) {
+      test_fail(__FILE__, __LINE__, names[e], retval);
+    }
+  }
+
+  fd = mkstemp(file);
+  if (fd < 0) test_fail(__FILE__, __LINE__, "mkstemp", 0);
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+    test_fail(__FILE__, __LINE__, "socketpair", 0);
+  }
+  memset(buf, 'x', BLOCK);
+
+  if (PAPI_start(EventSet) != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_start", 0);
+  }
+
+  /* 2 pwrites and a writev: 10240 bytes */
+  if (pwrite(fd, buf, BLOCK, 0) != BLOCK) test_fail(__FILE__, __LINE__, "pwrite", 0);
+  if (pwrite(fd, buf, BLOCK, BLOCK) != BLOCK) test_fail(__FILE__, __LINE__, "pwrite", 0);
+  lseek(fd, 2 * BLOCK, SEEK_SET);
+  iov[0].iov_base = buf; iov[0].iov_len = 1024;
+  iov[1].iov_base = buf + 1024; iov[1].iov_len = 1024;
+  if (writev(fd, iov, 2) != 2048) test_fail(__FILE__, __LINE__, "writev", 0);
+
+  /* a pread, a preadv2 and a readv: 8192 bytes */
+  if (pread(fd, buf2, BLOCK, BLOCK) != BLOCK) test_fail(__FILE__, __LINE__, "pread", 0);
+  iov[0].iov_base = buf2; iov[1].iov_base = buf2 + 1024;
+  if (preadv2(fd, iov, 2, 0, 0) != 2048) test_fail(__FILE__, __LINE__, "preadv2", 0);
+  lseek(fd, 0, SEEK_SET);
+  if (readv(fd, iov, 2) != 2048) test_fail(__FILE__, __LINE__, "readv", 0);
+
+  /* 100 bytes through a socket pair */
+  memset(&msg, 0, sizeof(msg));
+  iov[0].iov_base = buf; iov[0].iov_len = 100;
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 1;
+  if (sendmsg(sv[0], &msg, 0) != 100) test_fail(__FILE__, __LINE__, "sendmsg", 0);
+  iov[0].iov_base = buf2;
+  if (recvmsg(sv[1], &msg, 0) != 100) test_fail(__FILE__, __LINE__, "recvmsg", 0);
+
+  /* one file page mapped */
+  map = mmap(NULL, BLOCK, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) test_fail(__FILE__, __LINE__, "mmap", 0);
+  munmap(map, BLOCK);
+
+  rfd = uring_read(fd);
+
+  if (PAPI_stop(EventSet, values) != PAPI_OK) {
+    test_fail(__FILE__, __LINE__, "PAPI_stop", 0);
+  }
+
+  if (rfd >= 0) close(rfd);
+  close(sv[0]);
+  close(sv[1]);
+  close(fd);
+  unlink(file);
+
+  if (!TESTS_QUIET) {
+    for (e=0; e<NUM_EVENTS; e++) {
+      printf("%-22s %10lld\n", names[e], values[e]);
+    }
+    if (rfd < 0) printf("io_uring is not available, its events are not checked\n");
+  }
+
+  if (values[PWRITE] != 2 || values[WRITEV] != 1 || values[WRITE_BYTES] != 2 * BLOCK + 2048) {
+    test_fail(__FILE__, __LINE__, "pwrite/writev", 0);
+  }
+  if (values[PREAD] != 2 || values[READV] != 2 || values[READ_BYTES] != BLOCK + 2 * 2048) {
+    test_fail(__FILE__, __LINE__, "pread/preadv2/readv", 0);
+  }
+  if (values[SEND_BYTES] != 100 || values[RECV_BYTES] != 100) {
+    test_fail(__FILE__, __LINE__, "sendmsg/recvmsg", 0);
+  }
+  if (values[MMAP_CALLS] < 1 || values[MMAP_BYTES] != BLOCK) {
+    test_fail(__FILE__, __LINE__, "mmap", 0);
+  }
+  if (rfd >= 0 && (values[URING_SUBMITTED] != 1 || values[URING_COMPLETED] != 1)) {
+    test_fail(__FILE__, __LINE__, "io_uring", 0);
+  }
+
+  test_pass( __FILE__ );
+  return 0;
+}
@@ -10,12 +10,21 @@
  *  system file /proc/self/io. It typically contains 7 counters,
  *  but for robusness we read the file and create whatever events
  *  it contains.
+ *
+ *  With PAPI_GRN_THR the counters of the calling thread are read
+ *  from /proc/self/task/<tid>/io instead, and EventSets can be
+ *  attached to other processes or threads. The files are kept open
+ *  and read with pread().
  */
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 /* Headers required by PAPI */
 #include "papi.h"
@@ -34,6 +43,8 @@ papi_vector_t _io_vector;
 #define IO_COUNTERS 64
 // File name to access.
 #define IO_FILENAME "/proc/self/io"
+// Enough for IO_COUNTERS lines of a short name and a 64-bit value.
+#define IO_BUFFER_SIZE 4096
 
 // The following macro follows if a string function has an error. It should 
 // never happen; but it is necessary to prevent compiler warnings. We print 
@@ -46,6 +57,7 @@ typedef struct IO_native_event_entry
     char name[PAPI_MAX_STR_LEN];	      // Name of the counter.
     char desc[PAPI_MAX_STR_LEN];       // Description of the counter.
 	int fileIdx;                        // Line in file.
+	int valueOffset;                    // Of the value in its line.
 } IO_native_event_entry_t;
 
 //-----------------------------------------------------------------------------
@@ -58,6 +70,11 @@ typedef struct _io_control_state
    long long EventSetVal[IO_COUNTERS];
    long long EventSetReport[IO_COUNTERS];
    int EventSetIdx[IO_COUNTERS];
+   int granularity;                 // PAPI_GRN_PROC or PAPI_GRN_THR.
+   int attached;
+   pid_t tid;                       // Attached to, if attached.
+   int attachFd;                    // Open on the tid, or -1.
+   int attachGranularity;           // Of the file attachFd is open on.
 } _io_control_state_t;
 
 //-----------------------------------------------------------------------------
@@ -68,6 +85,8 @@ typedef struct _io_context
    int  EventCount;
    FILE *pFile;
    char line[FILE_LINE_SIZE]; 
+   int procFd;                      // /proc/self/io, or -1.
+   int taskFd;                      // /proc/self/task/<tid>/io, or -1.
 } _io_context_t;
 
 // ----------------------- GLOBALS ----------------------------
@@ -128,36 +147,99 @@ static int io_count_events(_io_context_t *myCtx)
 } // END ROUTINE.
 
 
+// Opens the io file of a process (PAPI_GRN_PROC) or of a thread
+// (PAPI_GRN_THR); tid 0 is the calling thread.
+static int io_open_file(pid_t tid, int granularity)
+{
+    char path[PAPI_MIN_STR_LEN];
+
+    if (tid == 0 && granularity == PAPI_GRN_PROC) {
+        return open(IO_FILENAME, O_RDONLY | O_CLOEXEC);
+    }
+    if (tid == 0) {
+        tid = syscall(SYS_gettid);
+        snprintf(path, sizeof(path), "/proc/self/task/%d/io", (int) tid);
+    } else if (granularity == PAPI_GRN_THR) {
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/io", (int) tid, (int) tid);
+    } else {
+        snprintf(path, sizeof(path), "/proc/%d/io", (int) tid);
+    }
+
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// The file an EventSet reads, opened on first use and kept open.
+static int io_target_fd(_io_context_t *ctx, _io_control_state_t *ctl)
+{
+    int *fd;
+
+    if (ctl->attached) {
+        if (ctl->attachFd >= 0 && ctl->attachGranularity != ctl->granularity) {
+            close(ctl->attachFd);
+            ctl->attachFd = -1;
+        }
+        if (ctl->attachFd < 0) {
+            ctl->attachFd = io_open_file(ctl->tid, ctl->granularity);
+            ctl->attachGranularity = ctl->granularity;
+        }
+        return ctl->attachFd;
+    }
+
+    fd = (ctl->granularity == PAPI_GRN_THR) ? &ctx->taskFd : &ctx->procFd;
+    if (*fd < 0) *fd = io_open_file(0, ctl->granularity);
+    return *fd;
+}
+
+// Parses the values out of the file contents. Every line starts with
+// the name found at init, so its value is at a fixed offset.
+static int io_parse_values(const char *buf, int len, long long *values)
+{
+    const char *p = buf, *end = buf + len;
+    long long value;
+    int idx;
+
+    for (idx = 0; idx < gEventCount; idx++) {
+        p += io_native_table[idx].valueOffset;
+        if (p >= end || *p < '0' || *p > '9') return PAPI_ENOCNTR;
+        value = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (*p++ - '0');
+        }
+        if (p >= end || *p++ != '\n') return PAPI_ENOCNTR;
+        values[idx] = value;
+    }
+
+    return PAPI_OK;
+}
+
 // Code to read values; returns PAPI_OK or an error.
 // We presume the number of counters and order of them
 // will not change from our initialization read.
 static int 
 io_hardware_read(_io_context_t *ctx, _io_control_state_t *ctl)
 {
-    ctx->pFile = fopen(IO_FILENAME, "r");
-    if (ctx->pFile == NULL) return(PAPI_ENOCNTR); /* No counters */
+    char buf[IO_BUFFER_SIZE];
+    ssize_t len;
+    int fd;
 
-    /* Read each line */
-    int idx;
-    for (idx=0; idx<gEventCount; idx++) {
-        if (fgets(ctx->line, FILE_LINE_SIZE-1, ctx->pFile)) {
-            char dummy[FILE_LINE_SIZE] = {0};
-            long long tmplong = 0LL;
-            int nf = sscanf(ctx->line, "%s %lld\n", dummy, &tmplong);
-            if (nf != 2 || strlen(dummy)<2 || dummy[strlen(dummy)-1] != ':') {
-                return PAPI_ENOCNTR;
-            }
+    fd = io_target_fd(ctx, ctl);
+    if (fd < 0) return(PAPI_ENOCNTR); /* No counters */
 
-            ctl->EventSetVal[idx] = tmplong;
-        } else {                            /* Did not read ALL counters. */
-            return(PAPI_EMISC);
-        }
+    len = pread(fd, buf, sizeof(buf), 0);
+    if (len <= 0) {
+        SUBDBG("pread of io file failed: %s\n", len ? strerror(errno) : "empty");
+        return(PAPI_ESYS);    /* Attached target is gone */
     }
 
-    fclose(ctx->pFile);
-    return(PAPI_OK);
+    return io_parse_values(buf, (int) len, ctl->EventSetVal);
 } // END FUNCTION.
 
+static void io_close_fd(int *fd)
+{
+    if (*fd >= 0) close(*fd);
+    *fd = -1;
+}
+
 /********************************************************************/
 /* Below are the functions required by the PAPI component interface */
 /********************************************************************/
@@ -219,6 +301,10 @@ _io_init_component( int cidx )
         name[strlen(name)-1]=0;     // null terminate over ':' we found.
         strncpy(io_native_table[fileIdx].name, name, PAPI_MAX_STR_LEN-1);
         io_native_table[fileIdx].fileIdx=fileIdx;
+        // The value follows the name, its ':' and blanks.
+        char *value = myCtx.line + strlen(name) + 1;
+        while (*value == ' ' || *value == '\t') value++;
+        io_native_table[fileIdx].valueOffset = value - myCtx.line;
         io_native_table[fileIdx].desc[0]=0;         // flag for successful copy.
         if (strcmp("rchar", name) == 0) {
             strcpy(io_native_table[fileIdx].desc, "Characters read.");
@@ -272,6 +358,8 @@ _io_init_thread( hwd_context_t *ctx )
 {
     _io_context_t* myCtx = (_io_context_t*) ctx;
     int ret;
+    myCtx->procFd = -1;
+    myCtx->taskFd = -1;
     ret = io_count_events(myCtx);
     if (ret != PAPI_OK) return(ret);
 
@@ -287,12 +375,14 @@ _io_init_thread( hwd_context_t *ctx )
 } // END of init thread.
 
 // Our control state holds arrays for reading/arranging Event values.
-// We just ensure it is all zeros.
+// We just ensure it is all zeros, and nothing is open yet.
 static int
 _io_init_control_state( hwd_control_state_t * ctl )
 {
     _io_control_state_t* control = ( _io_control_state_t* ) ctl;
     memset(control, 0, sizeof(_io_control_state_t));
+    control->granularity = _io_vector.cmp_info.default_granularity;
+    control->attachFd = -1;
     return PAPI_OK;
 } // END.
 
@@ -312,8 +402,11 @@ _io_update_control_state( hwd_control_state_t *ctl,
 
     myCtl->EventSetCount = count;
     
-    /* if no events, return */
-    if (count==0) return PAPI_OK;
+    /* if no events, return; this is also how cleanup closes */
+    if (count==0) {
+        io_close_fd(&myCtl->attachFd);
+        return PAPI_OK;
+    }
 
     for( i = 0; i < count; i++ ) {
         index = native[i].ni_event;
@@ -366,7 +459,8 @@ _io_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
     SUBDBG( "io_read... %p %d", ctx, flags );
 
     /* Read all counters into EventSetVal */
-    io_hardware_read(myCtx, myCtl);
+    int retval = io_hardware_read(myCtx, myCtl);
+    if (retval != PAPI_OK) return retval;
     for (i=0; i<myCtl->EventSetCount; i++) {
         myCtl->EventSetReport[i]=myCtl->EventSetVal[myCtl->EventSetIdx[i]];
     }
@@ -416,8 +510,10 @@ _io_shutdown_component(void)
 static int
 _io_shutdown_thread( hwd_context_t *ctx )
 {
-    (void) ctx;
+    _io_context_t *myCtx = (_io_context_t*) ctx;
     SUBDBG( "io_shutdown_thread... %p", ctx );
+    io_close_fd(&myCtx->procFd);
+    io_close_fd(&myCtx->taskFd);
     return PAPI_OK;
 }
 
@@ -431,9 +527,39 @@ static int
 _io_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
 {
     (void) ctx;
-    (void) code;
-    (void) option;
+    _io_control_state_t *myCtl;
+    int fd;
     SUBDBG( "io_ctl..." );
+
+    switch (code) {
+        case PAPI_GRANUL:
+            myCtl = (_io_control_state_t*) option->granularity.ESI->ctl_state;
+            myCtl->granularity = option->granularity.granularity;
+            return PAPI_OK;
+
+        case PAPI_ATTACH:
+            myCtl = (_io_control_state_t*) option->attach.ESI->ctl_state;
+            /* Fail now if the target cannot be read */
+            fd = io_open_file((pid_t) option->attach.tid, myCtl->granularity);
+            if (fd < 0) {
+                SUBDBG("cannot open io file of %lu: %s\n", option->attach.tid, strerror(errno));
+                return (errno == EACCES || errno == EPERM) ? PAPI_EPERM : PAPI_ESYS;
+            }
+            io_close_fd(&myCtl->attachFd);
+            myCtl->attachFd = fd;
+            myCtl->attachGranularity = myCtl->granularity;
+            myCtl->tid = (pid_t) option->attach.tid;
+            myCtl->attached = 1;
+            return PAPI_OK;
+
+        case PAPI_DETACH:
+            myCtl = (_io_control_state_t*) option->attach.ESI->ctl_state;
+            io_close_fd(&myCtl->attachFd);
+            myCtl->attached = 0;
+            myCtl->tid = 0;
+            return PAPI_OK;
+    }
+
     return PAPI_OK;
 }
 
@@ -570,7 +696,7 @@ papi_vector_t _io_vector = {
 
         .name = "io",
         .short_name = "io",
-        .description = "A component to read /proc/self/io",
+        .description = "A component to read /proc/<pid>/io and /proc/self/task/<tid>/io",
         .version = "1.0",
         .support_version = "n/a",
         .kernel_version = "n/a",
@@ -578,11 +704,13 @@ papi_vector_t _io_vector = {
         .num_mpx_cntrs =           512,
         .default_domain =          PAPI_DOM_USER,
         .available_domains =       PAPI_DOM_USER,
-        .default_granularity =     PAPI_GRN_THR,
-        .available_granularities = PAPI_GRN_THR,
+        .default_granularity =     PAPI_GRN_PROC,
+        .available_granularities = PAPI_GRN_THR | PAPI_GRN_PROC,
         .hardware_intr_sig =       PAPI_INT_SIGNAL,
 
         /* component specific cmp_info initializations */
+        .attach =                  1,
+        .attach_must_ptrace =      0,
     },
 
     /* sizes of framework-opaque component-private structures */
@@ -0,0 +1,191 @@
+/****************************/
+/* THIS IS OPEN SOURCE CODE */
+/****************************/
+
+/**
+ * @file    io_thread_attach.c
+ * test case for I/O component
+ *
+ * @brief
+ *  Checks the per-thread counters of PAPI_GRN_THR against the
+ *  process-wide default, and an EventSet attached to a child process.
+ *  wchar counts the bytes passed to write(), so the writes go to
+ *  /dev/null.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define THREAD_BYTES (64*1024)
+#define MAIN_BYTES   1000
+#define CHILD_BYTES  (128*1024)
+
+static void write_null(long bytes)
+{
+    char buf[4096];
+    int fd, n;
+
+    memset(buf, 0, sizeof(buf));
+    fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) return;
+    while (bytes > 0) {
+        n = bytes > (long) sizeof(buf) ? (int) sizeof(buf) : (int) bytes;
+        if (write(fd, buf, n) != n) break;
+        bytes -= n;
+    }
+    close(fd);
+}
+
+static void *thread_writer(void *arg)
+{
+    (void) arg;
+    write_null(THREAD_BYTES);
+    return NULL;
+}
+
+/* wchar written while a thread writes THREAD_BYTES and this thread */
+/* writes MAIN_BYTES, as seen with the given granularity             */
+static long long measure(int granularity)
+{
+    int retval, EventSet = PAPI_NULL;
+    long long before, after;
+    PAPI_option_t opt;
+    pthread_t thread;
+
+    retval = PAPI_create_eventset(&EventSet);
+    if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, "PAPI_create_eventset", retval);
+    retval = PAPI_add_named_event(EventSet, "io:::wchar");
+    if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, "io:::wchar", retval);
+
+    memset(&opt, 0, sizeof(opt));
+    opt.granularity.eventset = EventSet;
+    opt.granularity.granularity = granularity;
+    retval = PAPI_set_opt(PAPI_GRANUL, &opt);
+    if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, "PAPI_set_opt GRANUL", retval);
+
+    retval = PAPI_start(EventSet);
+    if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, "PAPI_start", retval);
+    retval = PAPI_read(EventSet, &before);
+    if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, "PAPI_read", retval);
+
+    if (pthread_create(&thread, NULL, thread_writer, NULL) != 0) {
+        test_fail(__FILE__, __LINE__, "pthread_create", 0);
+    }
+    pthread_join(thread, NULL);
+    write_null(MAIN_BYTES);
+
+    retval = PAPI_stop(EventSet, &after);
+    if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, "PAPI_stop", retval);
+
+    PAPI_cleanup_eventset(EventSet);
+    PAPI_destroy_eventset(&EventSet);
+
+    return after - before;
+}
+
+/* wchar of a child process that wrote CHILD_BYTES, -1 if not allowed */
+static long long measure_child(int quiet)
+{
+    int retval, EventSet = PAPI_NULL;
+    int ready[2], done[2];
+    long long value = -1;
+    char c;
+    pid_t pid;
+
+    if (pipe(ready) < 0 || pipe(done) < 0) test_fail(__FILE__, __LINE__, "pipe", 0);
+
+    pid = fork();
+    if (pid < 0) test_fail(__FILE__, __LINE__, "fork", 0);
+    if (pid == 0) {
+        write_null(CHILD_BYTES);
+        if (write(ready[1], "x", 1) != 1) _exit(1);
+        if (read(done[0], &c, 1) != 1) _exit(1);
+        _exit(0);
+    }
+
+    if (read(ready[0], &c, 1) != 1) test_fail(__FILE__, __LINE__, "child", 0);
+
+    retval = PAPI_create_eventset(&EventSet);
+    if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, "PAPI_create_eventset", retval);
+    retval = PAPI_add_named_event(EventSet, "io:::wchar");
+    if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, "io:::wchar", retval);
+
+    retval = PAPI_attach(EventSet, (unsigned long) pid);
+    if (retval == PAPI_OK) {
+        retval = PAPI_start(EventSet);
+        if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, "PAPI_start", retval);
+        retval = PAPI_stop(EventSet, &value);
+        if (retval != PAPI_OK) test_fail(__FILE__, __LINE__, "PAPI_stop", retval);
+        PAPI_detach(EventSet);
+    } else if (retval == PAPI_EPERM) {
+        if (!quiet) printf("Not allowed to read the io file of the child\n");
+    } else {
+        test_fail(__FILE__, __LINE__, "PAPI_attach", retval);
+    }
+
+    if (write(done[1], "x", 1) != 1) test_fail(__FILE__, __LINE__, "child", 0);
+    waitpid(pid, NULL, 0);
+
+    PAPI_cleanup_eventset(EventSet);
+    PAPI_destroy_eventset(&EventSet);
+
+    return value;
+}
+
+int main (int argc, char **argv)
+{
+    int retval, cid, quiet;
+    long long proc_bytes, thread_bytes, child_bytes;
+
+    /* Set TESTS_QUIET variable */
+    quiet=tests_quiet( argc, argv );
+
+    /* PAPI Initialization */
+    retval = PAPI_library_init( PAPI_VER_CURRENT );
+    if ( retval != PAPI_VER_CURRENT ) {
+        test_fail(__FILE__, __LINE__,"PAPI_library_init failed\n",retval);
+    }
+
+    retval = PAPI_thread_init( ( unsigned long ( * )( void ) ) pthread_self );
+    if ( retval != PAPI_OK ) {
+        test_fail(__FILE__, __LINE__,"PAPI_thread_init failed\n",retval);
+    }
+
+    cid = PAPI_get_component_index("io");
+    if (cid < 0 || PAPI_get_component_info(cid)->disabled) {
+        test_skip(__FILE__, __LINE__, "io component not available\n", 0);
+    }
+
+    proc_bytes = measure(PAPI_GRN_PROC);
+    thread_bytes = measure(PAPI_GRN_THR);
+    child_bytes = measure_child(quiet);
+
+    if (!quiet) {
+        printf("wchar, process:        %lld\n", proc_bytes);
+        printf("wchar, this thread:    %lld\n", thread_bytes);
+        printf("wchar, child process:  %lld\n", child_bytes);
+    }
+
+    if (proc_bytes < THREAD_BYTES + MAIN_BYTES) {
+        test_fail(__FILE__, __LINE__, "process counts miss the thread\n", 0);
+    }
+    if (thread_bytes < MAIN_BYTES || thread_bytes >= THREAD_BYTES) {
+        test_fail(__FILE__, __LINE__, "thread counts are not per thread\n", 0);
+    }
+    if (child_bytes >= 0 && child_bytes < CHILD_BYTES) {
+        test_fail(__FILE__, __LINE__, "attached counts miss the child\n", 0);
+    }
+
+    test_pass( __FILE__ );
+
+    return 0;
+}
@@ -0,0 +1,392 @@
+/**
+* @file    linux-mem.c
+* @brief A component for the memory usage of the process, as in
+*        PAPI_get_dmem_info(), as events.
+*
+* The values come from /proc/self/statm, /proc/self/status and, for the
+* proportional set size, /proc/self/smaps_rollup. Only the files that hold
+* an event of the EventSet are read: statm is the cheapest, smaps_rollup
+* makes the kernel walk all mappings of the process and is the most
+* expensive. The files are kept open and read again with pread().
+*
+* All values are in KB and are current values, not differences, so
+* start, stop and reset do nothing.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stddef.h>
+
+#include "papi.h"
+#include "papi_internal.h"
+#include "papi_vector.h"
+#include "papi_memory.h"
+#include "linux-memory.h"
+
+/* statm columns */
+#define MEM_STATM_SIZE     0
+#define MEM_STATM_RESIDENT 1
+#define MEM_STATM_SHARED   2
+#define MEM_STATM_TEXT     3
+#define MEM_STATM_DATA     5
+
+typedef struct
+{
+	const char *name;
+	const char *description;
+	int file;					/* LINUX_DMEM_* */
+	const char *key;			/* line of status or smaps_rollup */
+	int column;					/* column of statm */
+} MEM_native_event_entry_t;
+
+static const MEM_native_event_entry_t mem_events[] = {
+	{ "SIZE", "Virtual memory size", LINUX_DMEM_STATM, NULL, MEM_STATM_SIZE },
+	{ "RESIDENT", "Resident set size", LINUX_DMEM_STATM, NULL, MEM_STATM_RESIDENT },
+	{ "SHARED", "Resident file backed and shared memory", LINUX_DMEM_STATM, NULL, MEM_STATM_SHARED },
+	{ "TEXT", "Text of the executable", LINUX_DMEM_STATM, NULL, MEM_STATM_TEXT },
+	{ "DATA", "Data and stack", LINUX_DMEM_STATM, NULL, MEM_STATM_DATA },
+	{ "PEAK", "Peak virtual memory size", LINUX_DMEM_STATUS, "VmPeak:", 0 },
+	{ "LOCKED", "Locked memory", LINUX_DMEM_STATUS, "VmLck:", 0 },
+	{ "PINNED", "Pinned memory", LINUX_DMEM_STATUS, "VmPin:", 0 },
+	{ "HIGH_WATER_MARK", "Peak resident set size", LINUX_DMEM_STATUS, "VmHWM:", 0 },
+	{ "RSS_ANON", "Resident anonymous memory", LINUX_DMEM_STATUS, "RssAnon:", 0 },
+	{ "RSS_FILE", "Resident file mappings", LINUX_DMEM_STATUS, "RssFile:", 0 },
+	{ "RSS_SHMEM", "Resident shared memory", LINUX_DMEM_STATUS, "RssShmem:", 0 },
+	{ "HEAP", "Size of the data segment", LINUX_DMEM_STATUS, "VmData:", 0 },
+	{ "STACK", "Size of the stack", LINUX_DMEM_STATUS, "VmStk:", 0 },
+	{ "LIBRARY", "Shared library code", LINUX_DMEM_STATUS, "VmLib:", 0 },
+	{ "PTE", "Page table entries", LINUX_DMEM_STATUS, "VmPTE:", 0 },
+	{ "SWAP", "Swapped out anonymous memory", LINUX_DMEM_STATUS, "VmSwap:", 0 },
+	{ "PSS", "Proportional set size", LINUX_DMEM_SMAPS, "Pss:", 0 },
+	{ "PSS_ANON", "Proportional set size of anonymous memory", LINUX_DMEM_SMAPS, "Pss_Anon:", 0 },
+	{ "PSS_FILE", "Proportional set size of file mappings", LINUX_DMEM_SMAPS, "Pss_File:", 0 },
+	{ "PSS_SHMEM", "Proportional set size of shared memory", LINUX_DMEM_SMAPS, "Pss_Shmem:", 0 },
+	{ "ANONYMOUS", "Anonymous memory, including not resident", LINUX_DMEM_SMAPS, "Anonymous:", 0 },
+	{ "SWAP_PSS", "Proportional swap size", LINUX_DMEM_SMAPS, "SwapPss:", 0 },
+};
+
+#define MEM_MAX_EVENTS ( sizeof ( mem_events ) / sizeof ( mem_events[0] ) )
+
+typedef struct
+{
+	int which_counter[MEM_MAX_EVENTS];
+	long long values[MEM_MAX_EVENTS];
+	int num_events;
+	int files;					/* bit mask of the files to read */
+} MEM_control_state_t;
+
+typedef struct
+{
+	int dummy;
+} MEM_context_t;
+
+typedef struct
+{
+	int dummy;
+} MEM_reg_alloc_t;
+
+/* Events found on this system, as indexes into mem_events */
+static int mem_index[MEM_MAX_EVENTS];
+static int num_events = 0;
+
+/* Keys of each file, their values go to mem_value[] by event */
+static _linux_dmem_key_t mem_keys[LINUX_DMEM_FILES][MEM_MAX_EVENTS];
+static int mem_num_keys[LINUX_DMEM_FILES];
+static long long page_kb;
+
+papi_vector_t _memory_vector;
+
+/* Read the files in the mask, values[] is indexed like mem_events */
+static int
+read_memory( int files, long long *values )
+{
+	long long statm[7];
+	int file, i;
+
+	if ( files & ( 1 << LINUX_DMEM_STATM ) ) {
+		if ( _linux_dmem_read_statm( statm ) != PAPI_OK )
+			return PAPI_ESYS;
+		for ( i = 0; i < ( int ) MEM_MAX_EVENTS; i++ )
+			if ( mem_events[i].file == LINUX_DMEM_STATM )
+				values[i] = statm[mem_events[i].column] * page_kb;
+	}
+	for ( file = 0; file < LINUX_DMEM_FILES; file++ ) {
+		if ( file == LINUX_DMEM_STATM || !( files & ( 1 << file ) ) )
+			continue;
+		if ( _linux_dmem_read( file, mem_keys[file], mem_num_keys[file],
+							   values ) < 0 )
+			return PAPI_ESYS;
+	}
+	return PAPI_OK;
+}
+
+static int
+_memory_init_component( int cidx )
+{
+	long long values[MEM_MAX_EVENTS];
+	int retval = PAPI_OK;
+	int i, file;
+
+	page_kb = getpagesize(  ) / 1024;
+
+	/* PAPI_shutdown and PAPI_library_init run this again */
+	num_events = 0;
+	memset( mem_num_keys, 0, sizeof ( mem_num_keys ) );
+
+	for ( i = 0; i < ( int ) MEM_MAX_EVENTS; i++ ) {
+		file = mem_events[i].file;
+		if ( file == LINUX_DMEM_STATM )
+			continue;
+		mem_keys[file][mem_num_keys[file]].key = mem_events[i].key;
+		mem_keys[file][mem_num_keys[file]].len = strlen( mem_events[i].key );
+		mem_keys[file][mem_num_keys[file]].offset = i * sizeof ( long long );
+		mem_num_keys[file]++;
+	}
+
+	if ( read_memory( 1 << LINUX_DMEM_STATM, values ) != PAPI_OK ) {
+		strncpy( _memory_vector.cmp_info.disabled_reason,
+				 "Cannot read /proc/self/statm", PAPI_MAX_STR_LEN );
+		retval = PAPI_ENOSUPP;
+		goto fn_fail;
+	}
+
+	/* Keep the events whose line is there, smaps_rollup and some */
+	/* status lines are missing on older kernels                   */
+	for ( i = 0; i < ( int ) MEM_MAX_EVENTS; i++ )
+		values[i] = -1;
+	read_memory( ( 1 << LINUX_DMEM_STATUS ) | ( 1 << LINUX_DMEM_SMAPS ), values );
+	for ( i = 0; i < ( int ) MEM_MAX_EVENTS; i++ )
+		if ( mem_events[i].file == LINUX_DMEM_STATM || values[i] >= 0 )
+			mem_index[num_events++] = i;
+
+	_memory_vector.cmp_info.num_native_events = num_events;
+	_memory_vector.cmp_info.num_cntrs = num_events;
+	_memory_vector.cmp_info.num_mpx_cntrs = num_events;
+
+  fn_exit:
+	_papi_hwd[cidx]->cmp_info.disabled = retval;
+	return retval;
+  fn_fail:
+	goto fn_exit;
+}
+
+static int
+_memory_init_thread( hwd_context_t * ctx )
+{
+	( void ) ctx;
+	return PAPI_OK;
+}
+
+static int
+_memory_shutdown_thread( hwd_context_t * ctx )
+{
+	( void ) ctx;
+	return PAPI_OK;
+}
+
+static int
+_memory_shutdown_component( void )
+{
+	return PAPI_OK;
+}
+
+static int
+_memory_init_control_state( hwd_control_state_t * ctl )
+{
+	MEM_control_state_t *control = ( MEM_control_state_t * ) ctl;
+
+	control->num_events = 0;
+	control->files = 0;
+	return PAPI_OK;
+}
+
+static int
+_memory_update_control_state( hwd_control_state_t * ctl, NativeInfo_t * native,
+							  int count, hwd_context_t * ctx )
+{
+	MEM_control_state_t *control = ( MEM_control_state_t * ) ctl;
+	int i, index;
+
+	( void ) ctx;
+
+	if ( count > ( int ) MEM_MAX_EVENTS )
+		return PAPI_ECOUNT;
+
+	control->files = 0;
+	for ( i = 0; i < count; i++ ) {
+		index = mem_index[native[i].ni_event];
+		control->which_counter[i] = index;
+		control->files |= 1 << mem_events[index].file;
+		native[i].ni_position = i;
+	}
+	control->num_events = count;
+
+	return PAPI_OK;
+}
+
+static int
+_memory_start( hwd_context_t * ctx, hwd_control_state_t * ctl )
+{
+	( void ) ctx;
+	( void ) ctl;
+	return PAPI_OK;
+}
+
+static int
+_memory_stop( hwd_context_t * ctx, hwd_control_state_t * ctl )
+{
+	( void ) ctx;
+	( void ) ctl;
+	return PAPI_OK;
+}
+
+static int
+_memory_read( hwd_context_t * ctx, hwd_control_state_t * ctl,
+			  long long **events, int flags )
+{
+	MEM_control_state_t *control = ( MEM_control_state_t * ) ctl;
+	long long values[MEM_MAX_EVENTS];
+	int i, retval;
+
+	( void ) ctx;
+	( void ) flags;
+
+	retval = read_memory( control->files, values );
+	if ( retval != PAPI_OK )
+		return retval;
+	for ( i = 0; i < control->num_events; i++ )
+		control->values[i] = values[control->which_counter[i]];
+
+	*events = control->values;
+	return PAPI_OK;
+}
+
+static int
+_memory_reset( hwd_context_t * ctx, hwd_control_state_t * ctl )
+{
+	( void ) ctx;
+	( void ) ctl;
+	return PAPI_OK;
+}
+
+static int
+_memory_ctl( hwd_context_t * ctx, int code, _papi_int_option_t * option )
+{
+	( void ) ctx;
+	( void ) code;
+	( void ) option;
+	return PAPI_OK;
+}
+
+static int
+_memory_set_domain( hwd_control_state_t * ctl, int domain )
+{
+	( void ) ctl;
+	if ( !( domain & ( PAPI_DOM_USER | PAPI_DOM_KERNEL | PAPI_DOM_OTHER ) ) )
+		return PAPI_EINVAL;
+	return PAPI_OK;
+}
+
+static int
+_memory_ntv_enum_events( unsigned int *EventCode, int modifier )
+{
+	if ( modifier == PAPI_ENUM_FIRST ) {
+		if ( num_events == 0 )
+			return PAPI_ENOEVNT;
+		*EventCode = 0;
+		return PAPI_OK;
+	}
+
+	if ( modifier == PAPI_ENUM_EVENTS ) {
+		if ( ( int ) *EventCode + 1 < num_events ) {
+			*EventCode = *EventCode + 1;
+			return PAPI_OK;
+		}
+		return PAPI_ENOEVNT;
+	}
+
+	return PAPI_EINVAL;
+}
+
+static int
+_memory_ntv_code_to_name( unsigned int EventCode, char *name, int len )
+{
+	if ( ( int ) EventCode >= num_events )
+		return PAPI_ENOEVNT;
+	strncpy( name, mem_events[mem_index[EventCode]].name, len );
+	return PAPI_OK;
+}
+
+static int
+_memory_ntv_code_to_descr( unsigned int EventCode, char *descr, int len )
+{
+	if ( ( int ) EventCode >= num_events )
+		return PAPI_ENOEVNT;
+	strncpy( descr, mem_events[mem_index[EventCode]].description, len );
+	return PAPI_OK;
+}
+
+static int
+_memory_ntv_code_to_info( unsigned int EventCode, PAPI_event_info_t * info )
+{
+	const MEM_native_event_entry_t *event;
+
+	if ( ( int ) EventCode >= num_events )
+		return PAPI_ENOEVNT;
+	event = &mem_events[mem_index[EventCode]];
+
+	strncpy( info->symbol, event->name, sizeof ( info->symbol ) - 1 );
+	info->symbol[sizeof ( info->symbol ) - 1] = '\0';
+	strncpy( info->long_descr, event->description, sizeof ( info->long_descr ) - 1 );
+	info->long_descr[sizeof ( info->long_descr ) - 1] = '\0';
+	strncpy( info->units, "KB", sizeof ( info->units ) - 1 );
+	info->units[sizeof ( info->units ) - 1] = '\0';
+	info->value_type = PAPI_VALUETYPE_ABSOLUTE;
+	info->timescope = PAPI_TIMESCOPE_POINT;
+
+	return PAPI_OK;
+}
+
+papi_vector_t _memory_vector = {
+	.cmp_info = {
+		.name = "memory",
+		.short_name = "memory",
+		.version = "1.0",
+		.description = "Memory usage of the process from /proc/self",
+		.default_domain = PAPI_DOM_USER,
+		.default_granularity = PAPI_GRN_THR,
+		.available_granularities = PAPI_GRN_THR,
+		.hardware_intr_sig = PAPI_INT_SIGNAL,
+		.fast_real_timer = 0,
+		.fast_virtual_timer = 0,
+		.attach = 0,
+		.attach_must_ptrace = 0,
+		.available_domains = PAPI_DOM_USER | PAPI_DOM_KERNEL,
+	},
+
+	.size = {
+		.context = sizeof ( MEM_context_t ),
+		.control_state = sizeof ( MEM_control_state_t ),
+		.reg_value = sizeof ( MEM_reg_alloc_t ),
+		.reg_alloc = sizeof ( MEM_reg_alloc_t ),
+	},
+
+	.init_thread = _memory_init_thread,
+	.init_component = _memory_init_component,
+	.init_control_state = _memory_init_control_state,
+	.start = _memory_start,
+	.stop = _memory_stop,
+	.read = _memory_read,
+	.shutdown_thread = _memory_shutdown_thread,
+	.shutdown_component = _memory_shutdown_component,
+	.ctl = _memory_ctl,
+	.update_control_state = _memory_update_control_state,
+	.set_domain = _memory_set_domain,
+	.reset = _memory_reset,
+
+	.ntv_enum_events = _memory_ntv_enum_events,
+	.ntv_code_to_name = _memory_ntv_code_to_name,
+	.ntv_code_to_descr = _memory_ntv_code_to_descr,
+	.ntv_code_to_info = _memory_ntv_code_to_info,
+};
@@ -0,0 +1,187 @@
+/**
+ * @file    memory_basic.c
+ * @brief Test of the memory component.
+ *
+ *  - Add the resident set size and the proportional set size, if there
+ *    is one, to an EventSet.
+ *  - Touch memory and check that the resident set size grows by about
+ *    as much, and that it matches PAPI_get_dmem_info().
+ *  - Time reads of the EventSet and calls of PAPI_get_dmem_info().
+ *  - Shut PAPI down and initialize it again a few times, the component
+ *    must offer the same events and still read them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define TOUCH_KB ( 64 * 1024 )
+#define CALLS 1000
+#define INITS 8
+
+int main (int argc, char **argv)
+{
+    int retval, i, round, cidx, num_native, num_events = 1;
+    int EventSet = PAPI_NULL;
+    long long before[2], after[2], now[2], start, read_ns, dmem_ns;
+    PAPI_dmem_info_t dmem;
+    const PAPI_component_info_t *cmpinfo;
+    char *buffer;
+    int quiet;
+
+    /* Set TESTS_QUIET variable */
+    quiet = tests_quiet( argc, argv );
+
+    retval = PAPI_library_init( PAPI_VER_CURRENT );
+    if ( retval != PAPI_VER_CURRENT ) {
+        test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+    }
+
+    retval = PAPI_create_eventset( &EventSet );
+    if ( retval != PAPI_OK ) {
+        test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+    }
+
+    retval = PAPI_add_named_event( EventSet, "memory:::RESIDENT" );
+    if ( retval != PAPI_OK ) {
+        test_skip( __FILE__, __LINE__, "memory component not available", retval );
+    }
+    /* smaps_rollup is missing on older kernels */
+    if ( PAPI_add_named_event( EventSet, "memory:::PSS" ) == PAPI_OK ) {
+        num_events = 2;
+    }
+
+    retval = PAPI_start( EventSet );
+    if ( retval != PAPI_OK ) {
+        test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+    }
+
+    retval = PAPI_read( EventSet, before );
+    if ( retval != PAPI_OK ) {
+        test_fail( __FILE__, __LINE__, "PAPI_read", retval );
+    }
+
+    buffer = malloc( TOUCH_KB * 1024 );
+    if ( buffer == NULL ) {
+        test_fail( __FILE__, __LINE__, "malloc", 0 );
+    }
+    memset( buffer, 1, TOUCH_KB * 1024 );
+
+    retval = PAPI_read( EventSet, after );
+    if ( retval != PAPI_OK ) {
+        test_fail( __FILE__, __LINE__, "PAPI_read", retval );
+    }
+    retval = PAPI_get_dmem_info( &dmem );
+    if ( retval != PAPI_OK ) {
+        test_fail( __FILE__, __LINE__, "PAPI_get_dmem_info", retval );
+    }
+
+    start = PAPI_get_real_nsec();
+    for ( i = 0; i < CALLS; i++ ) {
+        PAPI_read( EventSet, now );
+    }
+    read_ns = ( PAPI_get_real_nsec() - start ) / CALLS;
+
+    start = PAPI_get_real_nsec();
+    for ( i = 0; i < CALLS; i++ ) {
+        PAPI_get_dmem_info( &dmem );
+    }
+    dmem_ns = ( PAPI_get_real_nsec() - start ) / CALLS;
+
+    retval = PAPI_stop( EventSet, now );
+    if ( retval != PAPI_OK ) {
+        test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+    }
+
+    if ( !quiet ) {
+        printf( "memory:::RESIDENT %lld KB after touching %d KB, dmem resident %lld KB\n",
+                after[0], TOUCH_KB, dmem.resident );
+        if ( num_events > 1 )
+            printf( "memory:::PSS %lld KB\n", after[1] );
+        printf( "%lld ns per PAPI_read, %lld ns per PAPI_get_dmem_info\n",
+                read_ns, dmem_ns );
+    }
+
+    /* malloc and libc may take a little on the side */
+    if ( after[0] - before[0] < TOUCH_KB * 9 / 10 ) {
+        test_fail( __FILE__, __LINE__, "Resident set did not grow", after[0] );
+    }
+    if ( dmem.resident < after[0] * 9 / 10 || dmem.resident > after[0] * 11 / 10 ) {
+        test_fail( __FILE__, __LINE__, "RESIDENT does not match PAPI_get_dmem_info", 0 );
+    }
+
+    free( buffer );
+
+    /* The events are set up again by each PAPI_library_init, over
+       and over without piling up */
+    cidx = PAPI_get_component_index( "memory" );
+    cmpinfo = PAPI_get_component_info( cidx );
+    if ( cmpinfo == NULL ) {
+        test_fail( __FILE__, __LINE__, "PAPI_get_component_info", 0 );
+    }
+    num_native = cmpinfo->num_native_events;
+
+    for ( round = 0; round < INITS; round++ ) {
+        retval = PAPI_cleanup_eventset( EventSet );
+        if ( retval != PAPI_OK ) {
+            test_fail( __FILE__, __LINE__, "PAPI_cleanup_eventset", retval );
+        }
+        retval = PAPI_destroy_eventset( &EventSet );
+        if ( retval != PAPI_OK ) {
+            test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset", retval );
+        }
+        PAPI_shutdown();
+
+        retval = PAPI_library_init( PAPI_VER_CURRENT );
+        if ( retval != PAPI_VER_CURRENT ) {
+            test_fail( __FILE__, __LINE__, "PAPI_library_init again", retval );
+        }
+        cidx = PAPI_get_component_index( "memory" );
+        cmpinfo = PAPI_get_component_info( cidx );
+        if ( cmpinfo == NULL || cmpinfo->num_native_events != num_native ) {
+            test_fail( __FILE__, __LINE__, "Events differ after PAPI_library_init again", 0 );
+        }
+
+        retval = PAPI_create_eventset( &EventSet );
+        if ( retval != PAPI_OK ) {
+            test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+        }
+        retval = PAPI_add_named_event( EventSet, "memory:::RESIDENT" );
+        if ( retval != PAPI_OK ) {
+            test_fail( __FILE__, __LINE__, "PAPI_add_named_event after PAPI_library_init again", retval );
+        }
+        if ( num_events > 1 ) {
+            retval = PAPI_add_named_event( EventSet, "memory:::PSS" );
+            if ( retval != PAPI_OK ) {
+                test_fail( __FILE__, __LINE__, "PAPI_add_named_event after PAPI_library_init again", retval );
+            }
+        }
+        retval = PAPI_start( EventSet );
+        if ( retval != PAPI_OK ) {
+            test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+        }
+        retval = PAPI_stop( EventSet, now );
+        if ( retval != PAPI_OK ) {
+            test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+        }
+        for ( i = 0; i < num_events; i++ ) {
+            if ( now[i] <= 0 ) {
+                test_fail( __FILE__, __LINE__, "Event not read after PAPI_library_init again", now[i] );
+            }
+        }
+    }
+
+    if ( !quiet ) {
+        printf( "%d events, memory:::RESIDENT %lld KB after %d more PAPI_library_init\n",
+                num_native, now[0], INITS );
+        if ( num_events > 1 )
+            printf( "memory:::PSS %lld KB\n", now[1] );
+    }
+
+    test_pass( __FILE__ );
+
+    return 0;
+}
@@ -4,9 +4,11 @@
 // Performance Co-Pilot package. A manual for pmXXX commands is online at 
 // https://pcp.io/man/
 // Performance: As tested on the ICL Saturn system, round-trip communications 
-// with the PCP Daemon cost us 8-10ms, so every pm___ call is a stall. We have
-// to create our event list when initialized, but we can do that with some 
-// 'batch' reads to minimize overhead. 
+// with the PCP Daemon cost us 8-10ms, so every pm___ call is a stall. So the
+// event list is not built when initialized; it is built a subtree at a time,
+// the first time a name in that subtree is looked up (or all of it, when the
+// events are enumerated), with 'batch' reads to minimize overhead. A read only
+// fetches the PMIDs of its own EventSet, listed once when the set changes.
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 // #define DEBUG /* To enable SUBDBG messages */
@@ -113,6 +115,7 @@ typedef struct _pcp_event_info               // an array of these is populated b
    char      domainDesc[PAPI_MAX_STR_LEN];   // Domain description if not null.
    int       numVal;                         // number of values in array.
    int       idx;                            // idx into vlist array.
+   int       inst;                           // instance id of vlist[idx], PM_IN_NULL if none.
    unsigned long long zeroValue;             // Value that counts as zero.
 } _pcp_event_info_t;
 
@@ -142,6 +145,9 @@ typedef struct _pcp_control_state
    int maxAllocated;                               // The most ever allocated.
    int *pcpIndex;                                  // array of indices into pcp_event_info[].
    unsigned long long *pcpValue;                   // corresponding value read.
+   int numPMID;                                    // The number of unique PMIDs in the set.
+   pmID *pmidList;                                 // the unique PMIDs, what pmFetch reads.
+   int *vsetIndex;                                 // for each event, its vset in the pmResult.
 } _pcp_control_state_t;
 
 
@@ -193,6 +199,11 @@ static int  ctxHandle = -1;                                             // conte
 static char *cachedGetInDom(pmInDom indom, int inst);                   // cache all reads of pcp_pmGetInDom, to save time.
 #define     HASH_SIZE 512                                               /* very roughly in the range of total events. full Saturn test, had ~ 11,000 events.*/
 static      _pcp_hash_t sNameHash[HASH_SIZE];                           // hash table into pcp_event_info by event name.
+#define     PCP_MAX_COUNTERS 512                                        /* most events in one EventSet; the event count is not known at init. */
+static char sNamespace[PAPI_MAX_STR_LEN];                               // root of our names; AGENT_NAME, or PAPI_PCP_NAMESPACE if set.
+static int  sNamespaceLoaded = 0;                                       // 1 once the whole of sNamespace has been traversed.
+static char **sLoadedPrefix = NULL;                                     // names and subtrees traversed so far.
+static int  sLoadedCount = 0;                                           // .. number of them.
 
 #define COUNT_ROUTINES 1                                                /* Change to zero to stop counting. */
 #if (COUNT_ROUTINES == 1)
@@ -273,6 +284,7 @@ static int     (*pmLookupDesc_ptr)     (pmID pmid, pmDesc *desc);
 static int     (*pmGetInDom_ptr)       (pmInDom indom, int **instlist, char ***namelist);
 static int     (*pmLookupText_ptr)     (pmID pmid, int level, char **buffer);
 static char *  (*pmUnitsStr_r_ptr)     (const pmUnits *pu, char *buf, int buflen); 
+static int     (*pmGetChildren_ptr)    (const char *name, char ***offspring);
 
 // -------------------- LOCAL WRAPPERS FOR LIB FUNCTIONS ---------------------
 static int     pcp_pmLookupName (int numpid, char **namelist, pmID *pmidlist) 
@@ -308,6 +320,9 @@ static int     pcp_pmLookupText(pmID pmid, int level, char **buffer)
 static char*   pcp_pmUnitsStr_r (const pmUnits *pu, char *buf, int buflen) 
                   {return ((*pmUnitsStr_r_ptr) (pu, buf, buflen)); }
 
+static int     pcp_pmGetChildren (const char *name, char ***offspring) 
+                  { return ((*pmGetChildren_ptr) (name, offspring)); }
+
 
 //-----------------------------------------------------------------------------
 // stringHash: returns unsigned long value for hashed string.  See djb2, Dan
@@ -480,6 +495,7 @@ static int _local_linkDynamicLibraries(void)
    mGet_DL_FPtr(pmGetInDom);
    mGet_DL_FPtr(pmLookupText);
    mGet_DL_FPtr(pmUnitsStr_r);
+   mGet_DL_FPtr(pmGetChildren);
    return PAPI_OK;   // If we get here, all above succeeded. 
 } // end routine.
 
@@ -504,12 +520,17 @@ static int qsPMID(const void *arg1, const void* arg2)
 // cbPopulateNameOnly: This is a callback routine, called by pmTraversePMNS.  That
 // routine iterates through the PM name space and calls this routine once per
 // name. We increment sEventCount as we go, this will be the final count of valid
-// array entries. sEventInfoSize will be >= sEventCount.
+// array entries. sEventInfoSize will be >= sEventCount. Names of subtrees
+// that were traversed before are skipped; their events are already present.
 // WARNING: May realloc() pcp_event_info[], invalidating pointers into it.
 //-----------------------------------------------------------------------------
 
+static int pcpNameLoaded(const char *name);
+
 static void cbPopulateNameOnly(const char *name) 
 {
+   if (pcpNameLoaded(name)) return;                                     // Have it from an earlier traversal.
+
    if (sEventCount >= sEventInfoSize) {                                 // If we must realloc, 
       sEventInfoSize += sEventInfoBlock;                                // .. Add another page.
       pcp_event_info = realloc(pcp_event_info,                          // .. do realloc.
@@ -529,7 +550,7 @@ static void cbPopulateNameOnly(const char *name)
 // (which CAN invalidate any pointers into it).
 //-----------------------------------------------------------------------------
 
-static void makeQualifiedEvent(int baseEvent, int idx, char *qualifier) 
+static void makeQualifiedEvent(int baseEvent, int idx, int inst, char *qualifier) 
 {
    int prevSize;
    if (sEventCount >= sEventInfoSize) {                                 // If we must realloc, 
@@ -552,6 +573,7 @@ static void makeQualifiedEvent(int baseEvent, int idx, char *qualifier)
    pcp_event_info[sEventCount] = pcp_event_info[baseEvent];             // copy the structure.
    pcp_event_info[sEventCount].numVal = 1;                              // Just one value.
    pcp_event_info[sEventCount].idx = idx;                               // Set the right index.
+   pcp_event_info[sEventCount].inst = inst;                             // .. and the instance it was fetched for.
    pcp_event_info[sEventCount].zeroValue = 0;                           // Set the base value.  
    int slen = strlen(pcp_event_info[sEventCount].name);                 // get length of user name.
    char *c = qualifier;                                                 // point at qualifier.
@@ -843,6 +865,304 @@ static int getHelpText(unsigned int pcpIdx, char **helpText)
 } // end routine.
 
 
+//-----------------------------------------------------------------------------
+// Helper routine, returns the index into vset->vlist[] of the value for
+// pcp_event_info[pcpIdx], or -1 if the fetch returned none for it. That is
+// the index seen when the event was created, unless the instances of the
+// metric have changed since.
+//-----------------------------------------------------------------------------
+static int getValueIndex(pmValueSet *vset, int pcpIdx) 
+{
+   int i, idx = pcp_event_info[pcpIdx].idx;                             // where it was.
+   int inst = pcp_event_info[pcpIdx].inst;                              // what it was.
+
+   if (idx < vset->numval && vset->vlist[idx].inst == inst) return(idx); // The usual case; numval < 0 is an error.
+   for (i=0; i<vset->numval; i++) {                                     // Otherwise search for the instance.
+      if (vset->vlist[i].inst == inst) return(i);                       // .. found it.
+   }
+
+   return(-1);                                                          // No value for this event.
+} // end routine.
+
+
+//-----------------------------------------------------------------------------
+// pcpNameLoaded: Returns 1 if name lies in a subtree of the PM name space that
+// has already been traversed, so any events for it are in pcp_event_info[].
+//-----------------------------------------------------------------------------
+static int pcpNameLoaded(const char *name) 
+{
+   int i;
+   size_t len;
+
+   if (sNamespaceLoaded) return(1);                                     // We have it all.
+   for (i=0; i<sLoadedCount; i++) {                                     // Check the subtrees we have.
+      len = strlen(sLoadedPrefix[i]);                                   // .. 
+      if (strncmp(name, sLoadedPrefix[i], len) == 0 &&                  // .. If it starts with the prefix,
+          (name[len] == 0 || name[len] == '.')) return(1);              // .. .. at a node boundary, it is loaded.
+   }
+
+   return(0);                                                           // Not traversed yet.
+} // end routine.
+
+
+//-----------------------------------------------------------------------------
+// pcpInNamespace: Returns 1 if name lies under sNamespace, the part of the PM
+// name space we serve.
+//-----------------------------------------------------------------------------
+static int pcpInNamespace(const char *name) 
+{
+   size_t len = strlen(sNamespace);
+   if (len == 0) return(1);                                             // Serving it all.
+   return(strncmp(name, sNamespace, len) == 0 && name[len] == '.');     // A metric below the root.
+} // end routine.
+
+
+//-----------------------------------------------------------------------------
+// pcpSetupEvent: Sets up the new event pcp_event_info[i] from the value set
+// fetched for it. Events we cannot return (no values, strings, unknown
+// types) are left with numVal = 0, for deletion. If a multi-valued event has
+// instance names, we need to force an event for every value (PAPI only
+// returns 1 value per event; not an array). In experiments thus far, all
+// multi-valued events have had domain descriptor names; so we just concat
+// with the name and make a new Event, and let the base event be deleted.
+// WARNING: May realloc() pcp_event_info[], invalidating pointers into it.
+// RETURNS PAPI_OK or PAPI error.
+//-----------------------------------------------------------------------------
+static int pcpSetupEvent(int i, pmValueSet *vset) 
+{
+   int j;
+
+   pcp_event_info[i].desc.pmid = PM_ID_NULL;                            // This indicates the description is NOT loaded yet.
+
+   // On Saturn test system, never saw this happen.
+   if (vset == NULL) {                                                  // .. should not happen. leave numVal=0 for deletion.
+      fprintf(stderr, "%s:%i vset=NULL for name='%s'\n", 
+         __FILE__, __LINE__, pcp_event_info[i].name);
+      return PAPI_OK;
+   }
+  
+   pcp_event_info[i].numVal = vset->numval;                             // Show we have a value.
+   if (vset->numval <= 0) {                                             // If there are no values (or an error), 
+      pcp_event_info[i].numVal = 0;                                     // .. leave numVal = 0 for deletion. (We do see this in tests). 
+      return PAPI_OK;
+   }
+
+   pcp_event_info[i].valfmt = vset->valfmt;                             // Get the value format. (INSITU or not).
+   pcp_event_info[i].idx = 0;                                           // The single value is the first.
+   pcp_event_info[i].inst = vset->vlist[0].inst;                        // .. for this instance.
+   getPMDesc(i);                                                        // Get the value descriptor.
+
+   if (vset->valfmt != PM_VAL_INSITU) {                                 // If not in situ, must check the type.
+      pmValueBlock *pB = vset->vlist[0].value.pval;                     // .. get the first value.
+      if (pcp_event_info[i].valType != pB->vtype) {
+         fprintf(stderr, "%s:%i:%s Unexpected value type fetched for %s. %i vs %i. Possible version incompatibiity.\n", 
+            __FILE__, __LINE__, FUNC, pcp_event_info[i].name, pcp_event_info[i].valType, pB->vtype);
+         return PAPI_ENOSUPP;
+      }
+
+      switch(pB->vtype) {                                               // PCP's variable type; an int flag.
+         case  PM_TYPE_32:                                              // 32-bit signed integer
+         case  PM_TYPE_U32:                                             // 32-bit unsigned integer
+         case  PM_TYPE_FLOAT:                                           // 32-bit floating point
+         case  PM_TYPE_64:                                              // 64-bit signed integer
+         case  PM_TYPE_U64:                                             // 64-bit unsigned integer
+         case  PM_TYPE_DOUBLE:                                          // 64-bit floating point
+            break;                                                      // END CASE.
+
+         // IF YOU want to return string values, this is a place
+         // to change; currently all string-valued events are
+         // rejected. But, pB->vbuf is the string value. I would
+         // copy it into a new pcp_event_info[] field; it would
+         // need to be malloc'd here and free'd at component
+         // shutdown. Also PAPI would need a new way to accept a
+         // char* or void*. 
+
+         case  PM_TYPE_STRING:                                          // pB->vbuf is char* to string value.
+            _prog_fprintf(stderr, "%s:%i Discarding PM_TYPE_STRING event, desc.sem=%i, event '%s'\n", __FILE__, __LINE__, pcp_event_info[i].desc.sem, pcp_event_info[i].name); 
+            pcp_event_info[i].numVal = 0;                               // .. .. set numVal = 0 for deletion.
+            return PAPI_OK;
+
+         default:                                                       // If we don't recognize the type,
+            _prog_fprintf(stderr, "%s:%i Discarding PM_UNKNOWN_TYPE event, desc.sem=%i, event '%s'\n", __FILE__, __LINE__, pcp_event_info[i].desc.sem, pcp_event_info[i].name); 
+            pcp_event_info[i].numVal = 0;                               // .. set numVal = 0 for deletion.
+            return PAPI_OK;
+      } // end switch.
+   } // If not In Situ.
+
+   if (pcp_event_info[i].numVal > 1 &&                                  // If a domain qualifier is possible;
+       pcp_event_info[i].desc.indom != PM_INDOM_NULL) {                 // .. and we have a non-null domain,
+      _prog_fprintf(stderr, "Event %s has %i values, indom=%i.\n", pcp_event_info[i].name, pcp_event_info[i].numVal, pcp_event_info[i].desc.indom); 
+      for (j=0; j<vset->numval; j++) {                                  // .. for every value present,
+         pmValue *pmval = &vset->vlist[j];                              // .. .. get that guy.
+
+         char *dname = cachedGetInDom(                                  // .. .. read from cached domains (and populate it when needed).
+                           pcp_event_info[i].desc.indom,
+                           pmval->inst);                                // .. .. get the name. Not malloced so don't free dName.
+
+         makeQualifiedEvent(i, j, pmval->inst, dname);                  // .. .. helper routine; may realloc pcp_event_info[], change sEventCount.
+      } // end value list.
+      
+      pcp_event_info[i].numVal = 0;                                     // .. let the base event be discarded.
+   } // end if multiple valued with a domain.
+
+   return PAPI_OK;
+} // end routine.
+
+
+//-----------------------------------------------------------------------------
+// pcpLoadNames: Adds the events of one subtree of the PM name space, or of a
+// single metric, to pcp_event_info[]. The new names are appended behind the
+// existing events, so event codes handed out earlier remain valid. Names are
+// looked up and fetched once in blocks (to find their values, types and
+// instances) and exploded into one event per instance; the new events are
+// sorted by PMID, idx and name, and added to the name hash.
+// Caller must hold COMPONENT_LOCK.
+// RETURNS PAPI_OK, PAPI_ENOEVNT if prefix is not a PCP name, or PAPI error.
+//-----------------------------------------------------------------------------
+static int pcpLoadNames(const char *prefix) 
+{
+   int i, j, k, ret, retval = PAPI_OK;
+   int first = sEventCount;                                             // New events start here.
+   int newCount;
+   char **newNames = NULL;                                              // Work areas, freed on exit.
+   pmID *newPMID = NULL;                                                // ..
+   pmResult *newFetch = NULL;                                           // ..
+
+   if (pcpNameLoaded(prefix)) return PAPI_OK;                           // Nothing new to get.
+
+   _time_gettimeofday(&t1, NULL);
+   ret = pcp_pmTraversePMNS(prefix, cbPopulateNameOnly);                // Timed on Saturn [Intel Xeon 2.0GHz]; typical 9ms, range 8.5-10.5ms for all.
+   _time_gettimeofday(&t2, NULL);
+   _time_fprintf(stderr, "pmTraversePMNS '%s' took %li uS, %i names.\n", 
+      prefix, (mConvertUsec(t2)-mConvertUsec(t1)), sEventCount-first);
+   if (ret < 0) {                                                       // Failure...
+      sEventCount = first;                                              // .. drop any names we got.
+      if (ret == PM_ERR_NAME) return PAPI_ENOEVNT;                      // .. not a name the daemon knows.
+      fprintf(stderr, "%s:%i:%s pmTraversePMNS('%s') failed; ret=%i [%s].\n", 
+         __FILE__, __LINE__, FUNC, prefix, ret, pcp_pmErrStr(ret));
+      return PAPI_ESYS;
+   }      
+
+   newCount = sEventCount - first;                                      // Names we did not have.
+   if (newCount > 0) {
+      newNames = calloc(newCount, sizeof(char*));                       // Make an array for the new names. 
+      newPMID = calloc(newCount, sizeof(pmID));                         // .. and for their PMIDs.
+      if (newNames == NULL || newPMID == NULL) {                        // If we failed,
+         retval = PAPI_ENOMEM;
+         goto fn_fail;
+      }
+
+      for (i=0; i<newCount; i++) {                                      // .. 
+         newNames[i] = pcp_event_info[first+i].name;                    // copy pointer into array; no realloc before the lookup.
+      } // end for each event.
+
+      //----------------------------------------------------------------
+      // Unlike Saturn, on the Power9 we get an 'IPC protocol failure' 
+      // if we try to read more than 946 names at a time. This is some
+      // limitation on a communication packet size. On our test system
+      // Power9; the maximum number we can read is 946. To allow leeway
+      // for other possible values; we read (and fetch) in blocks of 256.
+      //----------------------------------------------------------------
+      #define LNBLOCK 256                                               /* Power9 gets IPC errors if read block is too large. */
+      k = (__LINE__)-1;                                                 // where LNBLOCK is defined.   
+
+      _time_gettimeofday(&t1, NULL);
+      for (i=0; i<newCount; i+=j) {                                     // read in blocks of LNBLOCK.
+         j = newCount-i;                                                // .. presume we can read the rest.
+         if (j > LNBLOCK) j=LNBLOCK;                                    // .. reduce if we cannot.
+         ret = pcp_pmLookupName(j, newNames+i, newPMID+i);              // .. Get a block of PMIDs for a block of names.
+         if (ret < 0) {                                                 // .. Failure...
+            if (ret == PM_ERR_IPC) {                                    // .. If we know it, say so.
+               fprintf(stderr, "%s:%i:%s pmLookupName ret=PM_ERR_IPC: one known cause is a readblock too large; reduce LNBLOCK (%s:%i).\n",
+                  __FILE__, __LINE__, FUNC, __FILE__, k);
+               retval = PAPI_EBUF;
+               goto fn_fail;
+            }
+
+            fprintf(stderr, "%s:%i:%s pmLookupName for %i names failed; ret=%i [%s].\n", 
+               __FILE__, __LINE__, FUNC, j, ret, pcp_pmErrStr(ret));
+            retval = PAPI_ESYS;
+            goto fn_fail;
+         }
+      } // end for to read names in chunks, and avoid IPC error. 
+
+      _time_gettimeofday(&t2, NULL);
+      _time_fprintf(stderr, "pmLookupName for %i took %li uS.\n", 
+         newCount, (mConvertUsec(t2)-mConvertUsec(t1)));
+
+      for (i=0; i<newCount; i++) pcp_event_info[first+i].pmid = newPMID[i]; // copy the pmid over to array.
+
+      _time_gettimeofday(&t1, NULL);
+      for (i=0; i<newCount; i+=j) {                                     // fetch in blocks of LNBLOCK, only the new ones.
+         j = newCount-i;                                                // .. 
+         if (j > LNBLOCK) j=LNBLOCK;                                    // .. 
+         ret = pcp_pmFetch(j, newPMID+i, &newFetch);                    // .. Fetch (read) a block of events.
+         if (ret < 0) {
+            fprintf(stderr, "%s:%i:%s pmFetch for %i events failed; ret=%i [%s].\n", 
+               __FILE__, __LINE__, FUNC, j, ret, pcp_pmErrStr(ret));
+            retval = PAPI_ENOSUPP;
+            goto fn_fail;
+         }
+
+         for (k=0; k<j; k++) {                                          // .. set up each event of the block.
+            retval = pcpSetupEvent(first+i+k, newFetch->vset[k]);       // .. .. may append qualified events.
+            if (retval != PAPI_OK) goto fn_fail;
+         }
+
+         pcp_pmFreeResult(newFetch);                                    // .. done with this block.
+         newFetch = NULL;                                               // .. never free it twice.
+      } // end for each block.
+      #undef LNBLOCK                                                    /* Discard constant; no further use. */  
+
+      _time_gettimeofday(&t2, NULL);
+      _time_fprintf(stderr, "pmFetch and indexedExplosion for %i took %li uS.\n", 
+         newCount, (mConvertUsec(t2)-mConvertUsec(t1)));
+
+      // Trim the fat! We get rid of every new event with numVal == 0,
+      // by compaction; moving valid entries to backfill invalid ones.
+      // The array keeps its size, later loads append to it.
+
+      j=first;                                                          // first destination.
+      for (i=first; i<sEventCount; i++) {                               // loop through all new, base and qualified.
+         if (pcp_event_info[i].numVal > 0) {                            // If we have a valid entry,
+            if (i != j) pcp_event_info[j] = pcp_event_info[i];          // move if it isn't already there.
+            j++;                                                        // count one moved; new count of valid ones.
+         }
+      } 
+               
+      sEventCount = j;                                                  // this is our new count.
+      qsort(pcp_event_info+first, sEventCount-first,                    // sort the new ones by PMID, idx, name.
+            sizeof(_pcp_event_info_t), qsPMID);                         // ..
+
+      for (i=first; i<sEventCount; i++) {                                    
+         addNameHash(pcp_event_info[i].name, i);                        // Point this hash to this entry.   
+      }                                                                  
+   } // end if any new names.
+
+   if (strcmp(prefix, sNamespace) == 0) {                               // If we did the whole thing,
+      sNamespaceLoaded = 1;                                             // .. no need to ever traverse again.
+   } else {                                                             // Otherwise remember the subtree.
+      char **more = realloc(sLoadedPrefix, (sLoadedCount+1)*sizeof(char*));
+      if (more != NULL) {                                               // If we can't, we only traverse it again.
+         sLoadedPrefix = more;
+         sLoadedPrefix[sLoadedCount] = strdup(prefix);
+         if (sLoadedPrefix[sLoadedCount] != NULL) sLoadedCount++;
+      }
+   }
+
+   _pcp_vector.cmp_info.num_native_events = sEventCount;                // What we know of so far.
+
+  fn_exit:
+   free(newNames);                                                      // Local allocations not needed anymore.
+   free(newPMID);                                                       // ..
+   if (newFetch != NULL) pcp_pmFreeResult(newFetch);                    // .. release any results we fetched.
+   return retval;
+  fn_fail:
+   sEventCount = first;                                                 // Nothing of this load is usable.
+   goto fn_exit;
+} // end routine.
+
+
 //----------------------------------------------------------------------------
 //----------------------------------------------------------------------------
 // PAPI FUNCTIONS. 
@@ -863,7 +1183,7 @@ static int _pcp_init_component(int cidx)
    mRtnCnt(_pcp_init_component);                                        // count the routine.
    #define hostnameLen 512 /* constant used multiple times. */
    char hostname[hostnameLen];                                          // host name.
-   int  ret;
+   int  i, ret;
 
    ret = _local_linkDynamicLibraries();
    if ( ret != PAPI_OK ) {                                              // Failure to get lib.
@@ -884,7 +1204,21 @@ static int _pcp_init_component(int cidx)
 
    _prog_fprintf(stderr, "%s:%i retrieved hostname='%s'\n", __FILE__, __LINE__, hostname); // show progress.
 
-   ctxHandle = pcp_pmNewContext(PM_CONTEXT_HOST, "local:");             // Set the new context to local host.
+   char *archive = getenv("PAPI_PCP_ARCHIVE");                          // An archive in place of the daemon, e.g. for tests.
+   if (archive != NULL && archive[0] != 0) {                            // If we have one,
+      ctxHandle = pcp_pmNewContext(PM_CONTEXT_ARCHIVE, archive);        // .. read it instead.
+      if (ctxHandle < 0) {
+         int strErr=snprintf(reason, rLen, "Cannot open PCP archive \"%s\" "
+            "given by PAPI_PCP_ARCHIVE; ret=%i.\n", archive, ctxHandle);
+         reason[rLen-1]=0;
+         if (strErr > rLen) SUBDBG("%s:%i Warning! Error's 'reason' string truncated:\n%s\n",__FILE__,__LINE__,reason);
+         retval = PAPI_ESYS;
+         goto fn_fail;
+      }
+   } else {                                                             // Otherwise,
+      ctxHandle = pcp_pmNewContext(PM_CONTEXT_HOST, "local:");          // .. set the new context to local host.
+   }
+
    if (ctxHandle < 0) {
       int strErr=snprintf(reason, rLen, "Cannot connect to PM Daemon on \"%s\".\n "
          "(Is the Performance Co-Pilot running?)\n", hostname);
@@ -896,9 +1230,14 @@ static int _pcp_init_component(int cidx)
 
    _prog_fprintf(stderr, "%s:%i Found ctxHandle=%i\n", __FILE__, __LINE__, ctxHandle); // show progress.
 
+   char *nspace = getenv("PAPI_PCP_NAMESPACE");                         // User may choose the root of our names.
+   if (nspace == NULL) nspace = AGENT_NAME;                             // .. default is the filter we were built with.
+   strncpy(sNamespace, nspace, PAPI_MAX_STR_LEN-1);                     // ..
+   sNamespace[PAPI_MAX_STR_LEN-1] = 0;                                  // force z-termination.
+
    sEventInfoSize = sEventInfoBlock;                                    // first allocation.   
    pcp_event_info = (_pcp_event_info_t*) 
-      calloc(sEventInfoSize, sizeof(_pcp_event_info_t));                // Make room for all events.
+      calloc(sEventInfoSize, sizeof(_pcp_event_info_t));                // Make room for the first events.
    if (pcp_event_info == NULL) {
       int strErr=snprintf(_pcp_vector.cmp_info.disabled_reason, PAPI_HUGE_STR_LEN,
           "Could not allocate %lu bytes of memory for pcp_event_info.", sEventInfoSize*sizeof(_pcp_event_info_t));
@@ -909,14 +1248,34 @@ static int _pcp_init_component(int cidx)
    }
 
    sEventCount = 0;                                                     // begin at zero.
+   sNamespaceLoaded = 0;                                                // nothing traversed yet.
+   for (i=0; i<HASH_SIZE; i++) {                                        // init hash table.
+      sNameHash[i].idx = -1;                                            // unused entry. 
+      sNameHash[i].next = NULL;                                         // ..
+   }                                                                  
+
+   //-------------------------------------------------------------------
+   // The events are not read here; traversing the name space, looking
+   // up and fetching every metric took seconds on large systems, even
+   // for programs that never use a PCP event. Names are loaded by
+   // pcpLoadNames(), a metric at a time when looked up by name, or all
+   // of sNamespace when the events are enumerated. Here we only check
+   // that the root is known to the daemon, one round trip.
+   //-------------------------------------------------------------------
+
+   char **children = NULL;                                              // allocated by PCP.
    _time_gettimeofday(&t1, NULL);
-   ret = pcp_pmTraversePMNS(AGENT_NAME, cbPopulateNameOnly);            // Timed on Saturn [Intel Xeon 2.0GHz]; typical 9ms, range 8.5-10.5ms.
+   ret = pcp_pmGetChildren(sNamespace, &children);                      // Number of children, or error.
+   _time_gettimeofday(&t2, NULL);
+   _time_fprintf(stderr, "pmGetChildren '%s' took %li uS.\n", 
+      sNamespace, (mConvertUsec(t2)-mConvertUsec(t1)));
+   if (children != NULL) free(children);                                // Only the count matters.
    if (ret < 0) {                                                       // Failure...
-      int strErr=snprintf(reason, rLen, "pmTraversePMNS failed; ret=%i [%s]\n", 
+      int strErr=snprintf(reason, rLen, "pmGetChildren failed; ret=%i [%s]\n", 
          ret, pcp_pmErrStr(ret));
       if (ret == PM_ERR_NAME) {                                         // We know what this one is,
-         strErr=snprintf(reason, rLen, "pmTraversePMNS ret=PM_ERR_NAME: "
-            "Occurs if event filter '%s' unknown to PCP Daemon.\n", AGENT_NAME);
+         strErr=snprintf(reason, rLen, "pmGetChildren ret=PM_ERR_NAME: "
+            "Occurs if event filter '%s' unknown to PCP Daemon.\n", sNamespace);
       }
       reason[rLen-1]=0;
       if (strErr >rLen) HANDLE_STRING_ERROR;
@@ -924,309 +1283,22 @@ static int _pcp_init_component(int cidx)
       goto fn_fail;
    }      
       
-   _time_gettimeofday(&t2, NULL);
-   _time_fprintf(stderr, "pmTraversePMNS PopulateNameOnly took %li uS.\n", 
-      (mConvertUsec(t2)-mConvertUsec(t1)));
-   _time_fprintf(stderr, "Final sEventCount=%i, sEventInfoSize=%i, "
-               "sEventInfoBlock=%i.\n", 
-      sEventCount, sEventInfoSize, sEventInfoBlock);
-  
-   if (sEventCount < 1) {                                               // Failure...
-      int strErr=snprintf(reason, rLen, "pmTraversePMNS returned zero events "
-         "for AGENT=\"%s\".\n", AGENT_NAME);
+   if (ret < 1) {                                                       // Failure...
+      int strErr=snprintf(reason, rLen, "pmGetChildren returned zero events "
+         "for AGENT=\"%s\".\n", sNamespace);
       reason[rLen-1]=0;
       if (strErr >rLen) HANDLE_STRING_ERROR;
       retval = PAPI_ENOIMPL;
       goto fn_fail;
    }
 
-   int i,j,k;
-   char **allNames=calloc(sEventCount, sizeof(char*));                  // Make an array for all names. 
-   for (i=0; i<sEventCount; i++) {                                      // .. 
-      allNames[i] = pcp_event_info[i].name;                             // copy pointer into array. 
-   } // end for each event.
-
-   pmID *allPMID=calloc(sEventCount, sizeof(pmID));                     // Make an array for results.
-   if (allPMID == NULL) {                                               // If we failed,
-      snprintf(reason, rLen, "memory alloc denied for allPMID; "
-            "size=%i.\n", sEventCount);
-      int strErr=snprintf(reason, rLen, "Could not allocate %lu bytes of memory for allPMID.", sEventCount*sizeof(pmID));
-      free(allNames);
-      if (strErr > rLen) HANDLE_STRING_ERROR;
-      retval = PAPI_ENOMEM;
-      goto fn_fail;
-   } // end if calloc failed.
-
-   //----------------------------------------------------------------
-   // Unlike Saturn, on the Power9 we get an 'IPC protocol failure' 
-   // if we try to read more than 946 names at a time. This is some
-   // limitation on a communication packet size. On our test system
-   // Power9; the maximum number we can read is 946. To allow leeway
-   // for other possible values; we read in blocks of 256.
-   //----------------------------------------------------------------
-   #define LNBLOCK 256                                                  /* Power9 gets IPC errors if read block is too large. */
-   k = (__LINE__)-1;                                                    // where LNBLOCK is defined.   
+//  For PCP, we can read any number of events at once in a single event
+//  set, but the number of events is not known until they are loaded. 
+//  Set vector elements for PAPI; num_native_events grows as we load.
 
-   _time_gettimeofday(&t1, NULL);
-
-   i=0;                                                                 // Starting index for allPMID.
-   while (i<sEventCount) {                                              // read in blocks of LNBLOCK.
-      j = sEventCount-i;                                                // .. presume we can read the rest.
-      if (j > LNBLOCK) j=LNBLOCK;                                       // .. reduce if we cannot.
-      ret = pcp_pmLookupName(j, allNames+i, allPMID+i);                 // .. Get a block of PMIDs for a block of names.
-      if (ret < 0) {                                                    // .. Failure...
-         int strErr=snprintf(reason, rLen, "pmLookupName for %i names failed; ret=%i [%s].\n", 
-            sEventCount, ret, pcp_pmErrStr(ret));
-         reason[rLen-1]=0;
-         if (strErr > rLen) HANDLE_STRING_ERROR;
-
-         if (ret == PM_ERR_IPC) {                                       // .. If we know it, rewrite.
-            strErr=snprintf(reason, rLen, "pmLookupName ret=PM_ERR_IPC: one known cause is a readblock too large; reduce LNBLOCK (%s:%i).\n",
-                  __FILE__,k);
-            reason[rLen-1]=0;
-            if (strErr > rLen) HANDLE_STRING_ERROR;
-            retval = PAPI_EBUF;
-            goto fn_fail;
-         }
-
-         retval = PAPI_ESYS;
-         goto fn_fail;
-      }
-
-      i+=j;                                                             // .. Adjust the pointer forward by what we read.
-   } // end while to read names in chunks, and avoid IPC error. 
-   #undef LNBLOCK                                                       /* Discard constant; no further use. */  
-
-   _time_gettimeofday(&t2, NULL);
-   _time_fprintf(stderr, "pmLookupName for all took %li uS, ret=%i.\n", 
-      (mConvertUsec(t2)-mConvertUsec(t1)), ret );
-
-   for (i=0; i<sEventCount; i++) pcp_event_info[i].pmid = allPMID[i];   // copy all the pmid over to array.
-
-   pmResult *allFetch = NULL;                                           // result of pmFetch. 
-   _time_gettimeofday(&t1, NULL);
-   ret = pcp_pmFetch(sEventCount, allPMID, &allFetch);                  // Fetch (read) all the events.
-   _time_gettimeofday(&t2, NULL);
-   if (ret != 0) {
-      int strErr=snprintf(reason, rLen, "pcp_pmFetch failed, retcode=%d.", ret);
-      reason[rLen-1]=0;
-      if (strErr > rLen) HANDLE_STRING_ERROR;
-      retval = PAPI_ENOSUPP;
-      goto fn_fail;
-   }
-
-   _time_fprintf(stderr, "pmFetch for all took %li uS, for %i events; ret=%i.\n", 
-      (mConvertUsec(t2)-mConvertUsec(t1)), sEventCount, ret);
-
-   //-------------------------------------------------------------------
-   // In processing fetches, if we find a multi-valued event, we need
-   // to force an event for every value (PAPI only returns 1 value per
-   // event; not an array). In experiments thus far, all multi-valued
-   // events have had domain descriptor names; so we just concat with
-   // the name and make a new Event. We use a helper for that,
-   // afterward we set the number of values in the original 'base name'
-   // to zero; so it will be deleted by the cleanup routine.                                        
-   //-------------------------------------------------------------------
-
-   _time_gettimeofday(&t1, NULL);                                       // time this index explosion.
-   int origEventCount = sEventCount;                                    // sEventCount may change in below routine.
-
-   for (i=0; i<origEventCount; i++) {                                   // process all the fetch results.
-      pcp_event_info[i].desc.pmid = PM_ID_NULL;                         // This indicates the description is NOT loaded yet.
-      pmValueSet *vset = allFetch->vset[i];                             // get the result for event[i].
-
-      // On Saturn test system, never saw this happen.
-      if (vset == NULL) {                                               // .. should not happen. leave numVal=0 for deletion.
-         fprintf(stderr, "%s:%i vset=NULL for name='%s'\n", 
-            __FILE__, __LINE__, pcp_event_info[i].name);
-         continue;                                                      // .. next in loop.
-      }
-     
-      pcp_event_info[i].numVal = vset->numval;                          // Show we have a value.
-      if (vset->numval == 0) {                                          // If the value is zero, 
-//       _prog_fprintf(stderr, "%s:%i Discarding, no values for event  '%s'.\n", __FILE__, __LINE__, pcp_event_info[i].name);
-         continue;                                  // If no values, leave numVal = 0 for deletion. (We do see this in tests). 
-      }
-
-      pcp_event_info[i].valfmt = vset->valfmt;                          // Get the value format. (INSITU or not).
-      getPMDesc(i);                                                     // Get the value descriptor.
-      unsigned long long ullval= (long long) -1;   // debug stuff.
-      convert_64_t convert;
-
-      if (vset->valfmt != PM_VAL_INSITU) {                              // If not in situ, must get the type.
-         pmValue *pmval = &vset->vlist[0];                              // .. Get the first value.
-         pmValueBlock *pB = pmval->value.pval;                          // .. get it.
-         if (pcp_event_info[i].valType != pB->vtype) {
-            int strErr=snprintf(reason, rLen, "Unexpected value type fetched for %s. %i vs %i. Possible version incompatibiity.\n", 
-               pcp_event_info[i].name, pcp_event_info[i].valType, pB->vtype);
-            reason[rLen-1]=0;
-            if( strErr > rLen) HANDLE_STRING_ERROR;
-            retval = PAPI_ENOSUPP;
-            goto fn_fail;
-         }
-
-//       pcp_event_info[i].valType = pB->vtype;                         // .. get the type.
-         ullval = getULLValue(vset, 0);                                 // .. get the first value.
-
-         switch(pB->vtype) {                                            // PCP's variable type; an int flag.
-            case  PM_TYPE_32:                                           // 32-bit signed integer
-               _prog_fprintf(stderr, "type I32, desc.sem=%i, event '%s'=", pcp_event_info[i].desc.sem, pcp_event_info[i].name); 
-               break;
-            case  PM_TYPE_U32:                                          // 32-bit unsigned integer
-               _prog_fprintf(stderr, "type U32, desc.sem=%i, event '%s'=", pcp_event_info[i].desc.sem, pcp_event_info[i].name); 
-               break;
-            case  PM_TYPE_FLOAT:                                        // 32-bit floating point
-               _prog_fprintf(stderr, "type F32, desc.sem=%i, event '%s'=", pcp_event_info[i].desc.sem, pcp_event_info[i].name); 
-               break;                                                   // END CASE.
-
-            case  PM_TYPE_64:                                           // 64-bit signed integer
-               convert.ull = ullval;
-               _prog_fprintf(stderr, "type I64, desc.sem=%i, event '%s'= (ll) %lli =", pcp_event_info[i].desc.sem, pcp_event_info[i].name, convert.ll); 
-               break;
-            case  PM_TYPE_U64:                                          // 64-bit unsigned integer
-               _prog_fprintf(stderr, "type U64, desc.sem=%i, event '%s'= (ull) %llu =", pcp_event_info[i].desc.sem, pcp_event_info[i].name, convert.ull); 
-               break;
-            case  PM_TYPE_DOUBLE:                                       // 64-bit floating point
-               convert.ull = ullval;
-               _prog_fprintf(stderr, "type U64, desc.sem=%i, event '%s'= (double) %f =", pcp_event_info[i].desc.sem, pcp_event_info[i].name, convert.d); 
-               break;                                                   // END CASE.
-
-            // IF YOU want to return string values, this is a place
-            // to change; currently all string-valued events are
-            // rejected. But, pB->vbuf is the string value. I would
-            // copy it into a new pcp_event_info[] field; it would
-            // need to be malloc'd here and free'd at component
-            // shutdown. Also PAPI would need a new way to accept a
-            // char* or void*. 
-
-            case  PM_TYPE_STRING:                                       // pB->vbuf is char* to string value.
-               _prog_fprintf(stderr, "%s:%i Discarding PM_TYPE_STRING event, desc.sem=%i, event '%s'=", __FILE__, __LINE__, pcp_event_info[i].desc.sem, pcp_event_info[i].name); 
-               pcp_event_info[i].numVal = 0;                            // .. .. set numVal = 0 for deletion.
-               break;
-
-            default:                                                    // If we don't recognize the type,
-               _prog_fprintf(stderr, "%s:%i Dsicarding PM_UNKNOWN_TYPE event, desc.sem=%i, event '%s'=", __FILE__, __LINE__, pcp_event_info[i].desc.sem, pcp_event_info[i].name); 
-               pcp_event_info[i].numVal = 0;                            // .. set numVal = 0 for deletion.
-               break;
-         } // end switch.
-      } // If not In Situ.
-      else {
-         _prog_fprintf(stderr, "type IST, desc.sem=%i, event '%s'=", pcp_event_info[i].desc.sem, pcp_event_info[i].name); 
-      }
-
-      convert.ull = ullval; 
-      _prog_fprintf(stderr, "%02X%02X%02X%02X %02X%02X%02X%02X\n", convert.ch[0], convert.ch[1],  convert.ch[2], convert.ch[3],  convert.ch[4], convert.ch[5],  convert.ch[6], convert.ch[7]);
-      // Lookup description takes time; so we only do it for
-      // multi-valued events here. For other events, we will do it
-      // as needed for EventInfo filling.
-
-      if (pcp_event_info[i].numVal > 1) {                               // If a domain qualifier is possible;
-         getPMDesc(i);                                                  // .. Get the event descriptor.
-         _prog_fprintf(stderr, "Event %s has %i values, indom=%i.\n", pcp_event_info[i].name, pcp_event_info[i].numVal, pcp_event_info[i].desc.indom); 
-         if (pcp_event_info[i].desc.indom != PM_INDOM_NULL) {           // .. If we have a non-null domain,
-            for (j=0; j<vset->numval; j++) {                            // .. for every value present,
-               pmValue *pmval = &vset->vlist[j];                        // .. .. get that guy.
-
-               char *dname = cachedGetInDom(                            // .. .. read from cached domains (and populate it when needed).
-                                 pcp_event_info[i].desc.indom,
-                                 pmval->inst);                          // .. .. get the name. Not malloced so don't free dName.
-
-               makeQualifiedEvent(i, j, dname);                         // .. .. helper routine; may realloc pcp_event_info[], change sEventCount.
-            } // end value list.
-            
-            pcp_event_info[i].numVal = 0;                               // .. let the base event be discarded.
-         } // end if we have a domain.                                  
-      } // end if multiple valued.                                      
-   } // end for each event.
-
-   // Trim the fat! We get rid of everything with numVal == 0.
-   // We do that by compaction; moving valid entries to backfill
-   // invalid ones.
-
-   j=0;                                                                 // first destination.                                                  
-   for (i=0; i<sEventCount; i++) {                                      // loop thorugh all old and new.
-      if (pcp_event_info[i].numVal > 0) {                               // If we have a valid entry,
-         if (i != j) pcp_event_info[j] = pcp_event_info[i];             // move if it isn't already there.
-         j++;                                                           // count one moved; new count of valid ones.
-      }
-   } 
-            
-   sEventCount = j;                                                     // this is our new count.
-   pcp_event_info = realloc(pcp_event_info,                             // release any extra memory. 
-                        sEventCount*sizeof(_pcp_event_info_t));         // .. 
-   if (pcp_event_info == NULL) {
-      int strErr=snprintf(reason, rLen, 
-          "Could not reallocate %lu bytes of memory for pcp_event_info.", sEventCount*sizeof(_pcp_event_info_t));
-      reason[rLen-1]=0;    // force null termination.
-      if (strErr > rLen) HANDLE_STRING_ERROR;    
-      retval = PAPI_ENOMEM;
-      goto fn_fail;
-   } // end if realloc failed.
-
-   qsort(pcp_event_info, sEventCount,                                   // sort by PMID, idx, name.
-         sizeof(_pcp_event_info_t), qsPMID);                            // ..
-
-   _time_gettimeofday(&t2, NULL);                                       // done with index explosion.
-   _time_fprintf(stderr, "indexedExplosion for all took %li uS.\n", 
-               (mConvertUsec(t2)-mConvertUsec(t1)) );
-
-   for (i=0; i<HASH_SIZE; i++) {                                        // init hash table.
-      sNameHash[i].idx = -1;                                            // unused entry. 
-      sNameHash[i].next = NULL;                                         // ..
-   }                                                                  
-                                                                   
-   unsigned int myHash;                              
-   for (i=0; i<sEventCount; i++) {                                    
-      myHash = addNameHash(pcp_event_info[i].name, i);                  // Point this hash to this entry.   
-   }                                                                  
-
-   //-----------------------------------------------------------------------------------------------------------------------
-   // *************************************** DEBUG REPORT OF INFORMATION DISCOVERED ***************************************
-   //-----------------------------------------------------------------------------------------------------------------------
-   // We use -O2, but even in -O0, if(0){...} is completely removed from code. It costs us nothing to leave this code in.
-   if (0) {                                                             // change to 1 to enable debug report. 
-      unsigned int current, prev=0;                              
-      printf("count, hash, name, pmid, value[idx]\n");
-      for (i=0; i<sEventCount; i++) {
-         myHash = stringHash(pcp_event_info[i].name, HASH_SIZE);        // Get the hash value.
-         current = pcp_event_info[i].pmid;
-         if (prev > 0 && current != (prev+1) && current != prev)        // print separators.
-            printf("----,----,----,----\n");     
-         printf("%i, %u, \"%s\", 0x%08X, %i\n", i, myHash,              // quote name, may contain \,/,comma, etc.
-                pcp_event_info[i].name, 
-                pcp_event_info[i].pmid, 
-                pcp_event_info[i].idx);
-         prev=current;                                                  // for finding pmid skips.
-      } 
-
-      // Test hashing.
-      int hashErr = 0;
-      _time_gettimeofday(&t1, NULL);
-      for (i=0; i<sEventCount; i++) {
-         int f = findNameHash(pcp_event_info[i].name);                  // Try to find this name. 
-         if (f != i) hashErr++;
-      }
-
-      _time_gettimeofday(&t2, NULL);
-      
-      _time_fprintf(stderr, "HashLookup avg uS: %3.6f\n", ((double) (mConvertUsec(t2)-mConvertUsec(t1)) )/((double) sEventCount) );
-      _time_fprintf(stderr, "Hash Errors: %i of %i.\n", hashErr, sEventCount);
-
-   } // END DEBUG REPORT.
-   //-----------------------------------------------------------------------------------------------------------------------
-   // *************************************** END DEBUG REPORT INFORMATION DISCOVERED **************************************
-   //-----------------------------------------------------------------------------------------------------------------------
-
-   free(allNames);                                                      // Locals allocations not needed anymore.
-   free(allPMID);                                                       // .. the pmIDs we read.
-   pcp_pmFreeResult(allFetch);                                          // .. release the results we fetched.
-
-//  For PCP, we can read any number of events at once
-//  in a single event set. Set vector elements for PAPI.
-
-   _pcp_vector.cmp_info.num_native_events = sEventCount;                // Setup our pcp vector.
-   _pcp_vector.cmp_info.num_cntrs = sEventCount;                  
-   _pcp_vector.cmp_info.num_mpx_cntrs = sEventCount;
+   _pcp_vector.cmp_info.num_native_events = 0;                          // Setup our pcp vector.
+   _pcp_vector.cmp_info.num_cntrs = PCP_MAX_COUNTERS;                  
+   _pcp_vector.cmp_info.num_mpx_cntrs = PCP_MAX_COUNTERS;
    _pcp_vector.cmp_info.CmpIdx = cidx;                                  // export the component ID.
 
   fn_exit:
@@ -1309,7 +1381,7 @@ static int _pcp_update_control_state(
         hwd_context_t *ctx)                                             // context, we don't use it.
 {
    mRtnCnt(_pcp_update_control_state);                                  // count this function.
-   int i, index = 0;
+   int i, j, index = 0;
    ( void ) ctx;
 
    _pcp_control_state_t* MyCtl = ( _pcp_control_state_t* ) ctl;         // Recast ctl.
@@ -1319,11 +1391,16 @@ static int _pcp_update_control_state(
       if (MyCtl->pcpIndex != NULL) {                                    // If we have space allocated,
          free(MyCtl->pcpIndex);                                         // .. discard it,
          free(MyCtl->pcpValue);                                         // .. and values.
+         free(MyCtl->pmidList);                                         // .. and what we fetch.
+         free(MyCtl->vsetIndex);                                        // .. 
          MyCtl->pcpIndex = NULL;                                        // .. never free it again.
          MyCtl->pcpValue = NULL;                                        // .. never free it again.
+         MyCtl->pmidList = NULL;                                        // .. 
+         MyCtl->vsetIndex = NULL;                                       // .. 
       }
 
       MyCtl->maxAllocated = 0;                                          // .. no longer tracking max.
+      MyCtl->numPMID = 0;                                               // .. nothing to fetch.
       return PAPI_OK;                                                   // .. get out.
    }
 
@@ -1338,6 +1415,10 @@ static int _pcp_update_control_state(
                                    newalloc*sizeof(int));               // .. .. ..
          MyCtl->pcpValue = realloc(MyCtl->pcpValue,                     // .. .. reallocate to make more room.
                                    newalloc*sizeof(unsigned long long));// .. .. ..
+         MyCtl->pmidList = realloc(MyCtl->pmidList,                     // .. .. at most one PMID per event.
+                                   newalloc*sizeof(pmID));              // .. .. ..
+         MyCtl->vsetIndex = realloc(MyCtl->vsetIndex,                   // .. .. one vset per event.
+                                   newalloc*sizeof(int));               // .. .. ..
          MyCtl->maxAllocated = newalloc;                                // .. .. remember what we've got.
       }
    } else {                                                             // If NULL then I have no previous set,
@@ -1346,9 +1427,14 @@ static int _pcp_update_control_state(
          calloc(MyCtl->maxAllocated, sizeof(int));                      // .. 
       MyCtl->pcpValue =                                                 // .. make room for 'count' values.
          calloc(MyCtl->maxAllocated, sizeof(unsigned long long));       // .. 
+      MyCtl->pmidList =                                                 // .. and for their PMIDs,
+         calloc(MyCtl->maxAllocated, sizeof(pmID));                     // .. 
+      MyCtl->vsetIndex =                                                // .. and where they are in a fetch.
+         calloc(MyCtl->maxAllocated, sizeof(int));                      // .. 
    }
 
-   if (MyCtl->pcpIndex == NULL) {                                       // If malloc failed,
+   if (MyCtl->pcpIndex == NULL || MyCtl->pcpValue == NULL ||            // If malloc failed,
+       MyCtl->pmidList == NULL || MyCtl->vsetIndex == NULL) {           // ..
       return PAPI_ENOMEM;                                               // .. out of memory.
    } // end if malloc failed.
 
@@ -1357,8 +1443,17 @@ static int _pcp_update_control_state(
    // pcpIndex[i] holds the event pcp_event_info[] index for 
    // EventSet[i], and we populate the caller's ni_position for 
    // EventSet[i] with the index into pcpIndex[].
+   //
+   // We also build the list of all *unique* PMIDs, here rather than on
+   // every read. Because PMID can return an array of N values for a
+   // single event (e.g. one per CPU), we 'explode' such events into N
+   // events for PAPI, which can only return 1 value per event. Thus
+   // PAPI could add several to an EventSet that all have the same PMID
+   // (PCP's ID). We only need to fetch those once; vsetIndex[i] is the
+   // value set of EventSet[i] in the result of fetching pmidList[].
    //------------------------------------------------------------------
 
+   MyCtl->numPMID = 0;                                                  // No PMIDs yet.
    for (i=0; i<count; i++) {                                            // for each event passed in,
       index = native[i].ni_event & PAPI_NATIVE_AND_MASK;                // get index.
       if (index < 0 || index >= sEventCount) {                          // if something is wrong, 
@@ -1369,6 +1464,17 @@ static int _pcp_update_control_state(
       MyCtl->pcpValue[i]=0;                                             // clear the value.   
       native[i].ni_position = i;                                        // Tell PAPI about its location (doesn't matter to us), we have no restrictions on position.
       getPMDesc(index);                                                 // Any time an event is added, ensure we have its variable descriptor.
+
+      pmID myPMID = pcp_event_info[index].pmid;                         // get the PMID for that event,
+      for (j=0; j<MyCtl->numPMID; j++) {                                // .. Search the unique PMID list for a match. 
+         if (myPMID == MyCtl->pmidList[j]) break;                       // .. .. found it. break out.
+      } 
+
+      if (j == MyCtl->numPMID) {                                        // full loop ==> myPMID was not found in list,
+         MyCtl->pmidList[MyCtl->numPMID++] = myPMID;                    // .. store the unique pmid in list, inc count.
+      }
+
+      MyCtl->vsetIndex[i] = j;                                          // The value set it is read from.
    } // end for each event listed.
 
    return PAPI_OK;
@@ -1377,7 +1483,9 @@ static int _pcp_update_control_state(
 
 //---------------------------------------------------------------------
 // Helper routine, for reset and read, does the work of reading all
-// current raw values in an EventSet (hwd_control_state). 
+// current raw values in an EventSet (hwd_control_state). Only the
+// unique PMIDs of the EventSet, listed by update_control_state, are
+// fetched, and each event is decoded from the value set found then.
 //
 // 1) Does not subtract zeroValue; returns raw read in ULL format.
 // 2) Does not change pcp_event_info[] in any way.
@@ -1392,73 +1500,34 @@ static int _pcp_update_control_state(
 static int PCP_ReadList(hwd_control_state_t *ctl,                       // the event set.
     pmResult **results)                                                 // results from pmFetch, caller must pmFreeResult(results).
 {
-   int i, j, ret;
+   int i, k, v, ret;
     _pcp_control_state_t* myCtl = ( _pcp_control_state_t* ) ctl;
    *results = NULL;                                                     // Nothing allocated.
    if (myCtl->numEvents < 1) return PAPI_ENOEVNT;                       // No events to start.
-   int nPMID = 0;                                                       // To count number of **unique** PMIDs.
-
-   pmID *allPMID=malloc((myCtl->numEvents)*sizeof(pmID));               // Make maximum possible room.
-
-   // We build a list of all *unique* PMIDs. Because PMID can return
-   // an array of N values for a single event (e.g. one per CPU), we
-   // 'explode' such events into N events for PAPI, which can only
-   // return 1 value per event. Thus PAPI could add several to an
-   // EventSet that all have the same PMID (PCP's ID). We only need
-   // to read those once, our pcp_event_info[] contains the index
-   // for each exploded event into the array returned for that PMID.
 
-   allPMID[nPMID++] = pcp_event_info[myCtl->pcpIndex[0]].pmid;          // Move the first, increment total so far. 
-
-   for (i=1; i<myCtl->numEvents; i++) {                                 // For every event in the event set,
-      int myIdx = myCtl->pcpIndex[i];                                   // .. Get pcp_event_info[] index of the event,
-      pmID myPMID = pcp_event_info[myIdx].pmid;                         // .. get the PMID for that event,
-      for (j=0; j<nPMID; j++) {                                         // .. Search the unique PMID list for a match. 
-         if (myPMID == allPMID[j]) break;                               // .. .. found it. break out.
-      } 
-
-      if (j == nPMID) {                                                 // full loop ==> myPMID was not found in list,
-         allPMID[nPMID++] = myPMID;                                     // .. store the unique pmid in list, inc count.
-      }
-   }                                                                    // done building list of unique pmid.
-   
-   // nPMID is # of unique PMID, now ready to read all the pmid needed.
    pmResult *allFetch = NULL;                                           // result of pmFetch. 
-   ret = pcp_pmFetch(nPMID, allPMID, &allFetch);                        // Fetch them all.
+   ret = pcp_pmFetch(myCtl->numPMID, myCtl->pmidList, &allFetch);       // Fetch them all.
    *results = allFetch;                                                 // For either success or failure.
    
-   if( ret != PAPI_OK) {                                                // If fetch failed .. 
+   if (ret < 0) {                                                       // If fetch failed .. 
       fprintf(stderr, "%s:%i:%s pcp_pmFetch failed, return=%s.\n", 
-         __FILE__, __LINE__, FUNC, PAPI_strerror(ret));                 // .. report error.
-         if (allPMID != NULL)  free(allPMID);                           // .. no memory leak.
-         allPMID = NULL;                                                // .. prevent future use.
-      return(ret);                                                      // .. exit with that error.
+         __FILE__, __LINE__, FUNC, pcp_pmErrStr(ret));                  // .. report error.
+      return(PAPI_ESYS);                                                // .. exit with that error.
    }
 
-   // For each unique PMID we just read, we must map it to the event
-   // sets, which may contain multiple entries with that same PMID.
-   // This is because PCP returns arrays, and PAPI does not, so each
-   // of our names translates to a PMID + an index.
-
-   for (i=0; i<nPMID; i++) {                                            // process all the fetch results.
-      pmValueSet *vset = allFetch->vset[i];                             // get the result for event[i].
-      pmID myPMID = allPMID[i];                                         // get the pmid from this read.
-       
-      // Now we must search for any events with this pmid, and get
-      // the corresponding value (may be more than one, since we
-      // treat each idx as its own value).         
-
-      for (j=0; j<myCtl->numEvents; j++) {                              // for each event,
-         int myPCPIdx = myCtl->pcpIndex[j];                             // .. get my pcp_event_info[] index.
-         pmID thisPMID = pcp_event_info[myPCPIdx].pmid;                 // .. collect its pmid.
-         if (thisPMID == myPMID) {                                      // .. If this result services that event, 
-            int myArrayIdx = pcp_event_info[myPCPIdx].idx;              // .. .. get array index within result array, for result value list.
-            myCtl->pcpValue[j] = getULLValue(vset, myArrayIdx);         // .. .. translate as needed, put back into pcpValue array.
-         } // end if counter was found for this PMID.
-      } // end loop through all events in this event set.
-   } // end for each pmID read.
-
-   if (allPMID != NULL)  free(allPMID);                                 // Done with this work area; no memory leak.
+   // Each event has its own index into the value set of its PMID, as
+   // PCP returns arrays, and PAPI does not, so each of our names
+   // translates to a PMID + an index.
+
+   for (i=0; i<myCtl->numEvents; i++) {                                 // for each event,
+      pmValueSet *vset = allFetch->vset[myCtl->vsetIndex[i]];           // .. get the result for its PMID.
+      k = myCtl->pcpIndex[i];                                           // .. get my pcp_event_info[] index.
+      v = getValueIndex(vset, k);                                       // .. get array index within result array.
+      if (v >= 0) {                                                     // .. If it has a value this time,
+         myCtl->pcpValue[i] = getULLValue(vset, v);                     // .. .. translate as needed, put back into pcpValue array.
+      } 
+   } // end loop through all events in this event set.
+
    return PAPI_OK;                                                      // All done.
 } // end routine.
 
@@ -1602,6 +1671,11 @@ static int _pcp_shutdown_component(void)
    freeNameHash();                                                      // free sNameHash. resets itself.
    cachedGetInDom(PM_INDOM_NULL, -1);                                   // -1 for inst == free its local static mallocs.
    sEventCount = 0;                                                     // clear number of events. 
+   sEventInfoSize = 0;                                                  // .. and the room for them.
+   for (i=0; i<sLoadedCount; i++) free(sLoadedPrefix[i]);               // forget what we traversed.
+   free(sLoadedPrefix); sLoadedPrefix=NULL;                             // ..
+   sLoadedCount = 0;                                                    // ..
+   sNamespaceLoaded = 0;                                                // ..
 
    for (i=0; i<=ctr_pcp_ntv_code_to_info; i++) 
       _prog_fprintf(stderr, "routine counter %i = %i.\n", i, cnt[i]);
@@ -1702,6 +1776,14 @@ static int _pcp_ntv_enum_events(unsigned int *EventCode, int modifier)
 
    switch (modifier) {                                                  // modifier is type of enum operation desired.
        case PAPI_ENUM_FIRST:                                            // Returns event code of first event created.
+           if (!sNamespaceLoaded) {                                     // Listing needs all of them.
+               _papi_hwi_lock(COMPONENT_LOCK);
+               idx = pcpLoadNames(sNamespace);                          // .. load all the rest.
+               _papi_hwi_unlock(COMPONENT_LOCK);
+               if (idx != PAPI_OK) return(idx);                         // .. could not.
+           }
+
+           if (sEventCount < 1) return PAPI_ENOEVNT;                    // Nothing to list.
            EventCode[0] = 0;                                            // Return 0 as event code after a start.
            return PAPI_OK;                                              // EXIT.
            break;                                                       // END CASE.
@@ -1746,6 +1828,21 @@ static int _pcp_ntv_name_to_code(const char *name, unsigned int *event_code)
    }
 
    int idx = findNameHash((char*) name);                                // Use our hash to find it.
+   if (idx < 0 && pcpInNamespace(name)) {                               // If not loaded yet, it may be a new one.
+      char metric[PAPI_MAX_STR_LEN];                                    // The metric, without any instance.
+      strncpy(metric, name, PAPI_MAX_STR_LEN-1);                        // ..
+      metric[PAPI_MAX_STR_LEN-1] = 0;                                   // ..
+      char *colon = strchr(metric, ':');                                // Instance qualifiers follow a colon,
+      if (colon != NULL) *colon = 0;                                    // .. drop it.
+
+      if (!pcpNameLoaded(metric)) {                                     // Load just that metric.
+         _papi_hwi_lock(COMPONENT_LOCK);
+         pcpLoadNames(metric);                                          // .. failure means no such event.
+         _papi_hwi_unlock(COMPONENT_LOCK);
+         idx = findNameHash((char*) name);                              // .. and try again.
+      }
+   }
+
    if (idx < 0) {                                                       // If we failed, 
       fprintf(stderr, "%s:%i:%s Failed to find name='%s', hash=%i.\n",  // .. report it.
          __FILE__, __LINE__, FUNC, name, 
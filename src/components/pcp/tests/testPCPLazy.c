@@ -0,0 +1,172 @@
+//-----------------------------------------------------------------------------
+// This test program checks that the pcp component loads its names lazily.
+// It runs against the PCP daemon, or against an archive given in
+// PAPI_PCP_ARCHIVE (with PAPI_PCP_NAMESPACE set to a subtree the archive
+// holds) on machines without one.
+//
+// 1) In a child process, enumerate to pick the last event.
+// 2) Init; no events may be known after init.
+// 3) Look the event up by name; only its metric should get loaded.
+// 4) Read it, then enumerate all; its event code must not change.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <papi.h>
+#include "papi_test.h" 
+
+//-----------------------------------------------------------------------------
+// Returns the index of the pcp component, or skips the test.
+//-----------------------------------------------------------------------------
+static int findPCP(void) 
+{
+   int cid = PAPI_get_component_index("pcp");                           // Find our component.
+   if (cid < 0) {
+      test_skip(__FILE__, __LINE__, "pcp component not configured", 0);
+   }
+
+   const PAPI_component_info_t *cmpInfo = PAPI_get_component_info(cid);
+   if (cmpInfo == NULL || cmpInfo->disabled) {                          // No daemon, no archive.
+      test_skip(__FILE__, __LINE__, "pcp component disabled", 0);
+   }
+
+   return(cid);
+} // end routine.
+
+//-----------------------------------------------------------------------------
+// Child process: enumerates all events, and writes the number of events and
+// the name of the last one to fd. Exits with 0, or 1 if there are none.
+//-----------------------------------------------------------------------------
+static void lastEvent(int fd) 
+{
+   int cid, code, lastCode, total;
+   char name[PAPI_MAX_STR_LEN];
+   FILE *out = fdopen(fd, "w");
+
+   if (out == NULL || PAPI_library_init(PAPI_VER_CURRENT) != PAPI_VER_CURRENT) exit(1);
+   cid = PAPI_get_component_index("pcp");
+   code = PAPI_NATIVE_MASK;
+   if (cid < 0 || PAPI_enum_cmp_event(&code, PAPI_ENUM_FIRST, cid) != PAPI_OK) exit(1);
+
+   do {                                                                 // walk to the last one.
+      lastCode = code;
+   } while (PAPI_enum_cmp_event(&code, PAPI_ENUM_EVENTS, cid) == PAPI_OK);
+
+   if (PAPI_event_code_to_name(lastCode, name) != PAPI_OK) exit(1);
+   total = PAPI_get_component_info(cid)->num_native_events;             // all of them.
+   fprintf(out, "%i %s\n", total, name);
+   fclose(out);
+   exit(0);
+} // end routine.
+
+//-----------------------------------------------------------------------------
+// MAIN.
+//-----------------------------------------------------------------------------
+
+int main(int argc, char **argv) {                                       // args to allow quiet flags. 
+   int cid, ret, code, total, lazyCode;
+   int EventSet = PAPI_NULL;
+   long long t1, t2, values[1];
+   char name[PAPI_MAX_STR_LEN];
+   const PAPI_component_info_t *cmpInfo;
+   int quiet = tests_quiet(argc, argv);                                 // From papi_test.h.
+
+   // 1) Enumerating loads the whole name space; do it in a child, so
+   //    this process starts with nothing loaded.
+   int fds[2], status;
+   FILE *in;
+   pid_t pid;
+
+   if (pipe(fds) != 0) test_fail(__FILE__, __LINE__, "pipe failed\n", 0);
+   pid = fork();
+   if (pid < 0) test_fail(__FILE__, __LINE__, "fork failed\n", 0);
+   if (pid == 0) {                                                      // Child.
+      close(fds[0]);
+      lastEvent(fds[1]);
+   }
+
+   close(fds[1]);
+   in = fdopen(fds[0], "r");
+   ret = (in != NULL && fscanf(in, "%i %127s", &total, name) == 2);
+   if (in != NULL) fclose(in);
+   waitpid(pid, &status, 0);
+   if (!ret) {                                                          // No component, daemon or events.
+      test_skip(__FILE__, __LINE__, "No pcp events", 0);
+   }
+
+   if (!quiet) printf("%i events, using '%s'.\n", total, name);
+
+   // 2) Init; nothing is traversed.
+   t1 = PAPI_get_real_usec();
+   ret = PAPI_library_init(PAPI_VER_CURRENT);
+   t2 = PAPI_get_real_usec();
+   if (ret != PAPI_VER_CURRENT) {
+      test_fail(__FILE__, __LINE__, "PAPI_library_init failed\n", ret);
+   }
+
+   cid = findPCP();
+   cmpInfo = PAPI_get_component_info(cid);
+   if (!quiet) printf("PAPI_library_init took %lli uS, %i events known.\n", 
+                      t2-t1, cmpInfo->num_native_events);
+   if (cmpInfo->num_native_events != 0) {
+      test_fail(__FILE__, __LINE__, "Events were loaded at init\n", 0);
+   }
+
+   // 3) A lookup by name loads the metric of that name.
+   t1 = PAPI_get_real_usec();
+   ret = PAPI_event_name_to_code(name, &lazyCode);
+   t2 = PAPI_get_real_usec();
+   if (ret != PAPI_OK) {
+      test_fail(__FILE__, __LINE__, "PAPI_event_name_to_code failed\n", ret);
+   }
+
+   if (!quiet) printf("Lookup took %lli uS, %i events known.\n", 
+                      t2-t1, cmpInfo->num_native_events);
+   if (cmpInfo->num_native_events < 1 || 
+      (total > 1 && cmpInfo->num_native_events >= total)) {
+      test_fail(__FILE__, __LINE__, "Lookup did not load just its metric\n", 0);
+   }
+
+   // 4) It reads, and enumerating the rest leaves its code alone.
+   ret = PAPI_create_eventset(&EventSet);
+   if (ret != PAPI_OK) {
+      test_fail(__FILE__, __LINE__, "PAPI_create_eventset failed\n", ret);
+   }
+
+   ret = PAPI_add_event(EventSet, lazyCode);
+   if (ret != PAPI_OK) {
+      test_fail(__FILE__, __LINE__, "PAPI_add_event failed\n", ret);
+   }
+
+   ret = PAPI_start(EventSet);
+   if (ret != PAPI_OK) {
+      test_fail(__FILE__, __LINE__, "PAPI_start failed\n", ret);
+   }
+
+   ret = PAPI_stop(EventSet, values);
+   if (ret != PAPI_OK) {
+      test_fail(__FILE__, __LINE__, "PAPI_stop failed\n", ret);
+   }
+
+   if (!quiet) printf("%s = %lli\n", name, values[0]);
+
+   code = PAPI_NATIVE_MASK;
+   ret = PAPI_enum_cmp_event(&code, PAPI_ENUM_FIRST, cid);
+   if (ret != PAPI_OK || cmpInfo->num_native_events != total) {
+      test_fail(__FILE__, __LINE__, "Enumeration did not load all events\n", ret);
+   }
+
+   ret = PAPI_event_name_to_code(name, &code);
+   if (ret != PAPI_OK || code != lazyCode) {
+      test_fail(__FILE__, __LINE__, "Event code changed by enumeration\n", ret);
+   }
+
+   PAPI_cleanup_eventset(EventSet);
+   PAPI_destroy_eventset(&EventSet);
+
+   test_pass(__FILE__);
+   return 0;
+} // end main.
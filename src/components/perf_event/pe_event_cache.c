@@ -0,0 +1,643 @@
+/*
+* File:    pe_event_cache.c
+*
+* Persistent index of the libpfm4 event space for the perf_event
+* components.
+*
+* Walking libpfm4's PMU/event tables is repeated from scratch by every
+* process that lists or looks up native events. If PAPI_EVENT_CACHE
+* names a directory, the events of the PMUs a component uses are
+* written there once, keyed by a kernel/libpfm4/CPU fingerprint, and
+* later processes mmap the file and read names, libpfm4 codes and the
+* perf_event encoding of each bare event name straight out of it.
+*
+* The file is rebuilt whenever the fingerprint does not match, it is
+* replaced atomically so concurrent readers never see a partial file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#include "papi.h"
+#include "papi_internal.h"
+#include "papi_vector.h"
+
+#include "papi_libpfm4_events.h"
+#include "pe_event_cache.h"
+
+#include "perfmon/pfmlib.h"
+#include "perfmon/pfmlib_perf_event.h"
+
+struct pe_event_cache {
+	void *map;
+	size_t size;
+	const struct pe_cache_header *hdr;
+	const struct pe_cache_entry *entries;
+	const uint32_t *by_code;
+	const char *strings;
+};
+
+/* Event being collected while the cache is built */
+struct pe_cache_build_event {
+	char *name;
+	int order;		/* position in enumeration order */
+	struct pe_cache_entry entry;
+};
+
+/* PMUs whose event names are patterns rather than a fixed list, */
+/* the cache cannot say an event does not exist on them          */
+static const char *pattern_pmus[] = { "perf_raw", NULL };
+
+static unsigned int
+fnv1a_hash( const char *str )
+{
+	unsigned int hash = 2166136261U;
+
+	while ( *str ) {
+		hash ^= ( unsigned char ) *str++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static void
+make_fingerprint( char *fp, size_t len, int pmu_type,
+		  const int *pmus, int num_pmus )
+{
+	struct utsname uts;
+	pfm_pmu_info_t pinfo;
+	size_t used;
+	int i;
+
+	memset( &uts, 0, sizeof ( uts ) );
+	uname( &uts );
+
+	used = snprintf( fp, len, "kernel=%s libpfm4=%#x cpu=%d/%d/%d/%d type=%d pmus=",
+			 uts.release, pfm_get_version(  ),
+			 _papi_hwi_system_info.hw_info.vendor,
+			 _papi_hwi_system_info.hw_info.cpuid_family,
+			 _papi_hwi_system_info.hw_info.cpuid_model,
+			 _papi_hwi_system_info.hw_info.cpuid_stepping,
+			 pmu_type );
+
+	for ( i = 0; i < num_pmus && used < len; i++ ) {
+		memset( &pinfo, 0, sizeof ( pfm_pmu_info_t ) );
+		pinfo.size = sizeof ( pfm_pmu_info_t );
+		if ( pfm_get_pmu_info( pmus[i], &pinfo ) != PFM_SUCCESS ) continue;
+		used += snprintf( fp + used, len - used, "%s/%d,",
+				  pinfo.name, pinfo.nevents );
+	}
+}
+
+/* Encode a bare event name the way allocate_native_event() does */
+static void
+encode_event( const char *name, struct pe_cache_entry *entry )
+{
+	pfm_perf_encode_arg_t perf_arg;
+	char *fstr = NULL;
+	int ret;
+
+	memset( &perf_arg, 0, sizeof ( pfm_perf_encode_arg_t ) );
+	memset( &entry->attr, 0, sizeof ( struct perf_event_attr ) );
+	entry->attr.size = sizeof ( struct perf_event_attr );
+	perf_arg.attr = &entry->attr;
+	perf_arg.fstr = &fstr;
+
+	ret = pfm_get_os_event_encoding( name, PFM_PLM0 | PFM_PLM3,
+					 PFM_OS_PERF_EVENT_EXT, &perf_arg );
+	entry->encoded = ( ret == PFM_SUCCESS ) && ( fstr != NULL );
+	entry->cpu = entry->encoded ? perf_arg.cpu : -1;
+	free( fstr );
+}
+
+static int
+cmp_build_name( const void *a, const void *b )
+{
+	return strcasecmp( ( ( const struct pe_cache_build_event * ) a )->name,
+			   ( ( const struct pe_cache_build_event * ) b )->name );
+}
+
+/* Walk every event of the given PMUs and write the index file */
+static int
+build_cache( const char *path, const char *fingerprint, int pmu_type,
+	     const int *pmus, int num_pmus )
+{
+	struct pe_cache_build_event *events = NULL, *tmp_events;
+	struct pe_cache_header hdr;
+	struct pe_cache_entry entry;
+	pfm_pmu_info_t pinfo;
+	pfm_event_info_t einfo;
+	char tmp_path[PATH_MAX];
+	char name[BUFSIZ];
+	uint32_t *by_code = NULL;
+	uint32_t str_off;
+	int num_events = 0, allocated = 0;
+	int i, code, fd, write_failed, retval = PAPI_ESYS;
+	FILE *fff;
+
+	for ( i = 0; i < num_pmus; i++ ) {
+		memset( &pinfo, 0, sizeof ( pfm_pmu_info_t ) );
+		pinfo.size = sizeof ( pfm_pmu_info_t );
+		if ( pfm_get_pmu_info( pmus[i], &pinfo ) != PFM_SUCCESS ) continue;
+
+		for ( code = pinfo.first_event; code >= 0;
+		      code = pfm_get_event_next( code ) ) {
+
+			memset( &einfo, 0, sizeof ( pfm_event_info_t ) );
+			einfo.size = sizeof ( pfm_event_info_t );
+			if ( pfm_get_event_info( code, PFM_OS_PERF_EVENT_EXT,
+						 &einfo ) != PFM_SUCCESS ) {
+				continue;
+			}
+
+			if ( num_events == allocated ) {
+				allocated += 1024;
+				tmp_events = realloc( events, allocated *
+					    sizeof ( struct pe_cache_build_event ) );
+				if ( tmp_events == NULL ) {
+					retval = PAPI_ENOMEM;
+					goto out;
+				}
+				events = tmp_events;
+			}
+
+			snprintf( name, sizeof ( name ), "%s::%s",
+				  pinfo.name, einfo.name );
+			events[num_events].name = strdup( name );
+			if ( events[num_events].name == NULL ) {
+				retval = PAPI_ENOMEM;
+				goto out;
+			}
+			events[num_events].order = num_events;
+			memset( &events[num_events].entry, 0,
+				sizeof ( struct pe_cache_entry ) );
+			events[num_events].entry.libpfm4_idx = code;
+			events[num_events].entry.found_idx =
+				pfm_find_event( name );
+			encode_event( name, &events[num_events].entry );
+			num_events++;
+		}
+	}
+
+	by_code = malloc( ( num_events + 1 ) * sizeof ( uint32_t ) );
+	if ( by_code == NULL ) {
+		retval = PAPI_ENOMEM;
+		goto out;
+	}
+
+	qsort( events, num_events, sizeof ( struct pe_cache_build_event ),
+	       cmp_build_name );
+
+	/* PMUs and their events were walked in ascending libpfm4 code */
+	/* order, which is also the order we enumerate them in         */
+	for ( i = 0; i < num_events; i++ ) {
+		by_code[events[i].order] = i;
+	}
+
+	memset( &hdr, 0, sizeof ( hdr ) );
+	hdr.magic = PE_CACHE_MAGIC;
+	hdr.version = PE_CACHE_VERSION;
+	hdr.num_events = num_events;
+	hdr.pmu_type = pmu_type;
+	hdr.attr_size = sizeof ( struct perf_event_attr );
+	hdr.entries_offset = sizeof ( hdr );
+	hdr.by_code_offset = hdr.entries_offset +
+			     num_events * sizeof ( struct pe_cache_entry );
+	hdr.strings_offset = hdr.by_code_offset + num_events * sizeof ( uint32_t );
+	strncpy( hdr.fingerprint, fingerprint, sizeof ( hdr.fingerprint ) - 1 );
+
+	str_off = 0;
+	for ( i = 0; i < num_events; i++ ) {
+		str_off += strlen( events[i].name ) + 1;
+	}
+	hdr.file_size = hdr.strings_offset + str_off;
+
+	snprintf( tmp_path, sizeof ( tmp_path ), "%s.%d.tmp", path, getpid(  ) );
+	fd = open( tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if ( fd < 0 ) {
+		SUBDBG( "Cannot create event cache %s\n", tmp_path );
+		goto out;
+	}
+	fff = fdopen( fd, "w" );
+	if ( fff == NULL ) {
+		close( fd );
+		unlink( tmp_path );
+		goto out;
+	}
+
+	fwrite( &hdr, sizeof ( hdr ), 1, fff );
+
+	str_off = 0;
+	for ( i = 0; i < num_events; i++ ) {
+		entry = events[i].entry;
+		entry.name_offset = str_off;
+		str_off += strlen( events[i].name ) + 1;
+		fwrite( &entry, sizeof ( entry ), 1, fff );
+	}
+
+	fwrite( by_code, sizeof ( uint32_t ), num_events, fff );
+
+	for ( i = 0; i < num_events; i++ ) {
+		fwrite( events[i].name, strlen( events[i].name ) + 1, 1, fff );
+	}
+
+	write_failed = ferror( fff );
+	if ( fclose( fff ) != 0 ) write_failed = 1;
+	if ( write_failed ) {
+		unlink( tmp_path );
+		goto out;
+	}
+
+	if ( rename( tmp_path, path ) < 0 ) {
+		unlink( tmp_path );
+		goto out;
+	}
+
+	SUBDBG( "Wrote %d events to event cache %s\n", num_events, path );
+	retval = PAPI_OK;
+
+  out:
+	for ( i = 0; i < num_events; i++ ) {
+		free( events[i].name );
+	}
+	free( events );
+	free( by_code );
+
+	return retval;
+}
+
+/* Whether count items of size bytes at offset, aligned to align, */
+/* lie within the file                                            */
+static int
+in_file( const struct pe_cache_header *hdr, uint32_t offset, uint32_t count,
+	 size_t size, size_t align )
+{
+	return ( offset % align == 0 ) &&
+		( ( uint64_t ) offset + ( uint64_t ) count * size <=
+		  hdr->file_size );
+}
+
+/* Whether every table and string of a mapped cache is within the */
+/* file, so that a truncated or corrupt one is never read past    */
+static int
+valid_cache( const struct pe_cache_header *hdr )
+{
+	const struct pe_cache_entry *entries;
+	const uint32_t *by_code;
+	const char *strings;
+	uint32_t i, strings_size;
+
+	if ( hdr->entries_offset < sizeof ( struct pe_cache_header ) ||
+	     hdr->by_code_offset < sizeof ( struct pe_cache_header ) ||
+	     hdr->strings_offset < sizeof ( struct pe_cache_header ) ||
+	     !in_file( hdr, hdr->entries_offset, hdr->num_events,
+		       sizeof ( struct pe_cache_entry ), sizeof ( uint64_t ) ) ||
+	     !in_file( hdr, hdr->by_code_offset, hdr->num_events,
+		       sizeof ( uint32_t ), sizeof ( uint32_t ) ) ||
+	     !in_file( hdr, hdr->strings_offset, 0, 1, 1 ) ) {
+		return 0;
+	}
+
+	entries = ( const struct pe_cache_entry * )
+		( ( const char * ) hdr + hdr->entries_offset );
+	by_code = ( const uint32_t * )
+		( ( const char * ) hdr + hdr->by_code_offset );
+	strings = ( const char * ) hdr + hdr->strings_offset;
+	strings_size = hdr->file_size - hdr->strings_offset;
+
+	/* a name that starts in the string table ends in it too */
+	if ( hdr->num_events > 0 &&
+	     ( strings_size == 0 || strings[strings_size - 1] != '\0' ) ) {
+		return 0;
+	}
+
+	for ( i = 0; i < hdr->num_events; i++ ) {
+		if ( entries[i].name_offset >= strings_size ||
+		     by_code[i] >= hdr->num_events ) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Map a cache file, returns NULL if missing, corrupt or stale */
+static struct pe_event_cache *
+map_cache( const char *path, const char *fingerprint )
+{
+	struct pe_event_cache *cache;
+	const struct pe_cache_header *hdr;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open( path, O_RDONLY );
+	if ( fd < 0 ) return NULL;
+
+	if ( fstat( fd, &st ) < 0 ||
+	     st.st_size < ( off_t ) sizeof ( struct pe_cache_header ) ) {
+		close( fd );
+		return NULL;
+	}
+
+	map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( map == MAP_FAILED ) return NULL;
+
+	hdr = ( const struct pe_cache_header * ) map;
+	if ( hdr->magic != PE_CACHE_MAGIC ||
+	     hdr->version != PE_CACHE_VERSION ||
+	     hdr->attr_size != sizeof ( struct perf_event_attr ) ||
+	     ( off_t ) hdr->file_size != st.st_size ||
+	     strncmp( hdr->fingerprint, fingerprint,
+		      sizeof ( hdr->fingerprint ) - 1 ) != 0 ) {
+		SUBDBG( "Event cache %s is stale\n", path );
+		munmap( map, st.st_size );
+		return NULL;
+	}
+
+	if ( !valid_cache( hdr ) ) {
+		SUBDBG( "Event cache %s is corrupt\n", path );
+		munmap( map, st.st_size );
+		return NULL;
+	}
+
+	cache = calloc( 1, sizeof ( struct pe_event_cache ) );
+	if ( cache == NULL ) {
+		munmap( map, st.st_size );
+		return NULL;
+	}
+
+	cache->map = map;
+	cache->size = st.st_size;
+	cache->hdr = hdr;
+	cache->entries = ( const struct pe_cache_entry * )
+		( ( const char * ) map + hdr->entries_offset );
+	cache->by_code = ( const uint32_t * )
+		( ( const char * ) map + hdr->by_code_offset );
+	cache->strings = ( const char * ) map + hdr->strings_offset;
+
+	return cache;
+}
+
+/** @class  _pe_cache_open
+ *  @brief  Map the event cache for a set of PMUs, building it if needed
+ *
+ *  @param[in] pmu_type
+ *        -- PMU_TYPE_* mask of the event table being served
+ *  @param[in] pmus
+ *        -- libpfm4 indices of the PMUs the component uses
+ *  @param[in] num_pmus
+ *        -- number of entries in pmus
+ *
+ *  @returns the cache or NULL if caching is off or not possible
+ */
+struct pe_event_cache *
+_pe_cache_open( int pmu_type, const int *pmus, int num_pmus )
+{
+	struct pe_event_cache *cache;
+	char fingerprint[PAPI_HUGE_STR_LEN];
+	char path[PATH_MAX];
+	char *dir;
+
+	dir = getenv( PE_CACHE_ENV );
+	if ( ( dir == NULL ) || ( strlen( dir ) == 0 ) ) return NULL;
+
+	memset( fingerprint, 0, sizeof ( fingerprint ) );
+	make_fingerprint( fingerprint, sizeof ( fingerprint ), pmu_type,
+			  pmus, num_pmus );
+
+	snprintf( path, sizeof ( path ), "%s/%s%d_%08x.idx", dir,
+		  PE_CACHE_PREFIX, pmu_type, fnv1a_hash( fingerprint ) );
+
+	cache = map_cache( path, fingerprint );
+	if ( cache != NULL ) {
+		SUBDBG( "Using event cache %s\n", path );
+		return cache;
+	}
+
+	if ( build_cache( path, fingerprint, pmu_type, pmus, num_pmus ) != PAPI_OK ) {
+		return NULL;
+	}
+
+	return map_cache( path, fingerprint );
+}
+
+void
+_pe_cache_close( struct pe_event_cache *cache )
+{
+	if ( cache == NULL ) return;
+
+	munmap( cache->map, cache->size );
+	free( cache );
+}
+
+/* Index of the first entry not sorting before key, compared on */
+/* at most keylen characters                                    */
+static uint32_t
+lower_bound( struct pe_event_cache *cache, const char *key, size_t keylen )
+{
+	uint32_t lo = 0, hi = cache->hdr->num_events, mid;
+
+	while ( lo < hi ) {
+		mid = lo + ( hi - lo ) / 2;
+		if ( strncasecmp( cache->strings + cache->entries[mid].name_offset,
+				  key, keylen ) < 0 ) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/** @class  _pe_cache_find_event
+ *  @brief  Look up the libpfm4 code of a "pmu::event" name
+ *
+ *  @param[in] name
+ *        -- event name, as passed to libpfm4, masks are ignored
+ *  @param[out] libpfm4_idx
+ *        -- libpfm4 code of the event
+ *
+ *  @retval PAPI_OK      The event is in the cache
+ *  @retval PAPI_ENOEVNT The PMU is cached and does not have this event
+ *  @retval PAPI_ECMP    The cache cannot tell, ask libpfm4
+ *
+ *  Names without a PMU are resolved by libpfm4 searching every PMU
+ *  in its own order, so they are always left to libpfm4.
+ */
+int
+_pe_cache_find_event( struct pe_event_cache *cache, const char *name,
+		      int *libpfm4_idx )
+{
+	char key[BUFSIZ];
+	const char *pmu_end;
+	size_t pmu_len, key_len;
+	uint32_t pos;
+	int i;
+
+	if ( cache == NULL ) return PAPI_ECMP;
+
+	pmu_end = strstr( name, "::" );
+	if ( pmu_end == NULL ) return PAPI_ECMP;
+
+	pmu_len = pmu_end - name;
+	for ( i = 0; pattern_pmus[i] != NULL; i++ ) {
+		if ( strlen( pattern_pmus[i] ) == pmu_len &&
+		     strncasecmp( name, pattern_pmus[i], pmu_len ) == 0 ) {
+			return PAPI_ECMP;
+		}
+	}
+
+	/* libpfm4 ends the event name at the first attribute delimiter */
+	key_len = pmu_len + 2 + strcspn( pmu_end + 2, ":., \t\n" );
+	if ( key_len >= sizeof ( key ) ) return PAPI_ECMP;
+	memcpy( key, name, key_len );
+	key[key_len] = '\0';
+
+	pos = lower_bound( cache, key, key_len + 1 );
+	if ( pos < cache->hdr->num_events &&
+	     strcasecmp( cache->strings + cache->entries[pos].name_offset,
+			 key ) == 0 ) {
+		*libpfm4_idx = cache->entries[pos].found_idx;
+		return PAPI_OK;
+	}
+
+	/* Only authoritative if we cached the PMU the name asks for */
+	pos = lower_bound( cache, key, pmu_len + 2 );
+	if ( pos < cache->hdr->num_events &&
+	     strncasecmp( cache->strings + cache->entries[pos].name_offset,
+			  key, pmu_len + 2 ) == 0 ) {
+		return PAPI_ENOEVNT;
+	}
+
+	return PAPI_ECMP;
+}
+
+/** @class  _pe_cache_get_encoding
+ *  @brief  Get the perf_event encoding of a bare "pmu::event" name
+ *
+ *  @param[in] name
+ *        -- event name, with a PMU and without masks
+ *  @param[out] attr
+ *        -- the encoding, as libpfm4 returns it for PFM_PLM0 | PFM_PLM3
+ *  @param[out] cpu
+ *        -- the cpu of the encoding, -1 if none
+ *
+ *  @retval PAPI_OK      attr and cpu are set
+ *  @retval PAPI_ENOEVNT The event is cached, and libpfm4 cannot encode it
+ *  @retval PAPI_ECMP    The name is not cached as is, ask libpfm4
+ */
+int
+_pe_cache_get_encoding( struct pe_event_cache *cache, const char *name,
+			struct perf_event_attr *attr, int *cpu )
+{
+	const struct pe_cache_entry *entry;
+	const char *event;
+	uint32_t pos;
+
+	if ( cache == NULL ) return PAPI_ECMP;
+
+	/* masks change the encoding, only bare names are cached */
+	event = strstr( name, "::" );
+	if ( event == NULL || event[2 + strcspn( event + 2, ":., \t\n" )] != '\0' )
+		return PAPI_ECMP;
+
+	pos = lower_bound( cache, name, strlen( name ) + 1 );
+	if ( pos >= cache->hdr->num_events ) return PAPI_ECMP;
+	entry = &cache->entries[pos];
+	if ( strcasecmp( cache->strings + entry->name_offset, name ) != 0 )
+		return PAPI_ECMP;
+
+	if ( !entry->encoded ) return PAPI_ENOEVNT;
+
+	*attr = entry->attr;
+	*cpu = entry->cpu;
+
+	return PAPI_OK;
+}
+
+/* Position in code order of the first event with a code above code */
+static uint32_t
+upper_bound_code( struct pe_event_cache *cache, int code )
+{
+	uint32_t lo = 0, hi = cache->hdr->num_events, mid;
+
+	while ( lo < hi ) {
+		mid = lo + ( hi - lo ) / 2;
+		if ( cache->entries[cache->by_code[mid]].libpfm4_idx <= code ) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/** @class  _pe_cache_next_event
+ *  @brief  Enumerate the cached events in libpfm4 code order
+ *
+ *  @param[in] code
+ *        -- current libpfm4 code, negative for the first event
+ *  @param[out] next_code
+ *        -- libpfm4 code of the following event
+ *  @param[out] name
+ *        -- its "pmu::event" name, pointing into the mapped cache
+ *
+ *  @retval PAPI_OK      An event was returned
+ *  @retval PAPI_ENOEVNT No more events
+ */
+int
+_pe_cache_next_event( struct pe_event_cache *cache, int code,
+		      int *next_code, const char **name )
+{
+	const struct pe_cache_entry *entry;
+	uint32_t pos;
+
+	pos = upper_bound_code( cache, code );
+	if ( pos >= cache->hdr->num_events ) return PAPI_ENOEVNT;
+
+	entry = &cache->entries[cache->by_code[pos]];
+	*next_code = entry->libpfm4_idx;
+	*name = cache->strings + entry->name_offset;
+
+	return PAPI_OK;
+}
+
+/** @class  _pe_cache_code_to_name
+ *  @brief  Get the name of a cached event from its libpfm4 code
+ *
+ *  @param[in] code
+ *        -- libpfm4 code of the event
+ *  @param[out] name
+ *        -- its "pmu::event" name, pointing into the mapped cache
+ *
+ *  @retval PAPI_OK      The event is in the cache
+ *  @retval PAPI_ENOEVNT It is not
+ */
+int
+_pe_cache_code_to_name( struct pe_event_cache *cache, int code,
+			const char **name )
+{
+	const struct pe_cache_entry *entry;
+	uint32_t pos;
+
+	if ( cache == NULL || code < 0 ) return PAPI_ENOEVNT;
+
+	pos = upper_bound_code( cache, code - 1 );
+	if ( pos >= cache->hdr->num_events ) return PAPI_ENOEVNT;
+
+	entry = &cache->entries[cache->by_code[pos]];
+	if ( entry->libpfm4_idx != code ) return PAPI_ENOEVNT;
+	*name = cache->strings + entry->name_offset;
+
+	return PAPI_OK;
+}
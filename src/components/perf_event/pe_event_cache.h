@@ -0,0 +1,63 @@
+/*
+* File:    pe_event_cache.h
+*
+* Persistent, mmap-able index of the libpfm4 event space
+*/
+
+#ifndef _PE_EVENT_CACHE_H
+#define _PE_EVENT_CACHE_H
+
+#include <stdint.h>
+
+#include "perfmon/pfmlib_perf_event.h"
+
+/* Directory holding the cache files, caching is off if unset */
+#define PE_CACHE_ENV      "PAPI_EVENT_CACHE"
+#define PE_CACHE_PREFIX   "papi_events_"
+
+#define PE_CACHE_MAGIC    0x43564550	/* "PEVC" */
+#define PE_CACHE_VERSION  2
+
+/* On-disk layout: header, entries sorted by name, entry indices */
+/* sorted by libpfm4 code (enumeration order), string table.     */
+
+struct pe_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_events;
+	uint32_t file_size;
+	uint32_t entries_offset;
+	uint32_t by_code_offset;
+	uint32_t strings_offset;
+	uint32_t pmu_type;
+	uint32_t attr_size;	/* sizeof the perf_event_attr entries */
+	uint32_t reserved;	/* keeps the entries 8-byte aligned   */
+	char fingerprint[PAPI_HUGE_STR_LEN];
+};
+
+struct pe_cache_entry {
+	uint32_t name_offset;	/* "pmu::event", relative to strings  */
+	int32_t libpfm4_idx;	/* code the event is listed under     */
+	int32_t found_idx;	/* code libpfm4 resolves the name to, */
+				/* differs for aliases                */
+	int32_t encoded;	/* libpfm4 could encode the name      */
+	int32_t cpu;		/* cpu of the encoding, -1 if none    */
+	int32_t reserved;
+	struct perf_event_attr attr;	/* encoding of the bare name  */
+};
+
+struct pe_event_cache;
+
+struct pe_event_cache *_pe_cache_open( int pmu_type, const int *pmus,
+				       int num_pmus );
+void _pe_cache_close( struct pe_event_cache *cache );
+int _pe_cache_find_event( struct pe_event_cache *cache, const char *name,
+			  int *libpfm4_idx );
+int _pe_cache_get_encoding( struct pe_event_cache *cache, const char *name,
+			    struct perf_event_attr *attr, int *cpu );
+int _pe_cache_next_event( struct pe_event_cache *cache, int code,
+			  int *next_code, const char **name );
+int _pe_cache_code_to_name( struct pe_event_cache *cache, int code,
+			    const char **name );
+
+#endif
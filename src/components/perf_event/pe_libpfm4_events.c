@@ -13,6 +13,7 @@
 * Handle the libpfm4 event interface for the perf_event component
 */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "papi.h"
@@ -21,6 +22,7 @@
 
 #include "papi_libpfm4_events.h"
 #include "pe_libpfm4_events.h"
+#include "pe_event_cache.h"
 #include "perf_event_lib.h"
 
 #include "perfmon/pfmlib.h"
@@ -111,6 +113,79 @@ static int pmu_is_present_and_right_type(pfm_pmu_info_t *pinfo, int type) {
 }
 
 
+/** @class  _pe_libpfm4_fanout
+ *  @brief  Split the PAPI qualifiers off an uncore event name
+ *
+ *  @param[in] name
+ *             -- name of the event
+ *  @param[out] stripped
+ *             -- the name without agg= and socket=, as passed to libpfm4
+ *  @param[in] len
+ *             -- size of stripped
+ *  @param[out] agg
+ *             -- PE_AGG_* given by agg=sum|min|max, PE_AGG_NONE without
+ *  @param[out] socket
+ *             -- the package given by socket=, -1 without
+ *
+ *  @retval PAPI_OK       The name was split
+ *  @retval PAPI_EINVAL   A qualifier has a bad value, or socket= is used
+ *                        without agg=
+ *  @retval PAPI_EBUF     The name does not fit in stripped
+ *
+ *  An event with agg= is counted on every instance of its PMU, the
+ *  boxes named like it but for the trailing instance number, on each
+ *  package, and read back as one value.
+ */
+
+int
+_pe_libpfm4_fanout(const char *name, char *stripped, size_t len,
+		   int *agg, int *socket)
+{
+	const char *p, *mask, *end;
+	char *endp;
+	size_t n, out;
+
+	*agg = PE_AGG_NONE;
+	*socket = -1;
+
+	/* masks start at the first ':' after the pmu delimiter */
+	p = strstr(name, "::");
+	mask = strchr(p ? p + 2 : name, ':');
+	out = mask ? (size_t)(mask - name) : strlen(name);
+	if (out >= len) return PAPI_EBUF;
+	memcpy(stripped, name, out);
+
+	for ( ; mask != NULL; mask = end) {
+		end = strchr(mask + 1, ':');
+		/* n counts the ':' in front of the mask */
+		n = end ? (size_t)(end - mask) : strlen(mask);
+
+		if ((n == 8) && !strncmp(mask, ":agg=sum", n)) {
+			*agg = PE_AGG_SUM;
+		} else if ((n == 8) && !strncmp(mask, ":agg=min", n)) {
+			*agg = PE_AGG_MIN;
+		} else if ((n == 8) && !strncmp(mask, ":agg=max", n)) {
+			*agg = PE_AGG_MAX;
+		} else if (!strncmp(mask, ":agg=", 5)) {
+			return PAPI_EINVAL;
+		} else if (!strncmp(mask, ":socket=", 8)) {
+			*socket = (int)strtol(mask + 8, &endp, 10);
+			if ((endp != mask + n) || (endp == mask + 8) || (*socket < 0))
+				return PAPI_EINVAL;
+		} else {
+			if (out + n >= len) return PAPI_EBUF;
+			memcpy(stripped + out, mask, n);
+			out += n;
+		}
+	}
+	stripped[out] = '\0';
+
+	if ((*socket >= 0) && (*agg == PE_AGG_NONE)) return PAPI_EINVAL;
+
+	return PAPI_OK;
+}
+
+
 /** @class  allocate_native_event
  *  @brief  Allocates a native event
  *
@@ -139,6 +214,7 @@ static struct native_event_t *allocate_native_event(
 	int nevt_idx;
 	int event_num;
 	int encode_failed=0;
+	int cached;
 
 	pfm_err_t ret;
 	char *event_string=NULL;
@@ -146,6 +222,9 @@ static struct native_event_t *allocate_native_event(
 	char *event;
 	char *masks;
 	char fullname[BUFSIZ];
+	char encode_name[BUFSIZ];
+	const char *all_masks;
+	int agg, socket;
 	struct native_event_t *ntv_evt;
 
 	pfm_perf_encode_arg_t perf_arg;
@@ -162,6 +241,20 @@ static struct native_event_t *allocate_native_event(
 	// find out if this event is already known
 	event_num=find_existing_event(name, event_table);
 
+	// uncore events may be fanned out over every box, libpfm4
+	// only gets to see the name of one box
+	if (event_table->pmu_type & PMU_TYPE_UNCORE) {
+		if (_pe_libpfm4_fanout(name, encode_name, sizeof(encode_name),
+				&agg, &socket) != PAPI_OK) {
+			SUBDBG("EXIT: bad agg= or socket= in %s\n", name);
+			return NULL;
+		}
+	} else {
+		snprintf(encode_name, sizeof(encode_name), "%s", name);
+		agg = PE_AGG_NONE;
+		socket = -1;
+	}
+
 	/* add the event to our event table */
 	_papi_hwi_lock( NAMELIB_LOCK );
 
@@ -194,15 +287,25 @@ static struct native_event_t *allocate_native_event(
 	// set the size of the perf attr struct before getting pfm encoding
 	ntv_evt->attr.size = sizeof(struct perf_event_attr);
 
-	/* use user provided name of the event to get the */
-	/* perf_event encoding and a fully qualified event string */
-	ret = pfm_get_os_event_encoding(name,
-					PFM_PLM0 | PFM_PLM3,
-					PFM_OS_PERF_EVENT_EXT,
-					&perf_arg);
+	// the event cache holds the encoding of bare event names
+	cached = _pe_cache_get_encoding(event_table->cache, encode_name,
+					&ntv_evt->attr, &perf_arg.cpu);
+	if (cached == PAPI_ECMP) {
+		/* use user provided name of the event to get the */
+		/* perf_event encoding and a fully qualified event string */
+		ret = pfm_get_os_event_encoding(encode_name,
+						PFM_PLM0 | PFM_PLM3,
+						PFM_OS_PERF_EVENT_EXT,
+						&perf_arg);
+	} else {
+		ret = (cached == PAPI_OK) ? PFM_SUCCESS : PFM_ERR_NOTFOUND;
+		SUBDBG("encoding of %s from the event cache: %d\n",
+			encode_name, cached);
+	}
 
 	// If the encode function failed, skip processing of the event_string
-	if ((ret != PFM_SUCCESS) || (event_string == NULL)) {
+	if ((ret != PFM_SUCCESS) ||
+	    ((cached == PAPI_ECMP) && (event_string == NULL))) {
 		SUBDBG("encode failed for event: %s, returned: %d\n",
 			name, ret);
 
@@ -231,7 +334,7 @@ static struct native_event_t *allocate_native_event(
 	// free string allocated by pfm_get_os_event_encoding
 	free(*(perf_arg.fstr));
 	// get a copy of the event name and break it up into its parts
-	event_string = strdup(name);
+	event_string = strdup(encode_name);
 
 	SUBDBG("event_string: %s\n", event_string);
 
@@ -309,7 +412,11 @@ static struct native_event_t *allocate_native_event(
 	}
 
 	ntv_evt->allocated_name=strdup(name);
-	ntv_evt->mask_string=strdup(masks);
+	// the masks in the name include the PAPI qualifiers,
+	// so that the event does not match the one of a single box
+	all_masks = strstr(name, "::");
+	all_masks = strchr(all_masks ? all_masks + 2 : name, ':');
+	ntv_evt->mask_string=strdup(all_masks ? all_masks + 1 : "");
 	ntv_evt->component=cidx;
 	ntv_evt->pmu=pmu_name;
 	ntv_evt->base_name=strdup(event);
@@ -318,6 +425,8 @@ static struct native_event_t *allocate_native_event(
 	ntv_evt->event_description=strdup(einfo.desc);
 	ntv_evt->users=0;      /* is this needed? */
 	ntv_evt->cpu=perf_arg.cpu;
+	ntv_evt->agg=agg;
+	ntv_evt->socket=socket;
 
 	SUBDBG("ntv_evt->mask_string: %p (%s)\n",
 		ntv_evt->mask_string, ntv_evt->mask_string);
@@ -414,6 +523,21 @@ static struct native_event_t *allocate_native_event(
 			ptr = ptrm;
 		}
 	}
+	if (agg != PE_AGG_NONE) {
+		const char *how = (agg == PE_AGG_SUM) ? "Summed" :
+			(agg == PE_AGG_MIN) ? "Minimum" : "Maximum";
+		size_t used = strlen(mask_desc);
+
+		if (socket >= 0) {
+			snprintf(mask_desc + used, sizeof(mask_desc) - used,
+				"%s%s over the boxes of socket %d",
+				used ? ":" : "", how, socket);
+		} else {
+			snprintf(mask_desc + used, sizeof(mask_desc) - used,
+				"%s%s over all boxes and sockets",
+				used ? ":" : "", how);
+		}
+	}
 	ntv_evt->mask_description=strdup(mask_desc);
 	SUBDBG("ntv_evt->mask_description: %p (%s)\n", ntv_evt->mask_description, ntv_evt->mask_description);
 
@@ -485,6 +609,61 @@ static struct native_event_t *allocate_native_event(
 }
 
 
+/** @class  find_code_event
+ *  @brief  finds the native event of a papi event code
+ *
+ *  @param[in] EventCode
+ *             -- libpfm4 index of the event
+ *  @param[in] papi_event_code
+ *             -- papi event code of the event
+ *  @param[in] event_table
+ *             -- native_event_table structure
+ *
+ *  @returns returns offset in array, or -1
+ *
+ *  Events enumerated from the event cache only get a native event
+ *  here, once they are described or added to an event set.
+ */
+
+static int find_code_event(unsigned int EventCode, int papi_event_code,
+                           struct native_event_table_t *event_table) {
+
+	const char *cached_name;
+	int eidx, cidx;
+
+	// search list backwards because it improves chances of finding it quickly
+	for (eidx=event_table->num_native_events-1 ; eidx>=0 ; eidx--) {
+		if ((papi_event_code == event_table->native_events[eidx].papi_event_code) && (EventCode == ((unsigned)event_table->native_events[eidx].libpfm4_idx))) {
+			SUBDBG("Found native_event[%d]: papi_event_code: %#x, libpfm4_idx: %#x\n", eidx, event_table->native_events[eidx].papi_event_code, event_table->native_events[eidx].libpfm4_idx);
+			return eidx;
+		}
+	}
+
+	if (_pe_cache_code_to_name(event_table->cache, (int)EventCode,
+				   &cached_name) != PAPI_OK) {
+		return -1;
+	}
+	cidx = _papi_hwi_component_index(papi_event_code);
+	if (cidx < 0) {
+		return -1;
+	}
+
+	// the papi event code was made from the cached name when the event
+	// was enumerated, allocating it by that name hands the same one back
+	SUBDBG("Allocating enumerated event: %s\n", cached_name);
+	_papi_hwi_set_papi_event_code(papi_event_code, 0);
+	allocate_native_event(cached_name, (int)EventCode, cidx, event_table);
+	_papi_hwi_set_papi_event_code(papi_event_code, 0);
+
+	for (eidx=event_table->num_native_events-1 ; eidx>=0 ; eidx--) {
+		if ((papi_event_code == event_table->native_events[eidx].papi_event_code) && (EventCode == ((unsigned)event_table->native_events[eidx].libpfm4_idx))) {
+			return eidx;
+		}
+	}
+	return -1;
+}
+
+
 /** @class  get_first_event_next_pmu
  *  @brief  return the first available event that's on an active PMU
  *
@@ -587,6 +766,7 @@ _pe_libpfm4_ntv_name_to_code( const char *name, unsigned int *event_code,
 
   struct native_event_t *our_event;
   int event_num;
+  int libpfm4_idx = -1;
 
   // if we already know this event name, just return its native code
   event_num=find_existing_event(name, event_table);
@@ -598,8 +778,15 @@ _pe_libpfm4_ntv_name_to_code( const char *name, unsigned int *event_code,
 	     return PAPI_OK;
   }
 
+     // the event cache knows the libpfm4 index, or that a pmu has no such event, without searching libpfm4
+     if (_pe_cache_find_event(event_table->cache, name,
+                              &libpfm4_idx) == PAPI_ENOEVNT) {
+    	 SUBDBG("EXIT: Event '%s' not in event cache\n", name);
+    	 return PAPI_ENOEVNT;
+     }
+
      // Try to allocate this event to see if it is known by libpfm4, if allocate fails tell the caller it is not valid
-     our_event=allocate_native_event(name, -1, cidx, event_table);
+     our_event=allocate_native_event(name, libpfm4_idx, cidx, event_table);
      if (our_event==NULL) {
     	 SUBDBG("EXIT: Allocating event: '%s' failed\n", name);
     	 return PAPI_ENOEVNT;
@@ -611,6 +798,30 @@ _pe_libpfm4_ntv_name_to_code( const char *name, unsigned int *event_code,
 }
 
 
+/** @class  _pe_libpfm4_ntv_find_event
+ *  @brief  Find the native event of a papi event code
+ *
+ *  @param[in] papi_event_code
+ *        -- PAPI event code
+ *  @param[in] event_table
+ *        -- native event table struct
+ *
+ *  @returns the index of the native event, or -1 if there is none
+ */
+
+int
+_pe_libpfm4_ntv_find_event(unsigned int papi_event_code,
+			   struct native_event_table_t *event_table)
+{
+	int code = _papi_hwi_eventcode_to_native(papi_event_code);
+
+	if (code < 0) {
+		return -1;
+	}
+	return find_code_event(code, papi_event_code, event_table);
+}
+
+
 /** @class  _pe_libpfm4_ntv_code_to_name
  *  @brief  Take an event code and convert it to a name
  *
@@ -647,13 +858,8 @@ _pe_libpfm4_ntv_code_to_name(unsigned int EventCode,
 		return PAPI_ENOEVNT;
 	}
 
-	// find our native event table for this papi event code (search list backwards because it improves chances of finding it quickly)
-	for (eidx=event_table->num_native_events-1 ; eidx>=0 ; eidx--) {
-		if ((papi_event_code == event_table->native_events[eidx].papi_event_code) && (EventCode == ((unsigned)event_table->native_events[eidx].libpfm4_idx))) {
-			SUBDBG("Found native_event[%d]: papi_event_code: %#x, libpfm4_idx: %#x\n", eidx, event_table->native_events[eidx].papi_event_code, event_table->native_events[eidx].libpfm4_idx);
-			break;
-		}
-	}
+	// find our native event table for this papi event code
+	eidx = find_code_event(EventCode, papi_event_code, event_table);
 
 	// if we did not find a match, return an error
 	if (eidx < 0) {
@@ -742,13 +948,8 @@ _pe_libpfm4_ntv_code_to_descr( unsigned int EventCode,
 		return PAPI_ENOEVNT;
 	}
 
-	// find our native event table for this papi event code (search list backwards because it improves chances of finding it quickly)
-	for (eidx=event_table->num_native_events-1 ; eidx>=0 ; eidx--) {
-		SUBDBG("native_event[%d]: papi_event_code: %#x, libpfm4_idx: %#x\n", eidx, event_table->native_events[eidx].papi_event_code, event_table->native_events[eidx].libpfm4_idx);
-		if ((papi_event_code == event_table->native_events[eidx].papi_event_code) && (EventCode == ((unsigned)event_table->native_events[eidx].libpfm4_idx))) {
-			break;
-		}
-	}
+	// find our native event table for this papi event code
+	eidx = find_code_event(EventCode, papi_event_code, event_table);
 
 	// if we did not find a match, return an error
 	if (eidx < 0) {
@@ -812,6 +1013,51 @@ _pe_libpfm4_ntv_code_to_info(unsigned int EventCode,
 }
 
 
+/** @class  enum_allocate_event
+ *  @brief  allocate the native event an enumeration step landed on
+ *
+ *  @param[in] event_string
+ *        -- full "pmu::event" name of the event
+ *  @param[in] code
+ *        -- libpfm4 index of the event
+ *  @param[out] *PapiEventCode
+ *        -- libpfm4 index handed back to the caller
+ *
+ *  @retval PAPI_OK       The event is listed
+ *  @retval PAPI_ENOEVENT The event could not be set up at all
+ */
+
+static int
+enum_allocate_event( const char *event_string, int code, int cidx,
+		     unsigned int *PapiEventCode,
+		     struct native_event_table_t *event_table) {
+
+	struct native_event_t *our_event;
+
+	// go allocate this event, need to create tables used by the get event info call that will probably follow
+	if ((our_event = allocate_native_event(event_string, code, cidx, event_table)) == NULL) {
+		// allocate may have created the event table but returned NULL to tell the caller the event string was invalid (attempt to encode it failed).
+		// if the caller wants to use this event to count something, it will report an error
+		// but if the caller is just interested in listing the event, then we need an event table with an event name and libpfm4 index
+		int evt_idx;
+		if ((evt_idx = find_existing_event(event_string, event_table)) < 0) {
+			SUBDBG("EXIT: Allocating event: '%s' failed\n", event_string);
+			return PAPI_ENOEVNT;
+		}
+
+		// give back the new event code
+		*PapiEventCode = event_table->native_events[evt_idx].libpfm4_idx;
+		SUBDBG("EXIT: event code: %#x\n", *PapiEventCode);
+		return PAPI_OK;
+	}
+
+	*PapiEventCode = our_event->libpfm4_idx;
+
+	SUBDBG("EXIT: *PapiEventCode: %#x\n", *PapiEventCode);
+	return PAPI_OK;
+}
+
+
 /** @class  _pe_libpfm4_ntv_enum_events
  *  @brief  Walk through all events in a pre-defined order
  *
@@ -838,10 +1084,30 @@ _pe_libpfm4_ntv_enum_events( unsigned int *PapiEventCode,
 	int code,ret, pnum;
 	int max_umasks;
 	char event_string[BUFSIZ];
+	const char *cached_name;
 	pfm_pmu_info_t pinfo;
 	pfm_event_info_t einfo;
 	struct native_event_t *our_event;
 
+	/* the event cache hands out names and codes in libpfm4 order, */
+	/* the native event is only allocated once the event is used   */
+	if ( (event_table->cache != NULL) &&
+	     ((modifier == PAPI_ENUM_FIRST) || (modifier == PAPI_ENUM_EVENTS)) ) {
+		attr_idx = 0;   // set so if they want attribute information, it will start with the first attribute
+		ret = _pe_cache_next_event(event_table->cache,
+				(modifier == PAPI_ENUM_FIRST) ? -1 : (int)*PapiEventCode,
+				&code, &cached_name);
+		if (ret != PAPI_OK) {
+			SUBDBG("EXIT: No more events in event cache\n");
+			return ret;
+		}
+		// the papi event code is made from this name
+		_papi_hwi_set_papi_event_string(cached_name);
+		*PapiEventCode = code;
+		SUBDBG("EXIT: cached event: %s, code: %#x\n", cached_name, code);
+		return PAPI_OK;
+	}
+
 	/* return first event if so specified */
 	if ( modifier == PAPI_ENUM_FIRST ) {
 		attr_idx = 0;   // set so if they want attribute information, it will start with the first attribute
@@ -872,27 +1138,7 @@ _pe_libpfm4_ntv_enum_events( unsigned int *PapiEventCode,
 		sprintf (event_string, "%s::%s", pinfo.name, einfo.name);
 		SUBDBG("code: %#x, pmu: %s, event: %s, event_string: %s\n", code, pinfo.name, einfo.name, event_string);
 
-		// go allocate this event, need to create tables used by the get event info call that will probably follow
-		if ((our_event = allocate_native_event(event_string, code, cidx, event_table)) == NULL) {
-			// allocate may have created the event table but returned NULL to tell the caller the event string was invalid (attempt to encode it failed).
-			// if the caller wants to use this event to count something, it will report an error
-			// but if the caller is just interested in listing the event, then we need an event table with an event name and libpfm4 index
-			int evt_idx;
-			if ((evt_idx = find_existing_event(event_string, event_table)) < 0) {
-				SUBDBG("EXIT: Allocating event: '%s' failed\n", event_string);
-				return PAPI_ENOEVNT;
-			}
-
-			// give back the new event code
-			*PapiEventCode = event_table->native_events[evt_idx].libpfm4_idx;
-			SUBDBG("EXIT: event code: %#x\n", *PapiEventCode);
-			return PAPI_OK;
-		}
-
-		*PapiEventCode = our_event->libpfm4_idx;
-
-		SUBDBG("EXIT: *PapiEventCode: %#x\n", *PapiEventCode);
-		return PAPI_OK;
+		return enum_allocate_event(event_string, code, cidx, PapiEventCode, event_table);
 	}
 
 	/* Handle looking for the next event */
@@ -944,28 +1190,7 @@ _pe_libpfm4_ntv_enum_events( unsigned int *PapiEventCode,
 		sprintf (event_string, "%s::%s", pinfo.name, einfo.name);
 		SUBDBG("code: %#x, pmu: %s, event: %s, event_string: %s\n", code, pinfo.name, einfo.name, event_string);
 
-		// go allocate this event, need to create tables used by the get event info call that will follow
-		if ((our_event = allocate_native_event(event_string, code, cidx, event_table)) == NULL) {
-			// allocate may have created the event table but returned NULL to tell the caller the event string was invalid (attempt to encode it failed).
-			// if the caller wants to use this event to count something, it will report an error
-			// but if the caller is just interested in listing the event, then we need an event table with an event name and libpfm4 index
-			int evt_idx;
-			if ((evt_idx = find_existing_event(event_string, event_table)) < 0) {
-				SUBDBG("EXIT: Allocating event: '%s' failed\n", event_string);
-				return PAPI_ENOEVNT;
-			}
-
-			// give back the new event code
-			*PapiEventCode = event_table->native_events[evt_idx].libpfm4_idx;
-			SUBDBG("EXIT: event code: %#x\n", *PapiEventCode);
-			return PAPI_OK;
-		}
-
-		// give back the new event code
-		*PapiEventCode = our_event->libpfm4_idx;
-
-		SUBDBG("EXIT: *PapiEventCode: %#x\n", *PapiEventCode);
-		return PAPI_OK;
+		return enum_allocate_event(event_string, code, cidx, PapiEventCode, event_table);
 	}
 
 	/* We don't handle PAPI_NTV_ENUM_UMASK_COMBOS */
@@ -996,6 +1221,9 @@ _pe_libpfm4_ntv_enum_events( unsigned int *PapiEventCode,
 
 		// find the event table for this event, we need the pmu name and event name without any masks
 		int ntv_idx = _papi_hwi_get_ntv_idx(_papi_hwi_get_papi_event_code());
+		if (ntv_idx == -1) {
+			ntv_idx = find_code_event(*PapiEventCode, _papi_hwi_get_papi_event_code(), event_table);
+		}
 		if (ntv_idx < 0) {
 			SUBDBG("EXIT: _papi_hwi_get_ntv_idx returned: %d\n", ntv_idx);
 			return ntv_idx;
@@ -1104,6 +1332,9 @@ _pe_libpfm4_shutdown(papi_vector_t *my_vector,
 	  }
   }
 
+  _pe_cache_close(event_table->cache);
+  event_table->cache = NULL;
+
   /* clean out and free the native events structure */
   _papi_hwi_lock( NAMELIB_LOCK );
 
@@ -1122,6 +1353,11 @@ _pe_libpfm4_shutdown(papi_vector_t *my_vector,
 
   free(event_table->native_events);
 
+  /* other components may look up names before we are initialized again */
+  event_table->native_events = NULL;
+  event_table->num_native_events = 0;
+  event_table->allocated_native_events = 0;
+
   _papi_hwi_unlock( NAMELIB_LOCK );
 
   SUBDBG("EXIT: PAPI_OK\n");
@@ -1155,6 +1391,7 @@ _pe_libpfm4_init(papi_vector_t *component, int cidx,
 	int i;
 	int j=0;
 	unsigned int ncnt;
+	int *pmus, *pmu_list=NULL;
 
 	pfm_err_t retval = PFM_SUCCESS;
 	pfm_pmu_info_t pinfo;
@@ -1163,6 +1400,7 @@ _pe_libpfm4_init(papi_vector_t *component, int cidx,
 	/* allocate the native event structure */
 	event_table->num_native_events=0;
 	event_table->pmu_type=pmu_type;
+	event_table->cache=NULL;
 
 	event_table->native_events=calloc(NATIVE_EVENT_CHUNK,
 					sizeof(struct native_event_t));
@@ -1251,6 +1489,13 @@ _pe_libpfm4_init(papi_vector_t *component, int cidx,
 			SUBDBG("\t%d %s %s %d\n",i,
 				pinfo.name,pinfo.desc,pinfo.type);
 
+			/* remember it for the event cache */
+			pmus=realloc(pmu_list, (detected_pmus+1)*sizeof(int));
+			if (pmus!=NULL) {
+				pmu_list=pmus;
+				pmu_list[detected_pmus]=i;
+			}
+
 			detected_pmus++;
 			ncnt+=pinfo.nevents;
 
@@ -1322,20 +1567,29 @@ _pe_libpfm4_init(papi_vector_t *component, int cidx,
 
 	if (detected_pmus==0) {
 		SUBDBG("Could not find any PMUs\n");
+		free(pmu_list);
 		return PAPI_ENOSUPP;
 	}
 
 	/* Error if we couldn't pick a default PMU */
 	if (!found_default) {
+		free(pmu_list);
 		return PAPI_ECMP;
 	}
 
 	/* Error if we found more than one default PMU */
 	/* FIXME: this breaks on heterogeneous CPU systems */
 	if (found_default>1) {
+		free(pmu_list);
 		return PAPI_ECOUNT;
 	}
 
+	/* Map (or build) the persistent event index if one is configured */
+	if (pmu_list!=NULL) {
+		event_table->cache=_pe_cache_open(pmu_type, pmu_list, detected_pmus);
+		free(pmu_list);
+	}
+
 	component->cmp_info.num_native_events = ncnt;
 
 	component->cmp_info.num_cntrs = event_table->default_pmu.num_cntrs+
@@ -1377,6 +1631,7 @@ _peu_libpfm4_init(papi_vector_t *my_vector, int cidx,
    pfm_err_t retval = PFM_SUCCESS;
    unsigned int ncnt;
    pfm_pmu_info_t pinfo;
+   int *pmus, *pmu_list=NULL;
 
 	(void)cidx;
 
@@ -1384,6 +1639,7 @@ _peu_libpfm4_init(papi_vector_t *my_vector, int cidx,
 
    event_table->num_native_events=0;
    event_table->pmu_type=pmu_type;
+   event_table->cache=NULL;
 
    event_table->native_events=calloc(NATIVE_EVENT_CHUNK,
 					   sizeof(struct native_event_t));
@@ -1418,6 +1674,13 @@ _peu_libpfm4_init(papi_vector_t *my_vector, int cidx,
 
 	 SUBDBG("\t%d %s %s %d\n",i,pinfo.name,pinfo.desc,pinfo.type);
 
+         /* remember it for the event cache */
+         pmus=realloc(pmu_list, (detected_pmus+1)*sizeof(int));
+         if (pmus!=NULL) {
+            pmu_list=pmus;
+            pmu_list[detected_pmus]=i;
+         }
+
          detected_pmus++;
 	 ncnt+=pinfo.nevents;
 
@@ -1435,6 +1698,12 @@ _peu_libpfm4_init(papi_vector_t *my_vector, int cidx,
 
    SUBDBG( "num_counters: %d\n", my_vector->cmp_info.num_cntrs );
 
+   /* Map (or build) the persistent event index if one is configured */
+   if (pmu_list!=NULL) {
+      event_table->cache=_pe_cache_open(pmu_type, pmu_list, detected_pmus);
+      free(pmu_list);
+   }
+
    return PAPI_OK;
 }
 
@@ -10,6 +10,8 @@ int _pe_libpfm4_ntv_enum_events( unsigned int *EventCode, int modifier, int cidx
 int _pe_libpfm4_ntv_name_to_code( const char *ntv_name,
 				    unsigned int *EventCode, int cidx,
 		       struct native_event_table_t *event_table);
+int _pe_libpfm4_ntv_find_event( unsigned int papi_event_code,
+		       struct native_event_table_t *event_table);
 int _pe_libpfm4_ntv_code_to_name( unsigned int EventCode, char *name,
 				    int len,
 		       struct native_event_table_t *event_table);
@@ -27,6 +29,8 @@ int _pe_libpfm4_init(papi_vector_t *my_vector, int cidx,
 		       struct native_event_table_t *event_table,
 		       int pmu_type);
 
+int _pe_libpfm4_fanout(const char *name, char *stripped, size_t len,
+		       int *agg, int *socket);
 int _peu_libpfm4_init(papi_vector_t *my_vector, int cidx,
 		       struct native_event_table_t *event_table,
 		       int pmu_type);
@@ -24,6 +24,8 @@
 
 
 #include <fcntl.h>
+#include <dirent.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 #include <signal.h>
@@ -38,6 +40,7 @@
 #include "papi_internal.h"
 #include "papi_vector.h"
 #include "extras.h"
+#include "papi_shlib.h"
 
 /* libpfm4 includes */
 #include "papi_libpfm4_events.h"
@@ -196,6 +199,20 @@ bug_format_group(void) {
 
 }
 
+/* PERF_IOC_FLAG_GROUP applies an enable/disable/reset ioctl to the    */
+/* group leader and all of its siblings, so a whole eventset changes    */
+/* state with one syscall.  When multiplexing every event is its own    */
+/* leader, and we only trust it where grouped reads work as well.       */
+
+static int
+use_group_ioctl( pe_control_t *ctl ) {
+
+	if (ctl->multiplexed) return 0;
+	if (bug_format_group()) return 0;
+
+	return 1;
+}
+
 #if (OBSOLETE_WORKAROUNDS==1)
 
 
@@ -688,6 +705,377 @@ static inline void arm64_request_user_access(struct perf_event_attr *hw_event)
 	hw_event->config1=0x2;        /* Request user access */
 }
 
+/* The overflow handler finds the event that signalled by its fd in */
+/* ctl->overflow_fds, filled in when the events are opened.         */
+static void
+add_overflow_fd( pe_control_t *ctl, int evt_idx )
+{
+	unsigned int h;
+
+	/* Past half full the handler searches all of the events instead */
+	if ( ++ctl->num_overflow_fds > PERF_EVENT_OVERFLOW_FDS / 2 ) return;
+
+	for ( h = ( unsigned int ) ctl->events[evt_idx].event_fd;
+		ctl->overflow_fds[h & ( PERF_EVENT_OVERFLOW_FDS - 1 )]; h++ );
+	ctl->overflow_fds[h & ( PERF_EVENT_OVERFLOW_FDS - 1 )] =
+		( short ) ( evt_idx + 1 );
+}
+
+static int
+find_overflow_fd( pe_control_t *ctl, int fd )
+{
+	unsigned int h;
+	int i;
+
+	if ( ctl->num_overflow_fds <= PERF_EVENT_OVERFLOW_FDS / 2 ) {
+		for ( h = ( unsigned int ) fd;
+			( i = ctl->overflow_fds[h & ( PERF_EVENT_OVERFLOW_FDS - 1 )] );
+			h++ ) {
+			if ( ctl->events[i - 1].event_fd == fd ) return i - 1;
+		}
+		return -1;
+	}
+
+	for( i = 0; i < ctl->num_events; i++ ) {
+		if ( fd == ctl->events[i].event_fd ) return i;
+	}
+	return -1;
+}
+
+/* Make room in the control state for one more thread */
+static int
+grow_threads( pe_control_t *ctl )
+{
+	int max;
+	pe_thread_t *threads;
+	int *fds;
+
+	if ( ctl->num_threads < ctl->max_threads ) return PAPI_OK;
+
+	/* the fds first: room to spare there is harmless if the */
+	/* threads cannot grow                                    */
+	max = ctl->max_threads ? 2 * ctl->max_threads : 16;
+	fds = papi_realloc( ctl->thread_fds,
+		max * ctl->num_events * sizeof ( int ) );
+	if ( fds == NULL ) return PAPI_ENOMEM;
+	ctl->thread_fds = fds;
+	threads = papi_realloc( ctl->threads, max * sizeof ( pe_thread_t ) );
+	if ( threads == NULL ) return PAPI_ENOMEM;
+	ctl->threads = threads;
+	ctl->max_threads = max;
+
+	return PAPI_OK;
+}
+
+/* Open the events once more, as the same groups, on thread tid. */
+/* Returns 0, or the errno of the open that failed.             */
+static int
+open_thread_group( pe_control_t *ctl, pid_t tid, int *fds )
+{
+	struct perf_event_attr attr;
+	int i, err;
+
+	for ( i = 0; i < ctl->num_events; i++ ) {
+		attr = ctl->events[i].attr;
+		fds[i] = sys_perf_event_open( &attr, tid,
+			ctl->events[i].cpu,
+			ctl->events[i].group_leader_fd == -1 ? -1 : fds[0],
+			0 /* flags */ );
+		if ( fds[i] == -1 ) {
+			err = errno;
+			SUBDBG( "sys_perf_event_open on tid %d returned error: %s\n",
+				tid, strerror( err ) );
+			while ( i > 0 ) close( fds[--i] );
+			fds[0] = -1;
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+/* Members before their leader.  A group that could not be opened */
+/* has -1 for its leader.                                         */
+static void
+close_thread_group( pe_control_t *ctl, int *fds )
+{
+	int i;
+
+	if ( fds[0] == -1 ) return;
+	for ( i = ctl->num_events - 1; i >= 0; i-- ) {
+		close( fds[i] );
+	}
+}
+
+/* With PAPI_INHERIT_THREADS the events are opened once more, as the  */
+/* same groups, on each of the other threads of the process.  They are */
+/* inherited, so threads created later count in the events of the      */
+/* thread that created them, and reading there includes them.          */
+static int
+open_thread_events( pe_control_t *ctl )
+{
+	DIR *dir;
+	struct dirent *entry;
+	pid_t self = mygettid(), tid;
+	int err, ret = PAPI_OK;
+	int *fds;
+
+	dir = opendir( "/proc/self/task" );
+	if ( dir == NULL ) {
+		PAPIERROR( "opendir /proc/self/task: %s", strerror( errno ) );
+		return PAPI_ESYS;
+	}
+
+	while ( ( entry = readdir( dir ) ) != NULL ) {
+		tid = ( pid_t ) atoi( entry->d_name );
+		if ( ( tid <= 0 ) || ( tid == self ) ) continue;
+
+		ret = grow_threads( ctl );
+		if ( ret != PAPI_OK ) break;
+
+		fds = ctl->thread_fds + ctl->num_threads * ctl->num_events;
+		err = open_thread_group( ctl, tid, fds );
+		/* it exited since we listed it */
+		if ( err == ESRCH ) continue;
+		if ( err ) {
+			ret = map_perf_event_errors_to_papi( err );
+			break;
+		}
+		ctl->threads[ctl->num_threads].tid = tid;
+		ctl->threads[ctl->num_threads].tgid = getpid();
+		ctl->threads[ctl->num_threads].last = -1;
+		ctl->num_threads++;
+	}
+	closedir( dir );
+
+	SUBDBG( "opened events on %d other threads\n", ctl->num_threads );
+
+	return ret;
+}
+
+static void
+close_thread_events( pe_control_t *ctl )
+{
+	int t;
+
+	for ( t = 0; t < ctl->num_threads; t++ ) {
+		close_thread_group( ctl, ctl->thread_fds + t * ctl->num_events );
+	}
+	if ( ctl->threads ) papi_free( ctl->threads );
+	if ( ctl->thread_fds ) papi_free( ctl->thread_fds );
+	ctl->threads = NULL;
+	ctl->thread_fds = NULL;
+	ctl->num_threads = 0;
+	ctl->max_threads = 0;
+}
+
+/* Apply an ioctl to the events of threads first..num_threads-1 as to */
+/* our own                                                             */
+static int
+ioctl_thread_events( pe_control_t *ctl, int first, unsigned long request,
+	int leaders_only )
+{
+	int t, i, fd;
+	int group_ioctl = use_group_ioctl( ctl );
+
+	for ( t = first; t < ctl->num_threads; t++ ) {
+		if ( ctl->thread_fds[t * ctl->num_events] == -1 ) continue;
+		for ( i = 0; i < ctl->num_events; i++ ) {
+			if ( ( leaders_only || group_ioctl ) &&
+				( ctl->events[i].group_leader_fd != -1 ) ) {
+				continue;
+			}
+			fd = ctl->thread_fds[t * ctl->num_events + i];
+			if ( ioctl( fd, request,
+				group_ioctl ? PERF_IOC_FLAG_GROUP : 0 ) == -1 ) {
+				PAPIERROR( "ioctl(%d, %#lx) returned error, "
+					"Linux says: %s", fd, request,
+					strerror( errno ) );
+				return PAPI_ESYS;
+			}
+		}
+	}
+
+	return PAPI_OK;
+}
+
+/* The process of tid, which with it tells a later tgkill() whether */
+/* it is still the same thread.  Looked up once, when attached; a    */
+/* tid whose status cannot be read is taken as a process of its own. */
+static pid_t
+thread_tgid( pid_t tid )
+{
+	char path[64], line[128];
+	FILE *f;
+	pid_t tgid = tid;
+
+	snprintf( path, sizeof ( path ), "/proc/%d/status", ( int ) tid );
+	f = fopen( path, "r" );
+	if ( f == NULL ) return tgid;
+	while ( fgets( line, sizeof ( line ), f ) != NULL ) {
+		if ( sscanf( line, "Tgid: %d", &tgid ) == 1 ) break;
+	}
+	fclose( f );
+
+	return tgid;
+}
+
+/* PAPI_attach_tids(): a group of the events on each of the tids.  */
+/* A tid that is already gone is kept, as exited, so that it shows */
+/* up in PAPI_read_tids() like one that exits later.               */
+static int
+attach_tids( pe_context_t *ctx, pe_control_t *ctl, int *tids, int num_tids )
+{
+	int k, t, err, ret, first = ctl->num_threads;
+	int *fds;
+
+	if ( ctl->all_threads || ctl->multiplexed ) return PAPI_ECNFLCT;
+	if ( ctl->num_events == 0 ) return PAPI_EINVAL;
+
+	for ( k = 0; k < num_tids; k++ ) {
+		if ( tids[k] <= 0 ) {
+			ret = PAPI_EINVAL;
+			goto attach_cleanup;
+		}
+		ret = grow_threads( ctl );
+		if ( ret != PAPI_OK ) goto attach_cleanup;
+
+		t = ctl->num_threads;
+		fds = ctl->thread_fds + t * ctl->num_events;
+		err = open_thread_group( ctl, tids[k], fds );
+		if ( err && ( err != ESRCH ) ) {
+			ret = map_perf_event_errors_to_papi( err );
+			goto attach_cleanup;
+		}
+		ctl->threads[t].tid = err ? -tids[k] : tids[k];
+		ctl->threads[t].tgid = err ? 0 : thread_tgid( tids[k] );
+		ctl->threads[t].last = -1;
+		ctl->num_threads++;
+	}
+
+	/* joining an EventSet that is already counting */
+	if ( ctx->state & PERF_EVENTS_RUNNING ) {
+		ret = ioctl_thread_events( ctl, first, PERF_EVENT_IOC_RESET, 0 );
+		if ( ret == PAPI_OK ) {
+			ret = ioctl_thread_events( ctl, first,
+				PERF_EVENT_IOC_ENABLE, 1 );
+		}
+		if ( ret != PAPI_OK ) goto attach_cleanup;
+	}
+
+	SUBDBG( "attached %d tids, %d in all\n", num_tids, ctl->num_threads );
+
+	return PAPI_OK;
+
+attach_cleanup:
+	while ( ctl->num_threads > first ) {
+		ctl->num_threads--;
+		close_thread_group( ctl,
+			ctl->thread_fds + ctl->num_threads * ctl->num_events );
+	}
+	return ret;
+}
+
+/* PAPI_detach_tids(): tids that are not attached are ignored, and */
+/* a tid may be given negated, as PAPI_read_tids() returns it.     */
+static int
+detach_tids( pe_control_t *ctl, int *tids, int num_tids )
+{
+	int k, t, last;
+	pid_t tid;
+
+	if ( ctl->all_threads ) return PAPI_ECNFLCT;
+
+	for ( k = 0; k < num_tids; k++ ) {
+		tid = tids[k] < 0 ? -tids[k] : tids[k];
+		for ( t = 0; t < ctl->num_threads; t++ ) {
+			if ( ( ctl->threads[t].tid == tid ) ||
+				( ctl->threads[t].tid == -tid ) ) break;
+		}
+		if ( t == ctl->num_threads ) continue;
+
+		/* the last one takes its place */
+		close_thread_group( ctl, ctl->thread_fds + t * ctl->num_events );
+		last = --ctl->num_threads;
+		if ( t != last ) {
+			ctl->threads[t] = ctl->threads[last];
+			memcpy( ctl->thread_fds + t * ctl->num_events,
+				ctl->thread_fds + last * ctl->num_events,
+				ctl->num_events * sizeof ( int ) );
+		}
+	}
+
+	return PAPI_OK;
+}
+
+/* PAPI_read_tids(): one read of each group, of the attached tids    */
+/* first..first+num_tids-1, into rows of counts.  A tid whose leader  */
+/* count has not moved since the last read may have exited; only     */
+/* then do we ask the kernel.  The threads of an EventSet can read   */
+/* disjoint ranges at the same time.                                 */
+static int
+read_tids( pe_control_t *ctl, int first, int *tids, long long *counts,
+	int *num_tids )
+{
+	int k, t, i, ret, n;
+	int grouped = !bug_format_group() && !ctl->inherit;
+	long long papi_pe_buffer[READ_BUFFER_SIZE];
+	long long *row;
+	pe_thread_t *thr;
+	int *fds;
+
+	if ( ctl->all_threads ) return PAPI_ECNFLCT;
+
+	n = ctl->num_threads - first;
+	if ( n > *num_tids ) n = *num_tids;
+	if ( n < 0 ) n = 0;
+
+	for ( k = 0; k < n; k++ ) {
+		t = first + k;
+		thr = &ctl->threads[t];
+		fds = ctl->thread_fds + t * ctl->num_events;
+		row = counts + k * ctl->num_events;
+
+		if ( fds[0] == -1 ) {
+			memset( row, 0, ctl->num_events * sizeof ( long long ) );
+			tids[k] = thr->tid;
+			continue;
+		}
+
+		if ( grouped ) {
+			ret = read( fds[0], papi_pe_buffer, sizeof ( papi_pe_buffer ) );
+			if ( ret < ( signed ) ( ( 1 + ctl->num_events ) *
+				sizeof ( long long ) ) ) {
+				PAPIERROR( "read of tid %d returned %d: %s",
+					thr->tid, ret, strerror( errno ) );
+				return PAPI_ESYS;
+			}
+			memcpy( row, papi_pe_buffer + 1,
+				ctl->num_events * sizeof ( long long ) );
+		} else {
+			for ( i = 0; i < ctl->num_events; i++ ) {
+				ret = read( fds[i], &row[i], sizeof ( long long ) );
+				if ( ret != sizeof ( long long ) ) {
+					PAPIERROR( "read of tid %d event %d returned %d: %s",
+						thr->tid, i, ret, strerror( errno ) );
+					return PAPI_ESYS;
+				}
+			}
+		}
+
+		if ( ( thr->tid > 0 ) && ( row[0] == thr->last ) &&
+			( syscall( __NR_tgkill, thr->tgid, thr->tid, 0 ) == -1 ) &&
+			( errno == ESRCH ) ) {
+			thr->tid = -thr->tid;
+		}
+		thr->last = row[0];
+		tids[k] = thr->tid;
+	}
+	*num_tids = n;
+
+	return PAPI_OK;
+}
+
 /* Open all events in the control state */
 static int
 open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
@@ -845,7 +1233,13 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 			/* must be a power of 2 (1, 4, 8, 16, etc) or zero. */
 			/* This is required to optimize dealing with        */
 			/* circular buffer wrapping of the mapped pages.    */
-			if (ctl->events[i].sampling) {
+			if (ctl->events[i].attr.sample_type &
+				(PERF_SAMPLE_CALLCHAIN | PERF_SAMPLE_DATA_SRC)) {
+				/* Room for a few deep call chains, or for the  */
+				/* bursts of precise memory samples              */
+				ctl->events[i].nr_mmap_pages = 1 + 8;
+			}
+			else if (ctl->events[i].sampling) {
 				ctl->events[i].nr_mmap_pages = 1 + 2;
 			}
 			else if (_perf_event_vector.cmp_info.fast_counter_read) {
@@ -864,6 +1258,9 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 		}
 	}
 
+	ctl->num_overflow_fds = 0;
+	memset( ctl->overflow_fds, 0, sizeof ( ctl->overflow_fds ) );
+
 	for ( i = 0; i < ctl->num_events; i++ ) {
 
 		/* If sampling is enabled, hook up signal handler */
@@ -876,6 +1273,16 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 				i = ctl->num_events;
 				goto open_pe_cleanup;
 			}
+			add_overflow_fd( ctl, i );
+		}
+	}
+
+	if ( ctl->all_threads ) {
+		ret = open_thread_events( ctl );
+		if ( ret != PAPI_OK ) {
+			close_thread_events( ctl );
+			i = ctl->num_events;
+			goto open_pe_cleanup;
 		}
 	}
 
@@ -946,6 +1353,8 @@ close_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 		SUBDBG("Closing without stopping first\n");
 	}
 
+	close_thread_events( ctl );
+
 	/* Close child events first */
 	/* Is that necessary? -- vmw */
 	for( i=0; i<ctl->num_events; i++ ) {
@@ -1050,58 +1459,41 @@ _pe_init_thread( hwd_context_t *hwd_ctx )
 /**************************** COUNTER RELATED *******************/
 
 
-/* reset the hardware counters */
-/* Note: PAPI_reset() does not necessarily call this */
-/* unless the events are actually running.           */
+/* Reset the kernel counts of all events in the control state */
 static int
-_pe_reset( hwd_context_t *ctx, hwd_control_state_t *ctl )
+reset_pe_events( pe_control_t *pe_ctl )
 {
 	int i, ret;
-	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
+	int group_ioctl = use_group_ioctl( pe_ctl );
 
-	( void ) ctx;			 /*unused */
-
-	/* We need to reset all of the events, not just the group leaders */
+	/* We need to reset all of the events, not just the group leaders. */
+	/* With PERF_IOC_FLAG_GROUP one ioctl on the leader does the group. */
 	for( i = 0; i < pe_ctl->num_events; i++ ) {
-		if (_perf_event_vector.cmp_info.fast_counter_read) {
-			ret = ioctl( pe_ctl->events[i].event_fd, 
-					PERF_EVENT_IOC_RESET, NULL );
-			pe_ctl->reset_counts[i] = mmap_read_reset_count(
-					pe_ctl->events[i].mmap_buf);
-			pe_ctl->reset_flag = 1;
-		} else {
-			ret = ioctl( pe_ctl->events[i].event_fd, 
-					PERF_EVENT_IOC_RESET, NULL );
+		if ( group_ioctl && ( pe_ctl->events[i].group_leader_fd != -1 ) ) {
+			continue;
 		}
+		ret = ioctl( pe_ctl->events[i].event_fd,
+				PERF_EVENT_IOC_RESET,
+				group_ioctl ? PERF_IOC_FLAG_GROUP : 0 );
 		if ( ret == -1 ) {
-			PAPIERROR("ioctl(%d, PERF_EVENT_IOC_RESET, NULL) "
+			PAPIERROR("ioctl(%d, PERF_EVENT_IOC_RESET, %d) "
 					"returned error, Linux says: %s",
 					pe_ctl->events[i].event_fd,
+					group_ioctl,
 					strerror( errno ) );
 			return PAPI_ESYS;
 		}
 	}
 
-	return PAPI_OK;
-}
-
+	if ( pe_ctl->num_threads ) {
+		ret = ioctl_thread_events( pe_ctl, 0, PERF_EVENT_IOC_RESET, 0 );
+		if ( ret != PAPI_OK ) return ret;
+	}
 
-/* write (set) the hardware counters */
-/* Currently we do not support this.   */
-static int
-_pe_write( hwd_context_t *ctx, hwd_control_state_t *ctl,
-		long long *from )
-{
-	( void ) ctx;			 /*unused */
-	( void ) ctl;			 /*unused */
-	( void ) from;			 /*unused */
-	/*
-	 * Counters cannot be written.  Do we need to virtualize the
-	 * counters so that they can be written, or perhaps modify code so that
-	 * they can be written? FIXME ?
-	 */
+	/* The kernel counts start over, so do the virtual ones */
+	memset( pe_ctl->offsets, 0, sizeof ( pe_ctl->offsets ) );
 
-	return PAPI_ENOSUPP;
+	return PAPI_OK;
 }
 
 /*
@@ -1123,19 +1515,9 @@ _pe_write( hwd_context_t *ctx, hwd_control_state_t *ctl,
 /* Because of this we don't need separate multiplexing support */
 /* This is all handled by mmap_read_self() */
 static int
-_pe_rdpmc_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
-		long long **events, int flags )
+_pe_rdpmc_read( pe_control_t *pe_ctl )
 {
-	long long papi_pe_buffer[READ_BUFFER_SIZE];
-
-	SUBDBG("ENTER: ctx: %p, ctl: %p, events: %p, flags: %#x\n",
-		ctx, ctl, events, flags);
-
-	( void ) flags;			/*unused */
-	( void ) ctx;			/*unused */
-	( void ) papi_pe_buffer;	/*unused */
 	int i;
-	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
 	unsigned long long count, enabled = 0, running = 0, adjusted;
 	int errors=0;
 
@@ -1143,8 +1525,7 @@ _pe_rdpmc_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
 	for ( i = 0; i < pe_ctl->num_events; i++ ) {
 
 		count = mmap_read_self(pe_ctl->events[i].mmap_buf,
-						pe_ctl->reset_flag,
-						pe_ctl->reset_counts[i],
+						0, 0,
 						&enabled,&running);
 
 		if (count==0xffffffffffffffffULL) {
@@ -1164,16 +1545,12 @@ _pe_rdpmc_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
 			/* This should not happen, but we have had it reported */
 			SUBDBG("perf_event kernel bug(?) count, enabled, "
 				"running: %lld, %lld, %lld\n",
-				papi_pe_buffer[0],enabled,running);
+				count,enabled,running);
 
 		}
 
 		pe_ctl->counts[i] = count;
 	}
-	/* point PAPI to the values we read */
-	*events = pe_ctl->counts;
-
-	SUBDBG("EXIT: *events: %p\n", *events);
 
 	if (errors) return PAPI_ESYS;
 
@@ -1291,17 +1668,45 @@ _pe_read_nogroup( pe_control_t *pe_ctl ) {
 
 }
 
+/* Add the counts of the other threads, with PAPI_INHERIT_THREADS.    */
+/* Their events are inherited, so not grouped on read either.          */
 static int
-_pe_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
-	       long long **events, int flags )
+read_thread_events( pe_control_t *pe_ctl )
 {
-	SUBDBG("ENTER: ctx: %p, ctl: %p, events: %p, flags: %#x\n",
-		ctx, ctl, events, flags);
+	int t, i, ret;
+	long long count;
 
-	( void ) flags;			 /*unused */
-	( void ) ctx;			 /*unused */
+	for ( t = 0; t < pe_ctl->num_threads; t++ ) {
+		for ( i = 0; i < pe_ctl->num_events; i++ ) {
+			ret = read( pe_ctl->thread_fds[t * pe_ctl->num_events + i],
+				&count, sizeof ( count ) );
+			if ( ret != sizeof ( count ) ) {
+				PAPIERROR( "read of thread %d event %d returned %d: %s",
+					t, i, ret, strerror( errno ) );
+				return PAPI_ESYS;
+			}
+			pe_ctl->counts[i] += count;
+		}
+	}
+
+	return PAPI_OK;
+}
+
+/* Whether the counters of pe_ctl can be read with rdpmc */
+static int
+use_rdpmc( pe_control_t *pe_ctl )
+{
+	return (_perf_event_vector.cmp_info.fast_counter_read) &&
+		(!pe_ctl->inherit) &&
+		(!pe_ctl->attached) &&
+		(pe_ctl->granularity==PAPI_GRN_THR);
+}
+
+/* Read the kernel counts of all events into pe_ctl->counts */
+static int
+read_pe_counters( pe_control_t *pe_ctl )
+{
 	int i, j, ret = -1;
-	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
 	long long papi_pe_buffer[READ_BUFFER_SIZE];
 	int result;
 
@@ -1309,23 +1714,24 @@ _pe_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
 	/* FIXME: we fallback to slow reads if *any* event in eventset fails */
 	/*        in theory we could only fall back for the one event        */
 	/*        but that makes the code more complicated.                  */
-	if ((_perf_event_vector.cmp_info.fast_counter_read) &&
-		(!pe_ctl->inherit) &&
-		(!pe_ctl->attached) &&
-		(pe_ctl->granularity==PAPI_GRN_THR)) {
-		result=_pe_rdpmc_read( ctx, ctl, events, flags);
+	if (use_rdpmc(pe_ctl)) {
+		result=_pe_rdpmc_read( pe_ctl );
 		/* if successful we are done, otherwise fall back to read */
 		if (result==PAPI_OK) return PAPI_OK;
 	}
 
 	/* Handle case where we are multiplexing */
 	if (pe_ctl->multiplexed) {
-		_pe_read_multiplexed(pe_ctl);
+		return _pe_read_multiplexed(pe_ctl);
 	}
 
 	/* Handle cases where we cannot use FORMAT GROUP */
-	else if (bug_format_group() || pe_ctl->inherit) {
-		_pe_read_nogroup(pe_ctl);
+	if (bug_format_group() || pe_ctl->inherit) {
+		ret = _pe_read_nogroup(pe_ctl);
+		if ((ret == PAPI_OK) && (pe_ctl->all_threads)) {
+			ret = read_thread_events(pe_ctl);
+		}
+		return ret;
 	}
 
 	/* Handle common case where we are using FORMAT_GROUP	*/
@@ -1335,46 +1741,69 @@ _pe_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
 	/* of 64-bit values.  The first is the total number of    */
 	/* events, followed by the counts for them.               */
 
-	else {
-		if (pe_ctl->events[0].group_leader_fd!=-1) {
-			PAPIERROR("Was expecting group leader");
-		}
+	if (pe_ctl->events[0].group_leader_fd!=-1) {
+		PAPIERROR("Was expecting group leader");
+	}
 
-		ret = read( pe_ctl->events[0].event_fd,
-			papi_pe_buffer,
-			sizeof ( papi_pe_buffer ) );
+	ret = read( pe_ctl->events[0].event_fd,
+		papi_pe_buffer,
+		sizeof ( papi_pe_buffer ) );
 
-		if ( ret == -1 ) {
-			PAPIERROR("read returned an error: %s",
-				strerror( errno ));
-			return PAPI_ESYS;
-		}
+	if ( ret == -1 ) {
+		PAPIERROR("read returned an error: %s",
+			strerror( errno ));
+		return PAPI_ESYS;
+	}
 
-		/* we read 1 64-bit value (number of events) then     */
-		/* num_events more 64-bit values that hold the counts */
-		if (ret<(signed)((1+pe_ctl->num_events)*sizeof(long long))) {
-			PAPIERROR("Error! short read");
-			return PAPI_ESYS;
-		}
+	/* we read 1 64-bit value (number of events) then     */
+	/* num_events more 64-bit values that hold the counts */
+	if (ret<(signed)((1+pe_ctl->num_events)*sizeof(long long))) {
+		PAPIERROR("Error! short read");
+		return PAPI_ESYS;
+	}
 
-		SUBDBG("read: fd: %2d, tid: %ld, cpu: %d, ret: %d\n",
-			pe_ctl->events[0].event_fd,
-			(long)pe_ctl->tid, pe_ctl->events[0].cpu, ret);
+	SUBDBG("read: fd: %2d, tid: %ld, cpu: %d, ret: %d\n",
+		pe_ctl->events[0].event_fd,
+		(long)pe_ctl->tid, pe_ctl->events[0].cpu, ret);
 
-		for(j=0;j<ret/8;j++) {
-			SUBDBG("read %d: %lld\n",j,papi_pe_buffer[j]);
-		}
+	for(j=0;j<ret/8;j++) {
+		SUBDBG("read %d: %lld\n",j,papi_pe_buffer[j]);
+	}
 
-		/* Make sure the kernel agrees with how many events we have */
-		if (papi_pe_buffer[0]!=pe_ctl->num_events) {
-			PAPIERROR("Error!  Wrong number of events");
-			return PAPI_ESYS;
-		}
+	/* Make sure the kernel agrees with how many events we have */
+	if (papi_pe_buffer[0]!=pe_ctl->num_events) {
+		PAPIERROR("Error!  Wrong number of events");
+		return PAPI_ESYS;
+	}
 
-		/* put the count values in their proper location */
-		for(i=0;i<pe_ctl->num_events;i++) {
-			pe_ctl->counts[i] = papi_pe_buffer[1+i];
-		}
+	/* put the count values in their proper location */
+	for(i=0;i<pe_ctl->num_events;i++) {
+		pe_ctl->counts[i] = papi_pe_buffer[1+i];
+	}
+
+	return PAPI_OK;
+}
+
+static int
+_pe_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
+	       long long **events, int flags )
+{
+	SUBDBG("ENTER: ctx: %p, ctl: %p, events: %p, flags: %#x\n",
+		ctx, ctl, events, flags);
+
+	( void ) flags;			 /*unused */
+	( void ) ctx;			 /*unused */
+	int i, ret;
+	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
+
+	ret = read_pe_counters( pe_ctl );
+	if ( ret != PAPI_OK ) {
+		return ret;
+	}
+
+	/* Apply the virtual reset/write offsets */
+	for( i = 0; i < pe_ctl->num_events; i++ ) {
+		pe_ctl->counts[i] += pe_ctl->offsets[i];
 	}
 
 	/* point PAPI to the values we read */
@@ -1385,6 +1814,76 @@ _pe_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
 	return PAPI_OK;
 }
 
+/* Reset the counters.                                        */
+/* Note: PAPI_reset() does not necessarily call this          */
+/* unless the events are actually running.                    */
+/* With rdpmc the kernel counts are left alone: we remember    */
+/* their current values and subtract them on read, which makes */
+/* this a pure userspace operation.  Otherwise reading the     */
+/* counts costs more than the kernel reset, and when           */
+/* multiplexing the scaled counts do not subtract cleanly, so  */
+/* we ask the kernel to reset them.                            */
+static int
+_pe_reset( hwd_context_t *ctx, hwd_control_state_t *ctl )
+{
+	int i, ret;
+	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
+
+	( void ) ctx;			 /*unused */
+
+	if (pe_ctl->multiplexed || !use_rdpmc( pe_ctl )) {
+		return reset_pe_events( pe_ctl );
+	}
+
+	ret = read_pe_counters( pe_ctl );
+	if ( ret != PAPI_OK ) {
+		return reset_pe_events( pe_ctl );
+	}
+
+	for( i = 0; i < pe_ctl->num_events; i++ ) {
+		pe_ctl->offsets[i] = -pe_ctl->counts[i];
+	}
+
+	/* the attached tids are read on their own, without offsets */
+	if ( pe_ctl->num_threads && !pe_ctl->all_threads ) {
+		return ioctl_thread_events( pe_ctl, 0, PERF_EVENT_IOC_RESET, 0 );
+	}
+
+	return PAPI_OK;
+}
+
+
+/* write (set) the hardware counters */
+/* The counters cannot be written, so they are virtualized the */
+/* same way as for _pe_reset(). from[] is in counter order,    */
+/* PAPI_write() maps the events of the EventSet onto it. The   */
+/* scaled counts of a multiplexed set would drift away from an */
+/* offset, so those cannot be written.                         */
+static int
+_pe_write( hwd_context_t *ctx, hwd_control_state_t *ctl,
+		long long *from )
+{
+	int i, ret;
+	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
+
+	( void ) ctx;			 /*unused */
+
+	if ( pe_ctl->multiplexed ) {
+		return PAPI_ECNFLCT;
+	}
+
+	ret = read_pe_counters( pe_ctl );
+	if ( ret != PAPI_OK ) {
+		return ret;
+	}
+
+	for( i = 0; i < pe_ctl->num_events; i++ ) {
+		pe_ctl->offsets[i] = from[i] - pe_ctl->counts[i];
+	}
+
+	return PAPI_OK;
+}
+
 #if (OBSOLETE_WORKAROUNDS==1)
 /* On kernels before 2.6.33 the TOTAL_TIME_ENABLED and TOTAL_TIME_RUNNING */
 /* fields are always 0 unless the counter is disabled.  So if we are on   */
@@ -1454,7 +1953,7 @@ _pe_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
 	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
 
 	/* Reset the counters first.  Is this necessary? */
-	ret = _pe_reset( pe_ctx, pe_ctl );
+	ret = reset_pe_events( pe_ctl );
 	if ( ret ) {
 		return ret;
 	}
@@ -1466,11 +1965,8 @@ _pe_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
 			SUBDBG("ioctl(enable): fd: %d\n",
 				pe_ctl->events[i].event_fd);
 			ret=ioctl( pe_ctl->events[i].event_fd,
-				PERF_EVENT_IOC_ENABLE, NULL) ;
-			if (_perf_event_vector.cmp_info.fast_counter_read) {
-				pe_ctl->reset_counts[i] = 0LL;
-				pe_ctl->reset_flag = 0;
-			}
+				PERF_EVENT_IOC_ENABLE,
+				use_group_ioctl( pe_ctl ) ? PERF_IOC_FLAG_GROUP : 0 );
 
 			/* ioctls always return -1 on failure */
 			if (ret == -1) {
@@ -1487,6 +1983,11 @@ _pe_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
 		return PAPI_EBUG;
 	}
 
+	if (pe_ctl->num_threads) {
+		ret = ioctl_thread_events( pe_ctl, 0, PERF_EVENT_IOC_ENABLE, 1 );
+		if (ret != PAPI_OK) return ret;
+	}
+
 	pe_ctx->state |= PERF_EVENTS_RUNNING;
 
 	return PAPI_OK;
@@ -1508,7 +2009,8 @@ _pe_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
 	for ( i = 0; i < pe_ctl->num_events; i++ ) {
 		if ( pe_ctl->events[i].group_leader_fd == -1 ) {
 			ret=ioctl( pe_ctl->events[i].event_fd,
-				PERF_EVENT_IOC_DISABLE, NULL);
+				PERF_EVENT_IOC_DISABLE,
+				use_group_ioctl( pe_ctl ) ? PERF_IOC_FLAG_GROUP : 0 );
 			if ( ret == -1 ) {
 				PAPIERROR( "ioctl(%d, PERF_EVENT_IOC_DISABLE, NULL) "
 					"returned error, Linux says: %s",
@@ -1518,6 +2020,11 @@ _pe_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
 		}
 	}
 
+	if (pe_ctl->num_threads) {
+		ret = ioctl_thread_events( pe_ctl, 0, PERF_EVENT_IOC_DISABLE, 1 );
+		if (ret != PAPI_OK) return PAPI_EBUG;
+	}
+
 	pe_ctx->state &= ~PERF_EVENTS_RUNNING;
 
 	SUBDBG( "EXIT:\n");
@@ -1580,6 +2087,10 @@ _pe_update_control_state( hwd_control_state_t *ctl,
 						ntv_idx = j;
 					}
 				}
+				/* an event enumerated from the event cache may not be allocated yet */
+				if (ntv_idx == -1) {
+					ntv_idx = _pe_libpfm4_ntv_find_event((unsigned)(native[i].ni_papi_code), pe_ctx->event_table);
+				}
 			}
 
 			/* if native index is still negative, we did not find event we wanted so just return error */
@@ -1676,6 +2187,10 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
    switch ( code ) {
       case PAPI_MULTIPLEX:
 	   pe_ctl = ( pe_control_t * ) ( option->multiplex.ESI->ctl_state );
+	   /* the events of the other threads are grouped like ours */
+	   if (pe_ctl->all_threads) {
+	      return PAPI_ECNFLCT;
+	   }
 	   ret = check_permissions( pe_ctl->tid, pe_ctl->cpu, pe_ctl->domain,
 				    pe_ctl->granularity,
 				    1, pe_ctl->inherit );
@@ -1694,6 +2209,9 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
 
       case PAPI_ATTACH:
 	   pe_ctl = ( pe_control_t * ) ( option->attach.ESI->ctl_state );
+	   if (pe_ctl->all_threads) {
+	      return PAPI_ECNFLCT;
+	   }
 	   ret = check_permissions( option->attach.tid, pe_ctl->cpu,
 				  pe_ctl->domain, pe_ctl->granularity,
 				  pe_ctl->multiplexed,
@@ -1784,6 +2302,12 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
            if (ret != PAPI_OK) {
 	      return ret;
 	   }
+	   /* the threads of the process are ours to open */
+	   if ((option->inherit.inherit == PAPI_INHERIT_THREADS) &&
+	       ((pe_ctl->attached) || (pe_ctl->multiplexed) ||
+	        (pe_ctl->granularity == PAPI_GRN_SYS))) {
+	      return PAPI_ECNFLCT;
+	   }
 	   /* looks like we are allowed, so set the requested inheritance */
 	   if (option->inherit.inherit) {
 	      /* children will inherit counters */
@@ -1792,7 +2316,27 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
 	      /* children won't inherit counters */
 	      pe_ctl->inherit = 0;
 	   }
-	   return PAPI_OK;
+	   pe_ctl->all_threads =
+	      (option->inherit.inherit == PAPI_INHERIT_THREADS);
+
+	   /* reopen events already added, with or without the threads */
+	   return _pe_update_control_state( pe_ctl, NULL,
+						pe_ctl->num_events, pe_ctx );
+
+      case PAPI_ATTACH_TIDS:
+	   pe_ctl = (pe_control_t *) ( option->tids.ESI->ctl_state );
+	   return attach_tids( pe_ctx, pe_ctl, option->tids.tids,
+				option->tids.num_tids );
+
+      case PAPI_DETACH_TIDS:
+	   pe_ctl = (pe_control_t *) ( option->tids.ESI->ctl_state );
+	   return detach_tids( pe_ctl, option->tids.tids,
+				option->tids.num_tids );
+
+      case PAPI_READ_TIDS:
+	   pe_ctl = (pe_control_t *) ( option->tids.ESI->ctl_state );
+	   return read_tids( pe_ctl, option->tids.first, option->tids.tids,
+			     option->tids.counts, &option->tids.num_tids );
 
       case PAPI_DATA_ADDRESS:
 	   return PAPI_ENOSUPP;
@@ -1912,48 +2456,22 @@ _pe_ntv_code_to_info(unsigned int EventCode,
 /*********************** SAMPLING / PROFILING *******************/
 
 
-/* Find a native event specified by a profile index */
-static int
-find_profile_index( EventSetInfo_t *ESI, int evt_idx, int *flags,
-		unsigned int *native_index, int *profile_index )
-{
-	int pos, esi_index, count;
-
-	for ( count = 0; count < ESI->profile.event_counter; count++ ) {
-		esi_index = ESI->profile.EventIndex[count];
-		pos = ESI->EventInfoArray[esi_index].pos[0];
-
-		if ( pos == evt_idx ) {
-			*profile_index = count;
-			*native_index = ESI->NativeInfoArray[pos].ni_event &
-					PAPI_NATIVE_AND_MASK;
-			*flags = ESI->profile.flags;
-			SUBDBG( "Native event %d is at profile index %d, flags %d\n",
-				*native_index, *profile_index, *flags );
-			return PAPI_OK;
-		}
-	}
-	PAPIERROR( "wrong count: %d vs. ESI->profile.event_counter %d",
-			count, ESI->profile.event_counter );
-	return PAPI_EBUG;
-}
-
-
-/* What exactly does this do? */
+/* Hand the samples in the mmap buffer of evt_idx to its profile */
 static int
 process_smpl_buf( int evt_idx, ThreadInfo_t **thr, int cidx )
 {
-	int ret, flags, profile_index;
-	unsigned native_index;
+	EventSetInfo_t *ESI = ( *thr )->running_eventset[cidx];
+	int profile_index;
 	pe_control_t *ctl;
 
-	ret = find_profile_index( ( *thr )->running_eventset[cidx], evt_idx,
-			&flags, &native_index, &profile_index );
-	if ( ret != PAPI_OK ) {
-		return ret;
+	/* Mapped by PAPI_start() */
+	profile_index = ESI->profile.PosIndex[evt_idx];
+	if ( profile_index < 0 ) {
+		PAPIERROR( "event %d is not profiled", evt_idx );
+		return PAPI_EBUG;
 	}
 
-	ctl= (*thr)->running_eventset[cidx]->ctl_state;
+	ctl= ESI->ctl_state;
 
 	mmap_read( cidx, thr, &(ctl->events[evt_idx]), profile_index );
 
@@ -1973,7 +2491,6 @@ _pe_dispatch_timer( int n, hwd_siginfo_t *info, void *uc)
 	int found_evt_idx = -1, fd = info->si_fd;
 	vptr_t address;
 	ThreadInfo_t *thread = _papi_hwi_lookup_thread( 0 );
-	int i;
 	pe_control_t *ctl;
 	int cidx = _perf_event_vector.cmp_info.CmpIdx;
 
@@ -2020,12 +2537,7 @@ _pe_dispatch_timer( int n, hwd_siginfo_t *info, void *uc)
 	ctl= thread->running_eventset[cidx]->ctl_state;
 
 	/* See if the fd is one that's part of the this thread's context */
-	for( i=0; i < ctl->num_events; i++ ) {
-		if ( fd == ctl->events[i].event_fd ) {
-			found_evt_idx = i;
-			break;
-		}
-	}
+	found_evt_idx = find_overflow_fd( ctl, fd );
 
 	if ( found_evt_idx == -1 ) {
 		PAPIERROR( "Unable to find fd %d among the open event fds "
@@ -2033,8 +2545,12 @@ _pe_dispatch_timer( int n, hwd_siginfo_t *info, void *uc)
 		return;
 	}
 
-	if (ioctl( fd, PERF_EVENT_IOC_DISABLE, NULL ) == -1 ) {
-		PAPIERROR("ioctl(PERF_EVENT_IOC_DISABLE) failed");
+	/* With a refresh count the kernel already disabled the event */
+	/* when it overflowed, PERF_EVENT_IOC_REFRESH below rearms it */
+	if ( PAPI_REFRESH_VALUE == 0 ) {
+		if (ioctl( fd, PERF_EVENT_IOC_DISABLE, NULL ) == -1 ) {
+			PAPIERROR("ioctl(PERF_EVENT_IOC_DISABLE) failed");
+		}
 	}
 
 	if ( ( thread->running_eventset[cidx]->state & PAPI_PROFILING ) &&
@@ -2196,7 +2712,8 @@ _pe_set_overflow( EventSetInfo_t *ESI, int EventIndex, int threshold )
 		/* counter overflow (not mmap page overflow).                 */
 		ctl->events[evt_idx].attr.wakeup_events = 1;
 		/* We need the IP to pass to the overflow handler */
-		ctl->events[evt_idx].attr.sample_type = PERF_SAMPLE_IP;
+		/* (and maybe the call chain, see _pe_set_profile) */
+		ctl->events[evt_idx].attr.sample_type |= PERF_SAMPLE_IP;
 	}
 
 
@@ -2276,7 +2793,12 @@ _pe_set_profile( EventSetInfo_t *ESI, int EventIndex, int threshold )
 //		ctl->events[evt_idx].nr_mmap_pages = 0;
 
 		/* no longer sample on IP */
-		ctl->events[evt_idx].attr.sample_type &= ~PERF_SAMPLE_IP;
+		ctl->events[evt_idx].attr.sample_type &=
+			~( PERF_SAMPLE_IP | PERF_SAMPLE_CALLCHAIN | PERF_SAMPLE_ADDR |
+			   PERF_SAMPLE_WEIGHT | PERF_SAMPLE_DATA_SRC );
+		ctl->events[evt_idx].attr.exclude_callchain_kernel = 0;
+		ctl->events[evt_idx].attr.mmap = 0;
+		ctl->events[evt_idx].attr.mmap2 = 0;
 
 		/* Clear any residual overflow flags */
 		/* ??? old warning says "This should be handled somewhere else" */
@@ -2303,6 +2825,38 @@ _pe_set_profile( EventSetInfo_t *ESI, int EventIndex, int threshold )
 			/* Linux currently does not have this ability. FIXME */
 			return PAPI_ENOSUPP;
 		}
+		/* The user part of the call chain, kernel frames could */
+		/* not be attributed anyway.                            */
+		if ( ESI->profile.flags & PAPI_PROFIL_CALLCHAIN ) {
+			ctl->events[evt_idx].attr.sample_type |=
+				PERF_SAMPLE_CALLCHAIN;
+			ctl->events[evt_idx].attr.exclude_callchain_kernel = 1;
+		}
+		else {
+			ctl->events[evt_idx].attr.sample_type &=
+				~PERF_SAMPLE_CALLCHAIN;
+		}
+		/* Data address, latency and source of precise memory  */
+		/* events, PEBS load latency or IBS                    */
+		if ( ESI->profile.flags & PAPI_PROFIL_DATA_SRC ) {
+			if ( _papi_os_info.os_version < LINUX_VERSION(3,10,0) ) {
+				return PAPI_ENOSUPP;
+			}
+			ctl->events[evt_idx].attr.sample_type |=
+				PERF_SAMPLE_ADDR | PERF_SAMPLE_WEIGHT |
+				PERF_SAMPLE_DATA_SRC;
+		}
+		else {
+			ctl->events[evt_idx].attr.sample_type &=
+				~( PERF_SAMPLE_ADDR | PERF_SAMPLE_WEIGHT |
+				   PERF_SAMPLE_DATA_SRC );
+		}
+		/* Executable mmaps keep the shared library map up to  */
+		/* date without re-reading /proc/self/maps             */
+		if ( _papi_os_info.os_version >= LINUX_VERSION(3,16,0) ) {
+			ctl->events[evt_idx].attr.mmap = 1;
+			ctl->events[evt_idx].attr.mmap2 = 1;
+		}
 		ctl->events[evt_idx].profiling=1;
 	}
 
@@ -2688,6 +3242,8 @@ papi_vector_t _perf_event_vector = {
       .attach_must_ptrace = 1,
       .cpu = 1,
       .inherit = 1,
+      .inherit_threads = 1,
+      .attach_tids = 1,
       .cntr_umasks = 1,
 
 	.kernel_multiplex = 1,
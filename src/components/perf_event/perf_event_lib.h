@@ -4,6 +4,9 @@
 /* you run out of fds                                           */
 #define PERF_EVENT_MAX_MPX_COUNTERS 384
 
+/* Slots of the fd to event table of the overflow handler, a power of 2 */
+#define PERF_EVENT_OVERFLOW_FDS 64
+
 /* We really don't need fancy definitions for these */
 
 typedef struct
@@ -22,6 +25,13 @@ typedef struct
 } pe_event_info_t;
 
 
+/* A thread with a group of the events of its own */
+typedef struct {
+  pid_t tid;                      /* negated once it has exited        */
+  pid_t tgid;                     /* its process                       */
+  long long last;                 /* leader count at the last read     */
+} pe_thread_t;
+
 typedef struct {
   int num_events;                 /* number of events in control state */
   unsigned int domain;            /* control-state wide domain         */
@@ -31,13 +41,19 @@ typedef struct {
   unsigned int inherit;           /* inherit enable                    */
   unsigned int overflow_signal;   /* overflow signal                   */
   unsigned int attached;          /* attached to a process             */
+  unsigned int all_threads;       /* PAPI_INHERIT_THREADS              */
   int cidx;                       /* current component                 */
   int cpu;                        /* which cpu to measure              */
   pid_t tid;                      /* thread we are monitoring          */
+  int num_threads;                /* of all_threads or attach_tids     */
+  int max_threads;                /* room in threads and thread_fds    */
+  pe_thread_t *threads;
+  int *thread_fds;                /* num_events fds for each of them   */
+  int num_overflow_fds;           /* sampling events with a signal     */
+  short overflow_fds[PERF_EVENT_OVERFLOW_FDS]; /* hashed by fd: event index + 1, 0 is empty */
   pe_event_info_t events[PERF_EVENT_MAX_MPX_COUNTERS];
   long long counts[PERF_EVENT_MAX_MPX_COUNTERS];
-  unsigned int reset_flag;
-  long long reset_counts[PERF_EVENT_MAX_MPX_COUNTERS];
+  long long offsets[PERF_EVENT_MAX_MPX_COUNTERS]; /* virtual reset/write */
 } pe_control_t;
 
 
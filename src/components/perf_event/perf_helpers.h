@@ -453,12 +453,78 @@ struct lost_event {
 	uint64_t id;
 	uint64_t lost;
 };
+struct mmap2_event {
+	struct perf_event_header header;
+	uint32_t pid, tid;
+	uint64_t addr;
+	uint64_t len;
+	uint64_t pgoff;
+	uint32_t maj, min;
+	uint64_t ino;
+	uint64_t ino_generation;
+	uint32_t prot, flags;
+	/* followed by the NUL padded file name, read from the ring buffer */
+};
 typedef union event_union {
 	struct perf_event_header header;
 	struct ip_event ip;
 	struct lost_event lost;
+	struct mmap2_event mmap2;
 } perf_sample_event_t;
 
+/* Hand a PERF_SAMPLE_IP | PERF_SAMPLE_CALLCHAIN sample at offset  */
+/* (just past its header) to the profile code. Records are u64      */
+/* aligned and the data area is a power of two, so no word straddles */
+/* the end of the buffer.                                            */
+static void
+mmap_read_callchain( int cidx, ThreadInfo_t **thr, pe_event_info_t *pe,
+                     unsigned char *data, uint64_t offset, int profile_index )
+{
+	vptr_t chain[PAPI_PROFIL_MAX_DEPTH];
+	uint64_t ip, nr, addr, i;
+	int depth = 0;
+
+	ip = *( uint64_t * ) &data[offset & pe->mask];
+	offset += sizeof( uint64_t );
+	nr = *( uint64_t * ) &data[offset & pe->mask];
+	offset += sizeof( uint64_t );
+
+	for( i = 0; i < nr && depth < PAPI_PROFIL_MAX_DEPTH; i++ ) {
+		addr = *( uint64_t * ) &data[offset & pe->mask];
+		offset += sizeof( uint64_t );
+		/* Skip the PERF_CONTEXT_* markers between kernel and user frames */
+		if ( addr >= ( uint64_t ) PERF_CONTEXT_MAX ) continue;
+		chain[depth++] = ( vptr_t ) ( unsigned long ) addr;
+	}
+	if ( depth == 0 ) {
+		chain[depth++] = ( vptr_t ) ( unsigned long ) ip;
+	}
+
+	_papi_hwi_dispatch_profile_chain( ( *thr )->running_eventset[cidx],
+		chain, depth, 0, profile_index );
+}
+
+/* Hand a PERF_SAMPLE_IP | PERF_SAMPLE_ADDR | PERF_SAMPLE_WEIGHT |  */
+/* PERF_SAMPLE_DATA_SRC sample at offset to the profile code.        */
+static void
+mmap_read_memory( int cidx, ThreadInfo_t **thr, pe_event_info_t *pe,
+                  unsigned char *data, uint64_t offset, int profile_index )
+{
+	uint64_t ip, addr, weight, data_src;
+
+	ip = *( uint64_t * ) &data[offset & pe->mask];
+	offset += sizeof( uint64_t );
+	addr = *( uint64_t * ) &data[offset & pe->mask];
+	offset += sizeof( uint64_t );
+	weight = *( uint64_t * ) &data[offset & pe->mask];
+	offset += sizeof( uint64_t );
+	data_src = *( uint64_t * ) &data[offset & pe->mask];
+
+	_papi_hwi_dispatch_profile_memory( ( *thr )->running_eventset[cidx],
+		( vptr_t ) ( unsigned long ) ip, ( vptr_t ) ( unsigned long ) addr,
+		weight, data_src, profile_index );
+}
+
 /* Should re-write with comments if we ever figure out what's */
 /* going on here.                                             */
 static void
@@ -482,6 +548,7 @@ mmap_read( int cidx, ThreadInfo_t **thr, pe_event_info_t *pe,
 		perf_sample_event_t *event = ( perf_sample_event_t * )& data[old & pe->mask];
 		perf_sample_event_t event_copy;
 		size_t size = event->header.size;
+		uint64_t record = old;
 
 		/* Event straddles the mmap boundary -- header should always */
 		/* be inside due to u64 alignment of output.                 */
@@ -507,11 +574,41 @@ mmap_read( int cidx, ThreadInfo_t **thr, pe_event_info_t *pe,
 
 		switch ( event->header.type ) {
 			case PERF_RECORD_SAMPLE:
+				if ( pe->attr.sample_type & PERF_SAMPLE_DATA_SRC ) {
+					mmap_read_memory( cidx, thr, pe, data,
+						record + sizeof( struct perf_event_header ),
+						profile_index );
+					break;
+				}
+				if ( pe->attr.sample_type & PERF_SAMPLE_CALLCHAIN ) {
+					mmap_read_callchain( cidx, thr, pe, data,
+						record + sizeof( struct perf_event_header ),
+						profile_index );
+					break;
+				}
 				_papi_hwi_dispatch_profile( ( *thr )->running_eventset[cidx],
 					( vptr_t ) ( unsigned long ) event->ip.ip,
 					0, profile_index );
 				break;
 
+			case PERF_RECORD_MMAP2:
+				/* The name is not copied with a straddling record, */
+				/* it is passed in the two pieces around the wrap    */
+				if ( ( event->mmap2.prot & PROT_EXEC ) &&
+					( size > sizeof ( struct mmap2_event ) ) ) {
+					uint64_t name = ( record + sizeof ( struct mmap2_event ) )
+						& pe->mask;
+					size_t len = size - sizeof ( struct mmap2_event );
+					size_t first = min( len, pe->mask + 1 - name );
+					_papi_hwi_shlib_note_mmap(
+						( vptr_t ) ( unsigned long ) event->mmap2.addr,
+						( vptr_t ) ( unsigned long ) ( event->mmap2.addr +
+							event->mmap2.len ),
+						( const char * ) &data[name], first,
+						( const char * ) data, len - first );
+				}
+				break;
+
 			case PERF_RECORD_LOST:
 				SUBDBG( "Warning: because of a mmap buffer overrun, %" PRId64
 					" events were lost.\n"
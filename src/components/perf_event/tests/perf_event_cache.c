@@ -0,0 +1,240 @@
+/*
+ * This tests the native event cache of the perf_event component
+ *
+ * The native events are listed and looked up without a cache, with a
+ * cache being built and with the cache built, and must come out with
+ * the same names and codes each time. Every encoding stored in the
+ * cache must be the one libpfm4 gives for the event name.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "perfmon/pfmlib_perf_event.h"
+#include "../pe_event_cache.h"
+
+#define MAX_EVENTS 20000
+
+struct event_list {
+	int num;
+	int codes[MAX_EVENTS];
+	int lookups[MAX_EVENTS];
+	char names[MAX_EVENTS][PAPI_MAX_STR_LEN];
+};
+
+/* List the native events of perf_event and look each one up by name */
+static void
+list_events( struct event_list *list )
+{
+	int retval, cidx, code = PAPI_NATIVE_MASK;
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	cidx = PAPI_get_component_index( "perf_event" );
+	if ( cidx < 0 ) {
+		test_skip( __FILE__, __LINE__, "perf_event component not found", 0 );
+	}
+
+	list->num = 0;
+	retval = PAPI_enum_cmp_event( &code, PAPI_ENUM_FIRST, cidx );
+	while ( ( retval == PAPI_OK ) && ( list->num < MAX_EVENTS ) ) {
+		list->codes[list->num] = code;
+		retval = PAPI_event_code_to_name( code, list->names[list->num] );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_event_code_to_name", retval );
+		}
+		/* some events are listed but cannot be encoded here */
+		retval = PAPI_event_name_to_code( list->names[list->num],
+				&list->lookups[list->num] );
+		if ( retval != PAPI_OK ) list->lookups[list->num] = retval;
+		list->num++;
+		retval = PAPI_enum_cmp_event( &code, PAPI_ENUM_EVENTS, cidx );
+	}
+}
+
+/* Number of events that differ */
+static int
+compare_lists( struct event_list *a, struct event_list *b, int quiet )
+{
+	int i, errors = 0;
+
+	if ( a->num != b->num ) {
+		if ( !quiet ) printf( "%d events without the cache, %d with it\n",
+				a->num, b->num );
+		return 1;
+	}
+	for ( i = 0; i < a->num; i++ ) {
+		if ( ( a->codes[i] != b->codes[i] ) ||
+		     ( a->lookups[i] != b->lookups[i] ) ||
+		     ( strcmp( a->names[i], b->names[i] ) != 0 ) ) {
+			if ( !quiet ) printf( "%s %#x without the cache, %s %#x with it\n",
+					a->names[i], a->codes[i], b->names[i], b->codes[i] );
+			errors++;
+		}
+	}
+	return errors;
+}
+
+/* Check every entry of every cache file in dir against libpfm4, */
+/* returns the number of files or -1 if an entry differs          */
+static int
+check_encodings( const char *dir, int quiet )
+{
+	const struct pe_cache_header *hdr;
+	const struct pe_cache_entry *entry;
+	struct perf_event_attr attr;
+	pfm_perf_encode_arg_t perf_arg;
+	struct dirent *d;
+	struct stat st;
+	char path[PATH_MAX], *fstr;
+	const char *name;
+	int fd, ret, encoded, files = 0, errors = 0;
+	unsigned int i;
+	void *map;
+	DIR *dp;
+
+	dp = opendir( dir );
+	if ( dp == NULL ) return -1;
+
+	while ( ( d = readdir( dp ) ) != NULL ) {
+		if ( strncmp( d->d_name, PE_CACHE_PREFIX,
+			      strlen( PE_CACHE_PREFIX ) ) != 0 ) continue;
+
+		snprintf( path, sizeof ( path ), "%s/%s", dir, d->d_name );
+		fd = open( path, O_RDONLY );
+		if ( ( fd < 0 ) || ( fstat( fd, &st ) < 0 ) ) {
+			errors++;
+			continue;
+		}
+		map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+		close( fd );
+		if ( map == MAP_FAILED ) {
+			errors++;
+			continue;
+		}
+
+		hdr = map;
+		for ( i = 0; i < hdr->num_events; i++ ) {
+			entry = ( const struct pe_cache_entry * )
+				( ( const char * ) map + hdr->entries_offset ) + i;
+			name = ( const char * ) map + hdr->strings_offset +
+				entry->name_offset;
+
+			if ( entry->found_idx != pfm_find_event( name ) ) {
+				if ( !quiet ) printf( "%s: cached code %#x\n",
+						name, entry->found_idx );
+				errors++;
+			}
+
+			memset( &perf_arg, 0, sizeof ( perf_arg ) );
+			memset( &attr, 0, sizeof ( attr ) );
+			attr.size = sizeof ( attr );
+			fstr = NULL;
+			perf_arg.attr = &attr;
+			perf_arg.fstr = &fstr;
+			ret = pfm_get_os_event_encoding( name, PFM_PLM0 | PFM_PLM3,
+					PFM_OS_PERF_EVENT_EXT, &perf_arg );
+			encoded = ( ret == PFM_SUCCESS ) && ( fstr != NULL );
+			free( fstr );
+
+			if ( ( encoded != entry->encoded ) ||
+			     ( encoded && ( ( perf_arg.cpu != entry->cpu ) ||
+				memcmp( &attr, &entry->attr, sizeof ( attr ) ) ) ) ) {
+				if ( !quiet ) printf( "%s: cached encoding differs\n", name );
+				errors++;
+			}
+		}
+		if ( !quiet ) printf( "%s: %u events checked\n", d->d_name,
+				hdr->num_events );
+		munmap( map, st.st_size );
+		files++;
+	}
+	closedir( dp );
+
+	return errors ? -1 : files;
+}
+
+static void
+remove_dir( const char *dir )
+{
+	struct dirent *d;
+	char path[PATH_MAX];
+	DIR *dp;
+
+	dp = opendir( dir );
+	if ( dp == NULL ) return;
+	while ( ( d = readdir( dp ) ) != NULL ) {
+		if ( d->d_name[0] == '.' ) continue;
+		snprintf( path, sizeof ( path ), "%s/%s", dir, d->d_name );
+		unlink( path );
+	}
+	closedir( dp );
+	rmdir( dir );
+}
+
+int main( int argc, char **argv ) {
+
+	struct event_list *uncached, *cached;
+	char dir[] = "/tmp/papi_event_cache_XXXXXX";
+	int quiet, errors, files;
+
+	quiet = tests_quiet( argc, argv );
+
+	uncached = malloc( sizeof ( struct event_list ) );
+	cached = malloc( sizeof ( struct event_list ) );
+	if ( ( uncached == NULL ) || ( cached == NULL ) ) {
+		test_fail( __FILE__, __LINE__, "malloc", PAPI_ENOMEM );
+	}
+
+	unsetenv( PE_CACHE_ENV );
+	list_events( uncached );
+	PAPI_shutdown(  );
+	if ( !quiet ) printf( "%d events without the cache\n", uncached->num );
+
+	if ( mkdtemp( dir ) == NULL ) {
+		test_fail( __FILE__, __LINE__, "mkdtemp", PAPI_ESYS );
+	}
+
+	/* the first run with the cache builds it, the second maps it */
+	setenv( PE_CACHE_ENV, dir, 1 );
+	list_events( cached );
+	PAPI_shutdown(  );
+	errors = compare_lists( uncached, cached, quiet );
+
+	list_events( cached );
+	errors += compare_lists( uncached, cached, quiet );
+
+	/* libpfm4 is still initialized by PAPI */
+	files = check_encodings( dir, quiet );
+	PAPI_shutdown(  );
+
+	remove_dir( dir );
+	free( uncached );
+	free( cached );
+
+	if ( errors ) {
+		test_fail( __FILE__, __LINE__, "Events differ with the cache", errors );
+	}
+	if ( files < 0 ) {
+		test_fail( __FILE__, __LINE__, "Cached encodings differ", 1 );
+	}
+	if ( files == 0 ) {
+		test_fail( __FILE__, __LINE__, "No cache file written", 1 );
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * This tests PAPI_reset() and PAPI_write() on running perf_event counters
+ *
+ * The counters are virtualized in userspace, so after a write the
+ * values read must continue counting from the values written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "do_loops.h"
+
+#define NUM_EVENTS 2
+
+static char *event_names[NUM_EVENTS] = {
+	"perf::TASK-CLOCK",
+	"perf::PAGE-FAULTS",
+};
+
+/* Touch freshly allocated pages so PAGE-FAULTS has something to count */
+static void
+touch_pages( int pages )
+{
+	char *buffer;
+	int i;
+
+	buffer = malloc( pages * 4096 );
+	if ( buffer == NULL ) return;
+	for ( i = 0; i < pages; i++ ) buffer[i * 4096] = i;
+	free( buffer );
+}
+
+int main( int argc, char **argv ) {
+
+	int retval, i, quiet;
+	int EventSet = PAPI_NULL;
+	long long before[NUM_EVENTS], after[NUM_EVENTS];
+	long long written[NUM_EVENTS] = { 1000000000LL, 5000LL };
+
+	/* Set TESTS_QUIET variable */
+	quiet = tests_quiet( argc, argv );
+
+	/* Init the PAPI library */
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	retval = PAPI_create_eventset( &EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	}
+
+	for ( i = 0; i < NUM_EVENTS; i++ ) {
+		retval = PAPI_add_named_event( EventSet, event_names[i] );
+		if ( retval != PAPI_OK ) {
+			if ( !quiet ) printf( "Could not add %s\n", event_names[i] );
+			test_skip( __FILE__, __LINE__, "PAPI_add_named_event", retval );
+		}
+	}
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	do_flops( NUM_FLOPS );
+	touch_pages( 256 );
+
+	retval = PAPI_read( EventSet, before );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_read", retval );
+	}
+
+	/* A reset brings the counts back near zero */
+	retval = PAPI_reset( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_reset", retval );
+	}
+
+	retval = PAPI_read( EventSet, after );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_read", retval );
+	}
+
+	if ( !quiet ) {
+		printf( "%-20s %16s %16s\n", "Event", "Before reset", "After reset" );
+		for ( i = 0; i < NUM_EVENTS; i++ ) {
+			printf( "%-20s %16lld %16lld\n",
+				event_names[i], before[i], after[i] );
+		}
+	}
+
+	for ( i = 0; i < NUM_EVENTS; i++ ) {
+		if ( ( after[i] < 0 ) || ( after[i] > before[i] ) ) {
+			test_fail( __FILE__, __LINE__, "PAPI_reset did not reset", i );
+		}
+	}
+
+	/* After a write the counts continue from the written values */
+	retval = PAPI_write( EventSet, written );
+	if ( retval == PAPI_ENOSUPP ) {
+		test_skip( __FILE__, __LINE__, "PAPI_write", retval );
+	}
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_write", retval );
+	}
+
+	do_flops( NUM_FLOPS );
+	touch_pages( 256 );
+
+	retval = PAPI_stop( EventSet, after );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	if ( !quiet ) {
+		printf( "%-20s %16s %16s\n", "Event", "Written", "After write" );
+		for ( i = 0; i < NUM_EVENTS; i++ ) {
+			printf( "%-20s %16lld %16lld\n",
+				event_names[i], written[i], after[i] );
+		}
+	}
+
+	for ( i = 0; i < NUM_EVENTS; i++ ) {
+		if ( after[i] < written[i] ) {
+			test_fail( __FILE__, __LINE__, "PAPI_write value lost", i );
+		}
+		/* Far more than a few loops could ever count */
+		if ( after[i] > 2 * written[i] + before[i] ) {
+			test_fail( __FILE__, __LINE__, "PAPI_write value wrong", i );
+		}
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
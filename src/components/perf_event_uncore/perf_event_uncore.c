@@ -14,6 +14,9 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
@@ -34,6 +37,7 @@
 #include "papi_libpfm4_events.h"
 #include "components/perf_event/pe_libpfm4_events.h"
 #include "perfmon/pfmlib.h"
+#include "perfmon/pfmlib_perf_event.h"
 #include PEINCLUDE
 
 /* Linux-specific includes */
@@ -65,6 +69,35 @@ static int our_cidx;
 // something just in case there is programmer error in invoking the function.
 #define HANDLE_STRING_ERROR {fprintf(stderr,"%s:%i unexpected string function error.\n",__FILE__,__LINE__); exit(-1);}
 
+/* Upper bound on the cpus in the cpumask of an uncore PMU, one per package */
+#define PEU_MAX_PACKAGES 64
+
+/* Upper bound on the uncore PMUs whose cpumask is cached */
+#define PEU_MAX_PMUS 256
+
+/* The kernel events of an EventSet are those of pe_control_t. An event */
+/* fanned out over the uncore boxes (agg=) has one per box and package,  */
+/* their counts are combined into the value of the event when read.     */
+typedef struct {
+   pe_control_t pe;                /* first: the control state is used as one */
+   int num_logical;                /* events of the EventSet                  */
+   int logical[PERF_EVENT_MAX_MPX_COUNTERS];  /* event of each kernel event   */
+   char grouped[PERF_EVENT_MAX_MPX_COUNTERS]; /* may join the previous group  */
+   int agg[PERF_EVENT_MAX_MPX_COUNTERS];      /* PE_AGG_* of each event       */
+   long long values[PERF_EVENT_MAX_MPX_COUNTERS]; /* combined counts          */
+} peu_control_t;
+
+/* The cpumask of an uncore PMU, read once: every box of an event with */
+/* agg= needs the one of its PMU                                        */
+typedef struct {
+   uint32_t type;
+   int num_cpus;
+   int cpus[PEU_MAX_PACKAGES];
+} peu_pmu_cpus_t;
+
+static peu_pmu_cpus_t peu_cpus_cache[PEU_MAX_PMUS];
+static int peu_num_cpus_cache = 0;
+
 static int _peu_set_domain( hwd_control_state_t *ctl, int domain);
 static int _peu_shutdown_component( void );
 
@@ -307,7 +340,9 @@ static int
 open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 {
 
+   peu_control_t *peu_ctl = ( peu_control_t *) ctl;
    int i, ret = PAPI_OK;
+   int leader = -1;
    long pid;
 
    if (ctl->granularity==PAPI_GRN_SYS) {
@@ -371,6 +406,24 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
          	 ctl->inherit = 1;
          	 ctl->events[i].group_leader_fd=-1;
              ctl->events[i].attr.read_format = get_read_format(ctl->multiplexed, ctl->inherit, 0 );
+
+      /* The boxes of fanned out events are grouped by PMU and cpu, which */
+      /* the kernel allows, so that one read returns all of their counts */
+      if ( ( peu_ctl->agg[peu_ctl->logical[i]] != PE_AGG_NONE ) &&
+           !ctl->multiplexed ) {
+         ctl->events[i].attr.inherit = 0;
+         if ( peu_ctl->grouped[i] && ( leader >= 0 ) ) {
+            ctl->events[i].attr.pinned = 0;
+            ctl->events[i].attr.disabled = 0;
+            ctl->events[i].group_leader_fd = ctl->events[leader].event_fd;
+            ctl->events[i].attr.read_format = 0;
+         } else {
+            leader = i;
+            ctl->events[i].attr.read_format = PERF_FORMAT_GROUP;
+         }
+      } else {
+         leader = -1;
+      }
 #endif
 
 
@@ -382,6 +435,23 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 						     0 /* flags */
 						     );
 
+      /* A box may not have counters left for one more group member, */
+      /* the event then starts a group of its own                     */
+      if ( ( ctl->events[i].event_fd == -1 ) &&
+           ( ctl->events[i].group_leader_fd != -1 ) && ( leader >= 0 ) ) {
+         SUBDBG("event #%d does not fit the group of #%d: %s\n",
+                i, leader, strerror( errno ) );
+         leader = i;
+         ctl->events[i].attr.pinned = 1;
+         ctl->events[i].attr.disabled = 1;
+         ctl->events[i].group_leader_fd = -1;
+         ctl->events[i].attr.read_format = PERF_FORMAT_GROUP;
+         ctl->events[i].event_fd = sys_perf_event_open( &ctl->events[i].attr,
+                                                        pid,
+                                                        ctl->events[i].cpu,
+                                                        -1, 0 );
+      }
+
       /* Try to match Linux errors to PAPI errors */
       if ( ctl->events[i].event_fd == -1 ) {
 	 SUBDBG("sys_perf_event_open returned error on event #%d."
@@ -540,6 +610,300 @@ close_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 
 
 
+/********************************************************************/
+/* Events fanned out over uncore boxes                              */
+/********************************************************************/
+
+/* Read the cpus in the sysfs cpumask of the uncore PMU with perf_event */
+/* type, the ones to open its events on: one per package                */
+static int
+peu_read_pmu_cpus( uint32_t type, int *cpus, int max )
+{
+   char path[BUFSIZ], list[BUFSIZ];
+   struct dirent *d;
+   unsigned int pmu_type;
+   char *p, *end;
+   int first, last, found = 0, n = 0;
+   DIR *dir;
+   FILE *fff;
+
+   dir = opendir( "/sys/bus/event_source/devices" );
+   if ( dir == NULL ) {
+      return 0;
+   }
+
+   while ( !found && ( d = readdir( dir ) ) != NULL ) {
+      if ( d->d_name[0] == '.' ) continue;
+
+      snprintf( path, sizeof ( path ), "/sys/bus/event_source/devices/%s/type",
+                d->d_name );
+      fff = fopen( path, "r" );
+      if ( fff == NULL ) continue;
+      found = ( fscanf( fff, "%u", &pmu_type ) == 1 ) && ( pmu_type == type );
+      fclose( fff );
+      if ( !found ) continue;
+
+      snprintf( path, sizeof ( path ),
+                "/sys/bus/event_source/devices/%s/cpumask", d->d_name );
+      fff = fopen( path, "r" );
+      if ( fff == NULL ) break;
+      if ( fgets( list, sizeof ( list ), fff ) == NULL ) list[0] = '\0';
+      fclose( fff );
+
+      /* a cpu list such as "0,18" or "0-1" */
+      for ( p = list; ( *p != '\0' ) && ( *p != '\n' ); p = end ) {
+         first = ( int ) strtol( p, &end, 10 );
+         if ( end == p ) break;
+         last = first;
+         if ( *end == '-' ) {
+            p = end + 1;
+            last = ( int ) strtol( p, &end, 10 );
+            if ( end == p ) break;
+         }
+         for ( ; ( first <= last ) && ( n < max ); first++ ) {
+            cpus[n++] = first;
+         }
+         if ( *end == ',' ) end++;
+      }
+   }
+   closedir( dir );
+
+   return n;
+}
+
+/* The cpus of the uncore PMU with perf_event type, from the cache */
+/* or read and cached on first use                                 */
+static int
+peu_pmu_cpus( uint32_t type, int *cpus, int max )
+{
+   peu_pmu_cpus_t *entry = NULL;
+   int i, n;
+
+   _papi_hwi_lock( COMPONENT_LOCK );
+   for ( i = 0; i < peu_num_cpus_cache; i++ ) {
+      if ( peu_cpus_cache[i].type == type ) {
+         entry = &peu_cpus_cache[i];
+         break;
+      }
+   }
+   if ( ( entry == NULL ) && ( peu_num_cpus_cache < PEU_MAX_PMUS ) ) {
+      entry = &peu_cpus_cache[peu_num_cpus_cache++];
+      entry->type = type;
+      entry->num_cpus = peu_read_pmu_cpus( type, entry->cpus, PEU_MAX_PACKAGES );
+   }
+
+   if ( entry != NULL ) {
+      n = ( entry->num_cpus < max ) ? entry->num_cpus : max;
+      memcpy( cpus, entry->cpus, n * sizeof ( int ) );
+   } else {
+      n = peu_read_pmu_cpus( type, cpus, max );
+   }
+   _papi_hwi_unlock( COMPONENT_LOCK );
+
+   return n;
+}
+
+/* The package of a cpu, -1 if unknown */
+static int
+peu_cpu_package( int cpu )
+{
+   char path[BUFSIZ];
+   int package = -1;
+   FILE *fff;
+
+   snprintf( path, sizeof ( path ),
+             "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu );
+   fff = fopen( path, "r" );
+   if ( fff != NULL ) {
+      if ( fscanf( fff, "%d", &package ) != 1 ) package = -1;
+      fclose( fff );
+   }
+
+   return package;
+}
+
+/* Set up the kernel events of an event with agg= from events[first] on: */
+/* the event on every present PMU named like its own but for the box     */
+/* number, on each cpu of the PMU's cpumask. Returns how many were set   */
+/* up, or a PAPI error.                                                  */
+static int
+peu_fanout( peu_control_t *peu_ctl, struct native_event_t *ntv_evt,
+            int logical, int first )
+{
+   pe_control_t *pe_ctl = &peu_ctl->pe;
+   char name[BUFSIZ], masks[BUFSIZ], stripped[BUFSIZ];
+   int cpus[PEU_MAX_PACKAGES];
+   pfm_perf_encode_arg_t perf_arg;
+   struct perf_event_attr attr;
+   pfm_pmu_info_t pinfo;
+   size_t family;
+   int pmu, ncpus, agg, socket, c, n = 0;
+   pfm_err_t ret;
+
+   /* the family is the pmu name without the box number */
+   family = strlen( ntv_evt->pmu );
+   while ( ( family > 0 ) && isdigit( ( unsigned char ) ntv_evt->pmu[family - 1] ) ) {
+      family--;
+   }
+
+   snprintf( masks, sizeof ( masks ), ":%s", ntv_evt->mask_string );
+   if ( _pe_libpfm4_fanout( masks, stripped, sizeof ( stripped ),
+                            &agg, &socket ) != PAPI_OK ) {
+      return PAPI_EINVAL;
+   }
+
+   for ( pmu = 0; ; pmu++ ) {
+      memset( &pinfo, 0, sizeof ( pinfo ) );
+      pinfo.size = sizeof ( pinfo );
+      ret = pfm_get_pmu_info( pmu, &pinfo );
+      if ( ret == PFM_ERR_INVAL ) break;
+      if ( ( ret != PFM_SUCCESS ) || ( pinfo.name == NULL ) ||
+           !pinfo.is_present || ( pinfo.type != PFM_PMU_TYPE_UNCORE ) ) {
+         continue;
+      }
+      if ( ( strncmp( pinfo.name, ntv_evt->pmu, family ) != 0 ) ||
+           ( strspn( pinfo.name + family, "0123456789" ) !=
+             strlen( pinfo.name + family ) ) ) {
+         continue;
+      }
+
+      snprintf( name, sizeof ( name ), "%s::%s%s", pinfo.name,
+                ntv_evt->base_name, stripped );
+      memset( &perf_arg, 0, sizeof ( perf_arg ) );
+      memset( &attr, 0, sizeof ( attr ) );
+      attr.size = sizeof ( attr );
+      perf_arg.attr = &attr;
+      ret = pfm_get_os_event_encoding( name, PFM_PLM0 | PFM_PLM3,
+                                       PFM_OS_PERF_EVENT_EXT, &perf_arg );
+      if ( ret != PFM_SUCCESS ) {
+         SUBDBG("%s does not encode: %d\n", name, ret);
+         continue;
+      }
+
+      ncpus = peu_pmu_cpus( attr.type, cpus, PEU_MAX_PACKAGES );
+      if ( ncpus == 0 ) {
+         /* no cpumask, the PMU counts for the whole machine */
+         cpus[ncpus++] = ( ntv_evt->cpu >= 0 ) ? ntv_evt->cpu : 0;
+      }
+
+      for ( c = 0; c < ncpus; c++ ) {
+         if ( ( socket >= 0 ) && ( peu_cpu_package( cpus[c] ) != socket ) ) {
+            continue;
+         }
+         if ( first + n >= PERF_EVENT_MAX_MPX_COUNTERS ) {
+            return PAPI_ECOUNT;
+         }
+         memcpy( &pe_ctl->events[first + n].attr, &attr, sizeof ( attr ) );
+         pe_ctl->events[first + n].cpu = cpus[c];
+         peu_ctl->logical[first + n] = logical;
+         n++;
+      }
+   }
+
+   SUBDBG("%s fans out to %d boxes and packages\n", ntv_evt->allocated_name, n);
+
+   return n ? n : PAPI_ENOEVNT;
+}
+
+/* Order of the kernel events: single events in EventSet order, then    */
+/* the boxes of fanned out events by PMU and cpu, so that the events    */
+/* counted on the same box and cpu can be one group                     */
+typedef struct {
+   int fanout;
+   uint32_t type;
+   int cpu;
+   int index;
+} peu_order_t;
+
+static int
+peu_order_compare( const void *a, const void *b )
+{
+   const peu_order_t *oa = a, *ob = b;
+
+   if ( oa->fanout != ob->fanout ) return oa->fanout - ob->fanout;
+   if ( oa->fanout ) {
+      if ( oa->type != ob->type ) return oa->type < ob->type ? -1 : 1;
+      if ( oa->cpu != ob->cpu ) return oa->cpu - ob->cpu;
+   }
+   return oa->index - ob->index;
+}
+
+static int
+peu_group_fanout( peu_control_t *peu_ctl )
+{
+   pe_control_t *pe_ctl = &peu_ctl->pe;
+   int n = pe_ctl->num_events;
+   pe_event_info_t *events;
+   peu_order_t *order;
+   int *logical;
+   int i;
+
+   order = papi_malloc( n * sizeof ( peu_order_t ) );
+   logical = papi_malloc( n * sizeof ( int ) );
+   events = papi_malloc( n * sizeof ( pe_event_info_t ) );
+   if ( ( order == NULL ) || ( logical == NULL ) || ( events == NULL ) ) {
+      if ( order ) papi_free( order );
+      if ( logical ) papi_free( logical );
+      if ( events ) papi_free( events );
+      return PAPI_ENOMEM;
+   }
+
+   for ( i = 0; i < n; i++ ) {
+      order[i].fanout = ( peu_ctl->agg[peu_ctl->logical[i]] != PE_AGG_NONE );
+      order[i].type = pe_ctl->events[i].attr.type;
+      order[i].cpu = pe_ctl->events[i].cpu;
+      order[i].index = i;
+   }
+   qsort( order, n, sizeof ( peu_order_t ), peu_order_compare );
+
+   memcpy( events, pe_ctl->events, n * sizeof ( pe_event_info_t ) );
+   memcpy( logical, peu_ctl->logical, n * sizeof ( int ) );
+   for ( i = 0; i < n; i++ ) {
+      pe_ctl->events[i] = events[order[i].index];
+      peu_ctl->logical[i] = logical[order[i].index];
+      peu_ctl->grouped[i] = ( i > 0 ) && order[i].fanout &&
+         order[i - 1].fanout && ( order[i].type == order[i - 1].type ) &&
+         ( order[i].cpu == order[i - 1].cpu );
+   }
+
+   papi_free( order );
+   papi_free( logical );
+   papi_free( events );
+
+   return PAPI_OK;
+}
+
+/* Combine the counts of the kernel events into the values of the events */
+static void
+peu_combine( peu_control_t *peu_ctl )
+{
+   pe_control_t *pe_ctl = &peu_ctl->pe;
+   char seen[PERF_EVENT_MAX_MPX_COUNTERS];
+   long long count;
+   int i, l;
+
+   memset( seen, 0, peu_ctl->num_logical );
+   memset( peu_ctl->values, 0, peu_ctl->num_logical * sizeof ( long long ) );
+
+   for ( i = 0; i < pe_ctl->num_events; i++ ) {
+      l = peu_ctl->logical[i];
+      count = pe_ctl->counts[i];
+
+      if ( !seen[l] ) {
+         peu_ctl->values[l] = count;
+         seen[l] = 1;
+      } else if ( peu_ctl->agg[l] == PE_AGG_MIN ) {
+         if ( count < peu_ctl->values[l] ) peu_ctl->values[l] = count;
+      } else if ( peu_ctl->agg[l] == PE_AGG_MAX ) {
+         if ( count > peu_ctl->values[l] ) peu_ctl->values[l] = count;
+      } else {
+         peu_ctl->values[l] += count;
+      }
+   }
+}
+
+
+
 /********************************************************************/
 /* Component Interface                                              */
 /********************************************************************/
@@ -570,7 +934,7 @@ _peu_init_control_state( hwd_control_state_t *ctl )
   pe_control_t *pe_ctl = ( pe_control_t *) ctl;
 
   /* clear the contents */
-  memset( pe_ctl, 0, sizeof ( pe_control_t ) );
+  memset( ctl, 0, sizeof ( peu_control_t ) );
 
   /* Set the default domain */
   _peu_set_domain( ctl, _perf_event_uncore_vector.cmp_info.default_domain );
@@ -685,6 +1049,9 @@ _peu_init_component( int cidx )
 static int
 _peu_shutdown_component( void ) {
 
+	/* the PMUs may differ at the next init */
+	peu_num_cpus_cache = 0;
+
 	/* deallocate our event table */
 	_pe_libpfm4_shutdown(&_perf_event_uncore_vector,
 				&uncore_native_event_table);
@@ -706,11 +1073,16 @@ _peu_update_control_state( hwd_control_state_t *ctl,
 {
 	int i;
 	int j;
+	int k;
 	int ret;
 	int skipped_events=0;
+	int num_fds=0;
+	int added;
+	int fanout=0;
 	struct native_event_t *ntv_evt;
    pe_context_t *pe_ctx = ( pe_context_t *) ctx;
    pe_control_t *pe_ctl = ( pe_control_t *) ctl;
+   peu_control_t *peu_ctl = ( peu_control_t *) ctl;
 
    /* close all of the existing fds and start over again */
    /* In theory we could have finer-grained control and know if             */
@@ -721,6 +1093,7 @@ _peu_update_control_state( hwd_control_state_t *ctl,
    /* when an eventset is destroyed.                                      */
    if ( count == 0 ) {
       SUBDBG( "Called with count == 0\n" );
+      peu_ctl->num_logical = 0;
       return PAPI_OK;
    }
 
@@ -741,6 +1114,10 @@ _peu_update_control_state( hwd_control_state_t *ctl,
 						ntv_idx = j;
 					}
 				}
+				// an event enumerated from the event cache may not be allocated yet
+				if (ntv_idx == -1) {
+					ntv_idx = _pe_libpfm4_ntv_find_event((unsigned)(native[i].ni_papi_code), pe_ctx->event_table);
+				}
 			}
 
 			// if native index is still negative, we did not find event we wanted so just return error
@@ -756,39 +1133,67 @@ _peu_update_control_state( hwd_control_state_t *ctl,
 
 			SUBDBG("i: %d, pe_ctx->event_table->num_native_events: %d\n", i, pe_ctx->event_table->num_native_events);
 
-	    	// Move this events hardware config values and other attributes to the perf_events attribute structure
-			memcpy (&pe_ctl->events[i].attr, &ntv_evt->attr, sizeof(perf_event_attr_t));
+			// An event with agg= becomes one kernel event per box and package
+			peu_ctl->agg[i] = ntv_evt->agg;
+			if (ntv_evt->agg != PE_AGG_NONE) {
+				added = peu_fanout(peu_ctl, ntv_evt, i, num_fds);
+				if (added < 0) {
+					SUBDBG("EXIT: fanning out %s failed: %d\n", ntv_evt->allocated_name, added);
+					return added;
+				}
+				fanout = 1;
+			} else {
+				if (num_fds >= PERF_EVENT_MAX_MPX_COUNTERS) {
+					return PAPI_ECOUNT;
+				}
+				added = 1;
+		    	// Move this events hardware config values and other attributes to the perf_events attribute structure
+				memcpy (&pe_ctl->events[num_fds].attr, &ntv_evt->attr, sizeof(perf_event_attr_t));
+
+				// set the cpu number provided with an event mask if there was one (will be -1 if mask not provided)
+				pe_ctl->events[num_fds].cpu = ntv_evt->cpu;
+				// if cpu event mask not provided, then set the cpu to use to what may have been set on call to PAPI_set_opt (will still be -1 if not called)
+				if (pe_ctl->events[num_fds].cpu == -1) {
+					pe_ctl->events[num_fds].cpu = pe_ctl->cpu;
+				}
+				peu_ctl->logical[num_fds] = i;
+			}
 
 			// may need to update the attribute structure with information from event set level domain settings (values set by PAPI_set_domain)
 			// only done if the event mask which controls each counting domain was not provided
 
 			// get pointer to allocated name, will be NULL when adding preset events to event set
 			char *aName = ntv_evt->allocated_name;
-			if ((aName == NULL)  ||  (strstr(aName, ":u=") == NULL)) {
-				SUBDBG("set exclude_user attribute from eventset level domain flags, encode: %d, eventset: %d\n", pe_ctl->events[i].attr.exclude_user, !(pe_ctl->domain & PAPI_DOM_USER));
-				pe_ctl->events[i].attr.exclude_user = !(pe_ctl->domain & PAPI_DOM_USER);
-			}
-			if ((aName == NULL)  ||  (strstr(aName, ":k=") == NULL)) {
-				SUBDBG("set exclude_kernel attribute from eventset level domain flags, encode: %d, eventset: %d\n", pe_ctl->events[i].attr.exclude_kernel, !(pe_ctl->domain & PAPI_DOM_KERNEL));
-				pe_ctl->events[i].attr.exclude_kernel = !(pe_ctl->domain & PAPI_DOM_KERNEL);
-			}
-
-			// set the cpu number provided with an event mask if there was one (will be -1 if mask not provided)
-			pe_ctl->events[i].cpu = ntv_evt->cpu;
-			// if cpu event mask not provided, then set the cpu to use to what may have been set on call to PAPI_set_opt (will still be -1 if not called)
-			if (pe_ctl->events[i].cpu == -1) {
-				pe_ctl->events[i].cpu = pe_ctl->cpu;
+			for (k = num_fds; k < num_fds + added; k++) {
+				if ((aName == NULL)  ||  (strstr(aName, ":u=") == NULL)) {
+					SUBDBG("set exclude_user attribute from eventset level domain flags, encode: %d, eventset: %d\n", pe_ctl->events[k].attr.exclude_user, !(pe_ctl->domain & PAPI_DOM_USER));
+					pe_ctl->events[k].attr.exclude_user = !(pe_ctl->domain & PAPI_DOM_USER);
+				}
+				if ((aName == NULL)  ||  (strstr(aName, ":k=") == NULL)) {
+					SUBDBG("set exclude_kernel attribute from eventset level domain flags, encode: %d, eventset: %d\n", pe_ctl->events[k].attr.exclude_kernel, !(pe_ctl->domain & PAPI_DOM_KERNEL));
+					pe_ctl->events[k].attr.exclude_kernel = !(pe_ctl->domain & PAPI_DOM_KERNEL);
+				}
 			}
       } else {
     	  // This case happens when called from _pe_set_overflow and _pe_ctl
           // Those callers put things directly into the pe_ctl structure so it is already set for the open call
+          added = 1;
+          // The kernel events keep the events they were set up for; without
+          // any, each is an event of its own, so that reads combine nothing
+          if ( peu_ctl->num_logical == 0 ) {
+             peu_ctl->logical[num_fds] = i;
+             peu_ctl->agg[i] = PE_AGG_NONE;
+          }
       }
 
       // Copy the inherit flag into the attribute block that will be passed to the kernel
-      pe_ctl->events[i].attr.inherit = pe_ctl->inherit;
+      for (k = num_fds; k < num_fds + added; k++) {
+         pe_ctl->events[k].attr.inherit = pe_ctl->inherit;
+      }
+      num_fds += added;
 
       /* Set the position in the native structure */
-      /* We just set up events linearly           */
+      /* The values read are those of the events  */
       if ( native ) {
     	  native[i].ni_position = i;
     	  SUBDBG( "&native[%d]: %p, ni_papi_code: %#x, ni_event: %#x, ni_position: %d, ni_owners: %d\n",
@@ -801,7 +1206,18 @@ _peu_update_control_state( hwd_control_state_t *ctl,
 		return PAPI_ENOEVNT;
 	}
 
-  pe_ctl->num_events = count - skipped_events;
+   pe_ctl->num_events = num_fds;
+   if ( native ) {
+      peu_ctl->num_logical = count;
+      if ( fanout ) {
+         ret = peu_group_fanout( peu_ctl );
+         if ( ret != PAPI_OK ) {
+            return ret;
+         }
+      }
+   } else if ( peu_ctl->num_logical == 0 ) {
+      peu_ctl->num_logical = count;
+   }
 
    /* actuall open the events */
    /* (why is this a separate function?) */
@@ -918,8 +1334,10 @@ _peu_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
    /* pe_context_t *pe_ctx = ( pe_context_t *) ctx; */ 
    (void) ctx; /*unused*/
    pe_control_t *pe_ctl = ( pe_control_t *) ctl;
+   peu_control_t *peu_ctl = ( peu_control_t *) ctl;
    long long papi_pe_buffer[READ_BUFFER_SIZE];
    long long tot_time_running, tot_time_enabled, scale;
+   int j;
 
    /* Handle case where we are multiplexing */
    if (pe_ctl->multiplexed) {
@@ -984,7 +1402,8 @@ _peu_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
    /* Handle cases where we cannot use FORMAT GROUP */
    else if (pe_ctl->inherit) {
 
-      /* we must read each counter individually */
+      /* we must read each counter individually, but for the */
+      /* groups of the boxes of fanned out events            */
       for ( i = 0; i < pe_ctl->num_events; i++ ) {
 
          ret = read( pe_ctl->events[i].event_fd, papi_pe_buffer, 
@@ -995,6 +1414,27 @@ _peu_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
 	    return PAPI_ESYS;
 	 }
 
+	 /* the number of members, then their counts; the members */
+	 /* follow their leader                                   */
+	 if ( pe_ctl->events[i].attr.read_format & PERF_FORMAT_GROUP ) {
+	    if ( ( ret < (signed)( 2 * sizeof ( long long ) ) ) ||
+		 ( papi_pe_buffer[0] < 1 ) ||
+		 ( ret < (signed)( ( 1 + papi_pe_buffer[0] ) * sizeof ( long long ) ) ) ||
+		 ( i + papi_pe_buffer[0] > pe_ctl->num_events ) ) {
+	       PAPIERROR("Error! short group read!\n");
+	       SUBDBG("EXIT: PAPI_ESYS\n");
+	       return PAPI_ESYS;
+	    }
+	    SUBDBG("read: fd: %2d, cpu: %d, %lld members\n",
+		   pe_ctl->events[i].event_fd, pe_ctl->events[i].cpu,
+		   papi_pe_buffer[0]);
+	    for ( j = 0; j < papi_pe_buffer[0]; j++ ) {
+	       pe_ctl->counts[i + j] = papi_pe_buffer[1 + j];
+	    }
+	    i += papi_pe_buffer[0] - 1;
+	    continue;
+	 }
+
 	 /* we should read one 64-bit value from each counter */
 	 if (ret!=sizeof(long long)) {
 	    PAPIERROR("Error!  short read!\n");
@@ -1063,8 +1503,9 @@ _peu_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
       }
    }
 
-   /* point PAPI to the values we read */
-   *events = pe_ctl->counts;
+   /* point PAPI to the values we read, combined for fanned out events */
+   peu_combine( peu_ctl );
+   *events = peu_ctl->values;
 
    SUBDBG("EXIT: PAPI_OK\n");
    return PAPI_OK;
@@ -1339,7 +1780,7 @@ papi_vector_t _perf_event_uncore_vector = {
   /* sizes of framework-opaque component-private structures */
   .size = {
       .context = sizeof ( pe_context_t ),
-      .control_state = sizeof ( pe_control_t ),
+      .control_state = sizeof ( peu_control_t ),
       .reg_value = sizeof ( int ),
       .reg_alloc = sizeof ( int ),
   },
@@ -0,0 +1,119 @@
+/*
+ * This file tests uncore events counted on all boxes with :agg=
+ *
+ * The cbox event of perf_event_uncore_cbox is added once for each of
+ * agg=sum, agg=min and agg=max in one EventSet, which then reads all
+ * boxes of all sockets with one grouped read per box and socket.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "do_loops.h"
+
+#include "perf_event_uncore_lib.h"
+
+#define NUM_AGG 3
+
+int main( int argc, char **argv ) {
+
+	int retval,i,quiet;
+	int EventSet = PAPI_NULL;
+	long long values[NUM_AGG];
+	const char *agg[NUM_AGG] = { "sum", "min", "max" };
+	char event_name[BUFSIZ];
+	char uncore_base[BUFSIZ];
+	char uncore_event[BUFSIZ];
+	int uncore_cidx=-1;
+	char *result;
+
+	/* Set TESTS_QUIET variable */
+	quiet = tests_quiet( argc, argv );
+
+	/* Init the PAPI library */
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	/* Find the uncore PMU */
+	uncore_cidx=PAPI_get_component_index("perf_event_uncore");
+	if (uncore_cidx<0) {
+		if (!quiet) {
+			printf("perf_event_uncore component not found\n");
+		}
+		test_skip(__FILE__,__LINE__,"perf_event_uncore component not found",0);
+	}
+
+	/* Get event to use */
+	result=get_uncore_cbox_event(event_name,uncore_base,BUFSIZ);
+	if (result==NULL) {
+		if (!quiet) {
+			printf("No event available\n");
+		}
+		test_skip( __FILE__, __LINE__,
+			"No event available", PAPI_ENOSUPP );
+	}
+
+	retval = PAPI_create_eventset(&EventSet);
+	if (retval != PAPI_OK) {
+		test_fail(__FILE__, __LINE__, "PAPI_create_eventset",retval);
+	}
+
+	for(i=0;i<NUM_AGG;i++) {
+		retval = snprintf(uncore_event, BUFSIZ, "%s0::%s:agg=%s",
+			uncore_base,event_name,agg[i]);
+		if( retval >= BUFSIZ ){
+			test_fail(__FILE__, __LINE__, "Event name too long",0);
+		}
+		retval = PAPI_add_named_event(EventSet, uncore_event);
+		if (retval != PAPI_OK) {
+			if (!quiet) {
+				printf("Could not add %s\n",uncore_event);
+			}
+			test_skip( __FILE__, __LINE__,
+				"this test; trying to add an uncore event; need to run as root",
+				retval);
+		}
+		if (!quiet) {
+			printf("Added %s\n",uncore_event);
+		}
+	}
+
+	/* Start PAPI */
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	/* our work code */
+	do_flops( NUM_FLOPS );
+
+	/* Stop PAPI */
+	retval = PAPI_stop( EventSet, values );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	/* Print Results */
+	if ( !quiet ) {
+		for(i=0;i<NUM_AGG;i++) {
+			printf("\t%s0::%s:agg=%s %lld\n",uncore_base,event_name,
+				agg[i],values[i]);
+		}
+	}
+
+	/* Boxes of the same kind count the same, multiplexing aside */
+	if ((values[1] > values[2]) || (values[2] > values[0])) {
+		test_fail( __FILE__, __LINE__, "min <= max <= sum does not hold", 0 );
+	}
+
+	PAPI_shutdown();
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
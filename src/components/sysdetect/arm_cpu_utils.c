@@ -235,6 +235,16 @@ arm_cpu_get_attribute_at( CPU_attr_e attr, int loc, int *value )
         case CPU_ATTR__NUMA_MEM_SIZE:
             //fall through
         case CPU_ATTR__HWTHREAD_NUMA_AFFINITY:
+            //fall through
+        case CPU_ATTR__HWTHREAD_SOCKET_AFFINITY:
+            //fall through
+        case CPU_ATTR__HWTHREAD_CORE_AFFINITY:
+            //fall through
+        case CPU_ATTR__HWTHREAD_L2_AFFINITY:
+            //fall through
+        case CPU_ATTR__HWTHREAD_L3_AFFINITY:
+            //fall through
+        case CPU_ATTR__HWTHREAD_UNCORE_READER:
             status = os_cpu_get_attribute_at(attr, loc, value);
             break;
         default:
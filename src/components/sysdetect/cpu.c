@@ -25,6 +25,51 @@
     }                                                                           \
 } while(0)
 
+/*
+ * Number the domains given as the lowest thread in them in order of first
+ * appearance, so that they count from 0 like sockets and NUMA nodes.
+ */
+static void
+renumber_domains( int *domain, int threads )
+{
+    int raw[PAPI_MAX_NUM_THREADS];
+    int a, b, next = 0;
+
+    memcpy(raw, domain, threads * sizeof(*raw));
+    for (a = 0; a < threads; ++a) {
+        for (b = 0; b < a && raw[b] != raw[a]; ++b);
+        domain[a] = (b < a) ? domain[b] : next++;
+    }
+}
+
+static void
+fill_thread_topology( _sysdetect_cpu_info_t *info )
+{
+    int a, threads = info->threads * info->cores * info->sockets;
+
+    if (threads > PAPI_MAX_NUM_THREADS) {
+        threads = PAPI_MAX_NUM_THREADS;
+    }
+
+    for (a = 0; a < threads; ++a) {
+        CPU_CALL(cpu_get_attribute_at(CPU_ATTR__HWTHREAD_SOCKET_AFFINITY, a, &info->socket_affinity[a]),
+                 info->socket_affinity[a] = 0);
+        CPU_CALL(cpu_get_attribute_at(CPU_ATTR__HWTHREAD_CORE_AFFINITY, a, &info->core_affinity[a]),
+                 info->core_affinity[a] = a);
+        /* without a shared L2 or L3 the domain is the core or the socket */
+        CPU_CALL(cpu_get_attribute_at(CPU_ATTR__HWTHREAD_L2_AFFINITY, a, &info->l2_affinity[a]),
+                 info->l2_affinity[a] = info->core_affinity[a]);
+        CPU_CALL(cpu_get_attribute_at(CPU_ATTR__HWTHREAD_L3_AFFINITY, a, &info->l3_affinity[a]),
+                 info->l3_affinity[a] = -1 - info->socket_affinity[a]);
+        CPU_CALL(cpu_get_attribute_at(CPU_ATTR__HWTHREAD_UNCORE_READER, a, &info->uncore_reader[a]),
+                 info->uncore_reader[a] = 0);
+    }
+
+    renumber_domains(info->core_affinity, threads);
+    renumber_domains(info->l2_affinity, threads);
+    renumber_domains(info->l3_affinity, threads);
+}
+
 static void
 fill_cpu_info( _sysdetect_cpu_info_t *info )
 {
@@ -123,6 +168,8 @@ fill_cpu_info( _sysdetect_cpu_info_t *info )
                  info->numa_affinity[a] = 0);
     }
 
+    fill_thread_topology(info);
+
     info->cache_levels = level;
 }
 
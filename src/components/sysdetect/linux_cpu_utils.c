@@ -42,6 +42,10 @@ static int get_cache_partition_count( const char *dirname, int *value );
 static int get_cache_set_count( const char *dirname, int *value );
 static int get_mem_info( int node, int *value );
 static int get_thread_affinity( int thread, int *value );
+static int get_thread_topology( CPU_attr_e attr, int thread, int *value );
+static int get_thread_package( int thread );
+static int get_uncore_reader( int thread, int *value );
+static int path_first_int( const char *path, ... );
 static int path_sibling( const char *path, ... );
 static char *search_cpu_info( FILE *fp, const char *key );
 static int path_exist( const char *path, ... );
@@ -248,6 +252,15 @@ linux_cpu_get_attribute_at( CPU_attr_e attr, int loc, int *value )
         case CPU_ATTR__HWTHREAD_NUMA_AFFINITY:
             status = get_thread_affinity(loc, value);
             break;
+        case CPU_ATTR__HWTHREAD_SOCKET_AFFINITY:
+        case CPU_ATTR__HWTHREAD_CORE_AFFINITY:
+        case CPU_ATTR__HWTHREAD_L2_AFFINITY:
+        case CPU_ATTR__HWTHREAD_L3_AFFINITY:
+            status = get_thread_topology(attr, loc, value);
+            break;
+        case CPU_ATTR__HWTHREAD_UNCORE_READER:
+            status = get_uncore_reader(loc, value);
+            break;
         default:
             status = CPU_ERROR;
     }
@@ -774,6 +787,144 @@ get_thread_affinity( int thread, int *val )
     return CPU_SUCCESS;
 }
 
+/*
+ * Core and cache domains are returned as the lowest hardware thread that
+ * shares the core or the cache; the kernel lists are sorted, so that is
+ * the first number in them. Sockets are the physical package id, as used
+ * by the uncore PMUs.
+ */
+int
+get_thread_topology( CPU_attr_e attr, int thread, int *val )
+{
+    int index, level;
+
+    switch(attr) {
+        case CPU_ATTR__HWTHREAD_SOCKET_AFFINITY:
+            *val = get_thread_package(thread);
+            break;
+        case CPU_ATTR__HWTHREAD_CORE_AFFINITY:
+            *val = path_first_int(_PATH_SYS_SYSTEM "/cpu/cpu%d/topology/thread_siblings_list", thread);
+            break;
+        case CPU_ATTR__HWTHREAD_L2_AFFINITY:
+        case CPU_ATTR__HWTHREAD_L3_AFFINITY:
+            *val = -1;
+            for (index = 0; path_exist(_PATH_SYS_SYSTEM "/cpu/cpu%d/cache/index%d", thread, index); ++index) {
+                level = path_first_int(_PATH_SYS_SYSTEM "/cpu/cpu%d/cache/index%d/level", thread, index);
+                if (level == ((attr == CPU_ATTR__HWTHREAD_L2_AFFINITY) ? 2 : 3)) {
+                    *val = path_first_int(_PATH_SYS_SYSTEM "/cpu/cpu%d/cache/index%d/shared_cpu_list", thread, index);
+                    break;
+                }
+            }
+            break;
+        default:
+            return CPU_ERROR;
+    }
+
+    return (*val < 0) ? CPU_ERROR : CPU_SUCCESS;
+}
+
+int
+get_thread_package( int thread )
+{
+    static int package[PAPI_MAX_NUM_THREADS];
+    static int package_read[PAPI_MAX_NUM_THREADS];
+
+    if (thread < 0 || thread >= PAPI_MAX_NUM_THREADS) {
+        return -1;
+    }
+
+    if (!package_read[thread]) {
+        package[thread] = path_first_int(_PATH_SYS_SYSTEM "/cpu/cpu%d/topology/physical_package_id", thread);
+        package_read[thread] = 1;
+    }
+
+    return package[thread];
+}
+
+/*
+ * The hardware thread that reads the socket scope counters of a thread's
+ * socket: the lowest thread of the socket in the cpumask of a socket scope
+ * PMU (uncore, power, data fabric), else the lowest thread of the socket.
+ * That is where the kernel opens uncore events, and reading them from
+ * there does not cross sockets.
+ */
+int
+get_uncore_reader( int thread, int *val )
+{
+    static char in_cpumask[PAPI_MAX_NUM_THREADS];
+    static int cpumask_read;
+    char path[PATH_MAX], list[PAPI_HUGE_STR_LEN];
+    struct dirent *d;
+    DIR *dir;
+    FILE *fp;
+    char *p, *end;
+    int first, last, cpu, pass;
+    int socket = get_thread_package(thread);
+    int num_cpus = linux_cpu_get_num_supported();
+
+    if (socket < 0) {
+        return CPU_ERROR;
+    }
+
+    if (!cpumask_read) {
+        dir = opendir("/sys/bus/event_source/devices");
+        while (dir && (d = readdir(dir)) != NULL) {
+            if (d->d_name[0] == '.') {
+                continue;
+            }
+            snprintf(path, sizeof(path), "/sys/bus/event_source/devices/%s/cpumask", d->d_name);
+            fp = fopen(path, "r");
+            if (!fp) {
+                continue;
+            }
+            if (!fgets(list, sizeof(list), fp)) {
+                list[0] = '\0';
+            }
+            fclose(fp);
+
+            /* a cpu list such as "0,18" or "0-1" */
+            for (p = list; *p != '\0' && *p != '\n'; p = end) {
+                first = last = (int) strtol(p, &end, 10);
+                if (end == p) {
+                    break;
+                }
+                if (*end == '-') {
+                    p = end + 1;
+                    last = (int) strtol(p, &end, 10);
+                    if (end == p) {
+                        break;
+                    }
+                }
+                for (; first <= last && first < PAPI_MAX_NUM_THREADS; ++first) {
+                    in_cpumask[first] = 1;
+                }
+                if (*end == ',') {
+                    ++end;
+                }
+            }
+        }
+        if (dir) {
+            closedir(dir);
+        }
+        cpumask_read = 1;
+    }
+
+    if (num_cpus > PAPI_MAX_NUM_THREADS) {
+        num_cpus = PAPI_MAX_NUM_THREADS;
+    }
+
+    for (pass = 0; pass < 2; ++pass) {
+        for (cpu = 0; cpu < num_cpus; ++cpu) {
+            if ((pass || in_cpumask[cpu]) && get_thread_package(cpu) == socket) {
+                *val = cpu;
+                return CPU_SUCCESS;
+            }
+        }
+    }
+
+    return CPU_ERROR;
+}
+
 static char pathbuf[PATH_MAX] = "/";
 
 FILE *
@@ -858,6 +1009,26 @@ path_exist( const char *path, ... )
     return access(pathbuf, F_OK) == 0;
 }
 
+int
+path_first_int( const char *path, ... )
+{
+    int val = -1;
+    FILE *fp;
+    va_list ap;
+    va_start(ap, path);
+    fp = path_vfopen("r", path, ap);
+    va_end(ap);
+
+    if (fp) {
+        if (fscanf(fp, "%d", &val) != 1) {
+            val = -1;
+        }
+        fclose(fp);
+    }
+
+    return val;
+}
+
 void
 decode_vendor_string( char *s, int *vendor )
 {
@@ -224,6 +224,11 @@ powerpc_cpu_get_attribute_at( CPU_attr_e attr, int loc, int *value )
             break;
         case CPU_ATTR__NUMA_MEM_SIZE:
         case CPU_ATTR__HWTHREAD_NUMA_AFFINITY:
+        case CPU_ATTR__HWTHREAD_SOCKET_AFFINITY:
+        case CPU_ATTR__HWTHREAD_CORE_AFFINITY:
+        case CPU_ATTR__HWTHREAD_L2_AFFINITY:
+        case CPU_ATTR__HWTHREAD_L3_AFFINITY:
+        case CPU_ATTR__HWTHREAD_UNCORE_READER:
             status = os_cpu_get_attribute_at(attr, loc, value);
             break;
         default:
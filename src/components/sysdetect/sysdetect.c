@@ -51,6 +51,8 @@ static int _sysdetect_get_dev_type_attr( void *handle,
 static int _sysdetect_get_dev_attr( void *handle, int id, PAPI_dev_attr_e attr,
                                     void *val );
 static void get_num_threads_per_numa( _sysdetect_cpu_info_t *cpu_info );
+static int get_thread_topology( _sysdetect_cpu_info_t *cpu_info, int id,
+                                PAPI_dev_attr_e attr, void *val );
 
 static void
 init_dev_info( void )
@@ -319,6 +321,13 @@ _sysdetect_get_dev_attr( void *handle, int id, PAPI_dev_attr_e attr, void *val )
             get_num_threads_per_numa(cpu_info);
             *(int *) val = cpu_info->num_threads_per_numa[id];
             break;
+        case PAPI_DEV_ATTR__CPU_UINT_THR_SOCKET_AFFINITY:
+        case PAPI_DEV_ATTR__CPU_UINT_THR_CORE_AFFINITY:
+        case PAPI_DEV_ATTR__CPU_UINT_THR_L2_AFFINITY:
+        case PAPI_DEV_ATTR__CPU_UINT_THR_L3_AFFINITY:
+        case PAPI_DEV_ATTR__CPU_UINT_THR_UNCORE_READER:
+            papi_errno = get_thread_topology(cpu_info, id, attr, val);
+            break;
         case PAPI_DEV_ATTR__CPU_UINT_NUMA_MEM_SIZE:
             *(unsigned int *) val = (cpu_info->numa_memory[id] >> 10);
             break;
@@ -460,6 +469,37 @@ get_num_threads_per_numa( _sysdetect_cpu_info_t *cpu_info )
     initialized = 1;
 }
 
+int
+get_thread_topology( _sysdetect_cpu_info_t *cpu_info, int id, PAPI_dev_attr_e attr, void *val )
+{
+    if (id < 0 || id >= PAPI_MAX_NUM_THREADS ||
+        id >= cpu_info->threads * cpu_info->cores * cpu_info->sockets) {
+        return PAPI_EINVAL;
+    }
+
+    switch(attr) {
+        case PAPI_DEV_ATTR__CPU_UINT_THR_SOCKET_AFFINITY:
+            *(int *) val = cpu_info->socket_affinity[id];
+            break;
+        case PAPI_DEV_ATTR__CPU_UINT_THR_CORE_AFFINITY:
+            *(int *) val = cpu_info->core_affinity[id];
+            break;
+        case PAPI_DEV_ATTR__CPU_UINT_THR_L2_AFFINITY:
+            *(int *) val = cpu_info->l2_affinity[id];
+            break;
+        case PAPI_DEV_ATTR__CPU_UINT_THR_L3_AFFINITY:
+            *(int *) val = cpu_info->l3_affinity[id];
+            break;
+        case PAPI_DEV_ATTR__CPU_UINT_THR_UNCORE_READER:
+            *(int *) val = cpu_info->uncore_reader[id];
+            break;
+        default:
+            return PAPI_ENOSUPP;
+    }
+
+    return PAPI_OK;
+}
+
 /** Vector that points to entry points for our component */
 papi_vector_t _sysdetect_vector = {
     .cmp_info = {
@@ -72,6 +72,11 @@ typedef struct {
     int numa_memory[PAPI_MAX_NUM_NODES];
 #define PAPI_MAX_NUM_THREADS 512
     int numa_affinity[PAPI_MAX_NUM_THREADS];
+    int socket_affinity[PAPI_MAX_NUM_THREADS];
+    int core_affinity[PAPI_MAX_NUM_THREADS];
+    int l2_affinity[PAPI_MAX_NUM_THREADS];
+    int l3_affinity[PAPI_MAX_NUM_THREADS];
+    int uncore_reader[PAPI_MAX_NUM_THREADS];
 #define PAPI_MAX_THREADS_PER_NUMA (PAPI_MAX_NUM_THREADS / PAPI_MAX_NUM_NODES)
     int num_threads_per_numa[PAPI_MAX_THREADS_PER_NUMA];
 } _sysdetect_cpu_info_t;
@@ -0,0 +1,102 @@
+/**
+ * @file    query_topology.c
+ *
+ * test case for sysdetect component
+ *
+ * @brief
+ *  This file contains an example of how to use the sysdetect component to
+ *  query the topology of the hardware threads: socket, NUMA node, core,
+ *  L2 and L3 domain, and the thread to read the uncore counters of each
+ *  socket from. The domains have to nest: siblings share their caches
+ *  and threads sharing an L3 share their socket.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "papi.h"
+#include "papi_test.h"
+
+#define MAX_THREADS 512
+
+int main(int argc, char *argv[])
+{
+    int i, j, quiet = 0;
+    quiet = tests_quiet(argc, argv);
+
+    int retval = PAPI_library_init(PAPI_VER_CURRENT);
+    if (retval != PAPI_VER_CURRENT) {
+        test_fail(__FILE__, __LINE__, "PAPI_library_init failed\n", retval);
+    }
+
+    void *handle;
+    int id, found = 0;
+    unsigned int threads = 0, value;
+    static unsigned int socket[MAX_THREADS], numa[MAX_THREADS], core[MAX_THREADS];
+    static unsigned int l2[MAX_THREADS], l3[MAX_THREADS], reader[MAX_THREADS];
+
+    while (PAPI_enum_dev_type(PAPI_DEV_TYPE_ENUM__CPU, &handle) == PAPI_OK) {
+        PAPI_get_dev_type_attr(handle, PAPI_DEV_TYPE_ATTR__INT_PAPI_ID, &id);
+        if (id == PAPI_DEV_TYPE_ID__CPU) {
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        test_skip(__FILE__, __LINE__, "No CPU device type", 0);
+    }
+
+    PAPI_get_dev_attr(handle, 0, PAPI_DEV_ATTR__CPU_UINT_THREAD_COUNT, &threads);
+    if (threads == 0) {
+        test_skip(__FILE__, __LINE__, "No hardware threads detected", 0);
+    }
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+
+    for (i = 0; i < (int) threads; ++i) {
+        retval  = PAPI_get_dev_attr(handle, i, PAPI_DEV_ATTR__CPU_UINT_THR_SOCKET_AFFINITY, &socket[i]);
+        retval |= PAPI_get_dev_attr(handle, i, PAPI_DEV_ATTR__CPU_UINT_THR_NUMA_AFFINITY, &numa[i]);
+        retval |= PAPI_get_dev_attr(handle, i, PAPI_DEV_ATTR__CPU_UINT_THR_CORE_AFFINITY, &core[i]);
+        retval |= PAPI_get_dev_attr(handle, i, PAPI_DEV_ATTR__CPU_UINT_THR_L2_AFFINITY, &l2[i]);
+        retval |= PAPI_get_dev_attr(handle, i, PAPI_DEV_ATTR__CPU_UINT_THR_L3_AFFINITY, &l3[i]);
+        retval |= PAPI_get_dev_attr(handle, i, PAPI_DEV_ATTR__CPU_UINT_THR_UNCORE_READER, &reader[i]);
+        if (retval != PAPI_OK) {
+            test_fail(__FILE__, __LINE__, "PAPI_get_dev_attr failed\n", retval);
+        }
+    }
+
+    if (PAPI_get_dev_attr(handle, threads + MAX_THREADS, PAPI_DEV_ATTR__CPU_UINT_THR_CORE_AFFINITY, &value) != PAPI_EINVAL) {
+        test_fail(__FILE__, __LINE__, "Out of range thread accepted\n", 0);
+    }
+
+    if (!quiet) {
+        printf("Thread Socket Numa Core L2 L3 UncoreReader\n");
+        for (i = 0; i < (int) threads; ++i) {
+            printf("%6d %6u %4u %4u %2u %2u %12u\n",
+                   i, socket[i], numa[i], core[i], l2[i], l3[i], reader[i]);
+        }
+    }
+
+    for (i = 0; i < (int) threads; ++i) {
+        if (reader[i] >= threads || socket[reader[i]] != socket[i]) {
+            test_fail(__FILE__, __LINE__, "Uncore reader on another socket\n", i);
+        }
+        for (j = 0; j < i; ++j) {
+            if (core[i] == core[j] && l2[i] != l2[j]) {
+                test_fail(__FILE__, __LINE__, "Siblings in different L2 domains\n", i);
+            }
+            if (l2[i] == l2[j] && l3[i] != l3[j]) {
+                test_fail(__FILE__, __LINE__, "L2 domain across L3 domains\n", i);
+            }
+            if (l3[i] == l3[j] && socket[i] != socket[j]) {
+                test_fail(__FILE__, __LINE__, "L3 domain across sockets\n", i);
+            }
+            if (socket[i] == socket[j] && reader[i] != reader[j]) {
+                test_fail(__FILE__, __LINE__, "Socket with two uncore readers\n", i);
+            }
+        }
+    }
+
+    PAPI_shutdown();
+    test_pass(__FILE__);
+    return 0;
+}
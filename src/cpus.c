@@ -16,37 +16,120 @@
 #include "papi_vector.h"
 #include "papi_memory.h"
 #include "cpus.h"
+#include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 
-/* The list of cpus; this gets built as user apps set the cpu papi */
-/* option on an event set */
+/* The table of cpus; entries get filled in as user apps set the cpu   */
+/* papi option on an event set.  It is indexed by cpu number and sized */
+/* for every configured cpu, so lookups need neither a list walk nor   */
+/* CPUS_LOCK.  Entries are only created and removed with CPUS_LOCK     */
+/* held, and are published with release stores.                        */
 
-static CpuInfo_t *_papi_hwi_cpu_head;
+static CpuInfo_t **_papi_hwi_cpu_table;
+static unsigned int _papi_hwi_cpu_table_size;
 
+/* Cpu numbers grouped by NUMA node, the order used to walk the table */
+static unsigned int *_papi_hwi_cpu_order;
+
+#if defined(__linux__)
+/* Append the cpus of a sysfs cpulist ("0-3,8,10-11") to order[] */
+static unsigned int
+parse_cpulist( const char *path, unsigned int *order, unsigned int count,
+	       unsigned char *seen )
+{
+   FILE *fff;
+   unsigned int first, last, cpu;
+   int c;
+
+   fff = fopen( path, "r" );
+   if ( fff == NULL ) return count;
+
+   while ( fscanf( fff, "%u", &first ) == 1 ) {
+      last = first;
+      c = fgetc( fff );
+      if ( c == '-' ) {
+	 if ( fscanf( fff, "%u", &last ) != 1 ) break;
+	 c = fgetc( fff );
+      }
+      for ( cpu = first; cpu <= last; cpu++ ) {
+	 if ( cpu >= _papi_hwi_cpu_table_size || seen[cpu] ) continue;
+	 seen[cpu] = 1;
+	 order[count++] = cpu;
+      }
+      if ( c != ',' ) break;
+   }
+   fclose( fff );
+
+   return count;
+}
+#endif
+
+/* Must be called with CPUS_LOCK held! */
+static int
+allocate_cpu_table( void )
+{
+   unsigned int *order, count = 0, cpu;
+   unsigned char *seen;
+   CpuInfo_t **table;
+   long ncpus;
+#if defined(__linux__)
+   char path[PATH_MAX];
+   int node;
+#endif
+
+   ncpus = sysconf( _SC_NPROCESSORS_CONF );
+   if ( ncpus < 1 ) ncpus = 1;
+
+   table = papi_calloc( ( size_t ) ncpus, sizeof ( CpuInfo_t * ) );
+   order = papi_calloc( ( size_t ) ncpus, sizeof ( unsigned int ) );
+   seen = papi_calloc( ( size_t ) ncpus, sizeof ( unsigned char ) );
+   if ( table == NULL || order == NULL || seen == NULL ) {
+      if ( table ) papi_free( table );
+      if ( order ) papi_free( order );
+      if ( seen ) papi_free( seen );
+      return PAPI_ENOMEM;
+   }
+
+   _papi_hwi_cpu_table_size = ( unsigned int ) ncpus;
+
+#if defined(__linux__)
+   for ( node = 0; ; node++ ) {
+      snprintf( path, sizeof ( path ),
+		"/sys/devices/system/node/node%d/cpulist", node );
+      if ( access( path, R_OK ) ) break;
+      count = parse_cpulist( path, order, count, seen );
+   }
+#endif
+
+   /* cpus without NUMA information go last, in numerical order */
+   for ( cpu = 0; cpu < _papi_hwi_cpu_table_size; cpu++ ) {
+      if ( !seen[cpu] ) order[count++] = cpu;
+   }
+   papi_free( seen );
+
+   _papi_hwi_cpu_order = order;
+   __atomic_store_n( &_papi_hwi_cpu_table, table, __ATOMIC_RELEASE );
+
+   THRDBG( "Allocated cpu table for %u cpus\n", _papi_hwi_cpu_table_size );
+
+   return PAPI_OK;
+}
 
 static CpuInfo_t *
 _papi_hwi_lookup_cpu( unsigned int cpu_num )
 {
    APIDBG("Entry:\n");
 
-   CpuInfo_t *tmp;
+   CpuInfo_t **table, *tmp = NULL;
 
-   tmp = ( CpuInfo_t * ) _papi_hwi_cpu_head;
-   while ( tmp != NULL ) {
-      THRDBG( "Examining cpu %#x at %p\n", tmp->cpu_num, tmp );
-      if ( tmp->cpu_num == cpu_num ) {
-	 break;
-      }
-      tmp = tmp->next;
-      if ( tmp == _papi_hwi_cpu_head ) {
-	 tmp = NULL;
-	 break;
-      }
+   table = __atomic_load_n( &_papi_hwi_cpu_table, __ATOMIC_ACQUIRE );
+   if ( table != NULL && cpu_num < _papi_hwi_cpu_table_size ) {
+      tmp = __atomic_load_n( &table[cpu_num], __ATOMIC_ACQUIRE );
    }
 
    if ( tmp ) {
-      _papi_hwi_cpu_head = tmp;
       THRDBG( "Found cpu %#x at %p\n", cpu_num, tmp );
    } else {
       THRDBG( "Did not find cpu %#x\n", cpu_num );
@@ -65,15 +148,26 @@ _papi_hwi_lookup_or_create_cpu( CpuInfo_t **here, unsigned int cpu_num )
 
    _papi_hwi_lock( CPUS_LOCK );
 
-   tmp = _papi_hwi_lookup_cpu(cpu_num);
-   if ( tmp == NULL ) {
-      retval = _papi_hwi_initialize_cpu( &tmp, cpu_num );
+   if ( _papi_hwi_cpu_table == NULL ) {
+      retval = allocate_cpu_table(  );
    }
 
-   /* Increment use count */
-   tmp->num_users++;
+   if ( retval == PAPI_OK && cpu_num >= _papi_hwi_cpu_table_size ) {
+      THRDBG( "Cpu %u is beyond the %u configured cpus\n",
+	      cpu_num, _papi_hwi_cpu_table_size );
+      retval = PAPI_EINVAL;
+   }
 
    if ( retval == PAPI_OK ) {
+      tmp = _papi_hwi_lookup_cpu(cpu_num);
+      if ( tmp == NULL ) {
+	 retval = _papi_hwi_initialize_cpu( &tmp, cpu_num );
+      }
+   }
+
+   if ( retval == PAPI_OK ) {
+      /* Increment use count */
+      tmp->num_users++;
       *here = tmp;
    }
 
@@ -82,6 +176,66 @@ _papi_hwi_lookup_or_create_cpu( CpuInfo_t **here, unsigned int cpu_num )
    return retval;
 }
 
+/* Collect the event sets of component cidx that are running on a cpu, */
+/* in NUMA order, at most max of them.  Returns how many are running.  */
+/* Must be called with CPUS_LOCK held!  The event sets stay running    */
+/* until it is released, see _papi_hwi_set_running_cpu_eventset().     */
+int
+_papi_hwi_get_running_cpu_eventsets( int cidx, EventSetInfo_t **esis,
+				     unsigned int *cpus, int max )
+{
+   CpuInfo_t **table, *cpu;
+   EventSetInfo_t *ESI;
+   unsigned int i;
+   int count = 0;
+
+   table = _papi_hwi_cpu_table;
+   if ( table == NULL ) return 0;
+
+   for ( i = 0; i < _papi_hwi_cpu_table_size; i++ ) {
+      cpu = table[_papi_hwi_cpu_order[i]];
+      if ( cpu == NULL ) continue;
+      ESI = cpu->running_eventset[cidx];
+      if ( ESI == NULL ) continue;
+      if ( count < max ) {
+	 esis[count] = ESI;
+	 cpus[count] = cpu->cpu_num;
+      }
+      count++;
+   }
+
+   return count;
+}
+
+/* Set the event set of component cidx running on cpu, NULL once it */
+/* stops.  CPUS_LOCK makes this wait for a PAPI_read_cpus() that may */
+/* be reading the previous one.                                      */
+void
+_papi_hwi_set_running_cpu_eventset( CpuInfo_t *cpu, int cidx,
+				    EventSetInfo_t *ESI )
+{
+   _papi_hwi_lock( CPUS_LOCK );
+   cpu->running_eventset[cidx] = ESI;
+   _papi_hwi_unlock( CPUS_LOCK );
+}
+
+/* Free the cpu table, all cpus must have been shut down */
+void
+_papi_hwi_shutdown_global_cpus( void )
+{
+   _papi_hwi_lock( CPUS_LOCK );
+
+   if ( _papi_hwi_cpu_table != NULL ) {
+      papi_free( _papi_hwi_cpu_table );
+      papi_free( _papi_hwi_cpu_order );
+      _papi_hwi_cpu_table = NULL;
+      _papi_hwi_cpu_order = NULL;
+      _papi_hwi_cpu_table_size = 0;
+   }
+
+   _papi_hwi_unlock( CPUS_LOCK );
+}
+
 
 static CpuInfo_t *
 allocate_cpu( unsigned int cpu_num )
@@ -145,42 +299,18 @@ static int
 remove_cpu( CpuInfo_t * entry )
 {
    APIDBG("Entry: entry: %p\n", entry);
-	
-   CpuInfo_t *tmp = NULL, *prev = NULL;
-
-   THRDBG( "_papi_hwi_cpu_head was cpu %d at %p\n",
-			_papi_hwi_cpu_head->cpu_num, _papi_hwi_cpu_head );
 
-	/* Find the preceding element and the matched element,
-	   short circuit if we've seen the head twice */
-
-   for ( tmp = ( CpuInfo_t * ) _papi_hwi_cpu_head;
-       ( entry != tmp ) || ( prev == NULL ); tmp = tmp->next ) {
-       prev = tmp;
-   }
-
-   if ( tmp != entry ) {
-      THRDBG( "Cpu %d at %p was not found in the cpu list!\n",
+   if ( entry->cpu_num >= _papi_hwi_cpu_table_size ||
+	_papi_hwi_cpu_table[entry->cpu_num] != entry ) {
+      THRDBG( "Cpu %d at %p was not found in the cpu table!\n",
 				entry->cpu_num, entry );
       return PAPI_EBUG;
    }
 
-   /* Only 1 element in list */
+   __atomic_store_n( &_papi_hwi_cpu_table[entry->cpu_num], NULL,
+		     __ATOMIC_RELEASE );
 
-   if ( prev == tmp ) {
-      _papi_hwi_cpu_head = NULL;
-      tmp->next = NULL;
-      THRDBG( "_papi_hwi_cpu_head now NULL\n" );
-   } else {
-      prev->next = tmp->next;
-      /* If we're removing the head, better advance it! */
-      if ( _papi_hwi_cpu_head == tmp ) {
-	 _papi_hwi_cpu_head = tmp->next;
-	 THRDBG( "_papi_hwi_cpu_head now cpu %d at %p\n",
-		 _papi_hwi_cpu_head->cpu_num, _papi_hwi_cpu_head );
-      }
-      THRDBG( "Removed cpu %p from list\n", tmp );
-   }
+   THRDBG( "Removed cpu %p from table\n", entry );
 
    return PAPI_OK;
 }
@@ -244,28 +374,11 @@ insert_cpu( CpuInfo_t * entry )
 {
    APIDBG("Entry: entry: %p\n", entry);
 
-   if ( _papi_hwi_cpu_head == NULL ) {	
-      /* 0 elements */
-      THRDBG( "_papi_hwi_cpu_head is NULL\n" );
-      entry->next = entry;
-   } else if ( _papi_hwi_cpu_head->next == _papi_hwi_cpu_head ) {
-      /* 1 element */
-      THRDBG( "_papi_hwi_cpu_head was cpu %d at %p\n",
-              _papi_hwi_cpu_head->cpu_num, _papi_hwi_cpu_head );
-      _papi_hwi_cpu_head->next = entry;
-      entry->next = ( CpuInfo_t * ) _papi_hwi_cpu_head;
-   } else {
-      /* 2+ elements */
-      THRDBG( "_papi_hwi_cpu_head was cpu %d at %p\n",
-	      _papi_hwi_cpu_head->cpu_num, _papi_hwi_cpu_head );
-      entry->next = _papi_hwi_cpu_head->next;
-      _papi_hwi_cpu_head->next = entry;
-   }
-
-   _papi_hwi_cpu_head = entry;
+   /* The entry is fully set up before other threads can see it */
+   __atomic_store_n( &_papi_hwi_cpu_table[entry->cpu_num], entry,
+		     __ATOMIC_RELEASE );
 
-   THRDBG( "_papi_hwi_cpu_head now cpu %d at %p\n",
-	   _papi_hwi_cpu_head->cpu_num, _papi_hwi_cpu_head );
+   THRDBG( "Inserted cpu %d at %p\n", entry->cpu_num, entry );
 }
 
 
@@ -10,7 +10,6 @@
 typedef struct _CpuInfo
 {
 	unsigned int cpu_num;
-	struct _CpuInfo *next;
   	hwd_context_t **context;
 	EventSetInfo_t **running_eventset;
   	EventSetInfo_t *from_esi;          /* ESI used for last update this control state */
@@ -20,5 +19,10 @@ typedef struct _CpuInfo
 int _papi_hwi_initialize_cpu( CpuInfo_t **dest, unsigned int cpu_num );
 int _papi_hwi_shutdown_cpu( CpuInfo_t *cpu );
 int _papi_hwi_lookup_or_create_cpu( CpuInfo_t ** here, unsigned int cpu_num );
+int _papi_hwi_get_running_cpu_eventsets( int cidx, EventSetInfo_t **esis,
+					 unsigned int *cpus, int max );
+void _papi_hwi_set_running_cpu_eventset( CpuInfo_t *cpu, int cidx,
+					 EventSetInfo_t *ESI );
+void _papi_hwi_shutdown_global_cpus( void );
 
 #endif
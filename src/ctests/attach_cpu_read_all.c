@@ -0,0 +1,164 @@
+/*
+ * This test case attaches one event set to every cpu, starts them all
+ * and reads them back with a single PAPI_read_cpus() call.
+ *
+ * Every cpu must show up exactly once in the result, and the counts
+ * must match what PAPI_read() reports for the same event set.
+ *
+ * perf::CPU-CLOCK and perf::PAGE-FAULTS are used as they are available
+ * even without hardware counters.  Measuring cpus needs privileges, the test is skipped
+ * when the attach is refused.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "do_loops.h"
+
+#define NUM_EVENTS 2
+
+static const char *event_names[NUM_EVENTS] = {
+	"perf::CPU-CLOCK",
+	"perf::PAGE-FAULTS",
+};
+
+int
+main( int argc, char **argv )
+{
+	int retval, i, j, ncpus, num_rows, quiet;
+	int *eventsets, *cpus, *seen;
+	long long *matrix, values[NUM_EVENTS];
+	PAPI_option_t opts;
+
+	/* Set TESTS_QUIET variable */
+	quiet = tests_quiet( argc, argv );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT )
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+
+	ncpus = ( int ) sysconf( _SC_NPROCESSORS_ONLN );
+	if ( ncpus < 1 )
+		test_skip( __FILE__, __LINE__, "sysconf", ncpus );
+
+	eventsets = malloc( ncpus * sizeof ( int ) );
+	cpus = malloc( ncpus * sizeof ( int ) );
+	seen = calloc( ncpus, sizeof ( int ) );
+	matrix = malloc( ncpus * NUM_EVENTS * sizeof ( long long ) );
+	if ( !eventsets || !cpus || !seen || !matrix )
+		test_fail( __FILE__, __LINE__, "malloc", PAPI_ENOMEM );
+
+	for ( i = 0; i < ncpus; i++ ) {
+		eventsets[i] = PAPI_NULL;
+
+		retval = PAPI_create_eventset( &eventsets[i] );
+		if ( retval != PAPI_OK )
+			test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+
+		// perf_events component provides the software events
+		retval = PAPI_assign_eventset_component( eventsets[i], 0 );
+		if ( retval != PAPI_OK )
+			test_fail( __FILE__, __LINE__, "PAPI_assign_eventset_component", retval );
+
+		opts.cpu.eventset = eventsets[i];
+		opts.cpu.cpu_num = i;
+		retval = PAPI_set_opt( PAPI_CPU_ATTACH, &opts );
+		if ( retval != PAPI_OK ) {
+			if (!quiet) printf("Can't PAPI_CPU_ATTACH: %s\n",
+					PAPI_strerror(retval));
+			test_skip( __FILE__, __LINE__, "PAPI_set_opt", retval );
+		}
+
+		for ( j = 0; j < NUM_EVENTS; j++ ) {
+			retval = PAPI_add_named_event( eventsets[i], event_names[j] );
+			if ( retval != PAPI_OK ) {
+				if (!quiet) printf("Trouble adding event %s\n",
+						event_names[j]);
+				test_skip( __FILE__, __LINE__, "PAPI_add_named_event", retval );
+			}
+		}
+
+		retval = PAPI_start( eventsets[i] );
+		if ( retval != PAPI_OK ) {
+			if (!quiet) printf("Can't start on cpu %d: %s\n", i,
+					PAPI_strerror(retval));
+			test_skip( __FILE__, __LINE__, "PAPI_start", retval );
+		}
+	}
+
+	// do some work
+	do_flops( NUM_FLOPS );
+
+	num_rows = ncpus;
+	retval = PAPI_read_cpus( 0, cpus, matrix, &num_rows, NUM_EVENTS );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_read_cpus", retval );
+
+	if ( num_rows != ncpus )
+		test_fail( __FILE__, __LINE__, "PAPI_read_cpus missed cpus",
+			   num_rows );
+
+	for ( i = 0; i < num_rows; i++ ) {
+		if ( cpus[i] < 0 || cpus[i] >= ncpus || seen[cpus[i]]++ )
+			test_fail( __FILE__, __LINE__, "bad cpu in result", cpus[i] );
+		for ( j = 0; j < NUM_EVENTS && !quiet; j++ ) {
+			printf ("Event: %s: %12lld on Cpu: %d\n", event_names[j],
+				matrix[i * NUM_EVENTS + j], cpus[i]);
+		}
+	}
+
+	// A later read of the same event set can only have counted more
+	for ( i = 0; i < num_rows; i++ ) {
+		retval = PAPI_read( eventsets[cpus[i]], values );
+		if ( retval != PAPI_OK )
+			test_fail( __FILE__, __LINE__, "PAPI_read", retval );
+		for ( j = 0; j < NUM_EVENTS; j++ ) {
+			if ( values[j] < matrix[i * NUM_EVENTS + j] )
+				test_fail( __FILE__, __LINE__, "count went backwards",
+					   cpus[i] );
+		}
+	}
+
+	// Too few rows are refused with the number needed
+	if ( ncpus > 1 ) {
+		num_rows = ncpus - 1;
+		retval = PAPI_read_cpus( 0, cpus, matrix, &num_rows, NUM_EVENTS );
+		if ( retval != PAPI_EBUF || num_rows != ncpus )
+			test_fail( __FILE__, __LINE__, "PAPI_read_cpus too few rows",
+				   retval );
+	}
+
+	// A row too short for the event set is refused
+	num_rows = ncpus;
+	retval = PAPI_read_cpus( 0, cpus, matrix, &num_rows, NUM_EVENTS - 1 );
+	if ( retval != PAPI_EINVAL )
+		test_fail( __FILE__, __LINE__, "PAPI_read_cpus short row", retval );
+
+	for ( i = 0; i < ncpus; i++ ) {
+		retval = PAPI_stop( eventsets[i], values );
+		if ( retval != PAPI_OK )
+			test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	// Nothing is running any more
+	num_rows = ncpus;
+	retval = PAPI_read_cpus( 0, cpus, matrix, &num_rows, NUM_EVENTS );
+	if ( retval != PAPI_OK || num_rows != 0 )
+		test_fail( __FILE__, __LINE__, "PAPI_read_cpus after stop", num_rows );
+
+	free( eventsets );
+	free( cpus );
+	free( seen );
+	free( matrix );
+
+	PAPI_shutdown( );
+
+	test_pass( __FILE__ );
+
+	return 0;
+
+}
@@ -0,0 +1,177 @@
+/*
+ * Attach one EventSet to several threads with PAPI_attach_tids, read
+ * them in two ranges with PAPI_read_tids, and check that a thread that
+ * exits is flagged, keeps its counts, and can be detached.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "do_loops.h"
+
+#define NUM_WORKERS 4
+#define MAX_ROWS ( NUM_WORKERS + 1 )
+
+static volatile int tids[NUM_WORKERS + 1];
+static volatile int quit[NUM_WORKERS];
+
+static void *
+worker( void *arg )
+{
+	int me = ( int ) ( long ) arg;
+
+	tids[me] = ( int ) syscall( SYS_gettid );
+	if ( me == NUM_WORKERS )
+		return NULL;
+	while ( !quit[me] )
+		do_flops( NUM_FLOPS / 100 );
+
+	return NULL;
+}
+
+/* Read all the attached threads, in two ranges */
+static int
+read_all( int EventSet, int *rows, long long *values )
+{
+	int n1 = 2, n2 = MAX_ROWS, retval;
+
+	retval = PAPI_read_tids( EventSet, 0, rows, values, &n1, 1 );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_read_tids", retval );
+	retval = PAPI_read_tids( EventSet, n1, rows + n1, values + n1, &n2, 1 );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_read_tids", retval );
+
+	return n1 + n2;
+}
+
+int
+main( int argc, char **argv )
+{
+	int retval, i, n, tries, EventSet = PAPI_NULL;
+	int attach[NUM_WORKERS + 1], rows[MAX_ROWS];
+	long long values[MAX_ROWS];
+	pthread_t thr[NUM_WORKERS + 1];
+	const PAPI_component_info_t *cmpinfo;
+	char event_name[PAPI_MAX_STR_LEN];
+	int quiet;
+
+	quiet = tests_quiet( argc, argv );
+
+	if ( ( retval = PAPI_library_init( PAPI_VER_CURRENT ) ) != PAPI_VER_CURRENT )
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+
+	cmpinfo = PAPI_get_component_info( 0 );
+	if ( cmpinfo == NULL || !cmpinfo->attach_tids )
+		test_skip( __FILE__, __LINE__, "Component does not support attach_tids", 0 );
+
+	/* the last one is gone by the time it is attached */
+	for ( i = 0; i <= NUM_WORKERS; i++ ) {
+		if ( pthread_create( &thr[i], NULL, worker, ( void * ) ( long ) i ) != 0 )
+			test_fail( __FILE__, __LINE__, "pthread_create", PAPI_ESYS );
+	}
+	pthread_join( thr[NUM_WORKERS], NULL );
+	for ( i = 0; i <= NUM_WORKERS; i++ ) {
+		while ( tids[i] == 0 )
+			usleep( 1000 );
+		attach[i] = tids[i];
+	}
+
+	if ( ( retval = PAPI_create_eventset( &EventSet ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+
+	strcpy( event_name, "PAPI_TOT_CYC" );
+	retval = PAPI_add_named_event( EventSet, event_name );
+	if ( retval != PAPI_OK ) {
+		strcpy( event_name, "perf::TASK-CLOCK" );
+		retval = PAPI_add_named_event( EventSet, event_name );
+	}
+	if ( retval != PAPI_OK ) {
+		if ( !quiet ) printf( "Could not add PAPI_TOT_CYC or perf::TASK-CLOCK\n" );
+		test_skip( __FILE__, __LINE__, "PAPI_add_named_event", retval );
+	}
+
+	retval = PAPI_attach_tids( EventSet, attach, NUM_WORKERS + 1 );
+	if ( retval == PAPI_EPERM )
+		test_skip( __FILE__, __LINE__, "PAPI_attach_tids", retval );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_attach_tids", retval );
+
+	if ( ( retval = PAPI_start( EventSet ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+
+	do_flops( NUM_FLOPS );
+
+	n = read_all( EventSet, rows, values );
+	if ( n != NUM_WORKERS + 1 )
+		test_fail( __FILE__, __LINE__, "Wrong number of rows", n );
+
+	for ( i = 0; i < n; i++ ) {
+		if ( !quiet )
+			printf( "tid %6d: %s %lld\n", rows[i], event_name, values[i] );
+		if ( rows[i] == -attach[NUM_WORKERS] ) {
+			if ( values[i] != 0 )
+				test_fail( __FILE__, __LINE__, "Exited thread counted", 1 );
+		} else if ( rows[i] <= 0 || values[i] <= 0 ) {
+			test_fail( __FILE__, __LINE__, "Live thread not counted", 1 );
+		}
+	}
+
+	/* one more exits, and is noticed within a few reads */
+	quit[0] = 1;
+	pthread_join( thr[0], NULL );
+	for ( tries = 0; tries < 10; tries++ ) {
+		n = read_all( EventSet, rows, values );
+		for ( i = 0; i < n; i++ ) {
+			if ( rows[i] == -attach[0] )
+				break;
+		}
+		if ( i < n )
+			break;
+		usleep( 10000 );
+	}
+	if ( tries == 10 )
+		test_fail( __FILE__, __LINE__, "Exit not noticed", 1 );
+	if ( values[i] <= 0 )
+		test_fail( __FILE__, __LINE__, "Exited thread lost its counts", 1 );
+	if ( !quiet )
+		printf( "tid %6d exited with %lld\n", attach[0], values[i] );
+
+	/* detach the exited ones, as returned */
+	attach[0] = rows[i];
+	attach[1] = -attach[NUM_WORKERS];
+	if ( ( retval = PAPI_detach_tids( EventSet, attach, 2 ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_detach_tids", retval );
+
+	n = read_all( EventSet, rows, values );
+	if ( n != NUM_WORKERS - 1 )
+		test_fail( __FILE__, __LINE__, "Wrong number of rows after detach", n );
+	for ( i = 0; i < n; i++ ) {
+		if ( rows[i] <= 0 )
+			test_fail( __FILE__, __LINE__, "Exited thread still attached", 1 );
+	}
+
+	if ( ( retval = PAPI_stop( EventSet, values ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+
+	for ( i = 1; i < NUM_WORKERS; i++ ) {
+		quit[i] = 1;
+		pthread_join( thr[i], NULL );
+	}
+
+	if ( ( retval = PAPI_cleanup_eventset( EventSet ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_cleanup_eventset", retval );
+	if ( ( retval = PAPI_destroy_eventset( &EventSet ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset", retval );
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
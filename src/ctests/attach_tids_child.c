@@ -0,0 +1,148 @@
+/*
+ * Attach the tid of a forked child with PAPI_attach_tids, and check
+ * that PAPI_read_tids keeps it live while the child sleeps, with counts
+ * that do not move, and flags it once the child is gone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "do_loops.h"
+
+static void
+kill_child( pid_t pid )
+{
+	kill( pid, SIGKILL );
+	waitpid( pid, NULL, 0 );
+}
+
+int
+main( int argc, char **argv )
+{
+	int retval, i, n, row, EventSet = PAPI_NULL;
+	int pipefd[2];
+	long long value;
+	pid_t pid;
+	const PAPI_component_info_t *cmpinfo;
+	char event_name[PAPI_MAX_STR_LEN];
+	char c;
+	int quiet;
+
+	quiet = tests_quiet( argc, argv );
+
+	if ( ( retval = PAPI_library_init( PAPI_VER_CURRENT ) ) != PAPI_VER_CURRENT )
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+
+	cmpinfo = PAPI_get_component_info( 0 );
+	if ( cmpinfo == NULL || !cmpinfo->attach_tids )
+		test_skip( __FILE__, __LINE__, "Component does not support attach_tids", 0 );
+
+	/* the child works a little, then sleeps until it is killed */
+	if ( pipe( pipefd ) != 0 )
+		test_fail( __FILE__, __LINE__, "pipe", PAPI_ESYS );
+	pid = fork(  );
+	if ( pid < 0 )
+		test_fail( __FILE__, __LINE__, "fork", PAPI_ESYS );
+	if ( pid == 0 ) {
+		close( pipefd[1] );
+		if ( read( pipefd[0], &c, 1 ) != 1 )
+			_exit( 1 );
+		do_flops( NUM_FLOPS );
+		for ( ;; )
+			pause(  );
+	}
+	close( pipefd[0] );
+
+	if ( ( retval = PAPI_create_eventset( &EventSet ) ) != PAPI_OK ) {
+		kill_child( pid );
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	}
+
+	strcpy( event_name, "PAPI_TOT_CYC" );
+	retval = PAPI_add_named_event( EventSet, event_name );
+	if ( retval != PAPI_OK ) {
+		strcpy( event_name, "perf::TASK-CLOCK" );
+		retval = PAPI_add_named_event( EventSet, event_name );
+	}
+	if ( retval != PAPI_OK ) {
+		kill_child( pid );
+		if ( !quiet ) printf( "Could not add PAPI_TOT_CYC or perf::TASK-CLOCK\n" );
+		test_skip( __FILE__, __LINE__, "PAPI_add_named_event", retval );
+	}
+
+	row = ( int ) pid;
+	retval = PAPI_attach_tids( EventSet, &row, 1 );
+	if ( retval != PAPI_OK ) {
+		kill_child( pid );
+		if ( retval == PAPI_EPERM )
+			test_skip( __FILE__, __LINE__, "PAPI_attach_tids", retval );
+		test_fail( __FILE__, __LINE__, "PAPI_attach_tids", retval );
+	}
+
+	if ( ( retval = PAPI_start( EventSet ) ) != PAPI_OK ) {
+		kill_child( pid );
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	if ( write( pipefd[1], "x", 1 ) != 1 ) {
+		kill_child( pid );
+		test_fail( __FILE__, __LINE__, "write", PAPI_ESYS );
+	}
+	close( pipefd[1] );
+
+	/* idle but alive: the counts stop moving, the tid stays live */
+	for ( i = 0; i < 10; i++ ) {
+		usleep( 50000 );
+		n = 1;
+		retval = PAPI_read_tids( EventSet, 0, &row, &value, &n, 1 );
+		if ( retval != PAPI_OK ) {
+			kill_child( pid );
+			test_fail( __FILE__, __LINE__, "PAPI_read_tids", retval );
+		}
+		if ( !quiet )
+			printf( "tid %6d: %s %lld\n", row, event_name, value );
+		if ( n != 1 || row != ( int ) pid ) {
+			kill_child( pid );
+			test_fail( __FILE__, __LINE__, "Sleeping child taken as exited", row );
+		}
+	}
+	if ( value <= 0 ) {
+		kill_child( pid );
+		test_fail( __FILE__, __LINE__, "Child not counted", 1 );
+	}
+
+	/* gone: noticed within a few reads */
+	kill_child( pid );
+	for ( i = 0; i < 10; i++ ) {
+		n = 1;
+		retval = PAPI_read_tids( EventSet, 0, &row, &value, &n, 1 );
+		if ( retval != PAPI_OK )
+			test_fail( __FILE__, __LINE__, "PAPI_read_tids", retval );
+		if ( row < 0 )
+			break;
+		usleep( 10000 );
+	}
+	if ( !quiet )
+		printf( "tid %6d exited with %lld\n", row, value );
+	if ( n != 1 || row != -( int ) pid )
+		test_fail( __FILE__, __LINE__, "Exit not noticed", row );
+
+	if ( ( retval = PAPI_stop( EventSet, NULL ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	if ( ( retval = PAPI_cleanup_eventset( EventSet ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_cleanup_eventset", retval );
+	if ( ( retval = PAPI_destroy_eventset( &EventSet ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset", retval );
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
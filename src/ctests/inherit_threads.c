@@ -0,0 +1,130 @@
+/*
+ * Count every thread of the process with PAPI_INHERIT_THREADS, from a
+ * main thread that does next to nothing itself: some workers exist
+ * before the events are added, one is created after PAPI_start.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "do_loops.h"
+
+#define NUM_EARLY 2
+#define NUM_WORKERS ( NUM_EARLY + 1 )
+
+static pthread_mutex_t go_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t go_cond = PTHREAD_COND_INITIALIZER;
+static int go;
+
+static void *
+worker( void *arg )
+{
+	( void ) arg;
+
+	pthread_mutex_lock( &go_lock );
+	while ( !go )
+		pthread_cond_wait( &go_cond, &go_lock );
+	pthread_mutex_unlock( &go_lock );
+
+	do_flops( NUM_FLOPS );
+
+	return NULL;
+}
+
+int
+main( int argc, char **argv )
+{
+	int retval, i, EventSet = PAPI_NULL;
+	long long all, one;
+	pthread_t tid[NUM_WORKERS];
+	PAPI_option_t opt;
+	char event_name[PAPI_MAX_STR_LEN];
+	int quiet;
+
+	quiet = tests_quiet( argc, argv );
+
+	if ( ( retval = PAPI_library_init( PAPI_VER_CURRENT ) ) != PAPI_VER_CURRENT )
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+
+	/* these exist before the events are opened */
+	for ( i = 0; i < NUM_EARLY; i++ ) {
+		if ( pthread_create( &tid[i], NULL, worker, NULL ) != 0 )
+			test_fail( __FILE__, __LINE__, "pthread_create", PAPI_ESYS );
+	}
+
+	if ( ( retval = PAPI_create_eventset( &EventSet ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+
+	if ( ( retval = PAPI_assign_eventset_component( EventSet, 0 ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_assign_eventset_component", retval );
+
+	memset( &opt, 0x0, sizeof ( PAPI_option_t ) );
+	opt.inherit.inherit = PAPI_INHERIT_THREADS;
+	opt.inherit.eventset = EventSet;
+	if ( ( retval = PAPI_set_opt( PAPI_INHERIT, &opt ) ) != PAPI_OK ) {
+		if ( ( retval == PAPI_ECMP ) || ( retval == PAPI_EPERM ) ) {
+			test_skip( __FILE__, __LINE__,
+				"Inherit threads not supported by current component.\n", retval );
+		}
+		test_fail( __FILE__, __LINE__, "PAPI_set_opt", retval );
+	}
+
+	strcpy( event_name, "PAPI_TOT_CYC" );
+	retval = PAPI_add_named_event( EventSet, event_name );
+	if ( retval != PAPI_OK ) {
+		strcpy( event_name, "perf::TASK-CLOCK" );
+		retval = PAPI_add_named_event( EventSet, event_name );
+	}
+	if ( retval != PAPI_OK ) {
+		if ( !quiet ) printf( "Could not add PAPI_TOT_CYC or perf::TASK-CLOCK\n" );
+		test_skip( __FILE__, __LINE__, "PAPI_add_named_event", retval );
+	}
+
+	if ( ( retval = PAPI_start( EventSet ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+
+	/* and this one inherits from us */
+	if ( pthread_create( &tid[NUM_EARLY], NULL, worker, NULL ) != 0 )
+		test_fail( __FILE__, __LINE__, "pthread_create", PAPI_ESYS );
+
+	pthread_mutex_lock( &go_lock );
+	go = 1;
+	pthread_cond_broadcast( &go_cond );
+	pthread_mutex_unlock( &go_lock );
+
+	for ( i = 0; i < NUM_WORKERS; i++ )
+		pthread_join( tid[i], NULL );
+
+	if ( ( retval = PAPI_read( EventSet, &all ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_read", retval );
+
+	/* the same work once, in this thread */
+	if ( ( retval = PAPI_reset( EventSet ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_reset", retval );
+
+	do_flops( NUM_FLOPS );
+
+	if ( ( retval = PAPI_stop( EventSet, &one ) ) != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+
+	if ( !quiet ) {
+		printf( "Test case inherit_threads: %d workers, %d started before "
+			"the events were added.\n", NUM_WORKERS, NUM_EARLY );
+		printf( "%s all threads:\t%lld\n", event_name, all );
+		printf( "%s one thread:\t%lld\n", event_name, one );
+		printf( "Verification: all threads >= %d x one thread\n",
+			NUM_WORKERS - 1 );
+	}
+
+	if ( all < ( NUM_WORKERS - 1 ) * one )
+		test_fail( __FILE__, __LINE__, "Threads missing from the count", 1 );
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * File:    lazy_init.c
+ */
+
+/*
+  This tests PAPI_LAZY_INIT, the deferred initialization of components.
+
+  A minimal perf_event-only program is timed twice, each in its own
+  child: once with every component initialized by PAPI_library_init()
+  and once with the non-perf_event components deferred. The startup
+  latency and the resident set growth of both runs are reported.
+
+  It also checks that a deferred component is brought up by its
+  first reference through PAPI_get_component_info().
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+static long
+resident_kb( void )
+{
+	FILE *fff;
+	long size, resident;
+
+	fff = fopen( "/proc/self/statm", "r" );
+	if ( fff == NULL ) return 0;
+	if ( fscanf( fff, "%ld %ld", &size, &resident ) != 2 ) resident = 0;
+	fclose( fff );
+
+	return resident * ( sysconf( _SC_PAGESIZE ) / 1024 );
+}
+
+/* Initialize the library, then count one perf_event event */
+static int
+perf_only_run( long long *init_usec, long *rss_kb, int quiet )
+{
+	int retval, EventSet = PAPI_NULL;
+	long long start_usec, value;
+	long start_rss;
+
+	start_rss = resident_kb(  );
+	start_usec = PAPI_get_real_usec(  );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	*init_usec = PAPI_get_real_usec(  ) - start_usec;
+	*rss_kb = resident_kb(  ) - start_rss;
+
+	retval = PAPI_create_eventset( &EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	}
+
+	retval = PAPI_add_named_event( EventSet, "perf::TASK-CLOCK" );
+	if ( retval != PAPI_OK ) {
+		if ( !quiet ) printf( "Could not add perf::TASK-CLOCK\n" );
+		return retval;
+	}
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	retval = PAPI_stop( EventSet, &value );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	PAPI_cleanup_eventset( EventSet );
+	PAPI_destroy_eventset( &EventSet );
+
+	return PAPI_OK;
+}
+
+/* PAPI cannot be re-initialized after PAPI_shutdown(), so every mode
+   is measured in its own child process */
+static int
+measure( int lazy, long long *init_usec, long *rss_kb, int *woken )
+{
+	int fds[2], status, cid, numcmp;
+	long long result[3];
+	const PAPI_component_info_t *cmpinfo;
+	long rss;
+	pid_t pid;
+
+	if ( pipe( fds ) < 0 ) return PAPI_ESYS;
+
+	pid = fork(  );
+	if ( pid < 0 ) return PAPI_ESYS;
+
+	if ( pid == 0 ) {
+		close( fds[0] );
+
+		if ( lazy ) setenv( "PAPI_LAZY_INIT", "1", 1 );
+		else unsetenv( "PAPI_LAZY_INIT" );
+
+		result[2] = 0;
+		if ( perf_only_run( &result[0], &rss, TESTS_QUIET ) != PAPI_OK ) {
+			_exit( 2 );
+		}
+		result[1] = rss;
+
+		/* First reference wakes up every deferred component */
+		numcmp = PAPI_num_components(  );
+		for ( cid = 0; cid < numcmp; cid++ ) {
+			cmpinfo = PAPI_get_component_info( cid );
+			if ( cmpinfo == NULL ) _exit( 1 );
+			if ( strstr( cmpinfo->disabled_reason, "PAPI_LAZY_INIT" ) ) {
+				_exit( 1 );
+			}
+			if ( !cmpinfo->disabled ) result[2]++;
+		}
+
+		if ( write( fds[1], result, sizeof ( result ) ) != sizeof ( result ) ) {
+			_exit( 1 );
+		}
+		_exit( 0 );
+	}
+
+	close( fds[1] );
+	if ( read( fds[0], result, sizeof ( result ) ) != sizeof ( result ) ) {
+		result[0] = result[1] = result[2] = 0;
+	}
+	close( fds[0] );
+
+	waitpid( pid, &status, 0 );
+	if ( !WIFEXITED( status ) ) return PAPI_EBUG;
+	if ( WEXITSTATUS( status ) == 2 ) return PAPI_ECMP;
+	if ( WEXITSTATUS( status ) != 0 ) return PAPI_EBUG;
+
+	*init_usec = result[0];
+	*rss_kb = ( long ) result[1];
+	*woken = ( int ) result[2];
+
+	return PAPI_OK;
+}
+
+int
+main( int argc, char **argv )
+{
+	int retval, lazy_woken, eager_woken;
+	long long lazy_usec, eager_usec;
+	long lazy_rss, eager_rss;
+
+	/* Set TESTS_QUIET variable */
+	tests_quiet( argc, argv );
+
+	retval = measure( 0, &eager_usec, &eager_rss, &eager_woken );
+	if ( retval == PAPI_ECMP ) {
+		test_skip( __FILE__, __LINE__, "perf_event not usable", retval );
+	}
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "eager perf_event run", retval );
+	}
+
+	retval = measure( 1, &lazy_usec, &lazy_rss, &lazy_woken );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "lazy perf_event run", retval );
+	}
+
+	/* Once referenced, the deferred components match the eager ones */
+	if ( lazy_woken != eager_woken ) {
+		test_fail( __FILE__, __LINE__,
+			   "deferred components differ after first use",
+			   lazy_woken - eager_woken );
+	}
+
+	if ( !TESTS_QUIET ) {
+		printf( "Active components: %d\n", eager_woken );
+		printf( "PAPI_library_init  eager: %8lld us  %6ld kB RSS\n",
+			eager_usec, eager_rss );
+		printf( "PAPI_library_init  lazy:  %8lld us  %6ld kB RSS\n",
+			lazy_usec, lazy_rss );
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
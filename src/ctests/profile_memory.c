@@ -0,0 +1,250 @@
+/* This file performs the following test: memory access profiling
+
+   - Build a PAPI_PROFIL_DATA_SRC buffer by hand with accesses to a
+     global array and to the stack, served by known cache levels, and
+     check the level breakdown, latency histogram, data objects and hot
+     cache lines from PAPI_profil_memory().
+   - Write it with PAPI_PROFIL_FORMAT_MEMORY and as folded stacks.
+   - Sample a pointer chase with PAPI_PROFIL_DATA_SRC on a precise load
+     event where the processor has one.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define NUM_WORDS (1 << 16)
+#define CHASE (1 << 20)
+
+/* perf_mem_data_src levels, shifted into place */
+#define SRC_L1 ( 0x08ULL << 5 )
+#define SRC_L3 ( 0x40ULL << 5 )
+#define SRC_RAM ( 0x80ULL << 5 )
+
+static unsigned long long samples[NUM_WORDS];
+
+/* The data object the fabricated samples point at */
+long profile_memory_array[1024] __attribute__ ( ( aligned ( 64 ) ) );
+
+static size_t chase[CHASE];
+
+/* Append one [4, ip, addr, weight, data_src] record */
+static void
+record( void *ip, void *addr, unsigned long long weight,
+		unsigned long long src )
+{
+	unsigned long long used = samples[1];
+
+	samples[used] = 4;
+	samples[used + 1] = ( unsigned long long ) ( unsigned long ) ip;
+	samples[used + 2] = ( unsigned long long ) ( unsigned long ) addr;
+	samples[used + 3] = weight;
+	samples[used + 4] = src;
+	samples[1] = used + 5;
+}
+
+static void
+check_summary( void )
+{
+	PAPI_memprof_t summary;
+	long on_stack = 0;
+	int retval, i;
+
+	/* Fabricate what PAPI_profil() would set up */
+	memset( samples, 0, sizeof ( samples ) );
+	samples[0] = 0x534d454d49504150ULL;
+	samples[1] = 5;
+	samples[3] = ( unsigned long long ) PAPI_TOT_CYC;
+	samples[4] = 10000;
+
+	/* 30 RAM accesses to one line of the array, 10 L3 to another */
+	for ( i = 0; i < 30; i++ )
+		record( ( void * ) check_summary, &profile_memory_array[8 + i % 8],
+				300, SRC_RAM );
+	for ( i = 0; i < 10; i++ )
+		record( ( void * ) check_summary, &profile_memory_array[512], 40,
+				SRC_L3 );
+	/* 20 L1 hits on the stack */
+	for ( i = 0; i < 20; i++ )
+		record( ( void * ) check_summary, &on_stack, 4, SRC_L1 );
+
+	retval = PAPI_profil_memory( samples, sizeof ( samples ), &summary );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_profil_memory", retval );
+
+	if ( ( summary.samples != 60 ) ||
+		 ( summary.level_samples[PAPI_MEMPROF_LOCAL_RAM] != 30 ) ||
+		 ( summary.level_samples[PAPI_MEMPROF_L3] != 10 ) ||
+		 ( summary.level_samples[PAPI_MEMPROF_L1] != 20 ) ||
+		 ( summary.level_weight[PAPI_MEMPROF_LOCAL_RAM] != 9000 ) )
+		test_fail( __FILE__, __LINE__, "Level breakdown", 0 );
+
+	/* 4 is in bucket 2, 40 in 5 and 300 in 8 */
+	if ( ( summary.latency[2] != 20 ) || ( summary.latency[5] != 10 ) ||
+		 ( summary.latency[8] != 30 ) )
+		test_fail( __FILE__, __LINE__, "Latency histogram", 0 );
+
+	if ( ( summary.num_objects != 2 ) ||
+		 strcmp( summary.objects[0].name, "profile_memory_array" ) ||
+		 ( summary.objects[0].samples != 40 ) ||
+		 ( summary.objects[0].weight != 9400 ) ||
+		 strcmp( summary.objects[1].name, "[stack]" ) )
+		test_fail( __FILE__, __LINE__, "Data objects", 0 );
+
+	if ( ( summary.num_lines != 3 ) || ( summary.lines[0].samples != 30 ) ||
+		 ( summary.lines[0].level != PAPI_MEMPROF_LOCAL_RAM ) ||
+		 ( summary.lines[0].addr % 64 ) ||
+		 strcmp( summary.lines[0].object, "profile_memory_array" ) ||
+		 ( summary.lines[1].samples != 20 ) ||
+		 ( summary.lines[2].level != PAPI_MEMPROF_L3 ) )
+		test_fail( __FILE__, __LINE__, "Hot cache lines", 0 );
+
+	if ( !TESTS_QUIET ) {
+		for ( i = 0; i < summary.num_objects; i++ )
+			printf( "%s: %lld samples, %lld cycles\n", summary.objects[i].name,
+					summary.objects[i].samples, summary.objects[i].weight );
+	}
+}
+
+static void
+check_write( void )
+{
+	char report[] = "/tmp/profile_memoryXXXXXX";
+	char folded[PAPI_MAX_STR_LEN];
+	char line[PAPI_HUGE_STR_LEN];
+	int retval, fd, found = 0;
+	FILE *fp;
+
+	fd = mkstemp( report );
+	if ( fd < 0 )
+		test_fail( __FILE__, __LINE__, "mkstemp", 0 );
+	close( fd );
+	snprintf( folded, sizeof ( folded ), "%s.folded", report );
+
+	retval = PAPI_profil_write( samples, sizeof ( samples ), report,
+								PAPI_PROFIL_FORMAT_MEMORY );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_profil_write memory", retval );
+	retval = PAPI_profil_write( samples, sizeof ( samples ), folded,
+								PAPI_PROFIL_FORMAT_FOLDED );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_profil_write folded", retval );
+
+	fp = fopen( report, "r" );
+	if ( fp == NULL )
+		test_fail( __FILE__, __LINE__, "fopen", 0 );
+	while ( fgets( line, sizeof ( line ), fp ) ) {
+		if ( strstr( line, "profile_memory_array" ) )
+			found = 1;
+		if ( !TESTS_QUIET )
+			printf( "%s", line );
+	}
+	fclose( fp );
+
+	fp = fopen( folded, "r" );
+	if ( ( fp == NULL ) || ( fgets( line, sizeof ( line ), fp ) == NULL ) ||
+		 ( strstr( line, "check_summary 60" ) == NULL ) )
+		test_fail( __FILE__, __LINE__, "Folded memory samples", 0 );
+	fclose( fp );
+
+	unlink( report );
+	unlink( folded );
+
+	if ( !found )
+		test_fail( __FILE__, __LINE__, "Array not in the report", 0 );
+}
+
+/* Sample a pointer chase through an array larger than the caches */
+static void
+check_live( void )
+{
+	const char *names[] = {
+		"MEM_TRANS_RETIRED:LOAD_LATENCY:ldlat=3:precise=2",
+		"MEM_LOAD_UOPS_RETIRED:L1_HIT:precise=2",
+		"ibs_op",
+	};
+	PAPI_memprof_t summary;
+	int EventSet = PAPI_NULL;
+	int retval, code = 0, i, n;
+	long long value;
+	size_t j, k, t;
+
+	retval = PAPI_create_eventset( &EventSet );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+
+	for ( i = 0; i < ( int ) ( sizeof ( names ) / sizeof ( names[0] ) ); i++ ) {
+		if ( PAPI_event_name_to_code( names[i], &code ) != PAPI_OK )
+			continue;
+		if ( PAPI_add_event( EventSet, code ) != PAPI_OK )
+			continue;
+		retval = PAPI_profil( samples, sizeof ( samples ), 0, 0, EventSet,
+							  code, 10007, PAPI_PROFIL_DATA_SRC );
+		if ( ( retval == PAPI_OK ) && ( PAPI_start( EventSet ) == PAPI_OK ) )
+			break;
+		PAPI_profil( samples, sizeof ( samples ), 0, 0, EventSet, code, 0,
+					 PAPI_PROFIL_DATA_SRC );
+		PAPI_remove_event( EventSet, code );
+	}
+	if ( i == ( int ) ( sizeof ( names ) / sizeof ( names[0] ) ) ) {
+		if ( !TESTS_QUIET )
+			printf( "No precise memory event, live sampling skipped\n" );
+		PAPI_destroy_eventset( &EventSet );
+		return;
+	}
+
+	/* A random cycle through chase */
+	for ( j = 0; j < CHASE; j++ )
+		chase[j] = j;
+	for ( j = CHASE - 1; j > 0; j-- ) {
+		k = ( size_t ) rand(  ) % j;
+		t = chase[j];
+		chase[j] = chase[k];
+		chase[k] = t;
+	}
+	for ( j = 0, k = 0, n = 0; n < 20 * CHASE; n++ )
+		k = chase[k];
+	if ( k == CHASE )
+		printf( "unreachable\n" );
+
+	retval = PAPI_stop( EventSet, &value );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+
+	retval = PAPI_profil_memory( samples, sizeof ( samples ), &summary );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_profil_memory", retval );
+	if ( !TESTS_QUIET )
+		printf( "Sampled %s: %lld samples, %lld lost, %s first\n", names[i],
+				summary.samples, summary.lost,
+				summary.num_objects ? summary.objects[0].name : "nothing" );
+
+	PAPI_profil( samples, sizeof ( samples ), 0, 0, EventSet, code, 0,
+				 PAPI_PROFIL_DATA_SRC );
+	PAPI_cleanup_eventset( EventSet );
+	PAPI_destroy_eventset( &EventSet );
+}
+
+int
+main( int argc, char **argv )
+{
+	int retval;
+
+	tests_quiet( argc, argv );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT )
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+
+	check_summary(  );
+	check_write(  );
+	check_live(  );
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -0,0 +1,174 @@
+/* This file performs the following test: raw sample profiling
+
+   - Profile a busy loop with PAPI_PROFIL_CALLCHAIN, or with
+     PAPI_PROFIL_SAMPLES where call chains are not supported, on
+     PAPI_TOT_CYC or, without hardware counters, perf::TASK-CLOCK.
+   - Write the samples as folded stacks and as a pprof profile.
+   - Check that the loop's function shows up in the folded stacks and
+     that the stack counts add up to the number of samples recorded.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define NUM_WORDS (1 << 18)
+
+static unsigned long long samples[NUM_WORDS];
+
+static volatile double sink;
+
+static void __attribute__ ((noinline))
+profile_samples_spin( long long nsec )
+{
+	long long start = PAPI_get_real_nsec(  );
+	double x = 1.0;
+
+	while ( PAPI_get_real_nsec(  ) - start < nsec ) {
+		int i;
+		for ( i = 0; i < 10000; i++ )
+			x = x * 1.000001 + 0.000001;
+	}
+	sink = x;
+}
+
+/* Adds the first usable event and enables raw sample profiling on it */
+static int
+setup( int EventSet, int *flags )
+{
+	const char *names[2] = { "PAPI_TOT_CYC", "perf::TASK-CLOCK" };
+	const int thresholds[2] = { 1000000, 200000 };
+	int i, code, retval;
+
+	for ( i = 0; i < 2; i++ ) {
+		if ( PAPI_event_name_to_code( names[i], &code ) != PAPI_OK )
+			continue;
+		if ( PAPI_add_event( EventSet, code ) != PAPI_OK )
+			continue;
+
+		*flags = PAPI_PROFIL_CALLCHAIN;
+		retval = PAPI_profil( samples, sizeof ( samples ), 0, 0, EventSet,
+							  code, thresholds[i], *flags );
+		if ( retval == PAPI_ENOSUPP ) {
+			*flags = PAPI_PROFIL_SAMPLES;
+			retval = PAPI_profil( samples, sizeof ( samples ), 0, 0,
+								  EventSet, code, thresholds[i], *flags );
+		}
+		if ( retval == PAPI_OK ) {
+			if ( !TESTS_QUIET )
+				printf( "Sampling %s every %d\n", names[i], thresholds[i] );
+			return code;
+		}
+
+		PAPI_remove_event( EventSet, code );
+	}
+
+	return -1;
+}
+
+int
+main( int argc, char **argv )
+{
+	char folded[] = "/tmp/profile_samplesXXXXXX";
+	char pprof[PAPI_MAX_STR_LEN];
+	char line[PAPI_HUGE_STR_LEN];
+	long long value, total = 0, records = 0;
+	int EventSet = PAPI_NULL;
+	int retval, code, flags, fd, found = 0;
+	unsigned long long pos;
+	FILE *fp;
+
+	tests_quiet( argc, argv );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT )
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+
+	retval = PAPI_create_eventset( &EventSet );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+
+	code = setup( EventSet, &flags );
+	if ( code == -1 )
+		test_skip( __FILE__, __LINE__, "No event can be sampled", 0 );
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+
+	profile_samples_spin( 300000000LL );
+
+	retval = PAPI_stop( EventSet, &value );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+
+	/* After a five word header, records are a word count followed */
+	/* by that many addresses                                       */
+	for ( pos = 5; pos < samples[1]; pos += 1 + samples[pos] )
+		records++;
+	if ( records == 0 )
+		test_fail( __FILE__, __LINE__, "No samples recorded", 0 );
+
+	fd = mkstemp( folded );
+	if ( fd < 0 )
+		test_fail( __FILE__, __LINE__, "mkstemp", 0 );
+	close( fd );
+	snprintf( pprof, sizeof ( pprof ), "%s.pb", folded );
+
+	retval = PAPI_profil_write( samples, sizeof ( samples ), folded,
+								PAPI_PROFIL_FORMAT_FOLDED );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_profil_write folded", retval );
+	retval = PAPI_profil_write( samples, sizeof ( samples ), pprof,
+								PAPI_PROFIL_FORMAT_PPROF );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_profil_write pprof", retval );
+
+	fp = fopen( folded, "r" );
+	if ( fp == NULL )
+		test_fail( __FILE__, __LINE__, "fopen", 0 );
+	while ( fgets( line, sizeof ( line ), fp ) ) {
+		char *count = strrchr( line, ' ' );
+
+		if ( count == NULL )
+			test_fail( __FILE__, __LINE__, "Malformed folded line", 0 );
+		if ( strncmp( line, "[lost]", 6 ) != 0 )
+			total += atoll( count + 1 );
+		if ( strstr( line, "profile_samples_spin" ) )
+			found = 1;
+		if ( !TESTS_QUIET )
+			printf( "%s", line );
+	}
+	fclose( fp );
+
+	fp = fopen( pprof, "rb" );
+	if ( ( fp == NULL ) || ( fgetc( fp ) != 0x0a ) )
+		test_fail( __FILE__, __LINE__, "pprof profile", 0 );
+	fclose( fp );
+
+	unlink( folded );
+	unlink( pprof );
+
+	if ( !TESTS_QUIET )
+		printf( "%lld samples, %s\n", records,
+				flags & PAPI_PROFIL_CALLCHAIN ? "with call chains" :
+				"without call chains" );
+
+	if ( total != records )
+		test_fail( __FILE__, __LINE__, "Folded counts do not add up", 0 );
+	if ( !found )
+		test_fail( __FILE__, __LINE__, "Busy function not attributed", 0 );
+
+	retval = PAPI_profil( samples, sizeof ( samples ), 0, 0, EventSet, code, 0,
+						  flags );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_profil disable", retval );
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -0,0 +1,184 @@
+/* This file performs the following test: incremental shared library map
+
+   - Sample PAPI_TOT_CYC or, without hardware counters, perf::TASK-CLOCK
+     with PAPI_PROFIL_SAMPLES.
+   - Map a file with PROT_EXEC while sampling, so that its mmap record is
+     queued, then rename the file.
+   - Write a sample inside that mapping as folded stacks. The object must
+     be named after the file as it was mapped, which only the queued mmap
+     gives; rebuilding the map from /proc/self/maps would give the new
+     name.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define NUM_WORDS (1 << 16)
+
+static unsigned long long samples[NUM_WORDS];
+
+/* One sample at addr, with the header of the sampled buffer */
+static unsigned long long fake[8];
+
+static volatile double sink;
+
+static void
+spin( long long nsec )
+{
+	long long start = PAPI_get_real_nsec(  );
+	double x = 1.0;
+	int i;
+
+	while ( PAPI_get_real_nsec(  ) - start < nsec ) {
+		for ( i = 0; i < 10000; i++ )
+			x = x * 1.000001 + 0.000001;
+	}
+	sink = x;
+}
+
+/* Adds the first usable event and enables sample profiling on it */
+static int
+setup( int EventSet )
+{
+	const char *names[2] = { "PAPI_TOT_CYC", "perf::TASK-CLOCK" };
+	const int thresholds[2] = { 1000000, 200000 };
+	int i, code;
+
+	for ( i = 0; i < 2; i++ ) {
+		if ( PAPI_event_name_to_code( names[i], &code ) != PAPI_OK )
+			continue;
+		if ( PAPI_add_event( EventSet, code ) != PAPI_OK )
+			continue;
+		if ( PAPI_profil( samples, sizeof ( samples ), 0, 0, EventSet, code,
+						  thresholds[i], PAPI_PROFIL_SAMPLES ) == PAPI_OK )
+			return code;
+		PAPI_remove_event( EventSet, code );
+	}
+
+	return -1;
+}
+
+int
+main( int argc, char **argv )
+{
+	char file[] = "/tmp/profile_shlibXXXXXX";
+	char moved[PAPI_MAX_STR_LEN], folded[PAPI_MAX_STR_LEN];
+	char line[PAPI_HUGE_STR_LEN], page[4096];
+	const char *base;
+	long long value, start;
+	unsigned long long before;
+	int EventSet = PAPI_NULL;
+	int retval, code, fd, found = 0, lines = 0;
+	void *addr;
+	FILE *fp;
+
+	tests_quiet( argc, argv );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT )
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+
+	/* The map the mmaps are applied to */
+	if ( PAPI_get_shared_lib_info(  ) == NULL )
+		test_skip( __FILE__, __LINE__, "PAPI_get_shared_lib_info", 0 );
+
+	retval = PAPI_create_eventset( &EventSet );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	code = setup( EventSet );
+	if ( code == -1 )
+		test_skip( __FILE__, __LINE__, "No event can be sampled", 0 );
+
+	fd = mkstemp( file );
+	if ( fd < 0 )
+		test_fail( __FILE__, __LINE__, "mkstemp", 0 );
+	memset( page, 0, sizeof ( page ) );
+	if ( write( fd, page, sizeof ( page ) ) != sizeof ( page ) )
+		test_fail( __FILE__, __LINE__, "write", 0 );
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+
+	addr = mmap( NULL, sizeof ( page ), PROT_READ | PROT_EXEC, MAP_PRIVATE,
+				 fd, 0 );
+	close( fd );
+	if ( addr == MAP_FAILED ) {
+		PAPI_stop( EventSet, &value );
+		unlink( file );
+		test_skip( __FILE__, __LINE__, "mmap with PROT_EXEC", 0 );
+	}
+
+	/* The records are read from the ring buffer at the next sample */
+	before = samples[1];
+	start = PAPI_get_real_nsec(  );
+	while ( ( samples[1] == before ) &&
+			( PAPI_get_real_nsec(  ) - start < 2000000000LL ) )
+		spin( 10000000LL );
+
+	retval = PAPI_stop( EventSet, &value );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	if ( samples[1] == before ) {
+		munmap( addr, sizeof ( page ) );
+		unlink( file );
+		test_skip( __FILE__, __LINE__, "No sample after the mmap", 0 );
+	}
+
+	snprintf( moved, sizeof ( moved ), "%s.moved", file );
+	if ( rename( file, moved ) != 0 )
+		test_fail( __FILE__, __LINE__, "rename", 0 );
+
+	/* After a five word header, records are a word count followed */
+	/* by that many addresses                                       */
+	memcpy( fake, samples, 5 * sizeof ( fake[0] ) );
+	fake[1] = 7;
+	fake[2] = 0;
+	fake[5] = 1;
+	fake[6] = ( unsigned long long ) ( unsigned long ) addr + 16;
+
+	snprintf( folded, sizeof ( folded ), "%s.folded", file );
+	retval = PAPI_profil_write( fake, sizeof ( fake ), folded,
+								PAPI_PROFIL_FORMAT_FOLDED );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_profil_write", retval );
+
+	base = strrchr( file, '/' ) + 1;
+	fp = fopen( folded, "r" );
+	if ( fp == NULL )
+		test_fail( __FILE__, __LINE__, "fopen", 0 );
+	while ( fgets( line, sizeof ( line ), fp ) ) {
+		/* the file cannot be opened anymore, so there is no */
+		/* symbol, only the object and an offset              */
+		if ( ( strncmp( line, base, strlen( base ) ) == 0 ) &&
+			 ( strncmp( line + strlen( base ), "+0x", 3 ) == 0 ) )
+			found = 1;
+		lines++;
+		if ( !TESTS_QUIET )
+			printf( "%s", line );
+	}
+	fclose( fp );
+
+	munmap( addr, sizeof ( page ) );
+	unlink( moved );
+	unlink( folded );
+
+	if ( ( lines != 1 ) || !found )
+		test_fail( __FILE__, __LINE__, "Queued mmap not applied", 0 );
+
+	retval = PAPI_profil( samples, sizeof ( samples ), 0, 0, EventSet, code, 0,
+						  PAPI_PROFIL_SAMPLES );
+	if ( retval != PAPI_OK )
+		test_fail( __FILE__, __LINE__, "PAPI_profil disable", retval );
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * File:    self_profile.c
+ */
+
+/*
+  This tests PAPI_SELF_PROFILE, the library's timing of its own calls.
+
+  An EventSet is read a known number of times, then the probes are
+  fetched with PAPI_get_opt(): PAPI_read has to be seen exactly that
+  often, its histogram has to hold every call and its maximum can not
+  exceed its total. PAPI_set_opt() has to clear the probes again.
+
+  A library configured without --enable-self-profile skips.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define NUM_READS 1000
+#define MAX_PROBES 128
+
+static PAPI_self_probe_t probes[MAX_PROBES];
+
+static PAPI_self_probe_t *
+get_probe( PAPI_option_t *opt, const char *name )
+{
+	int i;
+
+	for ( i = 0; i < opt->self_profile.num_probes; i++ ) {
+		if ( strcmp( probes[i].name, name ) == 0 ) return &probes[i];
+	}
+	return NULL;
+}
+
+static int
+get_probes( PAPI_option_t *opt, int num, int this_thread )
+{
+	memset( opt, 0, sizeof ( *opt ) );
+	opt->self_profile.this_thread = this_thread;
+	opt->self_profile.num_probes = num;
+	opt->self_profile.probes = probes;
+
+	return PAPI_get_opt( PAPI_SELF_PROFILE, opt );
+}
+
+int
+main( int argc, char **argv )
+{
+	int retval, i, quiet, EventSet = PAPI_NULL;
+	long long values[1], hist;
+	PAPI_self_probe_t *read;
+	PAPI_option_t opt;
+
+	/* Set TESTS_QUIET variable */
+	quiet = tests_quiet( argc, argv );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	retval = get_probes( &opt, MAX_PROBES, 0 );
+	if ( retval == PAPI_ENOSUPP ) {
+		test_skip( __FILE__, __LINE__, "Built without self-profiling", 0 );
+	}
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_get_opt", retval );
+	}
+
+	retval = PAPI_set_opt( PAPI_SELF_PROFILE, &opt );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_set_opt", retval );
+	}
+
+	retval = PAPI_create_eventset( &EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	}
+
+	retval = PAPI_add_named_event( EventSet, "PAPI_TOT_CYC" );
+	if ( retval != PAPI_OK ) {
+		retval = PAPI_add_named_event( EventSet, "perf::TASK-CLOCK" );
+	}
+	if ( retval != PAPI_OK ) {
+		test_skip( __FILE__, __LINE__, "No event to read", retval );
+	}
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+	for ( i = 0; i < NUM_READS; i++ ) {
+		PAPI_read( EventSet, values );
+	}
+	retval = PAPI_stop( EventSet, values );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	retval = get_probes( &opt, MAX_PROBES, 1 );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_get_opt", retval );
+	}
+
+	if ( !quiet ) {
+		printf( "%-32s %10s %12s %10s\n", "probe", "calls", "total ns", "max ns" );
+		for ( i = 0; i < opt.self_profile.num_probes; i++ ) {
+			printf( "%-32s %10lld %12lld %10lld\n", probes[i].name,
+					probes[i].count, probes[i].total_ns, probes[i].max_ns );
+		}
+	}
+
+	read = get_probe( &opt, "PAPI_read" );
+	if ( read == NULL || read->count != NUM_READS ) {
+		test_fail( __FILE__, __LINE__, "PAPI_read not counted", 0 );
+	}
+	if ( read->max_ns > read->total_ns ) {
+		test_fail( __FILE__, __LINE__, "Maximum above total", 0 );
+	}
+	for ( hist = 0, i = 0; i < PAPI_SELF_BUCKETS; i++ ) {
+		hist += read->hist[i];
+	}
+	if ( hist != read->count ) {
+		test_fail( __FILE__, __LINE__, "Histogram does not hold every call", 0 );
+	}
+	if ( get_probe( &opt, "PAPI_start" ) == NULL ||
+		 get_probe( &opt, "PAPI_stop" ) == NULL ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start/stop not counted", 0 );
+	}
+
+	/* a short array gets the first probes only */
+	retval = get_probes( &opt, 1, 0 );
+	if ( retval != PAPI_OK || opt.self_profile.num_probes != 1 ) {
+		test_fail( __FILE__, __LINE__, "Short probe array", retval );
+	}
+
+	retval = PAPI_set_opt( PAPI_SELF_PROFILE, &opt );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_set_opt", retval );
+	}
+	retval = get_probes( &opt, MAX_PROBES, 0 );
+	if ( retval != PAPI_OK || opt.self_profile.num_probes != 0 ) {
+		test_fail( __FILE__, __LINE__, "Probes not reset", retval );
+	}
+
+	PAPI_shutdown(  );
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -0,0 +1,115 @@
+/* This file performs the following test: high-level region handles
+
+   - Check that registering a name twice gives the same handle, that
+     distinct names get distinct handles and that invalid handles are
+     rejected.
+   - Instrument nested regions with handles, and a region entered by
+     name and left by handle.
+   - Time region begin/end pairs by name and by handle.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "papi.h"
+#include "papi_test.h"
+#include "do_loops.h"
+
+#define CALLS 10000
+
+int main( int argc, char **argv )
+{
+   int retval, i;
+   int quiet = 0;
+   int outer, inner, again;
+   long long start, by_name, by_handle;
+
+   /* Set TESTS_QUIET variable */
+   quiet = tests_quiet( argc, argv );
+
+   retval = PAPI_hl_region_register("outer", &outer);
+   if ( retval != PAPI_OK ) {
+      test_fail( __FILE__, __LINE__, "PAPI_hl_region_register", retval );
+   }
+   retval = PAPI_hl_region_register("inner", &inner);
+   if ( retval != PAPI_OK ) {
+      test_fail( __FILE__, __LINE__, "PAPI_hl_region_register", retval );
+   }
+   retval = PAPI_hl_region_register("outer", &again);
+   if ( retval != PAPI_OK ) {
+      test_fail( __FILE__, __LINE__, "PAPI_hl_region_register", retval );
+   }
+   if ( again != outer || inner == outer ) {
+      test_fail( __FILE__, __LINE__, "Region handles do not match names", 0 );
+   }
+   if ( PAPI_hl_region_begin_h(-1) != PAPI_EINVAL ) {
+      test_fail( __FILE__, __LINE__, "Invalid handle accepted", 0 );
+   }
+
+   for ( i = 1; i <= 4; ++i ) {
+
+      retval = PAPI_hl_region_begin_h(outer);
+      if ( retval != PAPI_OK ) {
+         test_fail( __FILE__, __LINE__, "PAPI_hl_region_begin_h", retval );
+      }
+
+      retval = PAPI_hl_region_begin_h(inner);
+      if ( retval != PAPI_OK ) {
+         test_fail( __FILE__, __LINE__, "PAPI_hl_region_begin_h", retval );
+      }
+
+      do_flops( NUM_FLOPS );
+
+      retval = PAPI_hl_read_h(inner);
+      if ( retval != PAPI_OK ) {
+         test_fail( __FILE__, __LINE__, "PAPI_hl_read_h", retval );
+      }
+
+      retval = PAPI_hl_region_end_h(inner);
+      if ( retval != PAPI_OK ) {
+         test_fail( __FILE__, __LINE__, "PAPI_hl_region_end_h", retval );
+      }
+
+      retval = PAPI_hl_region_end_h(outer);
+      if ( retval != PAPI_OK ) {
+         test_fail( __FILE__, __LINE__, "PAPI_hl_region_end_h", retval );
+      }
+   }
+
+   /* names and handles refer to the same regions */
+   retval = PAPI_hl_region_begin("inner");
+   if ( retval != PAPI_OK ) {
+      test_fail( __FILE__, __LINE__, "PAPI_hl_region_begin", retval );
+   }
+   do_flops( NUM_FLOPS );
+   retval = PAPI_hl_region_end_h(inner);
+   if ( retval != PAPI_OK ) {
+      test_fail( __FILE__, __LINE__, "PAPI_hl_region_end_h", retval );
+   }
+
+   start = PAPI_get_real_nsec();
+   for ( i = 0; i < CALLS; i++ ) {
+      if ( ( retval = PAPI_hl_region_begin("by_name") ) != PAPI_OK ||
+           ( retval = PAPI_hl_region_end("by_name") ) != PAPI_OK ) {
+         test_fail( __FILE__, __LINE__, "PAPI_hl_region_begin/end", retval );
+      }
+   }
+   by_name = PAPI_get_real_nsec() - start;
+
+   start = PAPI_get_real_nsec();
+   for ( i = 0; i < CALLS; i++ ) {
+      if ( ( retval = PAPI_hl_region_begin_h(inner) ) != PAPI_OK ||
+           ( retval = PAPI_hl_region_end_h(inner) ) != PAPI_OK ) {
+         test_fail( __FILE__, __LINE__, "PAPI_hl_region_begin_h/end_h", retval );
+      }
+   }
+   by_handle = PAPI_get_real_nsec() - start;
+
+   if ( !quiet ) {
+      printf("%lld ns per region by name, %lld ns per region by handle\n",
+             by_name / CALLS, by_handle / CALLS);
+   }
+
+   test_hl_pass( __FILE__ );
+
+   return 0;
+}
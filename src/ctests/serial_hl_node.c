@@ -0,0 +1,146 @@
+/* This file performs the following test: high-level node aggregation
+
+   - Start three processes that look like the MPI ranks of one node to
+     PAPI, with PAPI_HL_NODE_AGGREGATE set and the measurement directory
+     in a temporary directory. Rank i runs a region i+1 times.
+   - Check that a single node file is written instead of rank files,
+     and that it counts the region of all ranks.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/wait.h>
+#include "papi.h"
+#include "papi_test.h"
+#include "do_loops.h"
+
+#define RANKS 3
+
+static void
+child( const char *dir, int rank, int ready, int go )
+{
+   char buf[16];
+   int retval, i;
+
+   snprintf( buf, sizeof ( buf ), "%d", rank );
+   setenv( "OMPI_COMM_WORLD_RANK", buf, 1 );
+   setenv( "OMPI_COMM_WORLD_LOCAL_RANK", buf, 1 );
+   snprintf( buf, sizeof ( buf ), "%d", RANKS );
+   setenv( "OMPI_COMM_WORLD_LOCAL_SIZE", buf, 1 );
+   setenv( "PAPI_HL_NODE_AGGREGATE", "1", 1 );
+   setenv( "PAPI_OUTPUT_DIRECTORY", dir, 1 );
+   /* a software event works without hardware counters */
+   setenv( "PAPI_EVENTS", "perf::TASK-CLOCK", 0 );
+
+   retval = PAPI_hl_region_begin( "work" );
+   /* no rank may finish before all have set up the measurement directory */
+   if ( write( ready, "x", 1 ) != 1 || read( go, buf, 1 ) != 1 )
+      exit( 1 );
+   if ( retval != PAPI_OK )
+      exit( 2 );
+   do_flops( NUM_FLOPS );
+   if ( PAPI_hl_region_end( "work" ) != PAPI_OK )
+      exit( 1 );
+
+   for ( i = 0; i < rank; i++ ) {
+      if ( PAPI_hl_region_begin( "work" ) != PAPI_OK )
+         exit( 1 );
+      do_flops( NUM_FLOPS );
+      if ( PAPI_hl_region_end( "work" ) != PAPI_OK )
+         exit( 1 );
+   }
+   exit( 0 );
+}
+
+int main( int argc, char **argv )
+{
+   char dir[] = "/tmp/serial_hl_nodeXXXXXX";
+   char out[PAPI_HUGE_STR_LEN], path[PAPI_HUGE_STR_LEN * 2], line[PAPI_HUGE_STR_LEN];
+   struct dirent *entry;
+   DIR *d;
+   FILE *fp;
+   pid_t pids[RANKS];
+   int ready[2], go[2];
+   int quiet, status, i, skip = 0, failed = 0;
+   int node_files = 0, rank_files = 0, count = -1;
+
+   /* Set TESTS_QUIET variable */
+   quiet = tests_quiet( argc, argv );
+
+   if ( mkdtemp( dir ) == NULL )
+      test_fail( __FILE__, __LINE__, "mkdtemp", 0 );
+   if ( pipe( ready ) != 0 || pipe( go ) != 0 )
+      test_fail( __FILE__, __LINE__, "pipe", 0 );
+
+   for ( i = 0; i < RANKS; i++ ) {
+      pids[i] = fork();
+      if ( pids[i] < 0 )
+         test_fail( __FILE__, __LINE__, "fork", 0 );
+      if ( pids[i] == 0 )
+         child( dir, i, ready[1], go[0] );
+   }
+   for ( i = 0; i < RANKS; i++ ) {
+      if ( read( ready[0], line, 1 ) != 1 )
+         test_fail( __FILE__, __LINE__, "read", 0 );
+   }
+   if ( write( go[1], "xxx", RANKS ) != RANKS )
+      test_fail( __FILE__, __LINE__, "write", 0 );
+
+   for ( i = 0; i < RANKS; i++ ) {
+      if ( waitpid( pids[i], &status, 0 ) != pids[i] || !WIFEXITED( status ) )
+         test_fail( __FILE__, __LINE__, "Child did not exit", i );
+      if ( WEXITSTATUS( status ) == 2 )
+         skip = 1;
+      else if ( WEXITSTATUS( status ) != 0 )
+         failed = 1;
+   }
+
+   snprintf( out, sizeof ( out ), "%s/papi_hl_output", dir );
+   d = opendir( out );
+   if ( d != NULL ) {
+      while ( ( entry = readdir( d ) ) != NULL ) {
+         if ( entry->d_name[0] == '.' )
+            continue;
+         snprintf( path, sizeof ( path ), "%s/%s", out, entry->d_name );
+         if ( strncmp( entry->d_name, "node_", 5 ) == 0 ) {
+            node_files++;
+            fp = fopen( path, "r" );
+            while ( fp != NULL && fgets( line, sizeof ( line ), fp ) != NULL ) {
+               char *p = strstr( line, "\"region_count\":\"" );
+               if ( p != NULL )
+                  count = atoi( p + strlen( "\"region_count\":\"" ) );
+            }
+            if ( fp != NULL )
+               fclose( fp );
+         } else if ( strncmp( entry->d_name, "rank_", 5 ) == 0 ) {
+            rank_files++;
+         }
+         unlink( path );
+      }
+      closedir( d );
+      rmdir( out );
+   }
+   rmdir( dir );
+
+   if ( skip )
+      test_skip( __FILE__, __LINE__, "PAPI_hl_region_begin", 0 );
+   if ( failed )
+      test_fail( __FILE__, __LINE__, "PAPI_hl_region_end", 0 );
+
+   if ( !quiet )
+      printf( "%d node file(s), %d rank file(s), region count %d\n",
+              node_files, rank_files, count );
+
+   if ( node_files != 1 || rank_files != 0 )
+      test_fail( __FILE__, __LINE__, "Expected one node file", node_files );
+   /* rank i ran the region i+1 times */
+   if ( count != RANKS * ( RANKS + 1 ) / 2 )
+      test_fail( __FILE__, __LINE__, "Wrong region count", count );
+
+   test_hl_pass( __FILE__ );
+
+   return 0;
+}
@@ -0,0 +1,161 @@
+/* This file performs the following test: high-level time-series sampling
+
+   - Run an instrumented region in a child process with
+     PAPI_HL_SAMPLE_INTERVAL_MS set and the measurement directory in a
+     temporary directory.
+   - Check the header of the sample file the child leaves behind, and
+     that it holds samples of the child with increasing time stamps.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/wait.h>
+#include "papi.h"
+#include "papi_test.h"
+
+#define INTERVAL_MS 2
+#define RUN_NSEC 200000000LL
+
+static volatile double sink;
+
+static void
+child( const char *dir )
+{
+   long long start;
+   double x = 1.0;
+   int retval;
+
+   setenv( "PAPI_OUTPUT_DIRECTORY", dir, 1 );
+   setenv( "PAPI_HL_SAMPLE_INTERVAL_MS", "2", 1 );
+   /* a software event works without hardware counters */
+   setenv( "PAPI_EVENTS", "perf::TASK-CLOCK", 0 );
+
+   retval = PAPI_hl_region_begin( "spin" );
+   if ( retval != PAPI_OK )
+      exit( 2 );
+
+   start = PAPI_get_real_nsec();
+   while ( PAPI_get_real_nsec() - start < RUN_NSEC ) {
+      int i;
+      for ( i = 0; i < 10000; i++ )
+         x = x * 1.000001 + 0.000001;
+   }
+   sink = x;
+
+   retval = PAPI_hl_region_end( "spin" );
+   if ( retval != PAPI_OK )
+      exit( 1 );
+   exit( 0 );
+}
+
+/* Check a sample file, returns the number of samples */
+static long
+check_samples( const char *path )
+{
+   FILE *fp;
+   char magic[8];
+   uint32_t header[3];
+   uint64_t tid, first_tid = 0;
+   long long *values, last = 0;
+   long samples = 0;
+   unsigned int i;
+   int c;
+
+   fp = fopen( path, "rb" );
+   if ( fp == NULL )
+      test_fail( __FILE__, __LINE__, "fopen", 0 );
+   if ( fread( magic, 1, 8, fp ) != 8 || memcmp( magic, "PAPIHLTS", 8 ) != 0 )
+      test_fail( __FILE__, __LINE__, "Bad magic", 0 );
+   if ( fread( header, sizeof ( uint32_t ), 3, fp ) != 3 || header[0] != 1 ||
+        header[1] != INTERVAL_MS || header[2] < 3 )
+      test_fail( __FILE__, __LINE__, "Bad header", 0 );
+   /* skip the names */
+   for ( i = 0; i < header[2]; i++ ) {
+      while ( ( c = fgetc( fp ) ) != 0 ) {
+         if ( c == EOF )
+            test_fail( __FILE__, __LINE__, "Truncated names", i );
+      }
+   }
+
+   values = malloc( header[2] * sizeof ( long long ) );
+   if ( values == NULL )
+      test_fail( __FILE__, __LINE__, "malloc", 0 );
+   while ( fread( &tid, sizeof ( tid ), 1, fp ) == 1 ) {
+      if ( fread( values, sizeof ( long long ), header[2], fp ) != header[2] )
+         test_fail( __FILE__, __LINE__, "Truncated sample", samples );
+      if ( samples == 0 )
+         first_tid = tid;
+      else if ( tid != first_tid || values[0] < last )
+         test_fail( __FILE__, __LINE__, "Samples out of order", samples );
+      last = values[0];
+      samples++;
+   }
+   free( values );
+   fclose( fp );
+
+   return samples;
+}
+
+int main( int argc, char **argv )
+{
+   char dir[] = "/tmp/serial_hl_samplingXXXXXX";
+   char out[PAPI_HUGE_STR_LEN], path[PAPI_HUGE_STR_LEN * 2];
+   struct dirent *entry;
+   DIR *d;
+   long samples = 0;
+   int quiet, status, files = 0;
+   pid_t pid;
+
+   /* Set TESTS_QUIET variable */
+   quiet = tests_quiet( argc, argv );
+
+   if ( mkdtemp( dir ) == NULL )
+      test_fail( __FILE__, __LINE__, "mkdtemp", 0 );
+
+   pid = fork();
+   if ( pid < 0 )
+      test_fail( __FILE__, __LINE__, "fork", 0 );
+   if ( pid == 0 )
+      child( dir );
+   if ( waitpid( pid, &status, 0 ) != pid || !WIFEXITED( status ) )
+      test_fail( __FILE__, __LINE__, "Child did not exit", 0 );
+   if ( WEXITSTATUS( status ) == 2 )
+      test_skip( __FILE__, __LINE__, "PAPI_hl_region_begin", 0 );
+   if ( WEXITSTATUS( status ) != 0 )
+      test_fail( __FILE__, __LINE__, "PAPI_hl_region_end", 0 );
+
+   snprintf( out, sizeof ( out ), "%s/papi_hl_output", dir );
+   d = opendir( out );
+   if ( d == NULL )
+      test_fail( __FILE__, __LINE__, "No measurement directory", 0 );
+   while ( ( entry = readdir( d ) ) != NULL ) {
+      if ( entry->d_name[0] == '.' )
+         continue;
+      snprintf( path, sizeof ( path ), "%s/%s", out, entry->d_name );
+      if ( strstr( entry->d_name, ".samples" ) != NULL ) {
+         samples += check_samples( path );
+         files++;
+      }
+      unlink( path );
+   }
+   closedir( d );
+   rmdir( out );
+   rmdir( dir );
+
+   if ( !quiet )
+      printf( "%ld samples in %d file(s)\n", samples, files );
+
+   if ( files != 1 )
+      test_fail( __FILE__, __LINE__, "Expected one sample file", files );
+   /* the region runs for 100 intervals */
+   if ( samples < 10 )
+      test_fail( __FILE__, __LINE__, "Too few samples", samples );
+
+   test_hl_pass( __FILE__ );
+
+   return 0;
+}
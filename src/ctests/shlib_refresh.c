@@ -0,0 +1,102 @@
+/* This file performs the following test: shared library map refresh
+
+   - Check that the map from PAPI_get_shared_lib_info() is in address
+     order and that its text ranges do not overlap.
+   - Map the text of an already loaded library a second time and check
+     that the next call sees the new mapping, and that it is gone again
+     after munmap().
+   - Time repeated calls on an unchanged address space.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define CALLS 100
+
+/* Number of entries whose text starts at addr, fails if out of order */
+static int
+check_map( const PAPI_shlib_info_t * shinfo, vptr_t addr )
+{
+	int i, found = 0;
+
+	for ( i = 0; i < shinfo->count; i++ ) {
+		if ( shinfo->map[i].text_start >= shinfo->map[i].text_end )
+			test_fail( __FILE__, __LINE__, "Empty text range", i );
+		if ( ( i > 0 ) &&
+			 ( shinfo->map[i].text_start < shinfo->map[i - 1].text_end ) )
+			test_fail( __FILE__, __LINE__, "Map out of order", i );
+		if ( shinfo->map[i].text_start == addr )
+			found++;
+	}
+	return found;
+}
+
+int
+main( int argc, char **argv )
+{
+	const PAPI_shlib_info_t *shinfo;
+	char path[PAPI_HUGE_STR_LEN];
+	long long start, elapsed;
+	void *addr;
+	size_t len;
+	int retval, fd, i;
+
+	tests_quiet( argc, argv );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT )
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+
+	shinfo = PAPI_get_shared_lib_info(  );
+	if ( ( shinfo == NULL ) || ( shinfo->count == 0 ) )
+		test_skip( __FILE__, __LINE__, "PAPI_get_shared_lib_info", 0 );
+	check_map( shinfo, 0 );
+
+	/* Any library of the process will do */
+	strncpy( path, shinfo->map[0].name, sizeof ( path ) - 1 );
+	path[sizeof ( path ) - 1] = '\0';
+	fd = open( path, O_RDONLY );
+	if ( fd < 0 )
+		test_skip( __FILE__, __LINE__, path, 0 );
+	len = ( size_t ) getpagesize(  );
+	addr = mmap( NULL, len, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( addr == MAP_FAILED )
+		test_skip( __FILE__, __LINE__, "mmap", 0 );
+
+	shinfo = PAPI_get_shared_lib_info(  );
+	if ( shinfo == NULL )
+		test_fail( __FILE__, __LINE__, "PAPI_get_shared_lib_info", 0 );
+	if ( check_map( shinfo, ( vptr_t ) addr ) != 1 )
+		test_fail( __FILE__, __LINE__, "New mapping not seen", 0 );
+
+	munmap( addr, len );
+
+	shinfo = PAPI_get_shared_lib_info(  );
+	if ( shinfo == NULL )
+		test_fail( __FILE__, __LINE__, "PAPI_get_shared_lib_info", 0 );
+	if ( check_map( shinfo, ( vptr_t ) addr ) != 0 )
+		test_fail( __FILE__, __LINE__, "Unmapped mapping still seen", 0 );
+
+	start = PAPI_get_real_nsec(  );
+	for ( i = 0; i < CALLS; i++ ) {
+		if ( PAPI_get_shared_lib_info(  ) == NULL )
+			test_fail( __FILE__, __LINE__, "PAPI_get_shared_lib_info", 0 );
+	}
+	elapsed = PAPI_get_real_nsec(  ) - start;
+
+	if ( !TESTS_QUIET )
+		printf( "%d objects, %lld ns per unchanged refresh\n", shinfo->count,
+				elapsed / CALLS );
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
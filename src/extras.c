@@ -25,6 +25,8 @@ vendors did in the kernel extensions or performance libraries. */
 #include "papi_memory.h"
 #include "extras.h"
 #include "threads.h"
+#include "papi_profile.h"
+#include "papi_self.h"
 
 #if (!defined(HAVE_FFSLL) || defined(__bgp__))
 int ffsll( long long lli );
@@ -161,6 +163,87 @@ posix_profil( vptr_t address, PAPI_sprofil_t * prof,
 	}
 }
 
+/* Append one record to a PAPI_PROFIL_SAMPLES buffer: the number of
+   addresses, then the addresses, innermost first. This runs in the
+   overflow handler, so a full buffer only counts the sample as lost;
+   the addresses are attributed to symbols by PAPI_profil_write().
+*/
+static void
+samples_profil( PAPI_sprofil_t * prof, const vptr_t * chain, int depth )
+{
+	unsigned long long *buf = ( unsigned long long * ) prof->pr_base;
+	unsigned long long size = prof->pr_size / sizeof ( unsigned long long );
+	unsigned long long used = buf[SMPL_USED];
+	int i;
+
+	if ( depth > PAPI_PROFIL_MAX_DEPTH )
+		depth = PAPI_PROFIL_MAX_DEPTH;
+
+	if ( used + 1 + ( unsigned long long ) depth > size ) {
+		buf[SMPL_LOST]++;
+		return;
+	}
+
+	buf[used] = ( unsigned long long ) depth;
+	for ( i = 0; i < depth; i++ )
+		buf[used + 1 + i] = ( unsigned long long ) ( unsigned long ) chain[i];
+	buf[SMPL_USED] = used + 1 + ( unsigned long long ) depth;
+
+	PRFDBG( "samples_profil() record of %d at word %llu\n", depth, used );
+}
+
+/* Components that can unwind the interrupted thread, perf_event with
+   PAPI_PROFIL_CALLCHAIN, pass the whole chain here, innermost first.
+   Histograms only use the innermost address.
+*/
+void
+_papi_hwi_dispatch_profile_chain( EventSetInfo_t * ESI, const vptr_t * chain,
+								  int depth, long long over, int profile_index )
+{
+	if ( ESI->profile.flags & PAPI_PROFIL_SAMPLES ) {
+		samples_profil( ESI->profile.prof[profile_index], chain, depth );
+		return;
+	}
+
+	_papi_hwi_dispatch_profile( ESI, chain[0], over, profile_index );
+}
+
+/* Components that sample data addresses, perf_event with
+   PAPI_PROFIL_DATA_SRC, pass the access here as one record of
+   SMPL_MEM_WORDS words. Histograms only use the instruction address.
+*/
+void
+_papi_hwi_dispatch_profile_memory( EventSetInfo_t * ESI, vptr_t pc,
+								   vptr_t addr, unsigned long long weight,
+								   unsigned long long data_src,
+								   int profile_index )
+{
+	PAPI_sprofil_t *prof;
+	unsigned long long *buf, size, used;
+
+	if ( !( ESI->profile.flags & PAPI_PROFIL_DATA_SRC ) ) {
+		_papi_hwi_dispatch_profile( ESI, pc, 0, profile_index );
+		return;
+	}
+
+	prof = ESI->profile.prof[profile_index];
+	buf = ( unsigned long long * ) prof->pr_base;
+	size = prof->pr_size / sizeof ( unsigned long long );
+	used = buf[SMPL_USED];
+
+	if ( used + 1 + SMPL_MEM_WORDS > size ) {
+		buf[SMPL_LOST]++;
+		return;
+	}
+
+	buf[used] = SMPL_MEM_WORDS;
+	buf[used + 1 + SMPL_MEM_IP] = ( unsigned long long ) ( unsigned long ) pc;
+	buf[used + 1 + SMPL_MEM_ADDR] = ( unsigned long long ) ( unsigned long ) addr;
+	buf[used + 1 + SMPL_MEM_WEIGHT] = weight;
+	buf[used + 1 + SMPL_MEM_SRC] = data_src;
+	buf[SMPL_USED] = used + 1 + SMPL_MEM_WORDS;
+}
+
 void
 _papi_hwi_dispatch_profile( EventSetInfo_t * ESI, vptr_t pc,
 							long long over, int profile_index )
@@ -175,6 +258,11 @@ _papi_hwi_dispatch_profile( EventSetInfo_t * ESI, vptr_t pc,
 
 	PRFDBG( "handled IP %p\n", pc );
 
+	if ( profile->flags & PAPI_PROFIL_SAMPLES ) {
+		samples_profil( profile->prof[profile_index], &pc, 1 );
+		return;
+	}
+
 	sprof = profile->prof[profile_index];
 	count = profile->count[profile_index];
 
@@ -193,6 +281,32 @@ _papi_hwi_dispatch_profile( EventSetInfo_t * ESI, vptr_t pc,
 				  profile->threshold[profile_index] );
 }
 
+/* Map each counter position of ESI to the profile index of the event */
+/* that uses it, so that the overflow handler does not have to search. */
+/* Positions only change while the EventSet is stopped.                */
+void
+_papi_hwi_map_profile_positions( EventSetInfo_t * ESI )
+{
+	int num_pos = _papi_hwd[ESI->CmpIdx]->cmp_info.num_mpx_cntrs;
+	int i, j, k, pos;
+
+	for ( i = 0; i < num_pos; i++ )
+		ESI->profile.PosIndex[i] = -1;
+
+	for ( j = 0; j < ESI->profile.event_counter; j++ ) {
+		i = ESI->profile.EventIndex[j];
+		/* Pentium 4 can have tagged events that contain more than one */
+		/* counter without being derived, map all of them              */
+		for ( k = 0; k < PAPI_EVENTS_IN_DERIVED_EVENT; k++ ) {
+			pos = ESI->EventInfoArray[i].pos[k];
+			if ( pos < 0 )
+				break;
+			if ( ( pos < num_pos ) && ( ESI->profile.PosIndex[pos] < 0 ) )
+				ESI->profile.PosIndex[pos] = j;
+		}
+	}
+}
+
 /* if isHardware is true, then the processor is using hardware overflow,
    else it is using software overflow. Use this parameter instead of 
    _papi_hwi_system_info.supports_hw_overflow is in CRAY some processors
@@ -218,12 +332,12 @@ _papi_hwi_dispatch_overflow_signal( void *papiContext, vptr_t address,
 				   int genOverflowBit, ThreadInfo_t ** t,
 				   int cidx )
 {
-	int retval, event_counter, i, overflow_flag, pos;
-	int papi_index, j;
+	int retval, event_counter, i, j, overflow_flag, pos;
+	int papi_index;
 	int profile_index = 0;
 	long long overflow_vector;
 
-	long long temp[_papi_hwd[cidx]->cmp_info.num_cntrs], over;
+	long long over;
 	long long latest = 0;
 	ThreadInfo_t *thread;
 	EventSetInfo_t *ESI;
@@ -277,7 +391,7 @@ _papi_hwi_dispatch_overflow_signal( void *papiContext, vptr_t address,
 			for ( i = 0; i < event_counter; i++ ) {
 				papi_index = ESI->overflow.EventIndex[i];
 				latest = ESI->sw_stop[papi_index];
-				temp[i] = -1;
+				ESI->overflow.excess[i] = -1;
 
 				if ( latest >= ( long long ) ESI->overflow.deadline[i] ) {
 					OVFDBG
@@ -286,7 +400,7 @@ _papi_hwi_dispatch_overflow_signal( void *papiContext, vptr_t address,
 						  ESI->overflow.threshold[i] );
 					pos = ESI->EventInfoArray[papi_index].pos[0];
 					overflow_vector ^= ( long long ) 1 << pos;
-					temp[i] = latest - ESI->overflow.deadline[i];
+					ESI->overflow.excess[i] = latest - ESI->overflow.deadline[i];
 					overflow_flag = 1;
 					/* adjust the deadline */
 					ESI->overflow.deadline[i] =
@@ -308,35 +422,29 @@ _papi_hwi_dispatch_overflow_signal( void *papiContext, vptr_t address,
 
 		if ( ( ESI->overflow.flags & PAPI_OVERFLOW_HARDWARE ) || overflow_flag ) {
 			if ( ESI->state & PAPI_PROFILING ) {
-				int k = 0;
+				int num_pos = _papi_hwd[cidx]->cmp_info.num_mpx_cntrs;
+
 				while ( overflow_vector ) {
 					i = ffsll( overflow_vector ) - 1;
-					for ( j = 0; j < event_counter; j++ ) {
-						papi_index = ESI->overflow.EventIndex[j];
-						/* This loop is here ONLY because Pentium 4 can have tagged *
-						 * events that contain more than one counter without being  *
-						 * derived. You've gotta scan all terms to make sure you    *
-						 * find the one to profile. */
-						for ( k = 0, pos = 0; k < PAPI_EVENTS_IN_DERIVED_EVENT && pos >= 0;
-							  k++ ) {
-							pos = ESI->EventInfoArray[papi_index].pos[k];
-							if ( i == pos ) {
-								profile_index = j;
-								goto foundit;
-							}
-						}
-					}
-					if ( j == event_counter ) {
+					profile_index = i < num_pos ? ESI->profile.PosIndex[i] : -1;
+					if ( profile_index < 0 ) {
 						PAPIERROR
 							( "BUG! overflow_vector is 0, dropping interrupt" );
 						return ( PAPI_EBUG );
 					}
 
-				  foundit:
-					if ( ( ESI->overflow.flags & PAPI_OVERFLOW_HARDWARE ) )
-						over = 0;
-					else
-						over = temp[profile_index];
+					over = 0;
+					if ( !( ESI->overflow.flags & PAPI_OVERFLOW_HARDWARE ) ) {
+						/* excess is kept by overflow index; the software */
+						/* path reads all counters, so a search is cheap   */
+						papi_index = ESI->profile.EventIndex[profile_index];
+						for ( j = 0; j < event_counter; j++ ) {
+							if ( ESI->overflow.EventIndex[j] == papi_index ) {
+								over = ESI->overflow.excess[j];
+								break;
+							}
+						}
+					}
 					_papi_hwi_dispatch_profile( ESI, address, over,
 												profile_index );
 					overflow_vector ^= ( long long ) 1 << i;
@@ -399,6 +507,21 @@ _papi_hwi_start_timer( int timer, int signal, int ns )
 	return ( PAPI_OK );
 }
 
+#ifdef PAPI_SELF_PROFILING
+/* The component that handles each signal, for the timed handler */
+static int self_signal_cidx[PAPI_NSIG];
+
+static void
+self_dispatch_timer( int signal, siginfo_t * info, void *uc )
+{
+	int cidx = self_signal_cidx[signal];
+
+	PAPI_SELF_TIME( PAPI_SELF_VEC( cidx, dispatch_timer ),
+		( ( void ( * )( int, siginfo_t *, void * ) ) _papi_hwd[cidx]->
+		  dispatch_timer ) ( signal, info, uc ) );
+}
+#endif
+
 int
 _papi_hwi_start_signal( int signal, int need_context, int cidx )
 {
@@ -415,9 +538,14 @@ _papi_hwi_start_signal( int signal, int need_context, int cidx )
 
 	memset( &action, 0x00, sizeof ( struct sigaction ) );
 	action.sa_flags = SA_RESTART;
+#ifdef PAPI_SELF_PROFILING
+	self_signal_cidx[signal] = cidx;
+	action.sa_sigaction = self_dispatch_timer;
+#else
 	action.sa_sigaction =
 		( void ( * )( int, siginfo_t *, void * ) ) _papi_hwd[cidx]->
 		dispatch_timer;
+#endif
 	if ( need_context )
 #if (defined(_BGL) /*|| defined (__bgp__)*/)
 		action.sa_flags |= SIGPWR;
@@ -6,11 +6,19 @@ int _papi_hwi_start_timer( int timer, int signal, int ms );
 int _papi_hwi_stop_signal( int signal );
 int _papi_hwi_start_signal( int signal, int need_context, int cidx );
 int _papi_hwi_initialize( DynamicArray_t ** );
+void _papi_hwi_map_profile_positions( EventSetInfo_t * ESI );
 int _papi_hwi_dispatch_overflow_signal( void *papiContext, vptr_t address,
 					int *, long long, int,
 					ThreadInfo_t ** master, int cidx );
 void _papi_hwi_dispatch_profile( EventSetInfo_t * ESI, vptr_t address,
 				 long long over, int profile_index );
+void _papi_hwi_dispatch_profile_chain( EventSetInfo_t * ESI,
+				       const vptr_t * chain, int depth,
+				       long long over, int profile_index );
+void _papi_hwi_dispatch_profile_memory( EventSetInfo_t * ESI, vptr_t pc,
+					vptr_t addr, unsigned long long weight,
+					unsigned long long data_src,
+					int profile_index );
 
 
 #endif /* EXTRAS_H */
@@ -20,19 +20,25 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <time.h>
+#include <signal.h>
+#include <sched.h>
 #include <stdint.h>
 #include <unistd.h>
 #include "papi.h"
 #include "papi_internal.h"
+#include "papi_self.h"
 
 
 /* For dynamic linking to libpapi */
 /* Weak symbol for pthread_once to avoid additional linking
  * against libpthread when not used. */
 #pragma weak pthread_once
+#pragma weak pthread_create
+#pragma weak pthread_detach
 
 #define verbose_fprintf \
    if (verbosity == 1) fprintf
@@ -47,6 +53,9 @@
 /* number of nested regions */
 #define PAPIHL_MAX_STACK_SIZE 10
 
+/* number of distinct region names, a power of two */
+#define PAPIHL_MAX_REGION_NAMES 4096
+
 /* global components data begin *****************************************/
 typedef struct components
 {
@@ -108,12 +117,16 @@ typedef struct regions
 {
    unsigned int region_id; /**< Unique region ID */
    int parent_region_id;   /**< Region ID of parent region */
-   char *region;           /**< Region name */
+   int handle;             /**< Region handle, index into the region name table */
+   const char *region;     /**< Region name, owned by the region name table */
    struct regions *next;
    struct regions *prev;
    value_t values[];       /**< Array of event values based on current eventset */
 } regions_t;
 
+/**< Region node of each open region, parallel to _local_region_id_stack */
+THREAD_LOCAL_STORAGE_KEYWORD regions_t *_local_region_node_stack[PAPIHL_MAX_STACK_SIZE];
+
 typedef struct
 {
    unsigned long key;      /**< Thread ID */
@@ -139,6 +152,110 @@ binary_tree_t* binary_tree = NULL;
 /* global event storage data end ****************************************/
 
 
+/* global region name table begin ***************************************/
+/* Region names are interned once into an open addressing hash table
+ * whose slots are only ever filled, never cleared, so that lookups need
+ * no lock and the slot index can be handed out as the region handle.
+ * Names live as long as the process, like the handles pointing at them. */
+static char *region_names[PAPIHL_MAX_REGION_NAMES];
+
+/* global region name table end *****************************************/
+
+
+/* time-series sampling data begin **************************************/
+/* With PAPI_HL_SAMPLE_INTERVAL_MS set, a timer of each thread interrupts
+ * it periodically to read its event sets into a ring of the thread. The
+ * thread is the only producer and a writer thread, which appends the
+ * records to a file in the measurement directory, the only consumer, so
+ * memory stays bounded however long the application runs.
+ * Only components whose read takes no lock are read in the signal
+ * handler. With any other, the handler marks a sample as due and the
+ * thread takes it at its next high-level call. */
+#if defined(SIGEV_THREAD_ID)
+#define PAPIHL_SAMPLING 1
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+/* number of records per thread, a power of two */
+#define PAPIHL_SAMPLE_RING 1024
+/* longest time between two writes of the rings */
+#define PAPIHL_SAMPLE_MAX_FLUSH_MS 1000
+#define PAPIHL_SAMPLE_SIGNAL (SIGRTMIN + 1)
+
+typedef struct samplers
+{
+   struct samplers *next;
+   unsigned long tid;          /**< Thread ID */
+   bool armed;                 /**< The timer has been created */
+   timer_t timer;
+   unsigned int head;          /**< Next record to fill, only advanced by the thread */
+   unsigned int tail;          /**< Next record to write, only advanced by the writer */
+   unsigned long long dropped; /**< Samples lost to a full ring */
+   volatile sig_atomic_t pending; /**< A sample is due at the next high-level call */
+   long_long records[];        /**< PAPIHL_SAMPLE_RING records of sample_record_len values */
+} samplers_t;
+
+static int sample_interval_ms = 0;  /**< Sampling is off unless set */
+static int sample_record_len = 0;   /**< Values per record: time, cycles and all events */
+static samplers_t *samplers = NULL; /**< Sampled threads, changed with HIGHLEVEL_LOCK held */
+static FILE *sample_file = NULL;    /**< Changed with HIGHLEVEL_LOCK held */
+static volatile bool sample_writer_stop = false;
+static bool sample_in_handler = false; /**< All components can be read in the signal handler */
+static int sample_users = 0;        /**< Threads using their sampler without HIGHLEVEL_LOCK */
+static unsigned long long sample_dropped = 0; /**< Dropped by the samplers already freed */
+
+THREAD_LOCAL_STORAGE_KEYWORD samplers_t *_local_sampler = NULL;
+/**< Set while the thread uses its event sets outside of the signal handler */
+THREAD_LOCAL_STORAGE_KEYWORD volatile int _local_sample_blocked = 0;
+
+/* time-series sampling data end ****************************************/
+
+
+/* node aggregation data begin ******************************************/
+/* With PAPI_HL_NODE_AGGREGATE set, the ranks of a node sum up their
+ * regions by name and publish them in their slot of a POSIX shared
+ * memory segment. The last rank of the node to publish writes a single
+ * output file for the node with the total, minimum, average and maximum
+ * over the ranks, instead of one output file per rank. */
+#define PAPIHL_NODE_SLOT_SIZE ( 256 * 1024 )
+
+typedef struct
+{
+   int local_size;         /**< Number of ranks on the node */
+   int published;          /**< Number of slots filled in */
+   long_long pad[7];
+} node_header_t;
+
+typedef struct
+{
+   int rank;               /**< Global rank */
+   int num_values;         /**< Values per region, including cycles and real time */
+   int num_regions;        /**< Regions in the slot, -1 if the rank writes its own file */
+   int used;               /**< Bytes used by the regions */
+} node_slot_t;
+
+typedef struct
+{
+   long_long count;        /**< Number of region instances */
+   int size;               /**< Bytes of the record, a multiple of 8 */
+   int pad;
+   long_long values[];     /**< num_values values, followed by the region name */
+} node_region_t;
+
+typedef struct
+{
+   long_long count;        /**< Number of region instances on all ranks */
+   int ranks;              /**< Number of ranks with the region */
+   long_long *total;
+   long_long *min;
+   long_long *max;
+} node_aggregate_t;
+
+/* node aggregation data end ********************************************/
+
+
 /* global auxiliary variables begin *************************************/
 enum region_type { REGION_BEGIN, REGION_READ, REGION_END };
 
@@ -177,22 +294,39 @@ static int _internal_hl_create_event_sets();
 static int _internal_hl_start_counters();
 
 /* functions for storing events */
+static unsigned int _internal_hl_region_hash( const char *region );
+static int _internal_hl_region_intern( const char *region, int *handle );
 static int _internal_hl_region_id_pop();
-static int _internal_hl_region_id_push();
+static int _internal_hl_region_id_push( regions_t *node );
 static int _internal_hl_region_id_stack_peak();
 
 static inline reads_t* _internal_hl_insert_read_node( reads_t** head_node );
 static inline int _internal_hl_add_values_to_region( regions_t *node, enum region_type reg_typ );
-static inline regions_t* _internal_hl_insert_region_node( regions_t** head_node, const char *region );
-static inline regions_t* _internal_hl_find_region_node( regions_t* head_node, const char *region );
+static inline regions_t* _internal_hl_insert_region_node( regions_t** head_node, int handle );
+static inline regions_t* _internal_hl_find_region_node( int handle );
 static inline threads_t* _internal_hl_insert_thread_node( unsigned long tid );
 static inline threads_t* _internal_hl_find_thread_node( unsigned long tid );
-static int _internal_hl_store_counters( unsigned long tid, const char *region,
-                                        enum region_type reg_typ );
+static int _internal_hl_store_counters( unsigned long tid, int handle,
+                                        enum region_type reg_typ, regions_t **node );
 static int _internal_hl_read_counters();
-static int _internal_hl_read_and_store_counters( const char *region, enum region_type reg_typ );
+static int _internal_hl_read_and_store_counters( int handle, enum region_type reg_typ,
+                                                 regions_t **node );
 static int _internal_hl_create_global_binary_tree();
 
+/* functions for time-series sampling */
+#ifdef PAPIHL_SAMPLING
+static bool _internal_hl_sample_signal_safe();
+static void _internal_hl_sample_record( samplers_t *sampler );
+static void _internal_hl_sample_handler( int sig, siginfo_t *info, void *context );
+static void _internal_hl_sample_flush();
+static void *_internal_hl_sample_writer( void *arg );
+static int _internal_hl_sample_open();
+#endif
+static int _internal_hl_sample_start();
+static void _internal_hl_sample_take();
+static void _internal_hl_sample_stop();
+static void _internal_hl_sample_stop_thread();
+
 /* functions for output generation */
 static int _internal_hl_mkdir(const char *dir);
 static int _internal_hl_determine_output_path();
@@ -203,7 +337,12 @@ static void _internal_hl_json_regions(FILE* f, bool beautifier, threads_t* threa
 static void _internal_hl_json_threads(FILE* f, bool beautifier, unsigned long* tids, int threads_num);
 static int _internal_hl_cmpfunc(const void * a, const void * b);
 static int _internal_get_sorted_thread_list(unsigned long** tids, int* threads_num);
+static void _internal_hl_json_header(FILE* f, bool beautifier);
 static void _internal_hl_write_json_file(FILE* f, unsigned long* tids, int threads_num);
+static int _internal_hl_determine_local_rank( int *local_rank, int *local_size );
+static int _internal_hl_node_fill_slot( node_slot_t *slot, int rank );
+static int _internal_hl_node_write( node_header_t *header, int local_size );
+static int _internal_hl_node_publish( int rank );
 static void _internal_hl_read_json_file(const char* path);
 static void _internal_hl_write_output();
 
@@ -231,6 +370,15 @@ static void _internal_hl_library_init(void)
       verbosity = 1;
    }
 
+   /* check if time-series sampling is requested */
+   if ( getenv("PAPI_HL_SAMPLE_INTERVAL_MS") != NULL ) {
+#ifdef PAPIHL_SAMPLING
+      sample_interval_ms = atoi(getenv("PAPI_HL_SAMPLE_INTERVAL_MS"));
+#else
+      verbose_fprintf(stdout, "PAPI-HL Warning: Time-series sampling is not supported on this system.\n");
+#endif
+   }
+
    if ( ( retval = PAPI_library_init(PAPI_VER_CURRENT) ) != PAPI_VER_CURRENT )
       verbose_fprintf(stdout, "PAPI-HL Error: PAPI_library_init failed!\n");
    
@@ -600,8 +748,9 @@ static int _internal_hl_create_components()
       }
 
       /* change event type to instantaneous for specific events */
-      /* we consider all nvml events as instantaneous values */
-      if( (strstr(requested_event_names[i], "nvml:::") != NULL) ) {
+      /* we consider all nvml and memory events as instantaneous values */
+      if( (strstr(requested_event_names[i], "nvml:::") != NULL) ||
+          (strstr(requested_event_names[i], "memory:::") != NULL) ) {
          event_type = 1;
          verbose_fprintf(stdout, "PAPI-HL Info: The event \"%s\" will be stored as instantaneous value.\n", requested_event_names[i]);
       }
@@ -799,11 +948,62 @@ static int _internal_hl_start_counters()
          }
       }
       _papi_hl_events_running = 1;
+
+      /* sampling is optional, counting goes on without it */
+      if ( ( retval = _internal_hl_sample_start() ) != PAPI_OK )
+         verbose_fprintf(stdout, "PAPI-HL Warning: Cannot sample thread %lu: %s.\n", PAPI_thread_id(), PAPI_strerror(retval));
       return PAPI_OK;
    }
    return ( PAPI_EMISC );
 }
 
+static unsigned int _internal_hl_region_hash( const char *region )
+{
+   /* FNV-1a */
+   unsigned int hash = 2166136261u;
+   while ( *region != '\0' ) {
+      hash ^= (unsigned char)*region++;
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+/* Find the handle of a region name, adding the name to the table on its
+ * first use. Concurrent inserts race for an empty slot with a
+ * compare-and-swap, the loser frees its copy and checks the winner. */
+static int _internal_hl_region_intern( const char *region, int *handle )
+{
+   unsigned int i, slot;
+   char *name, *copy = NULL;
+
+   if ( region == NULL )
+      return ( PAPI_EINVAL );
+
+   slot = _internal_hl_region_hash(region) & ( PAPIHL_MAX_REGION_NAMES - 1 );
+   for ( i = 0; i < PAPIHL_MAX_REGION_NAMES; i++ ) {
+      name = __atomic_load_n(&region_names[slot], __ATOMIC_ACQUIRE);
+      if ( name == NULL ) {
+         if ( copy == NULL && ( copy = strdup(region) ) == NULL )
+            return ( PAPI_ENOMEM );
+         if ( __atomic_compare_exchange_n(&region_names[slot], &name, copy, 0,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ) {
+            *handle = (int)slot;
+            return ( PAPI_OK );
+         }
+      }
+      if ( strcmp(name, region) == 0 ) {
+         free(copy);
+         *handle = (int)slot;
+         return ( PAPI_OK );
+      }
+      slot = ( slot + 1 ) & ( PAPIHL_MAX_REGION_NAMES - 1 );
+   }
+
+   free(copy);
+   verbose_fprintf(stdout, "PAPI-HL Warning: More than %d region names.\n", PAPIHL_MAX_REGION_NAMES);
+   return ( PAPI_ENOMEM );
+}
+
 static int _internal_hl_region_id_pop() {
    if ( _local_region_id_top == -1 ) {
       return PAPI_ENOEVNT;
@@ -813,12 +1013,13 @@ static int _internal_hl_region_id_pop() {
    return PAPI_OK;
 }
 
-static int _internal_hl_region_id_push() {
-   if ( _local_region_id_top == PAPIHL_MAX_STACK_SIZE ) {
+static int _internal_hl_region_id_push( regions_t *node ) {
+   if ( _local_region_id_top == PAPIHL_MAX_STACK_SIZE - 1 ) {
       return PAPI_ENOMEM;
    } else {
       _local_region_id_top++;
       _local_region_id_stack[_local_region_id_top] = _local_region_begin_cnt;
+      _local_region_node_stack[_local_region_id_top] = node;
    }
    return PAPI_OK;
 }
@@ -910,7 +1111,7 @@ static inline int _internal_hl_add_values_to_region( regions_t *node, enum regio
 }
 
 
-static inline regions_t* _internal_hl_insert_region_node(regions_t** head_node, const char *region )
+static inline regions_t* _internal_hl_insert_region_node(regions_t** head_node, int handle )
 {
    regions_t *new_node;
    int i;
@@ -923,18 +1124,14 @@ static inline regions_t* _internal_hl_insert_region_node(regions_t** head_node,
    new_node = malloc(sizeof(regions_t) + extended_total_num_events * sizeof(value_t));
    if ( new_node == NULL )
       return ( NULL );
-   new_node->region = (char *)malloc((strlen(region) + 1) * sizeof(char));
-   if ( new_node->region == NULL ) {
-      free(new_node);
-      return ( NULL );
-   }
 
    new_node->next = NULL;
    new_node->prev = NULL;
 
    new_node->region_id = _local_region_begin_cnt;
    new_node->parent_region_id = _internal_hl_region_id_stack_peak();
-   strcpy(new_node->region, region);
+   new_node->handle = handle;
+   new_node->region = region_names[handle];
    for ( i = 0; i < extended_total_num_events; i++ ) {
       new_node->values[i].read_values = NULL;
    }
@@ -952,16 +1149,15 @@ static inline regions_t* _internal_hl_insert_region_node(regions_t** head_node,
 }
 
 
-static inline regions_t* _internal_hl_find_region_node(regions_t* head_node, const char *region )
+/* Only the innermost open region can be read or ended */
+static inline regions_t* _internal_hl_find_region_node( int handle )
 {
-   regions_t* find_node = head_node;
-   while ( find_node != NULL ) {
-      if ( ((int)find_node->region_id == _internal_hl_region_id_stack_peak()) && (strcmp(find_node->region, region) == 0) ) {
-         return find_node;
-      }
-      find_node = find_node->next;
-   }
-   find_node = NULL;
+   regions_t* find_node;
+   if ( _local_region_id_top == -1 )
+      return NULL;
+   find_node = _local_region_node_stack[_local_region_id_top];
+   if ( find_node->handle != handle )
+      return NULL;
    return find_node;
 }
 
@@ -989,9 +1185,10 @@ static inline threads_t* _internal_hl_find_thread_node(unsigned long tid)
 }
 
 
-static int _internal_hl_store_counters( unsigned long tid, const char *region,
-                                        enum region_type reg_typ )
+static int _internal_hl_store_counters( unsigned long tid, int handle,
+                                        enum region_type reg_typ, regions_t **node )
 {
+   PAPI_SELF_SCOPE( PAPI_SELF_hl_store_counters );
    int retval;
 
    _papi_hwi_lock( HIGHLEVEL_LOCK );
@@ -1014,14 +1211,14 @@ static int _internal_hl_store_counters( unsigned long tid, const char *region,
 
    regions_t* current_region_node;
    if ( reg_typ == REGION_READ || reg_typ == REGION_END ) {
-      current_region_node = _internal_hl_find_region_node(current_thread_node->value, region);
+      current_region_node = _internal_hl_find_region_node(handle);
       if ( current_region_node == NULL ) {
          if ( reg_typ == REGION_READ ) {
             /* ignore no matching REGION_READ */
-            verbose_fprintf(stdout, "PAPI-HL Warning: Cannot find matching region for PAPI_hl_read(\"%s\") for thread id=%lu.\n", region, PAPI_thread_id());
+            verbose_fprintf(stdout, "PAPI-HL Warning: Cannot find matching region for PAPI_hl_read(\"%s\") for thread id=%lu.\n", region_names[handle], PAPI_thread_id());
             retval = PAPI_OK;
          } else {
-            verbose_fprintf(stdout, "PAPI-HL Warning: Cannot find matching region for PAPI_hl_region_end(\"%s\") for thread id=%lu.\n", region, PAPI_thread_id());
+            verbose_fprintf(stdout, "PAPI-HL Warning: Cannot find matching region for PAPI_hl_region_end(\"%s\") for thread id=%lu.\n", region_names[handle], PAPI_thread_id());
             retval = PAPI_EINVAL;
          }
          _papi_hwi_unlock( HIGHLEVEL_LOCK );
@@ -1029,7 +1226,7 @@ static int _internal_hl_store_counters( unsigned long tid, const char *region,
       } 
    } else {
       /* create new node for current region in list if type is REGION_BEGIN */
-      if ( ( current_region_node = _internal_hl_insert_region_node(&current_thread_node->value, region) ) == NULL ) {
+      if ( ( current_region_node = _internal_hl_insert_region_node(&current_thread_node->value, handle) ) == NULL ) {
          _papi_hwi_unlock( HIGHLEVEL_LOCK );
          return ( PAPI_ENOMEM );
       }
@@ -1047,6 +1244,8 @@ static int _internal_hl_store_counters( unsigned long tid, const char *region,
    if ( reg_typ == REGION_END ) region_end_cnt++;
 
    _papi_hwi_unlock( HIGHLEVEL_LOCK );
+   if ( node != NULL )
+      *node = current_region_node;
    return ( PAPI_OK );
 }
 
@@ -1072,23 +1271,32 @@ static int _internal_hl_read_counters()
    return ( PAPI_OK );
 }
 
-static int _internal_hl_read_and_store_counters( const char *region, enum region_type reg_typ )
+static int _internal_hl_read_and_store_counters( int handle, enum region_type reg_typ,
+                                                 regions_t **node )
 {
    int retval;
+   /* the sample handler reads into the same buffers */
+   _local_sample_blocked++;
    /* read all events */
    if ( ( retval = _internal_hl_read_counters() ) != PAPI_OK ) {
+      _local_sample_blocked--;
       verbose_fprintf(stdout, "PAPI-HL Error: Could not read counters for thread %lu.\n", PAPI_thread_id());
       _internal_hl_clean_up_all(true);
       return ( retval );
    }
 
+   /* a sample due since the last call */
+   _internal_hl_sample_take();
+
    /* store all events */
-   if ( ( retval = _internal_hl_store_counters( PAPI_thread_id(), region, reg_typ) ) != PAPI_OK ) {
+   if ( ( retval = _internal_hl_store_counters( PAPI_thread_id(), handle, reg_typ, node) ) != PAPI_OK ) {
+      _local_sample_blocked--;
       verbose_fprintf(stdout, "PAPI-HL Error: Could not store counters for thread %lu.\n", PAPI_thread_id());
       verbose_fprintf(stdout, "PAPI-HL Advice: Check if your regions are matching.\n");
       _internal_hl_clean_up_all(true);
       return ( retval );
    }
+   _local_sample_blocked--;
    return ( PAPI_OK );
 }
 
@@ -1102,6 +1310,338 @@ static int _internal_hl_create_global_binary_tree()
    return ( PAPI_OK );
 }
 
+#ifdef PAPIHL_SAMPLING
+/* Components whose read is a system call or a counter read, without locks */
+static const char *sample_signal_safe_components[] = { "perf_event", "perf_event_uncore", NULL };
+
+static bool _internal_hl_sample_signal_safe()
+{
+   const PAPI_component_info_t *cmpinfo;
+   int i, j;
+
+   for ( i = 0; i < num_of_components; i++ ) {
+      cmpinfo = PAPI_get_component_info( components[i].component_id );
+      if ( cmpinfo == NULL )
+         return false;
+      for ( j = 0; sample_signal_safe_components[j] != NULL; j++ )
+         if ( strcmp(cmpinfo->name, sample_signal_safe_components[j]) == 0 )
+            break;
+      if ( sample_signal_safe_components[j] == NULL )
+         return false;
+   }
+   return true;
+}
+
+/* Append the values just read to the ring of the calling thread */
+static void _internal_hl_sample_record( samplers_t *sampler )
+{
+   unsigned int head;
+   long_long *record;
+   int i, j, k;
+
+   head = sampler->head;
+   if ( head - __atomic_load_n(&sampler->tail, __ATOMIC_ACQUIRE) >= PAPIHL_SAMPLE_RING ) {
+      sampler->dropped++;
+      return;
+   }
+
+   record = sampler->records + ( head & ( PAPIHL_SAMPLE_RING - 1 ) ) * sample_record_len;
+   record[0] = PAPI_get_real_nsec();
+   record[1] = _local_cycles;
+   k = 2;
+   for ( i = 0; i < num_of_components; i++ )
+      for ( j = 0; j < components[i].num_of_events; j++ )
+         record[k++] = _local_components[i].values[j];
+
+   __atomic_store_n(&sampler->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void _internal_hl_sample_handler( int sig, siginfo_t *info, void *context )
+{
+   samplers_t *sampler = (samplers_t *)info->si_value.sival_ptr;
+   int saved_errno = errno;
+
+   (void) sig;
+   (void) context;
+
+   /* the samplers are freed once sampling has stopped and no one uses them */
+   __atomic_add_fetch(&sample_users, 1, __ATOMIC_SEQ_CST);
+
+   /* the thread is inside a high-level call or has stopped counting */
+   if ( __atomic_load_n(&sample_writer_stop, __ATOMIC_SEQ_CST) == false &&
+        sampler != NULL && sampler == _local_sampler && !_local_sample_blocked &&
+        _papi_hl_events_running != 0 && _local_components != NULL ) {
+      if ( sample_in_handler == false )
+         sampler->pending = 1;
+      else if ( _internal_hl_read_counters() == PAPI_OK )
+         _internal_hl_sample_record(sampler);
+   }
+
+   __atomic_sub_fetch(&sample_users, 1, __ATOMIC_SEQ_CST);
+   errno = saved_errno;
+}
+
+/* Append the records of all rings to the sample file, HIGHLEVEL_LOCK must be held */
+static void _internal_hl_sample_flush()
+{
+   samplers_t *sampler;
+   unsigned int head, tail;
+   uint64_t tid;
+
+   if ( sample_file == NULL )
+      return;
+
+   for ( sampler = samplers; sampler != NULL; sampler = sampler->next ) {
+      head = __atomic_load_n(&sampler->head, __ATOMIC_ACQUIRE);
+      tid = sampler->tid;
+      for ( tail = sampler->tail; tail != head; tail++ ) {
+         fwrite(&tid, sizeof(tid), 1, sample_file);
+         fwrite(sampler->records + ( tail & ( PAPIHL_SAMPLE_RING - 1 ) ) * sample_record_len,
+                sizeof(long_long), sample_record_len, sample_file);
+      }
+      __atomic_store_n(&sampler->tail, tail, __ATOMIC_RELEASE);
+   }
+   fflush(sample_file);
+}
+
+static void *_internal_hl_sample_writer( void *arg )
+{
+   struct timespec ts;
+   long flush_ms;
+
+   (void) arg;
+   pthread_detach(pthread_self());
+
+   /* write well before a ring can fill up */
+   flush_ms = (long)sample_interval_ms * ( PAPIHL_SAMPLE_RING / 4 );
+   if ( flush_ms > PAPIHL_SAMPLE_MAX_FLUSH_MS )
+      flush_ms = PAPIHL_SAMPLE_MAX_FLUSH_MS;
+   ts.tv_sec = flush_ms / 1000;
+   ts.tv_nsec = ( flush_ms % 1000 ) * 1000000L;
+
+   while ( sample_writer_stop == false ) {
+      nanosleep(&ts, NULL);
+      _papi_hwi_lock( HIGHLEVEL_LOCK );
+      _internal_hl_sample_flush();
+      _papi_hwi_unlock( HIGHLEVEL_LOCK );
+   }
+   return NULL;
+}
+
+/* Create the sample file and start the writer, HIGHLEVEL_LOCK must be held */
+static int _internal_hl_sample_open()
+{
+   struct sigaction sa;
+   pthread_t writer;
+   char *path;
+   uint32_t header[3];
+   int rank, i, j;
+
+   if ( absolute_output_file_path == NULL ||
+        _internal_hl_mkdir(absolute_output_file_path) != PAPI_OK )
+      return ( PAPI_ESYS );
+
+   if ( ( path = (char *)malloc((strlen(absolute_output_file_path) + 32) * sizeof(char)) ) == NULL )
+      return ( PAPI_ENOMEM );
+   rank = _internal_hl_determine_rank();
+   if ( rank >= 0 )
+      sprintf(path, "%s/rank_%06d.samples", absolute_output_file_path, rank);
+   else
+      sprintf(path, "%s/pid_%06d.samples", absolute_output_file_path, (int)getpid());
+   sample_file = fopen(path, "wb");
+   if ( sample_file == NULL ) {
+      verbose_fprintf(stdout, "PAPI-HL Error: Cannot create sample file %s.\n", path);
+      free(path);
+      return ( PAPI_ESYS );
+   }
+   verbose_fprintf(stdout, "PAPI-HL Info: Writing samples to %s.\n", path);
+   free(path);
+
+   /* header: magic, version, interval and values per record, then the
+    * name of each value */
+   header[0] = 1;
+   header[1] = (uint32_t)sample_interval_ms;
+   header[2] = (uint32_t)sample_record_len;
+   fwrite("PAPIHLTS", 1, 8, sample_file);
+   fwrite(header, sizeof(uint32_t), 3, sample_file);
+   fwrite("real_time_nsec", 1, sizeof("real_time_nsec"), sample_file);
+   fwrite("cycles", 1, sizeof("cycles"), sample_file);
+   for ( i = 0; i < num_of_components; i++ )
+      for ( j = 0; j < components[i].num_of_events; j++ )
+         fwrite(components[i].event_names[j], 1, strlen(components[i].event_names[j]) + 1, sample_file);
+   fflush(sample_file);
+
+   sample_in_handler = _internal_hl_sample_signal_safe();
+   if ( sample_in_handler == false )
+      verbose_fprintf(stdout, "PAPI-HL Info: Samples are taken at the next high-level call, some components cannot be read in a signal handler.\n");
+
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_sigaction = _internal_hl_sample_handler;
+   sa.sa_flags = SA_SIGINFO | SA_RESTART;
+   sigemptyset(&sa.sa_mask);
+   if ( sigaction(PAPIHL_SAMPLE_SIGNAL, &sa, NULL) != 0 ) {
+      fclose(sample_file);
+      sample_file = NULL;
+      return ( PAPI_ESYS );
+   }
+
+   /* without threads the rings are only written at the end */
+   if ( pthread_create == NULL || pthread_create(&writer, NULL, _internal_hl_sample_writer, NULL) != 0 )
+      verbose_fprintf(stdout, "PAPI-HL Warning: Cannot start the sample writer, samples may be dropped.\n");
+
+   return ( PAPI_OK );
+}
+#endif
+
+/* Start sampling the event sets of the calling thread */
+static int _internal_hl_sample_start()
+{
+#ifdef PAPIHL_SAMPLING
+   samplers_t *sampler;
+   struct sigevent sev;
+   struct itimerspec its;
+   int retval;
+
+   if ( sample_interval_ms <= 0 || _local_sampler != NULL )
+      return ( PAPI_OK );
+
+   sampler = (samplers_t *)calloc(1, sizeof(samplers_t) + PAPIHL_SAMPLE_RING * ( total_num_events + 2 ) * sizeof(long_long));
+   if ( sampler == NULL )
+      return ( PAPI_ENOMEM );
+   sampler->tid = PAPI_thread_id();
+
+   _papi_hwi_lock( HIGHLEVEL_LOCK );
+   if ( sample_file == NULL ) {
+      if ( sample_writer_stop == true ) {
+         /* sampling has already been stopped */
+         _papi_hwi_unlock( HIGHLEVEL_LOCK );
+         free(sampler);
+         return ( PAPI_OK );
+      }
+      sample_record_len = total_num_events + 2;
+      if ( ( retval = _internal_hl_sample_open() ) != PAPI_OK ) {
+         sample_interval_ms = 0;
+         _papi_hwi_unlock( HIGHLEVEL_LOCK );
+         free(sampler);
+         return ( retval );
+      }
+   }
+   sampler->next = samplers;
+   samplers = sampler;
+   _papi_hwi_unlock( HIGHLEVEL_LOCK );
+
+   _local_sampler = sampler;
+
+   memset(&sev, 0, sizeof(sev));
+   sev.sigev_notify = SIGEV_THREAD_ID;
+   sev.sigev_signo = PAPIHL_SAMPLE_SIGNAL;
+   sev.sigev_value.sival_ptr = sampler;
+   sev.sigev_notify_thread_id = (pid_t)_papi_gettid();
+   if ( timer_create(CLOCK_MONOTONIC, &sev, &sampler->timer) != 0 )
+      return ( PAPI_ESYS );
+   sampler->armed = true;
+
+   its.it_value.tv_sec = sample_interval_ms / 1000;
+   its.it_value.tv_nsec = ( sample_interval_ms % 1000 ) * 1000000L;
+   its.it_interval = its.it_value;
+   if ( timer_settime(sampler->timer, 0, &its, NULL) != 0 )
+      return ( PAPI_ESYS );
+#endif
+   return ( PAPI_OK );
+}
+
+/* Take the sample the signal handler has marked as due, from the values
+ * just read by the calling thread */
+static void _internal_hl_sample_take()
+{
+#ifdef PAPIHL_SAMPLING
+   samplers_t *sampler = _local_sampler;
+
+   if ( sampler == NULL )
+      return;
+   __atomic_add_fetch(&sample_users, 1, __ATOMIC_SEQ_CST);
+   if ( __atomic_load_n(&sample_writer_stop, __ATOMIC_SEQ_CST) == false && sampler->pending ) {
+      sampler->pending = 0;
+      _internal_hl_sample_record(sampler);
+   }
+   __atomic_sub_fetch(&sample_users, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/* Stop the timer of the calling thread, write out its ring and free it */
+static void _internal_hl_sample_stop_thread()
+{
+#ifdef PAPIHL_SAMPLING
+   samplers_t *sampler = _local_sampler;
+   samplers_t **prev;
+
+   if ( sampler == NULL )
+      return;
+   _local_sample_blocked++;
+   _papi_hwi_lock( HIGHLEVEL_LOCK );
+   /* once sampling has stopped, the samplers are already freed */
+   if ( sample_writer_stop == false ) {
+      if ( sampler->armed )
+         timer_delete(sampler->timer);
+      _internal_hl_sample_flush();
+      sample_dropped += sampler->dropped;
+      for ( prev = &samplers; *prev != NULL; prev = &(*prev)->next ) {
+         if ( *prev == sampler ) {
+            *prev = sampler->next;
+            break;
+         }
+      }
+      free(sampler);
+   }
+   _papi_hwi_unlock( HIGHLEVEL_LOCK );
+   _local_sampler = NULL;
+   _local_sample_blocked--;
+#endif
+}
+
+/* Write out all rings, close the sample file and free the samplers */
+static void _internal_hl_sample_stop()
+{
+#ifdef PAPIHL_SAMPLING
+   samplers_t *sampler;
+   unsigned long long dropped;
+
+   if ( sample_interval_ms <= 0 )
+      return;
+
+   _internal_hl_sample_stop_thread();
+
+   _papi_hwi_lock( HIGHLEVEL_LOCK );
+   __atomic_store_n(&sample_writer_stop, true, __ATOMIC_SEQ_CST);
+   /* the other threads may still be sampling */
+   for ( sampler = samplers; sampler != NULL; sampler = sampler->next ) {
+      if ( sampler->armed ) {
+         timer_delete(sampler->timer);
+         sampler->armed = false;
+      }
+   }
+   while ( __atomic_load_n(&sample_users, __ATOMIC_SEQ_CST) != 0 )
+      sched_yield();
+
+   if ( sample_file != NULL ) {
+      _internal_hl_sample_flush();
+      fclose(sample_file);
+      sample_file = NULL;
+      dropped = sample_dropped;
+      for ( sampler = samplers; sampler != NULL; sampler = sampler->next )
+         dropped += sampler->dropped;
+      if ( dropped > 0 )
+         verbose_fprintf(stdout, "PAPI-HL Warning: %llu samples were dropped.\n", dropped);
+   }
+   while ( samplers != NULL ) {
+      sampler = samplers;
+      samplers = sampler->next;
+      free(sampler);
+   }
+   _papi_hwi_unlock( HIGHLEVEL_LOCK );
+#endif
+}
+
 
 static int _internal_hl_mkdir(const char *dir)
 {
@@ -1433,12 +1973,9 @@ static int _internal_get_sorted_thread_list(unsigned long** tids, int* threads_n
    return PAPI_OK;
 }
 
-static void _internal_hl_write_json_file(FILE* f, unsigned long* tids, int threads_num)
+/* Start of a JSON file up to the event definitions */
+static void _internal_hl_json_header(FILE* f, bool beautifier)
 {
-   /* JSON beautifier (line break and indent) */
-   bool beautifier = true;
-
-   /* start of JSON file */
    fprintf(f, "{");
    _internal_hl_json_line_break_and_indent(f, beautifier, 1);
    fprintf(f, "\"papi_version\":\"%d.%d.%d.%d\",", PAPI_VERSION_MAJOR( PAPI_VERSION ),
@@ -1461,6 +1998,15 @@ static void _internal_hl_write_json_file(FILE* f, unsigned long* tids, int threa
 
    /* write definitions */
    _internal_hl_json_definitions(f, beautifier);
+}
+
+static void _internal_hl_write_json_file(FILE* f, unsigned long* tids, int threads_num)
+{
+   /* JSON beautifier (line break and indent) */
+   bool beautifier = true;
+
+   /* start of JSON file */
+   _internal_hl_json_header(f, beautifier);
 
    /* write all regions with events per thread */
    _internal_hl_json_threads(f, beautifier, tids, threads_num);
@@ -1471,6 +2017,358 @@ static void _internal_hl_write_json_file(FILE* f, unsigned long* tids, int threa
    fprintf(f, "\n");
 }
 
+/* Rank and number of ranks on this node, as set by the launcher */
+static int _internal_hl_determine_local_rank( int *local_rank, int *local_size )
+{
+   char *rank_env = NULL, *size_env = NULL, *end;
+   long tasks, reps;
+   int node;
+
+   *local_size = -1;
+   if ( getenv("OMPI_COMM_WORLD_LOCAL_RANK") != NULL ) {
+      rank_env = getenv("OMPI_COMM_WORLD_LOCAL_RANK");
+      size_env = getenv("OMPI_COMM_WORLD_LOCAL_SIZE");
+   } else if ( getenv("MPI_LOCALRANKID") != NULL ) {
+      rank_env = getenv("MPI_LOCALRANKID");
+      size_env = getenv("MPI_LOCALNRANKS");
+   } else if ( getenv("PALS_LOCAL_RANKID") != NULL ) {
+      rank_env = getenv("PALS_LOCAL_RANKID");
+      size_env = getenv("PALS_LOCAL_SIZE");
+   } else if ( getenv("PMI_LOCAL_RANK") != NULL ) {
+      rank_env = getenv("PMI_LOCAL_RANK");
+      size_env = getenv("PMI_LOCAL_SIZE");
+   } else if ( getenv("SLURM_LOCALID") != NULL && getenv("SLURM_NODEID") != NULL ) {
+      /* tasks per node look like "2(x3),1", pick the entry of this node */
+      rank_env = getenv("SLURM_LOCALID");
+      node = atoi(getenv("SLURM_NODEID"));
+      if ( ( size_env = getenv("SLURM_STEP_TASKS_PER_NODE") ) == NULL )
+         size_env = getenv("SLURM_TASKS_PER_NODE");
+      while ( size_env != NULL && *size_env != '\0' ) {
+         tasks = strtol(size_env, &end, 10);
+         if ( end == size_env )
+            break;
+         reps = 1;
+         if ( end[0] == '(' && end[1] == 'x' ) {
+            reps = strtol(end + 2, &end, 10);
+            if ( *end++ != ')' )
+               break;
+         }
+         if ( node < reps ) {
+            *local_size = (int)tasks;
+            break;
+         }
+         node -= (int)reps;
+         size_env = ( *end == ',' ) ? end + 1 : NULL;
+      }
+      size_env = NULL;
+   }
+
+   if ( rank_env == NULL )
+      return ( PAPI_ENOSUPP );
+   *local_rank = atoi(rank_env);
+   if ( size_env != NULL )
+      *local_size = atoi(size_env);
+   if ( *local_rank < 0 || *local_size <= *local_rank )
+      return ( PAPI_ENOSUPP );
+   return ( PAPI_OK );
+}
+
+/* Sum up the regions of all threads by name into a node slot */
+static int _internal_hl_node_fill_slot( node_slot_t *slot, int rank )
+{
+   unsigned long *tids = NULL;
+   threads_t *thread_node;
+   regions_t *regions;
+   node_region_t *record;
+   char *data = (char *)( slot + 1 );
+   short *types;
+   int *index;
+   int threads_num, num_values, size, i, j, k;
+
+   num_values = total_num_events + 2;
+   slot->rank = rank;
+   slot->num_values = num_values;
+   slot->num_regions = 0;
+   slot->used = 0;
+
+   /* cycles and real time are deltas */
+   if ( ( types = (short *)calloc(num_values, sizeof(short)) ) == NULL )
+      return ( PAPI_ENOMEM );
+   k = 2;
+   for ( i = 0; i < num_of_components; i++ )
+      for ( j = 0; j < components[i].num_of_events; j++ )
+         types[k++] = components[i].event_types[j];
+
+   /* offset of the record of each region handle */
+   if ( ( index = (int *)malloc(PAPIHL_MAX_REGION_NAMES * sizeof(int)) ) == NULL ) {
+      free(types);
+      return ( PAPI_ENOMEM );
+   }
+   for ( i = 0; i < PAPIHL_MAX_REGION_NAMES; i++ )
+      index[i] = -1;
+
+   if ( _internal_get_sorted_thread_list(&tids, &threads_num) != PAPI_OK ) {
+      free(types);
+      free(index);
+      return ( PAPI_EMISC );
+   }
+
+   for ( i = 0; i < threads_num; i++ ) {
+      if ( ( thread_node = _internal_hl_find_thread_node(tids[i]) ) == NULL )
+         continue;
+      for ( regions = thread_node->value; regions != NULL; regions = regions->next ) {
+         if ( index[regions->handle] < 0 ) {
+            size = sizeof(node_region_t) + num_values * sizeof(long_long) +
+                   ( ( strlen(regions->region) + 8 ) & ~7 );
+            if ( slot->used + size > (int)( PAPIHL_NODE_SLOT_SIZE - sizeof(node_slot_t) ) ) {
+               free(tids);
+               free(types);
+               free(index);
+               return ( PAPI_ENOMEM );
+            }
+            record = (node_region_t *)( data + slot->used );
+            memset(record, 0, size);
+            record->size = size;
+            strcpy((char *)( record->values + num_values ), regions->region);
+            index[regions->handle] = slot->used;
+            slot->used += size;
+            slot->num_regions++;
+         }
+         record = (node_region_t *)( data + index[regions->handle] );
+         record->count++;
+         /* instantaneous values are not summed up, keep the largest */
+         for ( j = 0; j < num_values; j++ ) {
+            if ( types[j] == 0 )
+               record->values[j] += regions->values[j].region_value;
+            else if ( record->count == 1 || regions->values[j].region_value > record->values[j] )
+               record->values[j] = regions->values[j].region_value;
+         }
+      }
+   }
+
+   free(tids);
+   free(types);
+   free(index);
+   return ( PAPI_OK );
+}
+
+/* Merge the slots of all ranks of the node into one output file */
+static int _internal_hl_node_write( node_header_t *header, int local_size )
+{
+   node_aggregate_t **aggregates;
+   node_slot_t *slot;
+   node_region_t *record;
+   char hostname[PAPI_MAX_STR_LEN], *path, *name;
+   int *handles;
+   int num_handles = 0, num_ranks = 0, num_values = total_num_events + 2;
+   int i, j, k, handle, retval = PAPI_OK;
+   FILE *f;
+   bool beautifier = true;
+
+   if ( ( aggregates = (node_aggregate_t **)calloc(PAPIHL_MAX_REGION_NAMES, sizeof(node_aggregate_t *)) ) == NULL )
+      return ( PAPI_ENOMEM );
+   if ( ( handles = (int *)malloc(PAPIHL_MAX_REGION_NAMES * sizeof(int)) ) == NULL ) {
+      free(aggregates);
+      return ( PAPI_ENOMEM );
+   }
+
+   for ( i = 0; i < local_size && retval == PAPI_OK; i++ ) {
+      slot = (node_slot_t *)( (char *)( header + 1 ) + (size_t)i * PAPIHL_NODE_SLOT_SIZE );
+      if ( slot->num_regions < 0 )
+         continue;
+      if ( slot->num_values != num_values ) {
+         verbose_fprintf(stdout, "PAPI-HL Warning: Rank %d recorded other events, it is left out.\n", slot->rank);
+         continue;
+      }
+      num_ranks++;
+      record = (node_region_t *)( slot + 1 );
+      for ( j = 0; j < slot->num_regions; j++ ) {
+         name = (char *)( record->values + num_values );
+         if ( ( retval = _internal_hl_region_intern(name, &handle) ) != PAPI_OK )
+            break;
+         if ( aggregates[handle] == NULL ) {
+            aggregates[handle] = (node_aggregate_t *)calloc(1, sizeof(node_aggregate_t) + 3 * num_values * sizeof(long_long));
+            if ( aggregates[handle] == NULL ) {
+               retval = PAPI_ENOMEM;
+               break;
+            }
+            aggregates[handle]->total = (long_long *)( aggregates[handle] + 1 );
+            aggregates[handle]->min = aggregates[handle]->total + num_values;
+            aggregates[handle]->max = aggregates[handle]->min + num_values;
+            handles[num_handles++] = handle;
+         }
+         aggregates[handle]->count += record->count;
+         for ( k = 0; k < num_values; k++ ) {
+            if ( aggregates[handle]->ranks == 0 || record->values[k] < aggregates[handle]->min[k] )
+               aggregates[handle]->min[k] = record->values[k];
+            if ( aggregates[handle]->ranks == 0 || record->values[k] > aggregates[handle]->max[k] )
+               aggregates[handle]->max[k] = record->values[k];
+            aggregates[handle]->total[k] += record->values[k];
+         }
+         aggregates[handle]->ranks++;
+         record = (node_region_t *)( (char *)record + record->size );
+      }
+   }
+
+   if ( retval == PAPI_OK ) {
+      if ( gethostname(hostname, sizeof(hostname)) != 0 )
+         strcpy(hostname, "localhost");
+      hostname[sizeof(hostname) - 1] = '\0';
+      if ( ( path = (char *)malloc((strlen(absolute_output_file_path) + strlen(hostname) + 16) * sizeof(char)) ) == NULL )
+         retval = PAPI_ENOMEM;
+   }
+   if ( retval == PAPI_OK ) {
+      sprintf(path, "%s/node_%s.json", absolute_output_file_path, hostname);
+      if ( ( f = fopen(path, "w") ) == NULL ) {
+         verbose_fprintf(stdout, "PAPI-HL Error: Cannot create output file %s.\n", path);
+         retval = PAPI_ESYS;
+      } else {
+         /* same layout as a rank file, with one thread holding the
+          * regions of all ranks */
+         _internal_hl_json_header(f, beautifier);
+         _internal_hl_json_line_break_and_indent(f, beautifier, 1);
+         fprintf(f, "\"node\":\"%s\",", hostname);
+         _internal_hl_json_line_break_and_indent(f, beautifier, 1);
+         fprintf(f, "\"number_of_ranks\":\"%d\",", num_ranks);
+         _internal_hl_json_line_break_and_indent(f, beautifier, 1);
+         fprintf(f, "\"threads\":{");
+         _internal_hl_json_line_break_and_indent(f, beautifier, 2);
+         fprintf(f, "\"0\":{");
+         _internal_hl_json_line_break_and_indent(f, beautifier, 3);
+         fprintf(f, "\"regions\":{");
+         for ( i = 0; i < num_handles; i++ ) {
+            node_aggregate_t *aggregate = aggregates[handles[i]];
+            _internal_hl_json_line_break_and_indent(f, beautifier, 4);
+            fprintf(f, "\"%d\":{", i);
+            _internal_hl_json_line_break_and_indent(f, beautifier, 5);
+            fprintf(f, "\"name\":\"%s\",", region_names[handles[i]]);
+            _internal_hl_json_line_break_and_indent(f, beautifier, 5);
+            fprintf(f, "\"region_count\":\"%lld\",", aggregate->count);
+            k = 2;
+            for ( j = 0; j < num_values; j++ ) {
+               const char *value_name = ( j == 0 ) ? "cycles" : "real_time_nsec";
+               bool instant = false;
+               if ( j >= 2 ) {
+                  int c = 0, e = j - 2;
+                  while ( e >= components[c].num_of_events )
+                     e -= components[c++].num_of_events;
+                  value_name = components[c].event_names[e];
+                  instant = ( components[c].event_types[e] == 1 );
+               }
+               _internal_hl_json_line_break_and_indent(f, beautifier, 5);
+               fprintf(f, "\"%s\":{", value_name);
+               if ( !instant )
+                  fprintf(f, "\"total\":\"%lld\",", aggregate->total[j]);
+               fprintf(f, "\"min\":\"%lld\",\"avg\":\"%lld\",\"max\":\"%lld\"}",
+                       aggregate->min[j], aggregate->total[j] / aggregate->ranks, aggregate->max[j]);
+               if ( j < num_values - 1 )
+                  fprintf(f, ",");
+            }
+            _internal_hl_json_line_break_and_indent(f, beautifier, 4);
+            fprintf(f, i < num_handles - 1 ? "}," : "}");
+         }
+         _internal_hl_json_line_break_and_indent(f, beautifier, 3);
+         fprintf(f, "}");
+         _internal_hl_json_line_break_and_indent(f, beautifier, 2);
+         fprintf(f, "}");
+         _internal_hl_json_line_break_and_indent(f, beautifier, 1);
+         fprintf(f, "}");
+         _internal_hl_json_line_break_and_indent(f, beautifier, 0);
+         fprintf(f, "}\n");
+         fclose(f);
+
+         if ( getenv("PAPI_REPORT") != NULL )
+            _internal_hl_read_json_file(path);
+      }
+      free(path);
+   }
+
+   for ( i = 0; i < num_handles; i++ )
+      free(aggregates[handles[i]]);
+   free(aggregates);
+   free(handles);
+   return ( retval );
+}
+
+/* Publish the regions of this rank to the other ranks of the node, the
+ * last one writes the output of the node. Returns PAPI_OK if this rank
+ * has nothing left to write. */
+static int _internal_hl_node_publish( int rank )
+{
+   node_header_t *header;
+   node_slot_t *slot;
+   char name[PAPI_MAX_STR_LEN], job[PAPI_MIN_STR_LEN];
+   int local_rank, local_size, expected = 0, fd, i, retval;
+   struct stat dir;
+   size_t size;
+
+   if ( ( retval = _internal_hl_determine_local_rank(&local_rank, &local_size) ) != PAPI_OK ) {
+      verbose_fprintf(stdout, "PAPI-HL Warning: Cannot determine the ranks on this node, writing one file per rank.\n");
+      return ( retval );
+   }
+
+   /* the segment belongs to the job step and the measurement directory */
+   if ( getenv("SLURM_JOB_ID") != NULL )
+      snprintf(job, sizeof(job), "%s.%s", getenv("SLURM_JOB_ID"),
+               getenv("SLURM_STEP_ID") != NULL ? getenv("SLURM_STEP_ID") : "0");
+   else if ( getenv("PMIX_NAMESPACE") != NULL )
+      snprintf(job, sizeof(job), "%s", getenv("PMIX_NAMESPACE"));
+   else if ( getenv("OMPI_MCA_ess_base_jobid") != NULL )
+      snprintf(job, sizeof(job), "%s", getenv("OMPI_MCA_ess_base_jobid"));
+   else
+      snprintf(job, sizeof(job), "%d", (int)getppid());
+   for ( i = 0; job[i] != '\0'; i++ )
+      if ( job[i] == '/' )
+         job[i] = '_';
+   /* the measurement directory is created anew by each run, its inode
+    * keeps a segment left behind by a run that failed from being reused */
+   if ( stat(absolute_output_file_path, &dir) != 0 ) {
+      verbose_fprintf(stdout, "PAPI-HL Warning: Cannot stat %s: %s.\n", absolute_output_file_path, strerror(errno));
+      return ( PAPI_ESYS );
+   }
+   snprintf(name, sizeof(name), "/papi_hl_%s_%08x_%llx_%llx", job,
+            _internal_hl_region_hash(absolute_output_file_path),
+            (unsigned long long)dir.st_dev, (unsigned long long)dir.st_ino);
+
+   size = sizeof(node_header_t) + (size_t)local_size * PAPIHL_NODE_SLOT_SIZE;
+   if ( ( fd = shm_open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR) ) < 0 ) {
+      verbose_fprintf(stdout, "PAPI-HL Warning: Cannot open shared memory %s: %s.\n", name, strerror(errno));
+      return ( PAPI_ESYS );
+   }
+   /* every rank sets the same size, the first one zeroes it */
+   if ( ftruncate(fd, size) != 0 ||
+        ( header = (node_header_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ) == MAP_FAILED ) {
+      verbose_fprintf(stdout, "PAPI-HL Warning: Cannot map shared memory %s: %s.\n", name, strerror(errno));
+      close(fd);
+      return ( PAPI_ESYS );
+   }
+   close(fd);
+
+   if ( !__atomic_compare_exchange_n(&header->local_size, &expected, local_size, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) && expected != local_size ) {
+      verbose_fprintf(stdout, "PAPI-HL Warning: Ranks disagree on the number of ranks on this node.\n");
+      munmap(header, size);
+      return ( PAPI_EINVAL );
+   }
+
+   /* a rank that does not fit still has to be counted, it writes its own file */
+   slot = (node_slot_t *)( (char *)( header + 1 ) + (size_t)local_rank * PAPIHL_NODE_SLOT_SIZE );
+   if ( ( retval = _internal_hl_node_fill_slot(slot, rank) ) != PAPI_OK ) {
+      verbose_fprintf(stdout, "PAPI-HL Warning: Regions of rank %d do not fit in shared memory.\n", rank);
+      slot->num_regions = -1;
+   }
+
+   if ( __atomic_add_fetch(&header->published, 1, __ATOMIC_ACQ_REL) == local_size ) {
+      verbose_fprintf(stdout, "PAPI-HL Info: Print results of %d ranks...\n", local_size);
+      if ( _internal_hl_node_write(header, local_size) != PAPI_OK )
+         verbose_fprintf(stdout, "PAPI-HL Error: Cannot write the output of this node.\n");
+      shm_unlink(name);
+   }
+
+   munmap(header, size);
+   return ( retval );
+}
+
 static void _internal_hl_read_json_file(const char* path)
 {
    /* print output to stdout */
@@ -1520,6 +2418,15 @@ static void _internal_hl_write_output()
          /* determine rank for output file */
          int rank = _internal_hl_determine_rank();
 
+         /* with node aggregation one rank per node writes the output */
+         if ( getenv("PAPI_HL_NODE_AGGREGATE") != NULL && rank >= 0 &&
+              _internal_hl_node_publish(rank) == PAPI_OK ) {
+            output_generated = true;
+            free(absolute_output_file_path);
+            _papi_hwi_unlock( HIGHLEVEL_LOCK );
+            return;
+         }
+
          /* if system does not provide rank id, create a random id */
          if ( rank < 0 ) {
             srandom( time(NULL) + getpid() );
@@ -1608,6 +2515,7 @@ static void _internal_hl_write_output()
 static void _internal_hl_clean_up_local_data()
 {
    int i, retval;
+   _internal_hl_sample_stop_thread();
    /* destroy all EventSets from local data */
    if ( _local_components != NULL ) {
       HLDBG("Thread-ID:%lu\n", PAPI_thread_id());
@@ -1665,7 +2573,6 @@ static void _internal_hl_clean_up_global_data()
             tmp = region;
             region = region->next;
 
-            free(tmp->region);
             free(tmp);
          }
          free(region);
@@ -1693,6 +2600,9 @@ static void _internal_hl_clean_up_all(bool deactivate)
     * cannot be generated due to previous errors */
    output_generated = true;
 
+   /* keep the samples taken so far */
+   _internal_hl_sample_stop();
+
    /* clean up thread local data */
    if ( _local_state == PAPIHL_ACTIVE ) {
      HLDBG("Clean up thread local data for thread %lu\n", PAPI_thread_id());
@@ -1838,6 +2748,7 @@ _internal_PAPI_hl_print_output()
    if ( state == PAPIHL_ACTIVE && 
         hl_initiated == true && 
         output_generated == false ) {
+      _internal_hl_sample_stop();
       _internal_hl_write_output();
    }
 }
@@ -1895,11 +2806,183 @@ _internal_PAPI_hl_print_output()
  * @see PAPI_hl_read
  * @see PAPI_hl_region_end
  * @see PAPI_hl_stop
+ * @see PAPI_hl_region_register
  */
 int
 PAPI_hl_region_begin( const char* region )
 {
+   int retval, handle;
+
+   if ( ( retval = _internal_hl_region_intern(region, &handle) ) != PAPI_OK )
+      return ( retval );
+
+   return ( PAPI_hl_region_begin_h(handle) );
+}
+
+/** @class PAPI_hl_read
+ * @brief Read performance events inside of a region and store the difference to the corresponding
+ * beginning of the region.
+ *
+ * @par C Interface:
+ * \#include <papi.h> @n
+ * int PAPI_hl_read( const char* region );
+ *
+ * @param region
+ * -- a unique region name corresponding to PAPI_hl_region_begin
+ *
+ * @retval PAPI_OK
+ * @retval PAPI_ENOTRUN
+ * -- EventSet is currently not running or could not determined.
+ * @retval PAPI_ESYS
+ * -- A system or C library call failed inside PAPI, see the errno variable.
+ * @retval PAPI_EMISC
+ * -- PAPI has been deactivated due to previous errors.
+ * @retval PAPI_ENOMEM
+ * -- Insufficient memory.
+ *
+ * PAPI_hl_read reads performance events inside of a region and stores the difference to the 
+ * corresponding beginning of the region.
+ *
+ * Assumes that PAPI_hl_region_begin was called before.
+ *
+ * @par Example:
+ *
+ * @code
+ * int retval;
+ *
+ * retval = PAPI_hl_region_begin("computation");
+ * if ( retval != PAPI_OK )
+ *     handle_error(1);
+ *
+ *  //Do some computation here
+ *
+ * retval = PAPI_hl_read("computation");
+ * if ( retval != PAPI_OK )
+ *     handle_error(1);
+ *
+ *  //Do some computation here
+ *
+ * retval = PAPI_hl_region_end("computation");
+ * if ( retval != PAPI_OK )
+ *     handle_error(1);
+ *
+ * @endcode
+ *
+ * @see PAPI_hl_region_begin
+ * @see PAPI_hl_region_end
+ * @see PAPI_hl_stop
+ */
+int
+PAPI_hl_read(const char* region)
+{
+   int retval, handle;
+
+   if ( ( retval = _internal_hl_region_intern(region, &handle) ) != PAPI_OK )
+      return ( retval );
+
+   return ( PAPI_hl_read_h(handle) );
+}
+
+/** @class PAPI_hl_region_register
+ * @brief Get a handle for a region name.
+ *
+ * @par C Interface:
+ * \#include <papi.h> @n
+ * int PAPI_hl_region_register( const char* region, int *handle );
+ *
+ * @param region
+ * -- a region name
+ * @param handle
+ * -- returns the handle of the region
+ *
+ * @retval PAPI_OK
+ * @retval PAPI_EINVAL
+ * -- One or more of the arguments is invalid.
+ * @retval PAPI_ENOMEM
+ * -- Insufficient memory, or too many distinct region names.
+ *
+ * PAPI_hl_region_register stores a region name once and returns a handle for it that can be
+ * passed to PAPI_hl_region_begin_h, PAPI_hl_read_h and PAPI_hl_region_end_h. The handle calls
+ * do not look at the name again, which matters for regions that are entered very often.
+ * Registering the same name again returns the same handle, in any thread, and the string
+ * calls use the same handle internally, so both kinds of calls can be mixed on a region.
+ * Handles stay valid until the application terminates.
+ *
+ * @par Example:
+ *
+ * @code
+ * int retval, handle;
+ *
+ * retval = PAPI_hl_region_register("computation", &handle);
+ * if ( retval != PAPI_OK )
+ *     handle_error(1);
+ *
+ * for ( i = 0; i < n; i++ ) {
+ *    retval = PAPI_hl_region_begin_h(handle);
+ *    if ( retval != PAPI_OK )
+ *        handle_error(1);
+ *
+ *     //Do some computation here
+ *
+ *    retval = PAPI_hl_region_end_h(handle);
+ *    if ( retval != PAPI_OK )
+ *        handle_error(1);
+ * }
+ *
+ * @endcode
+ *
+ * @see PAPI_hl_region_begin_h
+ * @see PAPI_hl_read_h
+ * @see PAPI_hl_region_end_h
+ */
+int
+PAPI_hl_region_register( const char* region, int *handle )
+{
+   if ( handle == NULL )
+      return ( PAPI_EINVAL );
+   return ( _internal_hl_region_intern(region, handle) );
+}
+
+/** @class PAPI_hl_region_begin_h
+ * @brief Read performance events at the beginning of a region given by its handle.
+ *
+ * @par C Interface:
+ * \#include <papi.h> @n
+ * int PAPI_hl_region_begin_h( int handle );
+ *
+ * @param handle
+ * -- a region handle from PAPI_hl_region_register
+ *
+ * @retval PAPI_OK
+ * @retval PAPI_EINVAL
+ * -- The handle is invalid.
+ * @retval PAPI_ENOTRUN
+ * -- EventSet is currently not running or could not determined.
+ * @retval PAPI_ESYS
+ * -- A system or C library call failed inside PAPI, see the errno variable.
+ * @retval PAPI_EMISC
+ * -- PAPI has been deactivated due to previous errors.
+ * @retval PAPI_ENOMEM
+ * -- Insufficient memory.
+ *
+ * PAPI_hl_region_begin_h does the same as PAPI_hl_region_begin for the region name the handle
+ * was registered with.
+ *
+ * @see PAPI_hl_region_register
+ * @see PAPI_hl_region_begin
+ * @see PAPI_hl_region_end_h
+ */
+int
+PAPI_hl_region_begin_h( int handle )
+{
+   PAPI_SELF_SCOPE( PAPI_SELF_PAPI_hl_region_begin );
    int retval;
+   regions_t *node;
+
+   if ( handle < 0 || handle >= PAPIHL_MAX_REGION_NAMES ||
+        __atomic_load_n(&region_names[handle], __ATOMIC_ACQUIRE) == NULL )
+      return ( PAPI_EINVAL );
+
    /* if a rate event set is running stop it */
    if ( _papi_rate_events_running == 1 ) {
       if ( ( retval = PAPI_rate_stop() ) != PAPI_OK )
@@ -1943,11 +3026,11 @@ PAPI_hl_region_begin( const char* region )
    }
 
    /* read and store all events */
-   HLDBG("Thread ID:%lu, Region:%s\n", PAPI_thread_id(), region);
-   if ( ( retval = _internal_hl_read_and_store_counters(region, REGION_BEGIN) ) != PAPI_OK )
+   HLDBG("Thread ID:%lu, Region:%s\n", PAPI_thread_id(), region_names[handle]);
+   if ( ( retval = _internal_hl_read_and_store_counters(handle, REGION_BEGIN, &node) ) != PAPI_OK )
       return ( retval );
 
-   if ( ( retval = _internal_hl_region_id_push() ) != PAPI_OK ) {
+   if ( ( retval = _internal_hl_region_id_push(node) ) != PAPI_OK ) {
       verbose_fprintf(stdout, "PAPI-HL Warning: Number of nested regions exceeded for thread %lu.\n", PAPI_thread_id());
       _internal_hl_clean_up_all(true);
       return ( retval );
@@ -1956,18 +3039,19 @@ PAPI_hl_region_begin( const char* region )
    return ( PAPI_OK );
 }
 
-/** @class PAPI_hl_read
- * @brief Read performance events inside of a region and store the difference to the corresponding
- * beginning of the region.
+/** @class PAPI_hl_read_h
+ * @brief Read performance events inside of a region given by its handle.
  *
  * @par C Interface:
  * \#include <papi.h> @n
- * int PAPI_hl_read( const char* region );
+ * int PAPI_hl_read_h( int handle );
  *
- * @param region
- * -- a unique region name corresponding to PAPI_hl_region_begin
+ * @param handle
+ * -- a region handle from PAPI_hl_region_register
  *
  * @retval PAPI_OK
+ * @retval PAPI_EINVAL
+ * -- The handle is invalid.
  * @retval PAPI_ENOTRUN
  * -- EventSet is currently not running or could not determined.
  * @retval PAPI_ESYS
@@ -1977,43 +3061,23 @@ PAPI_hl_region_begin( const char* region )
  * @retval PAPI_ENOMEM
  * -- Insufficient memory.
  *
- * PAPI_hl_read reads performance events inside of a region and stores the difference to the 
- * corresponding beginning of the region.
- *
- * Assumes that PAPI_hl_region_begin was called before.
- *
- * @par Example:
- *
- * @code
- * int retval;
- *
- * retval = PAPI_hl_region_begin("computation");
- * if ( retval != PAPI_OK )
- *     handle_error(1);
- *
- *  //Do some computation here
- *
- * retval = PAPI_hl_read("computation");
- * if ( retval != PAPI_OK )
- *     handle_error(1);
- *
- *  //Do some computation here
+ * PAPI_hl_read_h does the same as PAPI_hl_read for the region name the handle was registered
+ * with.
  *
- * retval = PAPI_hl_region_end("computation");
- * if ( retval != PAPI_OK )
- *     handle_error(1);
- *
- * @endcode
- *
- * @see PAPI_hl_region_begin
- * @see PAPI_hl_region_end
- * @see PAPI_hl_stop
+ * @see PAPI_hl_region_register
+ * @see PAPI_hl_read
+ * @see PAPI_hl_region_begin_h
  */
 int
-PAPI_hl_read(const char* region)
+PAPI_hl_read_h( int handle )
 {
+   PAPI_SELF_SCOPE( PAPI_SELF_PAPI_hl_read );
    int retval;
 
+   if ( handle < 0 || handle >= PAPIHL_MAX_REGION_NAMES ||
+        __atomic_load_n(&region_names[handle], __ATOMIC_ACQUIRE) == NULL )
+      return ( PAPI_EINVAL );
+
    if ( state == PAPIHL_DEACTIVATED ) {
       /* check if we have to clean up local stuff */
       if ( _local_state == PAPIHL_ACTIVE )
@@ -2022,7 +3086,7 @@ PAPI_hl_read(const char* region)
    }
 
    if ( _local_region_begin_cnt == 0 ) {
-      verbose_fprintf(stdout, "PAPI-HL Warning: Cannot find matching region for PAPI_hl_read(\"%s\") for thread %lu.\n", region, PAPI_thread_id());
+      verbose_fprintf(stdout, "PAPI-HL Warning: Cannot find matching region for PAPI_hl_read(\"%s\") for thread %lu.\n", region_names[handle], PAPI_thread_id());
       return ( PAPI_EMISC );
    }
 
@@ -2030,8 +3094,8 @@ PAPI_hl_read(const char* region)
       return ( PAPI_ENOTRUN );
 
    /* read and store all events */
-   HLDBG("Thread ID:%lu, Region:%s\n", PAPI_thread_id(), region);
-   if ( ( retval = _internal_hl_read_and_store_counters(region, REGION_READ) ) != PAPI_OK )
+   HLDBG("Thread ID:%lu, Region:%s\n", PAPI_thread_id(), region_names[handle]);
+   if ( ( retval = _internal_hl_read_and_store_counters(handle, REGION_READ, NULL) ) != PAPI_OK )
       return ( retval );
 
    return ( PAPI_OK );
@@ -2081,11 +3145,34 @@ PAPI_hl_read(const char* region)
  * For more convenience, the output can also be printed to stdout by setting PAPI_REPORT=1. This
  * is not recommended for MPI applications as each MPI rank tries to print the output concurrently.
  *
+ * To follow the events over time, set PAPI_HL_SAMPLE_INTERVAL_MS to a sampling interval in
+ * milliseconds. Each thread then records the current values of its events at that interval,
+ * skipping samples while it is inside a high-level call, and the samples are appended to the
+ * file rank_<rank>.samples (or pid_<pid>.samples) in the measurement directory while the
+ * application runs. The file starts with the eight characters "PAPIHLTS", followed by three
+ * 32-bit integers: the format version (1), the interval and the number of values per sample.
+ * The names of the values follow as null-terminated strings: "real_time_nsec", "cycles" and the
+ * recorded events. Each sample is then a 64-bit thread id followed by the 64-bit values, all in
+ * the byte order of the machine. Values are totals since counting started, not differences.
+ * The events are read in the signal handler of the timer only when every component is
+ * perf_event or perf_event_uncore, whose reads take no lock. Otherwise a sample that falls due
+ * is taken at the next high-level call of the thread.
+ *
+ * MPI applications with many ranks per node can set PAPI_HL_NODE_AGGREGATE=1 to write one
+ * file per node instead of one per rank. Each rank sums up the regions of its threads by name
+ * and leaves them in a shared memory segment, and the last rank of the node to finish writes
+ * node_<hostname>.json. For each region and event it holds the total over all ranks and the
+ * minimum, average and maximum of the ranks (instantaneous values have no total). The number
+ * of ranks on the node is taken from the launcher (Open MPI, MPICH, PMI, PALS or Slurm); when
+ * it is not known, or the regions of a rank do not fit, ranks write their own files as usual.
+ *
  * The generated measurement output can also be converted in a better readable output. The python
  * script papi_hl_output_writer.py enhances the output by creating some derived metrics, like IPC,
  * MFlops/s, and MFlips/s as well as real and processor time in case the corresponding PAPI events
  * have been recorded. The python script can also summarize performance events over all threads and
- * MPI ranks when using the option "accumulate" as seen below.
+ * MPI ranks when using the option "accumulate" as seen below. For measurements of many ranks, the
+ * utility papi_hl_report writes the same summary much faster, reading the rank files in parallel
+ * without loading them into memory.
  * 
  * @par Example:
  *
@@ -2130,8 +3217,53 @@ PAPI_hl_read(const char* region)
 int
 PAPI_hl_region_end( const char* region )
 {
+   int retval, handle;
+
+   if ( ( retval = _internal_hl_region_intern(region, &handle) ) != PAPI_OK )
+      return ( retval );
+
+   return ( PAPI_hl_region_end_h(handle) );
+}
+
+/** @class PAPI_hl_region_end_h
+ * @brief Read performance events at the end of a region given by its handle.
+ *
+ * @par C Interface:
+ * \#include <papi.h> @n
+ * int PAPI_hl_region_end_h( int handle );
+ *
+ * @param handle
+ * -- a region handle from PAPI_hl_region_register
+ *
+ * @retval PAPI_OK
+ * @retval PAPI_EINVAL
+ * -- The handle is invalid.
+ * @retval PAPI_ENOTRUN
+ * -- EventSet is currently not running or could not determined.
+ * @retval PAPI_ESYS
+ * -- A system or C library call failed inside PAPI, see the errno variable.
+ * @retval PAPI_EMISC
+ * -- PAPI has been deactivated due to previous errors.
+ * @retval PAPI_ENOMEM
+ * -- Insufficient memory.
+ *
+ * PAPI_hl_region_end_h does the same as PAPI_hl_region_end for the region name the handle
+ * was registered with.
+ *
+ * @see PAPI_hl_region_register
+ * @see PAPI_hl_region_end
+ * @see PAPI_hl_region_begin_h
+ */
+int
+PAPI_hl_region_end_h( int handle )
+{
+   PAPI_SELF_SCOPE( PAPI_SELF_PAPI_hl_region_end );
    int retval;
 
+   if ( handle < 0 || handle >= PAPIHL_MAX_REGION_NAMES ||
+        __atomic_load_n(&region_names[handle], __ATOMIC_ACQUIRE) == NULL )
+      return ( PAPI_EINVAL );
+
    if ( state == PAPIHL_DEACTIVATED ) {
       /* check if we have to clean up local stuff */
       if ( _local_state == PAPIHL_ACTIVE )
@@ -2140,7 +3272,7 @@ PAPI_hl_region_end( const char* region )
    }
 
    if ( _local_region_begin_cnt == 0 ) {
-      verbose_fprintf(stdout, "PAPI-HL Warning: Cannot find matching region for PAPI_hl_region_end(\"%s\") for thread %lu.\n", region, PAPI_thread_id());
+      verbose_fprintf(stdout, "PAPI-HL Warning: Cannot find matching region for PAPI_hl_region_end(\"%s\") for thread %lu.\n", region_names[handle], PAPI_thread_id());
       return ( PAPI_EMISC );
    }
 
@@ -2148,8 +3280,8 @@ PAPI_hl_region_end( const char* region )
       return ( PAPI_ENOTRUN );
 
    /* read and store all events */
-   HLDBG("Thread ID:%lu, Region:%s\n", PAPI_thread_id(), region);
-   if ( ( retval = _internal_hl_read_and_store_counters(region, REGION_END) ) != PAPI_OK )
+   HLDBG("Thread ID:%lu, Region:%s\n", PAPI_thread_id(), region_names[handle]);
+   if ( ( retval = _internal_hl_read_and_store_counters(handle, REGION_END, NULL) ) != PAPI_OK )
       return ( retval );
 
    _internal_hl_region_id_pop();
@@ -2186,13 +3318,16 @@ PAPI_hl_stop()
    int retval, i;
 
    if ( _papi_hl_events_running == 1 ) {
+      /* samples are not taken while stopped */
+      _papi_hl_events_running = 0;
       if ( _local_components != NULL ) {
          for ( i = 0; i < num_of_components; i++ ) {
-            if ( ( retval = PAPI_stop( _local_components[i].EventSet, _local_components[i].values ) ) != PAPI_OK )
+            if ( ( retval = PAPI_stop( _local_components[i].EventSet, _local_components[i].values ) ) != PAPI_OK ) {
+               _papi_hl_events_running = 1;
                return ( retval );
+            }
          }
       }
-      _papi_hl_events_running = 0;
       return ( PAPI_OK );
    }
    return ( PAPI_ENOEVNT );
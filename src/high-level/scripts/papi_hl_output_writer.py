@@ -38,17 +38,20 @@ def merge_json_files(source_dir):
   #get measurement files
   file_list = os.listdir(source_dir)
   file_list.sort()
-  rank_cnt = 0
   json_rank = OrderedDict()
   
   for item in file_list:
-    #determine mpi rank based on file name (rank_#)
-    rank = item.split('_', 1)[1]
-    rank = rank.rsplit('.', 1)[0]
-    try:
-      rank = int(rank)
-    except:
-      rank = rank_cnt
+    #skip sample files
+    if not item.endswith('.json'):
+      continue
+    #determine mpi rank based on file name (rank_#), other files like
+    #node_<host>.json keep their name so that keys cannot collide
+    rank = item.rsplit('.', 1)[0]
+    if rank.startswith('rank_'):
+      try:
+        rank = int(rank.split('_', 1)[1])
+      except ValueError:
+        pass
 
     #open measurement file
     file_name = str(source_dir) + "/" + str(item)
@@ -70,8 +73,6 @@ def merge_json_files(source_dir):
     #get all threads
     json_rank[str(rank)] = OrderedDict()
     json_rank[str(rank)]['threads'] = data['threads']
-
-    rank_cnt = rank_cnt + 1
   
   json_object['ranks'] = json_rank
 
@@ -110,6 +111,7 @@ class Sum_Counter(object):
   def __init__(self):
     self.min = None
     self.all_values = []
+    self.sum = 0
     self.max = 0
 
   def add_event(self, value):
@@ -117,6 +119,8 @@ class Sum_Counter(object):
       if self.min is None or self.min > int(value['min']):
         self.min = int(value['min'])
       self.all_values.append(int(value['avg']))
+      #node files carry the total of all ranks
+      self.sum += int(value['total']) if 'total' in value else int(value['avg'])
       if self.max < int(value['max']):
         self.max = int(value['max'])
     else:
@@ -124,6 +128,7 @@ class Sum_Counter(object):
       if self.min is None or self.min > val:
         self.min = val
       self.all_values.append(val)
+      self.sum += val
       if self.max < val:
         self.max = val
 
@@ -136,10 +141,7 @@ class Sum_Counter(object):
     return (sum(s[n//2-1:n//2+1])/2.0, s[n//2])[n % 2] if n else None
 
   def get_sum(self):
-    sum = 0
-    for value in self.all_values:
-      sum += value
-    return sum
+    return self.sum
 
   def get_max(self):
     return self.max
@@ -418,10 +420,9 @@ def derive_events(events):
     derive_events['name'] = events['name']
     del events['name']
 
-  #skip parent_region_id and cycles
-  if 'parent_region_id' in events or 'cycles' in events:
-    del events['parent_region_id']
-    del events['cycles']
+  #skip parent_region_id and cycles, node files have no parent_region_id
+  events.pop('parent_region_id', None)
+  events.pop('cycles', None)
 
   #Real Time
   if 'real_time_nsec' in events:
@@ -21,6 +21,8 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <stddef.h>
 
 #include "papi.h"
 #include "papi_internal.h"
@@ -29,6 +31,7 @@
 #include "x86_cpuid_info.h"
 
 #include "linux-lock.h"
+#include "linux-memory.h"
 
 /* 2.6.19 has this:
 VmPeak:     4588 kB
@@ -46,84 +49,172 @@ VmPTE:        20 kB
 int
 generic_get_memory_info( PAPI_hw_info_t *hw_info );
 
+/* The files stay open and are read again with pread(), as memory usage is
+   sampled at a high rate next to the counters. /proc/self is resolved at
+   open, so a child of fork() opens them again. */
+static const char *dmem_path[LINUX_DMEM_FILES] = {
+	"/proc/self/status", "/proc/self/statm", "/proc/self/smaps_rollup"
+};
+
+static int dmem_fd[LINUX_DMEM_FILES] = { -1, -1, -1 };
+static pid_t dmem_pid = 0;
+
+#define DMEM_KEY( key, field ) { key, sizeof ( key ) - 1, offsetof( PAPI_dmem_info_t, field ) }
+
+/* Lines of /proc/self/status in PAPI_dmem_info_t, in the order of the file */
+static const _linux_dmem_key_t dmem_status_keys[] = {
+	DMEM_KEY( "VmPeak:", peak ),
+	DMEM_KEY( "VmSize:", size ),
+	DMEM_KEY( "VmLck:", locked ),
+	DMEM_KEY( "VmHWM:", high_water_mark ),
+	DMEM_KEY( "VmRSS:", resident ),
+	DMEM_KEY( "VmData:", heap ),
+	DMEM_KEY( "VmStk:", stack ),
+	DMEM_KEY( "VmExe:", text ),
+	DMEM_KEY( "VmLib:", library ),
+	DMEM_KEY( "VmPTE:", pte ),
+};
+
+static int
+dmem_open( int file )
+{
+	pid_t pid = getpid(  );
+	int fd, old, i;
+
+	if ( __atomic_load_n( &dmem_pid, __ATOMIC_ACQUIRE ) != pid ) {
+		for ( i = 0; i < LINUX_DMEM_FILES; i++ ) {
+			old = __atomic_exchange_n( &dmem_fd[i], -1, __ATOMIC_ACQ_REL );
+			if ( old >= 0 )
+				close( old );
+		}
+		__atomic_store_n( &dmem_pid, pid, __ATOMIC_RELEASE );
+	}
+
+	fd = __atomic_load_n( &dmem_fd[file], __ATOMIC_ACQUIRE );
+	if ( fd >= 0 )
+		return fd;
+
+	fd = open( dmem_path[file], O_RDONLY | O_CLOEXEC );
+	if ( fd < 0 )
+		return -1;
+	old = -1;
+	if ( !__atomic_compare_exchange_n( &dmem_fd[file], &old, fd, 0,
+									   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ) {
+		/* another thread was first */
+		close( fd );
+		fd = old;
+	}
+	return fd;
+}
+
+/* The whole file, NUL terminated, or -1 */
+static int
+dmem_pread( int file, char *buf, size_t size )
+{
+	ssize_t n;
+	int fd;
+
+	fd = dmem_open( file );
+	if ( fd < 0 )
+		return -1;
+	n = pread( fd, buf, size - 1, 0 );
+	if ( n < 0 )
+		return -1;
+	buf[n] = '\0';
+	return ( int ) n;
+}
+
+static long long
+dmem_number( const char *p )
+{
+	long long v = 0;
+
+	while ( *p == ' ' || *p == '\t' )
+		p++;
+	while ( *p >= '0' && *p <= '9' )
+		v = v * 10 + ( *p++ - '0' );
+	return v;
+}
+
+/* Reads the "key: value" lines of a /proc/self file into the long longs at
+   base + keys[i].offset, returns the number of keys found or PAPI_ESYS.
+   Lines are matched against the key expected next first, so a table in
+   the order of the file costs one compare per line. */
 int
-_linux_get_dmem_info( PAPI_dmem_info_t * d )
+_linux_dmem_read( int file, const _linux_dmem_key_t * keys, int num_keys,
+				  void *base )
 {
-	char fn[PATH_MAX], tmp[PATH_MAX];
-	FILE *f;
-	int ret;
-	long long sz = 0, lck = 0, res = 0, shr = 0, stk = 0, txt = 0, dat =
-		0, dum = 0, lib = 0, hwm = 0;
-
-	sprintf( fn, "/proc/%ld/status", ( long ) getpid(  ) );
-	f = fopen( fn, "r" );
-	if ( f == NULL ) {
-		PAPIERROR( "fopen(%s): %s\n", fn, strerror( errno ) );
+	char buf[8192];
+	const char *p;
+	int next = 0, found = 0, i;
+
+	if ( file == LINUX_DMEM_STATM || dmem_pread( file, buf, sizeof ( buf ) ) < 0 )
 		return PAPI_ESYS;
-	}
-	while ( 1 ) {
-		if ( fgets( tmp, PATH_MAX, f ) == NULL )
-			break;
-		if ( strspn( tmp, "VmSize:" ) == strlen( "VmSize:" ) ) {
-			sscanf( tmp + strlen( "VmSize:" ), "%lld", &sz );
-			d->size = sz;
-			continue;
-		}
-		if ( strspn( tmp, "VmHWM:" ) == strlen( "VmHWM:" ) ) {
-			sscanf( tmp + strlen( "VmHWM:" ), "%lld", &hwm );
-			d->high_water_mark = hwm;
-			continue;
-		}
-		if ( strspn( tmp, "VmLck:" ) == strlen( "VmLck:" ) ) {
-			sscanf( tmp + strlen( "VmLck:" ), "%lld", &lck );
-			d->locked = lck;
-			continue;
-		}
-		if ( strspn( tmp, "VmRSS:" ) == strlen( "VmRSS:" ) ) {
-			sscanf( tmp + strlen( "VmRSS:" ), "%lld", &res );
-			d->resident = res;
-			continue;
-		}
-		if ( strspn( tmp, "VmData:" ) == strlen( "VmData:" ) ) {
-			sscanf( tmp + strlen( "VmData:" ), "%lld", &dat );
-			d->heap = dat;
-			continue;
-		}
-		if ( strspn( tmp, "VmStk:" ) == strlen( "VmStk:" ) ) {
-			sscanf( tmp + strlen( "VmStk:" ), "%lld", &stk );
-			d->stack = stk;
-			continue;
-		}
-		if ( strspn( tmp, "VmExe:" ) == strlen( "VmExe:" ) ) {
-			sscanf( tmp + strlen( "VmExe:" ), "%lld", &txt );
-			d->text = txt;
-			continue;
+
+	for ( p = buf; *p && found < num_keys; p++ ) {
+		i = next;
+		if ( strncmp( p, keys[i].key, keys[i].len ) ) {
+			for ( i = 0; i < num_keys; i++ )
+				if ( !strncmp( p, keys[i].key, keys[i].len ) )
+					break;
 		}
-		if ( strspn( tmp, "VmLib:" ) == strlen( "VmLib:" ) ) {
-			sscanf( tmp + strlen( "VmLib:" ), "%lld", &lib );
-			d->library = lib;
-			continue;
+		if ( i < num_keys ) {
+			*( long long * ) ( ( char * ) base + keys[i].offset ) =
+				dmem_number( p + keys[i].len );
+			found++;
+			next = ( i + 1 < num_keys ) ? i + 1 : 0;
 		}
+		if ( ( p = strchr( p, '\n' ) ) == NULL )
+			break;
 	}
-	fclose( f );
 
-	sprintf( fn, "/proc/%ld/statm", ( long ) getpid(  ) );
-	f = fopen( fn, "r" );
-	if ( f == NULL ) {
-		PAPIERROR( "fopen(%s): %s\n", fn, strerror( errno ) );
+	return found;
+}
+
+/* The seven columns of /proc/self/statm, in pages */
+int
+_linux_dmem_read_statm( long long *values )
+{
+	char buf[256];
+	const char *p = buf;
+	int i;
+
+	if ( dmem_pread( LINUX_DMEM_STATM, buf, sizeof ( buf ) ) <= 0 )
 		return PAPI_ESYS;
+
+	for ( i = 0; i < 7; i++ ) {
+		if ( *p < '0' || *p > '9' )
+			return PAPI_ESYS;
+		values[i] = dmem_number( p );
+		while ( *p >= '0' && *p <= '9' )
+			p++;
+		if ( *p == ' ' )
+			p++;
 	}
-	ret =
-		fscanf( f, "%lld %lld %lld %lld %lld %lld %lld", &dum, &dum, &shr, &dum,
-				&dum, &dat, &dum );
-	if ( ret != 7 ) {
-		PAPIERROR( "fscanf(7 items): %d\n", ret );
-		fclose(f);
+	return PAPI_OK;
+}
+
+int
+_linux_get_dmem_info( PAPI_dmem_info_t * d )
+{
+	long long statm[7];
+	int retval;
+
+	retval = _linux_dmem_read( LINUX_DMEM_STATUS, dmem_status_keys,
+							   sizeof ( dmem_status_keys ) /
+							   sizeof ( dmem_status_keys[0] ), d );
+	if ( retval < 0 ) {
+		PAPIERROR( "read(%s): %s\n", dmem_path[LINUX_DMEM_STATUS], strerror( errno ) );
+		return PAPI_ESYS;
+	}
+
+	retval = _linux_dmem_read_statm( statm );
+	if ( retval != PAPI_OK ) {
+		PAPIERROR( "read(%s): %s\n", dmem_path[LINUX_DMEM_STATM], strerror( errno ) );
 		return PAPI_ESYS;
 	}
 	d->pagesize = getpagesize(  );
-	d->shared = ( shr * d->pagesize ) / 1024;
-	fclose( f );
+	d->shared = ( statm[2] * d->pagesize ) / 1024;
 
 	return PAPI_OK;
 }
@@ -1480,141 +1571,229 @@ _linux_get_memory_info( PAPI_hw_info_t * hwinfo, int cpu_type )
 	return retval;
 }
 
+/* The contents of /proc/<pid>/maps that the current map was built from; */
+/* a refresh that reads the same bytes again keeps the map as it is.     */
+/* Plain malloc, these outlive papi_mem_cleanup_all() at PAPI_shutdown.  */
+static char *linux_maps_last = NULL;
+static size_t linux_maps_last_len = 0, linux_maps_last_size = 0;
+static char *linux_maps_buf = NULL;
+static size_t linux_maps_size = 0;
+
+/* Read all of fname into linux_maps_buf, returns its length or -1 */
+static ssize_t
+linux_read_maps( const char *fname )
+{
+	size_t len = 0;
+	ssize_t n;
+	char *tmp;
+	int fd;
+
+	fd = open( fname, O_RDONLY | O_CLOEXEC );
+	if ( fd < 0 )
+		return -1;
+
+	for ( ;; ) {
+		if ( len == linux_maps_size ) {
+			size_t size = linux_maps_size ? 2 * linux_maps_size : 65536;
+
+			tmp = realloc( linux_maps_buf, size );
+			if ( tmp == NULL ) {
+				close( fd );
+				return -1;
+			}
+			linux_maps_buf = tmp;
+			linux_maps_size = size;
+		}
+		n = read( fd, linux_maps_buf + len, linux_maps_size - len );
+		if ( n < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			close( fd );
+			return -1;
+		}
+		if ( n == 0 )
+			break;
+		len += ( size_t ) n;
+	}
+
+	close( fd );
+	return ( ssize_t ) len;
+}
+
+static unsigned long
+linux_maps_number( const char **p, const char *end, int base )
+{
+	unsigned long v = 0;
+	const char *s = *p;
+	int d;
+
+	for ( ; s < end; s++ ) {
+		if ( *s >= '0' && *s <= '9' )
+			d = *s - '0';
+		else if ( base == 16 && *s >= 'a' && *s <= 'f' )
+			d = *s - 'a' + 10;
+		else if ( base == 16 && *s >= 'A' && *s <= 'F' )
+			d = *s - 'A' + 10;
+		else
+			break;
+		v = v * ( unsigned long ) base + ( unsigned long ) d;
+	}
+	*p = s;
+	return v;
+}
+
+static int
+linux_maps_is( const char *name, size_t len, const char *path )
+{
+	return ( len > 0 ) && ( strlen( path ) == len ) &&
+		( memcmp( name, path, len ) == 0 );
+}
+
+/* One pass over /proc/<pid>/maps without stdio: the executable's text,   */
+/* data and bss go to exe_info, and every other file backed executable    */
+/* mapping becomes an entry of the shared library map, with the first     */
+/* writable file and anonymous mappings after it as its data and bss.     */
+/* The map is in address order, which _papi_hwi_lookup_shlib() relies on. */
+/* The [heap] and [stack] mappings are kept for naming data addresses.    */
 int
 _linux_update_shlib_info( papi_mdi_t *mdi )
 {
-
 	char fname[PAPI_HUGE_STR_LEN];
-	unsigned long t_index = 0, d_index = 0, b_index = 0, counting = 1;
-	char buf[PAPI_HUGE_STR_LEN + PAPI_HUGE_STR_LEN], perm[5], dev[16];
-	char mapname[PAPI_HUGE_STR_LEN], lastmapname[PAPI_HUGE_STR_LEN];
-	unsigned long begin = 0, end = 0, size = 0, inode = 0, foo = 0;
-	PAPI_address_map_t *tmp = NULL;
-	FILE *f;
-
-	memset( fname, 0x0, sizeof ( fname ) );
-	memset( buf, 0x0, sizeof ( buf ) );
-	memset( perm, 0x0, sizeof ( perm ) );
-	memset( dev, 0x0, sizeof ( dev ) );
-	memset( mapname, 0x0, sizeof ( mapname ) );
-	memset( lastmapname, 0x0, sizeof ( lastmapname ) );
+	PAPI_address_map_t *map = NULL, *last, *tmp;
+	char *swap;
+	size_t swap_size;
+	const char *exe = mdi->exe_info.fullname;
+	const char *p, *end, *eol, *name = NULL, *prev_name = NULL;
+	size_t name_len = 0, prev_len = 0;
+	unsigned long begin, stop, inode;
+	int count = 0, max = 0, is_exe;
+	ssize_t len;
+	char perm[4];
 
 	sprintf( fname, "/proc/%ld/maps", ( long ) mdi->pid );
-	f = fopen( fname, "r" );
+	len = linux_read_maps( fname );
+	if ( len < 0 ) {
+		PAPIERROR( "read(%s) failed", fname );
+		return PAPI_OK;
+	}
 
-	if ( !f ) {
-		PAPIERROR( "fopen(%s) returned < 0", fname );
+	if ( ( mdi->shlib_info.map != NULL ) &&
+		 ( ( size_t ) len == linux_maps_last_len ) &&
+		 ( memcmp( linux_maps_buf, linux_maps_last, ( size_t ) len ) == 0 ) ) {
 		return PAPI_OK;
 	}
 
-  again:
-	while ( !feof( f ) ) {
-		begin = end = size = inode = foo = 0;
-		if ( fgets( buf, sizeof ( buf ), f ) == 0 )
-			break;
-		/* If mapname is null in the string to be scanned, we need to detect that */
-		if ( strlen( mapname ) )
-			strcpy( lastmapname, mapname );
-		else
-			lastmapname[0] = '\0';
-		/* If mapname is null in the string to be scanned, we need to detect that */
-		mapname[0] = '\0';
-		sscanf( buf, "%lx-%lx %4s %lx %s %ld %s", &begin, &end, perm, &foo, dev,
-				&inode, mapname );
-		size = end - begin;
-
-		/* the permission string looks like "rwxp", where each character can
-		 * be either the letter, or a hyphen.  The final character is either
-		 * p for private or s for shared. */
-
-		if ( counting ) {
-			if ( ( perm[2] == 'x' ) && ( perm[0] == 'r' ) && ( inode != 0 ) ) {
-				if ( strcmp( mdi->exe_info.fullname, mapname )
-					 == 0 ) {
-					mdi->exe_info.address_info.text_start =
-						( vptr_t ) begin;
-					mdi->exe_info.address_info.text_end =
-						( vptr_t ) ( begin + size );
-				}
-				t_index++;
-			} else if ( ( perm[0] == 'r' ) && ( perm[1] == 'w' ) &&
-						( inode != 0 )
-						&&
-						( strcmp
-						  ( mdi->exe_info.fullname,
-							mapname ) == 0 ) ) {
-				mdi->exe_info.address_info.data_start =
-					( vptr_t ) begin;
-				mdi->exe_info.address_info.data_end =
-					( vptr_t ) ( begin + size );
-				d_index++;
-			} else if ( ( perm[0] == 'r' ) && ( perm[1] == 'w' ) &&
-						( inode == 0 )
-						&&
-						( strcmp
-						  ( mdi->exe_info.fullname,
-							lastmapname ) == 0 ) ) {
-				mdi->exe_info.address_info.bss_start =
-					( vptr_t ) begin;
-				mdi->exe_info.address_info.bss_end =
-					( vptr_t ) ( begin + size );
-				b_index++;
+	mdi->heap_start = mdi->heap_end = 0;
+	mdi->stack_start = mdi->stack_end = 0;
+
+	for ( p = linux_maps_buf, end = linux_maps_buf + len; p < end; p = eol + 1 ) {
+		eol = memchr( p, '\n', ( size_t ) ( end - p ) );
+		if ( eol == NULL )
+			eol = end;
+
+		prev_name = name;
+		prev_len = name_len;
+
+		/* start-end perms offset dev inode [path] */
+		begin = linux_maps_number( &p, eol, 16 );
+		if ( p < eol && *p == '-' )
+			p++;
+		stop = linux_maps_number( &p, eol, 16 );
+		while ( p < eol && *p == ' ' )
+			p++;
+		if ( eol - p < 4 ) {
+			name = NULL;
+			name_len = 0;
+			continue;
+		}
+		memcpy( perm, p, sizeof ( perm ) );
+		p += 4;
+		while ( p < eol && *p == ' ' )
+			p++;
+		linux_maps_number( &p, eol, 16 );
+		while ( p < eol && *p == ' ' )
+			p++;
+		while ( p < eol && *p != ' ' )
+			p++;
+		while ( p < eol && *p == ' ' )
+			p++;
+		inode = linux_maps_number( &p, eol, 10 );
+		while ( p < eol && *p == ' ' )
+			p++;
+		name = p;
+		name_len = ( size_t ) ( eol - p );
+		if ( ( name_len > 10 ) &&
+			 ( memcmp( name + name_len - 10, " (deleted)", 10 ) == 0 ) )
+			name_len -= 10;
+
+		is_exe = linux_maps_is( name, name_len, exe );
+
+		if ( linux_maps_is( name, name_len, "[heap]" ) ) {
+			mdi->heap_start = ( vptr_t ) begin;
+			mdi->heap_end = ( vptr_t ) stop;
+		} else if ( linux_maps_is( name, name_len, "[stack]" ) ) {
+			mdi->stack_start = ( vptr_t ) begin;
+			mdi->stack_end = ( vptr_t ) stop;
+		}
+
+		if ( ( perm[0] == 'r' ) && ( perm[2] == 'x' ) && ( inode != 0 ) ) {
+			if ( is_exe ) {
+				mdi->exe_info.address_info.text_start = ( vptr_t ) begin;
+				mdi->exe_info.address_info.text_end = ( vptr_t ) stop;
+				continue;
 			}
-		} else if ( !counting ) {
-			if ( ( perm[2] == 'x' ) && ( perm[0] == 'r' ) && ( inode != 0 ) ) {
-				if ( strcmp( mdi->exe_info.fullname, mapname )
-					 != 0 ) {
-					t_index++;
-					tmp[t_index - 1].text_start = ( vptr_t ) begin;
-					tmp[t_index - 1].text_end = ( vptr_t ) ( begin + size );
-					strncpy( tmp[t_index - 1].name, mapname, PAPI_HUGE_STR_LEN );
-               tmp[t_index - 1].name[PAPI_HUGE_STR_LEN-1]=0;
-				}
-			} else if ( ( perm[0] == 'r' ) && ( perm[1] == 'w' ) &&
-						( inode != 0 ) ) {
-				if ( ( strcmp
-					   ( mdi->exe_info.fullname,
-						 mapname ) != 0 )
-					 && ( t_index > 0 ) &&
-					 ( tmp[t_index - 1].data_start == 0 ) ) {
-					tmp[t_index - 1].data_start = ( vptr_t ) begin;
-					tmp[t_index - 1].data_end = ( vptr_t ) ( begin + size );
-				}
-			} else if ( ( perm[0] == 'r' ) && ( perm[1] == 'w' ) &&
-						( inode == 0 ) ) {
-				if ( ( t_index > 0 ) && ( tmp[t_index - 1].bss_start == 0 ) ) {
-					tmp[t_index - 1].bss_start = ( vptr_t ) begin;
-					tmp[t_index - 1].bss_end = ( vptr_t ) ( begin + size );
+			if ( count == max ) {
+				max = max ? 2 * max : 64;
+				tmp = papi_realloc( map, ( size_t ) max *
+									sizeof ( PAPI_address_map_t ) );
+				if ( tmp == NULL ) {
+					PAPIERROR( "Error allocating shared library address map" );
+					if ( map )
+						papi_free( map );
+					return PAPI_ENOMEM;
 				}
+				map = tmp;
+			}
+			last = &map[count++];
+			memset( last, 0, sizeof ( *last ) );
+			if ( name_len >= PAPI_HUGE_STR_LEN )
+				name_len = PAPI_HUGE_STR_LEN - 1;
+			memcpy( last->name, name, name_len );
+			last->text_start = ( vptr_t ) begin;
+			last->text_end = ( vptr_t ) stop;
+		} else if ( ( perm[0] == 'r' ) && ( perm[1] == 'w' ) && ( inode != 0 ) ) {
+			if ( is_exe ) {
+				mdi->exe_info.address_info.data_start = ( vptr_t ) begin;
+				mdi->exe_info.address_info.data_end = ( vptr_t ) stop;
+			} else if ( ( count > 0 ) && ( map[count - 1].data_start == 0 ) ) {
+				map[count - 1].data_start = ( vptr_t ) begin;
+				map[count - 1].data_end = ( vptr_t ) stop;
+			}
+		} else if ( ( perm[0] == 'r' ) && ( perm[1] == 'w' ) && ( inode == 0 ) ) {
+			if ( prev_name && linux_maps_is( prev_name, prev_len, exe ) ) {
+				mdi->exe_info.address_info.bss_start = ( vptr_t ) begin;
+				mdi->exe_info.address_info.bss_end = ( vptr_t ) stop;
+			}
+			if ( ( count > 0 ) && ( map[count - 1].bss_start == 0 ) ) {
+				map[count - 1].bss_start = ( vptr_t ) begin;
+				map[count - 1].bss_end = ( vptr_t ) stop;
 			}
 		}
 	}
 
-	if ( counting ) {
-		/* When we get here, we have counted the number of entries in the map
-		   for us to allocate */
-
-		tmp =
-			( PAPI_address_map_t * ) papi_calloc( t_index,
-												  sizeof
-												  ( PAPI_address_map_t ) );
-		if ( tmp == NULL ) {
-			PAPIERROR( "Error allocating shared library address map" );
-			fclose(f);
-			return PAPI_ENOMEM;
-		}
-		t_index = 0;
-		rewind( f );
-		counting = 0;
-		goto again;
-	} else {
-		if ( mdi->shlib_info.map )
-			papi_free( mdi->shlib_info.map );
-		mdi->shlib_info.map = tmp;
-		mdi->shlib_info.count = t_index;
-
-		fclose( f );
-	}
+	if ( mdi->shlib_info.map )
+		papi_free( mdi->shlib_info.map );
+	mdi->shlib_info.map = map;
+	mdi->shlib_info.count = count;
+
+	/* Keep what was parsed to recognize it next time */
+	swap = linux_maps_last;
+	swap_size = linux_maps_last_size;
+	linux_maps_last = linux_maps_buf;
+	linux_maps_last_size = linux_maps_size;
+	linux_maps_last_len = ( size_t ) len;
+	linux_maps_buf = swap;
+	linux_maps_size = swap_size;
 
 	return PAPI_OK;
 }
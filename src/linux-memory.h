@@ -2,3 +2,19 @@ int _linux_get_dmem_info( PAPI_dmem_info_t * d );
 int _linux_get_memory_info( PAPI_hw_info_t * hwinfo, int cpu_type );
 int _linux_update_shlib_info( papi_mdi_t *mdi );
 
+/* Files of _linux_dmem_read(), kept open per process */
+#define LINUX_DMEM_STATUS  0	/* /proc/self/status */
+#define LINUX_DMEM_STATM   1	/* /proc/self/statm */
+#define LINUX_DMEM_SMAPS   2	/* /proc/self/smaps_rollup, Linux 4.14 and later */
+#define LINUX_DMEM_FILES   3
+
+/* A "key: value" line and where its value goes */
+typedef struct
+{
+	const char *key;			/* with the colon */
+	int len;
+	size_t offset;				/* of a long long */
+} _linux_dmem_key_t;
+
+int _linux_dmem_read( int file, const _linux_dmem_key_t * keys, int num_keys, void *base );
+int _linux_dmem_read_statm( long long *values );
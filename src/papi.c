@@ -39,6 +39,9 @@
 #include "cpus.h"
 #include "extras.h"
 #include "sw_multiplex.h"
+#include "papi_profile.h"
+#include "papi_shlib.h"
+#include "papi_self.h"
 
 
 /* simplified papi functions for event rates */
@@ -1022,6 +1025,13 @@ PAPI_set_thr_specific( int tag, void *ptr )
  *	It must be called before any low level PAPI functions can be used. 
  *	If your application is making use of threads PAPI_thread_init must also be 
  *	called prior to making any calls to the library other than PAPI_library_init() . 
+ *
+ *	By default every compiled-in component is initialized here. If the 
+ *	environment variable PAPI_LAZY_INIT is set, only perf_event, 
+ *	perf_event_uncore and sysdetect are; every other component is 
+ *	initialized the first time it is referenced through 
+ *	PAPI_event_name_to_code(), PAPI_enum_cmp_event() or 
+ *	PAPI_get_component_info(). Until then it is reported as disabled. 
  *	@par Examples:
  *	@code
  *		int retval;
@@ -1352,8 +1362,12 @@ PAPI_get_component_info( int cidx )
    APIDBG( "Entry: Component Index %d\n", cidx);
    if ( _papi_hwi_invalid_cmp( cidx ) )
       return ( NULL );
-   else
-      return ( &( _papi_hwd[cidx]->cmp_info ) );
+
+   /* Asking about a deferred component is a first use */
+   if ( init_level != PAPI_NOT_INITED )
+      _papi_hwi_init_component_deferred( cidx );
+
+   return ( &( _papi_hwd[cidx]->cmp_info ) );
 }
 
 /* PAPI_get_event_info:
@@ -1903,6 +1917,8 @@ PAPI_enum_cmp_event( int *EventCode, int modifier, int cidx )
 		return PAPI_ENOCMP;
 	}
 
+	_papi_hwi_init_component_deferred( cidx );
+
 	if (_papi_hwd[cidx]->cmp_info.disabled &&
         _papi_hwd[cidx]->cmp_info.disabled != PAPI_EDELAY_INIT) {
 	  return PAPI_ENOCMP;
@@ -2202,6 +2218,7 @@ PAPI_get_eventset_component( int EventSet)
 int
 PAPI_add_event( int EventSet, int EventCode )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_add_event );
    APIDBG("Entry: EventSet: %d, EventCode: %#x\n", EventSet, EventCode);
 	EventSetInfo_t *ESI;
 
@@ -2297,6 +2314,7 @@ PAPI_add_event( int EventSet, int EventCode )
 int
 PAPI_remove_event( int EventSet, int EventCode )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_remove_event );
 	APIDBG("Entry: EventSet: %d, EventCode: %#x\n", EventSet, EventCode);
 	EventSetInfo_t *ESI;
 	int i,retval;
@@ -2417,6 +2435,7 @@ PAPI_remove_event( int EventSet, int EventCode )
 int
 PAPI_add_named_event( int EventSet, const char *EventName )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_add_named_event );
 	APIDBG("Entry: EventSet: %d, EventName: %s\n", EventSet, EventName);
 
 	int ret, code;
@@ -2637,6 +2656,7 @@ PAPI_destroy_eventset( int *EventSet )
 int
 PAPI_start( int EventSet )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_start );
 	APIDBG("Entry: EventSet: %d\n", EventSet);
 
 	int is_dirty=0;
@@ -2701,11 +2721,12 @@ PAPI_start( int EventSet )
 	   /* we need to reset the context state because it was last used   */
 	   /* for some other event set and does not contain the information */
            /* for our events.                                               */
-	   retval = _papi_hwd[ESI->CmpIdx]->update_control_state(
+	   PAPI_SELF_TIME( PAPI_SELF_VEC( ESI->CmpIdx, update_control_state ),
+	   	retval = _papi_hwd[ESI->CmpIdx]->update_control_state(
                                                         ESI->ctl_state,
 							ESI->NativeInfoArray,
 							ESI->NativeCount,
-							context);
+							context) );
 	   if ( retval != PAPI_OK ) {
 	      papi_return( retval );
 	   }
@@ -2732,6 +2753,10 @@ PAPI_start( int EventSet )
 
 	}
 
+	/* Let the overflow handler find the profile of a counter directly */
+	if ( ESI->state & PAPI_PROFILING )
+	   _papi_hwi_map_profile_positions( ESI );
+
 	/* If overflowing is enabled, turn it on */
 	if ( ( ESI->state & PAPI_OVERFLOWING ) &&
 	     !( ESI->overflow.flags & PAPI_OVERFLOW_HARDWARE ) ) {
@@ -2748,7 +2773,8 @@ PAPI_start( int EventSet )
            /* can not be attached to thread or cpu if overflowing */
 	   thread->running_eventset[cidx] = ESI;
 
-	   retval = _papi_hwd[cidx]->start( context, ESI->ctl_state );
+	   PAPI_SELF_TIME( PAPI_SELF_VEC( cidx, start ),
+	   	retval = _papi_hwd[cidx]->start( context, ESI->ctl_state ) );
 	   if ( retval != PAPI_OK ) {
 	      _papi_hwi_stop_signal( _papi_os_info.itimer_sig );
 	      ESI->state ^= PAPI_RUNNING;
@@ -2780,10 +2806,11 @@ PAPI_start( int EventSet )
 		 thread->running_eventset[cidx] = ESI;
 	      }
 	   } else {
-	      cpu->running_eventset[cidx] = ESI;
+	      _papi_hwi_set_running_cpu_eventset( cpu, cidx, ESI );
 	   }
 
-	   retval = _papi_hwd[cidx]->start( context, ESI->ctl_state );
+	   PAPI_SELF_TIME( PAPI_SELF_VEC( cidx, start ),
+	   	retval = _papi_hwd[cidx]->start( context, ESI->ctl_state ) );
 	   if ( retval != PAPI_OK ) {
 	      _papi_hwd[cidx]->stop( context, ESI->ctl_state );
 	      ESI->state ^= PAPI_RUNNING;
@@ -2792,7 +2819,7 @@ PAPI_start( int EventSet )
 		 if ( !( ESI->state & PAPI_ATTACHED ) ) 
 		    thread->running_eventset[cidx] = NULL;
 	      } else {
-		 cpu->running_eventset[cidx] = NULL;
+		 _papi_hwi_set_running_cpu_eventset( cpu, cidx, NULL );
 	      }
 	      papi_return( retval );
 	   }
@@ -2855,6 +2882,7 @@ PAPI_start( int EventSet )
 int
 PAPI_stop( int EventSet, long long *values )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_stop );
    APIDBG("Entry: EventSet: %d, values: %p\n", EventSet, values);
 	EventSetInfo_t *ESI;
 	hwd_context_t *context;
@@ -2886,17 +2914,26 @@ PAPI_stop( int EventSet, long long *values )
 		return ( PAPI_OK );
 	}
 
+	/* Take an event set off its cpu before it stops, which waits */
+	/* for a PAPI_read_cpus() that may be reading it              */
+	if ( ESI->state & PAPI_CPU_ATTACHED )
+		_papi_hwi_set_running_cpu_eventset( ESI->CpuInfo, cidx, NULL );
+
 	/* get the context we should use for this event set */
 	context = _papi_hwi_get_context( ESI, NULL );
 	/* Read the current counter values into the EventSet */
 	retval = _papi_hwi_read( context, ESI, ESI->sw_stop );
-	if ( retval != PAPI_OK )
-		papi_return( retval );
-
-	/* Remove the control bits from the active counter config. */
-	retval = _papi_hwd[cidx]->stop( context, ESI->ctl_state );
-	if ( retval != PAPI_OK )
+	if ( retval == PAPI_OK ) {
+		/* Remove the control bits from the active counter config. */
+		PAPI_SELF_TIME( PAPI_SELF_VEC( cidx, stop ),
+			retval = _papi_hwd[cidx]->stop( context, ESI->ctl_state ) );
+	}
+	if ( retval != PAPI_OK ) {
+		/* still running */
+		if ( ESI->state & PAPI_CPU_ATTACHED )
+			_papi_hwi_set_running_cpu_eventset( ESI->CpuInfo, cidx, ESI );
 		papi_return( retval );
+	}
 	if ( values )
 		memcpy( values, ESI->sw_stop,
 				( size_t ) ESI->NumberOfEvents * sizeof ( long long ) );
@@ -2933,8 +2970,6 @@ PAPI_stop( int EventSet, long long *values )
 	if ( !(ESI->state & PAPI_CPU_ATTACHED) ) {
 		if ( !( ESI->state & PAPI_ATTACHED ))
 			ESI->master->running_eventset[cidx] = NULL;
-	} else {
-		ESI->CpuInfo->running_eventset[cidx] = NULL;
 	}
 	
 #if defined(DEBUG)
@@ -3000,6 +3035,7 @@ if (ret != PAPI_OK) handle_error(ret);
 int
 PAPI_reset( int EventSet )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_reset );
 	APIDBG("Entry: EventSet: %d\n", EventSet);
 	int retval = PAPI_OK;
 	EventSetInfo_t *ESI;
@@ -3024,7 +3060,8 @@ PAPI_reset( int EventSet )
 			   that are shared. */
 			/* get the context we should use for this event set */
 			context = _papi_hwi_get_context( ESI, NULL );
-			retval = _papi_hwd[cidx]->reset( context, ESI->ctl_state );
+			PAPI_SELF_TIME( PAPI_SELF_VEC( cidx, reset ),
+				retval = _papi_hwd[cidx]->reset( context, ESI->ctl_state ) );
 		}
 	} else {
 #ifdef __bgp__
@@ -3033,7 +3070,8 @@ PAPI_reset( int EventSet )
 		//  are truly zero...
 		/* get the context we should use for this event set */
 		context = _papi_hwi_get_context( ESI, NULL );
-		retval = _papi_hwd[cidx]->reset( context, ESI->ctl_state );
+		PAPI_SELF_TIME( PAPI_SELF_VEC( cidx, reset ),
+			retval = _papi_hwd[cidx]->reset( context, ESI->ctl_state ) );
 #endif
 		memset( ESI->sw_stop, 0x00,
 				( size_t ) ESI->NumberOfEvents * sizeof ( long long ) );
@@ -3102,6 +3140,7 @@ PAPI_reset( int EventSet )
 int
 PAPI_read( int EventSet, long long *values )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_read );
 	APIDBG( "Entry: EventSet: %d, values: %p\n", EventSet, values);
 	EventSetInfo_t *ESI;
 	hwd_context_t *context;
@@ -3191,6 +3230,7 @@ PAPI_read( int EventSet, long long *values )
 int
 PAPI_read_ts( int EventSet, long long *values, long long *cycles )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_read_ts );
 	APIDBG( "Entry: EventSet: %d, values: %p, cycles: %p\n", EventSet, values, cycles);
 	EventSetInfo_t *ESI;
 	hwd_context_t *context;
@@ -3237,6 +3277,253 @@ PAPI_read_ts( int EventSet, long long *values, long long *cycles )
 	return PAPI_OK;
 }
 
+/** @class PAPI_read_cpus
+ *  @brief Read the running event sets of all cpus at once.
+ *
+ *  @par C Interface:
+ *  \#include <papi.h> @n
+ *  int PAPI_read_cpus( int cidx, int *cpus, long long *values, int *num_cpus, int num_events );
+ *
+ *  PAPI_read_cpus() reads every event set of component cidx that is 
+ *  attached to a cpu with PAPI_CPU_ATTACH and currently running. 
+ *  The cpus are visited grouped by NUMA node, and the results are 
+ *  returned as a matrix with one row of num_events values per cpu. 
+ *  Rows of event sets with fewer than num_events events are zero padded. 
+ *
+ *  The counters continue counting after the read. 
+ *
+ *  @param[in] cidx
+ *     -- the component whose event sets are read
+ *  @param[out] *cpus
+ *     -- the cpu number of each row of values
+ *  @param[out] *values
+ *     -- an array of *num_cpus times num_events counter values
+ *  @param[in,out] *num_cpus
+ *     -- on input the number of rows available in cpus and values, 
+ *        on output the number of rows filled in, or the number of 
+ *        rows needed with PAPI_EBUF
+ *  @param[in] num_events
+ *     -- the number of values in each row
+ *
+ *  @retval PAPI_EBUF 
+ *	    More cpus are running event sets than *num_cpus, none are read.
+ *  @retval PAPI_EINVAL 
+ *	    One or more of the arguments is invalid, or an event set 
+ *	    has more than num_events events.
+ *  @retval PAPI_ENOCMP 
+ *	    The component index is invalid.
+ *  @retval PAPI_ENOMEM 
+ *	    Insufficient memory to complete the operation.
+ *  @retval PAPI_ESYS 
+ *	    A system or C library call failed inside PAPI, see the 
+ *          errno variable.
+ *
+ *  PAPI_stop() on one of the event sets waits for the read to finish. 
+ *
+ * @see PAPI_read 
+ * @see PAPI_set_opt 
+ */
+int
+PAPI_read_cpus( int cidx, int *cpus, long long *values, int *num_cpus,
+		int num_events )
+{
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_read_cpus );
+	APIDBG( "Entry: cidx: %d, cpus: %p, values: %p, num_cpus: %p, num_events: %d\n",
+		cidx, cpus, values, num_cpus, num_events);
+	EventSetInfo_t **esis;
+	unsigned int *cpu_nums;
+	hwd_context_t *context;
+	long long *row;
+	int i, count, retval = PAPI_OK;
+
+	if ( cpus == NULL || values == NULL || num_cpus == NULL ||
+	     *num_cpus < 1 || num_events < 1 )
+		papi_return( PAPI_EINVAL );
+
+	if ( _papi_hwi_invalid_cmp( cidx ) )
+		papi_return( PAPI_ENOCMP );
+
+	esis = papi_malloc( ( size_t ) *num_cpus * sizeof ( EventSetInfo_t * ) );
+	cpu_nums = papi_malloc( ( size_t ) *num_cpus * sizeof ( unsigned int ) );
+	if ( esis == NULL || cpu_nums == NULL ) {
+		if ( esis ) papi_free( esis );
+		if ( cpu_nums ) papi_free( cpu_nums );
+		papi_return( PAPI_ENOMEM );
+	}
+
+	/* The event sets cannot stop, so cannot go away, until the */
+	/* lock is released                                          */
+	_papi_hwi_lock( CPUS_LOCK );
+
+	count = _papi_hwi_get_running_cpu_eventsets( cidx, esis, cpu_nums,
+						     *num_cpus );
+	if ( count > *num_cpus ) {
+		_papi_hwi_unlock( CPUS_LOCK );
+		papi_free( esis );
+		papi_free( cpu_nums );
+		*num_cpus = count;
+		papi_return( PAPI_EBUF );
+	}
+
+	for ( i = 0; i < count; i++ ) {
+		if ( esis[i]->NumberOfEvents > num_events ) {
+			retval = PAPI_EINVAL;
+			break;
+		}
+
+		row = values + ( size_t ) i * ( size_t ) num_events;
+		memset( row, 0, ( size_t ) num_events * sizeof ( long long ) );
+
+		/* get the context we should use for this event set */
+		context = _papi_hwi_get_context( esis[i], NULL );
+		retval = _papi_hwi_read( context, esis[i], row );
+		if ( retval != PAPI_OK )
+			break;
+
+		cpus[i] = ( int ) cpu_nums[i];
+	}
+
+	_papi_hwi_unlock( CPUS_LOCK );
+
+	papi_free( esis );
+	papi_free( cpu_nums );
+
+	if ( retval != PAPI_OK )
+		papi_return( retval );
+
+	*num_cpus = count;
+
+	APIDBG( "PAPI_read_cpus read %d cpus\n", count );
+	return ( PAPI_OK );
+}
+
+/** @class PAPI_read_tids
+ *  @brief Read the threads attached to an event set with PAPI_attach_tids.
+ *
+ *  @par C Interface:
+ *  \#include <papi.h> @n
+ *  int PAPI_read_tids( int EventSet, int first, int *tids, long long *values, int *num_tids, int num_events );
+ *
+ *  PAPI_read_tids() reads the attached threads from the first one on, 
+ *  with one read of its group of events each, and returns the results 
+ *  as a matrix with one row of num_events values per thread, in the 
+ *  order of the events in the event set. Rows are zero padded past the 
+ *  events of the event set. 
+ *
+ *  A thread that has exited is returned with its tid negated and its 
+ *  last counts, until it is detached with PAPI_detach_tids. A thread 
+ *  that had exited before it was attached has a row of zeros. 
+ *
+ *  The threads of a process can each read a different range of the 
+ *  attached threads at the same time, for instance to spread thousands 
+ *  of them over several cpus. Threads must not be attached or detached 
+ *  while they are being read. 
+ *
+ *  @param[in] EventSet
+ *     -- an integer handle for a PAPI event set as created by PAPI_create_eventset
+ *  @param[in] first
+ *     -- the first attached thread to read, 0 for the first one
+ *  @param[out] *tids
+ *     -- the thread id of each row of values, negated if it has exited
+ *  @param[out] *values
+ *     -- an array of *num_tids times num_events counter values
+ *  @param[in,out] *num_tids
+ *     -- on input the number of rows available in tids and values, 
+ *        on output the number of rows filled in, less once the 
+ *        attached threads run out
+ *  @param[in] num_events
+ *     -- the number of values in each row
+ *
+ *  @retval PAPI_ECMP 
+ *	    This feature is unsupported on this component.
+ *  @retval PAPI_EINVAL 
+ *	    One or more of the arguments is invalid, or the event set 
+ *	    has more than num_events events.
+ *  @retval PAPI_ENOEVST 
+ *	    The event set specified does not exist.
+ *  @retval PAPI_ENOMEM 
+ *	    Insufficient memory to complete the operation.
+ *  @retval PAPI_ESYS 
+ *	    A system or C library call failed inside PAPI, see the 
+ *          errno variable.
+ *
+ * @see PAPI_attach_tids 
+ * @see PAPI_detach_tids 
+ * @see PAPI_read_cpus 
+ */
+int
+PAPI_read_tids( int EventSet, int first, int *tids, long long *values,
+		int *num_tids, int num_events )
+{
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_read_tids );
+	APIDBG( "Entry: EventSet: %d, first: %d, tids: %p, values: %p, num_tids: %p, num_events: %d\n",
+		EventSet, first, tids, values, num_tids, num_events);
+	EventSetInfo_t *ESI;
+	_papi_int_option_t internal;
+	hwd_context_t *context;
+	long long *counts, *row;
+	int i, cidx, retval;
+
+	if ( tids == NULL || values == NULL || num_tids == NULL ||
+	     *num_tids < 1 || first < 0 || num_events < 1 )
+		papi_return( PAPI_EINVAL );
+
+	ESI = _papi_hwi_lookup_EventSet( EventSet );
+	if ( ESI == NULL )
+		papi_return( PAPI_ENOEVST );
+
+	cidx = valid_ESI_component( ESI );
+	if ( cidx < 0 )
+		papi_return( cidx );
+
+	if ( _papi_hwd[cidx]->cmp_info.attach_tids == 0 )
+		papi_return( PAPI_ECMP );
+
+	if ( ESI->NumberOfEvents > num_events )
+		papi_return( PAPI_EINVAL );
+
+	if ( ESI->NativeCount == 0 ) {
+		*num_tids = 0;
+		return ( PAPI_OK );
+	}
+
+	/* the counters of the component, before derived events */
+	counts = papi_malloc( ( size_t ) *num_tids *
+			      ( size_t ) ESI->NativeCount * sizeof ( long long ) );
+	if ( counts == NULL )
+		papi_return( PAPI_ENOMEM );
+
+	memset( &internal, 0x0, sizeof ( internal ) );
+	internal.tids.ESI = ESI;
+	internal.tids.tids = tids;
+	internal.tids.num_tids = *num_tids;
+	internal.tids.first = first;
+	internal.tids.counts = counts;
+
+	/* get the context we should use for this event set */
+	context = _papi_hwi_get_context( ESI, NULL );
+	retval = _papi_hwd[cidx]->ctl( context, PAPI_READ_TIDS, &internal );
+
+	if ( retval == PAPI_OK ) {
+		for ( i = 0; i < internal.tids.num_tids; i++ ) {
+			row = values + ( size_t ) i * ( size_t ) num_events;
+			memset( row, 0, ( size_t ) num_events * sizeof ( long long ) );
+			_papi_hwi_map_values( ESI, counts +
+					      ( size_t ) i * ( size_t ) ESI->NativeCount,
+					      row );
+		}
+		*num_tids = internal.tids.num_tids;
+	}
+
+	papi_free( counts );
+
+	if ( retval != PAPI_OK )
+		papi_return( retval );
+
+	APIDBG( "PAPI_read_tids read %d tids\n", *num_tids );
+	return ( PAPI_OK );
+}
+
 /**	@class PAPI_accum
  *	@brief Accumulate and reset counters in an EventSet.
  *	
@@ -3293,6 +3580,7 @@ PAPI_read_ts( int EventSet, long long *values, long long *cycles )
 int
 PAPI_accum( int EventSet, long long *values )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_accum );
 	APIDBG("Entry: EventSet: %d, values: %p\n", EventSet, values);
 	EventSetInfo_t *ESI;
 	hwd_context_t *context;
@@ -3344,6 +3632,9 @@ PAPI_accum( int EventSet, long long *values )
  *		The EventSet specified does not exist.
  *	@retval PAPI_ECMP 
  *		PAPI_write() is not implemented for this architecture. 
+ *	@retval PAPI_ECNFLCT 
+ *		The EventSet is running multiplexed and the component cannot 
+ *		write its scaled counts. 
  *      @retval PAPI_ESYS 
  *              The EventSet is currently counting events and 
  *		the component could not change the values of the 
@@ -3361,9 +3652,10 @@ PAPI_accum( int EventSet, long long *values )
 int
 PAPI_write( int EventSet, long long *values )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_PAPI_write );
 	APIDBG("Entry: EventSet: %d, values: %p\n", EventSet, values);
 
-	int cidx, retval = PAPI_OK;
+	int i, index, cidx, retval = PAPI_OK;
 	EventSetInfo_t *ESI;
 	hwd_context_t *context;
 
@@ -3378,18 +3670,26 @@ PAPI_write( int EventSet, long long *values )
 	if ( values == NULL )
 		papi_return( PAPI_EINVAL );
 
+	/* values[] holds one value per event, in the order they were
+	   added, the component wants them in counter order. A derived
+	   event sets its first counter. */
+	for ( i = 0; i < ESI->NumberOfEvents; i++ ) {
+		index = ESI->EventInfoArray[i].pos[0];
+		if ( index == -1 )
+			continue;
+		ESI->hw_start[index] = values[i];
+	}
+
 	if ( ESI->state & PAPI_RUNNING ) {
 		/* get the context we should use for this event set */
 		context = _papi_hwi_get_context( ESI, NULL );
-		retval = _papi_hwd[cidx]->write( context, ESI->ctl_state, values );
+		PAPI_SELF_TIME( PAPI_SELF_VEC( cidx, write ),
+			retval = _papi_hwd[cidx]->write( context, ESI->ctl_state,
+							 ESI->hw_start ) );
 		if ( retval != PAPI_OK )
 			return ( retval );
 	}
 
-	memcpy( ESI->hw_start, values,
-			( size_t ) _papi_hwd[cidx]->cmp_info.num_cntrs *
-			sizeof ( long long ) );
-
 	return ( retval );
 }
 
@@ -3810,6 +4110,137 @@ PAPI_detach( int EventSet )
 	return ( _papi_set_attach( PAPI_DETACH, EventSet, 0 ) );
 }
 
+/* Attaches an event set to, or detaches it from, many thread ids */
+static int
+_papi_set_tids( int code, int EventSet, int *tids, int num_tids )
+{
+	EventSetInfo_t *ESI;
+	_papi_int_option_t internal;
+	hwd_context_t *context;
+	int cidx;
+
+	if ( tids == NULL || num_tids < 1 )
+		papi_return( PAPI_EINVAL );
+
+	ESI = _papi_hwi_lookup_EventSet( EventSet );
+	if ( ESI == NULL )
+		papi_return( PAPI_ENOEVST );
+
+	cidx = valid_ESI_component( ESI );
+	if ( cidx < 0 )
+		papi_return( cidx );
+
+	if ( _papi_hwd[cidx]->cmp_info.attach_tids == 0 )
+		papi_return( PAPI_ECMP );
+
+	/* the tids count what the event set counts */
+	if ( code == PAPI_ATTACH_TIDS && ESI->NumberOfEvents == 0 )
+		papi_return( PAPI_EINVAL );
+
+	memset( &internal, 0x0, sizeof ( internal ) );
+	internal.tids.ESI = ESI;
+	internal.tids.tids = tids;
+	internal.tids.num_tids = num_tids;
+
+	/* get the context we should use for this event set */
+	context = _papi_hwi_get_context( ESI, NULL );
+	papi_return( _papi_hwd[cidx]->ctl( context, code, &internal ) );
+}
+
+/** @class PAPI_attach_tids
+ *	@brief Count the events of an event set on many other threads, each on its own.
+ *
+ *	@par C Interface:
+ *	\#include <papi.h> @n
+ *	int PAPI_attach_tids( int EventSet, int *tids, int num_tids );
+ *
+ *	PAPI_attach_tids() gives each of the threads in tids a group of the 
+ *	events of EventSet, without an event set or a context of its own, 
+ *	so that a single thread can monitor thousands of threads of other 
+ *	processes. The event set keeps counting where it did; PAPI_start, 
+ *	PAPI_stop and PAPI_reset apply to the attached threads as well, and 
+ *	PAPI_read_tids reads them. Threads can be attached to an event set 
+ *	that is already counting, and they start counting then. 
+ *
+ *	A thread that has already exited, or exits later, stays attached 
+ *	with its last counts until PAPI_detach_tids, see PAPI_read_tids. 
+ *	Adding or removing events, or changing the options of the event 
+ *	set, detaches all the threads. 
+ *
+ *	Each thread takes one file descriptor per event, the limit on open 
+ *	files may need to be raised. 
+ *
+ *	@param EventSet 
+ *		An integer handle for a PAPI EventSet as created by PAPI_create_eventset, 
+ *		with its events added.
+ *	@param *tids 
+ *		The thread ids to attach.
+ *	@param num_tids 
+ *		The number of thread ids in tids.
+ *
+ *	@retval PAPI_ECMP 
+ *		This feature is unsupported on this component.
+ *	@retval PAPI_ECNFLCT 
+ *		The event set is multiplexed or counts with PAPI_INHERIT_THREADS.
+ *	@retval PAPI_EINVAL 
+ *		One or more of the arguments is invalid, or the event set has no events.
+ *	@retval PAPI_ENOEVST 
+ *		The event set specified does not exist.
+ *	@retval PAPI_ENOMEM 
+ *		Insufficient memory to complete the operation.
+ *	@retval PAPI_EPERM 
+ *		A thread cannot be monitored by this process. None of the 
+ *		threads are attached then.
+ *
+ *	@see PAPI_detach_tids
+ *	@see PAPI_read_tids
+ *	@see PAPI_attach
+ */
+int
+PAPI_attach_tids( int EventSet, int *tids, int num_tids )
+{
+	APIDBG( "Entry: EventSet: %d, tids: %p, num_tids: %d\n",
+		EventSet, tids, num_tids);
+	return ( _papi_set_tids( PAPI_ATTACH_TIDS, EventSet, tids, num_tids ) );
+}
+
+/** @class PAPI_detach_tids
+ *	@brief Stop counting on threads attached with PAPI_attach_tids.
+ *
+ *	@par C Interface:
+ *	\#include <papi.h> @n
+ *	int PAPI_detach_tids( int EventSet, int *tids, int num_tids );
+ *
+ *	Thread ids that are not attached are ignored, and a thread id may be 
+ *	given negated, as PAPI_read_tids returns it for a thread that has 
+ *	exited. The event set may be counting. The order in which 
+ *	PAPI_read_tids returns the remaining threads may change. 
+ *
+ *	@param EventSet 
+ *		An integer handle for a PAPI EventSet as created by PAPI_create_eventset.
+ *	@param *tids 
+ *		The thread ids to detach.
+ *	@param num_tids 
+ *		The number of thread ids in tids.
+ *
+ *	@retval PAPI_ECMP 
+ *		This feature is unsupported on this component.
+ *	@retval PAPI_EINVAL 
+ *		One or more of the arguments is invalid.
+ *	@retval PAPI_ENOEVST 
+ *		The event set specified does not exist.
+ *
+ *	@see PAPI_attach_tids
+ *	@see PAPI_read_tids
+ */
+int
+PAPI_detach_tids( int EventSet, int *tids, int num_tids )
+{
+	APIDBG( "Entry: EventSet: %d, tids: %p, num_tids: %d\n",
+		EventSet, tids, num_tids);
+	return ( _papi_set_tids( PAPI_DETACH_TIDS, EventSet, tids, num_tids ) );
+}
+
 /** @class PAPI_set_multiplex
  *	@brief Convert a standard event set to a multiplexed event set. 
  *
@@ -3976,12 +4407,15 @@ PAPI_set_multiplex( int EventSet )
  * PAPI_GRANUL		Set granularity for EventSet specified in ptr->granularity.eventset. 
  *					Will error if eventset is not bound to a component.
  * PAPI_INHERIT		Enable or disable inheritance for specified EventSet.
+ *					With PAPI_INHERIT_THREADS the EventSet counts every thread
+ *					of the process, and a read from any thread sums them.
  * PAPI_DATA_ADDRESS	Set data address range to restrict event counting for EventSet specified
  *					in ptr->addr.eventset. Starting and ending addresses are specified in
  *					ptr->addr.start and ptr->addr.end, respectively. If exact addresses
  *					cannot be instantiated, offsets are returned in ptr->addr.start_off and
  *					ptr->addr.end_off. Currently implemented on Itanium only.
  * PAPI_INSTR_ADDRESS	Set instruction address range as described above. Itanium only.
+ * PAPI_SELF_PROFILE	Clear the self-profiling probes of all threads, ptr is not used.
  * @endmanonly
  * @htmlonly
  * <table class="doxtable">
@@ -3999,9 +4433,10 @@ PAPI_set_multiplex( int EventSet )
  * <tr><td>PAPI_DETACH</td><td>Detach EventSet specified in ptr->attach.eventset from any thread or process id.</td></tr>
  * <tr><td>PAPI_DOMAIN</td><td>Set domain for EventSet specified in ptr->domain.eventset. Will error if eventset is not bound to a component.</td></tr>
  * <tr><td>PAPI_GRANUL</td><td>Set granularity for EventSet specified in ptr->granularity.eventset. Will error if eventset is not bound to a component.</td></tr>
- * <tr><td>PAPI_INHERIT</td><td>Enable or disable inheritance for specified EventSet.</td></tr>
+ * <tr><td>PAPI_INHERIT</td><td>Enable or disable inheritance for specified EventSet. With PAPI_INHERIT_THREADS the EventSet counts every thread of the process, and a read from any thread sums them.</td></tr>
  * <tr><td>PAPI_DATA_ADDRESS</td><td>Set data address range to restrict event counting for EventSet specified in ptr->addr.eventset. Starting and ending addresses are specified in ptr->addr.start and ptr->addr.end, respectively. If exact addresses cannot be instantiated, offsets are returned in ptr->addr.start_off and ptr->addr.end_off. Currently implemented on Itanium only.</td></tr>
  * <tr><td>PAPI_INSTR_ADDRESS</td><td>Set instruction address range as described above. Itanium only.</td></tr>
+ * <tr><td>PAPI_SELF_PROFILE</td><td>Clear the self-profiling probes of all threads, ptr is not used.</td></tr>
  * </table>
  * @endhtmlonly
  *
@@ -4379,6 +4814,10 @@ PAPI_set_opt( int option, PAPI_option_t * ptr )
 		if ( _papi_hwd[cidx]->cmp_info.inherit == 0 )
 			papi_return( PAPI_ECMP );
 
+		if ( ptr->inherit.inherit == PAPI_INHERIT_THREADS &&
+			 _papi_hwd[cidx]->cmp_info.inherit_threads == 0 )
+			papi_return( PAPI_ECMP );
+
 		if ( ( ESI->state & PAPI_STOPPED ) == 0 )
 			papi_return( PAPI_EISRUN );
 
@@ -4440,6 +4879,8 @@ PAPI_set_opt( int option, PAPI_option_t * ptr )
 //		_papi_user_defined_events_setup(ptr->events_file);
 		return( PAPI_OK );
 	}
+	case PAPI_SELF_PROFILE:
+		papi_return( _papi_self_reset(  ) );
 	default:
 		papi_return( PAPI_EINVAL );
 	}
@@ -4652,6 +5093,9 @@ PAPI_get_multiplex( int EventSet )
  * PAPI_MAX_MPX_CTRS	Get maximum number of multiplexing counters. Requires a component index.
  * PAPI_SHLIBINFO	Get shared library information used by the program.
  * PAPI_COMPONENTINFO	Get the PAPI features the specified component supports. Requires a component index.
+ * PAPI_SELF_PROFILE	Get the calls and time spent in the library, per API entry, internal path and
+ *					component vector call, in ptr->self_profile.probes. Only in a library built
+ *					with --enable-self-profile, else PAPI_ENOSUPP is returned.
  * @endmanonly
  * @htmlonly
  * <table class="doxtable">
@@ -4680,6 +5124,7 @@ PAPI_get_multiplex( int EventSet )
  * <tr><td>PAPI_MAX_MPX_CTRS</td><td>Get maximum number of multiplexing counters. Requires a component index.</td></tr>
  * <tr><td>PAPI_SHLIBINFO</td><td>Get shared library information used by the program.</td></tr>
  * <tr><td>PAPI_COMPONENTINFO</td><td>Get the PAPI features the specified component supports. Requires a component index.</td></tr>
+ * <tr><td>PAPI_SELF_PROFILE</td><td>Get the calls and time spent in the library, per API entry, internal path and component vector call, in ptr->self_profile.probes. Only in a library built with --enable-self-profile, else PAPI_ENOSUPP is returned.</td></tr>
  * </table>
  * @endhtmlonly
  *
@@ -4825,6 +5270,10 @@ PAPI_get_opt( int option, PAPI_option_t * ptr )
 		return ( PAPI_OK );
 	case PAPI_LIB_VERSION:
 		return ( PAPI_VERSION );
+	case PAPI_SELF_PROFILE:
+		if ( ptr == NULL )
+			papi_return( PAPI_EINVAL );
+		papi_return( _papi_self_get( &ptr->self_profile ) );
 /* The following cases all require a component index 
     and are handled by PAPI_get_cmp_opt() with cidx == 0*/
 	case PAPI_MAX_HWCTRS:
@@ -4907,7 +5356,7 @@ PAPI_get_cmp_opt( int option, PAPI_option_t * ptr, int cidx )
 		int retval;
 		if ( ptr == NULL )
 			papi_return( PAPI_EINVAL );
-		retval = _papi_os_vector.update_shlib_info( &_papi_hwi_system_info );
+		retval = _papi_hwi_update_shlib_info( 1 );
 		ptr->shlib_info = &_papi_hwi_system_info.shlib_info;
 		papi_return( retval );
 	}
@@ -5088,11 +5537,13 @@ again:
 	//_papi_hwi_shutdown_highlevel(  );
 	_papi_hwi_shutdown_global_internal(  );
 	_papi_hwi_shutdown_global_threads(  );
+	_papi_hwi_shutdown_global_cpus(  );
 	for( i = 0; i < papi_num_components; i++ ) {
 	   if (!_papi_hwd[i]->cmp_info.disabled) {
               _papi_hwd[i]->shutdown_component(  );
 	   }
 	}
+	_papi_hwi_shutdown_deferred_components(  );
 
 	/* Now it is safe to call re-init */
 
@@ -5544,6 +5995,13 @@ PAPI_overflow( int EventSet, int EventCode, int threshold, int flags,
  *	Each structure in the array defines the profiling parameters that are 
  *	normally passed to PAPI_profil(). 
  *	For more information on profiling, @ref PAPI_profil
+ *
+ *	With PAPI_PROFIL_SAMPLES or PAPI_PROFIL_CALLCHAIN, profcnt must be 1 and 
+ *	pr_base is a buffer of 64-bit words that receives the raw samples; 
+ *	pr_off and pr_scale are ignored. Enabling profiling clears the buffer, 
+ *	and samples accumulate across PAPI_start() calls until it is enabled 
+ *	again. The buffer is decoded by PAPI_profil_write(), and with 
+ *	PAPI_PROFIL_DATA_SRC also by PAPI_profil_memory().
  *	@manonly
  *
  *	@endmanonly
@@ -5646,6 +6104,11 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
       profcnt = 0;
    }
 
+   /* A call chain or a data address is only recorded as a raw sample */
+   if ( flags & ( PAPI_PROFIL_CALLCHAIN | PAPI_PROFIL_DATA_SRC ) ) {
+      flags |= PAPI_PROFIL_SAMPLES;
+   }
+
    /* check all profile regions for valid scale factors of:
       2 (131072/65536),
       1 (65536/65536),
@@ -5654,7 +6117,7 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
       {0,1}/65536 are traditionally used to terminate profiling
       but are unused here since PAPI uses threshold instead
     */
-   for( i = 0; i < profcnt; i++ ) {
+   for( i = 0; i < profcnt && !( flags & PAPI_PROFIL_SAMPLES ); i++ ) {
       if ( !( ( prof[i].pr_scale == 131072 ) ||
 	   ( ( prof[i].pr_scale <= 65536 && prof[i].pr_scale > 1 ) ) ) ) {
 	 APIDBG( "Improper scale factor: %d\n", prof[i].pr_scale );
@@ -5674,6 +6137,37 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
       }
    }
 
+   /* Raw samples go to a single buffer of 64-bit words with room  */
+   /* for the header and one record; histogram options do not apply */
+   if ( ( flags & PAPI_PROFIL_SAMPLES ) && ( threshold > 0 ) ) {
+      if ( ( profcnt != 1 ) || ( prof[0].pr_base == NULL ) ||
+	   ( ( unsigned long ) prof[0].pr_base % sizeof ( unsigned long long ) ) ||
+	   ( prof[0].pr_size < ( SMPL_HEADER + 2 ) * sizeof ( unsigned long long ) ) ) {
+	 papi_return( PAPI_EINVAL );
+      }
+      if ( flags & ( PAPI_PROFIL_RANDOM | PAPI_PROFIL_WEIGHTED |
+		     PAPI_PROFIL_COMPRESS | PAPI_PROFIL_BUCKETS |
+		     PAPI_PROFIL_INST_EAR | PAPI_PROFIL_DATA_EAR ) ) {
+	 papi_return( PAPI_EINVAL );
+      }
+      /* Records are either call chains or memory accesses */
+      if ( ( flags & PAPI_PROFIL_CALLCHAIN ) &&
+	   ( flags & PAPI_PROFIL_DATA_SRC ) ) {
+	 papi_return( PAPI_EINVAL );
+      }
+      /* Unwinding and data addresses need the kernel to sample, not */
+      /* the signal handler                                          */
+      if ( ( flags & ( PAPI_PROFIL_CALLCHAIN | PAPI_PROFIL_DATA_SRC ) ) &&
+	   ( ( flags & PAPI_PROFIL_FORCE_SW ) ||
+	     !_papi_hwd[cidx]->cmp_info.kernel_profile ) ) {
+	 papi_return( PAPI_ENOSUPP );
+      }
+      if ( ( ESI->profile.event_counter > 0 ) &&
+	   !( ESI->profile.flags & PAPI_PROFIL_SAMPLES ) ) {
+	 papi_return( PAPI_ECNFLCT );
+      }
+   }
+
    /* ??? */
    if ( (threshold > 0) &&
 	(ESI->profile.event_counter >= _papi_hwd[cidx]->cmp_info.num_cntrs) ) {
@@ -5747,7 +6241,9 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
    if ( flags &
 	~( PAPI_PROFIL_POSIX | PAPI_PROFIL_RANDOM | PAPI_PROFIL_WEIGHTED |
 	   PAPI_PROFIL_COMPRESS | PAPI_PROFIL_BUCKETS | PAPI_PROFIL_FORCE_SW |
-	   PAPI_PROFIL_INST_EAR | PAPI_PROFIL_DATA_EAR ) ) {
+	   PAPI_PROFIL_INST_EAR | PAPI_PROFIL_DATA_EAR |
+	   PAPI_PROFIL_SAMPLES | PAPI_PROFIL_CALLCHAIN |
+	   PAPI_PROFIL_DATA_SRC ) ) {
       papi_return( PAPI_EINVAL );
    }
 
@@ -5762,7 +6258,12 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
 
    /* make sure one and only one bucket size is set */
    buckets = flags & PAPI_PROFIL_BUCKETS;
-   if ( !buckets ) {
+   if ( flags & PAPI_PROFIL_SAMPLES ) {
+      if ( threshold > 0 ) {
+	 _papi_hwi_profile_init_samples( prof, EventCode, threshold, flags );
+      }
+   }
+   else if ( !buckets ) {
       flags |= PAPI_PROFIL_BUCKET_16;	/* default to 16 bit if nothing set */
    }
    else {
@@ -5951,6 +6452,14 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
  * @arg PAPI_PROFIL_BUCKET_32	Use unsigned int (32 bit) buckets.@n
  * @arg PAPI_PROFIL_BUCKET_64	Use unsigned long long (64 bit) buckets.@n
  * @arg PAPI_PROFIL_FORCE_SW	Force software overflow in profiling. @n
+ * @arg PAPI_PROFIL_SAMPLES	Record each sampled address in buf instead of a histogram; 
+ *	offset and scale are ignored. See PAPI_profil_write(). @n
+ * @arg PAPI_PROFIL_CALLCHAIN	Record the call chain of each sample, implies PAPI_PROFIL_SAMPLES. 
+ *	Needs kernel based profiling; returns PAPI_ENOSUPP with PAPI_PROFIL_FORCE_SW. @n
+ * @arg PAPI_PROFIL_DATA_SRC	Record the data address, latency and data source of each sample, 
+ *	implies PAPI_PROFIL_SAMPLES and excludes PAPI_PROFIL_CALLCHAIN. The event must be a precise 
+ *	memory event, e.g. one with a :precise= modifier; see PAPI_profil_memory(). 
+ *	Needs kernel based profiling; returns PAPI_ENOSUPP with PAPI_PROFIL_FORCE_SW. @n
  *
  * @par Example
  * @code
@@ -6048,6 +6557,149 @@ PAPI_profil( void *buf, unsigned bufsiz, vptr_t offset,
 	papi_return( PAPI_sprofil( NULL, 0, EventSet, EventCode, 0, flags ) );
 }
 
+/** @class PAPI_profil_write
+ *  @brief Attribute the samples of a PAPI_PROFIL_SAMPLES buffer to symbols and write them out.
+ *
+ * @par C Interface:
+ * \#include <papi.h> @n
+ * int PAPI_profil_write( const void *buf, unsigned bufsiz, const char *filename, int format );
+ *
+ * @param *buf
+ *    -- the buffer given to PAPI_profil() or PAPI_sprofil() with PAPI_PROFIL_SAMPLES.
+ * @param bufsiz
+ *    -- its size in bytes.
+ * @param *filename
+ *    -- the file to create.
+ * @param format
+ *    -- PAPI_PROFIL_FORMAT_FOLDED, PAPI_PROFIL_FORMAT_PPROF or, for 
+ *    PAPI_PROFIL_DATA_SRC buffers only, PAPI_PROFIL_FORMAT_MEMORY.
+ *
+ * @retval PAPI_OK 
+ * @retval PAPI_EINVAL 
+ *	   buf was not set up by PAPI_PROFIL_SAMPLES profiling, or format is unknown.
+ * @retval PAPI_ESYS 
+ *	   filename could not be written.
+ * @retval PAPI_ENOMEM 
+ *	   Insufficient memory to complete the operation.
+ *
+ *	With PAPI_PROFIL_SAMPLES the overflow handler only appends the raw 
+ *	addresses, and with PAPI_PROFIL_CALLCHAIN their callers, to buf. 
+ *	PAPI_profil_write() does the attribution afterwards, typically after 
+ *	PAPI_stop(): it refreshes the shared library map, reads the ELF symbol 
+ *	tables of the objects that were hit, and writes either folded stacks, 
+ *	one "outer;...;inner count" line per distinct stack as consumed by 
+ *	flamegraph tools, or an uncompressed pprof profile.proto. Addresses 
+ *	without a symbol are written as object+offset, or as a bare address 
+ *	outside of any known object. Symbol names are not demangled.
+ *
+ *	Samples that did not fit in buf are counted but not recorded; the 
+ *	folded output notes them as a [lost] stack.
+ *
+ *	The stacks of a PAPI_PROFIL_DATA_SRC buffer are the instructions that 
+ *	accessed memory. PAPI_PROFIL_FORMAT_MEMORY writes the summary of 
+ *	PAPI_profil_memory() as text instead.
+ *
+ * @par Example
+ * @code
+ * static unsigned long long samples[1 << 20];
+ *
+ * retval = PAPI_profil( samples, sizeof(samples), 0, 0, EventSet, PAPI_TOT_CYC,
+ *                       1000000, PAPI_PROFIL_CALLCHAIN );
+ * if ( retval != PAPI_OK ) handle_error( retval );
+ * PAPI_start( EventSet );
+ * do_work( );
+ * PAPI_stop( EventSet, values );
+ * retval = PAPI_profil_write( samples, sizeof(samples), "cycles.folded",
+ *                             PAPI_PROFIL_FORMAT_FOLDED );
+ * @endcode
+ *
+ * @see PAPI_profil
+ * @see PAPI_sprofil
+ */
+int
+PAPI_profil_write( const void *buf, unsigned bufsiz, const char *filename,
+				   int format )
+{
+	APIDBG( "Entry: buf: %p, bufsiz: %u, filename: %s, format: %d\n", buf, bufsiz, filename ? filename : "(null)", format);
+
+	if ( init_level == PAPI_NOT_INITED )
+		papi_return( PAPI_ENOINIT );
+
+	if ( ( buf == NULL ) || ( filename == NULL ) )
+		papi_return( PAPI_EINVAL );
+
+	papi_return( _papi_hwi_profile_write( buf, bufsiz, filename, format ) );
+}
+
+/** @class PAPI_profil_memory
+ *  @brief Summarize the memory accesses of a PAPI_PROFIL_DATA_SRC buffer.
+ *
+ * @par C Interface:
+ * \#include <papi.h> @n
+ * int PAPI_profil_memory( const void *buf, unsigned bufsiz, PAPI_memprof_t *summary );
+ *
+ * @param *buf
+ *    -- the buffer given to PAPI_profil() or PAPI_sprofil() with PAPI_PROFIL_DATA_SRC.
+ * @param bufsiz
+ *    -- its size in bytes.
+ * @param *summary
+ *    -- receives the summary.
+ *
+ * @retval PAPI_OK 
+ * @retval PAPI_EINVAL 
+ *	   buf was not set up by PAPI_PROFIL_DATA_SRC profiling, or an argument is NULL.
+ * @retval PAPI_ENOMEM 
+ *	   Insufficient memory to complete the operation.
+ *
+ *	With PAPI_PROFIL_DATA_SRC the kernel records, for each sample of a 
+ *	precise memory event (PEBS load latency or IBS op sampling), the 
+ *	instruction, the data address, the access latency in cycles and where 
+ *	the data came from. The overflow handler only appends these to buf. 
+ *	PAPI_profil_memory() decodes them afterwards into the number of samples 
+ *	and total latency served by each level of the hierarchy (summary->
+ *	level_samples and level_weight, indexed by PAPI_MEMPROF_L1 and so on), 
+ *	a histogram of latencies in power of two buckets, the data objects with 
+ *	the largest total latency and the most sampled 64 byte cache lines. 
+ *	Data objects are the global and static variables of the executable and 
+ *	its libraries, from their ELF symbol tables, or else the mapping that 
+ *	holds the address, e.g. [heap] or [stack].
+ *
+ *	What the latency covers and which levels are reported depends on the 
+ *	processor; stores often have no latency.
+ *
+ * @par Example
+ * @code
+ * static unsigned long long samples[1 << 20];
+ * PAPI_memprof_t summary;
+ *
+ * retval = PAPI_event_name_to_code( "MEM_TRANS_RETIRED:LOAD_LATENCY:ldlat=3:precise=2", &code );
+ * retval = PAPI_add_event( EventSet, code );
+ * retval = PAPI_profil( samples, sizeof(samples), 0, 0, EventSet, code,
+ *                       10000, PAPI_PROFIL_DATA_SRC );
+ * PAPI_start( EventSet );
+ * do_work( );
+ * PAPI_stop( EventSet, values );
+ * retval = PAPI_profil_memory( samples, sizeof(samples), &summary );
+ * printf( "%lld samples from RAM\n", summary.level_samples[PAPI_MEMPROF_LOCAL_RAM] );
+ * @endcode
+ *
+ * @see PAPI_profil
+ * @see PAPI_profil_write
+ */
+int
+PAPI_profil_memory( const void *buf, unsigned bufsiz, PAPI_memprof_t *summary )
+{
+	APIDBG( "Entry: buf: %p, bufsiz: %u, summary: %p\n", buf, bufsiz, summary);
+
+	if ( init_level == PAPI_NOT_INITED )
+		papi_return( PAPI_ENOINIT );
+
+	if ( ( buf == NULL ) || ( summary == NULL ) )
+		papi_return( PAPI_EINVAL );
+
+	papi_return( _papi_hwi_profile_memory( buf, bufsiz, summary ) );
+}
+
 /* This function sets the low level default granularity
    for all newly manufactured eventsets. The first function
    preserves API compatibility and assumes component 0;
@@ -7461,6 +8113,11 @@ PAPI_get_dev_type_attr(void *handle, PAPI_dev_type_attr_e attr, void *val)
         PAPI_DEV_ATTR__ROCM_UINT_SIMD_PER_CU,
         PAPI_DEV_ATTR__ROCM_UINT_COMP_CAP_MAJOR,
         PAPI_DEV_ATTR__ROCM_UINT_COMP_CAP_MINOR,
+        PAPI_DEV_ATTR__CPU_UINT_THR_SOCKET_AFFINITY,
+        PAPI_DEV_ATTR__CPU_UINT_THR_CORE_AFFINITY,
+        PAPI_DEV_ATTR__CPU_UINT_THR_L2_AFFINITY,
+        PAPI_DEV_ATTR__CPU_UINT_THR_L3_AFFINITY,
+        PAPI_DEV_ATTR__CPU_UINT_THR_UNCORE_READER,
     } PAPI_dev_attr_e;
 
     void *handle;
@@ -7485,6 +8142,12 @@ PAPI_get_dev_type_attr(void *handle, PAPI_dev_type_attr_e attr, void *val)
  *  PAPI_get_dev_type_attr() allows the user to query all device type attributes.
  *  It takes a device type handle, returned by PAPI_enum_dev_type, the device sequential id
  *  and an attribute to be queried for the device and returns the attribute value.
+ *  The CPU_UINT_THR_* attributes take a hardware thread (cpu number) as id and give its
+ *  NUMA node, socket (physical package id), core, and L2 and L3 cache domain; cores and
+ *  cache domains are numbered from 0 and threads with the same core are siblings.
+ *  PAPI_DEV_ATTR__CPU_UINT_THR_UNCORE_READER gives the thread on which the uncore
+ *  counters of the thread's socket are opened, so a reader pinned there reads them
+ *  without crossing sockets.
  *
  *  \bug none known
  *  \see PAPI_enum_dev_type
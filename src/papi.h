@@ -413,7 +413,33 @@ All of the functions in the PerfAPI should use the following set of constants.
 #define PAPI_PROFIL_FORCE_SW  0x40       /**< Force Software overflow in profiling */
 #define PAPI_PROFIL_DATA_EAR  0x80       /**< Use data address register profiling */
 #define PAPI_PROFIL_INST_EAR  0x100      /**< Use instruction address register profiling */
+#define PAPI_PROFIL_SAMPLES   0x200      /**< Record the raw sample addresses instead of a histogram */
+#define PAPI_PROFIL_CALLCHAIN 0x400      /**< Record the call chain of each sample, implies PAPI_PROFIL_SAMPLES */
+#define PAPI_PROFIL_DATA_SRC  0x800      /**< Record the data address, latency and data source of each sample of a precise memory event, implies PAPI_PROFIL_SAMPLES */
 #define PAPI_PROFIL_BUCKETS   (PAPI_PROFIL_BUCKET_16 | PAPI_PROFIL_BUCKET_32 | PAPI_PROFIL_BUCKET_64)
+
+#define PAPI_PROFIL_FORMAT_FOLDED 0      /**< PAPI_profil_write(): one "root;...;leaf count" line per call stack */
+#define PAPI_PROFIL_FORMAT_PPROF  1      /**< PAPI_profil_write(): uncompressed pprof profile.proto */
+#define PAPI_PROFIL_FORMAT_MEMORY 2      /**< PAPI_profil_write(): text report of a PAPI_PROFIL_DATA_SRC buffer */
+#define PAPI_PROFIL_MAX_DEPTH     128    /**< Deepest call chain recorded with PAPI_PROFIL_CALLCHAIN */
+/** @} */
+
+/** @internal 
+	@defgroup memprof_defns Memory profile definitions, see PAPI_profil_memory() 
+	@{ */
+#define PAPI_MEMPROF_L1           0      /**< Load served by the L1 data cache */
+#define PAPI_MEMPROF_LFB          1      /**< Load served by a line fill buffer */
+#define PAPI_MEMPROF_L2           2      /**< Load served by the L2 cache */
+#define PAPI_MEMPROF_L3           3      /**< Load served by the last level cache */
+#define PAPI_MEMPROF_LOCAL_RAM    4      /**< Load served by local memory */
+#define PAPI_MEMPROF_REMOTE_RAM   5      /**< Load served by the memory of another node */
+#define PAPI_MEMPROF_REMOTE_CACHE 6      /**< Load served by the cache of another node */
+#define PAPI_MEMPROF_IO           7      /**< Load served by I/O */
+#define PAPI_MEMPROF_UNCACHED     8      /**< Uncached access */
+#define PAPI_MEMPROF_UNKNOWN      9      /**< Data source not reported */
+#define PAPI_MEMPROF_LEVELS       10
+#define PAPI_MEMPROF_BUCKETS      16     /**< Latency histogram buckets: 0-1, 2-3, 4-7, ... cycles, the last one open ended */
+#define PAPI_MEMPROF_TOP          16     /**< Data objects and cache lines kept in a PAPI_memprof_t */
 /** @} */
 
 /* @defgroup overflow_defns Overflow definitions 
@@ -434,6 +460,7 @@ All of the functions in the PerfAPI should use the following set of constants.
 	@{ */
 #define PAPI_INHERIT_ALL  1     /**< The flag to this to inherit all children's counters */
 #define PAPI_INHERIT_NONE 0     /**< The flag to this to inherit none of the children's counters */
+#define PAPI_INHERIT_THREADS 2  /**< The flag to this to count every thread of the process, read live from any thread */
 
 
 #define PAPI_DETACH			1		/**< Detach */
@@ -465,6 +492,7 @@ All of the functions in the PerfAPI should use the following set of constants.
 #define PAPI_CPU_ATTACH		27      /**< Specify a cpu number the event set should be tied to */
 #define PAPI_INHERIT		28      /**< Option to set counter inheritance flag */
 #define PAPI_USER_EVENTS_FILE 29	/**< Option to set file from where to parse user defined events */
+#define PAPI_SELF_PROFILE   30      /**< Time spent inside PAPI, with a library built with --enable-self-profile */
 
 #define PAPI_INIT_SLOTS    64     /*Number of initialized slots in
                                    DynamicArray of EventSets */
@@ -662,7 +690,9 @@ typedef void *vptr_t;
      /* This should be a granularity option */
      unsigned int cpu:1;                   /**< Supports specifying cpu number to use with event set */
      unsigned int inherit:1;               /**< Supports child processes inheriting parents counters */
-     unsigned int reserved_bits:19;
+     unsigned int inherit_threads:1;       /**< Supports PAPI_INHERIT_THREADS */
+     unsigned int attach_tids:1;           /**< Supports PAPI_attach_tids */
+     unsigned int reserved_bits:17;
    } PAPI_component_info_t;
 
 /**  @ingroup papi_data_structures*/
@@ -836,6 +866,26 @@ typedef char* PAPI_user_defined_events_file_t;
       int end_off;            /**< hardware specified offset from end address */
    } PAPI_addr_range_option_t;
 
+#define PAPI_SELF_BUCKETS   32      /**< Latency histogram buckets of a PAPI_self_probe_t */
+
+/** @ingroup papi_data_structures
+  *	@brief A probe of the library self-profiling, see PAPI_SELF_PROFILE */
+   typedef struct _papi_self_probe {
+      char name[PAPI_MIN_STR_LEN];   /**< API entry, internal path or "component:call" */
+      long long count;               /**< calls */
+      long long total_ns;            /**< time in the calls */
+      long long max_ns;              /**< longest call */
+      long long hist[PAPI_SELF_BUCKETS]; /**< calls taking 0, 1, 2-3, 4-7, ... ns, the last one open ended */
+   } PAPI_self_probe_t;
+
+/** @ingroup papi_data_structures
+  *	@brief Filled by PAPI_get_opt( PAPI_SELF_PROFILE ) */
+   typedef struct _papi_self_profile_option {
+      int this_thread;               /**< only the calls of the calling thread, else those of all threads */
+      int num_probes;                /**< in: size of probes, out: probes filled, the ones that were called */
+      PAPI_self_probe_t *probes;
+   } PAPI_self_profile_option_t;
+
 /** @ingroup papi_data_structures 
   *	@union PAPI_option_t
   *	@brief A pointer to the following is passed to PAPI_set/get_opt() */
@@ -859,6 +909,7 @@ typedef char* PAPI_user_defined_events_file_t;
 		PAPI_component_info_t *cmp_info;
 		PAPI_addr_range_option_t addr;
 		PAPI_user_defined_events_file_t events_file;
+		PAPI_self_profile_option_t self_profile;
 	} PAPI_option_t;
 
 /** @ingroup papi_data_structures
@@ -878,6 +929,39 @@ typedef char* PAPI_user_defined_events_file_t;
 	  long long pte;
 	} PAPI_dmem_info_t;
 
+/** @ingroup papi_data_structures
+  *	@brief A data object of a PAPI_memprof_t: a symbol, or the mapping of the address */
+	typedef struct _papi_memprof_object {
+	  char name[PAPI_MAX_STR_LEN];
+	  long long samples;
+	  long long weight;                          /**< sum of the latencies */
+	  long long latency[PAPI_MEMPROF_BUCKETS];   /**< samples per latency bucket */
+	} PAPI_memprof_object_t;
+
+/** @ingroup papi_data_structures
+  *	@brief A cache line of a PAPI_memprof_t */
+	typedef struct _papi_memprof_line {
+	  unsigned long long addr;                   /**< address of the line */
+	  long long samples;
+	  long long weight;
+	  int level;                                 /**< PAPI_MEMPROF_* that served most of its samples */
+	  char object[PAPI_MAX_STR_LEN];
+	} PAPI_memprof_line_t;
+
+/** @ingroup papi_data_structures
+  *	@brief A pointer to the following is passed to PAPI_profil_memory() */
+	typedef struct _papi_memprof {
+	  long long samples;
+	  long long lost;                            /**< samples that did not fit in the buffer */
+	  long long level_samples[PAPI_MEMPROF_LEVELS];
+	  long long level_weight[PAPI_MEMPROF_LEVELS];
+	  long long latency[PAPI_MEMPROF_BUCKETS];
+	  int num_objects;
+	  PAPI_memprof_object_t objects[PAPI_MEMPROF_TOP]; /**< by decreasing weight */
+	  int num_lines;
+	  PAPI_memprof_line_t lines[PAPI_MEMPROF_TOP];     /**< by decreasing samples */
+	} PAPI_memprof_t;
+
 /* Fortran offsets into PAPI_dmem_info_t structure. */
 
 #define PAPIF_DMEM_VMPEAK     1
@@ -1131,6 +1215,11 @@ typedef enum {
     PAPI_DEV_ATTR__ROCM_UINT_SIMD_PER_CU,
     PAPI_DEV_ATTR__ROCM_UINT_COMP_CAP_MAJOR,
     PAPI_DEV_ATTR__ROCM_UINT_COMP_CAP_MINOR,
+    PAPI_DEV_ATTR__CPU_UINT_THR_SOCKET_AFFINITY,
+    PAPI_DEV_ATTR__CPU_UINT_THR_CORE_AFFINITY,
+    PAPI_DEV_ATTR__CPU_UINT_THR_L2_AFFINITY,
+    PAPI_DEV_ATTR__CPU_UINT_THR_L3_AFFINITY,
+    PAPI_DEV_ATTR__CPU_UINT_THR_UNCORE_READER,
 } PAPI_dev_attr_e;
 
 
@@ -1143,9 +1232,11 @@ typedef enum {
    int   PAPI_add_events(int EventSet, int *Events, int number); /**< add array of PAPI preset or native hardware events to an event set */
    int   PAPI_assign_eventset_component(int EventSet, int cidx); /**< assign a component index to an existing but empty eventset */
    int   PAPI_attach(int EventSet, unsigned long tid); /**< attach specified event set to a specific process or thread id */
+   int   PAPI_attach_tids(int EventSet, int *tids, int num_tids); /**< also count the events of an event set on many other threads, each on its own */
    int   PAPI_cleanup_eventset(int EventSet); /**< remove all PAPI events from an event set */
    int   PAPI_create_eventset(int *EventSet); /**< create a new empty PAPI event set */
    int   PAPI_detach(int EventSet); /**< detach specified event set from a previously specified process or thread id */
+   int   PAPI_detach_tids(int EventSet, int *tids, int num_tids); /**< stop counting on threads attached with PAPI_attach_tids */
    int   PAPI_destroy_eventset(int *EventSet); /**< deallocates memory associated with an empty PAPI event set */
    int   PAPI_enum_event(int *EventCode, int modifier); /**< return the event code for the next available preset or natvie event */
    int   PAPI_enum_cmp_event(int *EventCode, int modifier, int cidx); /**< return the event code for the next available component event */
@@ -1182,10 +1273,14 @@ typedef enum {
    int   PAPI_profil(void *buf, unsigned bufsiz, vptr_t offset,
 					 unsigned scale, int EventSet, int EventCode,
 					 int threshold, int flags); /**< generate PC histogram data where hardware counter overflow occurs */
+   int   PAPI_profil_write(const void *buf, unsigned bufsiz, const char *filename, int format); /**< symbolize a PAPI_PROFIL_SAMPLES buffer and write it as folded stacks, pprof or a memory report */
+   int   PAPI_profil_memory(const void *buf, unsigned bufsiz, PAPI_memprof_t *summary); /**< aggregate a PAPI_PROFIL_DATA_SRC buffer by cache level, data object and cache line */
    int   PAPI_query_event(int EventCode); /**< query if a PAPI event exists */
    int   PAPI_query_named_event(const char *EventName); /**< query if a named PAPI event exists */
    int   PAPI_read(int EventSet, long long * values); /**< read hardware events from an event set with no reset */
    int   PAPI_read_ts(int EventSet, long long * values, long long *cyc); /**< read from an eventset with a real-time cycle timestamp */
+   int   PAPI_read_cpus(int cidx, int *cpus, long long *values, int *num_cpus, int num_events); /**< read the running cpu-attached eventsets of a component, in NUMA order */
+   int   PAPI_read_tids(int EventSet, int first, int *tids, long long *values, int *num_tids, int num_events); /**< read the threads attached with PAPI_attach_tids, one row each */
    int   PAPI_register_thread(void); /**< inform PAPI of the existence of a new thread */
    int   PAPI_remove_event(int EventSet, int EventCode); /**< remove a hardware event from a PAPI event set */
    int   PAPI_remove_named_event(int EventSet, const char *EventName); /**< remove a named event from a PAPI event set */
@@ -1238,6 +1333,10 @@ typedef enum {
    int PAPI_hl_region_begin(const char* region); /**< read performance events at the beginning of a region */
    int PAPI_hl_read(const char* region); /**< read performance events inside of a region and store the difference to the corresponding beginning of the region */
    int PAPI_hl_region_end(const char* region); /**< read performance events at the end of a region and store the difference to the corresponding beginning of the region */
+   int PAPI_hl_region_register(const char* region, int *handle); /**< get a handle for a region name */
+   int PAPI_hl_region_begin_h(int handle); /**< PAPI_hl_region_begin for a region handle */
+   int PAPI_hl_read_h(int handle); /**< PAPI_hl_read for a region handle */
+   int PAPI_hl_region_end_h(int handle); /**< PAPI_hl_region_end for a region handle */
    int PAPI_hl_stop(void); /**< stops a running high-level event set */
 /** @} */
 
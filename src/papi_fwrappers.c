@@ -1552,6 +1552,11 @@ PAPI_FCALL( papif_get_dev_attr, PAPIF_GET_DEV_ATTR, (int *handle_index,
         case PAPI_DEV_ATTR__CPU_UINT_CORE_COUNT:
         case PAPI_DEV_ATTR__CPU_UINT_THREAD_COUNT:
         case PAPI_DEV_ATTR__CPU_UINT_THR_PER_NUMA:
+        case PAPI_DEV_ATTR__CPU_UINT_THR_SOCKET_AFFINITY:
+        case PAPI_DEV_ATTR__CPU_UINT_THR_CORE_AFFINITY:
+        case PAPI_DEV_ATTR__CPU_UINT_THR_L2_AFFINITY:
+        case PAPI_DEV_ATTR__CPU_UINT_THR_L3_AFFINITY:
+        case PAPI_DEV_ATTR__CPU_UINT_THR_UNCORE_READER:
         case PAPI_DEV_ATTR__CUDA_ULONG_UID:
         case PAPI_DEV_ATTR__CUDA_CHAR_DEVICE_NAME:
         case PAPI_DEV_ATTR__CUDA_UINT_WARP_SIZE:
@@ -42,6 +42,7 @@
 #include "extras.h"
 #include "papi_preset.h"
 #include "cpus.h"
+#include "papi_self.h"
 
 #include "papi_common_strings.h"
 
@@ -800,12 +801,12 @@ _papi_hwi_assign_eventset( EventSetInfo_t *ESI, int cidx )
    /* NOTE: the next two malloc allocate blocks of memory that are later */
    /* parcelled into overflow and profile arrays                         */
    ESI->overflow.deadline = ( long long * )
-		papi_malloc( ( sizeof ( long long ) +
+		papi_malloc( ( sizeof ( long long ) * 2 +
 					   sizeof ( int ) * 3 ) * ( size_t ) max_counters );
 
    ESI->profile.prof = ( PAPI_sprofil_t ** )
 		papi_malloc( ( sizeof ( PAPI_sprofil_t * ) * ( size_t ) max_counters +
-					   ( size_t ) max_counters * sizeof ( int ) * 4 ) );
+					   ( size_t ) max_counters * sizeof ( int ) * 5 ) );
 
    /* If any of these allocations failed, free things up and fail */
 
@@ -834,6 +835,8 @@ _papi_hwi_assign_eventset( EventSetInfo_t *ESI, int cidx )
    /* Carve up the overflow block into separate arrays */
    ptr = ( char * ) ESI->overflow.deadline;
    ptr += sizeof ( long long ) * max_counters;
+   ESI->overflow.excess = ( long long * ) ptr;
+   ptr += sizeof ( long long ) * max_counters;
    ESI->overflow.threshold = ( int * ) ptr;
    ptr += sizeof ( int ) * max_counters;
    ESI->overflow.EventIndex = ( int * ) ptr;
@@ -850,6 +853,8 @@ _papi_hwi_assign_eventset( EventSetInfo_t *ESI, int cidx )
    ESI->profile.EventIndex = ( int * ) ptr;
    ptr += sizeof ( int ) * max_counters;
    ESI->profile.EventCode = ( int * ) ptr;
+   ptr += sizeof ( int ) * max_counters;
+   ESI->profile.PosIndex = ( int * ) ptr;
 
    /* initialize_EventInfoArray */
 
@@ -1294,10 +1299,11 @@ add_native_events( EventSetInfo_t *ESI, unsigned int *nevt,
 
       if ( _papi_hwd[ESI->CmpIdx]->allocate_registers( ESI ) == PAPI_OK ) {
 
-	 retval = _papi_hwd[ESI->CmpIdx]->update_control_state( ESI->ctl_state,
+	 PAPI_SELF_TIME( PAPI_SELF_VEC( ESI->CmpIdx, update_control_state ),
+	 	retval = _papi_hwd[ESI->CmpIdx]->update_control_state( ESI->ctl_state,
 		  ESI->NativeInfoArray,
 		  ESI->NativeCount,
-		  context);
+		  context) );
 	 if ( retval != PAPI_OK ) {
 clean:
 	    for( i = 0; i < size; i++ ) {
@@ -1610,8 +1616,9 @@ remove_native_events( EventSetInfo_t *ESI, int *nevt, int size )
 	if ( zero ) {
       /* get the context we should use for this event set */
       context = _papi_hwi_get_context( ESI, NULL );
-		retval = _papi_hwd[ESI->CmpIdx]->update_control_state( ESI->ctl_state,
-														  native, ESI->NativeCount, context);
+		PAPI_SELF_TIME( PAPI_SELF_VEC( ESI->CmpIdx, update_control_state ),
+			retval = _papi_hwd[ESI->CmpIdx]->update_control_state( ESI->ctl_state,
+														  native, ESI->NativeCount, context) );
 		if ( retval == PAPI_OK )
 			retval = update_overflow( ESI );
 	}
@@ -1705,18 +1712,32 @@ int
 _papi_hwi_read( hwd_context_t * context, EventSetInfo_t * ESI,
 				long long *values )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF__papi_hwi_read );
 	INTDBG("ENTER: context: %p, ESI: %p, values: %p\n", context, ESI, values);
 	int retval;
 	long long *dp = NULL;
-	int i, index;
 
-	retval = _papi_hwd[ESI->CmpIdx]->read( context, ESI->ctl_state,
-					       &dp, ESI->state );
+	PAPI_SELF_TIME( PAPI_SELF_VEC( ESI->CmpIdx, read ),
+		retval = _papi_hwd[ESI->CmpIdx]->read( context, ESI->ctl_state,
+					       &dp, ESI->state ) );
 	if ( retval != PAPI_OK ) {
 		INTDBG("EXIT: retval: %d\n", retval);
 	   return retval;
 	}
 
+	_papi_hwi_map_values( ESI, dp, values );
+
+	INTDBG("EXIT: PAPI_OK\n");
+	return PAPI_OK;
+}
+
+/* Turn the counters dp of the component into the values of the
+   events of ESI */
+void
+_papi_hwi_map_values( EventSetInfo_t * ESI, long long *dp, long long *values )
+{
+	int i, index;
+
 	/* This routine distributes hardware counters to software counters in the
 	   order that they were added. Note that the higher level
 	   EventInfoArray[i] entries may not be contiguous because the user
@@ -1749,9 +1770,6 @@ _papi_hwi_read( hwd_context_t * context, EventSetInfo_t * ESI,
 #endif
 		}
 	}
-
-	INTDBG("EXIT: PAPI_OK\n");
-	return PAPI_OK;
 }
 
 int
@@ -1804,8 +1822,9 @@ _papi_hwi_cleanup_eventset( EventSetInfo_t * ESI )
 
    context = _papi_hwi_get_context( ESI, NULL );
    /* calling with count of 0 equals a close? */
-   retval = _papi_hwd[ESI->CmpIdx]->update_control_state( ESI->ctl_state,
-			       NULL, 0, context);
+   PAPI_SELF_TIME( PAPI_SELF_VEC( ESI->CmpIdx, update_control_state ),
+      retval = _papi_hwd[ESI->CmpIdx]->update_control_state( ESI->ctl_state,
+			       NULL, 0, context) );
    if (retval!=PAPI_OK) {
      return retval;
    }
@@ -1927,17 +1946,156 @@ _papi_hwi_convert_eventset_to_multiplex( _papi_int_multiplex_t * mpx )
 
 int papi_num_components = ( sizeof ( _papi_hwd ) / sizeof ( *_papi_hwd ) ) - 1;
 
+/* Components whose init_component() was deferred by PAPI_LAZY_INIT.
+ * A deferred component is reported as disabled until it is first
+ * referenced by name, enumeration or PAPI_get_component_info().
+ */
+static int _papi_hwi_cmp_deferred[ sizeof ( _papi_hwd ) / sizeof ( *_papi_hwd ) ];
+
+/* The flag is checked without GLOBAL_LOCK. Clearing it is a release
+ * store, after init_component() and init_thread() are done, and every
+ * unlocked check an acquire load, so whoever sees it cleared also sees
+ * the component initialized.
+ */
+#define cmp_deferred( cidx ) \
+	__atomic_load_n( &_papi_hwi_cmp_deferred[cidx], __ATOMIC_ACQUIRE )
+#define set_cmp_deferred( cidx, value ) \
+	__atomic_store_n( &_papi_hwi_cmp_deferred[cidx], ( value ), __ATOMIC_RELEASE )
+
+/* Components that must always be initialized eagerly. perf_event and
+ * perf_event_uncore provide the presets, sysdetect already defers its
+ * own work until a PAPI_*_dev_* query arrives.
+ */
+static int
+is_lazy_candidate( int cidx )
+{
+	const char *name = _papi_hwd[cidx]->cmp_info.name;
+
+	if ( strcmp( name, "perf_event" ) == 0 ) return 0;
+	if ( strcmp( name, "perf_event_uncore" ) == 0 ) return 0;
+	if ( strcmp( name, "sysdetect" ) == 0 ) return 0;
+	return 1;
+}
+
+static void
+defer_component( int cidx )
+{
+	set_cmp_deferred( cidx, 1 );
+	_papi_hwd[cidx]->cmp_info.disabled = PAPI_ECMP_DISABLED;
+	strncpy( _papi_hwd[cidx]->cmp_info.disabled_reason,
+		 "Initialization deferred until first use (PAPI_LAZY_INIT)",
+		 PAPI_MAX_STR_LEN - 1 );
+	INTDBG( "Deferred initialization of component %d (%s)\n",
+		cidx, _papi_hwd[cidx]->cmp_info.name );
+}
+
+/* Returns non-zero if the component still waits for its deferred
+ * init_component() call.
+ */
+int
+_papi_hwi_component_deferred( int cidx )
+{
+	return cmp_deferred( cidx );
+}
+
+/* Run the deferred init_component() of a component, then let the
+ * component set up the context of every thread already registered,
+ * which it missed while it was deferred. Safe to call for components
+ * which were never deferred.
+ */
+int
+_papi_hwi_init_component_deferred( int cidx )
+{
+	int retval = PAPI_OK;
+	ThreadInfo_t *thread;
+	papi_vector_t *cmp;
+
+	if ( !cmp_deferred( cidx ) )
+		return PAPI_OK;
+
+	_papi_hwi_lock( GLOBAL_LOCK );
+
+	/* Someone else may have won the race */
+	if ( !cmp_deferred( cidx ) ) {
+		_papi_hwi_unlock( GLOBAL_LOCK );
+		return PAPI_OK;
+	}
+
+	cmp = _papi_hwd[cidx];
+	cmp->cmp_info.disabled = 0;
+	cmp->cmp_info.disabled_reason[0] = '\0';
+
+	INTDBG( "Running deferred init of component %d (%s)\n",
+		cidx, cmp->cmp_info.name );
+	retval = cmp->init_component( cidx );
+
+	if ( !cmp->cmp_info.disabled ||
+	     cmp->cmp_info.disabled == PAPI_EDELAY_INIT ) {
+		_papi_hwi_lock( THREADS_LOCK );
+		thread = ( ThreadInfo_t * ) _papi_hwi_thread_head;
+		if ( thread ) {
+			do {
+				cmp->init_thread( thread->context[cidx] );
+				thread = thread->next;
+			} while ( thread != _papi_hwi_thread_head );
+		}
+		_papi_hwi_unlock( THREADS_LOCK );
+	}
+
+	set_cmp_deferred( cidx, 0 );
+
+	_papi_hwi_unlock( GLOBAL_LOCK );
+
+	return retval;
+}
+
+/* Initialize every component still deferred. Returns how many were. */
+int
+_papi_hwi_init_deferred_components( void )
+{
+	int cidx, count = 0;
+
+	for ( cidx = 0; cidx < papi_num_components; cidx++ ) {
+		if ( cmp_deferred( cidx ) ) {
+			_papi_hwi_init_component_deferred( cidx );
+			count++;
+		}
+	}
+	return count;
+}
+
+/* Called by PAPI_shutdown() so a later PAPI_library_init() starts from
+ * a clean state. Deferred components never ran init_component(), so
+ * there is nothing to shut down, only the placeholder state to undo.
+ */
+void
+_papi_hwi_shutdown_deferred_components( void )
+{
+	int cidx;
+
+	for ( cidx = 0; cidx < papi_num_components; cidx++ ) {
+		if ( cmp_deferred( cidx ) ) {
+			_papi_hwd[cidx]->cmp_info.disabled = 0;
+			_papi_hwd[cidx]->cmp_info.disabled_reason[0] = '\0';
+			set_cmp_deferred( cidx, 0 );
+		}
+	}
+}
+
 /*
  * Routine that initializes all available components.
  * A component is available if a pointer to its info vector
  * appears in the NULL terminated_papi_hwd table.
  * Modified to accept an arg: 0=do not init perf_event or 
  * perf_event_uncore. 1=init ONLY perf_event or perf_event_uncore.
+ * If PAPI_LAZY_INIT is set in the environment, the init_component()
+ * of the other components is deferred until they are first used.
  */
 int
 _papi_hwi_init_global( int PE_OR_PEU )
 {
         int retval, is_pe_peu, i = 0;
+        int lazy_init = ( getenv( "PAPI_LAZY_INIT" ) != NULL );
 
 	retval = _papi_hwi_innoculate_os_vector( &_papi_os_vector );
 	if ( retval != PAPI_OK ) {
@@ -1955,6 +2113,12 @@ _papi_hwi_init_global( int PE_OR_PEU )
 
 	   /* We can be disabled by user before init */
 	   if (!_papi_hwd[i]->cmp_info.disabled && (PE_OR_PEU == is_pe_peu)) {
+	      if ( lazy_init && is_lazy_candidate( i ) ) {
+	         defer_component( i );
+	         i++;
+	         continue;
+	      }
+
 	      retval = _papi_hwd[i]->init_component( i );
 
 	      /* Do some sanity checking */
@@ -2487,6 +2651,13 @@ _papi_hwi_native_name_to_code( const char *in, int *out )
 	// look in each component
 	for(cidx=0; cidx < papi_num_components; cidx++) {
 
+		// a deferred component is only woken up by a name carrying its prefix
+		if (_papi_hwi_component_deferred(cidx) &&
+		    strstr(full_event_name, ":::") != NULL &&
+		    is_supported_by_component(cidx, full_event_name)) {
+			_papi_hwi_init_component_deferred(cidx);
+		}
+
 		if (_papi_hwd[cidx]->cmp_info.disabled &&
             _papi_hwd[cidx]->cmp_info.disabled != PAPI_EDELAY_INIT)
             continue;
@@ -2557,6 +2728,13 @@ _papi_hwi_native_name_to_code( const char *in, int *out )
 		}
 	}
 
+	// an unqualified name may belong to a component still deferred,
+	// wake them all up and look again
+	if (strstr(full_event_name, ":::") == NULL &&
+	    _papi_hwi_init_deferred_components() > 0) {
+		retval = _papi_hwi_native_name_to_code(full_event_name, out);
+	}
+
 	free (full_event_name);
 	INTDBG("EXIT: retval: %d\n", retval);
 
@@ -136,6 +136,7 @@ typedef struct _EventSetOverflowInfo {
    int event_counter;
    PAPI_overflow_handler_t handler;
    long long *deadline;
+   long long *excess;    /**< How far past the deadline each event was at the last software overflow */
    int *threshold;
    int *EventIndex;
    int *EventCode;
@@ -161,6 +162,7 @@ typedef struct _EventSetProfileInfo {
    int *threshold;
    int *EventIndex;
    int *EventCode;
+   int *PosIndex;  /**< Profile index of each counter position, -1 if none; set at PAPI_start */
    int flags;
    int event_counter;
 } EventSetProfileInfo_t;
@@ -372,6 +374,24 @@ typedef struct _papi_int_inherit
 	int inherit;
 } _papi_int_inherit_t;
 
+/* Component control codes of PAPI_attach_tids(), PAPI_detach_tids() and
+   PAPI_read_tids(). They are not options of PAPI_set_opt(), so they are
+   kept clear of the option codes of papi.h. */
+#define PAPI_ATTACH_TIDS    1001    /**< Attach an eventset to many more tids */
+#define PAPI_DETACH_TIDS    1002    /**< Detach some of those tids */
+#define PAPI_READ_TIDS      1003    /**< Read those tids */
+
+/** @internal
+ *  PAPI_ATTACH_TIDS, PAPI_DETACH_TIDS and PAPI_READ_TIDS */
+typedef struct _papi_int_tids
+{
+	EventSetInfo_t *ESI;
+	int *tids;                   /**< in, or out for PAPI_READ_TIDS */
+	int num_tids;                /**< in, and out for PAPI_READ_TIDS */
+	int first;                   /**< PAPI_READ_TIDS: the first tid to read */
+	long long *counts;           /**< PAPI_READ_TIDS: num_tids rows of the component counters */
+} _papi_int_tids_t;
+
 /** @internal */
 typedef struct _papi_int_addr_range { /* if both are zero, range is disabled */
    EventSetInfo_t *ESI;
@@ -394,6 +414,7 @@ typedef union _papi_int_option_t {
 	_papi_int_inherit_t inherit;
 	_papi_int_granularity_t granularity;
 	_papi_int_addr_range_t address_range;
+	_papi_int_tids_t tids;
 } _papi_int_option_t;
 
 /** Hardware independent context
@@ -411,6 +432,8 @@ typedef struct _papi_mdi {
    PAPI_exe_info_t exe_info;    /**< See definition in papi.h */
    PAPI_shlib_info_t shlib_info;    /**< See definition in papi.h */
    PAPI_preload_info_t preload_info; /**< See definition in papi.h */
+   vptr_t heap_start, heap_end;     /**< Set with shlib_info where the OS vector knows them */
+   vptr_t stack_start, stack_end;   /**< Of the initial thread */
 } papi_mdi_t;
 
 extern papi_mdi_t _papi_hwi_system_info;
@@ -465,9 +488,15 @@ int _papi_hwi_add_event( EventSetInfo_t * ESI, int EventCode );
 int _papi_hwi_remove_event( EventSetInfo_t * ESI, int EventCode );
 int _papi_hwi_read( hwd_context_t * context, EventSetInfo_t * ESI,
 		    long long *values );
+void _papi_hwi_map_values( EventSetInfo_t * ESI, long long *dp,
+			   long long *values );
 int _papi_hwi_cleanup_eventset( EventSetInfo_t * ESI );
 int _papi_hwi_convert_eventset_to_multiplex( _papi_int_multiplex_t * mpx );
 int _papi_hwi_init_global( int PE_OR_PEU );
+int _papi_hwi_component_deferred( int cidx );
+int _papi_hwi_init_component_deferred( int cidx );
+int _papi_hwi_init_deferred_components( void );
+void _papi_hwi_shutdown_deferred_components( void );
 int _papi_hwi_init_global_internal( void );
 int _papi_hwi_init_os(void);
 void _papi_hwi_init_errors(void);
@@ -21,6 +21,8 @@ struct native_event_t {
   char *pmu_plus_name;
   int cpu;
   int users;
+  int agg;                /* PE_AGG_*, uncore events counted on every box */
+  int socket;             /* with agg, only this package; -1 for all      */
   perf_event_attr_t attr;
 };
 
@@ -28,12 +30,21 @@ struct native_event_t {
 #define PMU_TYPE_UNCORE 2
 #define PMU_TYPE_OS     4
 
+/* How the counts of an event fanned out over uncore boxes are combined */
+#define PE_AGG_NONE 0
+#define PE_AGG_SUM  1
+#define PE_AGG_MIN  2
+#define PE_AGG_MAX  3
+
+struct pe_event_cache;
+
 struct native_event_table_t {
    struct native_event_t *native_events;
    int num_native_events;
    int allocated_native_events;
    pfm_pmu_info_t default_pmu;
    int pmu_type;
+   struct pe_event_cache *cache;   /* mmap'ed event index, may be NULL */
 };
 
 
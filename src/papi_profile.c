@@ -0,0 +1,1363 @@
+/****************************/
+/* THIS IS OPEN SOURCE CODE */
+/****************************/
+
+/*
+* File:    papi_profile.c
+*
+* Decoding of the raw sample buffers recorded with PAPI_PROFIL_SAMPLES.
+*
+* The overflow handler only appends addresses (see samples_profil() in
+* extras.c). Everything expensive happens here, when the user asks for
+* the profile: the shared library map is refreshed, the ELF symbol table
+* of each object that was hit is mapped and sorted the first time one of
+* its addresses is looked up, and the stacks are written either folded,
+* for flamegraph tools, or as a pprof profile.proto.
+*
+* Buffers of PAPI_PROFIL_DATA_SRC samples are aggregated by the level of
+* the memory hierarchy that served each load, by data object and by
+* cache line. Data addresses are attributed to the object symbols of the
+* executable and libraries, or else to the mapping that contains them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "papi.h"
+#include "papi_internal.h"
+#include "papi_memory.h"
+#include "papi_profile.h"
+#include "papi_shlib.h"
+
+#if defined(__linux__)
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/perf_event.h>
+#define PROFILE_ELF 1
+
+#if ( __SIZEOF_POINTER__ == 8 )
+typedef Elf64_Ehdr profile_ehdr_t;
+typedef Elf64_Phdr profile_phdr_t;
+typedef Elf64_Shdr profile_shdr_t;
+typedef Elf64_Sym profile_sym_t;
+#define PROFILE_ELFCLASS ELFCLASS64
+#define PROFILE_ST_TYPE(i) ELF64_ST_TYPE(i)
+#else
+typedef Elf32_Ehdr profile_ehdr_t;
+typedef Elf32_Phdr profile_phdr_t;
+typedef Elf32_Shdr profile_shdr_t;
+typedef Elf32_Sym profile_sym_t;
+#define PROFILE_ELFCLASS ELFCLASS32
+#define PROFILE_ST_TYPE(i) ELF32_ST_TYPE(i)
+#endif
+#endif
+
+typedef struct
+{
+	unsigned long value;	/* link time address */
+	unsigned long size;
+	const char *name;		/* points into the mapped image */
+} profile_symbol_t;
+
+typedef struct
+{
+	char *path;
+	unsigned long start, end;	/* text in this process */
+	unsigned long bias;			/* run time minus link time address */
+	unsigned long file_offset;	/* of the text mapping */
+	int loaded;
+	void *image;
+	size_t image_size;
+	profile_symbol_t *symbols;
+	int num_symbols;
+	profile_symbol_t *objects;	/* data symbols */
+	int num_objects;
+	int mapping_id;				/* pprof, 0 until referenced */
+} profile_module_t;
+
+/* One distinct sampled address, as the sampled instruction (inner) */
+/* or as a return address                                           */
+typedef struct
+{
+	unsigned long long addr;
+	int inner;
+	int module;					/* -1 outside of any known object */
+	int name;					/* string id of its function */
+} profile_frame_t;
+
+/* Interned strings; id 0 is "" as pprof requires */
+typedef struct
+{
+	char **str;
+	char *is_function;
+	int num, max;
+	int *hash;					/* string id + 1, 0 is empty */
+	int hash_size;
+} profile_strings_t;
+
+typedef struct
+{
+	profile_module_t *modules;
+	int num_modules;
+	profile_frame_t *frames;
+	int num_frames, max_frames;
+	int *frame_hash;			/* frame index + 1, 0 is empty */
+	int frame_hash_size;
+	profile_strings_t strings;
+} profile_state_t;
+
+/* A growable byte buffer for the protobuf encoding */
+typedef struct
+{
+	unsigned char *data;
+	size_t len, max;
+	int failed;
+} profile_buf_t;
+
+int
+_papi_hwi_profile_init_samples( PAPI_sprofil_t * prof, int EventCode,
+								int threshold, int flags )
+{
+	unsigned long long *buf = ( unsigned long long * ) prof->pr_base;
+
+	buf[SMPL_MAGIC] = ( flags & PAPI_PROFIL_DATA_SRC ) ?
+		PAPI_PROFIL_MEMORY_MAGIC : PAPI_PROFIL_SAMPLES_MAGIC;
+	buf[SMPL_USED] = SMPL_HEADER;
+	buf[SMPL_LOST] = 0;
+	buf[SMPL_EVENT] = ( unsigned long long ) ( unsigned int ) EventCode;
+	buf[SMPL_PERIOD] = ( unsigned long long ) threshold;
+
+	return PAPI_OK;
+}
+
+static unsigned long
+profile_hash( const void *key, size_t len )
+{
+	const unsigned char *p = key;
+	unsigned long h = 14695981039346656037UL;
+	size_t i;
+
+	for ( i = 0; i < len; i++ ) {
+		h ^= p[i];
+		h *= 1099511628211UL;
+	}
+	return h;
+}
+
+/* A return address is resolved one byte lower than the same address */
+/* sampled as the instruction, so both are part of the key           */
+static unsigned long
+profile_frame_hash( unsigned long long addr, int inner )
+{
+	unsigned long long key[2] = { addr, ( unsigned long long ) ( inner != 0 ) };
+
+	return profile_hash( key, sizeof ( key ) );
+}
+
+/* Returns the id of s, adding it if needed, or -1 without memory */
+static int
+profile_intern( profile_state_t * st, const char *s, int is_function )
+{
+	profile_strings_t *t = &st->strings;
+	size_t len = strlen( s );
+	unsigned long h;
+	int i, id, *hash;
+
+	if ( 2 * ( t->num + 1 ) > t->hash_size ) {
+		int size = t->hash_size ? 2 * t->hash_size : 1024;
+
+		hash = papi_calloc( ( size_t ) size, sizeof ( int ) );
+		if ( hash == NULL )
+			return -1;
+		for ( id = 0; id < t->num; id++ ) {
+			h = profile_hash( t->str[id], strlen( t->str[id] ) );
+			for ( i = ( int ) ( h & ( unsigned long ) ( size - 1 ) ); hash[i];
+				  i = ( i + 1 ) & ( size - 1 ) );
+			hash[i] = id + 1;
+		}
+		if ( t->hash )
+			papi_free( t->hash );
+		t->hash = hash;
+		t->hash_size = size;
+	}
+
+	h = profile_hash( s, len );
+	for ( i = ( int ) ( h & ( unsigned long ) ( t->hash_size - 1 ) ); t->hash[i];
+		  i = ( i + 1 ) & ( t->hash_size - 1 ) ) {
+		id = t->hash[i] - 1;
+		if ( strcmp( t->str[id], s ) == 0 ) {
+			t->is_function[id] |= ( char ) is_function;
+			return id;
+		}
+	}
+
+	if ( t->num == t->max ) {
+		int max = t->max ? 2 * t->max : 512;
+		char **str = papi_realloc( t->str, ( size_t ) max * sizeof ( char * ) );
+		char *is_function_new;
+
+		if ( str == NULL )
+			return -1;
+		t->str = str;
+		is_function_new = papi_realloc( t->is_function, ( size_t ) max );
+		if ( is_function_new == NULL )
+			return -1;
+		t->is_function = is_function_new;
+		t->max = max;
+	}
+
+	t->str[t->num] = papi_strdup( s );
+	if ( t->str[t->num] == NULL )
+		return -1;
+	t->is_function[t->num] = ( char ) is_function;
+	t->hash[i] = t->num + 1;
+
+	return t->num++;
+}
+
+/* Bring the shared library map up to date for the sampled addresses and */
+/* make room for one module per object: the executable, then the map.    */
+/* The map must not change until the addresses are resolved, the caller  */
+/* holds INTERNAL_LOCK.                                                  */
+static int
+profile_modules( profile_state_t * st, const unsigned long long *words,
+				 unsigned long long used )
+{
+	unsigned long long pos, depth, i;
+	int retval;
+
+	/* Applies the mmaps seen since PAPI_library_init(), if any. An    */
+	/* address outside of every object asks for a rebuild from the OS. */
+	retval = _papi_hwi_update_shlib_info_locked( 0 );
+	for ( pos = SMPL_HEADER; ( retval == PAPI_OK ) && ( pos < used );
+		  pos += 1 + depth ) {
+		depth = words[pos];
+		for ( i = 0; ( i < depth ) && ( pos + 1 + i < used ); i++ ) {
+			if ( _papi_hwi_lookup_shlib( ( vptr_t ) ( unsigned long )
+										 words[pos + 1 + i] ) == NULL ) {
+				retval = _papi_hwi_update_shlib_info_locked( 1 );
+				pos = used;
+				break;
+			}
+		}
+	}
+	if ( retval != PAPI_OK )
+		return retval;
+
+	st->num_modules = _papi_hwi_system_info.shlib_info.count + 1;
+	st->modules = papi_calloc( ( size_t ) st->num_modules,
+							   sizeof ( profile_module_t ) );
+	if ( st->modules == NULL )
+		return PAPI_ENOMEM;
+
+	return PAPI_OK;
+}
+
+static int
+profile_symbol_compare( const void *a, const void *b )
+{
+	const profile_symbol_t *sa = a, *sb = b;
+
+	if ( sa->value != sb->value )
+		return sa->value < sb->value ? -1 : 1;
+	/* Lookups take the last of the aliases, make it the sized one */
+	if ( sa->size != sb->size )
+		return sa->size < sb->size ? -1 : 1;
+	return 0;
+}
+
+/* Map the object of m and sort its function and data symbols, .symtab  */
+/* if it was not stripped and .dynsym otherwise. Failures leave m       */
+/* without symbols.                                                     */
+static void
+profile_load_module( profile_module_t * m )
+{
+#ifdef PROFILE_ELF
+	const profile_ehdr_t *ehdr;
+	const profile_phdr_t *phdr;
+	const profile_shdr_t *shdr, *symtab = NULL, *strtab;
+	const profile_sym_t *syms;
+	const char *image, *strings;
+	unsigned long pagemask = ~( ( unsigned long ) getpagesize(  ) - 1 );
+	struct stat sb;
+	size_t i, nsyms;
+	int fd, n, o;
+
+	m->loaded = 1;
+
+	fd = open( m->path, O_RDONLY | O_CLOEXEC );
+	if ( fd < 0 )
+		return;
+	if ( ( fstat( fd, &sb ) < 0 ) ||
+		 ( ( size_t ) sb.st_size < sizeof ( profile_ehdr_t ) ) ) {
+		close( fd );
+		return;
+	}
+	m->image = mmap( NULL, ( size_t ) sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( m->image == MAP_FAILED ) {
+		m->image = NULL;
+		return;
+	}
+	m->image_size = ( size_t ) sb.st_size;
+	image = m->image;
+	ehdr = m->image;
+
+	if ( ( memcmp( ehdr->e_ident, ELFMAG, SELFMAG ) != 0 ) ||
+		 ( ehdr->e_ident[EI_CLASS] != PROFILE_ELFCLASS ) ||
+		 ( ehdr->e_phoff + ( size_t ) ehdr->e_phnum * sizeof ( *phdr ) >
+		   m->image_size ) ||
+		 ( ehdr->e_shoff + ( size_t ) ehdr->e_shnum * sizeof ( *shdr ) >
+		   m->image_size ) ) {
+		PRFDBG( "%s is not a native ELF object\n", m->path );
+		return;
+	}
+
+	/* The executable segment is what the map recorded as text */
+	phdr = ( const profile_phdr_t * ) ( image + ehdr->e_phoff );
+	for ( i = 0; i < ehdr->e_phnum; i++ ) {
+		if ( ( phdr[i].p_type == PT_LOAD ) && ( phdr[i].p_flags & PF_X ) ) {
+			m->bias = m->start - ( ( unsigned long ) phdr[i].p_vaddr & pagemask );
+			m->file_offset = ( unsigned long ) phdr[i].p_offset & pagemask;
+			break;
+		}
+	}
+
+	shdr = ( const profile_shdr_t * ) ( image + ehdr->e_shoff );
+	for ( i = 0; i < ehdr->e_shnum; i++ ) {
+		if ( shdr[i].sh_type == SHT_SYMTAB ) {
+			symtab = &shdr[i];
+			break;
+		}
+		if ( shdr[i].sh_type == SHT_DYNSYM )
+			symtab = &shdr[i];
+	}
+	if ( ( symtab == NULL ) || ( symtab->sh_link >= ehdr->e_shnum ) )
+		return;
+	strtab = &shdr[symtab->sh_link];
+	if ( ( symtab->sh_offset + symtab->sh_size > m->image_size ) ||
+		 ( strtab->sh_offset + strtab->sh_size > m->image_size ) ||
+		 ( strtab->sh_size == 0 ) )
+		return;
+
+	syms = ( const profile_sym_t * ) ( image + symtab->sh_offset );
+	strings = image + strtab->sh_offset;
+	nsyms = symtab->sh_size / sizeof ( *syms );
+
+	m->symbols = papi_malloc( ( nsyms + 1 ) * sizeof ( profile_symbol_t ) );
+	m->objects = papi_malloc( ( nsyms + 1 ) * sizeof ( profile_symbol_t ) );
+	if ( ( m->symbols == NULL ) || ( m->objects == NULL ) )
+		return;
+
+	for ( i = 0, n = 0, o = 0; i < nsyms; i++ ) {
+		profile_symbol_t *sym;
+
+		if ( PROFILE_ST_TYPE( syms[i].st_info ) == STT_FUNC )
+			sym = &m->symbols[n];
+		else if ( PROFILE_ST_TYPE( syms[i].st_info ) == STT_OBJECT )
+			sym = &m->objects[o];
+		else
+			continue;
+		if ( ( syms[i].st_shndx == SHN_UNDEF ) || ( syms[i].st_value == 0 ) ||
+			 ( syms[i].st_name >= strtab->sh_size ) )
+			continue;
+		/* The string table must be terminated for the names to be safe */
+		if ( memchr( strings + syms[i].st_name, '\0',
+					 strtab->sh_size - syms[i].st_name ) == NULL )
+			continue;
+		sym->value = ( unsigned long ) syms[i].st_value;
+		sym->size = ( unsigned long ) syms[i].st_size;
+		sym->name = strings + syms[i].st_name;
+		if ( sym == &m->symbols[n] )
+			n++;
+		else
+			o++;
+	}
+	qsort( m->symbols, ( size_t ) n, sizeof ( profile_symbol_t ),
+		   profile_symbol_compare );
+	m->num_symbols = n;
+	qsort( m->objects, ( size_t ) o, sizeof ( profile_symbol_t ),
+		   profile_symbol_compare );
+	m->num_objects = o;
+
+	PRFDBG( "%s: %d functions, %d objects, bias %#lx\n", m->path, n, o,
+			m->bias );
+#else
+	m->loaded = 1;
+#endif
+}
+
+/* The symbol of syms containing addr. Unsized functions, usually hand */
+/* written assembly, extend to the next one; unsized data does not.    */
+static const char *
+profile_lookup_symbol( const profile_symbol_t * syms, int num,
+					   unsigned long addr, int sized )
+{
+	int lo = 0, hi = num - 1, mid;
+	const profile_symbol_t *s;
+
+	/* last symbol at or below addr */
+	while ( lo <= hi ) {
+		mid = ( lo + hi ) / 2;
+		if ( syms[mid].value <= addr )
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	if ( hi < 0 )
+		return NULL;
+
+	s = &syms[hi];
+	if ( ( ( s->size != 0 ) || sized ) && ( addr >= s->value + s->size ) )
+		return NULL;
+
+	return s->name;
+}
+
+/* The module of an entry of the shared library map, or of the  */
+/* executable, set up the first time it is used; -1 for NULL    */
+static int
+profile_module( profile_state_t * st, const PAPI_address_map_t * obj )
+{
+	profile_module_t *mod;
+	int m;
+
+	if ( obj == NULL )
+		return -1;
+	if ( obj == &_papi_hwi_system_info.exe_info.address_info )
+		m = 0;
+	else
+		m = ( int ) ( obj - _papi_hwi_system_info.shlib_info.map ) + 1;
+
+	mod = &st->modules[m];
+	if ( mod->path == NULL ) {
+		/* the output is written after the map may have changed */
+		mod->path = papi_strdup( m ? obj->name :
+								 _papi_hwi_system_info.exe_info.fullname );
+		if ( mod->path == NULL )
+			return -1;
+		mod->start = ( unsigned long ) obj->text_start;
+		mod->end = ( unsigned long ) obj->text_end;
+	}
+	if ( !mod->loaded )
+		profile_load_module( mod );
+
+	return m;
+}
+
+/* Returns the index of the frame for addr. Callers are return addresses, */
+/* which may already belong to the next function, hence the inner flag.   */
+static int
+profile_frame( profile_state_t * st, unsigned long long addr, int inner )
+{
+	char name[PAPI_HUGE_STR_LEN + 32];
+	const char *sym = NULL, *base;
+	unsigned long long lookup = inner ? addr : addr - 1;
+	profile_frame_t *f;
+	unsigned long h;
+	int i, m, *hash;
+
+	if ( 2 * ( st->num_frames + 1 ) > st->frame_hash_size ) {
+		int size = st->frame_hash_size ? 2 * st->frame_hash_size : 4096;
+
+		hash = papi_calloc( ( size_t ) size, sizeof ( int ) );
+		if ( hash == NULL )
+			return -1;
+		for ( m = 0; m < st->num_frames; m++ ) {
+			h = profile_frame_hash( st->frames[m].addr, st->frames[m].inner );
+			for ( i = ( int ) ( h & ( unsigned long ) ( size - 1 ) ); hash[i];
+				  i = ( i + 1 ) & ( size - 1 ) );
+			hash[i] = m + 1;
+		}
+		if ( st->frame_hash )
+			papi_free( st->frame_hash );
+		st->frame_hash = hash;
+		st->frame_hash_size = size;
+	}
+
+	inner = ( inner != 0 );
+	h = profile_frame_hash( addr, inner );
+	for ( i = ( int ) ( h & ( unsigned long ) ( st->frame_hash_size - 1 ) );
+		  st->frame_hash[i]; i = ( i + 1 ) & ( st->frame_hash_size - 1 ) ) {
+		f = &st->frames[st->frame_hash[i] - 1];
+		if ( ( f->addr == addr ) && ( f->inner == inner ) )
+			return st->frame_hash[i] - 1;
+	}
+
+	if ( st->num_frames == st->max_frames ) {
+		int max = st->max_frames ? 2 * st->max_frames : 1024;
+		profile_frame_t *frames = papi_realloc( st->frames,
+												( size_t ) max *
+												sizeof ( profile_frame_t ) );
+		if ( frames == NULL )
+			return -1;
+		st->frames = frames;
+		st->max_frames = max;
+	}
+
+	f = &st->frames[st->num_frames];
+	f->addr = addr;
+	f->inner = inner;
+	f->module = profile_module( st, _papi_hwi_lookup_shlib( ( vptr_t )
+														  ( unsigned long )
+														  lookup ) );
+
+	if ( f->module >= 0 ) {
+		profile_module_t *mod = &st->modules[f->module];
+
+		sym = profile_lookup_symbol( mod->symbols, mod->num_symbols,
+									 ( unsigned long ) lookup - mod->bias, 0 );
+		if ( sym == NULL ) {
+			base = strrchr( mod->path, '/' );
+			snprintf( name, sizeof ( name ), "%s+%#lx",
+					  base ? base + 1 : mod->path,
+					  ( unsigned long ) lookup - mod->bias );
+			sym = name;
+		}
+	} else {
+		snprintf( name, sizeof ( name ), "%#llx", addr );
+		sym = name;
+	}
+
+	f->name = profile_intern( st, sym, 1 );
+	if ( f->name < 0 )
+		return -1;
+
+	st->frame_hash[i] = st->num_frames + 1;
+	return st->num_frames++;
+}
+
+static void
+profile_cleanup( profile_state_t * st )
+{
+	int i;
+
+	for ( i = 0; i < st->num_modules; i++ ) {
+		if ( st->modules[i].path )
+			papi_free( st->modules[i].path );
+		if ( st->modules[i].symbols )
+			papi_free( st->modules[i].symbols );
+		if ( st->modules[i].objects )
+			papi_free( st->modules[i].objects );
+#ifdef PROFILE_ELF
+		if ( st->modules[i].image )
+			munmap( st->modules[i].image, st->modules[i].image_size );
+#endif
+	}
+	if ( st->modules )
+		papi_free( st->modules );
+	if ( st->frames )
+		papi_free( st->frames );
+	if ( st->frame_hash )
+		papi_free( st->frame_hash );
+	for ( i = 0; i < st->strings.num; i++ )
+		papi_free( st->strings.str[i] );
+	if ( st->strings.str )
+		papi_free( st->strings.str );
+	if ( st->strings.is_function )
+		papi_free( st->strings.is_function );
+	if ( st->strings.hash )
+		papi_free( st->strings.hash );
+}
+
+/* Replace every address of the buffer by its frame index, so that both */
+/* writers only deal with small integers.                               */
+static int
+profile_resolve( profile_state_t * st, unsigned long long *words,
+				 unsigned long long used )
+{
+	unsigned long long pos, depth, i;
+	int frame;
+
+	for ( pos = SMPL_HEADER; pos < used; pos += 1 + depth ) {
+		depth = words[pos];
+		if ( pos + 1 + depth > used )
+			return PAPI_EINVAL;
+		for ( i = 0; i < depth; i++ ) {
+			frame = profile_frame( st, words[pos + 1 + i], i == 0 );
+			if ( frame < 0 )
+				return PAPI_ENOMEM;
+			words[pos + 1 + i] = ( unsigned long long ) frame;
+		}
+	}
+	return PAPI_OK;
+}
+
+/* Folded stacks */
+
+typedef struct
+{
+	const unsigned long long *frames;	/* innermost first */
+	unsigned long long depth;
+} profile_stack_t;
+
+static int
+profile_stack_compare( const void *a, const void *b )
+{
+	const profile_stack_t *sa = a, *sb = b;
+	unsigned long long i;
+
+	for ( i = 0; i < sa->depth && i < sb->depth; i++ ) {
+		if ( sa->frames[sa->depth - 1 - i] != sb->frames[sb->depth - 1 - i] )
+			return sa->frames[sa->depth - 1 - i] <
+				sb->frames[sb->depth - 1 - i] ? -1 : 1;
+	}
+	if ( sa->depth != sb->depth )
+		return sa->depth < sb->depth ? -1 : 1;
+	return 0;
+}
+
+/* Stacks are merged by function, so frames become function name ids */
+static int
+profile_write_folded( profile_state_t * st, unsigned long long *words,
+					  unsigned long long used, FILE * fp )
+{
+	profile_stack_t *stacks;
+	unsigned long long pos, count, i;
+	int n = 0, j, k;
+
+	for ( pos = SMPL_HEADER; pos < used; pos += 1 + words[pos] ) {
+		for ( i = 0; i < words[pos]; i++ )
+			words[pos + 1 + i] =
+				( unsigned long long ) st->frames[words[pos + 1 + i]].name;
+		n++;
+	}
+
+	stacks = papi_malloc( ( size_t ) ( n ? n : 1 ) * sizeof ( profile_stack_t ) );
+	if ( stacks == NULL )
+		return PAPI_ENOMEM;
+
+	for ( pos = SMPL_HEADER, j = 0; pos < used; pos += 1 + words[pos], j++ ) {
+		stacks[j].frames = &words[pos + 1];
+		stacks[j].depth = words[pos];
+	}
+	qsort( stacks, ( size_t ) n, sizeof ( profile_stack_t ),
+		   profile_stack_compare );
+
+	for ( j = 0; j < n; j = k ) {
+		for ( k = j + 1;
+			  k < n && profile_stack_compare( &stacks[j], &stacks[k] ) == 0;
+			  k++ );
+		count = ( unsigned long long ) ( k - j );
+		for ( i = stacks[j].depth; i > 0; i-- ) {
+			fprintf( fp, "%s%s", i == stacks[j].depth ? "" : ";",
+					 st->strings.str[stacks[j].frames[i - 1]] );
+		}
+		fprintf( fp, " %llu\n", count );
+	}
+
+	if ( words[SMPL_LOST] )
+		fprintf( fp, "[lost] %llu\n", words[SMPL_LOST] );
+
+	papi_free( stacks );
+	return PAPI_OK;
+}
+
+/* pprof profile.proto, see github.com/google/pprof/proto/profile.proto */
+
+static void
+pb_bytes( profile_buf_t * b, const void *data, size_t len )
+{
+	if ( b->failed )
+		return;
+	if ( b->len + len > b->max ) {
+		size_t max = b->max ? 2 * b->max : 4096;
+		unsigned char *p;
+
+		while ( max < b->len + len )
+			max *= 2;
+		p = papi_realloc( b->data, max );
+		if ( p == NULL ) {
+			b->failed = 1;
+			return;
+		}
+		b->data = p;
+		b->max = max;
+	}
+	memcpy( b->data + b->len, data, len );
+	b->len += len;
+}
+
+static void
+pb_varint( profile_buf_t * b, unsigned long long v )
+{
+	unsigned char out[10];
+	size_t n = 0;
+
+	do {
+		out[n] = ( unsigned char ) ( v & 0x7f );
+		v >>= 7;
+		if ( v )
+			out[n] |= 0x80;
+		n++;
+	} while ( v );
+	pb_bytes( b, out, n );
+}
+
+static void
+pb_uint( profile_buf_t * b, int field, unsigned long long v )
+{
+	pb_varint( b, ( unsigned long long ) ( field << 3 ) );
+	pb_varint( b, v );
+}
+
+static void
+pb_string( profile_buf_t * b, int field, const char *s )
+{
+	size_t len = strlen( s );
+
+	pb_varint( b, ( unsigned long long ) ( field << 3 | 2 ) );
+	pb_varint( b, len );
+	pb_bytes( b, s, len );
+}
+
+/* Append sub as an embedded message, then empty it for reuse */
+static void
+pb_message( profile_buf_t * b, int field, profile_buf_t * sub )
+{
+	pb_varint( b, ( unsigned long long ) ( field << 3 | 2 ) );
+	pb_varint( b, sub->len );
+	pb_bytes( b, sub->data, sub->len );
+	if ( sub->failed )
+		b->failed = 1;
+	sub->len = 0;
+}
+
+static void
+pb_value_type( profile_buf_t * b, profile_buf_t * sub, int field, int type,
+			   int unit )
+{
+	pb_uint( sub, 1, ( unsigned long long ) type );
+	pb_uint( sub, 2, ( unsigned long long ) unit );
+	pb_message( b, field, sub );
+}
+
+static int
+profile_write_pprof( profile_state_t * st, const unsigned long long *words,
+					 unsigned long long used, FILE * fp )
+{
+	profile_buf_t b, sub, packed;
+	char event[PAPI_MAX_STR_LEN];
+	unsigned long long pos, i;
+	int samples_id, count_id, event_id, j, retval = PAPI_OK;
+
+	memset( &b, 0, sizeof ( b ) );
+	memset( &sub, 0, sizeof ( sub ) );
+	memset( &packed, 0, sizeof ( packed ) );
+
+	if ( PAPI_event_code_to_name( ( int ) words[SMPL_EVENT], event ) != PAPI_OK )
+		strcpy( event, "events" );
+	samples_id = profile_intern( st, "samples", 0 );
+	count_id = profile_intern( st, "count", 0 );
+	event_id = profile_intern( st, event, 0 );
+	if ( ( samples_id < 0 ) || ( count_id < 0 ) || ( event_id < 0 ) )
+		return PAPI_ENOMEM;
+
+	/* sample_type: one sample, and the events it stands for */
+	pb_value_type( &b, &sub, 1, samples_id, count_id );
+	pb_value_type( &b, &sub, 1, event_id, count_id );
+
+	for ( pos = SMPL_HEADER; pos < used; pos += 1 + words[pos] ) {
+		for ( i = 0; i < words[pos]; i++ )
+			pb_varint( &packed, words[pos + 1 + i] + 1 );
+		pb_message( &sub, 1, &packed );
+		pb_varint( &packed, 1 );
+		pb_varint( &packed, words[SMPL_PERIOD] );
+		pb_message( &sub, 2, &packed );
+		pb_message( &b, 2, &sub );
+	}
+
+	for ( j = 0; j < st->num_frames; j++ ) {
+		profile_module_t *m;
+		int path_id;
+
+		if ( st->frames[j].module < 0 )
+			continue;
+		m = &st->modules[st->frames[j].module];
+		if ( m->mapping_id )
+			continue;
+		path_id = profile_intern( st, m->path, 0 );
+		if ( path_id < 0 )
+			b.failed = 1;
+		m->mapping_id = st->frames[j].module + 1;
+		pb_uint( &sub, 1, ( unsigned long long ) m->mapping_id );
+		pb_uint( &sub, 2, m->start );
+		pb_uint( &sub, 3, m->end );
+		pb_uint( &sub, 4, m->file_offset );
+		pb_uint( &sub, 5, ( unsigned long long ) path_id );
+		pb_uint( &sub, 7, m->num_symbols > 0 );
+		pb_message( &b, 3, &sub );
+	}
+
+	/* location ids are frame index + 1, function ids their name id */
+	for ( j = 0; j < st->num_frames; j++ ) {
+		pb_uint( &sub, 1, ( unsigned long long ) j + 1 );
+		if ( st->frames[j].module >= 0 )
+			pb_uint( &sub, 2,
+					 ( unsigned long long ) st->modules[st->frames[j].module].
+					 mapping_id );
+		pb_uint( &sub, 3, st->frames[j].addr );
+		pb_uint( &packed, 1, ( unsigned long long ) st->frames[j].name );
+		pb_message( &sub, 4, &packed );
+		pb_message( &b, 4, &sub );
+	}
+
+	for ( j = 0; j < st->strings.num; j++ ) {
+		if ( !st->strings.is_function[j] )
+			continue;
+		pb_uint( &sub, 1, ( unsigned long long ) j );
+		pb_uint( &sub, 2, ( unsigned long long ) j );
+		pb_uint( &sub, 3, ( unsigned long long ) j );
+		pb_message( &b, 5, &sub );
+	}
+
+	/* period_type and period, before the string table which they use */
+	pb_value_type( &b, &sub, 11, event_id, count_id );
+	pb_uint( &b, 12, words[SMPL_PERIOD] );
+
+	for ( j = 0; j < st->strings.num; j++ )
+		pb_string( &b, 6, st->strings.str[j] );
+
+	if ( b.failed || sub.failed || packed.failed )
+		retval = PAPI_ENOMEM;
+	else if ( fwrite( b.data, 1, b.len, fp ) != b.len )
+		retval = PAPI_ESYS;
+
+	if ( b.data )
+		papi_free( b.data );
+	if ( sub.data )
+		papi_free( sub.data );
+	if ( packed.data )
+		papi_free( packed.data );
+	return retval;
+}
+
+/* Memory profiles */
+
+#define PROFILE_LINE_SIZE 64
+
+static const char *profile_mem_levels[PAPI_MEMPROF_LEVELS] = {
+	"L1", "LFB", "L2", "L3", "Local RAM", "Remote RAM", "Remote cache",
+	"I/O", "Uncached", "Unknown"
+};
+
+typedef struct
+{
+	unsigned long long addr;
+	long long samples, weight;
+	long long level_samples[PAPI_MEMPROF_LEVELS];
+	int object;					/* string id */
+} profile_line_t;
+
+typedef struct
+{
+	PAPI_memprof_object_t *objects;
+	int num_objects, max_objects;
+	int *object_of;				/* object index + 1 by string id */
+	int object_of_size;
+	profile_line_t *lines;		/* open addressing on addr */
+	int num_lines, lines_size;
+} profile_memory_t;
+
+/* The level of a perf_mem_data_src, from the mem_lvl bits or, on */
+/* newer kernels that leave them NA, from mem_lvl_num              */
+static int
+profile_mem_level( unsigned long long src )
+{
+#ifdef PROFILE_ELF
+	unsigned long long lvl = src >> PERF_MEM_LVL_SHIFT;
+
+	if ( lvl & PERF_MEM_LVL_L1 )
+		return PAPI_MEMPROF_L1;
+	if ( lvl & PERF_MEM_LVL_LFB )
+		return PAPI_MEMPROF_LFB;
+	if ( lvl & PERF_MEM_LVL_L2 )
+		return PAPI_MEMPROF_L2;
+	if ( lvl & PERF_MEM_LVL_L3 )
+		return PAPI_MEMPROF_L3;
+	if ( lvl & PERF_MEM_LVL_LOC_RAM )
+		return PAPI_MEMPROF_LOCAL_RAM;
+	if ( lvl & ( PERF_MEM_LVL_REM_RAM1 | PERF_MEM_LVL_REM_RAM2 ) )
+		return PAPI_MEMPROF_REMOTE_RAM;
+	if ( lvl & ( PERF_MEM_LVL_REM_CCE1 | PERF_MEM_LVL_REM_CCE2 ) )
+		return PAPI_MEMPROF_REMOTE_CACHE;
+	if ( lvl & PERF_MEM_LVL_IO )
+		return PAPI_MEMPROF_IO;
+	if ( lvl & PERF_MEM_LVL_UNC )
+		return PAPI_MEMPROF_UNCACHED;
+
+#ifdef PERF_MEM_LVLNUM_SHIFT
+	switch ( ( src >> PERF_MEM_LVLNUM_SHIFT ) & 0xf ) {
+	case PERF_MEM_LVLNUM_L1:
+		return PAPI_MEMPROF_L1;
+	case PERF_MEM_LVLNUM_L2:
+		return PAPI_MEMPROF_L2;
+	case PERF_MEM_LVLNUM_L3:
+	case PERF_MEM_LVLNUM_L4:
+		return PAPI_MEMPROF_L3;
+	case PERF_MEM_LVLNUM_LFB:
+		return PAPI_MEMPROF_LFB;
+	case PERF_MEM_LVLNUM_RAM:
+		return ( ( src >> PERF_MEM_REMOTE_SHIFT ) & PERF_MEM_REMOTE_REMOTE ) ?
+			PAPI_MEMPROF_REMOTE_RAM : PAPI_MEMPROF_LOCAL_RAM;
+	}
+#endif
+#else
+	( void ) src;
+#endif
+	return PAPI_MEMPROF_UNKNOWN;
+}
+
+static int
+profile_mem_bucket( unsigned long long weight )
+{
+	int b = 0;
+
+	while ( ( weight >>= 1 ) && ( b < PAPI_MEMPROF_BUCKETS - 1 ) )
+		b++;
+	return b;
+}
+
+/* The string id naming the data object at addr, -1 without memory. */
+/* Addresses in an object of the shared library map are named by    */
+/* their symbol, or the object; the others by the mapping they are   */
+/* in, as far as the map knows it.                                   */
+static int
+profile_data_object( profile_state_t * st, unsigned long addr )
+{
+	papi_mdi_t *mdi = &_papi_hwi_system_info;
+	const PAPI_address_map_t *obj;
+	const char *sym, *base;
+	vptr_t heap_end;
+	int m;
+
+	if ( addr == 0 )
+		return profile_intern( st, "[unknown]", 0 );
+
+	obj = _papi_hwi_lookup_object( ( vptr_t ) addr );
+	m = profile_module( st, obj );
+	if ( m >= 0 ) {
+		profile_module_t *mod = &st->modules[m];
+
+		sym = profile_lookup_symbol( mod->objects, mod->num_objects,
+									 addr - mod->bias, 1 );
+		if ( sym )
+			return profile_intern( st, sym, 0 );
+		base = strrchr( mod->path, '/' );
+		return profile_intern( st, base ? base + 1 : mod->path, 0 );
+	}
+
+	if ( ( ( vptr_t ) addr >= mdi->stack_start ) &&
+		 ( ( vptr_t ) addr < mdi->stack_end ) )
+		return profile_intern( st, "[stack]", 0 );
+
+	/* the heap may have grown since the map was read */
+	heap_end = mdi->heap_end;
+#ifdef PROFILE_ELF
+	if ( mdi->heap_start && ( ( vptr_t ) sbrk( 0 ) > heap_end ) )
+		heap_end = ( vptr_t ) sbrk( 0 );
+#endif
+	if ( ( ( vptr_t ) addr >= mdi->heap_start ) && ( ( vptr_t ) addr < heap_end ) )
+		return profile_intern( st, "[heap]", 0 );
+
+	return profile_intern( st, "[anon]", 0 );
+}
+
+static PAPI_memprof_object_t *
+profile_mem_object( profile_state_t * st, profile_memory_t * mem, int id )
+{
+	PAPI_memprof_object_t *obj;
+	int *object_of;
+
+	if ( id >= mem->object_of_size ) {
+		int size = st->strings.max;
+
+		object_of = papi_realloc( mem->object_of, ( size_t ) size * sizeof ( int ) );
+		if ( object_of == NULL )
+			return NULL;
+		memset( object_of + mem->object_of_size, 0,
+				( size_t ) ( size - mem->object_of_size ) * sizeof ( int ) );
+		mem->object_of = object_of;
+		mem->object_of_size = size;
+	}
+	if ( mem->object_of[id] )
+		return &mem->objects[mem->object_of[id] - 1];
+
+	if ( mem->num_objects == mem->max_objects ) {
+		int max = mem->max_objects ? 2 * mem->max_objects : 64;
+
+		obj = papi_realloc( mem->objects,
+							( size_t ) max * sizeof ( PAPI_memprof_object_t ) );
+		if ( obj == NULL )
+			return NULL;
+		mem->objects = obj;
+		mem->max_objects = max;
+	}
+	obj = &mem->objects[mem->num_objects];
+	memset( obj, 0, sizeof ( *obj ) );
+	strncpy( obj->name, st->strings.str[id], sizeof ( obj->name ) - 1 );
+	mem->object_of[id] = ++mem->num_objects;
+
+	return obj;
+}
+
+static profile_line_t *
+profile_mem_line( profile_memory_t * mem, unsigned long long addr )
+{
+	profile_line_t *lines;
+	unsigned long h;
+	int i, j;
+
+	if ( 2 * ( mem->num_lines + 1 ) > mem->lines_size ) {
+		int size = mem->lines_size ? 2 * mem->lines_size : 4096;
+
+		lines = papi_calloc( ( size_t ) size, sizeof ( profile_line_t ) );
+		if ( lines == NULL )
+			return NULL;
+		for ( j = 0; j < mem->lines_size; j++ ) {
+			if ( mem->lines[j].samples == 0 )
+				continue;
+			h = profile_hash( &mem->lines[j].addr, sizeof ( addr ) );
+			for ( i = ( int ) ( h & ( unsigned long ) ( size - 1 ) );
+				  lines[i].samples; i = ( i + 1 ) & ( size - 1 ) );
+			lines[i] = mem->lines[j];
+		}
+		if ( mem->lines )
+			papi_free( mem->lines );
+		mem->lines = lines;
+		mem->lines_size = size;
+	}
+
+	h = profile_hash( &addr, sizeof ( addr ) );
+	for ( i = ( int ) ( h & ( unsigned long ) ( mem->lines_size - 1 ) );
+		  mem->lines[i].samples; i = ( i + 1 ) & ( mem->lines_size - 1 ) ) {
+		if ( mem->lines[i].addr == addr )
+			return &mem->lines[i];
+	}
+	mem->lines[i].addr = addr;
+	mem->num_lines++;
+	return &mem->lines[i];
+}
+
+static int
+profile_object_compare( const void *a, const void *b )
+{
+	const PAPI_memprof_object_t *oa = a, *ob = b;
+
+	if ( oa->weight != ob->weight )
+		return oa->weight > ob->weight ? -1 : 1;
+	if ( oa->samples != ob->samples )
+		return oa->samples > ob->samples ? -1 : 1;
+	return strcmp( oa->name, ob->name );
+}
+
+static int
+profile_line_compare( const void *a, const void *b )
+{
+	const profile_line_t *la = a, *lb = b;
+
+	if ( la->samples != lb->samples )
+		return la->samples > lb->samples ? -1 : 1;
+	if ( la->weight != lb->weight )
+		return la->weight > lb->weight ? -1 : 1;
+	if ( la->addr != lb->addr )
+		return la->addr < lb->addr ? -1 : 1;
+	return 0;
+}
+
+static int
+profile_memory_summary( profile_state_t * st, const unsigned long long *words,
+						unsigned long long used, PAPI_memprof_t * summary )
+{
+	profile_memory_t mem;
+	PAPI_memprof_object_t *obj;
+	profile_line_t *line;
+	const unsigned long long *r;
+	unsigned long long pos;
+	int retval, level, bucket, id, i, j, n;
+
+	memset( summary, 0, sizeof ( *summary ) );
+	memset( &mem, 0, sizeof ( mem ) );
+	summary->lost = ( long long ) words[SMPL_LOST];
+
+	retval = PAPI_OK;
+	for ( pos = SMPL_HEADER; ( retval == PAPI_OK ) && ( pos < used );
+		  pos += 1 + words[pos] ) {
+		if ( ( words[pos] != SMPL_MEM_WORDS ) || ( pos + 1 + words[pos] > used ) ) {
+			retval = PAPI_EINVAL;
+			break;
+		}
+		r = &words[pos + 1];
+		level = profile_mem_level( r[SMPL_MEM_SRC] );
+		bucket = profile_mem_bucket( r[SMPL_MEM_WEIGHT] );
+
+		summary->samples++;
+		summary->level_samples[level]++;
+		summary->level_weight[level] += ( long long ) r[SMPL_MEM_WEIGHT];
+		summary->latency[bucket]++;
+
+		id = profile_data_object( st, ( unsigned long ) r[SMPL_MEM_ADDR] );
+		obj = id < 0 ? NULL : profile_mem_object( st, &mem, id );
+		line = profile_mem_line( &mem, r[SMPL_MEM_ADDR] &
+								 ~( unsigned long long ) ( PROFILE_LINE_SIZE - 1 ) );
+		if ( ( obj == NULL ) || ( line == NULL ) ) {
+			retval = PAPI_ENOMEM;
+			break;
+		}
+		obj->samples++;
+		obj->weight += ( long long ) r[SMPL_MEM_WEIGHT];
+		obj->latency[bucket]++;
+		line->samples++;
+		line->weight += ( long long ) r[SMPL_MEM_WEIGHT];
+		line->level_samples[level]++;
+		line->object = id;
+	}
+
+	if ( retval == PAPI_OK ) {
+		qsort( mem.objects, ( size_t ) mem.num_objects,
+			   sizeof ( PAPI_memprof_object_t ), profile_object_compare );
+		n = mem.num_objects < PAPI_MEMPROF_TOP ? mem.num_objects :
+			PAPI_MEMPROF_TOP;
+		memcpy( summary->objects, mem.objects,
+				( size_t ) n * sizeof ( PAPI_memprof_object_t ) );
+		summary->num_objects = n;
+
+		/* Gather the used slots to the front of the table */
+		for ( i = 0, n = 0; i < mem.lines_size; i++ ) {
+			if ( mem.lines[i].samples )
+				mem.lines[n++] = mem.lines[i];
+		}
+		qsort( mem.lines, ( size_t ) n, sizeof ( profile_line_t ),
+			   profile_line_compare );
+		for ( i = 0; ( i < n ) && ( i < PAPI_MEMPROF_TOP ); i++ ) {
+			PAPI_memprof_line_t *l = &summary->lines[i];
+
+			l->addr = mem.lines[i].addr;
+			l->samples = mem.lines[i].samples;
+			l->weight = mem.lines[i].weight;
+			l->level = 0;
+			for ( j = 1; j < PAPI_MEMPROF_LEVELS; j++ ) {
+				if ( mem.lines[i].level_samples[j] >
+					 mem.lines[i].level_samples[l->level] )
+					l->level = j;
+			}
+			strncpy( l->object, st->strings.str[mem.lines[i].object],
+					 sizeof ( l->object ) - 1 );
+		}
+		summary->num_lines = i;
+	}
+
+	if ( mem.objects )
+		papi_free( mem.objects );
+	if ( mem.object_of )
+		papi_free( mem.object_of );
+	if ( mem.lines )
+		papi_free( mem.lines );
+	return retval;
+}
+
+static long long
+profile_average( long long weight, long long samples )
+{
+	return samples ? weight / samples : 0;
+}
+
+static int
+profile_write_memory( const unsigned long long *words,
+					  const PAPI_memprof_t * m, FILE * fp )
+{
+	char event[PAPI_MAX_STR_LEN];
+	int i;
+
+	if ( PAPI_event_code_to_name( ( int ) words[SMPL_EVENT], event ) != PAPI_OK )
+		snprintf( event, sizeof ( event ), "%#llx", words[SMPL_EVENT] );
+
+	fprintf( fp, "# PAPI memory profile of %s every %llu events\n", event,
+			 words[SMPL_PERIOD] );
+	fprintf( fp, "# %lld samples, %lld lost\n", m->samples, m->lost );
+
+	fprintf( fp, "\n# %-14s %12s %7s %12s\n", "Served by", "Samples", "%",
+			 "Avg latency" );
+	for ( i = 0; i < PAPI_MEMPROF_LEVELS; i++ ) {
+		if ( m->level_samples[i] == 0 )
+			continue;
+		fprintf( fp, "  %-14s %12lld %6.2f%% %12lld\n", profile_mem_levels[i],
+				 m->level_samples[i],
+				 100.0 * ( double ) m->level_samples[i] / ( double ) m->samples,
+				 profile_average( m->level_weight[i], m->level_samples[i] ) );
+	}
+
+	fprintf( fp, "\n# %-14s %12s\n", "Latency", "Samples" );
+	for ( i = 0; i < PAPI_MEMPROF_BUCKETS; i++ ) {
+		char range[32];
+
+		if ( i == PAPI_MEMPROF_BUCKETS - 1 )
+			snprintf( range, sizeof ( range ), "%lld-", 1LL << i );
+		else
+			snprintf( range, sizeof ( range ), "%lld-%lld", i ? 1LL << i : 0,
+					  ( 1LL << ( i + 1 ) ) - 1 );
+		fprintf( fp, "  %-14s %12lld\n", range, m->latency[i] );
+	}
+
+	fprintf( fp, "\n# %-30s %12s %14s %12s  %s\n", "Data object", "Samples",
+			 "Latency", "Avg latency", "Histogram" );
+	for ( i = 0; i < m->num_objects; i++ ) {
+		const PAPI_memprof_object_t *o = &m->objects[i];
+		int b;
+
+		fprintf( fp, "  %-30s %12lld %14lld %12lld ", o->name, o->samples,
+				 o->weight, profile_average( o->weight, o->samples ) );
+		for ( b = 0; b < PAPI_MEMPROF_BUCKETS; b++ )
+			fprintf( fp, " %lld", o->latency[b] );
+		fprintf( fp, "\n" );
+	}
+
+	fprintf( fp, "\n# %-18s %12s %14s %12s  %-14s %s\n", "Cache line",
+			 "Samples", "Latency", "Avg latency", "Served by", "Object" );
+	for ( i = 0; i < m->num_lines; i++ ) {
+		const PAPI_memprof_line_t *l = &m->lines[i];
+
+		fprintf( fp, "  %#-18llx %12lld %14lld %12lld  %-14s %s\n", l->addr,
+				 l->samples, l->weight, profile_average( l->weight, l->samples ),
+				 profile_mem_levels[l->level], l->object );
+	}
+
+	return PAPI_OK;
+}
+
+/* Checks the header of buf and returns a copy of its used part, the */
+/* buffer may still be filled by a running EventSet                  */
+static int
+profile_copy( const void *buf, unsigned bufsiz, unsigned long long magic,
+			  unsigned long long **words, unsigned long long *used )
+{
+	const unsigned long long *samples = buf;
+
+	if ( ( bufsiz < SMPL_HEADER * sizeof ( unsigned long long ) ) ||
+		 ( samples[SMPL_MAGIC] != magic ) )
+		return PAPI_EINVAL;
+	*used = samples[SMPL_USED];
+	if ( ( *used < SMPL_HEADER ) ||
+		 ( *used > bufsiz / sizeof ( unsigned long long ) ) )
+		return PAPI_EINVAL;
+
+	*words = papi_malloc( ( size_t ) *used * sizeof ( unsigned long long ) );
+	if ( *words == NULL )
+		return PAPI_ENOMEM;
+	memcpy( *words, samples, ( size_t ) *used * sizeof ( unsigned long long ) );
+	return PAPI_OK;
+}
+
+int
+_papi_hwi_profile_memory( const void *buf, unsigned bufsiz,
+						  PAPI_memprof_t * summary )
+{
+	unsigned long long used, *words;
+	profile_state_t st;
+	int retval;
+
+	retval = profile_copy( buf, bufsiz, PAPI_PROFIL_MEMORY_MAGIC, &words, &used );
+	if ( retval != PAPI_OK )
+		return retval;
+
+	memset( &st, 0, sizeof ( st ) );
+	retval = profile_intern( &st, "", 0 ) < 0 ? PAPI_ENOMEM : PAPI_OK;
+	_papi_hwi_lock( INTERNAL_LOCK );
+	if ( retval == PAPI_OK )
+		retval = profile_modules( &st, words, SMPL_HEADER );
+	if ( retval == PAPI_OK )
+		retval = profile_memory_summary( &st, words, used, summary );
+	_papi_hwi_unlock( INTERNAL_LOCK );
+
+	profile_cleanup( &st );
+	papi_free( words );
+	return retval;
+}
+
+int
+_papi_hwi_profile_write( const void *buf, unsigned bufsiz, const char *filename,
+						 int format )
+{
+	const unsigned long long *samples = buf;
+	unsigned long long used, pos, from, *words;
+	PAPI_memprof_t *summary = NULL;
+	profile_state_t st;
+	FILE *fp;
+	int retval, memory;
+
+	if ( ( format != PAPI_PROFIL_FORMAT_FOLDED ) &&
+		 ( format != PAPI_PROFIL_FORMAT_PPROF ) &&
+		 ( format != PAPI_PROFIL_FORMAT_MEMORY ) )
+		return PAPI_EINVAL;
+	if ( bufsiz < SMPL_HEADER * sizeof ( unsigned long long ) )
+		return PAPI_EINVAL;
+	memory = ( samples[SMPL_MAGIC] == PAPI_PROFIL_MEMORY_MAGIC );
+	if ( ( format == PAPI_PROFIL_FORMAT_MEMORY ) && !memory )
+		return PAPI_EINVAL;
+
+	retval = profile_copy( buf, bufsiz, memory ? PAPI_PROFIL_MEMORY_MAGIC :
+						   PAPI_PROFIL_SAMPLES_MAGIC, &words, &used );
+	if ( retval != PAPI_OK )
+		return retval;
+
+	/* Stacks of memory samples are just their instruction */
+	if ( memory && ( format != PAPI_PROFIL_FORMAT_MEMORY ) ) {
+		for ( pos = from = SMPL_HEADER; from < used; from += 1 + SMPL_MEM_WORDS ) {
+			if ( ( words[from] != SMPL_MEM_WORDS ) ||
+				 ( from + 1 + SMPL_MEM_WORDS > used ) )
+				break;
+			words[pos + 1] = words[from + 1 + SMPL_MEM_IP];
+			words[pos] = 1;
+			pos += 2;
+		}
+		used = pos;
+	}
+
+	memset( &st, 0, sizeof ( st ) );
+	retval = profile_intern( &st, "", 0 ) < 0 ? PAPI_ENOMEM : PAPI_OK;
+	_papi_hwi_lock( INTERNAL_LOCK );
+	if ( format == PAPI_PROFIL_FORMAT_MEMORY ) {
+		summary = papi_malloc( sizeof ( *summary ) );
+		if ( summary == NULL )
+			retval = PAPI_ENOMEM;
+		if ( retval == PAPI_OK )
+			retval = profile_modules( &st, words, SMPL_HEADER );
+		if ( retval == PAPI_OK )
+			retval = profile_memory_summary( &st, words, used, summary );
+	} else {
+		if ( retval == PAPI_OK )
+			retval = profile_modules( &st, words, used );
+		if ( retval == PAPI_OK )
+			retval = profile_resolve( &st, words, used );
+	}
+	_papi_hwi_unlock( INTERNAL_LOCK );
+
+	if ( retval == PAPI_OK ) {
+		fp = fopen( filename, format == PAPI_PROFIL_FORMAT_PPROF ? "wb" : "w" );
+		if ( fp == NULL ) {
+			retval = PAPI_ESYS;
+		} else {
+			if ( format == PAPI_PROFIL_FORMAT_FOLDED )
+				retval = profile_write_folded( &st, words, used, fp );
+			else if ( format == PAPI_PROFIL_FORMAT_PPROF )
+				retval = profile_write_pprof( &st, words, used, fp );
+			else
+				retval = profile_write_memory( words, summary, fp );
+			if ( ( fclose( fp ) != 0 ) && ( retval == PAPI_OK ) )
+				retval = PAPI_ESYS;
+		}
+	}
+
+	PRFDBG( "wrote %d distinct addresses to %s: %d\n", st.num_frames,
+			filename, retval );
+
+	if ( summary )
+		papi_free( summary );
+	profile_cleanup( &st );
+	papi_free( words );
+	return retval;
+}
@@ -0,0 +1,46 @@
+/** @file papi_profile.h
+ *
+ * Layout of the sample buffers filled with PAPI_PROFIL_SAMPLES.
+ *
+ * A sample buffer is the pr_base of a PAPI_sprofil_t, viewed as an
+ * array of unsigned long long. PAPI_sprofil() writes the header, the
+ * overflow handler appends one record per sample: the number of
+ * addresses followed by the addresses, innermost frame first.
+ *
+ * With PAPI_PROFIL_DATA_SRC the header has its own magic and every
+ * record is the same 4 words, in the order of SMPL_MEM_*.
+ */
+
+#ifndef PAPI_PROFILE_H
+#define PAPI_PROFILE_H
+
+#define PAPI_PROFIL_SAMPLES_MAGIC 0x4c504d5349504150ULL	/* "PAPISMPL" */
+#define PAPI_PROFIL_MEMORY_MAGIC  0x534d454d49504150ULL	/* "PAPIMEMS" */
+
+enum
+{
+	SMPL_MAGIC = 0,			/* PAPI_PROFIL_SAMPLES_MAGIC */
+	SMPL_USED,				/* words in use, header included */
+	SMPL_LOST,				/* samples dropped because the buffer was full */
+	SMPL_EVENT,				/* event code that was sampled */
+	SMPL_PERIOD,			/* sampling threshold */
+	SMPL_HEADER				/* first record */
+};
+
+enum
+{
+	SMPL_MEM_IP = 0,		/* instruction */
+	SMPL_MEM_ADDR,			/* data address */
+	SMPL_MEM_WEIGHT,		/* latency, usually in core cycles */
+	SMPL_MEM_SRC,			/* perf_mem_data_src */
+	SMPL_MEM_WORDS
+};
+
+int _papi_hwi_profile_init_samples( PAPI_sprofil_t * prof, int EventCode,
+									int threshold, int flags );
+int _papi_hwi_profile_write( const void *buf, unsigned bufsiz,
+							 const char *filename, int format );
+int _papi_hwi_profile_memory( const void *buf, unsigned bufsiz,
+							  PAPI_memprof_t * summary );
+
+#endif /* PAPI_PROFILE_H */
@@ -0,0 +1,175 @@
+/****************************/
+/* THIS IS OPEN SOURCE CODE */
+/****************************/
+
+/*
+* File:    papi_self.c
+*
+* Self-profiling of the library, see papi_self.h.
+*
+* Every thread gets its own block of probes the first time it records
+* one, so recording takes no lock and touches no shared cache line. The
+* block is mapped rather than allocated, as probes are also recorded in
+* signal handlers, and pushed on a list that is never shortened: the
+* calls of threads that have exited still count. Reporting sums the
+* blocks without stopping the threads, a call may show up in the count
+* before it shows up in the time.
+*
+* Without PAPI_SELF_PROFILING only the PAPI_get_opt() and PAPI_set_opt()
+* entry points are here, returning PAPI_ENOSUPP.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "papi.h"
+#include "papi_internal.h"
+#include "papi_vector.h"
+#include "papi_self.h"
+
+#ifdef PAPI_SELF_PROFILING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef struct
+{
+	long long count;
+	long long total_ns;
+	long long max_ns;
+	long long hist[PAPI_SELF_BUCKETS];
+} self_probe_t;
+
+typedef struct self_thread
+{
+	struct self_thread *next;
+	unsigned long tid;
+	self_probe_t probe[];
+} self_thread_t;
+
+#define X( name ) #name,
+static const char *api_names[] = { PAPI_SELF_API_PROBES };
+static const char *vec_names[] = { PAPI_SELF_VEC_PROBES };
+#undef X
+
+static self_thread_t *self_threads;
+static __thread self_thread_t *self_mine;
+
+static int
+num_probes( void )
+{
+	return PAPI_SELF_NUM_API + papi_num_components * PAPI_SELF_NUM_VEC;
+}
+
+static self_thread_t *
+self_thread( void )
+{
+	self_thread_t *t;
+
+	t = mmap( NULL, sizeof ( *t ) + num_probes(  ) * sizeof ( self_probe_t ),
+			  PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( t == MAP_FAILED )
+		return NULL;
+	t->tid = ( unsigned long ) syscall( SYS_gettid );
+	do {
+		t->next = __atomic_load_n( &self_threads, __ATOMIC_ACQUIRE );
+	} while ( !__atomic_compare_exchange_n( &self_threads, &t->next, t, 0,
+											__ATOMIC_RELEASE,
+											__ATOMIC_RELAXED ) );
+	return t;
+}
+
+void
+_papi_self_record( int probe, long long start )
+{
+	long long ns = _papi_self_now(  ) - start;
+	self_probe_t *p;
+	int bucket;
+
+	if ( self_mine == NULL ) {
+		self_mine = self_thread(  );
+		if ( self_mine == NULL )
+			return;
+	}
+
+	p = &self_mine->probe[probe];
+	p->count++;
+	p->total_ns += ns;
+	if ( ns > p->max_ns )
+		p->max_ns = ns;
+	bucket = ( ns > 0 ) ? 64 - __builtin_clzll( ( unsigned long long ) ns ) : 0;
+	p->hist[bucket < PAPI_SELF_BUCKETS ? bucket : PAPI_SELF_BUCKETS - 1]++;
+}
+
+int
+_papi_self_get( PAPI_self_profile_option_t * opt )
+{
+	unsigned long tid = ( unsigned long ) syscall( SYS_gettid );
+	self_thread_t *t;
+	PAPI_self_probe_t *out;
+	int i, b, n = 0;
+
+	if ( opt == NULL || opt->num_probes < 0 ||
+		 ( opt->num_probes > 0 && opt->probes == NULL ) )
+		return PAPI_EINVAL;
+
+	for ( i = 0; i < num_probes(  ) && n < opt->num_probes; i++ ) {
+		out = &opt->probes[n];
+		memset( out, 0, sizeof ( *out ) );
+		for ( t = __atomic_load_n( &self_threads, __ATOMIC_ACQUIRE ); t != NULL;
+			  t = t->next ) {
+			if ( opt->this_thread && t->tid != tid )
+				continue;
+			out->count += t->probe[i].count;
+			out->total_ns += t->probe[i].total_ns;
+			if ( t->probe[i].max_ns > out->max_ns )
+				out->max_ns = t->probe[i].max_ns;
+			for ( b = 0; b < PAPI_SELF_BUCKETS; b++ )
+				out->hist[b] += t->probe[i].hist[b];
+		}
+		if ( out->count == 0 )
+			continue;
+		if ( i < PAPI_SELF_NUM_API ) {
+			snprintf( out->name, sizeof ( out->name ), "%s", api_names[i] );
+		} else {
+			snprintf( out->name, sizeof ( out->name ), "%s:%s",
+					  _papi_hwd[( i - PAPI_SELF_NUM_API ) / PAPI_SELF_NUM_VEC]->
+					  cmp_info.name,
+					  vec_names[( i - PAPI_SELF_NUM_API ) % PAPI_SELF_NUM_VEC] );
+		}
+		n++;
+	}
+	opt->num_probes = n;
+
+	return PAPI_OK;
+}
+
+int
+_papi_self_reset( void )
+{
+	self_thread_t *t;
+
+	for ( t = __atomic_load_n( &self_threads, __ATOMIC_ACQUIRE ); t != NULL;
+		  t = t->next )
+		memset( t->probe, 0, num_probes(  ) * sizeof ( self_probe_t ) );
+
+	return PAPI_OK;
+}
+
+#else
+
+int
+_papi_self_get( PAPI_self_profile_option_t * opt )
+{
+	( void ) opt;
+	return PAPI_ENOSUPP;
+}
+
+int
+_papi_self_reset( void )
+{
+	return PAPI_ENOSUPP;
+}
+
+#endif
@@ -0,0 +1,121 @@
+/** @file papi_self.h
+ *
+ * Self-profiling of the library, built with --enable-self-profile
+ * (-DPAPI_SELF_PROFILING).
+ *
+ * Each probe keeps, per thread, the number of calls, their total and
+ * maximum time and a histogram of the log2 of their time in ns. There
+ * is a probe for the measurement entry points of the API, for a few
+ * internal paths and, for every component, for each vector call that
+ * the library times. PAPI_get_opt( PAPI_SELF_PROFILE, ... ) sums them
+ * over the threads.
+ *
+ * PAPI_SELF_SCOPE( probe ) at the top of a function times it up to any
+ * return, PAPI_SELF_TIME( probe, statement ) times one statement. In a
+ * build without PAPI_SELF_PROFILING both are empty.
+ */
+
+#ifndef PAPI_SELF_H
+#define PAPI_SELF_H
+
+/* Probes of the API and of internal paths, in the order they are reported */
+#define PAPI_SELF_API_PROBES \
+	X( PAPI_start ) \
+	X( PAPI_stop ) \
+	X( PAPI_read ) \
+	X( PAPI_read_ts ) \
+	X( PAPI_accum ) \
+	X( PAPI_reset ) \
+	X( PAPI_write ) \
+	X( PAPI_read_cpus ) \
+	X( PAPI_read_tids ) \
+	X( PAPI_add_event ) \
+	X( PAPI_add_named_event ) \
+	X( PAPI_remove_event ) \
+	X( PAPI_hl_region_begin ) \
+	X( PAPI_hl_read ) \
+	X( PAPI_hl_region_end ) \
+	X( _papi_hwi_read ) \
+	X( mpx_handler ) \
+	X( hl_store_counters )
+
+/* Component vector calls, probed for each component */
+#define PAPI_SELF_VEC_PROBES \
+	X( read ) \
+	X( start ) \
+	X( stop ) \
+	X( reset ) \
+	X( write ) \
+	X( update_control_state ) \
+	X( dispatch_timer )
+
+#define X( name ) PAPI_SELF_##name,
+enum
+{
+	PAPI_SELF_API_PROBES
+	PAPI_SELF_NUM_API
+};
+enum
+{
+	PAPI_SELF_VEC_PROBES
+	PAPI_SELF_NUM_VEC
+};
+#undef X
+
+/* The probe of vector call of component cidx */
+#define PAPI_SELF_VEC( cidx, call ) \
+	( PAPI_SELF_NUM_API + ( cidx ) * PAPI_SELF_NUM_VEC + PAPI_SELF_##call )
+
+int _papi_self_get( PAPI_self_profile_option_t * opt );
+int _papi_self_reset( void );
+
+#ifdef PAPI_SELF_PROFILING
+
+#include <time.h>
+
+typedef struct
+{
+	int probe;
+	long long start;
+} _papi_self_scope_t;
+
+static inline long long
+_papi_self_now( void )
+{
+	struct timespec t;
+
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return ( long long ) t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+void _papi_self_record( int probe, long long start );
+
+static inline void
+_papi_self_leave( _papi_self_scope_t * scope )
+{
+	_papi_self_record( scope->probe, scope->start );
+}
+
+#define PAPI_SELF_SCOPE( probe ) \
+	_papi_self_scope_t _papi_self_scope \
+		__attribute__ ( ( cleanup( _papi_self_leave ), unused ) ) = \
+		{ ( probe ), _papi_self_now(  ) }
+
+#define PAPI_SELF_TIME( probe, statement ) \
+	do { \
+		long long _papi_self_start = _papi_self_now(  ); \
+		statement; \
+		_papi_self_record( ( probe ), _papi_self_start ); \
+	} while ( 0 )
+
+#else
+
+/* a declaration, as the enabled one, that leaves nothing behind, */
+/* not even an unused variable warning                            */
+#define PAPI_SELF_SCOPE( probe ) \
+	extern int _papi_self_disabled __attribute__ ( ( unused ) )
+#define PAPI_SELF_TIME( probe, statement ) do { statement; } while ( 0 )
+
+#endif
+
+#endif
@@ -0,0 +1,307 @@
+/****************************/
+/* THIS IS OPEN SOURCE CODE */
+/****************************/
+
+/*
+* File:    papi_shlib.c
+*
+* The shared library map, _papi_hwi_system_info.shlib_info.
+*
+* The OS vector builds the map from scratch, on Linux by parsing all of
+* /proc/<pid>/maps. That is too slow to do whenever an address has to be
+* attributed in a process with tens of thousands of mappings, so the map
+* is kept sorted by text address and searched with a binary search, and
+* components that see the mmaps of the process (perf_event, through
+* PERF_RECORD_MMAP2, while a profiling event is open) queue them with
+* _papi_hwi_shlib_note_mmap(). The next non forced update inserts them
+* into the map instead of rebuilding it.
+*
+* Mappings learned this way have no data or bss ranges, and unmaps are
+* not seen: a forced update, as done by PAPI_get_opt(PAPI_SHLIBINFO),
+* rebuilds the map from the OS.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "papi.h"
+#include "papi_internal.h"
+#include "papi_vector.h"
+#include "papi_memory.h"
+#include "papi_shlib.h"
+
+/* mmaps queued from signal handlers, applied by the next update. A full */
+/* queue only means that the next update will rebuild the map.           */
+#define SHLIB_PENDING 32
+
+typedef struct
+{
+	int ready;					/* the slot is filled in */
+	vptr_t start, end;
+	char name[PAPI_HUGE_STR_LEN];
+} shlib_pending_t;
+
+static shlib_pending_t shlib_pending[SHLIB_PENDING];
+static int shlib_reserved = 0;	/* slots handed out, SHLIB_PENDING + 1 if */
+								/* some mmaps were dropped                */
+
+/* Entries allocated for shlib_info.map, when it was grown here */
+static PAPI_address_map_t *shlib_map = NULL;
+static int shlib_capacity = 0;
+
+/* Called in signal handlers: no locks, no allocation. The name may be */
+/* split in two by the end of a ring buffer, name2 then holds the rest. */
+void
+_papi_hwi_shlib_note_mmap( vptr_t start, vptr_t end, const char *name,
+						   size_t len, const char *name2, size_t len2 )
+{
+	shlib_pending_t *slot;
+	size_t i, j;
+	int n;
+
+	/* Saturates, so that the count cannot wrap between updates */
+	n = __atomic_load_n( &shlib_reserved, __ATOMIC_ACQUIRE );
+	do {
+		if ( n > SHLIB_PENDING )
+			return;
+	} while ( !__atomic_compare_exchange_n( &shlib_reserved, &n, n + 1, 0,
+											__ATOMIC_ACQ_REL,
+											__ATOMIC_ACQUIRE ) );
+	if ( n == SHLIB_PENDING )
+		return;
+
+	slot = &shlib_pending[n];
+	slot->start = start;
+	slot->end = end;
+	for ( i = 0; ( i < len ) && ( i < PAPI_HUGE_STR_LEN - 1 ) && name[i]; i++ )
+		slot->name[i] = name[i];
+	if ( i == len ) {
+		for ( j = 0; ( j < len2 ) && ( i < PAPI_HUGE_STR_LEN - 1 ) && name2[j];
+			  j++ )
+			slot->name[i++] = name2[j];
+	}
+	slot->name[i] = '\0';
+	__atomic_store_n( &slot->ready, 1, __ATOMIC_RELEASE );
+}
+
+static int
+shlib_compare( const void *a, const void *b )
+{
+	const PAPI_address_map_t *ma = a, *mb = b;
+
+	if ( ma->text_start != mb->text_start )
+		return ma->text_start < mb->text_start ? -1 : 1;
+	return 0;
+}
+
+/* Index of the first entry whose text ends after addr */
+static int
+shlib_search( const PAPI_shlib_info_t * shlib, vptr_t addr )
+{
+	int lo = 0, hi = shlib->count, mid;
+
+	while ( lo < hi ) {
+		mid = lo + ( hi - lo ) / 2;
+		if ( shlib->map[mid].text_end <= addr )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Put a new text mapping in place of the entries it overlaps */
+static int
+shlib_insert( PAPI_shlib_info_t * shlib, const shlib_pending_t * m )
+{
+	PAPI_address_map_t *exe = &_papi_hwi_system_info.exe_info.address_info;
+	PAPI_address_map_t *map;
+	int lo, hi, count;
+
+	if ( ( m->name[0] != '/' ) || ( m->start >= m->end ) )
+		return PAPI_OK;
+	if ( ( m->start < exe->text_end ) && ( m->end > exe->text_start ) )
+		return PAPI_OK;
+
+	lo = shlib_search( shlib, m->start );
+	for ( hi = lo; ( hi < shlib->count ) &&
+		  ( shlib->map[hi].text_start < m->end ); hi++ );
+
+	count = shlib->count - ( hi - lo ) + 1;
+	if ( ( shlib->map != shlib_map ) || ( count > shlib_capacity ) ) {
+		int max = count > 2 * shlib->count ? count : 2 * shlib->count;
+
+		if ( shlib->map == shlib_map ) {
+			map = papi_realloc( shlib->map,
+								( size_t ) max * sizeof ( PAPI_address_map_t ) );
+		} else {
+			/* The OS vector allocated it to size, get room to grow */
+			map = papi_malloc( ( size_t ) max * sizeof ( PAPI_address_map_t ) );
+			if ( map && shlib->count )
+				memcpy( map, shlib->map,
+						( size_t ) shlib->count * sizeof ( PAPI_address_map_t ) );
+			if ( map && shlib->map )
+				papi_free( shlib->map );
+		}
+		if ( map == NULL )
+			return PAPI_ENOMEM;
+		shlib->map = shlib_map = map;
+		shlib_capacity = max;
+	}
+
+	memmove( &shlib->map[lo + 1], &shlib->map[hi],
+			 ( size_t ) ( shlib->count - hi ) * sizeof ( PAPI_address_map_t ) );
+	memset( &shlib->map[lo], 0, sizeof ( PAPI_address_map_t ) );
+	strcpy( shlib->map[lo].name, m->name );
+	shlib->map[lo].text_start = m->start;
+	shlib->map[lo].text_end = m->end;
+	shlib->count = count;
+
+	return PAPI_OK;
+}
+
+/* Bring the shared library map up to date. Without force the queued    */
+/* mmaps are applied to the current map, which is only built from the OS */
+/* when there is none yet or the queue could not keep every mmap.        */
+/* The caller holds INTERNAL_LOCK.                                       */
+int
+_papi_hwi_update_shlib_info_locked( int force )
+{
+	PAPI_shlib_info_t *shlib = &_papi_hwi_system_info.shlib_info;
+	int retval = PAPI_OK, full, pending, slots, i;
+
+	full = force || ( shlib->map == NULL );
+
+	pending = __atomic_load_n( &shlib_reserved, __ATOMIC_ACQUIRE );
+	if ( pending > SHLIB_PENDING )
+		full = 1;
+	slots = pending < SHLIB_PENDING ? pending : SHLIB_PENDING;
+
+	/* A slot still being written leaves the whole queue for the next */
+	/* update, which applies it on top of this rebuild                 */
+	for ( i = 0; i < slots; i++ ) {
+		if ( !__atomic_load_n( &shlib_pending[i].ready, __ATOMIC_ACQUIRE ) ) {
+			full = 1;
+			slots = 0;
+		}
+	}
+	for ( i = 0; i < slots; i++ ) {
+		if ( !full && ( shlib_insert( shlib, &shlib_pending[i] ) != PAPI_OK ) )
+			full = 1;
+	}
+
+	/* The slots are free once the count is reset. Mmaps queued meanwhile */
+	/* make that fail: the slots are then kept for the next update and    */
+	/* this one rebuilds the map.                                         */
+	if ( slots > 0 ) {
+		for ( i = 0; i < slots; i++ )
+			__atomic_store_n( &shlib_pending[i].ready, 0, __ATOMIC_RELAXED );
+		if ( !__atomic_compare_exchange_n( &shlib_reserved, &pending, 0, 0,
+										   __ATOMIC_ACQ_REL,
+										   __ATOMIC_ACQUIRE ) ) {
+			for ( i = 0; i < slots; i++ )
+				__atomic_store_n( &shlib_pending[i].ready, 1,
+								  __ATOMIC_RELEASE );
+			full = 1;
+		}
+	}
+
+	if ( full ) {
+		/* Linux keeps the map when /proc/<pid>/maps did not change since */
+		/* it was built, make sure it is rebuilt if it was edited here     */
+		if ( ( shlib->map != NULL ) && ( shlib->map == shlib_map ) ) {
+			papi_free( shlib->map );
+			shlib->map = NULL;
+			shlib->count = 0;
+		}
+		retval = _papi_os_vector.update_shlib_info( &_papi_hwi_system_info );
+		/* Whatever the OS vector left is sized to fit */
+		shlib_map = NULL;
+		shlib_capacity = 0;
+
+		for ( i = 1; i < shlib->count; i++ ) {
+			if ( shlib->map[i - 1].text_start > shlib->map[i].text_start ) {
+				qsort( shlib->map, ( size_t ) shlib->count,
+					   sizeof ( PAPI_address_map_t ), shlib_compare );
+				break;
+			}
+		}
+	}
+
+	return retval;
+}
+
+int
+_papi_hwi_update_shlib_info( int force )
+{
+	int retval;
+
+	_papi_hwi_lock( INTERNAL_LOCK );
+	retval = _papi_hwi_update_shlib_info_locked( force );
+	_papi_hwi_unlock( INTERNAL_LOCK );
+
+	return retval;
+}
+
+/* The executable or shared library whose text contains addr, NULL if */
+/* none. The entry is valid until the next update of the map, callers */
+/* that may race with one hold INTERNAL_LOCK.                          */
+const PAPI_address_map_t *
+_papi_hwi_lookup_shlib( vptr_t addr )
+{
+	PAPI_shlib_info_t *shlib = &_papi_hwi_system_info.shlib_info;
+	PAPI_address_map_t *exe = &_papi_hwi_system_info.exe_info.address_info;
+	int i;
+
+	if ( ( addr >= exe->text_start ) && ( addr < exe->text_end ) )
+		return exe;
+
+	i = shlib_search( shlib, addr );
+	if ( ( i < shlib->count ) && ( addr >= shlib->map[i].text_start ) )
+		return &shlib->map[i];
+
+	return NULL;
+}
+
+/* The end of the data of an object, its bss when that follows the data */
+/* or text; mappings further away are anonymous memory, not the object  */
+static vptr_t
+shlib_object_end( const PAPI_address_map_t * obj )
+{
+	vptr_t end = obj->text_end;
+
+	if ( obj->data_end > end )
+		end = obj->data_end;
+	if ( ( obj->bss_end > end ) &&
+		 ( ( obj->bss_start == obj->data_end ) ||
+		   ( obj->bss_start == obj->text_end ) ) )
+		end = obj->bss_end;
+
+	return end;
+}
+
+/* The executable or shared library whose text, data or bss contains */
+/* addr, NULL if none, valid as for _papi_hwi_lookup_shlib           */
+const PAPI_address_map_t *
+_papi_hwi_lookup_object( vptr_t addr )
+{
+	PAPI_shlib_info_t *shlib = &_papi_hwi_system_info.shlib_info;
+	PAPI_address_map_t *exe = &_papi_hwi_system_info.exe_info.address_info;
+	int lo = 0, hi = shlib->count, mid;
+
+	if ( ( addr >= exe->text_start ) && ( addr < shlib_object_end( exe ) ) )
+		return exe;
+
+	/* last entry starting at or below addr */
+	while ( lo < hi ) {
+		mid = lo + ( hi - lo ) / 2;
+		if ( shlib->map[mid].text_start <= addr )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if ( ( lo > 0 ) && ( addr < shlib_object_end( &shlib->map[lo - 1] ) ) )
+		return &shlib->map[lo - 1];
+
+	return NULL;
+}
@@ -0,0 +1,19 @@
+/** @file papi_shlib.h
+ *
+ * The shared library map of _papi_hwi_system_info, kept in address
+ * order so that the object containing an address is found with a binary
+ * search, and updated from the mmap records of the sampling components
+ * between full refreshes.
+ */
+
+#ifndef PAPI_SHLIB_H
+#define PAPI_SHLIB_H
+
+int _papi_hwi_update_shlib_info( int force );
+int _papi_hwi_update_shlib_info_locked( int force );
+const PAPI_address_map_t *_papi_hwi_lookup_shlib( vptr_t addr );
+const PAPI_address_map_t *_papi_hwi_lookup_object( vptr_t addr );
+void _papi_hwi_shlib_note_mmap( vptr_t start, vptr_t end, const char *name,
+								size_t len, const char *name2, size_t len2 );
+
+#endif /* PAPI_SHLIB_H */
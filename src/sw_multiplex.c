@@ -130,6 +130,7 @@ for advertising or product endorsement purposes.
 #include "papi_internal.h"
 #include "papi_vector.h"
 #include "papi_memory.h"
+#include "papi_self.h"
 
 #define MPX_MINCYC 25000
 
@@ -444,6 +445,7 @@ int _PNE_PM_RUN_CYC;
 static void
 mpx_handler( int signal )
 {
+	PAPI_SELF_SCOPE( PAPI_SELF_mpx_handler );
 	int retval;
 	MasterEvent *mev, *head;
 	Threadlist *me = NULL;
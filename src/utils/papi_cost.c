@@ -13,6 +13,8 @@
   *		This information provides the basic operating cost to a user's program
   *		for collecting hardware counter data.
   *		Command line options control display capabilities.
+  *		If the library was configured with --enable-self-profile, the time
+  *		spent in the library's own probes during the run is reported last.
   *
   *	@section Options
   *	<ul>
@@ -193,6 +195,37 @@ do_output( int test_type, long long *array, int bins, int show_std_dev,
 	}
 }
 
+/* Report the library's own probes, if it was built to keep them */
+static void
+print_self_profile( void )
+{
+	PAPI_self_probe_t probes[128];
+	PAPI_option_t opt;
+	long long n, half;
+	int i, b;
+
+	memset( &opt, 0, sizeof ( opt ) );
+	opt.self_profile.num_probes = 128;
+	opt.self_profile.probes = probes;
+	if ( PAPI_get_opt( PAPI_SELF_PROFILE, &opt ) != PAPI_OK )
+		return;
+
+	printf( "\nTime spent inside the library (ns):\n" );
+	printf( "%-32s %12s %10s %10s %10s\n",
+			"probe", "calls", "mean", "median<", "max" );
+	for ( i = 0; i < opt.self_profile.num_probes; i++ ) {
+		n = probes[i].count;
+		half = 0;
+		/* bucket b holds the calls under 2^b ns */
+		for ( b = 0; b < PAPI_SELF_BUCKETS - 1; b++ ) {
+			half += probes[i].hist[b];
+			if ( 2 * half >= n )
+				break;
+		}
+		printf( "%-32s %12lld %10lld %10lld %10lld\n", probes[i].name, n,
+				probes[i].total_ns / n, 1LL << b, probes[i].max_ns );
+	}
+}
 
 int
 main( int argc, char **argv )
@@ -512,6 +545,8 @@ main( int argc, char **argv )
 			"event to test, skipping.\n");
 	}
 
+	print_self_profile(  );
+
 	free( array );
 
 	return 0;
@@ -0,0 +1,168 @@
+/**
+  * file papi_event_cache.c
+  *	@brief papi_event_cache utility.
+  *	@page papi_event_cache
+  *	@section Name
+  *		papi_event_cache - builds the persistent native event cache.
+  *
+  *	@section Synopsis
+  *		papi_event_cache [-d dir] [-r] [-t] [-h]
+  *
+  *	@section Description
+  *		papi_event_cache is a PAPI utility program that (re)builds the
+  *		on-disk index of the perf_event native events. The index is used
+  *		by every PAPI program run with PAPI_EVENT_CACHE pointing to the
+  *		same directory: event enumeration and "pmu::event" lookups then
+  *		read it instead of walking the libpfm4 tables.
+  *
+  *		The cache files are keyed by kernel, libpfm4 and CPU, and are
+  *		rebuilt automatically when those change. Use this utility to
+  *		build them ahead of time, for instance at node boot.
+  *
+  *	@section Options
+  *	<ul>
+  *		<li>-d dir	Cache directory, defaults to $PAPI_EVENT_CACHE.
+  *		<li>-r		Remove existing cache files before building.
+  *		<li>-t		Time a full enumeration of the native events.
+  *		<li>-h		Display help information about this utility.
+  *	</ul>
+  *
+  *	@section Bugs
+  *		There are no known bugs in this utility.
+  *		If you find a bug, it should be reported to the
+  *		PAPI Mailing List at <ptools-perfapi@icl.utk.edu>.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "papi.h"
+
+/* Must match PE_CACHE_PREFIX in components/perf_event/pe_event_cache.h */
+#define CACHE_PREFIX "papi_events_"
+
+static void
+print_help( char **argv )
+{
+	printf( "This is the PAPI native event cache builder.\n" );
+	printf( "Usage: %s [options]\n", argv[0] );
+	printf( "Options:\n\n" );
+	printf( "  -d dir   Cache directory, defaults to $PAPI_EVENT_CACHE\n" );
+	printf( "  -r       Remove existing cache files before building\n" );
+	printf( "  -t       Time a full enumeration of the native events\n" );
+	printf( "  -h       Display this help message\n" );
+}
+
+/* Remove or list the cache files in dir */
+static int
+walk_cache_dir( const char *dir, int remove_files )
+{
+	DIR *dp;
+	struct dirent *de;
+	struct stat st;
+	char path[PATH_MAX];
+	int count = 0;
+
+	dp = opendir( dir );
+	if ( dp == NULL ) return 0;
+
+	while ( ( de = readdir( dp ) ) != NULL ) {
+		if ( strncmp( de->d_name, CACHE_PREFIX, strlen( CACHE_PREFIX ) ) )
+			continue;
+		snprintf( path, sizeof ( path ), "%s/%s", dir, de->d_name );
+		if ( remove_files ) {
+			if ( unlink( path ) == 0 ) count++;
+		} else if ( stat( path, &st ) == 0 ) {
+			printf( "%-50s %10ld bytes\n", path, ( long ) st.st_size );
+			count++;
+		}
+	}
+	closedir( dp );
+
+	return count;
+}
+
+int
+main( int argc, char **argv )
+{
+	int i, cid, numcmp, retval, events;
+	int rebuild = 0, timing = 0;
+	int code;
+	char *dir = getenv( "PAPI_EVENT_CACHE" );
+	long long start_usec, init_usec, enum_usec;
+	const PAPI_component_info_t *cmpinfo;
+
+	for ( i = 1; i < argc; i++ ) {
+		if ( !strcmp( argv[i], "-d" ) && ( i + 1 < argc ) ) {
+			dir = argv[++i];
+		} else if ( !strcmp( argv[i], "-r" ) ) {
+			rebuild = 1;
+		} else if ( !strcmp( argv[i], "-t" ) ) {
+			timing = 1;
+		} else {
+			print_help( argv );
+			return strcmp( argv[i], "-h" ) ? 1 : 0;
+		}
+	}
+
+	if ( ( dir == NULL ) || ( strlen( dir ) == 0 ) ) {
+		fprintf( stderr, "No cache directory, use -d or set PAPI_EVENT_CACHE\n" );
+		return 1;
+	}
+
+	if ( mkdir( dir, 0755 ) < 0 && access( dir, W_OK ) < 0 ) {
+		fprintf( stderr, "Cannot write to cache directory %s\n", dir );
+		return 1;
+	}
+
+	if ( rebuild ) {
+		printf( "Removed %d cache file(s)\n", walk_cache_dir( dir, 1 ) );
+	}
+
+	/* The perf_event components build missing or stale caches at init */
+	setenv( "PAPI_EVENT_CACHE", dir, 1 );
+
+	start_usec = PAPI_get_real_usec(  );
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		fprintf( stderr, "Error! PAPI_library_init\n" );
+		return retval;
+	}
+	init_usec = PAPI_get_real_usec(  ) - start_usec;
+
+	if ( walk_cache_dir( dir, 0 ) == 0 ) {
+		fprintf( stderr, "No cache was written to %s\n", dir );
+		return 1;
+	}
+	printf( "PAPI_library_init took %lld us\n", init_usec );
+
+	if ( timing ) {
+		numcmp = PAPI_num_components(  );
+		for ( cid = 0; cid < numcmp; cid++ ) {
+			cmpinfo = PAPI_get_component_info( cid );
+			if ( ( cmpinfo == NULL ) || cmpinfo->disabled ) continue;
+			if ( strncmp( cmpinfo->name, "perf_event", 10 ) ) continue;
+
+			events = 0;
+			start_usec = PAPI_get_real_usec(  );
+			code = PAPI_NATIVE_MASK;
+			if ( PAPI_enum_cmp_event( &code, PAPI_ENUM_FIRST, cid ) == PAPI_OK ) {
+				do {
+					events++;
+				} while ( PAPI_enum_cmp_event( &code, PAPI_ENUM_EVENTS, cid ) == PAPI_OK );
+			}
+			enum_usec = PAPI_get_real_usec(  ) - start_usec;
+			printf( "%-20s %6d events enumerated in %lld us\n",
+				cmpinfo->name, events, enum_usec );
+		}
+	}
+
+	PAPI_shutdown(  );
+
+	return 0;
+}
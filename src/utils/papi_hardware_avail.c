@@ -215,6 +215,20 @@ main( int argc, char **argv )
                     }
                     printf( "\n" );
                 }
+
+                for ( j = 0; j < sockets; ++j ) {
+                    unsigned int k, socket, reader = 0;
+                    printf( "Socket %u Threads                      : ", j );
+                    for ( k = 0; k < threads && k < MAX_CPU_THREADS; ++k ) {
+                        PAPI_get_dev_attr(handle, k, PAPI_DEV_ATTR__CPU_UINT_THR_SOCKET_AFFINITY, &socket);
+                        if ( socket == j ) {
+                            PAPI_get_dev_attr(handle, k, PAPI_DEV_ATTR__CPU_UINT_THR_UNCORE_READER, &reader);
+                            printf( "%u ", k );
+                        }
+                    }
+                    printf( "\n" );
+                    printf( "Socket %u Uncore Reader                : %u\n", j, reader );
+                }
                 printf( "\n" );
             }
         }
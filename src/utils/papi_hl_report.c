@@ -0,0 +1,1309 @@
+/**
+  * file papi_hl_report.c
+  *	@brief papi_hl_report utility.
+  *	@page papi_hl_report
+  *	@section Name
+  *		papi_hl_report - summarizes the measurements of the high-level API.
+  *
+  *	@section Synopsis
+  *		papi_hl_report [-r] [-m file] [-o file] [-t threads] [-h] path ...
+  *
+  *	@section Description
+  *		papi_hl_report is a PAPI utility program that writes the summary
+  *		of the papi_hl_output_writer.py script (--type=summary) for the
+  *		rank_*.json and node_*.json files of the high-level API. Each
+  *		path is a measurement directory or a single file.
+  *
+  *		Regions with the same name are merged over all threads and ranks,
+  *		giving the total, minimum, median and maximum of each event. By
+  *		default the real time, CPU time, IPC and event rates are derived
+  *		from the events, as with --notation=derived.
+  *
+  *		The files are parsed as they are read, by several threads, and
+  *		only the summary is kept in memory: the files are never loaded
+  *		as a whole. The memory used grows with the number of region
+  *		instances, 8 bytes per event for the medians.
+  *
+  *		The rates are given by a table of event and metric names, which
+  *		can be replaced with -m. Each line of the file holds an event name
+  *		followed by the name of the rate, which is computed as the total
+  *		of the event in millions per second of real time. Empty lines and
+  *		lines starting with '#' are skipped. For example:
+  *		@code
+  *		# event     rate
+  *		PAPI_FP_OPS MFLOPS/s
+  *		PAPI_DP_OPS Double precision MFLOPS/s
+  *		@endcode
+  *
+  *	@section Options
+  *	<ul>
+  *		<li>-r		Raw notation, do not derive metrics from the events.
+  *		<li>-m file	Table of event rates to derive.
+  *		<li>-o file	Write the summary to file instead of stdout.
+  *		<li>-t threads	Number of threads, defaults to the number of CPUs.
+  *		<li>-h		Display help information about this utility.
+  *	</ul>
+  *
+  *	@section Bugs
+  *		There are no known bugs in this utility.
+  *		If you find a bug, it should be reported to the
+  *		PAPI Mailing List at <ptools-perfapi@icl.utk.edu>.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define REPORT_STR_LEN 1024
+#define REPORT_BUF_LEN ( 64 * 1024 )
+
+/* Rates derived from an event: the total in millions per second */
+typedef struct
+{
+	char *event;
+	char *metric;
+} rate_t;
+
+static rate_t default_rates[] = {
+	{ "PAPI_FP_INS", "MFLIPS/s" },
+	{ "PAPI_VEC_SP", "Single precision vector/SIMD instructions rate in M/s" },
+	{ "PAPI_VEC_DP", "Double precision vector/SIMD instructions rate in M/s" },
+	{ "PAPI_FP_OPS", "MFLOPS/s" },
+	{ "PAPI_SP_OPS", "Single precision MFLOPS/s" },
+	{ "PAPI_DP_OPS", "Double precision MFLOPS/s" }
+};
+
+static rate_t *rates = default_rates;
+static int num_rates = sizeof ( default_rates ) / sizeof ( default_rates[0] );
+
+/* Events of the event_definitions, the first definition of a name wins */
+typedef struct
+{
+	char *name;
+	int total;					/* a delta event of perf_event */
+} event_def_t;
+
+static event_def_t *event_defs = NULL;
+static int num_event_defs = 0;
+static pthread_mutex_t event_defs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* All values of one key of a region, in file order */
+typedef struct
+{
+	char *key;
+	long long order;			/* where the key was seen first */
+	long long count, sum, min, max;
+	long long *values;			/* for the median, NULL for region_count */
+	size_t num_values, max_values;
+} value_t;
+
+typedef struct
+{
+	char *name;
+	long long order;			/* where the region was seen first */
+	int ranks, threads;
+	int last_file, last_thread;
+	value_t *values;
+	int num_values, max_values;
+} region_t;
+
+/* Regions by name, open addressing */
+typedef struct
+{
+	region_t **table;
+	size_t size, used;
+} summary_t;
+
+/* A value as found in a region of a file */
+typedef struct
+{
+	char key[REPORT_STR_LEN];
+	long long order;
+	int stats;					/* min, avg and max of a node file */
+	int has_total;
+	long long value, min, max, total;
+} entry_t;
+
+typedef struct
+{
+	summary_t summary;
+	int file, thread;			/* current file and thread */
+	long long order;
+	entry_t *entries;
+	int max_entries;
+	int failed;
+} worker_t;
+
+typedef struct
+{
+	FILE *f;
+	const char *path;
+	char buf[REPORT_BUF_LEN];
+	size_t pos, len;
+} reader_t;
+
+static char **files = NULL;
+static int num_files = 0;
+static int next_file = 0;
+
+static void
+print_help( char **argv )
+{
+	printf( "This is the PAPI high-level output summary utility.\n" );
+	printf( "It merges the regions of all rank files of a measurement.\n" );
+	printf( "Usage: %s [options] path ...\n", argv[0] );
+	printf( "Each path is a measurement directory or a single file.\n" );
+	printf( "Options:\n\n" );
+	printf( "  -r          Raw notation, do not derive metrics\n" );
+	printf( "  -m file     Table of event rates to derive, one event and rate name per line\n" );
+	printf( "  -o file     Write the summary to file instead of stdout\n" );
+	printf( "  -t threads  Number of threads, defaults to the number of CPUs\n" );
+	printf( "  -h          Display this help message\n" );
+}
+
+static void *
+xmalloc( size_t size )
+{
+	void *p = malloc( size );
+
+	if ( p == NULL ) {
+		fprintf( stderr, "Out of memory\n" );
+		exit( 1 );
+	}
+	return p;
+}
+
+static void *
+xrealloc( void *p, size_t size )
+{
+	p = realloc( p, size );
+	if ( p == NULL ) {
+		fprintf( stderr, "Out of memory\n" );
+		exit( 1 );
+	}
+	return p;
+}
+
+static char *
+xstrdup( const char *s )
+{
+	return strcpy( xmalloc( strlen( s ) + 1 ), s );
+}
+
+/*************************************************************************/
+/* Streaming JSON reader, for the layout written by the high-level API.  */
+/*************************************************************************/
+
+static int
+rd_peek( reader_t * r )
+{
+	if ( r->pos == r->len ) {
+		r->len = fread( r->buf, 1, sizeof ( r->buf ), r->f );
+		r->pos = 0;
+		if ( r->len == 0 )
+			return EOF;
+	}
+	return ( unsigned char ) r->buf[r->pos];
+}
+
+static int
+rd_getc( reader_t * r )
+{
+	int c = rd_peek( r );
+
+	if ( c != EOF )
+		r->pos++;
+	return c;
+}
+
+static int
+rd_skip_ws( reader_t * r )
+{
+	int c;
+
+	while ( ( c = rd_peek( r ) ) != EOF && isspace( c ) )
+		r->pos++;
+	return c;
+}
+
+static int
+rd_error( reader_t * r, const char *what )
+{
+	fprintf( stderr, "%s: %s\n", r->path, what );
+	return -1;
+}
+
+/* A string, or a number or literal, truncated to max - 1 characters */
+static int
+rd_scalar( reader_t * r, char *s, size_t max )
+{
+	size_t n = 0;
+	int c;
+
+	c = rd_skip_ws( r );
+	if ( c == '"' ) {
+		r->pos++;
+		while ( ( c = rd_getc( r ) ) != '"' ) {
+			if ( c == EOF )
+				return rd_error( r, "unterminated string" );
+			if ( c == '\\' ) {
+				c = rd_getc( r );
+				switch ( c ) {
+				case 'n': c = '\n'; break;
+				case 't': c = '\t'; break;
+				case 'r': c = '\r'; break;
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'u':
+					/* only ASCII is written, keep a placeholder */
+					if ( rd_getc( r ) == EOF || rd_getc( r ) == EOF ||
+						 rd_getc( r ) == EOF || rd_getc( r ) == EOF )
+						return rd_error( r, "unterminated string" );
+					c = '?';
+					break;
+				case EOF:
+					return rd_error( r, "unterminated string" );
+				}
+			}
+			if ( n < max - 1 )
+				s[n++] = ( char ) c;
+		}
+	} else {
+		while ( ( c = rd_peek( r ) ) != EOF && ( isalnum( c ) || c == '-' ||
+												  c == '+' || c == '.' ) ) {
+			if ( n < max - 1 )
+				s[n++] = ( char ) c;
+			r->pos++;
+		}
+		if ( n == 0 )
+			return rd_error( r, "value expected" );
+	}
+	s[n] = '\0';
+	return 0;
+}
+
+static int
+rd_expect( reader_t * r, int c )
+{
+	if ( rd_skip_ws( r ) != c ) {
+		char what[32];
+		snprintf( what, sizeof ( what ), "'%c' expected", c );
+		return rd_error( r, what );
+	}
+	r->pos++;
+	return 0;
+}
+
+/* The next key of an object, 1 if there is one, 0 at its end */
+static int
+rd_next_key( reader_t * r, char *key, size_t max )
+{
+	int c = rd_skip_ws( r );
+
+	if ( c == '}' ) {
+		r->pos++;
+		return 0;
+	}
+	if ( c == ',' ) {
+		r->pos++;
+		c = rd_skip_ws( r );
+	}
+	if ( c != '"' )
+		return rd_error( r, "key expected" );
+	if ( rd_scalar( r, key, max ) < 0 || rd_expect( r, ':' ) < 0 )
+		return -1;
+	return 1;
+}
+
+static int
+rd_skip_value( reader_t * r )
+{
+	char s[64];
+	int c, depth = 0;
+
+	c = rd_skip_ws( r );
+	if ( c != '{' && c != '[' )
+		return rd_scalar( r, s, sizeof ( s ) );
+
+	/* strings may hold brackets, so walk through them */
+	do {
+		c = rd_skip_ws( r );
+		if ( c == '"' ) {
+			if ( rd_scalar( r, s, sizeof ( s ) ) < 0 )
+				return -1;
+			continue;
+		}
+		if ( c == EOF )
+			return rd_error( r, "unexpected end of file" );
+		r->pos++;
+		if ( c == '{' || c == '[' )
+			depth++;
+		else if ( c == '}' || c == ']' )
+			depth--;
+	} while ( depth > 0 );
+
+	return 0;
+}
+
+static long long
+to_number( const char *s )
+{
+	char *end;
+	long long v = strtoll( s, &end, 10 );
+
+	if ( *end == '.' || *end == 'e' || *end == 'E' )
+		v = ( long long ) strtod( s, NULL );
+	return v;
+}
+
+/*************************************************************************/
+/* Summaries                                                             */
+/*************************************************************************/
+
+static unsigned long
+hash_name( const char *s )
+{
+	unsigned long h = 14695981039346656037UL;
+
+	while ( *s )
+		h = ( h ^ ( unsigned char ) *s++ ) * 1099511628211UL;
+	return h;
+}
+
+static region_t **
+summary_slot( summary_t * sum, const char *name )
+{
+	size_t i = hash_name( name ) & ( sum->size - 1 );
+
+	while ( sum->table[i] != NULL && strcmp( sum->table[i]->name, name ) )
+		i = ( i + 1 ) & ( sum->size - 1 );
+	return &sum->table[i];
+}
+
+static void
+summary_grow( summary_t * sum )
+{
+	region_t **old = sum->table;
+	size_t i, size = sum->size;
+
+	sum->size = size ? 2 * size : 64;
+	sum->table = calloc( sum->size, sizeof ( region_t * ) );
+	if ( sum->table == NULL ) {
+		fprintf( stderr, "Out of memory\n" );
+		exit( 1 );
+	}
+	for ( i = 0; i < size; i++ )
+		if ( old[i] != NULL )
+			*summary_slot( sum, old[i]->name ) = old[i];
+	free( old );
+}
+
+/* The region of a name, a new one is created at order */
+static region_t *
+summary_region( summary_t * sum, const char *name, long long order )
+{
+	region_t **slot, *region;
+
+	if ( 2 * ( sum->used + 1 ) > sum->size )
+		summary_grow( sum );
+	slot = summary_slot( sum, name );
+	if ( *slot == NULL ) {
+		region = calloc( 1, sizeof ( region_t ) );
+		if ( region == NULL ) {
+			fprintf( stderr, "Out of memory\n" );
+			exit( 1 );
+		}
+		region->name = xstrdup( name );
+		region->order = order;
+		region->last_file = -1;
+		region->last_thread = -1;
+		*slot = region;
+		sum->used++;
+	}
+	return *slot;
+}
+
+static value_t *
+region_value( region_t * region, const char *key, int hint, long long order )
+{
+	value_t *v;
+	int i;
+
+	/* keys mostly come in the same order in every region */
+	if ( hint < region->num_values && !strcmp( region->values[hint].key, key ) )
+		return &region->values[hint];
+	for ( i = 0; i < region->num_values; i++ )
+		if ( !strcmp( region->values[i].key, key ) )
+			return &region->values[i];
+
+	if ( region->num_values == region->max_values ) {
+		region->max_values = region->max_values ? 2 * region->max_values : 8;
+		region->values = xrealloc( region->values,
+								   region->max_values * sizeof ( value_t ) );
+	}
+	v = &region->values[region->num_values++];
+	memset( v, 0, sizeof ( *v ) );
+	v->key = xstrdup( key );
+	v->order = order;
+	return v;
+}
+
+static void
+value_push( value_t * v, long long value )
+{
+	if ( v->num_values == v->max_values ) {
+		v->max_values = v->max_values ? 2 * v->max_values : 16;
+		v->values = xrealloc( v->values, v->max_values * sizeof ( long long ) );
+	}
+	v->values[v->num_values++] = value;
+}
+
+/* Add one value as the script does: node files give min, avg and max */
+static void
+value_add( value_t * v, const entry_t * e )
+{
+	long long min = e->stats ? e->min : e->value;
+	long long max = e->stats ? e->max : e->value;
+
+	if ( v->count == 0 || min < v->min )
+		v->min = min;
+	if ( v->count == 0 || max > v->max )
+		v->max = max;
+	v->count++;
+	if ( e->stats )
+		v->sum += e->has_total ? e->total : e->value;
+	else
+		v->sum += e->value;
+	if ( strcmp( v->key, "region_count" ) )
+		value_push( v, e->value );
+}
+
+static void
+value_merge( value_t * v, value_t * from )
+{
+	if ( v->count == 0 || ( from->count > 0 && from->min < v->min ) )
+		v->min = from->min;
+	if ( v->count == 0 || ( from->count > 0 && from->max > v->max ) )
+		v->max = from->max;
+	v->count += from->count;
+	v->sum += from->sum;
+	if ( from->order < v->order )
+		v->order = from->order;
+	if ( from->num_values ) {
+		if ( v->num_values + from->num_values > v->max_values ) {
+			v->max_values = v->num_values + from->num_values;
+			v->values = xrealloc( v->values,
+								  v->max_values * sizeof ( long long ) );
+		}
+		memcpy( v->values + v->num_values, from->values,
+				from->num_values * sizeof ( long long ) );
+		v->num_values += from->num_values;
+	}
+	free( from->values );
+	free( from->key );
+}
+
+static void
+summary_merge( summary_t * sum, summary_t * from )
+{
+	region_t *region, *r;
+	value_t *v;
+	size_t i;
+	int j;
+
+	for ( i = 0; i < from->size; i++ ) {
+		if ( ( r = from->table[i] ) == NULL )
+			continue;
+		region = summary_region( sum, r->name, r->order );
+		if ( region->num_values == 0 && region->ranks == 0 ) {
+			/* new here, take it over */
+			free( region->name );
+			*region = *r;
+			free( r );
+			continue;
+		}
+		region->ranks += r->ranks;
+		region->threads += r->threads;
+		if ( r->order < region->order )
+			region->order = r->order;
+		for ( j = 0; j < r->num_values; j++ ) {
+			v = region_value( region, r->values[j].key, j, r->values[j].order );
+			value_merge( v, &r->values[j] );
+		}
+		free( r->values );
+		free( r->name );
+		free( r );
+	}
+	free( from->table );
+	from->table = NULL;
+	from->size = from->used = 0;
+}
+
+/*************************************************************************/
+/* Parsing the files                                                     */
+/*************************************************************************/
+
+static void
+add_event_def( const char *name, int total )
+{
+	int i;
+
+	pthread_mutex_lock( &event_defs_lock );
+	for ( i = 0; i < num_event_defs; i++ )
+		if ( !strcmp( event_defs[i].name, name ) )
+			break;
+	if ( i == num_event_defs ) {
+		event_defs = xrealloc( event_defs,
+							   ( num_event_defs + 1 ) * sizeof ( event_def_t ) );
+		event_defs[i].name = xstrdup( name );
+		event_defs[i].total = total;
+		num_event_defs++;
+	}
+	pthread_mutex_unlock( &event_defs_lock );
+}
+
+static int
+parse_definitions( reader_t * r )
+{
+	char name[REPORT_STR_LEN], key[REPORT_STR_LEN], value[REPORT_STR_LEN];
+	int delta, perf_event, ret;
+
+	if ( rd_expect( r, '{' ) < 0 )
+		return -1;
+	while ( ( ret = rd_next_key( r, name, sizeof ( name ) ) ) > 0 ) {
+		delta = perf_event = 0;
+		if ( rd_expect( r, '{' ) < 0 )
+			return -1;
+		while ( ( ret = rd_next_key( r, key, sizeof ( key ) ) ) > 0 ) {
+			if ( rd_scalar( r, value, sizeof ( value ) ) < 0 )
+				return -1;
+			if ( !strcmp( key, "type" ) )
+				delta = !strcmp( value, "delta" );
+			else if ( !strcmp( key, "component" ) )
+				perf_event = !strcmp( value, "perf_event" );
+		}
+		if ( ret < 0 )
+			return -1;
+		add_event_def( name, delta && perf_event );
+	}
+	return ret;
+}
+
+/* The value of an event, a number or an object */
+static int
+parse_entry( reader_t * r, entry_t * e )
+{
+	char key[REPORT_STR_LEN], value[REPORT_STR_LEN];
+	int ret, has_value = 0, has_avg = 0;
+
+	e->stats = 0;
+	e->has_total = 0;
+	if ( rd_skip_ws( r ) != '{' ) {
+		if ( rd_scalar( r, value, sizeof ( value ) ) < 0 )
+			return -1;
+		e->value = to_number( value );
+		return 1;
+	}
+
+	/* PAPI_hl_read values next to the region value, or node statistics */
+	r->pos++;
+	while ( ( ret = rd_next_key( r, key, sizeof ( key ) ) ) > 0 ) {
+		if ( rd_skip_ws( r ) == '{' || rd_skip_ws( r ) == '[' ) {
+			if ( rd_skip_value( r ) < 0 )
+				return -1;
+			continue;
+		}
+		if ( rd_scalar( r, value, sizeof ( value ) ) < 0 )
+			return -1;
+		if ( !strcmp( key, "region_value" ) ) {
+			e->value = to_number( value );
+			has_value = 1;
+		} else if ( !strcmp( key, "avg" ) ) {
+			e->stats = 1;
+			has_avg = 1;
+			if ( !has_value )
+				e->value = to_number( value );
+		} else if ( !strcmp( key, "min" ) ) {
+			e->min = to_number( value );
+		} else if ( !strcmp( key, "max" ) ) {
+			e->max = to_number( value );
+		} else if ( !strcmp( key, "total" ) ) {
+			e->total = to_number( value );
+			e->has_total = 1;
+		}
+	}
+	if ( ret < 0 )
+		return -1;
+	if ( has_value )
+		e->stats = 0;
+	return has_value || has_avg;
+}
+
+static int
+parse_region( worker_t * w, reader_t * r )
+{
+	char key[REPORT_STR_LEN], name[REPORT_STR_LEN] = "unknown";
+	long long order = w->order++;
+	region_t *region;
+	entry_t count;
+	value_t *v;
+	int i, n = 0, ret;
+
+	/* every instance of a region counts once, node files give a count */
+	strcpy( count.key, "region_count" );
+	count.order = order;
+	count.stats = 0;
+	count.value = 1;
+
+	if ( rd_expect( r, '{' ) < 0 )
+		return -1;
+	while ( ( ret = rd_next_key( r, key, sizeof ( key ) ) ) > 0 ) {
+		if ( !strcmp( key, "name" ) ) {
+			if ( rd_scalar( r, name, sizeof ( name ) ) < 0 )
+				return -1;
+			continue;
+		}
+		if ( !strcmp( key, "parent_region_id" ) ) {
+			if ( rd_skip_value( r ) < 0 )
+				return -1;
+			continue;
+		}
+		if ( n == w->max_entries ) {
+			w->max_entries = w->max_entries ? 2 * w->max_entries : 16;
+			w->entries = xrealloc( w->entries, w->max_entries * sizeof ( entry_t ) );
+		}
+		if ( !strcmp( key, "region_count" ) ) {
+			if ( parse_entry( r, &count ) < 0 )
+				return -1;
+			count.stats = 0;
+			continue;
+		}
+		strcpy( w->entries[n].key, key );
+		w->entries[n].order = w->order++;
+		if ( ( ret = parse_entry( r, &w->entries[n] ) ) < 0 )
+			return -1;
+		n += ret;
+	}
+	if ( ret < 0 )
+		return -1;
+
+	region = summary_region( &w->summary, name, order );
+	if ( region->last_file != w->file ) {
+		region->last_file = w->file;
+		region->last_thread = -1;
+		region->ranks++;
+	}
+	if ( region->last_thread != w->thread ) {
+		region->last_thread = w->thread;
+		region->threads++;
+	}
+
+	v = region_value( region, count.key, 0, count.order );
+	value_add( v, &count );
+	for ( i = 0; i < n; i++ ) {
+		v = region_value( region, w->entries[i].key, i + 1, w->entries[i].order );
+		value_add( v, &w->entries[i] );
+	}
+	return 0;
+}
+
+static int
+parse_threads( worker_t * w, reader_t * r )
+{
+	char key[REPORT_STR_LEN];
+	int ret, ret2;
+
+	if ( rd_expect( r, '{' ) < 0 )
+		return -1;
+	while ( ( ret = rd_next_key( r, key, sizeof ( key ) ) ) > 0 ) {
+		w->thread++;
+		if ( rd_expect( r, '{' ) < 0 )
+			return -1;
+		while ( ( ret2 = rd_next_key( r, key, sizeof ( key ) ) ) > 0 ) {
+			if ( strcmp( key, "regions" ) ) {
+				if ( rd_skip_value( r ) < 0 )
+					return -1;
+				continue;
+			}
+			if ( rd_expect( r, '{' ) < 0 )
+				return -1;
+			while ( ( ret = rd_next_key( r, key, sizeof ( key ) ) ) > 0 )
+				if ( parse_region( w, r ) < 0 )
+					return -1;
+			if ( ret < 0 )
+				return -1;
+		}
+		if ( ret2 < 0 )
+			return -1;
+	}
+	return ret;
+}
+
+static int
+parse_file( worker_t * w, const char *path )
+{
+	reader_t *r;
+	char key[REPORT_STR_LEN];
+	int ret = -1;
+
+	r = xmalloc( sizeof ( reader_t ) );
+	r->path = path;
+	r->pos = r->len = 0;
+	r->f = fopen( path, "r" );
+	if ( r->f == NULL ) {
+		fprintf( stderr, "Cannot open file %s\n", path );
+		free( r );
+		return -1;
+	}
+
+	if ( rd_expect( r, '{' ) == 0 ) {
+		while ( ( ret = rd_next_key( r, key, sizeof ( key ) ) ) > 0 ) {
+			if ( !strcmp( key, "event_definitions" ) )
+				ret = parse_definitions( r );
+			else if ( !strcmp( key, "threads" ) )
+				ret = parse_threads( w, r );
+			else
+				ret = rd_skip_value( r );
+			if ( ret < 0 )
+				break;
+		}
+	}
+
+	fclose( r->f );
+	free( r );
+	return ret;
+}
+
+static void *
+worker_main( void *arg )
+{
+	worker_t *w = arg;
+	int i;
+
+	while ( ( i = __atomic_fetch_add( &next_file, 1, __ATOMIC_RELAXED ) ) < num_files ) {
+		/* files are in the order of the script, regions follow it */
+		w->file = i;
+		w->thread = 0;
+		w->order = ( long long ) i << 32;
+		if ( parse_file( w, files[i] ) < 0 )
+			w->failed = 1;
+	}
+	return NULL;
+}
+
+static int
+compare_names( const void *a, const void *b )
+{
+	return strcmp( *( char *const * ) a, *( char *const * ) b );
+}
+
+/* The JSON files of a measurement directory, sorted, or a single file */
+static int
+add_path( const char *path )
+{
+	struct dirent *de;
+	struct stat st;
+	DIR *dp;
+	char *name;
+	size_t len;
+	int first = num_files;
+
+	if ( stat( path, &st ) < 0 ) {
+		fprintf( stderr, "Cannot open %s\n", path );
+		return -1;
+	}
+	if ( !S_ISDIR( st.st_mode ) ) {
+		files = xrealloc( files, ( num_files + 1 ) * sizeof ( char * ) );
+		files[num_files++] = xstrdup( path );
+		return 0;
+	}
+
+	if ( ( dp = opendir( path ) ) == NULL ) {
+		fprintf( stderr, "Cannot open %s\n", path );
+		return -1;
+	}
+	while ( ( de = readdir( dp ) ) != NULL ) {
+		len = strlen( de->d_name );
+		if ( len < 5 || strcmp( de->d_name + len - 5, ".json" ) )
+			continue;
+		name = xmalloc( strlen( path ) + len + 2 );
+		sprintf( name, "%s/%s", path, de->d_name );
+		files = xrealloc( files, ( num_files + 1 ) * sizeof ( char * ) );
+		files[num_files++] = name;
+	}
+	closedir( dp );
+	qsort( files + first, num_files - first, sizeof ( char * ), compare_names );
+
+	return 0;
+}
+
+static int
+read_rates( const char *path )
+{
+	char line[REPORT_STR_LEN], *event, *metric, *end;
+	FILE *f;
+
+	if ( ( f = fopen( path, "r" ) ) == NULL ) {
+		fprintf( stderr, "Cannot open rate table %s\n", path );
+		return -1;
+	}
+	rates = NULL;
+	num_rates = 0;
+	while ( fgets( line, sizeof ( line ), f ) != NULL ) {
+		event = line + strspn( line, " \t" );
+		if ( *event == '#' || *event == '\n' || *event == '\0' )
+			continue;
+		metric = event + strcspn( event, " \t\n" );
+		if ( *metric != '\0' )
+			*metric++ = '\0';
+		metric += strspn( metric, " \t" );
+		end = metric + strlen( metric );
+		while ( end > metric && isspace( ( unsigned char ) end[-1] ) )
+			*--end = '\0';
+		if ( *metric == '\0' ) {
+			fprintf( stderr, "No rate name for %s in %s\n", event, path );
+			fclose( f );
+			return -1;
+		}
+		rates = xrealloc( rates, ( num_rates + 1 ) * sizeof ( rate_t ) );
+		rates[num_rates].event = xstrdup( event );
+		rates[num_rates].metric = xstrdup( metric );
+		num_rates++;
+	}
+	fclose( f );
+	return 0;
+}
+
+/*************************************************************************/
+/* Output, formatted like json.dumps(indent=4) of the script             */
+/*************************************************************************/
+
+enum
+{ ITEM_INT, ITEM_FLOAT, ITEM_MEDIAN, ITEM_NA, ITEM_VALUE };
+
+typedef struct
+{
+	const char *key;
+	int kind;
+	long long i;
+	double d;
+	const value_t *v;
+} item_t;
+
+static void
+print_string( FILE * out, const char *s )
+{
+	fputc( '"', out );
+	for ( ; *s; s++ ) {
+		if ( *s == '"' || *s == '\\' )
+			fprintf( out, "\\%c", *s );
+		else if ( ( unsigned char ) *s < 0x20 )
+			fprintf( out, "\\u%04x", ( unsigned char ) *s );
+		else
+			fputc( *s, out );
+	}
+	fputc( '"', out );
+}
+
+static void
+print_key( FILE * out, int depth, int first, const char *key )
+{
+	fprintf( out, "%s\n%*s", first ? "" : ",", 4 * depth, "" );
+	print_string( out, key );
+	fprintf( out, ": " );
+}
+
+/* A float rounded to two decimals, as the script prints it */
+static double
+round2( double d )
+{
+	char s[64];
+
+	snprintf( s, sizeof ( s ), "%.2f", d );
+	return strtod( s, NULL );
+}
+
+static void
+print_float( FILE * out, double d )
+{
+	char s[64];
+	size_t n;
+
+	snprintf( s, sizeof ( s ), "%.2f", d );
+	n = strlen( s );
+	while ( s[n - 1] == '0' && s[n - 2] != '.' )
+		s[--n] = '\0';
+	fputs( s, out );
+}
+
+static int
+compare_long_long( const void *a, const void *b )
+{
+	long long x = *( const long long * ) a, y = *( const long long * ) b;
+
+	return ( x > y ) - ( x < y );
+}
+
+/* The median, a float if it falls between two values */
+static int
+median( value_t * v, long long *i, double *d )
+{
+	size_t n = v->num_values;
+
+	if ( n == 0 )
+		return -1;
+	qsort( v->values, n, sizeof ( long long ), compare_long_long );
+	if ( n % 2 ) {
+		*i = v->values[n / 2];
+		return ITEM_INT;
+	}
+	*d = v->values[n / 2 - 1] / 2.0 + v->values[n / 2] / 2.0;
+	return ITEM_MEDIAN;
+}
+
+static int
+has_total( const value_t * v )
+{
+	int i;
+
+	if ( !strcmp( v->key, "cycles" ) || !strcmp( v->key, "real_time_nsec" ) )
+		return 1;
+	for ( i = 0; i < num_event_defs; i++ )
+		if ( !strcmp( event_defs[i].name, v->key ) )
+			return event_defs[i].total;
+	return 0;
+}
+
+/* An event as summed up: a single value, or total, min, median and max */
+static void
+print_value( FILE * out, int depth, value_t * v, long long region_count )
+{
+	long long i = 0;
+	double d = 0;
+	int first = 1, kind;
+
+	if ( region_count <= 1 ) {
+		fprintf( out, "%lld", v->min );
+		return;
+	}
+	fprintf( out, "{" );
+	if ( has_total( v ) ) {
+		print_key( out, depth + 1, first, "total" );
+		fprintf( out, "%lld", v->sum );
+		first = 0;
+	}
+	print_key( out, depth + 1, first, "min" );
+	fprintf( out, "%lld", v->min );
+	print_key( out, depth + 1, 0, "median" );
+	kind = median( v, &i, &d );
+	if ( kind == ITEM_INT )
+		fprintf( out, "%lld", i );
+	else if ( kind == ITEM_MEDIAN )
+		fprintf( out, "%.1f", d );
+	else
+		fprintf( out, "null" );
+	print_key( out, depth + 1, 0, "max" );
+	fprintf( out, "%lld", v->max );
+	fprintf( out, "\n%*s}", 4 * depth, "" );
+}
+
+static void
+print_items( FILE * out, int depth, const item_t * items, int n,
+			 long long region_count )
+{
+	int i;
+
+	fprintf( out, "{" );
+	for ( i = 0; i < n; i++ ) {
+		print_key( out, depth + 1, i == 0, items[i].key );
+		switch ( items[i].kind ) {
+		case ITEM_INT:
+			fprintf( out, "%lld", items[i].i );
+			break;
+		case ITEM_FLOAT:
+			print_float( out, items[i].d );
+			break;
+		case ITEM_NA:
+			fprintf( out, "\"n/a\"" );
+			break;
+		case ITEM_VALUE:
+			print_value( out, depth + 1, ( value_t * ) items[i].v, region_count );
+			break;
+		}
+	}
+	if ( n )
+		fprintf( out, "\n%*s", 4 * depth, "" );
+	fprintf( out, "}" );
+}
+
+static value_t *
+find_value( region_t * region, const char *key )
+{
+	int i;
+
+	for ( i = 0; i < region->num_values; i++ )
+		if ( !strcmp( region->values[i].key, key ) )
+			return &region->values[i];
+	return NULL;
+}
+
+/* The total of an event over all instances, as used for rates */
+static int
+event_total( const value_t * v, long long region_count, long long *total )
+{
+	if ( region_count <= 1 )
+		*total = v->min;
+	else if ( has_total( v ) )
+		*total = v->sum;
+	else
+		return 0;
+	return 1;
+}
+
+static int
+derive_items( region_t * region, long long region_count, item_t * items,
+			  char *used )
+{
+	value_t *v, *ins, *cyc;
+	long long a, b;
+	double rt = 0;
+	int n = 0, has_rt = 0, i, j;
+
+	items[n].key = "Region count";
+	items[n].kind = ITEM_INT;
+	items[n++].i = region_count;
+
+	if ( ( v = find_value( region, "real_time_nsec" ) ) != NULL ) {
+		used[v - region->values] = 1;
+		items[n].key = "Real time in s";
+		items[n].kind = ITEM_FLOAT;
+		if ( region_count > 1 ) {
+			rt = round2( v->sum / 1.e09 );
+			items[n++].d = round2( v->max / 1.e09 );
+		} else {
+			rt = round2( v->min / 1.e09 );
+			items[n++].d = rt;
+		}
+		has_rt = 1;
+	}
+
+	if ( ( v = find_value( region, "perf::TASK-CLOCK" ) ) != NULL ) {
+		used[v - region->values] = 1;
+		items[n].key = "CPU time in s";
+		if ( event_total( v, region_count, &a ) ) {
+			items[n].kind = ITEM_FLOAT;
+			items[n].d = round2( a / 1.e09 );
+		} else {
+			items[n].kind = ITEM_NA;
+		}
+		n++;
+	}
+
+	ins = find_value( region, "PAPI_TOT_INS" );
+	cyc = find_value( region, "PAPI_TOT_CYC" );
+	if ( ins != NULL && cyc != NULL ) {
+		used[ins - region->values] = 1;
+		used[cyc - region->values] = 1;
+		items[n].key = "IPC";
+		if ( event_total( ins, region_count, &a ) &&
+			 event_total( cyc, region_count, &b ) && b != 0 ) {
+			items[n].kind = ITEM_FLOAT;
+			items[n].d = round2( ( double ) a / ( double ) b );
+		} else {
+			items[n].kind = ITEM_NA;
+		}
+		n++;
+	}
+
+	for ( i = 0; i < num_rates; i++ ) {
+		/* events used for the IPC, or by an earlier rate, are gone */
+		if ( ( v = find_value( region, rates[i].event ) ) == NULL ||
+			 used[v - region->values] )
+			continue;
+		used[v - region->values] = 1;
+		items[n].key = rates[i].metric;
+		if ( has_rt && rt != 0 && event_total( v, region_count, &a ) ) {
+			items[n].kind = ITEM_FLOAT;
+			items[n].d = round2( ( double ) a / 1000000 / rt );
+		} else {
+			items[n].kind = ITEM_NA;
+		}
+		n++;
+	}
+
+	/* the rest as they are, the cycles are left out */
+	for ( j = 0; j < region->num_values; j++ ) {
+		if ( used[j] || !strcmp( region->values[j].key, "cycles" ) )
+			continue;
+		items[n].key = region->values[j].key;
+		items[n].kind = ITEM_VALUE;
+		items[n++].v = &region->values[j];
+	}
+	return n;
+}
+
+static int
+compare_values( const void *a, const void *b )
+{
+	const value_t *x = a, *y = b;
+
+	return ( x->order > y->order ) - ( x->order < y->order );
+}
+
+static int
+compare_regions( const void *a, const void *b )
+{
+	const region_t *x = *( region_t * const * ) a, *y = *( region_t * const * ) b;
+
+	return ( x->order > y->order ) - ( x->order < y->order );
+}
+
+static void
+print_summary( FILE * out, summary_t * sum, int derived )
+{
+	region_t **regions, *region;
+	value_t *count;
+	item_t *items;
+	char *used;
+	long long region_count;
+	size_t i, num_regions = 0;
+	int n, j;
+
+	regions = xmalloc( ( sum->used + 1 ) * sizeof ( region_t * ) );
+	for ( i = 0; i < sum->size; i++ )
+		if ( sum->table[i] != NULL )
+			regions[num_regions++] = sum->table[i];
+	qsort( regions, num_regions, sizeof ( region_t * ), compare_regions );
+
+	fprintf( out, "{" );
+	for ( i = 0; i < num_regions; i++ ) {
+		region = regions[i];
+		qsort( region->values, region->num_values, sizeof ( value_t ),
+			   compare_values );
+		count = find_value( region, "region_count" );
+		region_count = count ? count->sum : 1;
+
+		items = xmalloc( ( region->num_values + num_rates + 8 ) * sizeof ( item_t ) );
+		used = calloc( region->num_values + 1, 1 );
+		if ( used == NULL ) {
+			fprintf( stderr, "Out of memory\n" );
+			exit( 1 );
+		}
+		if ( count != NULL )
+			used[count - region->values] = 1;
+
+		if ( derived ) {
+			n = derive_items( region, region_count, items, used );
+		} else {
+			n = 0;
+			items[n].key = "region_count";
+			items[n].kind = ITEM_INT;
+			items[n++].i = region_count;
+			for ( j = 0; j < region->num_values; j++ ) {
+				if ( used[j] )
+					continue;
+				items[n].key = region->values[j].key;
+				items[n].kind = ITEM_VALUE;
+				items[n++].v = &region->values[j];
+			}
+		}
+		if ( region->ranks > 1 || region->threads > 1 ) {
+			items[n].key = "Number of ranks";
+			items[n].kind = ITEM_INT;
+			items[n++].i = region->ranks;
+			items[n].key = "Number of threads per rank";
+			items[n].kind = ITEM_INT;
+			items[n++].i = region->threads / region->ranks;
+		}
+
+		print_key( out, 1, i == 0, region->name );
+		print_items( out, 1, items, n, region_count );
+		free( items );
+		free( used );
+	}
+	fprintf( out, num_regions ? "\n}\n" : "}\n" );
+	free( regions );
+}
+
+int
+main( int argc, char **argv )
+{
+	worker_t *workers;
+	pthread_t *tids;
+	FILE *out = stdout;
+	const char *output = NULL;
+	int derived = 1, num_threads = 0, failed = 0;
+	int i;
+
+	for ( i = 1; i < argc; i++ ) {
+		if ( !strcmp( argv[i], "-r" ) ) {
+			derived = 0;
+		} else if ( !strcmp( argv[i], "-m" ) && ( i + 1 < argc ) ) {
+			if ( read_rates( argv[++i] ) < 0 )
+				return 1;
+		} else if ( !strcmp( argv[i], "-o" ) && ( i + 1 < argc ) ) {
+			output = argv[++i];
+		} else if ( !strcmp( argv[i], "-t" ) && ( i + 1 < argc ) ) {
+			num_threads = atoi( argv[++i] );
+		} else if ( argv[i][0] == '-' ) {
+			print_help( argv );
+			return strcmp( argv[i], "-h" ) ? 1 : 0;
+		} else if ( add_path( argv[i] ) < 0 ) {
+			return 1;
+		}
+	}
+
+	if ( num_files == 0 ) {
+		fprintf( stderr, "No measurement files given\n" );
+		print_help( argv );
+		return 1;
+	}
+
+	if ( num_threads <= 0 )
+		num_threads = ( int ) sysconf( _SC_NPROCESSORS_ONLN );
+	if ( num_threads > num_files )
+		num_threads = num_files;
+	if ( num_threads <= 0 )
+		num_threads = 1;
+
+	workers = calloc( num_threads, sizeof ( worker_t ) );
+	tids = calloc( num_threads, sizeof ( pthread_t ) );
+	if ( workers == NULL || tids == NULL ) {
+		fprintf( stderr, "Out of memory\n" );
+		return 1;
+	}
+	for ( i = 1; i < num_threads; i++ ) {
+		if ( pthread_create( &tids[i], NULL, worker_main, &workers[i] ) != 0 ) {
+			fprintf( stderr, "Cannot create thread %d\n", i );
+			return 1;
+		}
+	}
+	worker_main( &workers[0] );
+	for ( i = 1; i < num_threads; i++ )
+		pthread_join( tids[i], NULL );
+
+	for ( i = 0; i < num_threads; i++ ) {
+		failed |= workers[i].failed;
+		if ( i > 0 )
+			summary_merge( &workers[0].summary, &workers[i].summary );
+		free( workers[i].entries );
+	}
+	if ( failed )
+		return 1;
+
+	if ( output != NULL && ( out = fopen( output, "w" ) ) == NULL ) {
+		fprintf( stderr, "Cannot create file %s\n", output );
+		return 1;
+	}
+	print_summary( out, &workers[0].summary, derived );
+	if ( out != stdout )
+		fclose( out );
+
+	return 0;
+}